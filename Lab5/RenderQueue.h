@@ -0,0 +1,220 @@
+// Lab5_RenderQueue
+// Очередь отрисовки на 64-битных ключах: каждый draw - ключ (проход, корзина глубины, шейдер, материал, мэш)
+// и полезная нагрузка. Раз в кадр ключи сортируются поразрядно (LSD, 11 бит за проход),
+// затем отрисовки идут по порядку ключей: состояние меняется только когда меняется его поле ключа.
+// Ключ: [63..60] проход | [59..44] глубина | [43..32] шейдер | [31..16] материал | [15..0] мэш.
+// Непрозрачные - грубая корзина глубины спереди назад (внутри корзины группировка по состоянию),
+// прозрачные - полная точность сзади вперёд. Прозрачные упорядочивает TransparentList: список живёт
+// между кадрами и досортировывается вставками от порядка прошлого кадра, в очередь он идёт готовым хвостом.
+// Без WinAPI/D3D: собирается и измеряется на любой платформе (Tests/RenderQueueTest.cpp,
+// Tests/TransparentListTest.cpp).
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+const uint32_t SORT_KEY_PASS_BITS = 4;
+const uint32_t SORT_KEY_DEPTH_BITS = 16;
+const uint32_t SORT_KEY_SHADER_BITS = 12;
+const uint32_t SORT_KEY_MATERIAL_BITS = 16;
+const uint32_t SORT_KEY_MESH_BITS = 16;
+
+const uint32_t SORT_KEY_MESH_SHIFT = 0;
+const uint32_t SORT_KEY_MATERIAL_SHIFT = SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS;
+const uint32_t SORT_KEY_SHADER_SHIFT = SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS;
+const uint32_t SORT_KEY_DEPTH_SHIFT = SORT_KEY_SHADER_SHIFT + SORT_KEY_SHADER_BITS;
+const uint32_t SORT_KEY_PASS_SHIFT = SORT_KEY_DEPTH_SHIFT + SORT_KEY_DEPTH_BITS;
+
+const uint32_t SORT_DEPTH_LEVELS = 1u << SORT_KEY_DEPTH_BITS;
+
+const uint32_t RADIX_DIGIT_BITS = 11;                                       // 6 проходов, гистограммы в L1
+const uint32_t RADIX_DIGITS = 1u << RADIX_DIGIT_BITS;
+const uint32_t RADIX_PASSES = (64 + RADIX_DIGIT_BITS - 1) / RADIX_DIGIT_BITS;
+
+inline uint64_t SortKeyField(uint32_t value, uint32_t bits, uint32_t shift)
+{
+    return (uint64_t)(value & ((1u << bits) - 1)) << shift;
+}
+
+inline uint64_t MakeSortKey(uint32_t pass, uint32_t depth, uint32_t shader, uint32_t material, uint32_t mesh)
+{
+    return SortKeyField(pass, SORT_KEY_PASS_BITS, SORT_KEY_PASS_SHIFT) |
+        SortKeyField(depth, SORT_KEY_DEPTH_BITS, SORT_KEY_DEPTH_SHIFT) |
+        SortKeyField(shader, SORT_KEY_SHADER_BITS, SORT_KEY_SHADER_SHIFT) |
+        SortKeyField(material, SORT_KEY_MATERIAL_BITS, SORT_KEY_MATERIAL_SHIFT) |
+        SortKeyField(mesh, SORT_KEY_MESH_BITS, SORT_KEY_MESH_SHIFT);
+}
+
+inline uint32_t SortKeyPass(uint64_t key)     { return (uint32_t)(key >> SORT_KEY_PASS_SHIFT) & ((1u << SORT_KEY_PASS_BITS) - 1); }
+inline uint32_t SortKeyDepth(uint64_t key)    { return (uint32_t)(key >> SORT_KEY_DEPTH_SHIFT) & ((1u << SORT_KEY_DEPTH_BITS) - 1); }
+inline uint32_t SortKeyShader(uint64_t key)   { return (uint32_t)(key >> SORT_KEY_SHADER_SHIFT) & ((1u << SORT_KEY_SHADER_BITS) - 1); }
+inline uint32_t SortKeyMaterial(uint64_t key) { return (uint32_t)(key >> SORT_KEY_MATERIAL_SHIFT) & ((1u << SORT_KEY_MATERIAL_BITS) - 1); }
+inline uint32_t SortKeyMesh(uint64_t key)     { return (uint32_t)(key >> SORT_KEY_MESH_SHIFT) & ((1u << SORT_KEY_MESH_BITS) - 1); }
+
+// Глубина (расстояние до камеры) -> корзина 0..levels-1, линейно между nearZ и farZ.
+// levels - степень двойки не больше SORT_DEPTH_LEVELS; backToFront - дальние получают меньший номер (для прозрачных).
+inline uint32_t QuantizeDepth(float depth, float nearZ, float farZ, uint32_t levels, bool backToFront)
+{
+    float t = (depth - nearZ) / (farZ - nearZ);
+    t = (std::min)((std::max)(t, 0.0f), 1.0f);
+    uint32_t bucket = (std::min)((uint32_t)(t * levels), levels - 1);
+    uint32_t step = SORT_DEPTH_LEVELS / levels;   // корзина растягивается на всё поле глубины
+    bucket = backToFront ? levels - 1 - bucket : bucket;
+    return bucket * step;
+}
+
+// ------------------------------------------------------------------
+// Поразрядная сортировка пар (ключ, индекс), устойчивая.
+// Гистограммы всех разрядов считаются за один проход; разряд, одинаковый у всех ключей, пропускается.
+// Результат в keys/values, tmpKeys/tmpValues - рабочие буферы того же размера.
+// keyBits - сколько младших бит занимают ключи: старшие разряды не считаются вовсе.
+// ------------------------------------------------------------------
+inline void RadixSortKeys(uint64_t* keys, uint32_t* values, uint64_t* tmpKeys, uint32_t* tmpValues, size_t count, uint32_t keyBits = 64)
+{
+    if (count < 2) return;
+    uint32_t passes = (std::min)((keyBits + RADIX_DIGIT_BITS - 1) / RADIX_DIGIT_BITS, RADIX_PASSES);
+    uint32_t histograms[RADIX_PASSES][RADIX_DIGITS];
+    memset(histograms, 0, passes * sizeof(histograms[0]));
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t k = keys[i];
+        for (uint32_t p = 0; p < passes; ++p) ++histograms[p][(k >> (p * RADIX_DIGIT_BITS)) & (RADIX_DIGITS - 1)];
+    }
+
+    uint64_t* srcKeys = keys; uint32_t* srcValues = values;
+    uint64_t* dstKeys = tmpKeys; uint32_t* dstValues = tmpValues;
+    for (uint32_t p = 0; p < passes; ++p)
+    {
+        uint32_t shift = p * RADIX_DIGIT_BITS;
+        uint32_t* h = histograms[p];
+        if (h[(srcKeys[0] >> shift) & (RADIX_DIGITS - 1)] == count) continue; // все ключи в одной корзине
+
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < RADIX_DIGITS; ++d) { uint32_t n = h[d]; h[d] = offset; offset += n; }
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t k = srcKeys[i];
+            uint32_t slot = h[(k >> shift) & (RADIX_DIGITS - 1)]++;
+            dstKeys[slot] = k;
+            dstValues[slot] = srcValues[i];
+        }
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+    if (srcKeys != keys)
+    {
+        memcpy(keys, srcKeys, count * sizeof(uint64_t));
+        memcpy(values, srcValues, count * sizeof(uint32_t));
+    }
+}
+
+// ------------------------------------------------------------------
+// Очередь кадра: ключи и индексы нагрузок сортируются, нагрузки остаются на месте.
+// Буферы переиспользуются между кадрами - в установившемся режиме без выделений памяти.
+// ------------------------------------------------------------------
+template <typename Payload>
+struct RenderQueue
+{
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;      // после Sort - индексы нагрузок в порядке ключей
+    std::vector<Payload> payloads;
+    std::vector<uint64_t> tmpKeys;
+    std::vector<uint32_t> tmpOrder;
+    size_t orderedFrom = SIZE_MAX;    // начало упорядоченного хвоста
+
+    void Clear() { keys.clear(); order.clear(); payloads.clear(); orderedFrom = SIZE_MAX; }
+
+    // Дальнейшие Push - уже упорядоченные отрисовки (прозрачные из TransparentList).
+    // Sort их не трогает, они остаются в конце, поэтому их проход должен быть последним.
+    void BeginOrderedTail() { orderedFrom = keys.size(); }
+    size_t Size() const { return keys.size(); }
+
+    void Push(uint64_t key, const Payload& payload)
+    {
+        order.push_back((uint32_t)keys.size());
+        keys.push_back(key);
+        payloads.push_back(payload);
+    }
+
+    void Sort()
+    {
+        size_t count = (std::min)(orderedFrom, keys.size());
+        tmpKeys.resize(count);
+        tmpOrder.resize(count);
+        RadixSortKeys(keys.data(), order.data(), tmpKeys.data(), tmpOrder.data(), count);
+    }
+
+    // i-я отрисовка в отсортированном порядке
+    uint64_t Key(size_t i) const { return keys[i]; }
+    const Payload& Get(size_t i) const { return payloads[order[i]]; }
+};
+
+// ------------------------------------------------------------------
+// Постоянный список прозрачных объектов, сортируются пары (ключ, индекс объекта).
+// Ключи пересчитываются в порядке прошлого кадра: камера и объекты движутся плавно, поэтому он почти
+// верен и досортировывается вставками. Вставки ограничены бюджетом сдвигов; не хватило - поразрядная
+// сортировка того, что получилось. Обе устойчивы: объекты с равным ключом сохраняют прошлый порядок
+// и не мерцают. Буферы живут между кадрами - в установившемся режиме без выделений памяти.
+// ------------------------------------------------------------------
+struct TransparentList
+{
+    std::vector<uint32_t> order;     // объекты в порядке отрисовки (после Sort - сзади вперёд)
+    std::vector<uint64_t> keys;      // ключи в порядке order
+    std::vector<uint64_t> tmpKeys;
+    std::vector<uint32_t> tmpOrder;
+    uint32_t keyBits = SORT_KEY_DEPTH_BITS;   // ширина ключа для поразрядной сортировки
+    uint32_t budgetPerObject = 1;             // сдвигов вставки на объект, дальше выгоднее поразрядная
+
+    // Последний Sort
+    uint64_t shifts = 0;
+    bool usedRadix = false;
+
+    // Объекты нумеруются 0..count-1: новые встают в конец порядка, удалённые выпадают,
+    // остальные сохраняют порядок прошлого кадра
+    void Resize(uint32_t count)
+    {
+        if (count == order.size()) return;
+        if (count < order.size())
+            order.erase(std::remove_if(order.begin(), order.end(), [count](uint32_t i) { return i >= count; }), order.end());
+        for (uint32_t i = (uint32_t)order.size(); i < count; ++i) order.push_back(i);
+        keys.resize(count);
+        tmpKeys.resize(count);
+        tmpOrder.resize(count);
+    }
+
+    // key(object) - ключ не шире keyBits, меньший рисуется раньше (для прозрачных - QuantizeDepth(..., true))
+    template <typename KeyFn>
+    void Sort(KeyFn key)
+    {
+        size_t count = order.size();
+        for (size_t i = 0; i < count; ++i) keys[i] = key(order[i]);
+        usedRadix = !InsertionSort((uint64_t)count * budgetPerObject + 64);
+        if (usedRadix)
+            RadixSortKeys(keys.data(), order.data(), tmpKeys.data(), tmpOrder.data(), count, keyBits);
+    }
+
+private:
+    // false - бюджет сдвигов исчерпан, массив частично упорядочен
+    bool InsertionSort(uint64_t budget)
+    {
+        uint64_t* k = keys.data();
+        uint32_t* o = order.data();
+        size_t count = order.size();
+        shifts = 0;
+        for (size_t i = 1; i < count; ++i)
+        {
+            uint64_t key = k[i];
+            if (k[i - 1] <= key) continue;
+            uint32_t object = o[i];
+            size_t j = i;
+            do { k[j] = k[j - 1]; o[j] = o[j - 1]; --j; } while (j > 0 && k[j - 1] > key);
+            k[j] = key;
+            o[j] = object;
+            shifts += i - j;
+            if (shifts > budget) return false;
+        }
+        return true;
+    }
+};
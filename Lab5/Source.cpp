@@ -2,6 +2,7 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <dxgi.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
@@ -10,6 +11,11 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include "ConstantRing.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
+#include "StateFilter.h"
+#include "WeightedOit.h"
 
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3)  \
@@ -121,14 +127,97 @@ struct MaterialBuffer
 {
     XMFLOAT4 color;  // цвет с альфой
 };
-ID3D11Buffer* g_pMaterialBuffer = nullptr;
 
 // Состояния для прозрачных объектов
 ID3D11BlendState* g_pBlendState = nullptr;          // альфа-блендинг
 ID3D11DepthStencilState* g_pDepthStateNoWrite = nullptr; // depth тест без записи
 
+// Weighted blended OIT (клавиша O): прозрачные без сортировки копятся в две цели (WeightedOit.h),
+// затем полноэкранный проход разрешает их поверх кадра
+bool g_UseOit = false;
+ID3D11Texture2D* g_pOitAccumTexture = nullptr;           // RGBA16F
+ID3D11RenderTargetView* g_pOitAccumRTV = nullptr;
+ID3D11ShaderResourceView* g_pOitAccumSRV = nullptr;
+ID3D11Texture2D* g_pOitRevealageTexture = nullptr;       // R8
+ID3D11RenderTargetView* g_pOitRevealageRTV = nullptr;
+ID3D11ShaderResourceView* g_pOitRevealageSRV = nullptr;
+ID3D11BlendState* g_pOitBlendState = nullptr;            // накопление ONE/ONE, revealage ZERO/INV_SRC_COLOR
+ID3D11PixelShader* g_pOitPS = nullptr;
+ID3D11VertexShader* g_pOitResolveVS = nullptr;
+ID3D11PixelShader* g_pOitResolvePS = nullptr;
+
+// Кэш объектов состояния: Create*State идут через него, повторное описание возвращает готовый объект
+struct D3D11StateApi
+{
+    typedef ID3D11Device Device;
+    typedef D3D11_DEPTH_STENCIL_DESC DepthStencilDesc;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef D3D11_RASTERIZER_DESC RasterizerDesc;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef D3D11_BLEND_DESC BlendDesc;
+    typedef ID3D11BlendState BlendState;
+    typedef D3D11_SAMPLER_DESC SamplerDesc;
+    typedef ID3D11SamplerState SamplerState;
+};
+PipelineStateCache<D3D11StateApi> g_StateCache;
+
+// Фильтр привязок: отправка очереди идёт через него, повторные привязки отбрасываются,
+// соседние слоты уходят одним вызовом
+struct D3D11ContextApi
+{
+    typedef ID3D11DeviceContext Context;
+    typedef ID3D11VertexShader VertexShader;
+    typedef ID3D11PixelShader PixelShader;
+    typedef ID3D11InputLayout InputLayout;
+    typedef ID3D11Buffer Buffer;
+    typedef ID3D11ShaderResourceView ShaderResourceView;
+    typedef ID3D11SamplerState SamplerState;
+    typedef ID3D11BlendState BlendState;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef D3D11_PRIMITIVE_TOPOLOGY Topology;
+    typedef DXGI_FORMAT Format;
+    static void VSSetShader(ID3D11DeviceContext* context, ID3D11VertexShader* shader) { context->VSSetShader(shader, nullptr, 0); }
+    static void PSSetShader(ID3D11DeviceContext* context, ID3D11PixelShader* shader) { context->PSSetShader(shader, nullptr, 0); }
+    // Окна кольца констант: только при g_ConstantOffsetting, через g_pDeviceContext1 (ниже)
+    static void VSSetConstantBuffers1(ID3D11DeviceContext* context, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* first, const UINT* num);
+    static void PSSetConstantBuffers1(ID3D11DeviceContext* context, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* first, const UINT* num);
+};
+StateFilter<D3D11ContextApi> g_StateFilter;
+
 void CreateExtraResources();
 
+// ------------------------------------------------------------------
+// Очередь отрисовки: ключ (проход, глубина, шейдер, материал, мэш) + данные отрисовки
+// ------------------------------------------------------------------
+enum { PASS_SKYBOX = 0, PASS_OPAQUE = 1, PASS_TRANSPARENT = 2 };
+enum { SHADER_SKYBOX = 0, SHADER_CUBE = 1, SHADER_CUBE_OIT = 2 };
+enum { MATERIAL_SKYBOX = 0, MATERIAL_BRICK = 1 };
+enum { MESH_SKYBOX = 0, MESH_CUBE = 1 };
+
+struct DrawPacket
+{
+    XMFLOAT4X4 model;
+    XMFLOAT4 color;
+    UINT indexCount;
+};
+RenderQueue<DrawPacket> g_RenderQueue;
+
+// Прозрачные кубы: смещение от центра, скорость вращения вокруг оси Y, цвет.
+// Порядок отрисовки хранит TransparentList и досортировывает его от прошлого кадра.
+struct TransparentCube
+{
+    XMFLOAT3 offset;
+    float spin;
+    XMFLOAT4 color;
+};
+const TransparentCube g_TransparentCubes[] = {
+    { XMFLOAT3(-1.5f, 0.0f, 0.0f), 0.3f, XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f) },   // слева
+    { XMFLOAT3(1.5f, 0.0f, -2.0f), 0.7f, XMFLOAT4(1.0f, 0.5f, 0.5f, 0.5f) },   // справа, дальше
+};
+const UINT TRANSPARENT_CUBE_COUNT = sizeof(g_TransparentCubes) / sizeof(g_TransparentCubes[0]);
+TransparentList g_TransparentList;
+
 // Загрузка DDS файла
 bool LoadDDS(const wchar_t* filename, TextureDesc& desc)
 {
@@ -248,9 +337,43 @@ struct ViewProjBuffer
 {
     XMMATRIX vp;
 };
-ID3D11Buffer* g_pModelBuffer = nullptr;
 ID3D11Buffer* g_pViewProjBuffer = nullptr;
 
+// Кольцо констант отрисовок (матрица модели, материал): Map один раз за кадр, привязка по смещению.
+// Часть кольца, занятая кадром, освобождается, когда сработал event query этого кадра.
+// Без D3D11.1 (нет ID3D11DeviceContext1, ConstantBufferOffsetting или NO_OVERWRITE для константных
+// буферов) кольцо лежит в памяти CPU и только собирает данные кадра, а каждая отрисовка
+// копирует свои куски в маленькие буферы b0/b2 через Map(WRITE_DISCARD).
+const UINT CONSTANT_RING_BYTES = 256 * 1024;
+const UINT FRAMES_IN_FLIGHT = 3;
+ID3D11DeviceContext1* g_pDeviceContext1 = nullptr;
+bool g_ConstantOffsetting = false;
+ID3D11Buffer* g_pConstantRingBuffer = nullptr;
+std::vector<uint8_t> g_ConstantRingCpu;           // кольцо без D3D11.1
+ID3D11Buffer* g_pDrawModelBuffer = nullptr;       // без D3D11.1: b0 отрисовки
+ID3D11Buffer* g_pDrawMaterialBuffer = nullptr;    // без D3D11.1: b2 отрисовки
+ID3D11Query* g_pFrameFences[FRAMES_IN_FLIGHT] = {};
+ConstantRing g_ConstantRing;
+UINT64 g_FrameIndex = 0;        // текущий кадр, с 1
+UINT64 g_CompletedFrame = 0;    // последний кадр, завершённый GPU
+struct DrawConstants
+{
+    ConstantAllocation model, material;
+    bool valid;
+};
+std::vector<DrawConstants> g_DrawConstants;   // по позиции в отсортированной очереди
+
+void D3D11ContextApi::VSSetConstantBuffers1(ID3D11DeviceContext*, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* first, const UINT* num)
+{
+    assert(g_ConstantOffsetting);
+    g_pDeviceContext1->VSSetConstantBuffers1(start, count, buffers, first, num);
+}
+void D3D11ContextApi::PSSetConstantBuffers1(ID3D11DeviceContext*, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* first, const UINT* num)
+{
+    assert(g_ConstantOffsetting);
+    g_pDeviceContext1->PSSetConstantBuffers1(start, count, buffers, first, num);
+}
+
 // Текстурные ресурсы
 ID3D11Texture2D* g_pTexture = nullptr;
 ID3D11ShaderResourceView* g_pTextureView = nullptr;
@@ -346,18 +469,43 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     LoadTextures();
     CreateExtraResources();
 
-    // Константные буферы
+    // Константные буферы: кольцо для данных отрисовок (без D3D11.1 - в памяти CPU и буферы на отрисовку)
+    // и VP на кадр
     D3D11_BUFFER_DESC desc = {};
-    desc.ByteWidth = sizeof(ModelBuffer);
-    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
     desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    HRESULT hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pModelBuffer);
-    assert(SUCCEEDED(hr));
-    SetResourceName(g_pModelBuffer, "ModelBuffer");
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    HRESULT hr;
+    if (g_ConstantOffsetting)
+    {
+        desc.ByteWidth = CONSTANT_RING_BYTES;
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pConstantRingBuffer);
+        assert(SUCCEEDED(hr));
+        SetResourceName(g_pConstantRingBuffer, "ConstantRing");
+    }
+    else
+    {
+        g_ConstantRingCpu.resize(CONSTANT_RING_BYTES);
+        desc.ByteWidth = sizeof(ModelBuffer);
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pDrawModelBuffer);
+        assert(SUCCEEDED(hr));
+        SetResourceName(g_pDrawModelBuffer, "DrawModelBuffer");
+        desc.ByteWidth = sizeof(MaterialBuffer);
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pDrawMaterialBuffer);
+        assert(SUCCEEDED(hr));
+        SetResourceName(g_pDrawMaterialBuffer, "DrawMaterialBuffer");
+    }
+    g_ConstantRing.Init(CONSTANT_RING_BYTES);
+
+    D3D11_QUERY_DESC fenceDesc = {};
+    fenceDesc.Query = D3D11_QUERY_EVENT;
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        hr = g_pDevice->CreateQuery(&fenceDesc, &g_pFrameFences[i]);
+        assert(SUCCEEDED(hr));
+    }
 
     desc.ByteWidth = sizeof(ViewProjBuffer);
-    desc.Usage = D3D11_USAGE_DYNAMIC;
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pViewProjBuffer);
     assert(SUCCEEDED(hr));
     SetResourceName(g_pViewProjBuffer, "ViewProjBuffer");
@@ -405,6 +553,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         if (wParam == VK_RIGHT) g_KeyRight = true;
         if (wParam == VK_UP) g_KeyUp = true;
         if (wParam == VK_DOWN) g_KeyDown = true;
+        if (wParam == 'O')
+        {
+            g_UseOit = !g_UseOit;
+            SetWindowTextW(g_hWnd, g_UseOit ? L"Lab 05 - Texturing (weighted blended OIT)" : L"Lab 05 - Texturing");
+        }
         return 0;
     case WM_KEYUP:
         if (wParam == VK_LEFT) g_KeyLeft = false;
@@ -475,6 +628,18 @@ bool InitDirectX()
         return false;
     }
 
+    // Кольцу констант нужна привязка по смещению и NO_OVERWRITE для константных буферов (D3D11.1),
+    // без них - Map на отрисовку
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (FAILED(g_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+        options = D3D11_FEATURE_DATA_D3D11_OPTIONS();
+    hr = g_pDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&g_pDeviceContext1);
+    g_ConstantOffsetting = SUCCEEDED(hr) && options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+    if (!g_ConstantOffsetting)
+        OutputDebugStringA("Constant buffer offsetting (D3D11.1) is not supported: per-draw Map\n");
+    g_StateFilter.context = g_pDeviceContext;
+    g_StateFilter.Reset();
+
     DXGI_SWAP_CHAIN_DESC scd = {};
     scd.BufferCount = 2;
     scd.BufferDesc.Width = g_ClientWidth;
@@ -738,6 +903,66 @@ void CompileShaders()
         }
     )";
 
+    // ---------------- Weighted blended OIT ----------------
+    // Прозрачный куб: тот же VS, вклад в накопление и revealage вместо смешивания с кадром
+    const char* oitPS = R"(
+        Texture2D colorTexture : register(t0);
+        SamplerState colorSampler : register(s0);
+        cbuffer MaterialBuffer : register(b2)
+        {
+            float4 materialColor;
+        }
+        struct VSOutput
+        {
+            float4 pos : SV_Position;
+            float2 uv : TEXCOORD;
+        };
+        struct OitOutput
+        {
+            float4 accum : SV_Target0;
+            float4 revealage : SV_Target1;
+        };
+        // Как OitWeight в WeightedOit.h
+        float OitWeight(float viewZ, float alpha)
+        {
+            float z = abs(viewZ);
+            float w = 10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0));
+            return alpha * clamp(w, 1e-2, 3e3);
+        }
+        OitOutput ps(VSOutput pixel)
+        {
+            float4 color = colorTexture.Sample(colorSampler, pixel.uv) * materialColor;
+            float w = OitWeight(pixel.pos.w, color.a);   // w в SV_Position - глубина в пространстве камеры
+            OitOutput result;
+            result.accum = float4(color.rgb * color.a, color.a) * w;
+            result.revealage = color.aaaa;
+            return result;
+        }
+    )";
+
+    // Разрешение: полноэкранный треугольник без вершинного буфера
+    const char* oitResolveVS = R"(
+        float4 vs(uint id : SV_VertexID) : SV_Position
+        {
+            float2 uv = float2((id << 1) & 2, id & 2);
+            return float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+        }
+    )";
+
+    const char* oitResolvePS = R"(
+        Texture2D<float4> oitAccum : register(t2);
+        Texture2D<float> oitRevealage : register(t3);
+        float4 ps(float4 pos : SV_Position) : SV_Target0
+        {
+            int3 p = int3(pos.xy, 0);
+            float revealage = oitRevealage.Load(p);
+            if (revealage >= 1.0) discard;   // прозрачных здесь нет
+            float4 accum = oitAccum.Load(p);
+            float3 average = accum.rgb / max(accum.a, 1e-5);
+            return float4(average, 1.0 - revealage);   // смешивается SRC_ALPHA/INV_SRC_ALPHA
+        }
+    )";
+
     UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
 #ifdef _DEBUG
     flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
@@ -795,6 +1020,30 @@ void CompileShaders()
 
 
 
+    SAFE_RELEASE(pVsBlob);
+    SAFE_RELEASE(pPsBlob);
+    SAFE_RELEASE(pErrorBlob);
+
+    // Компиляция шейдеров OIT
+    hr = D3DCompile(oitPS, strlen(oitPS), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
+    if (FAILED(hr)) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); return; }
+    hr = g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pOitPS);
+    if (FAILED(hr)) { OutputDebugStringA("CreatePixelShader failed\n"); return; }
+    SetResourceName(g_pOitPS, "OitPS");
+    SAFE_RELEASE(pPsBlob);
+
+    hr = D3DCompile(oitResolveVS, strlen(oitResolveVS), nullptr, nullptr, nullptr, "vs", "vs_5_0", flags, 0, &pVsBlob, &pErrorBlob);
+    if (FAILED(hr)) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); return; }
+    hr = g_pDevice->CreateVertexShader(pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), nullptr, &g_pOitResolveVS);
+    if (FAILED(hr)) { OutputDebugStringA("CreateVertexShader failed\n"); return; }
+    SetResourceName(g_pOitResolveVS, "OitResolveVS");
+
+    hr = D3DCompile(oitResolvePS, strlen(oitResolvePS), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
+    if (FAILED(hr)) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); return; }
+    hr = g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pOitResolvePS);
+    if (FAILED(hr)) { OutputDebugStringA("CreatePixelShader failed\n"); return; }
+    SetResourceName(g_pOitResolvePS, "OitResolvePS");
+
     SAFE_RELEASE(pVsBlob);
     SAFE_RELEASE(pPsBlob);
     SAFE_RELEASE(pErrorBlob);
@@ -906,7 +1155,7 @@ void LoadTextures()
     sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
     sampDesc.BorderColor[0] = sampDesc.BorderColor[1] = sampDesc.BorderColor[2] = sampDesc.BorderColor[3] = 1.0f;
 
-    hr = g_pDevice->CreateSamplerState(&sampDesc, &g_pSampler);
+    g_pSampler = g_StateCache.Sampler(g_pDevice, sampDesc);
 
     //if (FAILED(hr) || !g_pSampler)
     //{
@@ -1029,22 +1278,57 @@ void LoadTextures()
 
 
 // ------------------------------------------------------------------
-// Создание дополнительных ресурсов для лабораторной 8
+// Цели OIT: размер окна, пересоздаются в OnResize
 // ------------------------------------------------------------------
-void CreateExtraResources()
+void ReleaseOitTargets()
 {
-    HRESULT hr;
+    SAFE_RELEASE(g_pOitAccumSRV);
+    SAFE_RELEASE(g_pOitAccumRTV);
+    SAFE_RELEASE(g_pOitAccumTexture);
+    SAFE_RELEASE(g_pOitRevealageSRV);
+    SAFE_RELEASE(g_pOitRevealageRTV);
+    SAFE_RELEASE(g_pOitRevealageTexture);
+}
 
-    // Создание буфера для материала
-    D3D11_BUFFER_DESC matDesc = {};
-    matDesc.ByteWidth = sizeof(MaterialBuffer);
-    matDesc.Usage = D3D11_USAGE_DYNAMIC;
-    matDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    matDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-    hr = g_pDevice->CreateBuffer(&matDesc, nullptr, &g_pMaterialBuffer);
-    assert(SUCCEEDED(hr));
-    SetResourceName(g_pMaterialBuffer, "MaterialBuffer");
+bool CreateOitTarget(UINT width, UINT height, DXGI_FORMAT format, const char* name,
+    ID3D11Texture2D** texture, ID3D11RenderTargetView** rtv, ID3D11ShaderResourceView** srv)
+{
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    HRESULT hr = g_pDevice->CreateTexture2D(&desc, nullptr, texture);
+    if (FAILED(hr)) return false;
+    SetResourceName(*texture, name);
+    hr = g_pDevice->CreateRenderTargetView(*texture, nullptr, rtv);
+    if (FAILED(hr)) return false;
+    hr = g_pDevice->CreateShaderResourceView(*texture, nullptr, srv);
+    return SUCCEEDED(hr);
+}
 
+bool CreateOitTargets(UINT width, UINT height)
+{
+    ReleaseOitTargets();
+    if (!CreateOitTarget(width, height, DXGI_FORMAT_R16G16B16A16_FLOAT, "OitAccum", &g_pOitAccumTexture, &g_pOitAccumRTV, &g_pOitAccumSRV) ||
+        !CreateOitTarget(width, height, DXGI_FORMAT_R8_UNORM, "OitRevealage", &g_pOitRevealageTexture, &g_pOitRevealageRTV, &g_pOitRevealageSRV))
+    {
+        OutputDebugStringA("CreateOitTargets failed\n");
+        ReleaseOitTargets();
+        return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------------
+// Создание дополнительных ресурсов для лабораторной 8
+// ------------------------------------------------------------------
+void CreateExtraResources()
+{
     // Создание blend state для прозрачности
     D3D11_BLEND_DESC blendDesc = {};
     blendDesc.AlphaToCoverageEnable = FALSE;
@@ -1057,8 +1341,8 @@ void CreateExtraResources()
     blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
     blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
     blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-    hr = g_pDevice->CreateBlendState(&blendDesc, &g_pBlendState);
-    assert(SUCCEEDED(hr));
+    g_pBlendState = g_StateCache.Blend(g_pDevice, blendDesc);
+    assert(g_pBlendState);
     SetResourceName(g_pBlendState, "BlendState");
 
     // Создание depth state без записи глубины
@@ -1067,9 +1351,79 @@ void CreateExtraResources()
     dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
     dsDesc.DepthFunc = D3D11_COMPARISON_LESS;
     dsDesc.StencilEnable = FALSE;
-    hr = g_pDevice->CreateDepthStencilState(&dsDesc, &g_pDepthStateNoWrite);
-    assert(SUCCEEDED(hr));
+    g_pDepthStateNoWrite = g_StateCache.DepthStencil(g_pDevice, dsDesc);
+    assert(g_pDepthStateNoWrite);
     SetResourceName(g_pDepthStateNoWrite, "DepthStateNoWrite");
+
+    // OIT: накопление складывается, revealage умножается на 1 - alpha
+    D3D11_BLEND_DESC oitDesc = {};
+    oitDesc.IndependentBlendEnable = TRUE;
+    D3D11_RENDER_TARGET_BLEND_DESC& accum = oitDesc.RenderTarget[0];
+    accum.BlendEnable = TRUE;
+    accum.SrcBlend = accum.DestBlend = D3D11_BLEND_ONE;
+    accum.SrcBlendAlpha = accum.DestBlendAlpha = D3D11_BLEND_ONE;
+    accum.BlendOp = accum.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+    accum.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    D3D11_RENDER_TARGET_BLEND_DESC& revealage = oitDesc.RenderTarget[1];
+    revealage.BlendEnable = TRUE;
+    revealage.SrcBlend = revealage.SrcBlendAlpha = D3D11_BLEND_ZERO;
+    revealage.DestBlend = revealage.DestBlendAlpha = D3D11_BLEND_INV_SRC_COLOR;
+    revealage.BlendOp = revealage.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+    revealage.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED;
+    g_pOitBlendState = g_StateCache.Blend(g_pDevice, oitDesc);
+    assert(g_pOitBlendState);
+    SetResourceName(g_pOitBlendState, "OitBlendState");
+
+    CreateOitTargets(g_ClientWidth, g_ClientHeight);
+}
+
+// ------------------------------------------------------------------
+// Кольцо констант: начало кадра - ожидание заборов и Map, конец - забор кадра
+// ------------------------------------------------------------------
+
+void BeginConstantFrame()
+{
+    ++g_FrameIndex;
+    // Event query кадра отвечает TRUE, когда GPU дошёл до его End.
+    // Запрос кадра g_FrameIndex - FRAMES_IN_FLIGHT переиспользуется сейчас, его ждём обязательно.
+    while (g_CompletedFrame + 1 < g_FrameIndex)
+    {
+        UINT64 next = g_CompletedFrame + 1;
+        bool mustWait = next + FRAMES_IN_FLIGHT <= g_FrameIndex;
+        BOOL done = FALSE;
+        HRESULT hr = g_pDeviceContext->GetData(g_pFrameFences[next % FRAMES_IN_FLIGHT], &done, sizeof(done), mustWait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        if (FAILED(hr) || (hr == S_OK && done)) { g_CompletedFrame = next; continue; }   // ошибка устройства - не зависаем
+        if (!mustWait) break;
+    }
+
+    // Кольцо в памяти CPU GPU не читает: прошлые кадры освобождаются сразу
+    if (!g_ConstantOffsetting)
+    {
+        g_ConstantRing.BeginFrame(g_FrameIndex, g_FrameIndex - 1, g_ConstantRingCpu.data());
+        return;
+    }
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    D3D11_MAP mapType = g_ConstantRing.NeedsDiscard() ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (FAILED(g_pDeviceContext->Map(g_pConstantRingBuffer, 0, mapType, 0, &mapped)))
+        mapped.pData = nullptr;
+    g_ConstantRing.BeginFrame(g_FrameIndex, g_CompletedFrame, mapped.pData);
+}
+
+// Без D3D11.1: кусок кольца копируется в буфер отрисовки
+bool UploadDrawConstants(ID3D11Buffer* buffer, const ConstantAllocation& allocation, UINT bytes)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(g_pDeviceContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+        return false;
+    memcpy(mapped.pData, allocation.data, bytes);
+    g_pDeviceContext->Unmap(buffer, 0);
+    return true;
+}
+
+void EndConstantFrame()
+{
+    g_pDeviceContext->End(g_pFrameFences[g_FrameIndex % FRAMES_IN_FLIGHT]);
+    g_ConstantRing.EndFrame();
 }
 
 // ------------------------------------------------------------------
@@ -1103,7 +1457,7 @@ void RenderFrame()
     UpdateCamera(deltaTime);
 
     // Очистка back buffer и depth buffer
-    g_pDeviceContext->ClearState();
+    g_StateFilter.ClearState();
     ID3D11RenderTargetView* views[] = { g_pBackBufferRTV };
     g_pDeviceContext->OMSetRenderTargets(1, views, g_pDepthStencilView);
 
@@ -1127,159 +1481,225 @@ void RenderFrame()
     XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PI / 3, aspect, 0.1f, 100.0f);
     XMMATRIX vp = XMMatrixMultiply(view, proj);
 
-    // Установка сэмплера
+    // Установка сэмплера (слоты 0 и 1 фильтр отправит одним вызовом)
     ID3D11SamplerState* samplers[] = { g_pSampler };
-    g_pDeviceContext->PSSetSamplers(0, 1, samplers);
-    g_pDeviceContext->PSSetSamplers(1, 1, samplers);
+    g_StateFilter.PSSetSamplers(0, 1, samplers);
+    g_StateFilter.PSSetSamplers(1, 1, samplers);
 
-    // --- Рисуем skybox  ---
     XMMATRIX viewNoTranslate = view;
     viewNoTranslate.r[3] = XMVectorSet(0, 0, 0, 1);
     XMMATRIX vpSky = XMMatrixMultiply(viewNoTranslate, proj);
 
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    HRESULT hr = g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    if (SUCCEEDED(hr))
+    // --- Заполнение очереди: skybox, непрозрачный куб, прозрачные кубы ---
+    g_RenderQueue.Clear();
+    DrawPacket packet = {};
+    packet.indexCount = 36;
+    XMStoreFloat4x4(&packet.model, XMMatrixIdentity());
+    packet.color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    g_RenderQueue.Push(MakeSortKey(PASS_SKYBOX, 0, SHADER_SKYBOX, MATERIAL_SKYBOX, MESH_SKYBOX), packet);
+
+    // Непрозрачные - спереди назад по грубым корзинам, внутри корзины по состоянию
+    XMMATRIX modelOpaque = XMMatrixRotationY((float)currentTime * 0.5f);
+    float distOpaque = XMVectorGetX(XMVector3Length(modelOpaque.r[3] - eye));
+    XMStoreFloat4x4(&packet.model, modelOpaque);
+    g_RenderQueue.Push(MakeSortKey(PASS_OPAQUE, QuantizeDepth(distOpaque, 0.1f, 100.0f, 16, false), SHADER_CUBE, MATERIAL_BRICK, MESH_CUBE), packet);
+
+    // Прозрачные - сзади вперёд с полной точностью глубины: сортируется постоянный список пар
+    // (глубина, индекс куба), в очередь он идёт готовым хвостом
+    XMMATRIX modelTrans[TRANSPARENT_CUBE_COUNT];
+    float distTrans[TRANSPARENT_CUBE_COUNT];
+    for (UINT i = 0; i < TRANSPARENT_CUBE_COUNT; ++i)
     {
-        ViewProjBuffer* pVP = (ViewProjBuffer*)mapped.pData;
-        XMStoreFloat4x4((XMFLOAT4X4*)&pVP->vp, XMMatrixTranspose(vpSky));
-        g_pDeviceContext->Unmap(g_pViewProjBuffer, 0);
+        const TransparentCube& cube = g_TransparentCubes[i];
+        modelTrans[i] = XMMatrixTranslation(cube.offset.x, cube.offset.y, cube.offset.z) * XMMatrixRotationY((float)currentTime * cube.spin);
+        distTrans[i] = XMVectorGetX(XMVector3Length(modelTrans[i].r[3] - eye));
     }
-
-    // Настройка состояния для skybox
-    D3D11_DEPTH_STENCIL_DESC dsDescSky = {};
-    dsDescSky.DepthEnable = TRUE;
-    dsDescSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-    dsDescSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-    ID3D11DepthStencilState* pDSSky = nullptr;
-    g_pDevice->CreateDepthStencilState(&dsDescSky, &pDSSky);
-    g_pDeviceContext->OMSetDepthStencilState(pDSSky, 0);
-
-    D3D11_RASTERIZER_DESC rsDescSky = {};
-    rsDescSky.FillMode = D3D11_FILL_SOLID;
-    rsDescSky.CullMode = D3D11_CULL_NONE;
-    ID3D11RasterizerState* pRSSky = nullptr;
-    g_pDevice->CreateRasterizerState(&rsDescSky, &pRSSky);
-    g_pDeviceContext->RSSetState(pRSSky);
-
-    g_pDeviceContext->VSSetShader(g_pSkyboxVS, nullptr, 0);
-    g_pDeviceContext->PSSetShader(g_pSkyboxPS, nullptr, 0);
-    g_pDeviceContext->IASetInputLayout(g_pSkyboxInputLayout);
-    UINT stride = sizeof(TextureVertex);
-    UINT offset = 0;
-    ID3D11Buffer* vbSky[] = { g_pSkyboxVertexBuffer };
-    g_pDeviceContext->IASetVertexBuffers(0, 1, vbSky, &stride, &offset);
-    g_pDeviceContext->IASetIndexBuffer(g_pSkyboxIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    g_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    ID3D11ShaderResourceView* skySRV[] = { g_pCubemapView };
-    g_pDeviceContext->PSSetShaderResources(1, 1, skySRV);
-    ID3D11Buffer* cbsSky[] = { nullptr, g_pViewProjBuffer };
-    g_pDeviceContext->VSSetConstantBuffers(0, 2, cbsSky);
-    g_pDeviceContext->DrawIndexed(36, 0, 0);
-
-    SAFE_RELEASE(pRSSky);
-    SAFE_RELEASE(pDSSky);
-
-    g_pDeviceContext->OMSetDepthStencilState(nullptr, 0);
-    hr = g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-
-    // --- Обновляем буфер VP для основных объектов (с трансляцией) ---
-    hr = g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-    if (SUCCEEDED(hr))
+    // С OIT порядок не важен: кубы идут как есть, сортировки нет
+    g_RenderQueue.BeginOrderedTail();
+    bool oit = g_UseOit && g_pOitPS && g_pOitResolvePS && g_pOitAccumRTV;
+    if (oit)
     {
-        ViewProjBuffer* pVP = (ViewProjBuffer*)mapped.pData;
-        XMStoreFloat4x4((XMFLOAT4X4*)&pVP->vp, XMMatrixTranspose(vp));
-        g_pDeviceContext->Unmap(g_pViewProjBuffer, 0);
+        for (UINT i = 0; i < TRANSPARENT_CUBE_COUNT; ++i)
+        {
+            XMStoreFloat4x4(&packet.model, modelTrans[i]);
+            packet.color = g_TransparentCubes[i].color;
+            g_RenderQueue.Push(MakeSortKey(PASS_TRANSPARENT, 0, SHADER_CUBE_OIT, MATERIAL_BRICK, MESH_CUBE), packet);
+        }
     }
-
-    // --- Непрозрачный куб (обычный, с текстурой) ---
-    XMMATRIX modelOpaque = XMMatrixRotationY((float)currentTime * 0.5f);
-    ModelBuffer modelData;
-    XMStoreFloat4x4((XMFLOAT4X4*)&modelData.model, XMMatrixTranspose(modelOpaque));
-    g_pDeviceContext->UpdateSubresource(g_pModelBuffer, 0, nullptr, &modelData, 0, 0);
-
-    // Материал для непрозрачного (альфа = 1)
-    D3D11_MAPPED_SUBRESOURCE mappedMat;
-    hr = g_pDeviceContext->Map(g_pMaterialBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedMat);
-    if (SUCCEEDED(hr))
+    else
     {
-        MaterialBuffer* pMat = (MaterialBuffer*)mappedMat.pData;
-        pMat->color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-        g_pDeviceContext->Unmap(g_pMaterialBuffer, 0);
+        g_TransparentList.Resize(TRANSPARENT_CUBE_COUNT);
+        g_TransparentList.Sort([&distTrans](uint32_t i) { return QuantizeDepth(distTrans[i], 0.1f, 100.0f, SORT_DEPTH_LEVELS, true); });
+        for (size_t n = 0; n < g_TransparentList.order.size(); ++n)
+        {
+            UINT i = g_TransparentList.order[n];
+            XMStoreFloat4x4(&packet.model, modelTrans[i]);
+            packet.color = g_TransparentCubes[i].color;
+            g_RenderQueue.Push(MakeSortKey(PASS_TRANSPARENT, (uint32_t)g_TransparentList.keys[n], SHADER_CUBE, MATERIAL_BRICK, MESH_CUBE), packet);
+        }
     }
+    g_RenderQueue.Sort();
 
-    // Устанавливаем шейдеры и буферы для куба
-    g_pDeviceContext->VSSetShader(g_pVertexShader, nullptr, 0);
-    g_pDeviceContext->PSSetShader(g_pPixelShader, nullptr, 0);
-    g_pDeviceContext->IASetInputLayout(g_pInputLayout);
-    ID3D11Buffer* vbCube[] = { g_pVertexBuffer };
-    g_pDeviceContext->IASetVertexBuffers(0, 1, vbCube, &stride, &offset);
-    g_pDeviceContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-
-    ID3D11Buffer* cbsOpaque[] = { g_pModelBuffer, g_pViewProjBuffer, g_pMaterialBuffer };
-    g_pDeviceContext->VSSetConstantBuffers(0, 3, cbsOpaque);
-    g_pDeviceContext->PSSetConstantBuffers(2, 1, &g_pMaterialBuffer);
-
-    ID3D11ShaderResourceView* cubeSRV[] = { g_pTextureView };
-    g_pDeviceContext->PSSetShaderResources(0, 1, cubeSRV);
-
-    g_pDeviceContext->DrawIndexed(36, 0, 0);
-
-    // --- Прозрачные объекты (2 куба с альфой 0.5) ---
-    // Создаём список для сортировки
-    struct TransparentObject
+    // --- Константы отрисовок: кольцо отображается один раз, каждая отрисовка получает свои куски ---
+    BeginConstantFrame();
+    g_DrawConstants.resize(g_RenderQueue.Size());
+    for (size_t i = 0; i < g_RenderQueue.Size(); ++i)
     {
-        XMMATRIX model;
-        XMFLOAT4 color;
-        float distance;
-    };
-    std::vector<TransparentObject> transparentObjects;
-
-    // Первый прозрачный куб (слева)
-    XMMATRIX modelTrans1 = XMMatrixTranslation(-1.5f, 0.0f, 0.0f) * XMMatrixRotationY((float)currentTime * 0.3f);
-    XMVECTOR pos1 = modelTrans1.r[3];
-    float dist1 = XMVectorGetX(XMVector3Length(pos1 - eye));
+        DrawConstants& dc = g_DrawConstants[i];
+        dc.valid = false;
+        if (SortKeyPass(g_RenderQueue.Key(i)) == PASS_SKYBOX) continue;   // skybox их не использует
+        if (!g_ConstantRing.Allocate(sizeof(ModelBuffer), dc.model) || !g_ConstantRing.Allocate(sizeof(MaterialBuffer), dc.material))
+            continue;
+        const DrawPacket& draw = g_RenderQueue.Get(i);
+        XMStoreFloat4x4((XMFLOAT4X4*)dc.model.data, XMMatrixTranspose(XMLoadFloat4x4(&draw.model)));
+        ((MaterialBuffer*)dc.material.data)->color = draw.color;
+        dc.valid = true;
+    }
+    if (g_ConstantRing.mapped && g_ConstantOffsetting)
+        g_pDeviceContext->Unmap(g_pConstantRingBuffer, 0);
 
-    // Второй прозрачный куб (справа, дальше)
-    XMMATRIX modelTrans2 = XMMatrixTranslation(1.5f, 0.0f, -2.0f) * XMMatrixRotationY((float)currentTime * 0.7f);
-    XMVECTOR pos2 = modelTrans2.r[3];
-    float dist2 = XMVectorGetX(XMVector3Length(pos2 - eye));
+    // --- Отправка в порядке ключей: состояние ставится, только когда меняется его поле ---
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr;
+    UINT stride = sizeof(TextureVertex);
+    UINT offset = 0;
+    for (size_t i = 0; i < g_RenderQueue.Size(); ++i)
+    {
+        uint64_t key = g_RenderQueue.Key(i);
+        uint64_t prev = i ? g_RenderQueue.Key(i - 1) : ~0ull;
+        const DrawPacket& draw = g_RenderQueue.Get(i);
+        UINT pass = SortKeyPass(key);
 
-    transparentObjects.push_back({ modelTrans1, XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f), dist1 });
-    transparentObjects.push_back({ modelTrans2, XMFLOAT4(1.0f, 0.5f, 0.5f, 0.5f), dist2 });
+        if (pass != SortKeyPass(prev))
+        {
+            // Буфер VP: для skybox без трансляции камеры
+            hr = g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+            if (SUCCEEDED(hr))
+            {
+                ViewProjBuffer* pVP = (ViewProjBuffer*)mapped.pData;
+                XMStoreFloat4x4((XMFLOAT4X4*)&pVP->vp, XMMatrixTranspose(pass == PASS_SKYBOX ? vpSky : vp));
+                g_pDeviceContext->Unmap(g_pViewProjBuffer, 0);
+            }
+
+            if (pass == PASS_SKYBOX)
+            {
+                // Настройка состояния для skybox
+                D3D11_DEPTH_STENCIL_DESC dsDescSky = {};
+                dsDescSky.DepthEnable = TRUE;
+                dsDescSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+                dsDescSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+                g_StateFilter.OMSetDepthStencilState(g_StateCache.DepthStencil(g_pDevice, dsDescSky), 0);
+
+                D3D11_RASTERIZER_DESC rsDescSky = {};
+                rsDescSky.FillMode = D3D11_FILL_SOLID;
+                rsDescSky.CullMode = D3D11_CULL_NONE;
+                g_StateFilter.RSSetState(g_StateCache.Rasterizer(g_pDevice, rsDescSky));
+            }
+            else if (pass == PASS_OPAQUE)
+            {
+                g_StateFilter.OMSetDepthStencilState(nullptr, 0);
+                g_StateFilter.RSSetState(nullptr);
+            }
+            else if (oit)
+            {
+                // OIT: цели накопления с глубиной кадра, depth тест без записи
+                ID3D11RenderTargetView* oitViews[] = { g_pOitAccumRTV, g_pOitRevealageRTV };
+                g_pDeviceContext->OMSetRenderTargets(2, oitViews, g_pDepthStencilView);
+                const FLOAT accumClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                const FLOAT revealageClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+                g_pDeviceContext->ClearRenderTargetView(g_pOitAccumRTV, accumClear);
+                g_pDeviceContext->ClearRenderTargetView(g_pOitRevealageRTV, revealageClear);
+                g_StateFilter.OMSetBlendState(g_pOitBlendState, nullptr, 0xFFFFFFFF);
+                g_StateFilter.OMSetDepthStencilState(g_pDepthStateNoWrite, 0);
+                g_StateFilter.RSSetState(nullptr);
+            }
+            else
+            {
+                // Прозрачные: альфа-блендинг, depth тест без записи
+                g_StateFilter.OMSetBlendState(g_pBlendState, nullptr, 0xFFFFFFFF);
+                g_StateFilter.OMSetDepthStencilState(g_pDepthStateNoWrite, 0);
+                g_StateFilter.RSSetState(nullptr);
+            }
+        }
 
-    // Сортируем от дальнего к ближнему
-    std::sort(transparentObjects.begin(), transparentObjects.end(),
-        [](const TransparentObject& a, const TransparentObject& b) {
-            return a.distance > b.distance;
-        });
+        if (SortKeyShader(key) != SortKeyShader(prev))
+        {
+            if (SortKeyShader(key) == SHADER_SKYBOX)
+            {
+                g_StateFilter.VSSetShader(g_pSkyboxVS);
+                g_StateFilter.PSSetShader(g_pSkyboxPS);
+                g_StateFilter.IASetInputLayout(g_pSkyboxInputLayout);
+                ID3D11Buffer* cbsSky[] = { nullptr, g_pViewProjBuffer };
+                g_StateFilter.VSSetConstantBuffers(0, 2, cbsSky);
+            }
+            else
+            {
+                g_StateFilter.VSSetShader(g_pVertexShader);
+                g_StateFilter.PSSetShader(SortKeyShader(key) == SHADER_CUBE_OIT ? g_pOitPS : g_pPixelShader);
+                g_StateFilter.IASetInputLayout(g_pInputLayout);
+                g_StateFilter.VSSetConstantBuffers(1, 1, &g_pViewProjBuffer);
+            }
+            g_StateFilter.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        }
 
-    // Устанавливаем состояния для прозрачных объектов
-    g_pDeviceContext->OMSetBlendState(g_pBlendState, nullptr, 0xFFFFFFFF);
-    g_pDeviceContext->OMSetDepthStencilState(g_pDepthStateNoWrite, 0);
+        if (SortKeyMaterial(key) != SortKeyMaterial(prev))
+        {
+            if (SortKeyMaterial(key) == MATERIAL_SKYBOX)
+                g_StateFilter.PSSetShaderResources(1, 1, &g_pCubemapView);
+            else
+                g_StateFilter.PSSetShaderResources(0, 1, &g_pTextureView);
+        }
 
-    // Рисуем прозрачные объекты в отсортированном порядке
-    for (const auto& obj : transparentObjects)
-    {
-        // Обновляем матрицу модели
-        XMStoreFloat4x4((XMFLOAT4X4*)&modelData.model, XMMatrixTranspose(obj.model));
-        g_pDeviceContext->UpdateSubresource(g_pModelBuffer, 0, nullptr, &modelData, 0, 0);
+        if (SortKeyMesh(key) != SortKeyMesh(prev))
+        {
+            ID3D11Buffer* vb = SortKeyMesh(key) == MESH_SKYBOX ? g_pSkyboxVertexBuffer : g_pVertexBuffer;
+            g_StateFilter.IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+            g_StateFilter.IASetIndexBuffer(SortKeyMesh(key) == MESH_SKYBOX ? g_pSkyboxIndexBuffer : g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+        }
 
-        // Обновляем цвет материала
-        hr = g_pDeviceContext->Map(g_pMaterialBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedMat);
-        if (SUCCEEDED(hr))
+        // Данные отрисовки: матрица модели (b0) и цвет материала (b2) - окна кольца или копии в буферы отрисовки
+        if (pass != PASS_SKYBOX)
         {
-            MaterialBuffer* pMat = (MaterialBuffer*)mappedMat.pData;
-            pMat->color = obj.color;
-            g_pDeviceContext->Unmap(g_pMaterialBuffer, 0);
+            const DrawConstants& dc = g_DrawConstants[i];
+            if (!dc.valid) continue;   // кольцо переполнено
+            if (g_ConstantOffsetting)
+            {
+                UINT first = dc.model.FirstConstant(), num = dc.model.NumConstants();
+                g_StateFilter.VSSetConstantBuffers1(0, 1, &g_pConstantRingBuffer, &first, &num);
+                first = dc.material.FirstConstant(); num = dc.material.NumConstants();
+                g_StateFilter.PSSetConstantBuffers1(2, 1, &g_pConstantRingBuffer, &first, &num);
+            }
+            else
+            {
+                if (!UploadDrawConstants(g_pDrawModelBuffer, dc.model, sizeof(ModelBuffer)) ||
+                    !UploadDrawConstants(g_pDrawMaterialBuffer, dc.material, sizeof(MaterialBuffer)))
+                    continue;
+                g_StateFilter.VSSetConstantBuffers(0, 1, &g_pDrawModelBuffer);
+                g_StateFilter.PSSetConstantBuffers(2, 1, &g_pDrawMaterialBuffer);
+            }
         }
 
-        g_pDeviceContext->DrawIndexed(36, 0, 0);
+        g_StateFilter.DrawIndexed(draw.indexCount, 0, 0);
+    }
+
+    // Разрешение OIT поверх кадра: цели накопления уходят с OM раньше, чем фильтр привяжет их как SRV
+    if (oit)
+    {
+        g_pDeviceContext->OMSetRenderTargets(1, &g_pBackBufferRTV, nullptr);
+        g_StateFilter.IASetInputLayout(nullptr);
+        g_StateFilter.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        g_StateFilter.VSSetShader(g_pOitResolveVS);
+        g_StateFilter.PSSetShader(g_pOitResolvePS);
+        ID3D11ShaderResourceView* oitSRVs[] = { g_pOitAccumSRV, g_pOitRevealageSRV };
+        g_StateFilter.PSSetShaderResources(2, 2, oitSRVs);
+        g_StateFilter.OMSetBlendState(g_pBlendState, nullptr, 0xFFFFFFFF);
+        g_StateFilter.OMSetDepthStencilState(nullptr, 0);
+        g_StateFilter.RSSetState(nullptr);
+        g_StateFilter.Draw(3, 0);
     }
+    EndConstantFrame();
 
-    // Возвращаем стандартные состояния
-    g_pDeviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-    g_pDeviceContext->OMSetDepthStencilState(nullptr, 0);
+    // Стандартные состояния вернёт ClearState в начале следующего кадра
 
     g_pSwapChain->Present(1, 0);
 }
@@ -1331,6 +1751,7 @@ void OnResize(UINT newWidth, UINT newHeight)
     pDepthStencil->Release();
     if (FAILED(hr)) { OutputDebugStringA("CreateDepthStencilView failed\n"); return; }
     // ============================================================
+    CreateOitTargets(newWidth, newHeight);
 
     g_ClientWidth = newWidth;
     g_ClientHeight = newHeight;
@@ -1345,17 +1766,36 @@ void CleanupDirectX()
     if (g_pDeviceContext)
         g_pDeviceContext->ClearState();
 
-    SAFE_RELEASE(g_pMaterialBuffer);
-    SAFE_RELEASE(g_pBlendState);
-    SAFE_RELEASE(g_pDepthStateNoWrite);
+    SAFE_RELEASE(g_pConstantRingBuffer);
+    SAFE_RELEASE(g_pDrawModelBuffer);
+    SAFE_RELEASE(g_pDrawMaterialBuffer);
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i) SAFE_RELEASE(g_pFrameFences[i]);
+    char ringMsg[128];
+    sprintf_s(ringMsg, "Constant ring: %llu frames, %llu failed allocations\n", g_FrameIndex, g_ConstantRing.failed);
+    OutputDebugStringA(ringMsg);
+    // Объекты состояния принадлежат кэшу
+    StateCacheStats stateStats = g_StateCache.Stats();
+    char stateMsg[128];
+    sprintf_s(stateMsg, "State cache: %llu hits, %llu misses, %u objects\n", stateStats.hits, stateStats.misses, (unsigned)g_StateCache.Size());
+    OutputDebugStringA(stateMsg);
+    g_StateCache.Clear();
+    char filterMsg[128];
+    sprintf_s(filterMsg, "State filter: %llu of %llu binds elided\n", g_StateFilter.stats.Elided(), g_StateFilter.stats.requested);
+    OutputDebugStringA(filterMsg);
+    g_pBlendState = nullptr;
+    g_pDepthStateNoWrite = nullptr;
+    g_pOitBlendState = nullptr;
+    ReleaseOitTargets();
+    SAFE_RELEASE(g_pOitPS);
+    SAFE_RELEASE(g_pOitResolveVS);
+    SAFE_RELEASE(g_pOitResolvePS);
+    g_pSampler = nullptr;
 
-    SAFE_RELEASE(g_pSampler);
     SAFE_RELEASE(g_pTextureView);
     SAFE_RELEASE(g_pTexture);
     SAFE_RELEASE(g_pCubemapView);
     SAFE_RELEASE(g_pCubemapTexture);
 
-    SAFE_RELEASE(g_pModelBuffer);
     SAFE_RELEASE(g_pViewProjBuffer);
     SAFE_RELEASE(g_pInputLayout);
     SAFE_RELEASE(g_pVertexShader);
@@ -1383,6 +1823,7 @@ void CleanupDirectX()
     }
 #endif
 
+    SAFE_RELEASE(g_pDeviceContext1);
     SAFE_RELEASE(g_pDeviceContext);
     SAFE_RELEASE(g_pDevice);
 }
\ No newline at end of file
@@ -0,0 +1,337 @@
+// Lab5_StateFilter
+// Теневое состояние контекста: привязки графического конвейера запоминаются и уходят в контекст
+// только перед Draw/Dispatch, и только те, что отличаются от уже установленных.
+// Изменённые слоты одного массива (CB, SRV, сэмплеры, VB) отправляются одним вызовом
+// на диапазон от первого до последнего изменённого слота.
+// Константные буферы могут привязываться окном по смещению (*SetConstantBuffers1, D3D11.1):
+// слоты с окном и слоты с целым буфером уходят разными вызовами.
+// Счётчики: сколько привязок запрошено и сколько вызовов реально ушло.
+// D3D11 сам снимает SRV ресурса, который привязывается как UAV/RTV в обход фильтра, -
+// такие слоты нужно явно обнулить через фильтр, иначе тень будет считать их занятыми.
+// Типы контекста и объектов задаёт Api: в Lab5 - ID3D11DeviceContext, в Lab8 - RenderBackend, в проверках -
+// записывающая заглушка. Вызовы, сигнатуры которых у этих контекстов расходятся (установка шейдеров,
+// окна константных буферов), идут через статические функции Api. *SetConstantBuffers1 у фильтра есть,
+// только если Api их объявляет: у RenderBackend (Lab8) окон нет, и вызов окна не соберётся.
+// Файл лежит копиями в Lab5 и Lab8 (лабы - самостоятельные проекты VS), копии отличаются только первой
+// строкой (сверяет Lab5/Tests/SameHeaders.cmake; записывающая заглушка - Lab5/Tests/StateFilterTest.cpp).
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+const uint32_t FILTER_CB_SLOTS = 14;       // D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+const uint32_t FILTER_SRV_SLOTS = 16;      // отслеживаются первые слоты, остальные идут напрямую
+const uint32_t FILTER_SAMPLER_SLOTS = 16;
+const uint32_t FILTER_VB_SLOTS = 16;
+
+struct StateFilterStats
+{
+    uint64_t requested = 0;   // вызовы Set* через фильтр
+    uint64_t issued = 0;      // вызовы, дошедшие до контекста
+    uint64_t Elided() const { return requested > issued ? requested - issued : 0; }
+};
+
+// Одно значение: desired - что просили, applied - что стоит в контексте
+template <typename T>
+struct ShadowValue
+{
+    T desired, applied;
+    void Reset(const T& value) { desired = applied = value; }
+    template <typename Issue>
+    bool Flush(Issue issue)
+    {
+        if (desired == applied) return false;
+        applied = desired;
+        issue(applied);
+        return true;
+    }
+};
+
+// Массив слотов с диапазоном изменений
+template <typename T, uint32_t N>
+struct ShadowSlots
+{
+    T desired[N], applied[N];
+    uint32_t dirtyBegin = N, dirtyEnd = 0;
+
+    void Reset()
+    {
+        for (uint32_t i = 0; i < N; ++i) desired[i] = applied[i] = T();
+        dirtyBegin = N; dirtyEnd = 0;
+    }
+    void Set(uint32_t start, uint32_t count, const T* values)
+    {
+        for (uint32_t i = 0; i < count; ++i) desired[start + i] = values ? values[i] : T();
+        dirtyBegin = (std::min)(dirtyBegin, start);
+        dirtyEnd = (std::max)(dirtyEnd, start + count);
+    }
+    // Вызов контекста сделан в обход фильтра - слоты уже стоят
+    void SetApplied(uint32_t start, uint32_t count, const T* values)
+    {
+        for (uint32_t i = start; i < (std::min)(start + count, N); ++i) desired[i] = applied[i] = values ? values[i - start] : T();
+    }
+    // issue(first, count, values) - один вызов на диапазон [первый, последний изменённый]
+    template <typename Issue>
+    bool Flush(Issue issue)
+    {
+        uint32_t first = dirtyBegin, last = dirtyEnd;
+        dirtyBegin = N; dirtyEnd = 0;
+        while (first < last && desired[first] == applied[first]) ++first;
+        while (last > first && desired[last - 1] == applied[last - 1]) --last;
+        if (first >= last) return false;
+        for (uint32_t i = first; i < last; ++i) applied[i] = desired[i];
+        issue(first, last - first, &applied[first]);
+        return true;
+    }
+};
+
+// Api с окнами константных буферов (D3D11.1): объявлены VSSetConstantBuffers1 и PSSetConstantBuffers1
+template <typename Api, typename = void>
+struct FilterHasWindows : std::false_type {};
+template <typename Api>
+struct FilterHasWindows<Api, decltype((void)&Api::VSSetConstantBuffers1, (void)&Api::PSSetConstantBuffers1)> : std::true_type {};
+
+template <typename Api>
+struct StateFilter
+{
+    typedef typename Api::Context Context;
+    typedef typename Api::Buffer Buffer;
+    typedef typename Api::ShaderResourceView ShaderResourceView;
+    typedef typename Api::SamplerState SamplerState;
+    typedef typename Api::Topology Topology;
+    typedef typename Api::Format Format;
+
+    struct IndexBinding
+    {
+        Buffer* buffer; Format format; uint32_t offset;
+        bool operator==(const IndexBinding& o) const { return buffer == o.buffer && format == o.format && offset == o.offset; }
+    };
+    struct ConstantBinding
+    {
+        Buffer* buffer; uint32_t firstConstant, numConstants;   // numConstants == 0 - весь буфер
+        bool operator==(const ConstantBinding& o) const { return buffer == o.buffer && firstConstant == o.firstConstant && numConstants == o.numConstants; }
+    };
+    struct VertexBinding
+    {
+        Buffer* buffer; uint32_t stride, offset;
+        bool operator==(const VertexBinding& o) const { return buffer == o.buffer && stride == o.stride && offset == o.offset; }
+    };
+    struct BlendBinding
+    {
+        typename Api::BlendState* state; float factor[4]; uint32_t mask;
+        bool operator==(const BlendBinding& o) const
+        {
+            return state == o.state && mask == o.mask && factor[0] == o.factor[0] && factor[1] == o.factor[1] &&
+                factor[2] == o.factor[2] && factor[3] == o.factor[3];
+        }
+    };
+    struct DepthBinding
+    {
+        typename Api::DepthStencilState* state; uint32_t stencilRef;
+        bool operator==(const DepthBinding& o) const { return state == o.state && stencilRef == o.stencilRef; }
+    };
+
+    Context* context = nullptr;
+    StateFilterStats stats;
+
+    ShadowValue<typename Api::VertexShader*> vs;
+    ShadowValue<typename Api::PixelShader*> ps;
+    ShadowValue<typename Api::InputLayout*> inputLayout;
+    ShadowValue<Topology> topology;
+    ShadowValue<IndexBinding> indexBuffer;
+    ShadowSlots<VertexBinding, FILTER_VB_SLOTS> vertexBuffers;
+    ShadowSlots<ConstantBinding, FILTER_CB_SLOTS> vsConstantBuffers, psConstantBuffers;
+    ShadowSlots<ShaderResourceView*, FILTER_SRV_SLOTS> vsResources, psResources;
+    ShadowSlots<SamplerState*, FILTER_SAMPLER_SLOTS> psSamplers;
+    ShadowValue<BlendBinding> blend;
+    ShadowValue<DepthBinding> depthStencil;
+    ShadowValue<typename Api::RasterizerState*> rasterizer;
+
+    // Состояние после ClearState
+    void Reset()
+    {
+        vs.Reset(nullptr); ps.Reset(nullptr); inputLayout.Reset(nullptr);
+        topology.Reset(Topology());
+        IndexBinding ib = { nullptr, Format(), 0 };
+        indexBuffer.Reset(ib);
+        vertexBuffers.Reset();
+        vsConstantBuffers.Reset(); psConstantBuffers.Reset();
+        vsResources.Reset(); psResources.Reset();
+        psSamplers.Reset();
+        BlendBinding b = { nullptr, { 1.0f, 1.0f, 1.0f, 1.0f }, 0xFFFFFFFF };
+        blend.Reset(b);
+        DepthBinding d = { nullptr, 0 };
+        depthStencil.Reset(d);
+        rasterizer.Reset(nullptr);
+    }
+    void ClearState() { context->ClearState(); Reset(); }
+
+    void VSSetShader(typename Api::VertexShader* shader) { ++stats.requested; vs.desired = shader; }
+    void PSSetShader(typename Api::PixelShader* shader) { ++stats.requested; ps.desired = shader; }
+    void IASetInputLayout(typename Api::InputLayout* layout) { ++stats.requested; inputLayout.desired = layout; }
+    void IASetPrimitiveTopology(Topology t) { ++stats.requested; topology.desired = t; }
+    void IASetIndexBuffer(Buffer* buffer, Format format, uint32_t offset)
+    {
+        ++stats.requested;
+        IndexBinding ib = { buffer, format, offset };
+        indexBuffer.desired = ib;
+    }
+    void IASetVertexBuffers(uint32_t start, uint32_t count, Buffer* const* buffers, const uint32_t* strides, const uint32_t* offsets)
+    {
+        ++stats.requested;
+        if (start + count > FILTER_VB_SLOTS)
+        {
+            Flush();
+            ++stats.issued;
+            context->IASetVertexBuffers(start, count, buffers, strides, offsets);
+            for (uint32_t i = 0; i < count && start + i < FILTER_VB_SLOTS; ++i)
+            {
+                VertexBinding v = { buffers[i], strides[i], offsets[i] };
+                vertexBuffers.SetApplied(start + i, 1, &v);
+            }
+            return;
+        }
+        VertexBinding v[FILTER_VB_SLOTS];
+        for (uint32_t i = 0; i < count; ++i) { v[i].buffer = buffers[i]; v[i].stride = strides[i]; v[i].offset = offsets[i]; }
+        vertexBuffers.Set(start, count, v);
+    }
+
+    void VSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* buffers) { SetConstantBuffers(vsConstantBuffers, start, count, buffers, nullptr, nullptr); }
+    void PSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* buffers) { SetConstantBuffers(psConstantBuffers, start, count, buffers, nullptr, nullptr); }
+    // Окно буфера: first/num в константах (16 байт), first кратно 16
+    template <typename A = Api, typename std::enable_if<FilterHasWindows<A>::value, int>::type = 0>
+    void VSSetConstantBuffers1(uint32_t start, uint32_t count, Buffer* const* buffers, const uint32_t* first, const uint32_t* num)
+    {
+        SetConstantBuffers(vsConstantBuffers, start, count, buffers, first, num);
+    }
+    template <typename A = Api, typename std::enable_if<FilterHasWindows<A>::value, int>::type = 0>
+    void PSSetConstantBuffers1(uint32_t start, uint32_t count, Buffer* const* buffers, const uint32_t* first, const uint32_t* num)
+    {
+        SetConstantBuffers(psConstantBuffers, start, count, buffers, first, num);
+    }
+    void VSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* views)
+    {
+        SetSlots(vsResources, start, count, views, [this](uint32_t s, uint32_t n, ShaderResourceView* const* v) { context->VSSetShaderResources(s, n, v); });
+    }
+    void PSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* views)
+    {
+        SetSlots(psResources, start, count, views, [this](uint32_t s, uint32_t n, ShaderResourceView* const* v) { context->PSSetShaderResources(s, n, v); });
+    }
+    void PSSetSamplers(uint32_t start, uint32_t count, SamplerState* const* samplers)
+    {
+        SetSlots(psSamplers, start, count, samplers, [this](uint32_t s, uint32_t n, SamplerState* const* v) { context->PSSetSamplers(s, n, v); });
+    }
+
+    // factor == nullptr - (1, 1, 1, 1), как у D3D11
+    void OMSetBlendState(typename Api::BlendState* state, const float* factor, uint32_t mask)
+    {
+        ++stats.requested;
+        BlendBinding b = { state, { 1.0f, 1.0f, 1.0f, 1.0f }, mask };
+        if (factor) for (int i = 0; i < 4; ++i) b.factor[i] = factor[i];
+        blend.desired = b;
+    }
+    void OMSetDepthStencilState(typename Api::DepthStencilState* state, uint32_t stencilRef)
+    {
+        ++stats.requested;
+        DepthBinding d = { state, stencilRef };
+        depthStencil.desired = d;
+    }
+    void RSSetState(typename Api::RasterizerState* state) { ++stats.requested; rasterizer.desired = state; }
+
+    // Отправка накопленных изменений; вызывается сама перед Draw/Dispatch
+    void Flush()
+    {
+        Context* c = context;
+        uint64_t& issued = stats.issued;
+        issued += vs.Flush([c](typename Api::VertexShader* s) { Api::VSSetShader(c, s); });
+        issued += ps.Flush([c](typename Api::PixelShader* s) { Api::PSSetShader(c, s); });
+        issued += inputLayout.Flush([c](typename Api::InputLayout* l) { c->IASetInputLayout(l); });
+        issued += topology.Flush([c](Topology t) { c->IASetPrimitiveTopology(t); });
+        issued += indexBuffer.Flush([c](const IndexBinding& ib) { c->IASetIndexBuffer(ib.buffer, ib.format, ib.offset); });
+        issued += vertexBuffers.Flush([c](uint32_t start, uint32_t count, const VertexBinding* v)
+        {
+            Buffer* buffers[FILTER_VB_SLOTS]; uint32_t strides[FILTER_VB_SLOTS], offsets[FILTER_VB_SLOTS];
+            for (uint32_t i = 0; i < count; ++i) { buffers[i] = v[i].buffer; strides[i] = v[i].stride; offsets[i] = v[i].offset; }
+            c->IASetVertexBuffers(start, count, buffers, strides, offsets);
+        });
+        issued += vsConstantBuffers.Flush([c, &issued](uint32_t start, uint32_t count, const ConstantBinding* b)
+        {
+            issued += IssueConstantBuffers(start, count, b,
+                [c](uint32_t s, uint32_t n, Buffer* const* bb) { c->VSSetConstantBuffers(s, n, bb); },
+                [c](uint32_t s, uint32_t n, Buffer* const* bb, const uint32_t* f, const uint32_t* k) { VSWindows(c, s, n, bb, f, k, FilterHasWindows<Api>()); }) - 1;
+        });
+        issued += psConstantBuffers.Flush([c, &issued](uint32_t start, uint32_t count, const ConstantBinding* b)
+        {
+            issued += IssueConstantBuffers(start, count, b,
+                [c](uint32_t s, uint32_t n, Buffer* const* bb) { c->PSSetConstantBuffers(s, n, bb); },
+                [c](uint32_t s, uint32_t n, Buffer* const* bb, const uint32_t* f, const uint32_t* k) { PSWindows(c, s, n, bb, f, k, FilterHasWindows<Api>()); }) - 1;
+        });
+        issued += vsResources.Flush([c](uint32_t s, uint32_t n, ShaderResourceView* const* v) { c->VSSetShaderResources(s, n, v); });
+        issued += psResources.Flush([c](uint32_t s, uint32_t n, ShaderResourceView* const* v) { c->PSSetShaderResources(s, n, v); });
+        issued += psSamplers.Flush([c](uint32_t s, uint32_t n, SamplerState* const* v) { c->PSSetSamplers(s, n, v); });
+        issued += blend.Flush([c](const BlendBinding& b) { c->OMSetBlendState(b.state, b.factor, b.mask); });
+        issued += depthStencil.Flush([c](const DepthBinding& d) { c->OMSetDepthStencilState(d.state, d.stencilRef); });
+        issued += rasterizer.Flush([c](typename Api::RasterizerState* r) { c->RSSetState(r); });
+    }
+
+    void Draw(uint32_t vertexCount, uint32_t startVertex) { Flush(); context->Draw(vertexCount, startVertex); }
+    void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) { Flush(); context->DrawIndexed(indexCount, startIndex, baseVertex); }
+    void DrawIndexedInstancedIndirect(Buffer* args, uint32_t offset) { Flush(); context->DrawIndexedInstancedIndirect(args, offset); }
+    void Dispatch(uint32_t x, uint32_t y, uint32_t z) { Flush(); context->Dispatch(x, y, z); }
+
+private:
+    void SetConstantBuffers(ShadowSlots<ConstantBinding, FILTER_CB_SLOTS>& slots, uint32_t start, uint32_t count,
+        Buffer* const* buffers, const uint32_t* first, const uint32_t* num)
+    {
+        ++stats.requested;
+        ConstantBinding b[FILTER_CB_SLOTS];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            b[i].buffer = buffers ? buffers[i] : nullptr;
+            b[i].firstConstant = first ? first[i] : 0;
+            b[i].numConstants = num ? num[i] : 0;
+        }
+        slots.Set(start, count, b);
+    }
+
+    // Без окон у Api окно в тень не попадает (*SetConstantBuffers1 фильтра не объявлены), ветка пустая
+    static void VSWindows(Context* c, uint32_t s, uint32_t n, Buffer* const* b, const uint32_t* f, const uint32_t* k, std::true_type) { Api::VSSetConstantBuffers1(c, s, n, b, f, k); }
+    static void PSWindows(Context* c, uint32_t s, uint32_t n, Buffer* const* b, const uint32_t* f, const uint32_t* k, std::true_type) { Api::PSSetConstantBuffers1(c, s, n, b, f, k); }
+    static void VSWindows(Context*, uint32_t, uint32_t, Buffer* const*, const uint32_t*, const uint32_t*, std::false_type) {}
+    static void PSWindows(Context*, uint32_t, uint32_t, Buffer* const*, const uint32_t*, const uint32_t*, std::false_type) {}
+
+    // Подряд идущие слоты одного вида - один вызов; возвращает число вызовов
+    template <typename Whole, typename Window>
+    static uint32_t IssueConstantBuffers(uint32_t start, uint32_t count, const ConstantBinding* b, Whole whole, Window window)
+    {
+        uint32_t calls = 0;
+        for (uint32_t i = 0; i < count; ++calls)
+        {
+            bool windowed = b[i].numConstants != 0;
+            uint32_t end = i + 1;
+            while (end < count && (b[end].numConstants != 0) == windowed) ++end;
+            Buffer* buffers[FILTER_CB_SLOTS]; uint32_t first[FILTER_CB_SLOTS], num[FILTER_CB_SLOTS];
+            for (uint32_t k = i; k < end; ++k) { buffers[k - i] = b[k].buffer; first[k - i] = b[k].firstConstant; num[k - i] = b[k].numConstants; }
+            if (windowed) window(start + i, end - i, buffers, first, num);
+            else whole(start + i, end - i, buffers);
+            i = end;
+        }
+        return calls;
+    }
+
+    // Привязка за пределами отслеживаемых слотов идёт напрямую (после отправки накопленного)
+    template <typename T, uint32_t N, typename Direct>
+    void SetSlots(ShadowSlots<T, N>& slots, uint32_t start, uint32_t count, T const* values, Direct direct)
+    {
+        ++stats.requested;
+        if (start + count > N)
+        {
+            Flush();
+            ++stats.issued;
+            direct(start, count, values);
+            slots.SetApplied(start, count, values);
+            return;
+        }
+        slots.Set(start, count, values);
+    }
+};
@@ -0,0 +1,242 @@
+// Lab5_ConstantRingTest
+// Кольцо констант (ConstantRing.h) на заглушке памяти GPU: "GPU" читает куски кадра через несколько
+// кадров после записи и проверяет, что CPU их не перезаписал; выравнивание окон, отказ при полном
+// кольце и восстановление после завершения кадров, куски не режутся на стыке, режим без D3D11.1
+// (кольцо в памяти CPU). Затем замер: 100k выделений за кадр - кольцо против Map на отрисовку.
+// Запуск: ConstantRingTest [выделений = 100000]
+#include <vector>
+#include <deque>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../ConstantRing.h"
+
+// Заглушка динамического буфера и GPU, отстающего на latency кадров
+struct MockGpuStore
+{
+    struct Chunk { uint32_t offset, size; uint8_t pattern; };
+    struct Frame { uint64_t index; std::vector<Chunk> chunks; };
+
+    std::vector<uint8_t> memory;
+    std::deque<Frame> queued;
+    uint64_t completed = 0;
+    uint64_t corrupted = 0;     // кусков, изменённых до того, как GPU их прочёл
+    uint64_t chunksRead = 0;
+
+    explicit MockGpuStore(uint32_t bytes) : memory(bytes) {}
+
+    // GPU дошёл до кадра upTo: читает все его куски
+    void Complete(uint64_t upTo)
+    {
+        while (!queued.empty() && queued.front().index <= upTo)
+        {
+            for (const Chunk& c : queued.front().chunks)
+            {
+                ++chunksRead;
+                for (uint32_t i = 0; i < c.size; ++i)
+                    if (memory[c.offset + i] != c.pattern) { ++corrupted; break; }
+            }
+            completed = queued.front().index;
+            queued.pop_front();
+        }
+    }
+};
+
+static void TestFramesInFlight()
+{
+    const uint32_t capacity = 96 * 1024;
+    const uint64_t latency = 3;
+    MockGpuStore store(capacity);
+    ConstantRing ring;
+    ring.Init(capacity);
+    CHECK(ring.NeedsDiscard());
+
+    std::mt19937 rng(7);
+    uint64_t allocated = 0, failedFrames = 0;
+    for (uint64_t frame = 1; frame <= 2000; ++frame)
+    {
+        if (frame > latency) store.Complete(frame - latency);
+        ring.BeginFrame(frame, store.completed, store.memory.data());
+        MockGpuStore::Frame record;
+        record.index = frame;
+        // Нагрузка то меньше, то больше трети кольца: отказы бывают, но порчи быть не должно
+        uint32_t draws = 20 + rng() % 60;
+        bool failed = false;
+        for (uint32_t d = 0; d < draws; ++d)
+        {
+            ConstantAllocation a;
+            uint32_t bytes = 16 + rng() % 700;
+            if (!ring.Allocate(bytes, a)) { failed = true; continue; }
+            ++allocated;
+            CHECK(a.offset % CONSTANT_RING_ALIGNMENT == 0);
+            CHECK(a.FirstConstant() % 16 == 0);
+            CHECK(a.size >= bytes && a.size % CONSTANT_RING_ALIGNMENT == 0);
+            CHECK(a.offset + a.size <= capacity);                    // кусок не режется на стыке
+            CHECK((uint8_t*)a.data == store.memory.data() + a.offset);
+            uint8_t pattern = (uint8_t)(frame * 31 + d);
+            memset(a.data, pattern, a.size);
+            MockGpuStore::Chunk chunk = { a.offset, a.size, pattern };
+            record.chunks.push_back(chunk);
+        }
+        failedFrames += failed;
+        ring.EndFrame();
+        CHECK(!ring.NeedsDiscard());
+        CHECK(ring.Used() <= capacity);
+        store.queued.push_back(record);
+    }
+    store.Complete(~0ull);
+    CHECK(store.corrupted == 0);
+    CHECK(store.chunksRead == allocated);
+    CHECK(failedFrames > 0);                  // переполнение действительно проверено
+    CHECK(ring.failed > 0);
+    ring.Retire(2000);
+    CHECK(ring.Used() == 0);
+    std::printf("frames in flight: %llu allocations, %llu failed, %llu overflowing frames\n",
+        (unsigned long long)allocated, (unsigned long long)ring.failed, (unsigned long long)failedFrames);
+}
+
+static void TestOverflowAndRecovery()
+{
+    const uint32_t capacity = 4 * CONSTANT_RING_ALIGNMENT;
+    std::vector<uint8_t> memory(capacity);
+    ConstantRing ring;
+    ring.Init(capacity + 100);                // остаток меньше выравнивания отбрасывается
+    CHECK(ring.capacity == capacity);
+
+    ConstantAllocation a;
+    CHECK(!ring.Allocate(16, a));             // кадр не отображён
+    CHECK(ring.failed == 1);
+
+    ring.BeginFrame(1, 0, memory.data());
+    CHECK(ring.Allocate(300, a) && a.offset == 0 && a.size == 512);
+    CHECK(ring.Allocate(16, a) && a.offset == 512);
+    ring.EndFrame();
+
+    ring.BeginFrame(2, 0, memory.data());
+    CHECK(ring.Allocate(16, a) && a.offset == 768);
+    CHECK(!ring.Allocate(16, a));             // кадр 1 ещё в полёте
+    ring.EndFrame();
+
+    // Кадр 1 завершён: его 768 байт свободны, следующий кусок переходит через стык на начало
+    ring.BeginFrame(3, 1, memory.data());
+    CHECK(ring.Allocate(512, a) && a.offset == 0);
+    CHECK(!ring.Allocate(512, a));            // 256 свободных в начале мало, конец занят кадром 2
+    CHECK(ring.Allocate(256, a) && a.offset == 512);
+    ring.EndFrame();
+    CHECK(!ring.Allocate(16, a));             // после EndFrame кадр снова не отображён
+
+    // Кусок больше кольца - всегда отказ. Пропуск до стыка (256 байт) считается занятым,
+    // пока голова не обойдёт кольцо, поэтому после него помещается не всё кольцо
+    ring.BeginFrame(4, 3, memory.data());
+    CHECK(ring.Used() == 0);
+    CHECK(!ring.Allocate(capacity + 1, a));
+    CHECK(!ring.Allocate(capacity, a));
+    CHECK(ring.Allocate(capacity - CONSTANT_RING_ALIGNMENT, a) && a.offset == 0);
+    ring.EndFrame();
+}
+
+static void TestCpuRingFallback()
+{
+    // Без D3D11.1: кольцо в памяти CPU, каждый кадр освобождает все прошлые
+    const uint32_t capacity = 16 * 1024;
+    std::vector<uint8_t> memory(capacity);
+    ConstantRing ring;
+    ring.Init(capacity);
+    for (uint64_t frame = 1; frame <= 1000; ++frame)
+    {
+        ring.BeginFrame(frame, frame - 1, memory.data());
+        ConstantAllocation a;
+        for (int d = 0; d < 20; ++d) CHECK(ring.Allocate(64, a));
+        ring.EndFrame();
+        CHECK(ring.Used() == 20 * CONSTANT_RING_ALIGNMENT);
+        CHECK(ring.inFlight.size() == 1);
+    }
+    CHECK(ring.failed == 0);
+}
+
+// Отрисовка без D3D11.1: Map(WRITE_DISCARD) маленького буфера, копия, Unmap - вызовы заглушки
+struct MockDrawBuffer
+{
+    uint8_t data[256];
+    uint64_t maps = 0;
+};
+static MockDrawBuffer g_DrawBuffer;
+
+static void* MockMap(MockDrawBuffer* buffer) { ++buffer->maps; return buffer->data; }
+static void MockUnmap(MockDrawBuffer*) {}
+static void* (*volatile g_Map)(MockDrawBuffer*) = MockMap;   // вызов через указатель, как у COM
+static void (*volatile g_Unmap)(MockDrawBuffer*) = MockUnmap;
+
+static volatile uint64_t g_Sink;
+
+static void Benchmark(uint32_t allocations)
+{
+    const uint32_t bytesPerDraw = 64;           // матрица модели
+    const int frames = 20;
+    uint32_t capacity = (allocations + 1) * CONSTANT_RING_ALIGNMENT * 3;
+    std::vector<uint8_t> memory(capacity);
+    ConstantRing ring;
+    ring.Init(capacity);
+    float model[16];
+    for (int i = 0; i < 16; ++i) model[i] = (float)i;
+
+    // Кольцо: одно отображение на кадр, кусок на отрисовку
+    double ringBest = 1e30;
+    uint64_t checksum = 0;
+    for (int f = 1; f <= frames; ++f)
+    {
+        double t0 = NowMs();
+        ring.BeginFrame((uint64_t)f, f > 2 ? (uint64_t)f - 2 : 0, memory.data());
+        for (uint32_t i = 0; i < allocations; ++i)
+        {
+            ConstantAllocation a;
+            if (!ring.Allocate(bytesPerDraw, a)) break;
+            model[0] = (float)i;
+            memcpy(a.data, model, bytesPerDraw);
+            checksum += a.offset;
+        }
+        ring.EndFrame();
+        ringBest = (std::min)(ringBest, NowMs() - t0);
+    }
+    CHECK(ring.failed == 0);
+
+    // Без D3D11.1: кольцо в памяти CPU и Map/копия/Unmap на отрисовку
+    double mapBest = 1e30;
+    ConstantRing cpuRing;
+    cpuRing.Init(capacity);
+    for (int f = 1; f <= frames; ++f)
+    {
+        double t0 = NowMs();
+        cpuRing.BeginFrame((uint64_t)f, (uint64_t)f - 1, memory.data());
+        for (uint32_t i = 0; i < allocations; ++i)
+        {
+            ConstantAllocation a;
+            if (!cpuRing.Allocate(bytesPerDraw, a)) break;
+            model[0] = (float)i;
+            memcpy(a.data, model, bytesPerDraw);
+            void* mapped = g_Map(&g_DrawBuffer);
+            memcpy(mapped, a.data, bytesPerDraw);
+            g_Unmap(&g_DrawBuffer);
+            checksum += g_DrawBuffer.data[0];
+        }
+        cpuRing.EndFrame();
+        mapBest = (std::min)(mapBest, NowMs() - t0);
+    }
+    CHECK(cpuRing.failed == 0);
+    g_Sink = checksum;
+    CHECK(g_DrawBuffer.maps == (uint64_t)allocations * frames);
+
+    std::printf("%u allocations/frame: ring %.3f ms (%.1f ns each), CPU ring + per-draw Map %.3f ms (%.1f ns each)\n",
+        allocations, ringBest, ringBest * 1e6 / allocations, mapBest, mapBest * 1e6 / allocations);
+    std::printf("  (a mocked Map costs only a call; on a driver each Map/Unmap pair is far more expensive)\n");
+}
+
+int main(int argc, char** argv)
+{
+    TestFramesInFlight();
+    TestOverflowAndRecovery();
+    TestCpuRingFallback();
+    Benchmark(argc > 1 ? (uint32_t)atol(argv[1]) : 100000u);
+    return TestResult("ConstantRingTest");
+}
@@ -0,0 +1,151 @@
+// Lab5_RenderQueueTest
+// Поразрядная сортировка и очередь кадра (RenderQueue.h): совпадение с std::stable_sort на разных
+// распределениях ключей (устойчивость, пропуск одинаковых разрядов, keyBits), поля ключа,
+// упорядоченный хвост очереди, отсутствие выделений в установившемся режиме;
+// затем замер сортировки кадра против std::sort / std::stable_sort.
+// Запуск: RenderQueueTest [пакетов = 1000000]
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../RenderQueue.h"
+
+typedef std::pair<uint64_t, uint32_t> KeyValue;
+
+static bool RadixMatchesStableSort(std::vector<uint64_t> keys, uint32_t keyBits)
+{
+    size_t n = keys.size();
+    std::vector<uint32_t> values(n), tmpValues(n);
+    std::vector<uint64_t> tmpKeys(n);
+    std::vector<KeyValue> expected(n);
+    for (size_t i = 0; i < n; ++i) { values[i] = (uint32_t)i; expected[i] = KeyValue(keys[i], (uint32_t)i); }
+    std::stable_sort(expected.begin(), expected.end(), [](const KeyValue& a, const KeyValue& b) { return a.first < b.first; });
+    RadixSortKeys(keys.data(), values.data(), tmpKeys.data(), tmpValues.data(), n, keyBits);
+    for (size_t i = 0; i < n; ++i)
+        if (keys[i] != expected[i].first || values[i] != expected[i].second) return false;
+    return true;
+}
+
+static void TestRadixSort()
+{
+    std::mt19937_64 rng(1);
+    const size_t sizes[] = { 0, 1, 2, 3, 100, 4097, 100000 };
+    for (size_t n : sizes)
+    {
+        std::vector<uint64_t> keys(n);
+        for (uint64_t& k : keys) k = rng();
+        CHECK(RadixMatchesStableSort(keys, 64));                       // все 6 разрядов
+        for (uint64_t& k : keys) k %= 7;
+        CHECK(RadixMatchesStableSort(keys, 64));                       // много равных: устойчивость, пропуск разрядов
+        for (uint64_t& k : keys) k = rng() & 0xFFFF;
+        CHECK(RadixMatchesStableSort(keys, SORT_KEY_DEPTH_BITS));      // как у TransparentList
+        for (uint64_t& k : keys) k = 42;
+        CHECK(RadixMatchesStableSort(keys, 64));                       // все разряды пропускаются
+        for (size_t i = 0; i < n; ++i) keys[i] = n - i;
+        CHECK(RadixMatchesStableSort(keys, 64));                       // обратный порядок
+    }
+    // Реалистичные ключи кадра: мало проходов, шейдеров и материалов, много мэшей и глубин
+    std::vector<uint64_t> frame(50000);
+    for (uint64_t& k : frame)
+        k = MakeSortKey((uint32_t)(rng() % 3), (uint32_t)(rng() % SORT_DEPTH_LEVELS), (uint32_t)(rng() % 8),
+            (uint32_t)(rng() % 64), (uint32_t)(rng() % 1000));
+    CHECK(RadixMatchesStableSort(frame, 64));
+}
+
+static void TestKeyFields()
+{
+    uint64_t key = MakeSortKey(3, 0x1234, 0xABC, 0xBEEF, 0x7777);
+    CHECK(SortKeyPass(key) == 3 && SortKeyDepth(key) == 0x1234 && SortKeyShader(key) == 0xABC);
+    CHECK(SortKeyMaterial(key) == 0xBEEF && SortKeyMesh(key) == 0x7777);
+    CHECK(MakeSortKey(0x1F, 0, 0, 0, 0) == MakeSortKey(0xF, 0, 0, 0, 0));   // поле обрезается своей шириной
+    // Старшие поля важнее младших
+    CHECK(MakeSortKey(1, 0, 0, 0, 0) > MakeSortKey(0, 0xFFFF, 0xFFF, 0xFFFF, 0xFFFF));
+    CHECK(MakeSortKey(0, 1, 0, 0, 0) > MakeSortKey(0, 0, 0xFFF, 0xFFFF, 0xFFFF));
+
+    // Квантование: спереди назад - ближние раньше, сзади вперёд - дальние раньше, края зажаты
+    CHECK(QuantizeDepth(0.5f, 1.0f, 100.0f, 256, false) == 0);
+    CHECK(QuantizeDepth(1000.0f, 1.0f, 100.0f, 256, false) == 255u * (SORT_DEPTH_LEVELS / 256));
+    CHECK(QuantizeDepth(10.0f, 1.0f, 100.0f, 256, false) < QuantizeDepth(20.0f, 1.0f, 100.0f, 256, false));
+    CHECK(QuantizeDepth(10.0f, 1.0f, 100.0f, 256, true) > QuantizeDepth(20.0f, 1.0f, 100.0f, 256, true));
+    CHECK(QuantizeDepth(100.0f, 1.0f, 100.0f, SORT_DEPTH_LEVELS, true) == 0);
+}
+
+struct Packet { uint32_t mesh, material; float depth; };
+
+static void TestQueue()
+{
+    RenderQueue<Packet> queue;
+    std::mt19937 rng(2);
+    const void* buffers[4] = {};
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        queue.Clear();
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            Packet p = { (uint32_t)(rng() % 50), (uint32_t)(rng() % 10), (float)(rng() % 1000) };
+            queue.Push(MakeSortKey(0, QuantizeDepth(p.depth, 0.0f, 1000.0f, 16, false), 0, p.material, p.mesh), p);
+        }
+        queue.BeginOrderedTail();
+        for (uint32_t i = 0; i < 100; ++i)   // хвост: уже упорядоченные прозрачные, ключи убывают
+        {
+            Packet p = { 1000 + i, 0, (float)i };
+            queue.Push(MakeSortKey(1, SORT_DEPTH_LEVELS - 1 - i, 0, 0, 0), p);
+        }
+        queue.Sort();
+        CHECK(queue.Size() == 1100);
+        for (size_t i = 1; i < 1000; ++i) CHECK(queue.Key(i - 1) <= queue.Key(i));
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            const Packet& p = queue.Get(i);
+            CHECK(SortKeyMesh(queue.Key(i)) == p.mesh && SortKeyMaterial(queue.Key(i)) == p.material);
+        }
+        for (uint32_t i = 0; i < 100; ++i) CHECK(queue.Get(1000 + i).mesh == 1000 + i);   // хвост не тронут
+
+        // После первого кадра того же размера буферы не перевыделяются
+        const void* current[4] = { queue.keys.data(), queue.order.data(), queue.payloads.data(), queue.tmpKeys.data() };
+        if (frame > 0) for (int b = 0; b < 4; ++b) CHECK(current[b] == buffers[b]);
+        std::copy(current, current + 4, buffers);
+    }
+}
+
+static void Benchmark(size_t count)
+{
+    std::mt19937 rng(3);
+    std::vector<uint64_t> frameKeys(count);
+    for (uint64_t& k : frameKeys)
+        k = MakeSortKey(rng() % 2, rng() % 256 * (SORT_DEPTH_LEVELS / 256), rng() % 16, rng() % 256, rng() % 4096);
+
+    RenderQueue<Packet> queue;
+    double best[3] = { 1e30, 1e30, 1e30 };
+    std::vector<KeyValue> pairs(count);
+    for (int r = 0; r < 5; ++r)
+    {
+        queue.Clear();
+        for (size_t i = 0; i < count; ++i) queue.Push(frameKeys[i], Packet());
+        double t = NowMs();
+        queue.Sort();
+        best[0] = (std::min)(best[0], NowMs() - t);
+
+        for (size_t i = 0; i < count; ++i) pairs[i] = KeyValue(frameKeys[i], (uint32_t)i);
+        t = NowMs();
+        std::sort(pairs.begin(), pairs.end());
+        best[1] = (std::min)(best[1], NowMs() - t);
+
+        for (size_t i = 0; i < count; ++i) pairs[i] = KeyValue(frameKeys[i], (uint32_t)i);
+        t = NowMs();
+        std::stable_sort(pairs.begin(), pairs.end(), [](const KeyValue& a, const KeyValue& b) { return a.first < b.first; });
+        best[2] = (std::min)(best[2], NowMs() - t);
+    }
+    for (size_t i = 0; i < count; ++i) CHECK(queue.Key(i) == pairs[i].first);
+    std::printf("%zu packets: radix %.2f ms, std::sort %.2f ms (x%.1f), std::stable_sort %.2f ms (x%.1f)\n",
+        count, best[0], best[1], best[1] / best[0], best[2], best[2] / best[0]);
+}
+
+int main(int argc, char** argv)
+{
+    TestRadixSort();
+    TestKeyFields();
+    TestQueue();
+    Benchmark(argc > 1 ? (size_t)atol(argv[1]) : 1000000u);
+    return TestResult("RenderQueueTest");
+}
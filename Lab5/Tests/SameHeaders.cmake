@@ -0,0 +1,17 @@
+# Сверка копий заголовка в разных лабах: cmake -DFILES=a.h|b.h|... -P SameHeaders.cmake
+# Первая строка (// LabN_Name) у копий своя и не сравнивается.
+if(NOT FILES)
+    message(FATAL_ERROR "SameHeaders: FILES is empty")
+endif()
+string(REPLACE "|" ";" FILES "${FILES}")
+list(GET FILES 0 first)
+file(STRINGS ${first} reference)
+list(REMOVE_AT reference 0)
+foreach(path ${FILES})
+    file(STRINGS ${path} lines)
+    list(REMOVE_AT lines 0)
+    if(NOT lines STREQUAL reference)
+        message(FATAL_ERROR "SameHeaders: ${path} differs from ${first}")
+    endif()
+endforeach()
+message(STATUS "SameHeaders: ${FILES}: OK")
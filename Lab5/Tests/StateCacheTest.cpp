@@ -0,0 +1,200 @@
+// Lab5_StateCacheTest
+// Кэш объектов состояния (StateCache.h) на заглушке устройства: одинаковое описание - тот же объект
+// и один вызов Create*, разные описания - разные объекты, совпадение хэша без совпадения описания -
+// промах, ошибка создания - nullptr без записи в кэш, Clear освобождает каждый объект ровно раз.
+#include <vector>
+#include "TestCommon.h"
+#include "../StateCache.h"
+
+static int g_Live = 0;       // созданных и ещё не освобождённых объектов
+
+struct MockState
+{
+    int refs = 1;
+    MockState() { ++g_Live; }
+    void Release() { if (--refs == 0) { --g_Live; delete this; } }
+};
+struct MockDepthStencilState : MockState {};
+struct MockRasterizerState : MockState {};
+struct MockBlendState : MockState {};
+struct MockSamplerState : MockState {};
+
+// Описания - как у D3D11: простые структуры, объявляются обнулёнными
+struct MockDepthStencilDesc { int depthEnable; int writeMask; int func; };
+struct MockRasterizerDesc { int fill; int cull; float depthBias; };
+struct MockBlendDesc { int enable; int src, dst; int writeMask[4]; };
+struct MockSamplerDesc { int filter; int address[3]; float lodBias; };
+
+const long MOCK_E_FAIL = (long)0x80004005;
+
+struct MockDevice
+{
+    int creates = 0;
+    bool fail = false;
+
+    template <typename Object>
+    long Create(Object** out)
+    {
+        ++creates;
+        if (fail) { *out = nullptr; return MOCK_E_FAIL; }
+        *out = new Object();
+        return 0;
+    }
+    long CreateDepthStencilState(const MockDepthStencilDesc*, MockDepthStencilState** out) { return Create(out); }
+    long CreateRasterizerState(const MockRasterizerDesc*, MockRasterizerState** out) { return Create(out); }
+    long CreateBlendState(const MockBlendDesc*, MockBlendState** out) { return Create(out); }
+    long CreateSamplerState(const MockSamplerDesc*, MockSamplerState** out) { return Create(out); }
+};
+
+struct MockStateApi
+{
+    typedef MockDevice Device;
+    typedef MockDepthStencilDesc DepthStencilDesc;
+    typedef MockDepthStencilState DepthStencilState;
+    typedef MockRasterizerDesc RasterizerDesc;
+    typedef MockRasterizerState RasterizerState;
+    typedef MockBlendDesc BlendDesc;
+    typedef MockBlendState BlendState;
+    typedef MockSamplerDesc SamplerDesc;
+    typedef MockSamplerState SamplerState;
+};
+
+static void TestHitsAndMisses()
+{
+    MockDevice device;
+    PipelineStateCache<MockStateApi> cache;
+
+    MockSamplerDesc linear = {};
+    linear.filter = 1;
+    linear.address[0] = linear.address[1] = linear.address[2] = 3;
+    MockSamplerDesc point = linear;
+    point.filter = 0;
+
+    MockSamplerState* a = cache.Sampler(&device, linear);
+    MockSamplerState* b = cache.Sampler(&device, linear);
+    MockSamplerState* c = cache.Sampler(&device, point);
+    CHECK(a && a == b);
+    CHECK(c && c != a);
+    CHECK(device.creates == 2);
+
+    // Копия описания, собранная заново, - тот же объект
+    MockSamplerDesc linearCopy = {};
+    linearCopy.filter = 1;
+    linearCopy.address[0] = linearCopy.address[1] = linearCopy.address[2] = 3;
+    CHECK(cache.Sampler(&device, linearCopy) == a);
+
+    // Одинаковые байты в описаниях разных типов - разные кэши
+    MockRasterizerDesc solid = {};
+    solid.fill = 3;
+    solid.cull = 3;
+    MockRasterizerState* r = cache.Rasterizer(&device, solid);
+    CHECK(r && cache.Rasterizer(&device, solid) == r);
+    MockDepthStencilDesc depth = {};
+    depth.depthEnable = 1;
+    depth.writeMask = 1;
+    depth.func = 2;
+    MockDepthStencilState* d = cache.DepthStencil(&device, depth);
+    CHECK(d && cache.DepthStencil(&device, depth) == d);
+    MockBlendDesc blend = {};
+    blend.enable = 1;
+    blend.writeMask[0] = 15;
+    MockBlendState* bl = cache.Blend(&device, blend);
+    CHECK(bl && cache.Blend(&device, blend) == bl);
+
+    CHECK(device.creates == 5);
+    CHECK(cache.Size() == 5);
+    StateCacheStats stats = cache.Stats();
+    CHECK(stats.misses == 5);
+    CHECK(stats.hits == 5);
+    CHECK(g_Live == 5);
+
+    cache.Clear();
+    CHECK(cache.Size() == 0);
+    CHECK(g_Live == 0);
+
+    // После Clear объекты создаются заново
+    CHECK(cache.Sampler(&device, linear) != nullptr);
+    CHECK(device.creates == 6);
+    cache.Clear();
+    CHECK(g_Live == 0);
+}
+
+static void TestHashCollision()
+{
+    // Совпадение хэша подставляется вручную: найти коллизию FNV-1a для настоящих описаний долго
+    MockDevice device;
+    StateObjectCache<MockSamplerDesc, MockSamplerState> cache;
+    auto create = [&device](const MockSamplerDesc&, MockSamplerState** out) { return device.Create(out); };
+
+    MockSamplerDesc a = {}, b = {};
+    a.filter = 1;
+    b.filter = 2;
+    MockSamplerState* stranger = new MockSamplerState();
+    StateObjectCache<MockSamplerDesc, MockSamplerState>::Entry entry;
+    entry.desc = a;
+    entry.object = stranger;
+    cache.entries.emplace(HashBytes(&b, sizeof(b)), entry);
+
+    MockSamplerState* sb = cache.Get(b, create);
+    CHECK(sb && sb != stranger);
+    CHECK(cache.Get(b, create) == sb);
+    CHECK(device.creates == 1);
+    CHECK(cache.Size() == 2);
+    cache.Clear();
+    CHECK(g_Live == 0);
+}
+
+static void TestCreateFailure()
+{
+    MockDevice device;
+    PipelineStateCache<MockStateApi> cache;
+    MockBlendDesc desc = {};
+    desc.enable = 1;
+
+    device.fail = true;
+    CHECK(cache.Blend(&device, desc) == nullptr);
+    CHECK(cache.Blend(&device, desc) == nullptr);   // ошибка не запоминается: каждый запрос пробует снова
+    CHECK(device.creates == 2);
+    CHECK(cache.Size() == 0);
+    CHECK(cache.Stats().misses == 2);
+
+    device.fail = false;
+    MockBlendState* state = cache.Blend(&device, desc);
+    CHECK(state != nullptr);
+    CHECK(cache.Blend(&device, desc) == state);
+    CHECK(device.creates == 3);
+    cache.Clear();
+    CHECK(g_Live == 0);
+}
+
+static void TestManyDescs()
+{
+    MockDevice device;
+    PipelineStateCache<MockStateApi> cache;
+    std::vector<MockRasterizerState*> states;
+    for (int pass = 0; pass < 2; ++pass)
+        for (int i = 0; i < 1000; ++i)
+        {
+            MockRasterizerDesc desc = {};
+            desc.fill = i % 3;
+            desc.cull = i / 3 % 3;
+            desc.depthBias = (float)(i / 9);
+            MockRasterizerState* s = cache.Rasterizer(&device, desc);
+            if (pass == 0) states.push_back(s);
+            else CHECK(s == states[i]);
+        }
+    CHECK(device.creates == 1000);
+    CHECK(cache.Size() == 1000);
+    CHECK(cache.Stats().hits == 1000);
+    cache.Clear();
+    CHECK(g_Live == 0);
+}
+
+int main()
+{
+    TestHitsAndMisses();
+    TestHashCollision();
+    TestCreateFailure();
+    TestManyDescs();
+    return TestResult("StateCacheTest");
+}
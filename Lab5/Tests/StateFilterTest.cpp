@@ -0,0 +1,312 @@
+// Lab5_StateFilterTest
+// Фильтр привязок (StateFilter.h) на записывающей заглушке контекста: до Draw в контекст не уходит
+// ничего, повторные привязки отбрасываются, изменённые слоты уходят одним вызовом на диапазон,
+// окна константных буферов и целые буферы - разными вызовами, слоты за отслеживаемыми идут
+// напрямую после накопленного, ClearState сбрасывает тень; счётчики requested/issued.
+#include <string>
+#include <vector>
+#include "TestCommon.h"
+#include "../StateFilter.h"
+
+struct MockBuffer { int id; };
+struct MockView { int id; };
+struct MockSampler { int id; };
+struct MockVertexShader { int id; };
+struct MockPixelShader { int id; };
+struct MockInputLayout { int id; };
+struct MockBlendState { int id; };
+struct MockDepthStencilState { int id; };
+struct MockRasterizerState { int id; };
+
+// Вызов контекста: имя, диапазон слотов и привязанные значения (id объектов, окна - first/num)
+struct Call
+{
+    std::string name;
+    uint32_t start, count;
+    std::vector<int> values;
+};
+
+struct RecordingContext
+{
+    std::vector<Call> calls;
+
+    void Record(const char* name, uint32_t start = 0, uint32_t count = 0, std::vector<int> values = std::vector<int>())
+    {
+        Call c = { name, start, count, values };
+        calls.push_back(c);
+    }
+    template <typename T>
+    static std::vector<int> Ids(uint32_t count, T* const* objects)
+    {
+        std::vector<int> ids;
+        for (uint32_t i = 0; i < count; ++i) ids.push_back(objects && objects[i] ? objects[i]->id : 0);
+        return ids;
+    }
+
+    void ClearState() { Record("ClearState"); }
+    void IASetInputLayout(MockInputLayout* l) { Record("IASetInputLayout", 0, 1, Ids(1, &l)); }
+    void IASetPrimitiveTopology(int t) { Record("IASetPrimitiveTopology", 0, 1, std::vector<int>(1, t)); }
+    void IASetIndexBuffer(MockBuffer* b, int format, uint32_t offset)
+    {
+        std::vector<int> v = Ids(1, &b);
+        v.push_back(format); v.push_back((int)offset);
+        Record("IASetIndexBuffer", 0, 1, v);
+    }
+    void IASetVertexBuffers(uint32_t start, uint32_t count, MockBuffer* const* b, const uint32_t* strides, const uint32_t* offsets)
+    {
+        std::vector<int> v;
+        for (uint32_t i = 0; i < count; ++i) { v.push_back(b[i] ? b[i]->id : 0); v.push_back((int)strides[i]); v.push_back((int)offsets[i]); }
+        Record("IASetVertexBuffers", start, count, v);
+    }
+    void VSSetConstantBuffers(uint32_t start, uint32_t count, MockBuffer* const* b) { Record("VSSetConstantBuffers", start, count, Ids(count, b)); }
+    void PSSetConstantBuffers(uint32_t start, uint32_t count, MockBuffer* const* b) { Record("PSSetConstantBuffers", start, count, Ids(count, b)); }
+    void SetWindows(const char* name, uint32_t start, uint32_t count, MockBuffer* const* b, const uint32_t* first, const uint32_t* num)
+    {
+        std::vector<int> v;
+        for (uint32_t i = 0; i < count; ++i) { v.push_back(b[i] ? b[i]->id : 0); v.push_back((int)first[i]); v.push_back((int)num[i]); }
+        Record(name, start, count, v);
+    }
+    void VSSetShaderResources(uint32_t start, uint32_t count, MockView* const* v) { Record("VSSetShaderResources", start, count, Ids(count, v)); }
+    void PSSetShaderResources(uint32_t start, uint32_t count, MockView* const* v) { Record("PSSetShaderResources", start, count, Ids(count, v)); }
+    void PSSetSamplers(uint32_t start, uint32_t count, MockSampler* const* s) { Record("PSSetSamplers", start, count, Ids(count, s)); }
+    void OMSetBlendState(MockBlendState* s, const float* factor, uint32_t mask)
+    {
+        std::vector<int> v = Ids(1, &s);
+        for (int i = 0; i < 4; ++i) v.push_back((int)(factor[i] * 100.0f));
+        v.push_back((int)mask);
+        Record("OMSetBlendState", 0, 1, v);
+    }
+    void OMSetDepthStencilState(MockDepthStencilState* s, uint32_t ref) { std::vector<int> v = Ids(1, &s); v.push_back((int)ref); Record("OMSetDepthStencilState", 0, 1, v); }
+    void RSSetState(MockRasterizerState* s) { Record("RSSetState", 0, 1, Ids(1, &s)); }
+    void Draw(uint32_t count, uint32_t) { Record("Draw", 0, count); }
+    void DrawIndexed(uint32_t count, uint32_t, int32_t) { Record("DrawIndexed", 0, count); }
+    void DrawIndexedInstancedIndirect(MockBuffer*, uint32_t) { Record("DrawIndexedInstancedIndirect"); }
+    void Dispatch(uint32_t x, uint32_t, uint32_t) { Record("Dispatch", 0, x); }
+};
+
+struct MockContextApi
+{
+    typedef RecordingContext Context;
+    typedef MockVertexShader VertexShader;
+    typedef MockPixelShader PixelShader;
+    typedef MockInputLayout InputLayout;
+    typedef MockBuffer Buffer;
+    typedef MockView ShaderResourceView;
+    typedef MockSampler SamplerState;
+    typedef MockBlendState BlendState;
+    typedef MockDepthStencilState DepthStencilState;
+    typedef MockRasterizerState RasterizerState;
+    typedef int Topology;
+    typedef int Format;
+    static void VSSetShader(RecordingContext* c, MockVertexShader* s) { c->Record("VSSetShader", 0, 1, RecordingContext::Ids(1, &s)); }
+    static void PSSetShader(RecordingContext* c, MockPixelShader* s) { c->Record("PSSetShader", 0, 1, RecordingContext::Ids(1, &s)); }
+    static void VSSetConstantBuffers1(RecordingContext* c, uint32_t start, uint32_t count, MockBuffer* const* b, const uint32_t* first, const uint32_t* num)
+    {
+        c->SetWindows("VSSetConstantBuffers1", start, count, b, first, num);
+    }
+    static void PSSetConstantBuffers1(RecordingContext* c, uint32_t start, uint32_t count, MockBuffer* const* b, const uint32_t* first, const uint32_t* num)
+    {
+        c->SetWindows("PSSetConstantBuffers1", start, count, b, first, num);
+    }
+};
+
+typedef StateFilter<MockContextApi> Filter;
+static_assert(FilterHasWindows<MockContextApi>::value, "windowed binds must reach the mock");
+
+static size_t CountCalls(const RecordingContext& c, const char* name)
+{
+    size_t n = 0;
+    for (const Call& call : c.calls) n += call.name == name;
+    return n;
+}
+
+static const Call* FindCall(const RecordingContext& c, const char* name)
+{
+    for (const Call& call : c.calls) if (call.name == name) return &call;
+    return nullptr;
+}
+
+static void TestDeferredAndElided()
+{
+    RecordingContext context;
+    Filter filter;
+    filter.context = &context;
+    filter.ClearState();
+    context.calls.clear();
+
+    MockVertexShader vs1 = { 1 }, vs2 = { 2 };
+    MockPixelShader ps1 = { 11 };
+    filter.VSSetShader(&vs1);
+    filter.PSSetShader(&ps1);
+    filter.IASetPrimitiveTopology(4);
+    CHECK(context.calls.empty());                  // до Draw ничего не уходит
+
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 4);
+    CHECK(context.calls.back().name == "Draw");
+    CHECK(CountCalls(context, "VSSetShader") == 1);
+
+    // Те же привязки и промежуточная смена с возвратом - в контекст ничего
+    context.calls.clear();
+    filter.VSSetShader(&vs2);
+    filter.VSSetShader(&vs1);
+    filter.PSSetShader(&ps1);
+    filter.IASetPrimitiveTopology(4);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 1);
+
+    filter.VSSetShader(&vs2);
+    filter.DrawIndexed(6, 0, 0);
+    CHECK(context.calls.size() == 3);
+    CHECK(context.calls[1].name == "VSSetShader" && context.calls[1].values[0] == 2);
+
+    // Значения по умолчанию после ClearState не отправляются повторно
+    context.calls.clear();
+    filter.ClearState();
+    filter.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+    filter.OMSetDepthStencilState(nullptr, 0);
+    filter.RSSetState(nullptr);
+    filter.VSSetShader(&vs2);                       // после ClearState в контексте его уже нет
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 3);
+    CHECK(context.calls[0].name == "ClearState" && context.calls[1].name == "VSSetShader");
+}
+
+static void TestSlotRanges()
+{
+    RecordingContext context;
+    Filter filter;
+    filter.context = &context;
+    filter.ClearState();
+    context.calls.clear();
+
+    MockView v[8] = { { 1 }, { 2 }, { 3 }, { 4 }, { 5 }, { 6 }, { 7 }, { 8 } };
+    MockView* views[8] = { &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7] };
+    filter.PSSetShaderResources(0, 4, views);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 2);
+    const Call* srv = FindCall(context, "PSSetShaderResources");
+    CHECK(srv && srv->start == 0 && srv->count == 4);
+
+    // Слоты 1 и 5 из разных вызовов - один вызов на диапазон 1..5, неизменные края обрезаются
+    context.calls.clear();
+    MockView* changed1[3] = { &v[0], &v[6], &v[2] };
+    filter.PSSetShaderResources(0, 3, changed1);    // слоты 0 и 2 те же
+    filter.PSSetShaderResources(5, 1, &views[7]);
+    filter.Draw(3, 0);
+    srv = FindCall(context, "PSSetShaderResources");
+    CHECK(CountCalls(context, "PSSetShaderResources") == 1);
+    CHECK(srv && srv->start == 1 && srv->count == 5);
+    CHECK(srv && srv->values.size() == 5 && srv->values[0] == 7 && srv->values[1] == 3 && srv->values[2] == 4 &&
+        srv->values[3] == 0 && srv->values[4] == 8);
+
+    // Слот за отслеживаемыми: накопленное уходит раньше прямого вызова
+    context.calls.clear();
+    MockSampler s = { 42 };
+    MockSampler* sampler = &s;
+    filter.PSSetSamplers(0, 1, &sampler);
+    filter.PSSetShaderResources(FILTER_SRV_SLOTS, 1, &views[0]);
+    CHECK(context.calls.size() == 2);
+    CHECK(context.calls[0].name == "PSSetSamplers");
+    CHECK(context.calls[1].name == "PSSetShaderResources" && context.calls[1].start == FILTER_SRV_SLOTS);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 3);
+
+    // Вершинные буферы: шаг и смещение - часть привязки
+    context.calls.clear();
+    MockBuffer vb = { 9 };
+    MockBuffer* vbs[1] = { &vb };
+    uint32_t stride = 32, offset = 0;
+    filter.IASetVertexBuffers(0, 1, vbs, &stride, &offset);
+    filter.Draw(3, 0);
+    filter.IASetVertexBuffers(0, 1, vbs, &stride, &offset);
+    offset = 64;
+    filter.Draw(3, 0);
+    filter.IASetVertexBuffers(0, 1, vbs, &stride, &offset);
+    filter.Draw(3, 0);
+    CHECK(CountCalls(context, "IASetVertexBuffers") == 2);
+    CHECK(context.calls[3].name == "IASetVertexBuffers" && context.calls[3].values[2] == 64);
+}
+
+static void TestConstantWindows()
+{
+    RecordingContext context;
+    Filter filter;
+    filter.context = &context;
+    filter.ClearState();
+    context.calls.clear();
+
+    MockBuffer frame = { 1 }, ring = { 2 }, material = { 3 };
+    MockBuffer* whole[1] = { &frame };
+    filter.VSSetConstantBuffers(0, 1, whole);
+    uint32_t first = 16, num = 16;
+    MockBuffer* windowed[1] = { &ring };
+    filter.VSSetConstantBuffers1(1, 1, windowed, &first, &num);
+    MockBuffer* whole2[1] = { &material };
+    filter.VSSetConstantBuffers(2, 1, whole2);
+    filter.Draw(3, 0);
+
+    // Один диапазон 0..2 - три вызова: целый, окно, целый
+    CHECK(context.calls.size() == 4);
+    CHECK(context.calls[0].name == "VSSetConstantBuffers" && context.calls[0].start == 0 && context.calls[0].count == 1);
+    CHECK(context.calls[1].name == "VSSetConstantBuffers1" && context.calls[1].start == 1 &&
+        context.calls[1].values == std::vector<int>({ 2, 16, 16 }));
+    CHECK(context.calls[2].name == "VSSetConstantBuffers" && context.calls[2].start == 2);
+    CHECK(filter.stats.issued == 3);
+
+    // Тот же буфер с другим окном - новая привязка; то же окно - ничего
+    context.calls.clear();
+    first = 32;
+    filter.VSSetConstantBuffers1(1, 1, windowed, &first, &num);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 2 && context.calls[0].values[1] == 32);
+    filter.VSSetConstantBuffers1(1, 1, windowed, &first, &num);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 3);
+
+    // Окна подряд - одним вызовом; целый буфер вместо окна в том же слоте - смена вызова
+    context.calls.clear();
+    MockBuffer* two[2] = { &ring, &ring };
+    uint32_t firsts[2] = { 48, 64 }, nums[2] = { 16, 16 };
+    filter.PSSetConstantBuffers1(0, 2, two, firsts, nums);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 2 && context.calls[0].name == "PSSetConstantBuffers1" && context.calls[0].count == 2);
+    filter.PSSetConstantBuffers(1, 1, windowed);
+    filter.Draw(3, 0);
+    CHECK(context.calls.size() == 4 && context.calls[2].name == "PSSetConstantBuffers" && context.calls[2].start == 1);
+}
+
+static void TestStats()
+{
+    RecordingContext context;
+    Filter filter;
+    filter.context = &context;
+    filter.ClearState();
+    context.calls.clear();
+
+    MockVertexShader vs = { 1 };
+    MockPixelShader ps = { 2 };
+    MockBuffer cb = { 3 };
+    MockBuffer* cbs[1] = { &cb };
+    for (int i = 0; i < 100; ++i)
+    {
+        filter.VSSetShader(&vs);
+        filter.PSSetShader(&ps);
+        filter.VSSetConstantBuffers(0, 1, cbs);
+        filter.PSSetConstantBuffers(0, 1, cbs);
+        filter.Draw(3, 0);
+    }
+    CHECK(filter.stats.requested == 400);
+    CHECK(filter.stats.issued == 4);
+    CHECK(filter.stats.Elided() == 396);
+    CHECK(context.calls.size() == 4 + 100);
+}
+
+int main()
+{
+    TestDeferredAndElided();
+    TestSlotRanges();
+    TestConstantWindows();
+    TestStats();
+    return TestResult("StateFilterTest");
+}
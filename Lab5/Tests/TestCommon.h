@@ -0,0 +1,27 @@
+// Lab5_TestCommon
+// Общее для тестов Lab5: проверки без внешних фреймворков и таймер.
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+
+static int g_TestFailures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++g_TestFailures; } } while (0)
+
+#define CHECK_NEAR(a, b, eps) \
+    do { double a_ = (a), b_ = (b); if (!(a_ - b_ <= (eps) && b_ - a_ <= (eps))) { \
+        std::printf("%s:%d: CHECK_NEAR(%s, %s): %g vs %g\n", __FILE__, __LINE__, #a, #b, a_, b_); ++g_TestFailures; } } while (0)
+
+inline int TestResult(const char* name)
+{
+    if (g_TestFailures) std::printf("%s: %d check(s) failed\n", name, g_TestFailures);
+    else std::printf("%s: OK\n", name);
+    return g_TestFailures ? 1 : 0;
+}
+
+inline double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
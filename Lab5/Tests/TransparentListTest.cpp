@@ -0,0 +1,191 @@
+// Lab5_TransparentListTest
+// Постоянный список прозрачных (TransparentList в RenderQueue.h): каждый кадр порядок совпадает
+// с устойчивой сортировкой порядка прошлого кадра по ключу (сзади вперёд, равные ключи не меняются
+// местами), при плавной камере хватает вставок, при скачке - поразрядная; добавление и удаление
+// объектов, без выделений памяти в установившемся режиме. Затем замер на 100k объектов:
+// досортировка от прошлого кадра против std::sort пар (ключ, индекс) с нуля.
+// Запуск: TransparentListTest [объектов = 100000]
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../RenderQueue.h"
+
+struct Float3 { float x, y, z; };
+
+// Объекты в шаре радиуса 40, камера на орбите радиуса 50 вокруг начала координат, как в Lab5
+struct Scene
+{
+    std::vector<Float3> positions;
+    std::vector<float> depths;
+
+    Scene(size_t count, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> coord(-40.0f, 40.0f);
+        positions.resize(count);
+        for (Float3& p : positions)
+            do { p.x = coord(rng); p.y = coord(rng); p.z = coord(rng); } while (p.x * p.x + p.y * p.y + p.z * p.z > 1600.0f);
+        depths.resize(count);
+    }
+
+    void Camera(float angle)
+    {
+        Float3 eye = { 50.0f * sinf(angle), 10.0f, 50.0f * cosf(angle) };
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            float dx = positions[i].x - eye.x, dy = positions[i].y - eye.y, dz = positions[i].z - eye.z;
+            depths[i] = sqrtf(dx * dx + dy * dy + dz * dz);
+        }
+    }
+
+    uint64_t Key(uint32_t i) const { return QuantizeDepth(depths[i], 0.1f, 100.0f, SORT_DEPTH_LEVELS, true); }
+};
+
+// Ожидаемый результат: порядок прошлого кадра, устойчиво отсортированный по новым ключам
+static bool MatchesStableSort(const TransparentList& list, const std::vector<uint32_t>& previous, const Scene& scene)
+{
+    std::vector<uint32_t> expected = previous;
+    std::stable_sort(expected.begin(), expected.end(), [&scene](uint32_t a, uint32_t b) { return scene.Key(a) < scene.Key(b); });
+    if (list.order != expected) return false;
+    for (size_t i = 0; i < expected.size(); ++i)
+        if (list.keys[i] != scene.Key(expected[i])) return false;
+    return true;
+}
+
+static void TestOrdering()
+{
+    const size_t count = 5000;
+    Scene scene(count, 11);
+    TransparentList list;
+    list.Resize((uint32_t)count);
+    CHECK(list.order.size() == count);
+    for (uint32_t i = 0; i < count; ++i) CHECK(list.order[i] == i);
+
+    int insertionFrames = 0, radixFrames = 0, mismatches = 0;
+    float angle = 0.0f;
+    const void* buffers[4] = {};
+    for (int frame = 0; frame < 300; ++frame)
+    {
+        // Плавный облёт, а каждые 50 кадров - скачок камеры на противоположную сторону
+        angle += frame % 50 == 49 ? 3.14159265f : 0.0005f;
+        scene.Camera(angle);
+        std::vector<uint32_t> previous = list.order;
+        list.Sort([&scene](uint32_t i) { return scene.Key(i); });
+        mismatches += !MatchesStableSort(list, previous, scene);
+        if (list.usedRadix) ++radixFrames; else ++insertionFrames;
+        if (frame == 0) CHECK(list.usedRadix);                 // первый кадр - с нуля
+        if (frame > 0 && frame % 50 == 49) CHECK(list.usedRadix);
+
+        // Сзади вперёд: глубина не растёт дальше, чем на ширину корзины
+        for (size_t i = 1; i < count; ++i)
+            CHECK(scene.depths[list.order[i]] <= scene.depths[list.order[i - 1]] + 100.0f / SORT_DEPTH_LEVELS);
+
+        const void* current[4] = { list.order.data(), list.keys.data(), list.tmpKeys.data(), list.tmpOrder.data() };
+        if (frame > 0) for (int b = 0; b < 4; ++b) CHECK(current[b] == buffers[b]);
+        std::copy(current, current + 4, buffers);
+    }
+    std::printf("ordering: 300 frames of %zu objects, %d by insertion, %d by radix, %d mismatches\n",
+        count, insertionFrames, radixFrames, mismatches);
+    CHECK(mismatches == 0);
+    CHECK(insertionFrames > 250);
+}
+
+static void TestEqualKeysKeepOrder()
+{
+    // Все ключи равны: порядок прошлого кадра не трогается ни вставками, ни поразрядной
+    TransparentList list;
+    list.Resize(1000);
+    std::mt19937 rng(5);
+    std::shuffle(list.order.begin(), list.order.end(), rng);
+    std::vector<uint32_t> previous = list.order;
+    list.Sort([](uint32_t) { return 42ull; });
+    CHECK(list.order == previous);
+    CHECK(!list.usedRadix && list.shifts == 0);
+
+    list.budgetPerObject = 0;                     // заставить поразрядную: два класса ключей в обратном порядке
+    list.Sort([](uint32_t i) { return i % 2 ? 0ull : 1ull; });
+    CHECK(list.usedRadix);
+    size_t odd = 0;
+    for (size_t i = 0; i < previous.size(); ++i) odd += previous[i] % 2;
+    std::vector<uint32_t> expected;
+    for (uint32_t o : previous) if (o % 2) expected.push_back(o);
+    for (uint32_t o : previous) if (o % 2 == 0) expected.push_back(o);
+    CHECK(list.order == expected);
+    CHECK(odd == 500);
+}
+
+static void TestResize()
+{
+    TransparentList list;
+    list.Resize(6);
+    list.Sort([](uint32_t i) { return 10ull - i; });   // 5 4 3 2 1 0
+    uint32_t reversed[6] = { 5, 4, 3, 2, 1, 0 };
+    CHECK(std::equal(list.order.begin(), list.order.end(), reversed));
+
+    // Удалённые выпадают, оставшиеся сохраняют порядок, новые встают в конец
+    list.Resize(4);
+    uint32_t shrunk[4] = { 3, 2, 1, 0 };
+    CHECK(list.order.size() == 4 && std::equal(list.order.begin(), list.order.end(), shrunk));
+    list.Resize(7);
+    uint32_t grown[7] = { 3, 2, 1, 0, 4, 5, 6 };
+    CHECK(list.order.size() == 7 && std::equal(list.order.begin(), list.order.end(), grown));
+    CHECK(list.keys.size() == 7 && list.tmpKeys.size() == 7 && list.tmpOrder.size() == 7);
+    list.Sort([](uint32_t i) { return i == 6 ? 0ull : 10ull; });   // новый объект - самый дальний
+    uint32_t sorted[7] = { 6, 3, 2, 1, 0, 4, 5 };
+    CHECK(std::equal(list.order.begin(), list.order.end(), sorted));
+    list.Resize(0);
+    list.Sort([](uint32_t) { return 0ull; });
+    CHECK(list.order.empty());
+}
+
+static volatile uint64_t g_Sink;
+
+// step - поворот камеры за кадр. Сдвигов вставки на объект - примерно плотность объектов по глубине
+// на сдвиг камеры: на 100k объектов меньше одного только при очень медленном облёте, дальше - поразрядная
+static void Benchmark(size_t count, float step, const char* label)
+{
+    Scene scene(count, 3);
+    TransparentList list;
+    list.Resize((uint32_t)count);
+    std::vector<std::pair<uint64_t, uint32_t>> pairs(count);
+    auto key = [&scene](uint32_t i) { return scene.Key(i); };
+    scene.Camera(0.0f);
+    list.Sort(key);                               // кадр с нуля не меряется
+
+    const int frames = 20;
+    double listMs = 0.0, sortMs = 0.0;
+    int radixFrames = 0;
+    uint64_t checksum = 0;
+    for (int f = 1; f <= frames; ++f)
+    {
+        scene.Camera(step * f);
+        double t = NowMs();
+        list.Sort(key);
+        listMs += NowMs() - t;
+        radixFrames += list.usedRadix;
+
+        t = NowMs();
+        for (uint32_t i = 0; i < count; ++i) pairs[i] = std::make_pair(key(i), i);
+        std::sort(pairs.begin(), pairs.end());
+        sortMs += NowMs() - t;
+        checksum += pairs[count / 2].second + list.order[count / 2];
+        for (size_t i = 0; i < count; i += 97) CHECK(list.keys[i] == pairs[i].first);
+    }
+    g_Sink = checksum;
+    std::printf("%zu objects, %s: TransparentList %.2f ms/frame (%d of %d frames radix), std::sort %.2f ms/frame (x%.1f)\n",
+        count, label, listMs / frames, radixFrames, frames, sortMs / frames, sortMs / listMs);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : 100000u;
+    TestOrdering();
+    TestEqualKeysKeepOrder();
+    TestResize();
+    Benchmark(count, 0.00005f, "slow orbit");
+    Benchmark(count, 0.002f, "orbit");
+    Benchmark(count, 0.5f, "camera jump every frame");
+    return TestResult("TransparentListTest");
+}
@@ -0,0 +1,251 @@
+// Lab5_WeightedOitTest
+// Weighted blended OIT (WeightedOit.h) против CPU-эталона - точного смешивания сзади вперёд
+// (CompositeSorted): округление до RGBA16F и R8 как у целей, вес по глубине, один слой совпадает
+// с обычным смешиванием, результат не зависит от порядка слоёв, пара кубов Lab5 и кадр 1280x720
+// со случайными прозрачными прямоугольниками - ошибка OIT в допуске приближения. Заодно время:
+// TransparentList + смешивание по порядку против накопления OIT и разрешения.
+#include <vector>
+#include <random>
+#include "TestCommon.h"
+#include "../WeightedOit.h"
+#include "../RenderQueue.h"
+
+const OitColor BACKGROUND = { 0.25f, 0.25f, 0.25f, 1.0f };   // g_ClearColor
+
+static float MaxChannelError(const OitColor& a, const OitColor& b)
+{
+    return (std::max)(fabsf(a.r - b.r), (std::max)(fabsf(a.g - b.g), fabsf(a.b - b.b)));
+}
+
+static void TestFormats()
+{
+    // RoundToHalf против округления мантиссы до 11 значащих бит через frexp
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+    int mismatches = 0;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        float v = unit(rng) * ldexpf(1.0f, (int)(rng() % 40) - 20), a = fabsf(v), expected;
+        if (a < 6.103515625e-05f) expected = nearbyintf(v * 16777216.0f) / 16777216.0f;
+        else if (a >= 65520.0f) expected = v > 0.0f ? INFINITY : -INFINITY;
+        else
+        {
+            int e;
+            float m = frexpf(v, &e);
+            expected = ldexpf(nearbyintf(ldexpf(m, 11)), e - 11);
+        }
+        mismatches += RoundToHalf(v) != expected;
+    }
+    CHECK(mismatches == 0);
+    CHECK(RoundToHalf(65504.0f) == 65504.0f);                        // наибольшее конечное
+    CHECK(RoundToHalf(65519.0f) == 65504.0f);
+    CHECK(std::isinf(RoundToHalf(65520.0f)) && RoundToHalf(-70000.0f) < 0.0f);
+    CHECK(RoundToHalf(1.0f + 1.0f / 2048) == 1.0f);                   // половина шага - к чётному
+    CHECK(RoundToHalf(1.0f + 3.0f / 2048) == 1.0f + 4.0f / 2048);
+    CHECK(RoundToHalf(0.0f) == 0.0f);
+    CHECK(std::isnan(RoundToHalf(NAN)));
+
+    CHECK(RoundToUnorm8(-1.0f) == 0.0f && RoundToUnorm8(2.0f) == 1.0f);
+    CHECK(RoundToUnorm8(0.5f) == 128.0f / 255.0f);
+    for (int i = 0; i <= 255; ++i) CHECK(RoundToUnorm8(i / 255.0f) == i / 255.0f);
+}
+
+static void TestWeight()
+{
+    // Ближе - тяжелее, вес в пределах [0.01, 3000] * alpha, пропорционален alpha
+    float previous = 1e30f;
+    for (float z = 0.1f; z < 1000.0f; z *= 1.5f)
+    {
+        float w = OitWeight(z, 1.0f);
+        CHECK(w <= previous);
+        CHECK(w >= 1e-2f && w <= 3e3f);
+        CHECK_NEAR(OitWeight(z, 0.25f), 0.25f * w, 1e-6 * w);
+        CHECK(OitWeight(-z, 1.0f) == w);
+        previous = w;
+    }
+    CHECK(OitWeight(0.0f, 1.0f) == 3e3f);
+    CHECK(OitWeight(1e4f, 1.0f) == 1e-2f);
+}
+
+static void TestSingleLayer()
+{
+    // Один слой: OIT даёт то же, что SRC_ALPHA/INV_SRC_ALPHA, с точностью до форматов целей
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float maxErr = 0.0f;
+    for (int i = 0; i < 10000; ++i)
+    {
+        OitFragment f = { { unit(rng), unit(rng), unit(rng), 0.05f + 0.9f * unit(rng) }, 0.5f + 50.0f * unit(rng) };
+        OitPixel p;
+        p.Clear();
+        p.Add(f);
+        maxErr = (std::max)(maxErr, MaxChannelError(p.Resolve(BACKGROUND), CompositeSorted(BACKGROUND, &f, 1)));
+    }
+    std::printf("one layer: max |OIT - exact| %.5f\n", maxErr);
+    CHECK(maxErr < 3.0f / 255.0f);
+
+    OitPixel empty;
+    empty.Clear();
+    OitColor r = empty.Resolve(BACKGROUND);
+    CHECK(r.r == BACKGROUND.r && r.g == BACKGROUND.g && r.b == BACKGROUND.b && r.a == BACKGROUND.a);
+}
+
+static void TestOrderIndependence()
+{
+    // Пара кубов сцены Lab5 (белый и красный, альфа 0.5, глубина 1.5..5.5) и четыре случайных слоя
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float pairErr = 0.0f, orderDelta = 0.0f, revealageDelta = 0.0f;
+    for (int i = 0; i < 10000; ++i)
+    {
+        OitFragment f[2] = { { { 1.0f, 1.0f, 1.0f, 0.5f }, 1.5f + 4.0f * unit(rng) }, { { 1.0f, 0.5f, 0.5f, 0.5f }, 1.5f + 4.0f * unit(rng) } };
+        OitPixel a, b;
+        a.Clear(); a.Add(f[0]); a.Add(f[1]);
+        b.Clear(); b.Add(f[1]); b.Add(f[0]);
+        OitColor oa = a.Resolve(BACKGROUND), ob = b.Resolve(BACKGROUND);
+        orderDelta = (std::max)(orderDelta, MaxChannelError(oa, ob));
+        pairErr = (std::max)(pairErr, MaxChannelError(oa, CompositeSorted(BACKGROUND, f, 2)));
+    }
+    for (int i = 0; i < 10000; ++i)
+    {
+        OitFragment f[4];
+        for (OitFragment& x : f) x = { { unit(rng), unit(rng), unit(rng), 0.1f + 0.8f * unit(rng) }, 1.0f + 20.0f * unit(rng) };
+        OitPixel a;
+        a.Clear();
+        for (const OitFragment& x : f) a.Add(x);
+        std::shuffle(f, f + 4, rng);
+        OitPixel b;
+        b.Clear();
+        for (const OitFragment& x : f) b.Add(x);
+        orderDelta = (std::max)(orderDelta, MaxChannelError(a.Resolve(BACKGROUND), b.Resolve(BACKGROUND)));
+        revealageDelta = (std::max)(revealageDelta, fabsf(a.revealage - b.revealage));
+    }
+    std::printf("order independence: max delta %.5f (revealage %.5f); Lab5 cube pair: max |OIT - exact| %.4f\n",
+        orderDelta, revealageDelta, pairErr);
+    // Порядок влияет только через округление: суммы в RGBA16F и произведение в R8 после каждого слоя
+    CHECK(revealageDelta <= 2.0f / 255.0f + 1e-6f);
+    CHECK(orderDelta < 3.0f / 255.0f);
+    CHECK(pairErr < 0.1f);                        // два слоя по 0.5: порядок передаёт лишь вес
+}
+
+struct Quad
+{
+    uint32_t x0, y0, x1, y1;
+    OitColor color;
+    float viewZ;
+};
+
+// Кадр с прямоугольниками постоянной глубины: эталон, OIT и сортированный путь Lab5.
+// Ошибка OIT растёт со сложностью глубины: допуски - средняя ошибка и доля пикселей с ошибкой больше 0.1
+static void TestFrame(uint32_t quadCount, double meanTolerance, double grossPercent)
+{
+    const uint32_t W = 1280, H = 720;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<Quad> quads(quadCount);
+    for (Quad& q : quads)
+    {
+        uint32_t w = 4 + rng() % 24, h = 4 + rng() % 24;
+        q.x0 = rng() % (W - w);
+        q.y0 = rng() % (H - h);
+        q.x1 = q.x0 + w;
+        q.y1 = q.y0 + h;
+        q.color = { unit(rng), unit(rng), unit(rng), 0.2f + 0.6f * unit(rng) };
+        q.viewZ = 1.0f + 20.0f * unit(rng);
+    }
+
+    // Сортированный путь: TransparentList сзади вперёд и смешивание по порядку
+    std::vector<OitColor> sorted((size_t)W * H, BACKGROUND);
+    TransparentList list;
+    list.Resize(quadCount);
+    double t = NowMs();
+    list.Sort([&quads](uint32_t i) { return QuantizeDepth(quads[i].viewZ, 0.1f, 100.0f, SORT_DEPTH_LEVELS, true); });
+    double sortMs = NowMs() - t;
+    t = NowMs();
+    for (uint32_t n = 0; n < quadCount; ++n)
+    {
+        const Quad& q = quads[list.order[n]];
+        const OitColor& c = q.color;
+        for (uint32_t y = q.y0; y < q.y1; ++y)
+            for (uint32_t x = q.x0; x < q.x1; ++x)
+            {
+                OitColor& d = sorted[(size_t)y * W + x];
+                d.r = c.r * c.a + d.r * (1.0f - c.a);
+                d.g = c.g * c.a + d.g * (1.0f - c.a);
+                d.b = c.b * c.a + d.b * (1.0f - c.a);
+            }
+    }
+    double blendMs = NowMs() - t;
+
+    // OIT: в порядке объектов, вес один на прямоугольник
+    std::vector<OitColor> frame((size_t)W * H, BACKGROUND);
+    OitCompositor oit;
+    oit.Resize(W, H);
+    t = NowMs();
+    for (const Quad& q : quads)
+    {
+        OitFragment f = { q.color, q.viewZ };
+        float w = OitWeight(q.viewZ, q.color.a);
+        for (uint32_t y = q.y0; y < q.y1; ++y)
+            for (uint32_t x = q.x0; x < q.x1; ++x) oit.Add(x, y, f, w);
+    }
+    double accumulateMs = NowMs() - t;
+    t = NowMs();
+    oit.Resolve(frame.data(), frame.data());
+    double resolveMs = NowMs() - t;
+
+    // Эталон: фрагменты каждого пикселя сзади вперёд
+    std::vector<uint32_t> start((size_t)W * H + 1, 0);
+    for (const Quad& q : quads)
+        for (uint32_t y = q.y0; y < q.y1; ++y)
+            for (uint32_t x = q.x0; x < q.x1; ++x) ++start[(size_t)y * W + x + 1];
+    for (size_t i = 1; i < start.size(); ++i) start[i] += start[i - 1];
+    std::vector<OitFragment> fragments(start.back());
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (const Quad& q : quads)
+        for (uint32_t y = q.y0; y < q.y1; ++y)
+            for (uint32_t x = q.x0; x < q.x1; ++x) fragments[fill[(size_t)y * W + x]++] = { q.color, q.viewZ };
+
+    double sumErr = 0.0;
+    float maxErr = 0.0f, sortedErr = 0.0f;
+    size_t covered = 0, overTolerance = 0, uncoveredChanged = 0, maxLayers = 0;
+    for (size_t i = 0; i + 1 < start.size(); ++i)
+    {
+        size_t layers = start[i + 1] - start[i];
+        if (!layers)
+        {
+            uncoveredChanged += MaxChannelError(frame[i], BACKGROUND) != 0.0f || MaxChannelError(sorted[i], BACKGROUND) != 0.0f;
+            continue;
+        }
+        ++covered;
+        maxLayers = (std::max)(maxLayers, layers);
+        OitColor exact = CompositeSorted(BACKGROUND, &fragments[start[i]], layers);
+        float err = MaxChannelError(frame[i], exact);
+        sumErr += err;
+        maxErr = (std::max)(maxErr, err);
+        overTolerance += err > 0.1f;
+        sortedErr = (std::max)(sortedErr, MaxChannelError(sorted[i], exact));
+    }
+    double meanErr = sumErr / (std::max)(covered, (size_t)1);
+    std::printf("%6u quads (%zu px covered, up to %zu layers): sorted path %.3f ms sort + %.2f ms blend, "
+        "OIT %.2f ms accumulate + %.2f ms resolve\n", quadCount, covered, maxLayers, sortMs, blendMs, accumulateMs, resolveMs);
+    std::printf("        OIT vs exact: mean %.4f, max %.3f, %.2f%% px over 0.1; sorted vs exact: max %.5f\n",
+        meanErr, maxErr, 100.0 * overTolerance / (std::max)(covered, (size_t)1), sortedErr);
+    CHECK(uncoveredChanged == 0);
+    // Глубина ключа - 16 бит: слои из одной корзины идут в порядке объектов, а не точной глубины
+    CHECK(sortedErr < 0.05f);
+    CHECK(meanErr < meanTolerance);
+    CHECK(overTolerance * 100.0 < covered * grossPercent);
+}
+
+int main()
+{
+    TestFormats();
+    TestWeight();
+    TestSingleLayer();
+    TestOrderIndependence();
+    TestFrame(100, 0.002, 0.1);                   // до 2 слоёв
+    TestFrame(1000, 0.015, 5.0);                  // до 4
+    TestFrame(10000, 0.1, 30.0);                  // до 14: приближение заметно, средний цвет слоёв
+    return TestResult("WeightedOitTest");
+}
@@ -0,0 +1,139 @@
+// Lab5_WeightedOit
+// Прозрачность без сортировки (weighted blended OIT, McGuire и Bavoil, 2013).
+// Прозрачные рисуются в любом порядке в две цели:
+//  - накопление (RGBA16F, сложение): premultiplied цвет и альфа, умноженные на вес по глубине;
+//  - revealage (R8, умножение на 1 - alpha): какая доля фона видна сквозь все слои.
+// Разрешение: средний цвет accum.rgb / accum.a с покрытием 1 - revealage поверх непрозрачного кадра.
+// Сумма и произведение от порядка не зависят, поэтому сортировка не нужна и пересекающиеся объекты
+// смешиваются попиксельно. Цена - приближение: порядок слоёв передаёт только вес, а он падает с глубиной.
+// CPU-эталон повторяет шейдеры Source.cpp (тот же вес, округление до форматов целей после каждого
+// смешивания) и содержит точное смешивание сзади вперёд для сравнения.
+// Без WinAPI/D3D: собирается и проверяется на любой платформе (Tests/WeightedOitTest.cpp: сравнение
+// с эталоном на кадре 1280x720 и допуски ошибки по числу слоёв).
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+struct OitColor { float r, g, b, a; };
+
+struct OitFragment
+{
+    OitColor color;   // не premultiplied, a - непрозрачность
+    float viewZ;      // глубина в пространстве камеры (SV_Position.w)
+};
+
+// Вес по глубине, формула (7) статьи: ближние слои весят больше. Как OitWeight в oitPS.
+inline float OitWeight(float viewZ, float alpha)
+{
+    float z = fabsf(viewZ);
+    float w = 10.0f / (1e-5f + powf(z / 5.0f, 2.0f) + powf(z / 200.0f, 6.0f));
+    return alpha * (std::min)((std::max)(w, 1e-2f), 3e3f);
+}
+
+// Значение после записи в RGBA16F: мантисса до 10 бит к ближайшему чётному, переполнение - бесконечность
+inline float RoundToHalf(float v)
+{
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    uint32_t sign = u & 0x80000000u, a = u & 0x7FFFFFFFu;
+    if (a > 0x7F800000u) return v;                                   // NaN
+    if (a >= 0x477FF000u) return sign ? -INFINITY : INFINITY;        // >= 65520
+    if (a < 0x38800000u) return nearbyintf(v * 16777216.0f) / 16777216.0f;   // субнормальные, шаг 2^-24
+    a = (a + 0x00000FFFu + ((a >> 13) & 1)) & 0xFFFFE000u;
+    u = sign | a;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+inline float RoundToUnorm8(float v)
+{
+    return nearbyintf((std::min)((std::max)(v, 0.0f), 1.0f) * 255.0f) / 255.0f;
+}
+
+// Один пиксель обеих целей
+struct OitPixel
+{
+    float accum[4];
+    float revealage;
+
+    void Clear()
+    {
+        accum[0] = accum[1] = accum[2] = accum[3] = 0.0f;
+        revealage = 1.0f;
+    }
+
+    // Смешивание ONE/ONE в накопление и ZERO/INV_SRC_COLOR в revealage
+    void Add(const OitFragment& f) { Add(f, OitWeight(f.viewZ, f.color.a)); }
+
+    // Вес посчитан заранее (один на примитив постоянной глубины)
+    void Add(const OitFragment& f, float w)
+    {
+        const OitColor& c = f.color;
+        accum[0] = RoundToHalf(accum[0] + c.r * c.a * w);
+        accum[1] = RoundToHalf(accum[1] + c.g * c.a * w);
+        accum[2] = RoundToHalf(accum[2] + c.b * c.a * w);
+        accum[3] = RoundToHalf(accum[3] + c.a * w);
+        revealage = RoundToUnorm8(revealage * (1.0f - c.a));
+    }
+
+    // Как resolvePS: SRC_ALPHA/INV_SRC_ALPHA поверх фона
+    OitColor Resolve(const OitColor& background) const
+    {
+        if (revealage >= 1.0f) return background;   // прозрачных здесь нет
+        float inv = 1.0f / (std::max)(accum[3], 1e-5f);
+        float coverage = 1.0f - revealage;
+        OitColor r;
+        r.r = accum[0] * inv * coverage + background.r * revealage;
+        r.g = accum[1] * inv * coverage + background.g * revealage;
+        r.b = accum[2] * inv * coverage + background.b * revealage;
+        r.a = background.a;
+        return r;
+    }
+};
+
+// Точное смешивание: слои пикселя сортируются сзади вперёд и кладутся поверх фона
+inline OitColor CompositeSorted(const OitColor& background, OitFragment* fragments, size_t count)
+{
+    std::stable_sort(fragments, fragments + count, [](const OitFragment& a, const OitFragment& b) { return a.viewZ > b.viewZ; });
+    OitColor r = background;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const OitColor& c = fragments[i].color;
+        r.r = c.r * c.a + r.r * (1.0f - c.a);
+        r.g = c.g * c.a + r.g * (1.0f - c.a);
+        r.b = c.b * c.a + r.b * (1.0f - c.a);
+    }
+    return r;
+}
+
+// Цели на весь кадр: фрагменты добавляются в любом порядке, Resolve кладёт результат поверх фона
+struct OitCompositor
+{
+    uint32_t width = 0, height = 0;
+    std::vector<OitPixel> pixels;
+
+    void Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        pixels.resize((size_t)w * h);
+        Clear();
+    }
+
+    void Clear()
+    {
+        for (OitPixel& p : pixels) p.Clear();
+    }
+
+    void Add(uint32_t x, uint32_t y, const OitFragment& f) { pixels[(size_t)y * width + x].Add(f); }
+    void Add(uint32_t x, uint32_t y, const OitFragment& f, float weight) { pixels[(size_t)y * width + x].Add(f, weight); }
+
+    // background и out - width * height цветов, можно один и тот же массив
+    void Resolve(const OitColor* background, OitColor* out) const
+    {
+        for (size_t i = 0; i < pixels.size(); ++i) out[i] = pixels[i].Resolve(background[i]);
+    }
+};
@@ -0,0 +1,92 @@
+// Lab6_ConstantRing
+// Кольцевой буфер констант для данных отрисовок: один большой динамический буфер,
+// Map один раз за кадр, каждая отрисовка получает свой кусок и привязывается по смещению
+// (VSSetConstantBuffers1/PSSetConstantBuffers1, D3D11.1).
+// Смещение привязки кратно 16 константам, поэтому куски выровнены на 256 байт.
+// Память кадра возвращается в кольцо, когда GPU закончил кадр (забор/event query):
+// в BeginFrame передаётся номер последнего завершённого кадра.
+// Без D3D11.1 кольцо работает в памяти CPU (BeginFrame с completedFrame = frameIndex - 1): оно
+// только собирает данные кадра, а отрисовка копирует свой кусок в маленький буфер через Map.
+// Без WinAPI/D3D: память отображения передаёт вызывающий, проверяется на любой платформе
+// (Lab5/Tests/ConstantRingTest.cpp - заглушка памяти GPU с кадрами в полёте и замер).
+// Файл лежит копиями в Lab5 и Lab6 (лабы - самостоятельные проекты VS), копии отличаются только
+// первой строкой (сверяет Lab5/Tests/SameHeaders.cmake).
+#pragma once
+#include <cstdint>
+#include <deque>
+
+const uint32_t CONSTANT_RING_ALIGNMENT = 256;
+
+struct ConstantAllocation
+{
+    uint32_t offset = 0;      // байты от начала буфера
+    uint32_t size = 0;        // выровненный размер
+    void* data = nullptr;     // куда писать (внутри отображённой памяти)
+
+    uint32_t FirstConstant() const { return offset / 16; }
+    uint32_t NumConstants() const { return size / 16; }
+};
+
+struct ConstantRing
+{
+    struct FrameMark { uint64_t frame, end; };
+
+    uint8_t* mapped = nullptr;      // отображение текущего кадра
+    uint32_t capacity = 0;
+    uint64_t head = 0;              // всего выделено байт (с пропусками на стыке)
+    uint64_t tail = 0;              // всего возвращено
+    uint64_t frame = 0;
+    std::deque<FrameMark> inFlight; // кадры, чья память ещё может читаться GPU
+    uint64_t failed = 0;            // отказов за всё время (кольцо переполнено)
+
+    void Init(uint32_t bytes)
+    {
+        capacity = bytes - bytes % CONSTANT_RING_ALIGNMENT;
+        head = tail = 0;
+        inFlight.clear();
+        failed = 0;
+    }
+
+    // completedFrame - последний кадр, завершённый GPU (0 - ещё ни одного)
+    void BeginFrame(uint64_t frameIndex, uint64_t completedFrame, void* mappedData)
+    {
+        Retire(completedFrame);
+        frame = frameIndex;
+        mapped = (uint8_t*)mappedData;
+    }
+
+    void Retire(uint64_t completedFrame)
+    {
+        while (!inFlight.empty() && inFlight.front().frame <= completedFrame)
+        {
+            tail = inFlight.front().end;
+            inFlight.pop_front();
+        }
+    }
+
+    // false - места нет (все куски заняты кадрами в полёте) или кадр не отображён
+    bool Allocate(uint32_t bytes, ConstantAllocation& out)
+    {
+        uint32_t size = (bytes + CONSTANT_RING_ALIGNMENT - 1) & ~(CONSTANT_RING_ALIGNMENT - 1);
+        uint64_t start = head;
+        uint32_t offset = (uint32_t)(start % capacity);
+        if (offset + size > capacity) { start += capacity - offset; offset = 0; }   // кусок не режется на стыке
+        if (!mapped || size > capacity || start + size - tail > capacity) { ++failed; return false; }
+        head = start + size;
+        out.offset = offset;
+        out.size = size;
+        out.data = mapped + offset;
+        return true;
+    }
+
+    void EndFrame()
+    {
+        FrameMark mark = { frame, head };
+        inFlight.push_back(mark);
+        mapped = nullptr;
+    }
+
+    // Первое отображение - WRITE_DISCARD, дальше NO_OVERWRITE: занятые куски не трогаются
+    bool NeedsDiscard() const { return head == 0; }
+    uint64_t Used() const { return head - tail; }
+};
@@ -2,6 +2,7 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <dxgi.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
@@ -10,6 +11,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include "ConstantRing.h"
+#include "StateCache.h"
 
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3)  \
@@ -238,11 +241,25 @@ struct SceneBuffer
     struct Light { XMFLOAT4 pos; XMFLOAT4 color; } lights[10];
     XMFLOAT4 ambientColor;
 };
-ID3D11Buffer* g_pModelBuffer1 = nullptr;
-ID3D11Buffer* g_pModelBuffer2 = nullptr;
 ID3D11Buffer* g_pViewProjBuffer = nullptr;
 ID3D11Buffer* g_pSceneBuffer = nullptr;
 
+// Кольцо констант: матрицы моделей всех кубов, Map один раз за кадр, привязка по смещению.
+// Часть кольца, занятая кадром, освобождается, когда сработал event query этого кадра.
+// Без D3D11.1 кольцо лежит в памяти CPU, а матрица каждого куба копируется в буфер b0 через
+// Map(WRITE_DISCARD) перед его отрисовкой.
+const UINT CONSTANT_RING_BYTES = 256 * 1024;
+const UINT FRAMES_IN_FLIGHT = 3;
+ID3D11DeviceContext1* g_pDeviceContext1 = nullptr;
+bool g_ConstantOffsetting = false;
+ID3D11Buffer* g_pConstantRingBuffer = nullptr;
+std::vector<uint8_t> g_ConstantRingCpu;           // кольцо без D3D11.1
+ID3D11Buffer* g_pDrawModelBuffer = nullptr;       // без D3D11.1: b0 отрисовки
+ID3D11Query* g_pFrameFences[FRAMES_IN_FLIGHT] = {};
+ConstantRing g_ConstantRing;
+UINT64 g_FrameIndex = 0;        // текущий кадр, с 1
+UINT64 g_CompletedFrame = 0;    // последний кадр, завершённый GPU
+
 // Текстурные ресурсы
 ID3D11Texture2D* g_pTexture = nullptr;
 ID3D11ShaderResourceView* g_pTextureView = nullptr;
@@ -259,6 +276,21 @@ ID3D11BlendState* g_pBlendState = nullptr;
 ID3D11DepthStencilState* g_pDepthNoWrite = nullptr;
 ID3D11RasterizerState* g_pRSCullNone = nullptr;
 
+// Кэш объектов состояния: Create*State идут через него, повторное описание возвращает готовый объект
+struct D3D11StateApi
+{
+    typedef ID3D11Device Device;
+    typedef D3D11_DEPTH_STENCIL_DESC DepthStencilDesc;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef D3D11_RASTERIZER_DESC RasterizerDesc;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef D3D11_BLEND_DESC BlendDesc;
+    typedef ID3D11BlendState BlendState;
+    typedef D3D11_SAMPLER_DESC SamplerDesc;
+    typedef ID3D11SamplerState SamplerState;
+};
+PipelineStateCache<D3D11StateApi> g_StateCache;
+
 UINT g_ClientWidth = 1280;
 UINT g_ClientHeight = 720;
 
@@ -336,19 +368,39 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     CompileShaders();
     LoadTextures();
 
-    // Создание константных буферов
+    // Создание константных буферов: кольцо для матриц моделей (без D3D11.1 - в памяти CPU и буфер
+    // на отрисовку), VP и сцена на кадр
     D3D11_BUFFER_DESC desc = {};
-    desc.ByteWidth = sizeof(ModelBuffer);
-    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
     desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    HRESULT hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pModelBuffer1);
-    assert(SUCCEEDED(hr));
-    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pModelBuffer2);
-    assert(SUCCEEDED(hr));
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    HRESULT hr;
+    if (g_ConstantOffsetting)
+    {
+        desc.ByteWidth = CONSTANT_RING_BYTES;
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pConstantRingBuffer);
+        assert(SUCCEEDED(hr));
+        SetResourceName(g_pConstantRingBuffer, "ConstantRing");
+    }
+    else
+    {
+        g_ConstantRingCpu.resize(CONSTANT_RING_BYTES);
+        desc.ByteWidth = sizeof(ModelBuffer);
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pDrawModelBuffer);
+        assert(SUCCEEDED(hr));
+        SetResourceName(g_pDrawModelBuffer, "DrawModelBuffer");
+    }
+    g_ConstantRing.Init(CONSTANT_RING_BYTES);
+
+    D3D11_QUERY_DESC fenceDesc = {};
+    fenceDesc.Query = D3D11_QUERY_EVENT;
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        hr = g_pDevice->CreateQuery(&fenceDesc, &g_pFrameFences[i]);
+        assert(SUCCEEDED(hr));
+    }
 
     desc.ByteWidth = sizeof(ViewProjBuffer);
-    desc.Usage = D3D11_USAGE_DYNAMIC;
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pViewProjBuffer);
     assert(SUCCEEDED(hr));
 
@@ -357,8 +409,6 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pSceneBuffer);
     assert(SUCCEEDED(hr));
 
-    SetResourceName(g_pModelBuffer1, "ModelBuffer1");
-    SetResourceName(g_pModelBuffer2, "ModelBuffer2");
     SetResourceName(g_pViewProjBuffer, "ViewProjBuffer");
     SetResourceName(g_pSceneBuffer, "SceneBuffer");
 
@@ -473,6 +523,16 @@ bool InitDirectX()
         return false;
     }
 
+    // Кольцу констант нужна привязка по смещению и NO_OVERWRITE для константных буферов (D3D11.1),
+    // без них - Map на отрисовку
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (FAILED(g_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+        options = D3D11_FEATURE_DATA_D3D11_OPTIONS();
+    hr = g_pDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&g_pDeviceContext1);
+    g_ConstantOffsetting = SUCCEEDED(hr) && options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+    if (!g_ConstantOffsetting)
+        OutputDebugStringA("Constant buffer offsetting (D3D11.1) is not supported: per-draw Map\n");
+
     DXGI_SWAP_CHAIN_DESC scd = {};
     scd.BufferCount = 2;
     scd.BufferDesc.Width = g_ClientWidth;
@@ -882,8 +942,8 @@ void LoadTextures()
     sampDesc.MaxAnisotropy = 16;
     sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
     sampDesc.BorderColor[0] = sampDesc.BorderColor[1] = sampDesc.BorderColor[2] = sampDesc.BorderColor[3] = 1.0f;
-    hr = g_pDevice->CreateSamplerState(&sampDesc, &g_pSampler);
-    if (FAILED(hr)) return;
+    g_pSampler = g_StateCache.Sampler(g_pDevice, sampDesc);
+    if (!g_pSampler) return;
 
     // Состояние для прозрачных объектов
     D3D11_BLEND_DESC blendDesc = {};
@@ -895,7 +955,7 @@ void LoadTextures()
     blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
     blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
     blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-    g_pDevice->CreateBlendState(&blendDesc, &g_pBlendState);
+    g_pBlendState = g_StateCache.Blend(g_pDevice, blendDesc);
 
     // Depth state без записи
     D3D11_DEPTH_STENCIL_DESC dsDesc = {};
@@ -903,14 +963,14 @@ void LoadTextures()
     dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
     dsDesc.DepthFunc = D3D11_COMPARISON_LESS;
     dsDesc.StencilEnable = FALSE;
-    g_pDevice->CreateDepthStencilState(&dsDesc, &g_pDepthNoWrite);
+    g_pDepthNoWrite = g_StateCache.DepthStencil(g_pDevice, dsDesc);
 
     // Растеризатор без отсечения (для прозрачных и skybox)
     D3D11_RASTERIZER_DESC rsDesc = {};
     rsDesc.FillMode = D3D11_FILL_SOLID;
     rsDesc.CullMode = D3D11_CULL_NONE;
     rsDesc.FrontCounterClockwise = FALSE;
-    g_pDevice->CreateRasterizerState(&rsDesc, &g_pRSCullNone);
+    g_pRSCullNone = g_StateCache.Rasterizer(g_pDevice, rsDesc);
 
     // Загрузка cubemap (skybox)
     std::wstring skyboxPath = basePath + L"skybox\\";
@@ -987,6 +1047,43 @@ void LoadTextures()
     }
 }
 
+// ------------------------------------------------------------------
+// Кольцо констант: начало кадра - ожидание заборов и Map, конец - забор кадра
+// ------------------------------------------------------------------
+void BeginConstantFrame()
+{
+    ++g_FrameIndex;
+    // Event query кадра отвечает TRUE, когда GPU дошёл до его End.
+    // Запрос кадра g_FrameIndex - FRAMES_IN_FLIGHT переиспользуется сейчас, его ждём обязательно.
+    while (g_CompletedFrame + 1 < g_FrameIndex)
+    {
+        UINT64 next = g_CompletedFrame + 1;
+        bool mustWait = next + FRAMES_IN_FLIGHT <= g_FrameIndex;
+        BOOL done = FALSE;
+        HRESULT hr = g_pDeviceContext->GetData(g_pFrameFences[next % FRAMES_IN_FLIGHT], &done, sizeof(done), mustWait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        if (FAILED(hr) || (hr == S_OK && done)) { g_CompletedFrame = next; continue; }   // ошибка устройства - не зависаем
+        if (!mustWait) break;
+    }
+
+    // Кольцо в памяти CPU GPU не читает: прошлые кадры освобождаются сразу
+    if (!g_ConstantOffsetting)
+    {
+        g_ConstantRing.BeginFrame(g_FrameIndex, g_FrameIndex - 1, g_ConstantRingCpu.data());
+        return;
+    }
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    D3D11_MAP mapType = g_ConstantRing.NeedsDiscard() ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+    if (FAILED(g_pDeviceContext->Map(g_pConstantRingBuffer, 0, mapType, 0, &mapped)))
+        mapped.pData = nullptr;
+    g_ConstantRing.BeginFrame(g_FrameIndex, g_CompletedFrame, mapped.pData);
+}
+
+void EndConstantFrame()
+{
+    g_pDeviceContext->End(g_pFrameFences[g_FrameIndex % FRAMES_IN_FLIGHT]);
+    g_ConstantRing.EndFrame();
+}
+
 // ------------------------------------------------------------------
 // Обновление камеры
 // ------------------------------------------------------------------
@@ -1055,11 +1152,8 @@ void RenderFrame()
         dsSky.DepthEnable = TRUE;
         dsSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
         dsSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-        ID3D11DepthStencilState* pDSSky = nullptr;
-        g_pDevice->CreateDepthStencilState(&dsSky, &pDSSky);
-        g_pDeviceContext->OMSetDepthStencilState(pDSSky, 0);
+        g_pDeviceContext->OMSetDepthStencilState(g_StateCache.DepthStencil(g_pDevice, dsSky), 0);
         g_pDeviceContext->RSSetState(g_pRSCullNone);
-        SAFE_RELEASE(pDSSky);
 
         g_pDeviceContext->VSSetShader(g_pSkyboxVS, nullptr, 0);
         g_pDeviceContext->PSSetShader(g_pSkyboxPS, nullptr, 0);
@@ -1114,14 +1208,21 @@ void RenderFrame()
     XMMATRIX model1 = XMMatrixRotationY(angle) * XMMatrixTranslation(0.0f, 0.0f, 0.0f);
     XMMATRIX model2 = XMMatrixRotationY(angle + XM_PI) * XMMatrixTranslation(0.0f, 0.0f, 2.0f);
 
-    ModelBuffer modelData;
-    XMStoreFloat4x4((XMFLOAT4X4*)&modelData.model, XMMatrixTranspose(model1));
-    g_pDeviceContext->UpdateSubresource(g_pModelBuffer1, 0, nullptr, &modelData, 0, 0);
-    XMStoreFloat4x4((XMFLOAT4X4*)&modelData.model, XMMatrixTranspose(model2));
-    g_pDeviceContext->UpdateSubresource(g_pModelBuffer2, 0, nullptr, &modelData, 0, 0);
+    // Матрицы моделей - в кольцо констант, одно отображение на кадр
+    XMMATRIX models[2] = { model1, model2 };
+    ConstantAllocation modelConstants[2];
+    UINT cubeCount = 0;
+    BeginConstantFrame();
+    for (; cubeCount < 2; ++cubeCount)
+    {
+        if (!g_ConstantRing.Allocate(sizeof(ModelBuffer), modelConstants[cubeCount])) break;   // кольцо переполнено
+        XMStoreFloat4x4((XMFLOAT4X4*)modelConstants[cubeCount].data, XMMatrixTranspose(models[cubeCount]));
+    }
+    if (g_ConstantRing.mapped && g_ConstantOffsetting)
+        g_pDeviceContext->Unmap(g_pConstantRingBuffer, 0);
 
-    ID3D11Buffer* cbsCube[] = { g_pModelBuffer1, g_pViewProjBuffer, g_pSceneBuffer };
-    g_pDeviceContext->VSSetConstantBuffers(0, 3, cbsCube);
+    ID3D11Buffer* cbsCube[] = { g_pViewProjBuffer, g_pSceneBuffer };
+    g_pDeviceContext->VSSetConstantBuffers(1, 2, cbsCube);
     g_pDeviceContext->PSSetConstantBuffers(2, 1, &g_pSceneBuffer);
 
     UINT stride = sizeof(TextureNormalTangentVertex);
@@ -1137,11 +1238,26 @@ void RenderFrame()
     ID3D11ShaderResourceView* cubeSRV[] = { g_pTextureView, g_pNormalMapView };
     g_pDeviceContext->PSSetShaderResources(0, 2, cubeSRV);
 
-    g_pDeviceContext->DrawIndexed(36, 0, 0); // первый куб
-
-    cbsCube[0] = g_pModelBuffer2;
-    g_pDeviceContext->VSSetConstantBuffers(0, 3, cbsCube);
-    g_pDeviceContext->DrawIndexed(36, 0, 0); // второй куб
+    // Каждый куб - своё окно кольца в слоте b0 (без D3D11.1 - копия в буфер отрисовки)
+    if (!g_ConstantOffsetting)
+        g_pDeviceContext->VSSetConstantBuffers(0, 1, &g_pDrawModelBuffer);
+    for (UINT i = 0; i < cubeCount; ++i)
+    {
+        if (g_ConstantOffsetting)
+        {
+            UINT first = modelConstants[i].FirstConstant(), num = modelConstants[i].NumConstants();
+            g_pDeviceContext1->VSSetConstantBuffers1(0, 1, &g_pConstantRingBuffer, &first, &num);
+        }
+        else
+        {
+            D3D11_MAPPED_SUBRESOURCE mappedModel;
+            if (FAILED(g_pDeviceContext->Map(g_pDrawModelBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedModel))) continue;
+            memcpy(mappedModel.pData, modelConstants[i].data, sizeof(ModelBuffer));
+            g_pDeviceContext->Unmap(g_pDrawModelBuffer, 0);
+        }
+        g_pDeviceContext->DrawIndexed(36, 0, 0);
+    }
+    EndConstantFrame();
 
     g_pSwapChain->Present(1, 0);
 }
@@ -1200,8 +1316,9 @@ void CleanupDirectX()
     if (g_pDeviceContext)
         g_pDeviceContext->ClearState();
 
-    SAFE_RELEASE(g_pModelBuffer1);
-    SAFE_RELEASE(g_pModelBuffer2);
+    SAFE_RELEASE(g_pConstantRingBuffer);
+    SAFE_RELEASE(g_pDrawModelBuffer);
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i) SAFE_RELEASE(g_pFrameFences[i]);
     SAFE_RELEASE(g_pViewProjBuffer);
     SAFE_RELEASE(g_pSceneBuffer);
     SAFE_RELEASE(g_pInputLayout);
@@ -1223,10 +1340,16 @@ void CleanupDirectX()
     SAFE_RELEASE(g_pNormalMapTexture);
     SAFE_RELEASE(g_pCubemapView);
     SAFE_RELEASE(g_pCubemapTexture);
-    SAFE_RELEASE(g_pSampler);
-    SAFE_RELEASE(g_pBlendState);
-    SAFE_RELEASE(g_pDepthNoWrite);
-    SAFE_RELEASE(g_pRSCullNone);
+    // Объекты состояния принадлежат кэшу
+    StateCacheStats stateStats = g_StateCache.Stats();
+    char stateMsg[128];
+    sprintf_s(stateMsg, "State cache: %llu hits, %llu misses, %u objects\n", stateStats.hits, stateStats.misses, (unsigned)g_StateCache.Size());
+    OutputDebugStringA(stateMsg);
+    g_StateCache.Clear();
+    g_pSampler = nullptr;
+    g_pBlendState = nullptr;
+    g_pDepthNoWrite = nullptr;
+    g_pRSCullNone = nullptr;
 
 #ifdef _DEBUG
     if (g_pDevice)
@@ -1240,6 +1363,7 @@ void CleanupDirectX()
     }
 #endif
 
+    SAFE_RELEASE(g_pDeviceContext1);
     SAFE_RELEASE(g_pDeviceContext);
     SAFE_RELEASE(g_pDevice);
 }
\ No newline at end of file
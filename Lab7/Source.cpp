@@ -11,6 +11,7 @@
 #include <vector>
 #include <algorithm>
 #include <cstring>
+#include "StateCache.h"
 
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3)  \
@@ -221,6 +222,21 @@ ID3D11ShaderResourceView* g_pCubemapView = nullptr;
 ID3D11RasterizerState* g_pRSCullNone = nullptr;
 ID3D11RasterizerState* g_pRSCullBack = nullptr;
 
+// Кэш объектов состояния: Create*State идут через него, повторное описание возвращает готовый объект
+struct D3D11StateApi
+{
+    typedef ID3D11Device Device;
+    typedef D3D11_DEPTH_STENCIL_DESC DepthStencilDesc;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef D3D11_RASTERIZER_DESC RasterizerDesc;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef D3D11_BLEND_DESC BlendDesc;
+    typedef ID3D11BlendState BlendState;
+    typedef D3D11_SAMPLER_DESC SamplerDesc;
+    typedef ID3D11SamplerState SamplerState;
+};
+PipelineStateCache<D3D11StateApi> g_StateCache;
+
 UINT g_ClientWidth = 1280;
 UINT g_ClientHeight = 720;
 
@@ -903,7 +919,7 @@ void LoadTextures()
     sampDesc.MaxAnisotropy = 16;
     sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
     sampDesc.BorderColor[0] = sampDesc.BorderColor[1] = sampDesc.BorderColor[2] = sampDesc.BorderColor[3] = 1.0f;
-    g_pDevice->CreateSamplerState(&sampDesc, &g_pSampler);
+    g_pSampler = g_StateCache.Sampler(g_pDevice, sampDesc);
 
     // Cubemap
     std::wstring skyboxPath = basePath + L"skybox\\";
@@ -966,9 +982,9 @@ void LoadTextures()
     rsDesc.FillMode = D3D11_FILL_SOLID;
     rsDesc.CullMode = D3D11_CULL_BACK;
     rsDesc.FrontCounterClockwise = FALSE;
-    g_pDevice->CreateRasterizerState(&rsDesc, &g_pRSCullBack);
+    g_pRSCullBack = g_StateCache.Rasterizer(g_pDevice, rsDesc);
     rsDesc.CullMode = D3D11_CULL_NONE;
-    g_pDevice->CreateRasterizerState(&rsDesc, &g_pRSCullNone);
+    g_pRSCullNone = g_StateCache.Rasterizer(g_pDevice, rsDesc);
 }
 
 // ------------------------------------------------------------------
@@ -1290,11 +1306,8 @@ void RenderFrame()
         }
         D3D11_DEPTH_STENCIL_DESC dsSky = {};
         dsSky.DepthEnable = TRUE; dsSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO; dsSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-        ID3D11DepthStencilState* pDSSky = nullptr;
-        g_pDevice->CreateDepthStencilState(&dsSky, &pDSSky);
-        g_pDeviceContext->OMSetDepthStencilState(pDSSky, 0);
+        g_pDeviceContext->OMSetDepthStencilState(g_StateCache.DepthStencil(g_pDevice, dsSky), 0);
         g_pDeviceContext->RSSetState(g_pRSCullNone);
-        SAFE_RELEASE(pDSSky);
         g_pDeviceContext->VSSetShader(g_pSkyboxVS, nullptr, 0);
         g_pDeviceContext->PSSetShader(g_pSkyboxPS, nullptr, 0);
         g_pDeviceContext->IASetInputLayout(g_pSkyboxInputLayout);
@@ -1479,9 +1492,15 @@ void CleanupDirectX()
     SAFE_RELEASE(g_pSwapChain);
     SAFE_RELEASE(g_pTextureView);
     SAFE_RELEASE(g_pCubemapView);
-    SAFE_RELEASE(g_pSampler);
-    SAFE_RELEASE(g_pRSCullBack);
-    SAFE_RELEASE(g_pRSCullNone);
+    // Объекты состояния принадлежат кэшу
+    StateCacheStats stateStats = g_StateCache.Stats();
+    char stateMsg[128];
+    sprintf_s(stateMsg, "State cache: %llu hits, %llu misses, %u objects\n", stateStats.hits, stateStats.misses, (unsigned)g_StateCache.Size());
+    OutputDebugStringA(stateMsg);
+    g_StateCache.Clear();
+    g_pSampler = nullptr;
+    g_pRSCullBack = nullptr;
+    g_pRSCullNone = nullptr;
     SAFE_RELEASE(g_pNormalMapView);
     SAFE_RELEASE(g_pTexture);
     SAFE_RELEASE(g_pNormalMapTexture);
@@ -0,0 +1,509 @@
+// Lab8_Bloom
+// Свечение (bloom) по пирамиде уменьшенных копий кадра вместо размытия в полном разрешении.
+// Спуск: уровень 0 - половина кадра, каждый следующий вдвое меньше; фильтр [1 3 3 1] / 8 по каждой оси
+// с прореживанием в 2 раза. На уровне 0 после фильтра отсекаются тёмные пиксели (порог с мягким коленом).
+// Подъём: уровень i + 1 растягивается в 2 раза фильтром [1 3] / 4 (ровно одна билинейная выборка)
+// и смешивается с уровнем i: i = up * scatter + i * (1 - scatter). Итог уровня 0 растягивается
+// до кадра и добавляется к сцене с весом intensity.
+// Радиус задаёт scatter - доля широких уровней, а не число пикселей фильтра, поэтому цена не зависит
+// от радиуса: все уровни вместе - около трети пикселей кадра.
+// Шейдеры bloomDownPS/bloomUpPS в Source.cpp считают то же самое билинейными выборками по 2D
+// (четыре выборки на [1 3 3 1] x [1 3 3 1]); здесь фильтры раздельные - сначала столбец, затем строка.
+// Край - clamp, как у сэмплера. Ядра AVX2 - по 8 пикселей строки, выбор при запуске (CpuPostProcess.h).
+// Без WinAPI/D3D: собирается и проверяется на любой платформе (Tests/BloomTest.cpp: сверка с эмуляцией
+// шейдеров с допуском fp16 и 1 младшего разряда, цена при разном scatter).
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "CpuPostProcess.h"
+
+const uint32_t BLOOM_MAX_LEVELS = 6;
+const uint32_t BLOOM_MIN_SIZE = 8;           // уровни меньше по короткой стороне не строятся
+const uint32_t BLOOM_ROWS_PER_GROUP = 8;     // строк на задание потоку
+const uint32_t BLOOM_ROW_PAD = 4;            // clamp-поля временной строки слева и справа
+
+struct BloomSettings
+{
+    float threshold = 0.8f;   // яркость (max по каналам), с которой начинается свечение
+    float knee = 0.4f;        // ширина мягкого перехода около порога
+    float intensity = 0.6f;   // вес свечения при сложении со сценой
+    float scatter = 0.7f;     // 0 - только узкое свечение уровня 0, 1 - только самые широкие уровни
+};
+
+inline uint32_t BloomLevelSize(uint32_t size) { return (std::max)(1u, (size + 1) / 2); }
+
+// Уровней для кадра width x height; уровень 0 строится всегда
+inline uint32_t BloomLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t count = 0;
+    while (count < BLOOM_MAX_LEVELS)
+    {
+        width = BloomLevelSize(width);
+        height = BloomLevelSize(height);
+        if (count > 0 && (std::min)(width, height) < BLOOM_MIN_SIZE) break;
+        ++count;
+    }
+    return count;
+}
+
+// Множитель цвета по яркости br; тот же порядок операций, что в bloomDownPS
+inline float BloomPrefilterWeight(float br, const BloomSettings& s)
+{
+    float soft = (std::min)((std::max)(br - s.threshold + s.knee, 0.0f), 2.0f * s.knee);
+    soft = soft * soft / (4.0f * s.knee + 1e-4f);
+    return (std::max)(soft, br - s.threshold) / (std::max)(br, 1e-4f);
+}
+
+// Уровень пирамиды: каналы отдельными плоскостями (альфа свечению не нужна)
+struct BloomLevel
+{
+    uint32_t width = 0, height = 0;
+    std::vector<float> r, g, b;
+
+    float* Row(std::vector<float>& plane, uint32_t y) { return plane.data() + (size_t)y * width; }
+};
+
+// ------------------------------------------------------------------
+// Строковые ядра: скалярные (эталон и хвост строки) и AVX2
+// ------------------------------------------------------------------
+// Столбец спуска: строки 2y - 1 .. 2y + 2 источника
+inline void BloomDownColumnScalar(const float* r0, const float* r1, const float* r2, const float* r3, float* out, uint32_t begin, uint32_t n)
+{
+    for (uint32_t x = begin; x < n; ++x) out[x] = (r0[x] + 3.0f * (r1[x] + r2[x]) + r3[x]) * 0.125f;
+}
+
+// Столбец спуска из кадра RGBA8: UNORM -> float один раз, на сумму
+inline void BloomDownColumnRgba8Scalar(const uint32_t* const rows[4], float* outR, float* outG, float* outB, uint32_t begin, uint32_t n)
+{
+    const float k = 0.125f / 255.0f;
+    for (uint32_t x = begin; x < n; ++x)
+    {
+        float c[4][3];
+        for (int i = 0; i < 4; ++i)
+        {
+            uint32_t v = rows[i][x];
+            c[i][0] = (float)(v & 0xFF);
+            c[i][1] = (float)((v >> 8) & 0xFF);
+            c[i][2] = (float)((v >> 16) & 0xFF);
+        }
+        outR[x] = (c[0][0] + 3.0f * (c[1][0] + c[2][0]) + c[3][0]) * k;
+        outG[x] = (c[0][1] + 3.0f * (c[1][1] + c[2][1]) + c[3][1]) * k;
+        outB[x] = (c[0][2] + 3.0f * (c[1][2] + c[2][2]) + c[3][2]) * k;
+    }
+}
+
+// Строка спуска: t - временная строка с clamp-полями, t[-1] и t[width..] заполнены
+inline void BloomDownRowScalar(const float* t, float* out, uint32_t begin, uint32_t n)
+{
+    for (uint32_t x = begin; x < n; ++x)
+    {
+        const float* p = t + 2 * x;
+        out[x] = (p[-1] + 3.0f * (p[0] + p[1]) + p[2]) * 0.125f;
+    }
+}
+
+inline void BloomPrefilterScalar(float* r, float* g, float* b, const BloomSettings& s, uint32_t begin, uint32_t n)
+{
+    for (uint32_t x = begin; x < n; ++x)
+    {
+        float w = BloomPrefilterWeight((std::max)(r[x], (std::max)(g[x], b[x])), s);
+        r[x] *= w; g[x] *= w; b[x] *= w;
+    }
+}
+
+// Столбец подъёма: near - ближняя строка уровня ниже, far - соседняя
+inline void BloomUpColumnScalar(const float* nearRow, const float* farRow, float* out, uint32_t begin, uint32_t n)
+{
+    for (uint32_t x = begin; x < n; ++x) out[x] = nearRow[x] * 0.75f + farRow[x] * 0.25f;
+}
+
+// Строка подъёма: fine-пиксели 2k и 2k + 1 из t[k - 1], t[k], t[k + 1]
+inline void BloomUpRowScalar(const float* t, float* out, uint32_t begin, uint32_t fineWidth)
+{
+    for (uint32_t x = begin; x < fineWidth; ++x)
+    {
+        const float* p = t + (x >> 1);
+        out[x] = p[0] * 0.75f + p[(x & 1) ? 1 : -1] * 0.25f;
+    }
+}
+
+inline void BloomBlendScalar(const float* up, float* dst, float scatter, uint32_t begin, uint32_t n)
+{
+    for (uint32_t x = begin; x < n; ++x) dst[x] = up[x] * scatter + dst[x] * (1.0f - scatter);
+}
+
+// Сцена + свечение, выход RGBA32F; альфа - из сцены
+inline void BloomCompositeScalar(const uint32_t* scene, const float* r, const float* g, const float* b, float intensity, float* out, uint32_t begin, uint32_t n)
+{
+    const float k = 1.0f / 255.0f;
+    for (uint32_t x = begin; x < n; ++x)
+    {
+        uint32_t c = scene[x];
+        out[x * 4 + 0] = (c & 0xFF) * k + r[x] * intensity;
+        out[x * 4 + 1] = ((c >> 8) & 0xFF) * k + g[x] * intensity;
+        out[x * 4 + 2] = ((c >> 16) & 0xFF) * k + b[x] * intensity;
+        out[x * 4 + 3] = (c >> 24) * k;
+    }
+}
+
+#ifdef POST_X64
+POST_AVX2 inline void BloomDownColumnAvx2(const float* r0, const float* r1, const float* r2, const float* r3, float* out, uint32_t n)
+{
+    const __m256 three = _mm256_set1_ps(3.0f), eighth = _mm256_set1_ps(0.125f);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 mid = _mm256_mul_ps(three, _mm256_add_ps(_mm256_loadu_ps(r1 + x), _mm256_loadu_ps(r2 + x)));
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(r0 + x), mid), _mm256_loadu_ps(r3 + x));
+        _mm256_storeu_ps(out + x, _mm256_mul_ps(sum, eighth));
+    }
+    BloomDownColumnScalar(r0, r1, r2, r3, out, x, n);
+}
+
+POST_AVX2 inline __m256 BloomUnpackChannelAvx2(__m256i c, int shift)
+{
+    return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, shift), _mm256_set1_epi32(0xFF)));
+}
+
+POST_AVX2 inline void BloomDownColumnRgba8Avx2(const uint32_t* const rows[4], float* outR, float* outG, float* outB, uint32_t n)
+{
+    const __m256 three = _mm256_set1_ps(3.0f), k = _mm256_set1_ps(0.125f / 255.0f);
+    float* out[3] = { outR, outG, outB };
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256i c[4];
+        for (int i = 0; i < 4; ++i) c[i] = _mm256_loadu_si256((const __m256i*)(rows[i] + x));
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            __m256 mid = _mm256_mul_ps(three, _mm256_add_ps(BloomUnpackChannelAvx2(c[1], ch * 8), BloomUnpackChannelAvx2(c[2], ch * 8)));
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(BloomUnpackChannelAvx2(c[0], ch * 8), mid), BloomUnpackChannelAvx2(c[3], ch * 8));
+            _mm256_storeu_ps(out[ch] + x, _mm256_mul_ps(sum, k));
+        }
+    }
+    BloomDownColumnRgba8Scalar(rows, outR, outG, outB, x, n);
+}
+
+// p[0..15] -> чётные и нечётные элементы по порядку
+POST_AVX2 inline void BloomDeinterleaveAvx2(const float* p, __m256& even, __m256& odd)
+{
+    __m256 a = _mm256_loadu_ps(p), b = _mm256_loadu_ps(p + 8);
+    even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+    odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+POST_AVX2 inline void BloomDownRowAvx2(const float* t, float* out, uint32_t n)
+{
+    const __m256 three = _mm256_set1_ps(3.0f), eighth = _mm256_set1_ps(0.125f);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 prevEven, prevOdd, even, odd, nextEven, nextOdd;
+        BloomDeinterleaveAvx2(t + 2 * x - 2, prevEven, prevOdd);   // prevOdd = t[2x - 1 + 2j]
+        BloomDeinterleaveAvx2(t + 2 * x, even, odd);
+        BloomDeinterleaveAvx2(t + 2 * x + 2, nextEven, nextOdd);   // nextEven = t[2x + 2 + 2j]
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(prevOdd, _mm256_mul_ps(three, _mm256_add_ps(even, odd))), nextEven);
+        _mm256_storeu_ps(out + x, _mm256_mul_ps(sum, eighth));
+    }
+    BloomDownRowScalar(t, out, x, n);
+}
+
+POST_AVX2 inline void BloomPrefilterAvx2(float* r, float* g, float* b, const BloomSettings& s, uint32_t n)
+{
+    const __m256 zero = _mm256_setzero_ps(), threshold = _mm256_set1_ps(s.threshold), knee = _mm256_set1_ps(s.knee);
+    const __m256 knee2 = _mm256_set1_ps(2.0f * s.knee), kneeDiv = _mm256_set1_ps(4.0f * s.knee + 1e-4f), eps = _mm256_set1_ps(1e-4f);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 vr = _mm256_loadu_ps(r + x), vg = _mm256_loadu_ps(g + x), vb = _mm256_loadu_ps(b + x);
+        __m256 br = _mm256_max_ps(vr, _mm256_max_ps(vg, vb));
+        __m256 over = _mm256_sub_ps(br, threshold);
+        __m256 soft = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(over, knee), zero), knee2);
+        soft = _mm256_div_ps(_mm256_mul_ps(soft, soft), kneeDiv);
+        __m256 w = _mm256_div_ps(_mm256_max_ps(soft, over), _mm256_max_ps(br, eps));
+        _mm256_storeu_ps(r + x, _mm256_mul_ps(vr, w));
+        _mm256_storeu_ps(g + x, _mm256_mul_ps(vg, w));
+        _mm256_storeu_ps(b + x, _mm256_mul_ps(vb, w));
+    }
+    BloomPrefilterScalar(r, g, b, s, x, n);
+}
+
+POST_AVX2 inline void BloomUpColumnAvx2(const float* nearRow, const float* farRow, float* out, uint32_t n)
+{
+    const __m256 wn = _mm256_set1_ps(0.75f), wf = _mm256_set1_ps(0.25f);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(nearRow + x), wn), _mm256_mul_ps(_mm256_loadu_ps(farRow + x), wf)));
+    BloomUpColumnScalar(nearRow, farRow, out, x, n);
+}
+
+POST_AVX2 inline void BloomUpRowAvx2(const float* t, float* out, uint32_t fineWidth)
+{
+    const __m256 wn = _mm256_set1_ps(0.75f), wf = _mm256_set1_ps(0.25f);
+    uint32_t k = 0;
+    for (; 2 * (k + 8) <= fineWidth; k += 8)
+    {
+        __m256 nearV = _mm256_mul_ps(_mm256_loadu_ps(t + k), wn);
+        __m256 even = _mm256_add_ps(nearV, _mm256_mul_ps(_mm256_loadu_ps(t + k - 1), wf));
+        __m256 odd = _mm256_add_ps(nearV, _mm256_mul_ps(_mm256_loadu_ps(t + k + 1), wf));
+        // Чередование: e0 o0 e1 o1 ... по 128-битным половинам
+        __m256 lo = _mm256_unpacklo_ps(even, odd), hi = _mm256_unpackhi_ps(even, odd);
+        _mm256_storeu_ps(out + 2 * k, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 2 * k + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    BloomUpRowScalar(t, out, 2 * k, fineWidth);
+}
+
+POST_AVX2 inline void BloomBlendAvx2(const float* up, float* dst, float scatter, uint32_t n)
+{
+    const __m256 s = _mm256_set1_ps(scatter), keep = _mm256_set1_ps(1.0f - scatter);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+        _mm256_storeu_ps(dst + x, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(up + x), s), _mm256_mul_ps(_mm256_loadu_ps(dst + x), keep)));
+    BloomBlendScalar(up, dst, scatter, x, n);
+}
+
+POST_AVX2 inline void BloomCompositeAvx2(const uint32_t* scene, const float* r, const float* g, const float* b, float intensity, float* out, uint32_t n)
+{
+    const __m256 k = _mm256_set1_ps(1.0f / 255.0f), w = _mm256_set1_ps(intensity);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(scene + x));
+        __m256 vr = _mm256_add_ps(_mm256_mul_ps(BloomUnpackChannelAvx2(c, 0), k), _mm256_mul_ps(_mm256_loadu_ps(r + x), w));
+        __m256 vg = _mm256_add_ps(_mm256_mul_ps(BloomUnpackChannelAvx2(c, 8), k), _mm256_mul_ps(_mm256_loadu_ps(g + x), w));
+        __m256 vb = _mm256_add_ps(_mm256_mul_ps(BloomUnpackChannelAvx2(c, 16), k), _mm256_mul_ps(_mm256_loadu_ps(b + x), w));
+        __m256 va = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c, 24)), k);
+        // Столбцы r, g, b, a -> пиксели RGBA: транспозиция 4x4 в каждой половине
+        __m128 p0 = _mm256_castps256_ps128(vr), p1 = _mm256_castps256_ps128(vg), p2 = _mm256_castps256_ps128(vb), p3 = _mm256_castps256_ps128(va);
+        __m128 q0 = _mm256_extractf128_ps(vr, 1), q1 = _mm256_extractf128_ps(vg, 1), q2 = _mm256_extractf128_ps(vb, 1), q3 = _mm256_extractf128_ps(va, 1);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+        float* o = out + x * 4;
+        _mm_storeu_ps(o, p0); _mm_storeu_ps(o + 4, p1); _mm_storeu_ps(o + 8, p2); _mm_storeu_ps(o + 12, p3);
+        _mm_storeu_ps(o + 16, q0); _mm_storeu_ps(o + 20, q1); _mm_storeu_ps(o + 24, q2); _mm_storeu_ps(o + 28, q3);
+    }
+    BloomCompositeScalar(scene, r, g, b, intensity, out, x, n);
+}
+#endif
+
+struct BloomStats
+{
+    uint32_t levels = 0;
+    uint64_t levelPixels = 0;   // сумма пикселей уровней
+    uint64_t framePixels = 0;
+    bool avx2 = false;
+    double downMs = 0.0, upMs = 0.0, compositeMs = 0.0;
+    double TotalMs() const { return downMs + upMs + compositeMs; }
+};
+
+// Пирамида кадра; уровни переиспользуются между кадрами одного размера
+struct BloomPyramid
+{
+    std::vector<BloomLevel> levels;
+    uint32_t width = 0, height = 0;
+    BloomStats stats;
+
+    void Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        levels.resize(BloomLevelCount(w, h));
+        for (size_t i = 0; i < levels.size(); ++i)
+        {
+            BloomLevel& l = levels[i];
+            l.width = BloomLevelSize(i ? levels[i - 1].width : w);
+            l.height = BloomLevelSize(i ? levels[i - 1].height : h);
+            size_t n = (size_t)l.width * l.height;
+            l.r.resize(n); l.g.resize(n); l.b.resize(n);
+        }
+    }
+
+    // Спуск и подъём по кадру RGBA8 (R в младшем байте); итог - в levels[0]
+    void Build(const uint32_t* scene, const BloomSettings& s, uint32_t threadCount, bool useSimd = true)
+    {
+        static const bool hasAvx2 = PostCpuHasAvx2();
+        bool avx2 = useSimd && hasAvx2;
+        stats = BloomStats();
+        stats.levels = (uint32_t)levels.size();
+        stats.framePixels = (uint64_t)width * height;
+        stats.avx2 = avx2;
+        for (const BloomLevel& l : levels) stats.levelPixels += (uint64_t)l.width * l.height;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < (uint32_t)levels.size(); ++i)
+        {
+            BloomLevel& dst = levels[i];
+            uint32_t srcWidth = i ? levels[i - 1].width : width, srcHeight = i ? levels[i - 1].height : height;
+            ForRows(dst.height, threadCount, srcWidth, [&](uint32_t y, float* t[3])
+            {
+                uint32_t rows[4];
+                for (int k = 0; k < 4; ++k) rows[k] = (uint32_t)(std::min)((std::max)((int)(2 * y) - 1 + k, 0), (int)srcHeight - 1);
+                if (i == 0)
+                {
+                    const uint32_t* src[4];
+                    for (int k = 0; k < 4; ++k) src[k] = scene + (size_t)rows[k] * width;
+                    DownColumnRgba8(avx2, src, t, srcWidth);
+                }
+                else
+                {
+                    BloomLevel& prev = levels[i - 1];
+                    std::vector<float>* planes[3] = { &prev.r, &prev.g, &prev.b };
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const float* p = planes[c]->data();
+                        DownColumn(avx2, p + (size_t)rows[0] * srcWidth, p + (size_t)rows[1] * srcWidth, p + (size_t)rows[2] * srcWidth, p + (size_t)rows[3] * srcWidth, t[c], srcWidth);
+                    }
+                }
+                float* out[3] = { dst.Row(dst.r, y), dst.Row(dst.g, y), dst.Row(dst.b, y) };
+                for (int c = 0; c < 3; ++c)
+                {
+                    PadRow(t[c], srcWidth);
+                    DownRow(avx2, t[c], out[c], dst.width);
+                }
+                if (i == 0) Prefilter(avx2, out[0], out[1], out[2], s, dst.width);
+            });
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        stats.downMs = std::chrono::duration<double, std::milli>(mid - start).count();
+
+        for (int i = (int)levels.size() - 2; i >= 0; --i)
+        {
+            BloomLevel& dst = levels[i];
+            BloomLevel& src = levels[i + 1];
+            ForRows(dst.height, threadCount, dst.width, [&](uint32_t y, float* t[3])
+            {
+                float* out[3] = { dst.Row(dst.r, y), dst.Row(dst.g, y), dst.Row(dst.b, y) };
+                std::vector<float>* planes[3] = { &src.r, &src.g, &src.b };
+                for (int c = 0; c < 3; ++c)
+                {
+                    // Столбец подъёма в t[c], строка подъёма - в хвост той же временной строки
+                    float* up = t[c] + src.width + 2 * BLOOM_ROW_PAD;
+                    UpsampleRow(avx2, src, planes[c]->data(), y, t[c], up, dst.width);
+                    Blend(avx2, up, out[c], s.scatter, dst.width);
+                }
+            });
+        }
+        stats.upMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mid).count();
+    }
+
+    // Сцена + intensity * свечение (уровень 0, растянутый до кадра) -> RGBA32F, width * height * 4
+    void Composite(const uint32_t* scene, const BloomSettings& s, float* out, uint32_t threadCount, bool useSimd = true)
+    {
+        static const bool hasAvx2 = PostCpuHasAvx2();
+        bool avx2 = useSimd && hasAvx2;
+        auto start = std::chrono::high_resolution_clock::now();
+        const BloomLevel& src = levels[0];
+        ForRows(height, threadCount, width, [&](uint32_t y, float* t[3])
+        {
+            const std::vector<float>* planes[3] = { &src.r, &src.g, &src.b };
+            float* up[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                up[c] = t[c] + src.width + 2 * BLOOM_ROW_PAD;
+                UpsampleRow(avx2, src, planes[c]->data(), y, t[c], up[c], width);
+            }
+            const uint32_t* row = scene + (size_t)y * width;
+            float* o = out + (size_t)y * width * 4;
+#ifdef POST_X64
+            if (avx2) { BloomCompositeAvx2(row, up[0], up[1], up[2], s.intensity, o, width); return; }
+#endif
+            BloomCompositeScalar(row, up[0], up[1], up[2], s.intensity, o, 0, width);
+        });
+        stats.compositeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+private:
+    // rowFn(y, t) по строкам выхода; t - три временные строки потока с clamp-полями, t[c][-BLOOM_ROW_PAD] доступен.
+    // Длины хватает на строку ширины rowWidth и на растянутую строку вдвое шире
+    template <typename RowFn>
+    static void ForRows(uint32_t rowCount, uint32_t threadCount, uint32_t rowWidth, RowFn rowFn)
+    {
+        uint32_t groups = (rowCount + BLOOM_ROWS_PER_GROUP - 1) / BLOOM_ROWS_PER_GROUP;
+        size_t stride = (size_t)rowWidth * 3 + 4 * BLOOM_ROW_PAD + 16;
+        DispatchGroups(groups, threadCount, [&](uint32_t group)
+        {
+            thread_local std::vector<float> scratch;
+            if (scratch.size() < stride * 3) scratch.resize(stride * 3);
+            float* t[3] = { scratch.data() + BLOOM_ROW_PAD, scratch.data() + stride + BLOOM_ROW_PAD, scratch.data() + 2 * stride + BLOOM_ROW_PAD };
+            uint32_t end = (std::min)(rowCount, (group + 1) * BLOOM_ROWS_PER_GROUP);
+            for (uint32_t y = group * BLOOM_ROWS_PER_GROUP; y < end; ++y) rowFn(y, t);
+        });
+    }
+
+    // clamp-поля: t[-pad..-1] = t[0], t[n..n + pad - 1] = t[n - 1]
+    static void PadRow(float* t, uint32_t n)
+    {
+        for (uint32_t i = 1; i <= BLOOM_ROW_PAD; ++i) { t[-(int)i] = t[0]; t[n - 1 + i] = t[n - 1]; }
+    }
+
+    // Строка y уровня вдвое крупнее src: столбец в t, строка в out
+    static void UpsampleRow(bool avx2, const BloomLevel& src, const float* plane, uint32_t y, float* t, float* out, uint32_t fineWidth)
+    {
+        uint32_t k = y >> 1;
+        uint32_t farRow = (y & 1) ? (std::min)(k + 1, src.height - 1) : (k ? k - 1 : 0);
+        UpColumn(avx2, plane + (size_t)k * src.width, plane + (size_t)farRow * src.width, t, src.width);
+        PadRow(t, src.width);
+#ifdef POST_X64
+        if (avx2) { BloomUpRowAvx2(t, out, fineWidth); return; }
+#endif
+        BloomUpRowScalar(t, out, 0, fineWidth);
+    }
+
+    static void DownColumnRgba8(bool avx2, const uint32_t* const rows[4], float* t[3], uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomDownColumnRgba8Avx2(rows, t[0], t[1], t[2], n); return; }
+#endif
+        (void)avx2;
+        BloomDownColumnRgba8Scalar(rows, t[0], t[1], t[2], 0, n);
+    }
+
+    static void DownColumn(bool avx2, const float* r0, const float* r1, const float* r2, const float* r3, float* out, uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomDownColumnAvx2(r0, r1, r2, r3, out, n); return; }
+#endif
+        (void)avx2;
+        BloomDownColumnScalar(r0, r1, r2, r3, out, 0, n);
+    }
+
+    static void DownRow(bool avx2, const float* t, float* out, uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomDownRowAvx2(t, out, n); return; }
+#endif
+        (void)avx2;
+        BloomDownRowScalar(t, out, 0, n);
+    }
+
+    static void Prefilter(bool avx2, float* r, float* g, float* b, const BloomSettings& s, uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomPrefilterAvx2(r, g, b, s, n); return; }
+#endif
+        (void)avx2;
+        BloomPrefilterScalar(r, g, b, s, 0, n);
+    }
+
+    static void UpColumn(bool avx2, const float* nearRow, const float* farRow, float* out, uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomUpColumnAvx2(nearRow, farRow, out, n); return; }
+#endif
+        (void)avx2;
+        BloomUpColumnScalar(nearRow, farRow, out, 0, n);
+    }
+
+    static void Blend(bool avx2, const float* up, float* dst, float scatter, uint32_t n)
+    {
+#ifdef POST_X64
+        if (avx2) { BloomBlendAvx2(up, dst, scatter, n); return; }
+#endif
+        (void)avx2;
+        BloomBlendScalar(up, dst, scatter, 0, n);
+    }
+};
@@ -0,0 +1,224 @@
+// Lab8_ClusteredLights
+// Кластерное (froxel) распределение точечных источников: фрустум камеры делится на сетку
+// CLUSTER_GRID_X x CLUSTER_GRID_Y тайлов экрана и CLUSTER_GRID_Z экспоненциальных слоёв глубины,
+// для каждого кластера строится список источников, чья сфера влияния его задевает.
+// Пиксельный шейдер перебирает только список своего кластера.
+// Слои глубины обрабатываются параллельно, внутри слоя: слой -> строка тайлов -> кластер,
+// сфера против AABB кластера проверяется SSE по 4 источника.
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <xmmintrin.h>
+#include "CpuMath.h"
+#include "WorkerPool.h"
+
+const uint32_t CLUSTER_GRID_X = 16;
+const uint32_t CLUSTER_GRID_Y = 8;
+const uint32_t CLUSTER_GRID_Z = 24;
+const uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+
+// Та же раскладка, что StructuredBuffer<PointLight> в шейдере (32 байта)
+struct PointLight
+{
+    Float3 pos; float radius;
+    Float3 color; float padding;
+};
+
+// Индекс кластера: (слой * Y + строка) * X + столбец, строка 0 - верх экрана
+inline uint32_t ClusterIndex(uint32_t x, uint32_t y, uint32_t z) { return (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x; }
+
+// Ближняя граница слоя: nearZ * (farZ / nearZ)^(slice / Z)
+inline float ClusterSliceDepth(uint32_t slice, float nearZ, float farZ)
+{
+    return nearZ * powf(farZ / nearZ, (float)slice / CLUSTER_GRID_Z);
+}
+
+// Слой по глубине в пространстве камеры (то же считает шейдер по SV_Position.w)
+inline uint32_t ClusterSliceFromDepth(float viewZ, float nearZ, float farZ)
+{
+    if (viewZ <= nearZ) return 0;
+    uint32_t slice = (uint32_t)(logf(viewZ / nearZ) * (CLUSTER_GRID_Z / logf(farZ / nearZ)));
+    return (std::min)(slice, CLUSTER_GRID_Z - 1);
+}
+
+// Кластер пикселя, как ClusterLights в шейдерах: x, y - SV_Position.xy (центр пикселя),
+// depth - значение буфера глубины, width, height - размер цели
+inline uint32_t ClusterForPixel(float x, float y, float depth, float width, float height, float nearZ, float farZ)
+{
+    float viewZ = nearZ * farZ / (farZ - depth * (farZ - nearZ));
+    uint32_t cx = (std::min)((uint32_t)(x * CLUSTER_GRID_X / width), CLUSTER_GRID_X - 1);
+    uint32_t cy = (std::min)((uint32_t)(y * CLUSTER_GRID_Y / height), CLUSTER_GRID_Y - 1);
+    return ClusterIndex(cx, cy, ClusterSliceFromDepth(viewZ, nearZ, farZ));
+}
+
+struct ClusterBounds { Float3 bmin, bmax; };
+
+struct LightClusters
+{
+    std::vector<ClusterBounds> bounds;   // AABB кластеров в пространстве камеры
+    std::vector<uint32_t> ranges;        // по 2 на кластер: смещение и число индексов (uint2 в шейдере)
+    std::vector<uint32_t> indices;       // списки источников всех кластеров подряд
+    uint32_t maxPerCluster = 0;
+
+    // Слои пишут в свои списки, потом склеиваются по порядку - результат не зависит от числа потоков
+    std::vector<std::vector<uint32_t>> sliceIndices;
+    std::vector<uint32_t> clusterCounts;
+    std::vector<float> viewX, viewY, viewZ, radius; // источники в пространстве камеры (SoA)
+
+    // projX, projY - элементы [0][0] и [1][1] матрицы проекции
+    void BuildBounds(float projX, float projY, float nearZ, float farZ)
+    {
+        bounds.resize(CLUSTER_COUNT);
+        for (uint32_t z = 0; z < CLUSTER_GRID_Z; ++z)
+        {
+            float z0 = ClusterSliceDepth(z, nearZ, farZ), z1 = ClusterSliceDepth(z + 1, nearZ, farZ);
+            for (uint32_t y = 0; y < CLUSTER_GRID_Y; ++y)
+            {
+                float ndcY0 = 1.0f - 2.0f * (y + 1) / CLUSTER_GRID_Y, ndcY1 = 1.0f - 2.0f * y / CLUSTER_GRID_Y;
+                for (uint32_t x = 0; x < CLUSTER_GRID_X; ++x)
+                {
+                    float ndcX0 = -1.0f + 2.0f * x / CLUSTER_GRID_X, ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTER_GRID_X;
+                    // Углы усечённой пирамиды кластера на ближней и дальней границе слоя
+                    ClusterBounds& b = bounds[ClusterIndex(x, y, z)];
+                    b.bmin = MakeFloat3((std::min)(ndcX0 * z0, ndcX0 * z1) / projX, (std::min)(ndcY0 * z0, ndcY0 * z1) / projY, z0);
+                    b.bmax = MakeFloat3((std::max)(ndcX1 * z0, ndcX1 * z1) / projX, (std::max)(ndcY1 * z0, ndcY1 * z1) / projY, z1);
+                }
+            }
+        }
+    }
+
+    // view - матрица камеры (v * M), границы кластеров должны быть построены BuildBounds
+    void Build(const Float4x4& view, const PointLight* lights, uint32_t lightCount, uint32_t threadCount, bool useSimd = true)
+    {
+        viewX.resize(lightCount); viewY.resize(lightCount); viewZ.resize(lightCount); radius.resize(lightCount);
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            Float4 v = TransformPoint(view, lights[i].pos);
+            viewX[i] = v.x; viewY[i] = v.y; viewZ[i] = v.z; radius[i] = lights[i].radius;
+        }
+
+        sliceIndices.resize(CLUSTER_GRID_Z);
+        sliceScratch.resize(CLUSTER_GRID_Z);
+        clusterCounts.assign(CLUSTER_COUNT, 0u);
+        DispatchGroups(CLUSTER_GRID_Z, threadCount, [&](uint32_t z) { BinSlice(z, lightCount, useSimd); });
+
+        ranges.resize(CLUSTER_COUNT * 2);
+        indices.clear();
+        maxPerCluster = 0;
+        uint32_t cluster = 0;
+        for (uint32_t z = 0; z < CLUSTER_GRID_Z; ++z)
+        {
+            for (uint32_t c = 0; c < CLUSTER_GRID_X * CLUSTER_GRID_Y; ++c, ++cluster)
+            {
+                ranges[cluster * 2 + 0] = (uint32_t)indices.size();
+                ranges[cluster * 2 + 1] = clusterCounts[cluster];
+                maxPerCluster = (std::max)(maxPerCluster, clusterCounts[cluster]);
+                indices.resize(indices.size() + clusterCounts[cluster]);
+            }
+        }
+        // Склейка: внутри слоя кластеры лежат подряд в порядке индекса
+        for (uint32_t z = 0; z < CLUSTER_GRID_Z; ++z)
+        {
+            uint32_t first = ClusterIndex(0, 0, z);
+            std::copy(sliceIndices[z].begin(), sliceIndices[z].end(), indices.begin() + ranges[first * 2]);
+        }
+    }
+
+private:
+    // Кандидаты в раскладке SoA: загрузки SSE идут подряд, без сборки по индексам
+    struct LightSoA
+    {
+        std::vector<float> x, y, z, r;
+        std::vector<uint32_t> id;
+        void Clear() { x.clear(); y.clear(); z.clear(); r.clear(); id.clear(); }
+        void Reserve(uint32_t n) { x.reserve(n); y.reserve(n); z.reserve(n); r.reserve(n); id.reserve(n); }
+        void Push(float px, float py, float pz, float pr, uint32_t pid) { x.push_back(px); y.push_back(py); z.push_back(pz); r.push_back(pr); id.push_back(pid); }
+        void Push(const LightSoA& src, uint32_t i) { Push(src.x[i], src.y[i], src.z[i], src.r[i], src.id[i]); }
+    };
+
+    // Кандидаты слоя и строки тайлов - свои у каждого слоя (слои идут параллельно) и живут между кадрами:
+    // Clear() сохраняет ёмкость, после первого кадра с тем же числом источников выделений нет
+    struct SliceScratch { LightSoA sliceLights, rowLights; };
+    std::vector<SliceScratch> sliceScratch;
+
+    // Сфера против AABB: квадрат расстояния от центра до бокса <= r^2
+    static bool SphereTouchesBox(float x, float y, float z, float r, const ClusterBounds& b)
+    {
+        float dx = (std::max)((std::max)(b.bmin.x - x, x - b.bmax.x), 0.0f);
+        float dy = (std::max)((std::max)(b.bmin.y - y, y - b.bmax.y), 0.0f);
+        float dz = (std::max)((std::max)(b.bmin.z - z, z - b.bmax.z), 0.0f);
+        return dx * dx + dy * dy + dz * dz <= r * r;
+    }
+
+    // emit(i) для каждого кандидата i, задевающего бокс (SIMD по 4, хвост скалярно)
+    template <typename Emit>
+    static void FilterLights(const LightSoA& in, const ClusterBounds& b, bool useSimd, Emit emit)
+    {
+        uint32_t count = (uint32_t)in.id.size();
+        uint32_t i = 0;
+        if (useSimd)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 minX = _mm_set1_ps(b.bmin.x), minY = _mm_set1_ps(b.bmin.y), minZ = _mm_set1_ps(b.bmin.z);
+            const __m128 maxX = _mm_set1_ps(b.bmax.x), maxY = _mm_set1_ps(b.bmax.y), maxZ = _mm_set1_ps(b.bmax.z);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 x = _mm_loadu_ps(&in.x[i]), y = _mm_loadu_ps(&in.y[i]), z = _mm_loadu_ps(&in.z[i]), r = _mm_loadu_ps(&in.r[i]);
+                __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+                __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+                __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+                __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(r, r)));
+                if (mask & 1) emit(i);
+                if (mask & 2) emit(i + 1);
+                if (mask & 4) emit(i + 2);
+                if (mask & 8) emit(i + 3);
+            }
+        }
+        for (; i < count; ++i)
+            if (SphereTouchesBox(in.x[i], in.y[i], in.z[i], in.r[i], b)) emit(i);
+    }
+
+    void BinSlice(uint32_t z, uint32_t lightCount, bool useSimd)
+    {
+        std::vector<uint32_t>& out = sliceIndices[z];
+        out.clear();
+        const ClusterBounds& first = bounds[ClusterIndex(0, 0, z)];
+        float z0 = first.bmin.z, z1 = first.bmax.z;
+
+        // Кандидаты слоя - по глубине
+        LightSoA& sliceLights = sliceScratch[z].sliceLights;
+        LightSoA& rowLights = sliceScratch[z].rowLights;
+        sliceLights.Clear();
+        sliceLights.Reserve(lightCount);
+        rowLights.Reserve(lightCount);
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            if (viewZ[i] + radius[i] < z0 || viewZ[i] - radius[i] > z1) continue;
+            sliceLights.Push(viewX[i], viewY[i], viewZ[i], radius[i], i);
+        }
+
+        for (uint32_t y = 0; y < CLUSTER_GRID_Y; ++y)
+        {
+            // Строка тайлов - объединение AABB её кластеров
+            ClusterBounds row = bounds[ClusterIndex(0, y, z)];
+            for (uint32_t x = 1; x < CLUSTER_GRID_X; ++x)
+            {
+                const ClusterBounds& b = bounds[ClusterIndex(x, y, z)];
+                row.bmin = MakeFloat3((std::min)(row.bmin.x, b.bmin.x), (std::min)(row.bmin.y, b.bmin.y), (std::min)(row.bmin.z, b.bmin.z));
+                row.bmax = MakeFloat3((std::max)(row.bmax.x, b.bmax.x), (std::max)(row.bmax.y, b.bmax.y), (std::max)(row.bmax.z, b.bmax.z));
+            }
+            rowLights.Clear();
+            FilterLights(sliceLights, row, useSimd, [&](uint32_t i) { rowLights.Push(sliceLights, i); });
+
+            for (uint32_t x = 0; x < CLUSTER_GRID_X; ++x)
+            {
+                uint32_t cluster = ClusterIndex(x, y, z);
+                size_t before = out.size();
+                FilterLights(rowLights, bounds[cluster], useSimd, [&](uint32_t i) { out.push_back(rowLights.id[i]); });
+                clusterCounts[cluster] = (uint32_t)(out.size() - before);
+            }
+        }
+    }
+};
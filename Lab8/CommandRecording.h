@@ -0,0 +1,61 @@
+// Lab8_CommandRecording
+// Параллельная запись кадра: у каждого прохода свой отложенный контекст, проходы записываются
+// на нескольких потоках в списки команд, затем списки исполняются строго в порядке проходов.
+// Проход начинается с состояния по умолчанию (список закрывается без сохранения состояния),
+// поэтому каждый проход сам ставит цели, viewport и всё, что рисует.
+// Типы контекста и списка задаёт Api: в приложении - D3D11 (deferred context + ID3D11CommandList),
+// в проверках - записывающая заглушка (Tests/CommandRecordingTest.cpp: порядок исполнения при любом
+// числе потоков, один поток на контекст, ошибка Finish).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include "WorkerPool.h"
+
+template <typename Api>
+struct PassRecorder
+{
+    typedef typename Api::Context Context;
+    typedef typename Api::CommandList CommandList;
+
+    struct Slot
+    {
+        Context* context = nullptr;    // отложенный контекст прохода
+        CommandList* list = nullptr;   // записанный список, ждёт Submit
+        double recordMs = 0.0;
+    };
+    std::vector<Slot> slots;
+
+    // record(pass, context) вызывается из рабочих потоков пула (WorkerPool.h), по одному разу на проход;
+    // проходы раздаются потокам через чередование, вызывающий поток тоже пишет
+    template <typename RecordFn>
+    void Record(uint32_t threadCount, RecordFn record)
+    {
+        DispatchGroups((uint32_t)slots.size(), threadCount, [&](uint32_t p)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            record(p, slots[p].context);
+            slots[p].list = Api::Finish(slots[p].context);
+            slots[p].recordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        });
+    }
+
+    // Исполнение в порядке проходов; пустой проход (ошибка Finish) пропускается
+    void Submit(Context* immediate)
+    {
+        for (Slot& s : slots)
+        {
+            if (!s.list) continue;
+            Api::Execute(immediate, s.list);
+            Api::Release(s.list);
+            s.list = nullptr;
+        }
+    }
+
+    double TotalRecordMs() const
+    {
+        double total = 0.0;
+        for (const Slot& s : slots) total += s.recordMs;
+        return total;
+    }
+};
@@ -0,0 +1,130 @@
+// Lab8_ContributionCulling
+// Отсечение экземпляров по вкладу в кадр: AABB проецируется на экран, и если площадь
+// прямоугольника проекции меньше порога категории (в пикселях^2), экземпляр не рисуется.
+// Порог задаётся на категорию (у нас - на мэш), 0 отключает отсечение для категории.
+// Скалярная версия - эталон для cullCS, SSE-версия обрабатывает по 4 бокса за раз
+// (совпадение с эталоном и замер - Tests/ContributionCullingTest.cpp).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <xmmintrin.h>
+#include "CpuMath.h"
+
+// Боксы в раскладке SoA - для SIMD
+struct AABBSoA
+{
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    std::vector<uint32_t> category;
+
+    void Resize(size_t n)
+    {
+        minX.resize(n); minY.resize(n); minZ.resize(n);
+        maxX.resize(n); maxY.resize(n); maxZ.resize(n);
+        category.resize(n);
+    }
+    void Set(size_t i, const Float3& bmin, const Float3& bmax, uint32_t cat)
+    {
+        minX[i] = bmin.x; minY[i] = bmin.y; minZ[i] = bmin.z;
+        maxX[i] = bmax.x; maxY[i] = bmax.y; maxZ[i] = bmax.z;
+        category[i] = cat;
+    }
+    size_t Size() const { return minX.size(); }
+};
+
+struct ContributionStats
+{
+    uint32_t tested = 0;
+    uint32_t culled = 0;
+    uint64_t culledVertices = 0;
+};
+
+// Площадь проекции AABB в пикселях (без обрезки по экрану); FLT_MAX, если бокс пересекает ближнюю плоскость
+inline float ProjectedPixelArea(const Float4x4& vp, const Float3& bmin, const Float3& bmax, float viewportW, float viewportH)
+{
+    float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+    for (int c = 0; c < 8; ++c)
+    {
+        Float3 p = MakeFloat3((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+        Float4 clip = TransformPoint(vp, p);
+        if (clip.w <= 1e-5f) return FLT_MAX;
+        float invW = 1.0f / clip.w;
+        x0 = (std::min)(x0, clip.x * invW); x1 = (std::max)(x1, clip.x * invW);
+        y0 = (std::min)(y0, clip.y * invW); y1 = (std::max)(y1, clip.y * invW);
+    }
+    return (x1 - x0) * 0.5f * viewportW * (y1 - y0) * 0.5f * viewportH;
+}
+
+inline bool PassesContribution(float area, float minArea) { return area >= minArea; }
+
+// Скалярный проход: visible[i] = 1, если экземпляр достаточно крупный
+inline void ContributionCullScalar(const Float4x4& vp, const AABBSoA& boxes, uint32_t begin, uint32_t end,
+    float viewportW, float viewportH, const float* minAreaPerCategory, uint8_t* visible)
+{
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        Float3 bmin = MakeFloat3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+        Float3 bmax = MakeFloat3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+        float area = ProjectedPixelArea(vp, bmin, bmax, viewportW, viewportH);
+        visible[i] = PassesContribution(area, minAreaPerCategory[boxes.category[i]]) ? 1 : 0;
+    }
+}
+
+// SSE: 4 бокса за итерацию, 8 углов каждого трансформируются одновременно
+inline void ContributionCullSSE(const Float4x4& vp, const AABBSoA& boxes, uint32_t count,
+    float viewportW, float viewportH, const float* minAreaPerCategory, uint8_t* visible)
+{
+    const __m128 m00 = _mm_set1_ps(vp.m[0][0]), m10 = _mm_set1_ps(vp.m[1][0]), m20 = _mm_set1_ps(vp.m[2][0]), m30 = _mm_set1_ps(vp.m[3][0]);
+    const __m128 m01 = _mm_set1_ps(vp.m[0][1]), m11 = _mm_set1_ps(vp.m[1][1]), m21 = _mm_set1_ps(vp.m[2][1]), m31 = _mm_set1_ps(vp.m[3][1]);
+    const __m128 m03 = _mm_set1_ps(vp.m[0][3]), m13 = _mm_set1_ps(vp.m[1][3]), m23 = _mm_set1_ps(vp.m[2][3]), m33 = _mm_set1_ps(vp.m[3][3]);
+    const __m128 eps = _mm_set1_ps(1e-5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(0.25f * viewportW * viewportH);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 bmin[3] = { _mm_loadu_ps(&boxes.minX[i]), _mm_loadu_ps(&boxes.minY[i]), _mm_loadu_ps(&boxes.minZ[i]) };
+        __m128 bmax[3] = { _mm_loadu_ps(&boxes.maxX[i]), _mm_loadu_ps(&boxes.maxY[i]), _mm_loadu_ps(&boxes.maxZ[i]) };
+        __m128 x0 = _mm_set1_ps(FLT_MAX), y0 = x0;
+        __m128 x1 = _mm_set1_ps(-FLT_MAX), y1 = x1;
+        __m128 nearClipped = _mm_setzero_ps();
+        for (int c = 0; c < 8; ++c)
+        {
+            __m128 px = (c & 1) ? bmax[0] : bmin[0];
+            __m128 py = (c & 2) ? bmax[1] : bmin[1];
+            __m128 pz = (c & 4) ? bmax[2] : bmin[2];
+            __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m00), _mm_mul_ps(py, m10)), _mm_add_ps(_mm_mul_ps(pz, m20), m30));
+            __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m01), _mm_mul_ps(py, m11)), _mm_add_ps(_mm_mul_ps(pz, m21), m31));
+            __m128 cw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, m03), _mm_mul_ps(py, m13)), _mm_add_ps(_mm_mul_ps(pz, m23), m33));
+            nearClipped = _mm_or_ps(nearClipped, _mm_cmple_ps(cw, eps));
+            __m128 invW = _mm_div_ps(one, cw);
+            __m128 sx = _mm_mul_ps(cx, invW), sy = _mm_mul_ps(cy, invW);
+            x0 = _mm_min_ps(x0, sx); x1 = _mm_max_ps(x1, sx);
+            y0 = _mm_min_ps(y0, sy); y1 = _mm_max_ps(y1, sy);
+        }
+        __m128 area = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(x1, x0), _mm_sub_ps(y1, y0)), scale);
+        __m128 minArea = _mm_set_ps(minAreaPerCategory[boxes.category[i + 3]], minAreaPerCategory[boxes.category[i + 2]],
+            minAreaPerCategory[boxes.category[i + 1]], minAreaPerCategory[boxes.category[i]]);
+        int mask = _mm_movemask_ps(_mm_or_ps(nearClipped, _mm_cmpge_ps(area, minArea)));
+        visible[i + 0] = (uint8_t)(mask & 1);
+        visible[i + 1] = (uint8_t)((mask >> 1) & 1);
+        visible[i + 2] = (uint8_t)((mask >> 2) & 1);
+        visible[i + 3] = (uint8_t)((mask >> 3) & 1);
+    }
+    ContributionCullScalar(vp, boxes, i, count, viewportW, viewportH, minAreaPerCategory, visible);
+}
+
+// Сколько экземпляров и вершин убрал проход (verticesPerCategory - вершин на отрисовку экземпляра)
+inline ContributionStats GatherContributionStats(const AABBSoA& boxes, uint32_t count, const uint8_t* visible, const uint32_t* verticesPerCategory)
+{
+    ContributionStats stats;
+    stats.tested = count;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (visible[i]) continue;
+        ++stats.culled;
+        stats.culledVertices += verticesPerCategory[boxes.category[i]];
+    }
+    return stats;
+}
@@ -0,0 +1,96 @@
+// Lab8_CpuMath
+// Минимальная переносимая математика для CPU-частей (без DirectXMath/WinAPI),
+// чтобы их можно было собрать и проверить не только под Windows.
+// Раскладка Float4x4 совпадает с XMFLOAT4X4: строки, векторы умножаются слева (v * M).
+#pragma once
+#include <cmath>
+#include <cfloat>
+
+struct Float3 { float x, y, z; };
+struct Float4 { float x, y, z, w; };
+struct Float4x4 { float m[4][4]; };
+
+inline Float3 MakeFloat3(float x, float y, float z) { Float3 r = { x, y, z }; return r; }
+inline Float3 Add(const Float3& a, const Float3& b) { return MakeFloat3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Float3 Sub(const Float3& a, const Float3& b) { return MakeFloat3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Float3 Scale(const Float3& a, float s) { return MakeFloat3(a.x * s, a.y * s, a.z * s); }
+inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Float3 Cross(const Float3& a, const Float3& b) { return MakeFloat3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float Length(const Float3& a) { return sqrtf(Dot(a, a)); }
+inline Float3 Normalize(const Float3& a) { float l = Length(a); return l > 0.0f ? Scale(a, 1.0f / l) : a; }
+
+// Точка (w = 1) в однородные координаты
+inline Float4 TransformPoint(const Float4x4& m, const Float3& p)
+{
+    Float4 r;
+    r.x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+    r.y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+    r.z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+    r.w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+    return r;
+}
+
+// Направление (w = 0): нормали передаются с матрицей transpose(inverse(model))
+inline Float3 TransformDirection(const Float4x4& m, const Float3& d)
+{
+    return MakeFloat3(d.x * m.m[0][0] + d.y * m.m[1][0] + d.z * m.m[2][0],
+                      d.x * m.m[0][1] + d.y * m.m[1][1] + d.z * m.m[2][1],
+                      d.x * m.m[0][2] + d.y * m.m[1][2] + d.z * m.m[2][2]);
+}
+
+// Обратная матрица через алгебраические дополнения (вырожденная - нулевая)
+inline Float4x4 Inverse(const Float4x4& a)
+{
+    const float* m = &a.m[0][0];
+    float inv[16];
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    Float4x4 r = {};
+    if (det == 0.0f) return r;
+    float invDet = 1.0f / det;
+    for (int i = 0; i < 16; ++i) (&r.m[0][0])[i] = inv[i] * invDet;
+    return r;
+}
+
+// Плоскости фрустума из view-proj (как BuildFrustumPlanes в Source.cpp), нормали смотрят внутрь
+inline void BuildFrustumPlanesCPU(const Float4x4& vp, Float4 planes[6])
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        int axis = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        planes[i].x = vp.m[0][3] + sign * vp.m[0][axis];
+        planes[i].y = vp.m[1][3] + sign * vp.m[1][axis];
+        planes[i].z = vp.m[2][3] + sign * vp.m[2][axis];
+        planes[i].w = vp.m[3][3] + sign * vp.m[3][axis];
+        float len = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+        planes[i].x /= len; planes[i].y /= len; planes[i].z /= len; planes[i].w /= len;
+    }
+}
+
+inline bool IsAABBInsideFrustumCPU(const Float4 planes[6], const Float3& bmin, const Float3& bmax)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        float px = planes[i].x >= 0 ? bmax.x : bmin.x;
+        float py = planes[i].y >= 0 ? bmax.y : bmin.y;
+        float pz = planes[i].z >= 0 ? bmax.z : bmin.z;
+        if (px * planes[i].x + py * planes[i].y + pz * planes[i].z + planes[i].w < 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,489 @@
+// Lab8_CpuPostProcess
+// Постобработка кадра на CPU: яркость/оттенки серого, экспозиция, тональная компрессия (Рейнхард, ACES),
+// цветокоррекция 3D LUT, гамма - для кадров программного растеризатора и любых сохранённых изображений.
+// Цепочка операций выполняется слитно: кадр режется на полосы по POST_STRIP пикселей, полоса
+// распаковывается в float SoA (лежит в L1), все операции идут по ней подряд, затем запаковка
+// в RGBA8 - один проход по памяти на всю цепочку вместо прохода на операцию.
+// Ядра AVX2 по 8 пикселей; выбор при запуске по CPUID, без флагов компиляции всего проекта.
+// Скалярный путь - эталон (powf) и запасной вариант для CPU без AVX2; сверка путей и Мпикс/с
+// на цепочку - Tests/CpuPostProcessTest.cpp.
+// Без WinAPI/D3D: собирается и проверяется на любой платформе.
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include "WorkerPool.h"
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define POST_X64 1
+// GCC/Clang: AVX2 только внутри помеченных функций; MSVC разрешает интринсики без /arch
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define POST_AVX2 __attribute__((target("avx2")))
+#else
+#define POST_AVX2
+#endif
+#endif
+
+const uint32_t POST_STRIP = 1024;   // пикселей в полосе: 16 КБ float RGBA
+
+enum PostOp { POST_EXPOSURE, POST_REINHARD, POST_ACES, POST_LUT, POST_GAMMA, POST_GRAYSCALE, POST_QUANTIZE };
+
+// 3D LUT цветокоррекции: size^3 узлов RGB, узел (r, g, b) - по индексу ((b * size + g) * size + r) * 3
+struct ColorLut
+{
+    uint32_t size = 0;
+    std::vector<float> rgb;
+
+    // grade(r, g, b, out) задаёт цвет узла по входу в [0, 1]
+    template <typename GradeFn>
+    void Build(uint32_t n, GradeFn grade)
+    {
+        size = (std::max)(n, 2u);
+        rgb.resize((size_t)size * size * size * 3);
+        float step = 1.0f / (size - 1);
+        for (uint32_t b = 0; b < size; ++b)
+            for (uint32_t g = 0; g < size; ++g)
+                for (uint32_t r = 0; r < size; ++r)
+                    grade(r * step, g * step, b * step, &rgb[(((size_t)b * size + g) * size + r) * 3]);
+    }
+
+    void Identity(uint32_t n)
+    {
+        Build(n, [](float r, float g, float b, float* out) { out[0] = r; out[1] = g; out[2] = b; });
+    }
+
+    // Трилинейная выборка, вход обрезается к [0, 1]. Тот же порядок операций, что в ядре AVX2
+    void Sample(float r, float g, float b, float out[3]) const
+    {
+        float scale = (float)(size - 1);
+        uint32_t i[3];
+        float f[3];
+        const float in[3] = { r, g, b };
+        for (int c = 0; c < 3; ++c)
+        {
+            float x = in[c] > 0.0f ? (in[c] < 1.0f ? in[c] : 1.0f) : 0.0f;
+            x *= scale;
+            i[c] = (std::min)((uint32_t)x, size - 2);
+            f[c] = x - (float)i[c];
+        }
+        const size_t dr = 3, dg = (size_t)size * 3, db = (size_t)size * size * 3;
+        const float* p = &rgb[(((size_t)i[2] * size + i[1]) * size + i[0]) * 3];
+        for (int c = 0; c < 3; ++c)
+        {
+            float c00 = p[c] + (p[dr + c] - p[c]) * f[0];
+            float c10 = p[dg + c] + (p[dg + dr + c] - p[dg + c]) * f[0];
+            float c01 = p[db + c] + (p[db + dr + c] - p[db + c]) * f[0];
+            float c11 = p[db + dg + c] + (p[db + dg + dr + c] - p[db + dg + c]) * f[0];
+            float c0 = c00 + (c10 - c00) * f[1];
+            float c1 = c01 + (c11 - c01) * f[1];
+            out[c] = c0 + (c1 - c0) * f[2];
+        }
+    }
+};
+
+struct PostStep
+{
+    PostOp op;
+    float k[3];
+    const ColorLut* lut;   // для POST_LUT, живёт дольше цепочки
+};
+
+// Операции в порядке применения
+struct PostChain
+{
+    std::vector<PostStep> steps;
+
+    PostChain& Add(PostOp op, float k0 = 0.0f, float k1 = 0.0f, float k2 = 0.0f, const ColorLut* lut = nullptr)
+    {
+        PostStep s = { op, { k0, k1, k2 }, lut };
+        steps.push_back(s);
+        return *this;
+    }
+    PostChain& Exposure(float scale) { return Add(POST_EXPOSURE, scale); }
+    PostChain& Reinhard() { return Add(POST_REINHARD); }
+    PostChain& Aces() { return Add(POST_ACES); }
+    PostChain& Grade(const ColorLut& lut) { return Add(POST_LUT, 0.0f, 0.0f, 0.0f, &lut); }
+    PostChain& Gamma(float gamma) { return Add(POST_GAMMA, 1.0f / gamma); }   // x^(1/gamma)
+    // Веса filterPS по умолчанию
+    PostChain& Grayscale(float wr = 0.299f, float wg = 0.587f, float wb = 0.114f) { return Add(POST_GRAYSCALE, wr, wg, wb); }
+    // Округление к UNORM8 посреди цепочки - как запись в промежуточную цель
+    PostChain& Quantize() { return Add(POST_QUANTIZE); }
+
+    // Для отчётов: "exposure > aces > gamma"
+    std::string Describe() const
+    {
+        static const char* names[] = { "exposure", "reinhard", "aces", "lut", "gamma", "grayscale", "quantize" };
+        std::string s;
+        for (size_t i = 0; i < steps.size(); ++i) s += std::string(i ? " > " : "") + names[steps[i].op];
+        return s.empty() ? "copy" : s;
+    }
+};
+
+// Полоса в SoA: r, g, b, a подряд, выровнено под AVX
+struct alignas(32) PostStrip
+{
+    float r[POST_STRIP], g[POST_STRIP], b[POST_STRIP], a[POST_STRIP];
+};
+
+// ------------------------------------------------------------------
+// Скалярный путь
+// ------------------------------------------------------------------
+inline uint32_t PostToUnorm8(float c)
+{
+    c = c > 0.0f ? (c < 1.0f ? c : 1.0f) : 0.0f;   // NaN -> 0, как max/min в AVX
+    return (uint32_t)(c * 255.0f + 0.5f);
+}
+
+inline float PostAces(float x)
+{
+    // Аппроксимация ACES (Narkowicz, 2015)
+    x = x > 0.0f ? x : 0.0f;
+    float y = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+    return y < 1.0f ? y : 1.0f;
+}
+
+inline void PostLoadScalar(const uint32_t* src, PostStrip& s, uint32_t begin, uint32_t n)
+{
+    const float k = 1.0f / 255.0f;
+    for (uint32_t i = begin; i < n; ++i)
+    {
+        uint32_t c = src[i];
+        s.r[i] = (c & 0xFF) * k;
+        s.g[i] = ((c >> 8) & 0xFF) * k;
+        s.b[i] = ((c >> 16) & 0xFF) * k;
+        s.a[i] = (c >> 24) * k;
+    }
+}
+
+inline void PostLoadScalar(const float* src, PostStrip& s, uint32_t begin, uint32_t n)
+{
+    for (uint32_t i = begin; i < n; ++i)
+    {
+        s.r[i] = src[i * 4 + 0];
+        s.g[i] = src[i * 4 + 1];
+        s.b[i] = src[i * 4 + 2];
+        s.a[i] = src[i * 4 + 3];
+    }
+}
+
+inline void PostStoreScalar(const PostStrip& s, uint32_t* dst, uint32_t begin, uint32_t n)
+{
+    for (uint32_t i = begin; i < n; ++i)
+        dst[i] = PostToUnorm8(s.r[i]) | (PostToUnorm8(s.g[i]) << 8) | (PostToUnorm8(s.b[i]) << 16) | (PostToUnorm8(s.a[i]) << 24);
+}
+
+inline void PostStepScalar(const PostStep& step, PostStrip& s, uint32_t n)
+{
+    switch (step.op)
+    {
+    case POST_EXPOSURE:
+        for (uint32_t i = 0; i < n; ++i) { s.r[i] *= step.k[0]; s.g[i] *= step.k[0]; s.b[i] *= step.k[0]; }
+        break;
+    case POST_REINHARD:
+        for (uint32_t i = 0; i < n; ++i) { s.r[i] = s.r[i] / (1.0f + s.r[i]); s.g[i] = s.g[i] / (1.0f + s.g[i]); s.b[i] = s.b[i] / (1.0f + s.b[i]); }
+        break;
+    case POST_ACES:
+        for (uint32_t i = 0; i < n; ++i) { s.r[i] = PostAces(s.r[i]); s.g[i] = PostAces(s.g[i]); s.b[i] = PostAces(s.b[i]); }
+        break;
+    case POST_LUT:
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            float out[3];
+            step.lut->Sample(s.r[i], s.g[i], s.b[i], out);
+            s.r[i] = out[0]; s.g[i] = out[1]; s.b[i] = out[2];
+        }
+        break;
+    case POST_GAMMA:
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            s.r[i] = s.r[i] > 0.0f ? powf(s.r[i], step.k[0]) : 0.0f;
+            s.g[i] = s.g[i] > 0.0f ? powf(s.g[i], step.k[0]) : 0.0f;
+            s.b[i] = s.b[i] > 0.0f ? powf(s.b[i], step.k[0]) : 0.0f;
+        }
+        break;
+    case POST_GRAYSCALE:
+        for (uint32_t i = 0; i < n; ++i) s.r[i] = s.g[i] = s.b[i] = s.r[i] * step.k[0] + s.g[i] * step.k[1] + s.b[i] * step.k[2];
+        break;
+    case POST_QUANTIZE:
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            s.r[i] = PostToUnorm8(s.r[i]) * (1.0f / 255.0f);
+            s.g[i] = PostToUnorm8(s.g[i]) * (1.0f / 255.0f);
+            s.b[i] = PostToUnorm8(s.b[i]) * (1.0f / 255.0f);
+        }
+        break;
+    }
+}
+
+// ------------------------------------------------------------------
+// AVX2: по 8 пикселей; хвост полосы дополняется нулями до кратного 8
+// ------------------------------------------------------------------
+#ifdef POST_X64
+inline bool PostCpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;   // ОС сохраняет регистры YMM
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+POST_AVX2 inline __m256 PostClamp01Avx2(__m256 x)
+{
+    return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+}
+
+POST_AVX2 inline __m256i PostToUnorm8Avx2(__m256 x)
+{
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(PostClamp01Avx2(x), _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+// log2 для x > 0: x = m * 2^e, m в [sqrt(1/2), sqrt(2)), log2(m) через ряд atanh по t = (m - 1) / (m + 1)
+POST_AVX2 inline __m256 PostLog2Avx2(__m256 x)
+{
+    __m256i xi = _mm256_castps_si256(x);
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(xi, 23), _mm256_set1_epi32(127));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(xi, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)));
+    __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+    e = _mm256_sub_epi32(e, _mm256_castps_si256(big));   // маска -1 -> e + 1
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    __m256 t2 = _mm256_mul_ps(t, t);
+    // 2 / (k ln 2), k = 1, 3, 5, 7, 9
+    __m256 p = _mm256_set1_ps(0.32059889f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(0.41219858f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(0.57707801f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(0.96179669f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(2.88539008f));
+    return _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(p, t));
+}
+
+// 2^y: целая часть - в показатель, дробная [-1/2, 1/2] - ряд Тейлора до 6-й степени
+POST_AVX2 inline __m256 PostExp2Avx2(__m256 y)
+{
+    y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(126.0f));
+    __m256 n = _mm256_round_ps(y, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 f = _mm256_sub_ps(y, n);
+    __m256 p = _mm256_set1_ps(1.5403530e-4f);   // ln2^k / k!
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.3333558e-3f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(9.6181291e-3f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(5.5504109e-2f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(2.4022651e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(6.9314718e-1f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+    __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+}
+
+POST_AVX2 inline __m256 PostPowAvx2(__m256 x, __m256 e)
+{
+    __m256 positive = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 safe = _mm256_blendv_ps(_mm256_set1_ps(1.0f), x, positive);
+    return _mm256_and_ps(PostExp2Avx2(_mm256_mul_ps(PostLog2Avx2(safe), e)), positive);
+}
+
+POST_AVX2 inline __m256 PostAcesAvx2(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_setzero_ps());
+    __m256 num = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), x), _mm256_set1_ps(0.03f)));
+    __m256 den = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), x), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f));
+    return _mm256_min_ps(_mm256_div_ps(num, den), _mm256_set1_ps(1.0f));
+}
+
+POST_AVX2 inline void PostLoadAvx2(const uint32_t* src, PostStrip& s, uint32_t n)
+{
+    const __m256 k = _mm256_set1_ps(1.0f / 255.0f);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_store_ps(s.r + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(c, mask)), k));
+        _mm256_store_ps(s.g + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, 8), mask)), k));
+        _mm256_store_ps(s.b + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(c, 16), mask)), k));
+        _mm256_store_ps(s.a + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c, 24)), k));
+    }
+    PostLoadScalar(src, s, i, n);
+}
+
+POST_AVX2 inline void PostLoadAvx2(const float* src, PostStrip& s, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // Две транспозиции 4x4: пиксели RGBA -> столбцы r, g, b, a
+        __m128 p0 = _mm_loadu_ps(src + i * 4), p1 = _mm_loadu_ps(src + i * 4 + 4), p2 = _mm_loadu_ps(src + i * 4 + 8), p3 = _mm_loadu_ps(src + i * 4 + 12);
+        __m128 q0 = _mm_loadu_ps(src + i * 4 + 16), q1 = _mm_loadu_ps(src + i * 4 + 20), q2 = _mm_loadu_ps(src + i * 4 + 24), q3 = _mm_loadu_ps(src + i * 4 + 28);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+        _mm256_store_ps(s.r + i, _mm256_insertf128_ps(_mm256_castps128_ps256(p0), q0, 1));
+        _mm256_store_ps(s.g + i, _mm256_insertf128_ps(_mm256_castps128_ps256(p1), q1, 1));
+        _mm256_store_ps(s.b + i, _mm256_insertf128_ps(_mm256_castps128_ps256(p2), q2, 1));
+        _mm256_store_ps(s.a + i, _mm256_insertf128_ps(_mm256_castps128_ps256(p3), q3, 1));
+    }
+    PostLoadScalar(src, s, i, n);
+}
+
+POST_AVX2 inline void PostStoreAvx2(const PostStrip& s, uint32_t* dst, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i c = PostToUnorm8Avx2(_mm256_load_ps(s.r + i));
+        c = _mm256_or_si256(c, _mm256_slli_epi32(PostToUnorm8Avx2(_mm256_load_ps(s.g + i)), 8));
+        c = _mm256_or_si256(c, _mm256_slli_epi32(PostToUnorm8Avx2(_mm256_load_ps(s.b + i)), 16));
+        c = _mm256_or_si256(c, _mm256_slli_epi32(PostToUnorm8Avx2(_mm256_load_ps(s.a + i)), 24));
+        _mm256_storeu_si256((__m256i*)(dst + i), c);
+    }
+    PostStoreScalar(s, dst, i, n);
+}
+
+// Трилинейная выборка LUT: 8 углов x 3 канала - gather по индексам узлов
+POST_AVX2 inline void PostLutAvx2(const ColorLut& lut, __m256& r, __m256& g, __m256& b)
+{
+    const __m256 scale = _mm256_set1_ps((float)(lut.size - 1));
+    const __m256i last = _mm256_set1_epi32((int)lut.size - 2);
+    __m256 x[3] = { r, g, b };
+    __m256i i[3];
+    __m256 f[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        __m256 v = _mm256_mul_ps(PostClamp01Avx2(x[c]), scale);
+        i[c] = _mm256_min_epi32(_mm256_cvttps_epi32(v), last);
+        f[c] = _mm256_sub_ps(v, _mm256_cvtepi32_ps(i[c]));
+    }
+    const int size = (int)lut.size;
+    __m256i base = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(i[2], _mm256_set1_epi32(size)), i[1]), _mm256_set1_epi32(size)), i[0]), _mm256_set1_epi32(3));
+    const __m256i dr = _mm256_set1_epi32(3), dg = _mm256_set1_epi32(size * 3), db = _mm256_set1_epi32(size * size * 3);
+    __m256i corner[8];
+    for (int k = 0; k < 8; ++k)
+    {
+        __m256i idx = base;
+        if (k & 1) idx = _mm256_add_epi32(idx, dr);
+        if (k & 2) idx = _mm256_add_epi32(idx, dg);
+        if (k & 4) idx = _mm256_add_epi32(idx, db);
+        corner[k] = idx;
+    }
+    __m256 out[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        const float* p = lut.rgb.data() + c;
+        __m256 v[8];
+        for (int k = 0; k < 8; ++k) v[k] = _mm256_i32gather_ps(p, corner[k], 4);
+        __m256 c00 = _mm256_add_ps(v[0], _mm256_mul_ps(_mm256_sub_ps(v[1], v[0]), f[0]));
+        __m256 c10 = _mm256_add_ps(v[2], _mm256_mul_ps(_mm256_sub_ps(v[3], v[2]), f[0]));
+        __m256 c01 = _mm256_add_ps(v[4], _mm256_mul_ps(_mm256_sub_ps(v[5], v[4]), f[0]));
+        __m256 c11 = _mm256_add_ps(v[6], _mm256_mul_ps(_mm256_sub_ps(v[7], v[6]), f[0]));
+        __m256 c0 = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c10, c00), f[1]));
+        __m256 c1 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_sub_ps(c11, c01), f[1]));
+        out[c] = _mm256_add_ps(c0, _mm256_mul_ps(_mm256_sub_ps(c1, c0), f[2]));
+    }
+    r = out[0]; g = out[1]; b = out[2];
+}
+
+// n кратно 8
+POST_AVX2 inline void PostStepAvx2(const PostStep& step, PostStrip& s, uint32_t n)
+{
+    const __m256 k0 = _mm256_set1_ps(step.k[0]), k1 = _mm256_set1_ps(step.k[1]), k2 = _mm256_set1_ps(step.k[2]);
+    const __m256 one = _mm256_set1_ps(1.0f), inv255 = _mm256_set1_ps(1.0f / 255.0f);
+    for (uint32_t i = 0; i < n; i += 8)
+    {
+        __m256 r = _mm256_load_ps(s.r + i), g = _mm256_load_ps(s.g + i), b = _mm256_load_ps(s.b + i);
+        switch (step.op)
+        {
+        case POST_EXPOSURE:
+            r = _mm256_mul_ps(r, k0); g = _mm256_mul_ps(g, k0); b = _mm256_mul_ps(b, k0);
+            break;
+        case POST_REINHARD:
+            r = _mm256_div_ps(r, _mm256_add_ps(one, r)); g = _mm256_div_ps(g, _mm256_add_ps(one, g)); b = _mm256_div_ps(b, _mm256_add_ps(one, b));
+            break;
+        case POST_ACES:
+            r = PostAcesAvx2(r); g = PostAcesAvx2(g); b = PostAcesAvx2(b);
+            break;
+        case POST_LUT:
+            PostLutAvx2(*step.lut, r, g, b);
+            break;
+        case POST_GAMMA:
+            r = PostPowAvx2(r, k0); g = PostPowAvx2(g, k0); b = PostPowAvx2(b, k0);
+            break;
+        case POST_GRAYSCALE:
+            r = g = b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, k0), _mm256_mul_ps(g, k1)), _mm256_mul_ps(b, k2));
+            break;
+        case POST_QUANTIZE:
+            r = _mm256_mul_ps(_mm256_cvtepi32_ps(PostToUnorm8Avx2(r)), inv255);
+            g = _mm256_mul_ps(_mm256_cvtepi32_ps(PostToUnorm8Avx2(g)), inv255);
+            b = _mm256_mul_ps(_mm256_cvtepi32_ps(PostToUnorm8Avx2(b)), inv255);
+            break;
+        }
+        _mm256_store_ps(s.r + i, r); _mm256_store_ps(s.g + i, g); _mm256_store_ps(s.b + i, b);
+    }
+}
+
+template <typename Src>
+POST_AVX2 inline void PostStripAvx2(const PostChain& chain, const Src* src, uint32_t* dst, uint32_t n, PostStrip& s)
+{
+    PostLoadAvx2(src, s, n);
+    uint32_t n8 = (n + 7) & ~7u;
+    for (uint32_t i = n; i < n8; ++i) s.r[i] = s.g[i] = s.b[i] = s.a[i] = 0.0f;
+    for (const PostStep& step : chain.steps) PostStepAvx2(step, s, n8);
+    PostStoreAvx2(s, dst, n);
+}
+#else
+inline bool PostCpuHasAvx2() { return false; }
+#endif
+
+struct PostStats
+{
+    uint64_t pixels = 0;
+    uint32_t threads = 0;
+    bool avx2 = false;
+    double ms = 0.0;
+    double MPixelsPerSecond() const { return ms > 0.0 ? pixels / (ms * 1000.0) : 0.0; }
+};
+
+// Цепочка над count пикселями: src - RGBA8 (uint32_t, R в младшем байте) или RGBA32F (float x 4),
+// dst - RGBA8, может совпадать с src того же формата. Полосы раздаются потокам.
+template <typename Src>
+inline PostStats RunPostChain(const PostChain& chain, const Src* src, uint32_t* dst, size_t count, uint32_t threadCount, bool useSimd = true)
+{
+    static const bool hasAvx2 = PostCpuHasAvx2();
+    auto start = std::chrono::high_resolution_clock::now();
+    PostStats stats;
+    stats.pixels = count;
+    stats.avx2 = useSimd && hasAvx2;
+    uint32_t strips = (uint32_t)((count + POST_STRIP - 1) / POST_STRIP);
+    stats.threads = (std::max)(1u, (std::min)(threadCount, strips));
+    const size_t channels = std::is_same<Src, float>::value ? 4 : 1;   // элементов Src на пиксель
+    bool avx2 = stats.avx2;
+    DispatchGroups(strips, stats.threads, [&](uint32_t strip)
+    {
+        thread_local PostStrip s;
+        size_t first = (size_t)strip * POST_STRIP;
+        uint32_t n = (uint32_t)(std::min)((size_t)POST_STRIP, count - first);
+        const Src* in = src + first * channels;
+        uint32_t* out = dst + first;
+#ifdef POST_X64
+        if (avx2) { PostStripAvx2(chain, in, out, n, s); return; }
+#endif
+        PostLoadScalar(in, s, 0, n);
+        for (const PostStep& step : chain.steps) PostStepScalar(step, s, n);
+        PostStoreScalar(s, out, 0, n);
+    });
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
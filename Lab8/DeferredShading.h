@@ -0,0 +1,205 @@
+// Lab8_DeferredShading
+// Отложенное освещение: проход геометрии пишет компактный G-буфер, источники перебираются
+// полноэкранным проходом один раз на видимый пиксель - перекрытые фрагменты освещение не платят.
+// G-буфер, 8 байт на пиксель кроме глубины:
+//  - GBufferAlbedo, R8G8B8A8_UNORM: цвет текстуры, в альфе блеск / DEFERRED_MAX_SHININESS;
+//  - GBufferNormal, R16G16_SNORM: мировая нормаль в октаэдрической развёртке.
+// Позиция не хранится - восстанавливается по буферу глубины и обратной view-proj.
+// Источники пикселя - список его кластера (ClusteredLights.h): тайл экрана по пикселю, слой по глубине.
+// Функции повторяют gbufferPS и deferredPS из Source.cpp, включая округление к форматам целей,
+// поэтому разрешение по кластерам сверяется с полным перебором источников (Tests/DeferredShadingTest.cpp).
+// Без WinAPI/D3D: собирается и проверяется на любой платформе.
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "CpuMath.h"
+#include "ClusteredLights.h"
+#include "SoftRasterizer.h"
+
+const float DEFERRED_MAX_SHININESS = 255.0f;   // целые степени до 255 проходят через UNORM8 без потерь
+
+// ------------------------------------------------------------------
+// Октаэдрическая развёртка нормали: сфера -> октаэдр -> квадрат [-1, 1]^2
+// ------------------------------------------------------------------
+inline float OctSign(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+inline void OctEncode(const Float3& n, float& u, float& v)
+{
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    u = n.x / l1;
+    v = n.y / l1;
+    if (n.z < 0.0f)
+    {
+        // Нижняя полусфера отражается в углы квадрата
+        float pu = u, pv = v;
+        u = (1.0f - fabsf(pv)) * OctSign(pu);
+        v = (1.0f - fabsf(pu)) * OctSign(pv);
+    }
+}
+
+inline Float3 OctDecode(float u, float v)
+{
+    Float3 n = MakeFloat3(u, v, 1.0f - fabsf(u) - fabsf(v));
+    float t = (std::max)(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return Normalize(n);
+}
+
+// Запись в UNORM8 / SNORM16 и обратно - как преобразования формата при записи в цель и выборке
+inline uint32_t ToUnorm8(float v) { return (uint32_t)nearbyintf((std::min)((std::max)(v, 0.0f), 1.0f) * 255.0f); }
+inline int16_t ToSnorm16(float v) { return (int16_t)nearbyintf((std::min)((std::max)(v, -1.0f), 1.0f) * 32767.0f); }
+inline float FromSnorm16(int16_t v) { return (std::max)(v / 32767.0f, -1.0f); }
+
+struct GBufferTexel
+{
+    uint32_t albedo;      // RGBA8, R в младшем байте
+    int16_t normal[2];    // RG16_SNORM
+};
+
+struct GBufferSurface
+{
+    Float3 albedo;
+    Float3 normal;
+    float shininess;
+};
+
+// gbufferPS: нормаль уже нормализована
+inline GBufferTexel EncodeGBuffer(const Float3& albedo, const Float3& normal, float shininess)
+{
+    GBufferTexel t;
+    t.albedo = ToUnorm8(albedo.x) | (ToUnorm8(albedo.y) << 8) | (ToUnorm8(albedo.z) << 16) | (ToUnorm8(shininess / DEFERRED_MAX_SHININESS) << 24);
+    float u, v;
+    OctEncode(normal, u, v);
+    t.normal[0] = ToSnorm16(u);
+    t.normal[1] = ToSnorm16(v);
+    return t;
+}
+
+inline GBufferSurface DecodeGBuffer(const GBufferTexel& t)
+{
+    GBufferSurface s;
+    s.albedo = SwTexture::Unpack(t.albedo);
+    s.shininess = (t.albedo >> 24) / 255.0f * DEFERRED_MAX_SHININESS;
+    s.normal = OctDecode(FromSnorm16(t.normal[0]), FromSnorm16(t.normal[1]));
+    return s;
+}
+
+// Мировая позиция по глубине: x, y - центр пикселя, invViewProj - обратная view-proj (v * M)
+inline Float3 ReconstructWorldPosition(const Float4x4& invViewProj, float x, float y, float depth, float width, float height)
+{
+    Float4 p = TransformPoint(invViewProj, MakeFloat3(x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f, depth));
+    return Scale(MakeFloat3(p.x, p.y, p.z), 1.0f / p.w);
+}
+
+// Вклад источника по Фонгу, как PointLightContribution в clusteredLightingCode
+inline Float3 PointLightContribution(const PointLight& light, const Float3& world, const Float3& N, const Float3& V, const Float3& color, float shininess)
+{
+    Float3 L = Sub(light.pos, world);
+    float dist = Length(L);
+    L = Scale(L, 1.0f / dist);
+    float atten = SwLightAttenuation(dist, light.radius);
+    float diff = (std::max)(Dot(N, L), 0.0f);
+    Float3 R = Sub(Scale(N, 2.0f * Dot(N, L)), L);   // reflect(-L, N)
+    float spec = powf((std::max)(Dot(V, R), 0.0f), shininess);
+    return MakeFloat3((color.x * diff + spec) * atten * light.color.x,
+                      (color.y * diff + spec) * atten * light.color.y,
+                      (color.z * diff + spec) * atten * light.color.z);
+}
+
+// Кадр глазами прохода освещения
+struct DeferredView
+{
+    Float4x4 invViewProj;
+    Float3 cameraPos;
+    Float3 ambient;
+    float nearZ, farZ;
+};
+
+struct DeferredStats
+{
+    uint32_t shadedPixels = 0;       // пиксели с геометрией
+    uint64_t lightEvaluations = 0;   // источник x пиксель
+    uint32_t maxLightsPerPixel = 0;
+};
+
+// G-буфер кадра и буфер глубины (D32, 1 - пусто: там небо от прохода skybox)
+struct GBuffer
+{
+    uint32_t width = 0, height = 0;
+    std::vector<GBufferTexel> texels;
+    std::vector<float> depth;
+
+    void Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        texels.resize((size_t)w * h);
+        depth.resize((size_t)w * h);
+        Clear();
+    }
+
+    void Clear()
+    {
+        GBufferTexel empty = {};
+        std::fill(texels.begin(), texels.end(), empty);
+        std::fill(depth.begin(), depth.end(), 1.0f);
+    }
+
+    // Фрагмент прохода геометрии: тест глубины LESS, победитель пишет обе цели
+    bool Write(uint32_t x, uint32_t y, float z, const Float3& albedo, const Float3& normal, float shininess)
+    {
+        size_t i = (size_t)y * width + x;
+        if (!(z < depth[i])) return false;
+        depth[i] = z;
+        texels[i] = EncodeGBuffer(albedo, normal, shininess);
+        return true;
+    }
+
+    // deferredPS для пикселя (x, y); lightIndex(k) - k-й источник из count
+    template <typename LightIndexFn>
+    Float3 Shade(uint32_t x, uint32_t y, const DeferredView& view, const PointLight* lights, uint32_t count, LightIndexFn lightIndex) const
+    {
+        size_t i = (size_t)y * width + x;
+        GBufferSurface s = DecodeGBuffer(texels[i]);
+        Float3 world = ReconstructWorldPosition(view.invViewProj, x + 0.5f, y + 0.5f, depth[i], (float)width, (float)height);
+        Float3 V = Normalize(Sub(view.cameraPos, world));
+        Float3 result = MakeFloat3(view.ambient.x * s.albedo.x, view.ambient.y * s.albedo.y, view.ambient.z * s.albedo.z);
+        for (uint32_t k = 0; k < count; ++k)
+            result = Add(result, PointLightContribution(lights[lightIndex(k)], world, s.normal, V, s.albedo, s.shininess));
+        return result;
+    }
+
+    // Разрешение по спискам кластеров; пиксели неба в out не трогаются
+    DeferredStats Resolve(const DeferredView& view, const PointLight* lights, const LightClusters& clusters, Float3* out) const
+    {
+        DeferredStats stats;
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                size_t i = (size_t)y * width + x;
+                if (depth[i] >= 1.0f) continue;
+                uint32_t cluster = ClusterForPixel(x + 0.5f, y + 0.5f, depth[i], (float)width, (float)height, view.nearZ, view.farZ);
+                uint32_t first = clusters.ranges[cluster * 2], count = clusters.ranges[cluster * 2 + 1];
+                const uint32_t* indices = clusters.indices.data() + first;
+                out[i] = Shade(x, y, view, lights, count, [indices](uint32_t k) { return indices[k]; });
+                ++stats.shadedPixels;
+                stats.lightEvaluations += count;
+                stats.maxLightsPerPixel = (std::max)(stats.maxLightsPerPixel, count);
+            }
+        }
+        return stats;
+    }
+
+    // Эталон: все источники на каждый пиксель (за радиусом вклад нулевой, поэтому совпадает с Resolve)
+    void ResolveAllLights(const DeferredView& view, const PointLight* lights, uint32_t lightCount, Float3* out) const
+    {
+        for (uint32_t y = 0; y < height; ++y)
+            for (uint32_t x = 0; x < width; ++x)
+                if (depth[(size_t)y * width + x] < 1.0f)
+                    out[(size_t)y * width + x] = Shade(x, y, view, lights, lightCount, [](uint32_t k) { return k; });
+    }
+};
@@ -0,0 +1,206 @@
+// Lab8_FrameGovernor
+// Регулятор бюджета кадра: следит за временем CPU и GPU последних кадров и держит кадр в бюджете,
+// меняя три ручки детализации:
+//  - разрешение рендера - доля цели, в которую рисуется сцена (цели выделены под полный размер окна,
+//    смена доли - только viewport, без пересоздания текстур); растягивает проход POSTPROCESS;
+//  - сдвиг LOD - множитель экранного размера при выборе LOD (меньше - грубее);
+//  - плотность экземпляров - доля рисуемых экземпляров (префикс массива, см. CreateInstances).
+// Какую ручку крутить, решает узкое место: по GPU - разрешение, затем LOD, затем плотность;
+// по CPU - только плотность (остальное CPU не разгружает). Повышение снимает последнее понижение.
+// Гистерезис:
+//  - понижение - медиана окна выше budget * overFraction, повышение - ниже budget * underFraction
+//    raiseFrames кадров подряд (медиана не замечает одиночных всплесков);
+//  - повышение ещё и прогнозирует кадр: время, умноженное на выигрыш снимаемого понижения
+//    (медианы до и после него), должно остаться ниже budget * overFraction. Выигрыш ограничен
+//    номинальным (отношение пикселей, масштабов LOD, числа экземпляров): иначе понижение во время
+//    всплеска нагрузки "выигрывает" весь всплеск и качество не возвращается никогда;
+//  - после каждого шага settleFrames кадров пропускаются - время GPU приходит с опозданием
+//    на кадры в полёте - и окно набирается заново;
+//  - если повышение откатилось в течение probeFrames, следующее ждёт вдвое дольше (до maxRaiseFrames),
+//    удачное - вдвое сокращает ожидание: нагрузка между порогами ступеней не раскачивает качество.
+// Без WinAPI/D3D: собирается и проверяется на любой платформе синтетическими трассами времени кадра
+// (Tests/FrameGovernorTest.cpp: порядок шагов, settle, откаты и отсрочка повышения, сценарии нагрузки).
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+enum GovernorKnob { GOVERNOR_RESOLUTION, GOVERNOR_LOD, GOVERNOR_DENSITY, GOVERNOR_KNOB_COUNT };
+
+// Ступени ручек, от полного качества к грубому
+const float GOVERNOR_RENDER_SCALES[] = { 1.0f, 0.875f, 0.75f, 0.625f, 0.5f };
+const float GOVERNOR_LOD_SCALES[] = { 1.0f, 0.7f, 0.5f };
+const float GOVERNOR_DENSITIES[] = { 1.0f, 0.75f, 0.5f };
+const uint32_t GOVERNOR_STEPS[GOVERNOR_KNOB_COUNT] = {
+    sizeof(GOVERNOR_RENDER_SCALES) / sizeof(float), sizeof(GOVERNOR_LOD_SCALES) / sizeof(float), sizeof(GOVERNOR_DENSITIES) / sizeof(float) };
+
+struct GovernorSettings
+{
+    double budgetMs = 1000.0 / 60.0;
+    double overFraction = 0.95;      // запас на всплески внутри бюджета
+    double underFraction = 0.7;      // повышение, только если и после него кадр скорее всего уложится
+    uint32_t window = 8;             // кадров в медиане
+    uint32_t settleFrames = 4;       // после шага: кадры в полёте + 1
+    uint32_t raiseFrames = 60;
+    uint32_t probeFrames = 600;      // повышение, пережившее столько кадров, считается удачным
+    uint32_t maxRaiseFrames = 960;
+};
+
+// Размер области рендера: не меньше пикселя
+inline uint32_t GovernorRenderSize(uint32_t size, float scale)
+{
+    return (std::max)(1u, (uint32_t)(size * scale + 0.5f));
+}
+
+inline uint32_t GovernorInstanceCount(uint32_t total, float density)
+{
+    return (std::max)(1u, (uint32_t)ceilf(total * density - 1e-4f));
+}
+
+struct GovernorStats
+{
+    uint64_t frames = 0;
+    uint32_t drops = 0;
+    uint32_t raises = 0;
+    uint32_t rollbacks = 0;      // понижений сразу после повышения
+    uint32_t exhausted = 0;      // кадров сверх бюджета, когда крутить уже нечего
+};
+
+struct FrameGovernor
+{
+    GovernorSettings settings;
+    uint32_t step[GOVERNOR_KNOB_COUNT] = {};
+    GovernorStats stats;
+
+    float RenderScale() const { return GOVERNOR_RENDER_SCALES[step[GOVERNOR_RESOLUTION]]; }
+    float LodScale() const { return GOVERNOR_LOD_SCALES[step[GOVERNOR_LOD]]; }
+    float Density() const { return GOVERNOR_DENSITIES[step[GOVERNOR_DENSITY]]; }
+    uint32_t Drops() const { return (uint32_t)history.size(); }
+    uint32_t RaiseDelay() const { return raiseDelay; }
+    bool GpuBound() const { return gpuBound; }
+
+    // После смены settings
+    void Reset()
+    {
+        for (uint32_t k = 0; k < GOVERNOR_KNOB_COUNT; ++k) step[k] = 0;
+        history.clear();
+        stats = GovernorStats();
+        raiseDelay = settings.raiseFrames;
+        sinceRaise = ~0u;
+        Restart();
+    }
+
+    // Кадр: время работы CPU (без ожидания GPU) и GPU, 0 - нет данных.
+    // true - ступень изменилась, новое качество действует со следующего кадра
+    bool Update(double cpuMs, double gpuMs)
+    {
+        ++stats.frames;
+        if (sinceRaise != ~0u && ++sinceRaise >= settings.probeFrames)
+        {
+            raiseDelay = (std::max)(raiseDelay / 2, settings.raiseFrames);   // повышение прижилось
+            sinceRaise = ~0u;
+        }
+        if (settle) { --settle; return false; }
+
+        cpu[head] = cpuMs;
+        gpu[head] = gpuMs;
+        head = (head + 1) % Window();
+        if (++filled < Window()) return false;
+        filled = Window();
+
+        double cpuMedian = Median(cpu), gpuMedian = Median(gpu);
+        double frameMs = (std::max)(cpuMedian, gpuMedian);
+        gpuBound = gpuMedian >= cpuMedian;
+        if (!history.empty() && history.back().afterMs == 0.0) history.back().afterMs = frameMs;
+        if (frameMs > settings.budgetMs * settings.overFraction)
+        {
+            underFrames = 0;
+            if (Lower(frameMs)) return true;
+            ++stats.exhausted;
+            return false;
+        }
+        if (frameMs < settings.budgetMs * settings.underFraction && !history.empty() &&
+            frameMs * history.back().Gain() < settings.budgetMs * settings.overFraction)
+        {
+            if (++underFrames >= raiseDelay) { Raise(); return true; }
+        }
+        else
+            underFrames = 0;
+        return false;
+    }
+
+private:
+    struct Drop
+    {
+        uint32_t knob;
+        double beforeMs, afterMs;    // медианы до и после понижения, 0 - ещё не измерено
+        double nominalGain;
+        double Gain() const { return afterMs > 0.0 ? (std::min)(beforeMs / afterMs, nominalGain) : nominalGain; }
+    };
+    std::vector<Drop> history;       // понижения по порядку
+    double cpu[64] = {}, gpu[64] = {};
+    uint32_t head = 0, filled = 0, settle = 0, underFrames = 0;
+    uint32_t raiseDelay = GovernorSettings().raiseFrames;
+    uint32_t sinceRaise = ~0u;       // кадров после повышения, ~0 - проба не идёт
+    bool gpuBound = false;
+
+    static double Value(uint32_t knob, uint32_t s)
+    {
+        return knob == GOVERNOR_RESOLUTION ? GOVERNOR_RENDER_SCALES[s] : knob == GOVERNOR_LOD ? GOVERNOR_LOD_SCALES[s] : GOVERNOR_DENSITIES[s];
+    }
+
+    uint32_t Window() const { return (std::min)((std::max)(settings.window, 1u), 64u); }
+
+    double Median(const double* samples) const
+    {
+        double sorted[64];
+        uint32_t n = Window();
+        std::copy(samples, samples + n, sorted);
+        std::nth_element(sorted, sorted + n / 2, sorted + n);
+        return sorted[n / 2];
+    }
+
+    bool TryDrop(uint32_t knob, double frameMs)
+    {
+        if (step[knob] + 1 >= GOVERNOR_STEPS[knob]) return false;
+        double ratio = Value(knob, step[knob]) / Value(knob, step[knob] + 1);
+        ++step[knob];
+        Drop drop = { knob, frameMs, 0.0, knob == GOVERNOR_RESOLUTION ? ratio * ratio : ratio };
+        history.push_back(drop);
+        return true;
+    }
+
+    bool Lower(double frameMs)
+    {
+        bool dropped = gpuBound
+            ? TryDrop(GOVERNOR_RESOLUTION, frameMs) || TryDrop(GOVERNOR_LOD, frameMs) || TryDrop(GOVERNOR_DENSITY, frameMs)
+            : TryDrop(GOVERNOR_DENSITY, frameMs);
+        if (!dropped) return false;
+        ++stats.drops;
+        if (sinceRaise != ~0u)
+        {
+            // Повышение не удержалось: следующее ждёт дольше
+            ++stats.rollbacks;
+            raiseDelay = (std::min)(raiseDelay * 2, settings.maxRaiseFrames);
+            sinceRaise = ~0u;
+        }
+        Restart();
+        return true;
+    }
+
+    void Raise()
+    {
+        --step[history.back().knob];
+        history.pop_back();
+        ++stats.raises;
+        sinceRaise = 0;
+        Restart();
+    }
+
+    void Restart()
+    {
+        head = filled = underFrames = 0;
+        settle = settings.settleFrames;
+    }
+};
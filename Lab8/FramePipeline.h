@@ -0,0 +1,99 @@
+// Lab8_FramePipeline
+// Кадры в полёте: N слотов, у каждого свои динамические буферы, запросы и забор (fence).
+// CPU готовит кадр N+1, пока GPU исполняет кадр N. Слот берётся снова только после того,
+// как GPU завершил его прошлый кадр, поэтому данные слота не перезаписываются под GPU.
+// Кадры нумеруются с 1, кадр f живёт в слоте (f - 1) % N и завершается строго по порядку.
+// Забор задаёт Api: в приложении - D3D11_QUERY_EVENT, в проверках - симуляция шкалы GPU
+// (Tests/FramePipelineTest.cpp: 1000 кадров на 1-4 слотах, запись под GPU, порядок, темп кадра).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <chrono>
+
+template <typename Api>
+struct FramePipeline
+{
+    typedef typename Api::Context Context;
+    typedef typename Api::Fence Fence;
+
+    struct Slot
+    {
+        Fence* fence = nullptr;
+        uint64_t frame = 0;   // последний отправленный в слоте кадр (0 - ещё не было)
+    };
+
+    Context* context = nullptr;
+    std::vector<Slot> slots;
+    uint64_t frame = 0;            // текущий кадр CPU
+    uint64_t completedFrame = 0;   // последний кадр, завершённый GPU
+    uint64_t stalls = 0;           // сколько раз BeginFrame ждал GPU
+    double waitMs = 0.0;           // суммарное ожидание
+
+    uint32_t SlotCount() const { return (uint32_t)slots.size(); }
+    uint32_t Current() const { return (uint32_t)((frame - 1) % slots.size()); }
+    uint64_t InFlight() const { return frame - completedFrame; }
+
+    // Без ожидания: забирает завершённые кадры по порядку, onComplete(slot, frame) на каждый
+    template <typename OnComplete>
+    void Poll(OnComplete onComplete)
+    {
+        while (completedFrame < frame)
+        {
+            uint32_t index = (uint32_t)(completedFrame % slots.size());
+            if (slots[index].frame != completedFrame + 1) break;   // кадр ещё не отправлен
+            if (!Api::IsComplete(context, slots[index].fence)) break;
+            Retire(index, onComplete);
+        }
+    }
+
+    // Начало кадра: номер слота, свободного от GPU. Ждёт, только если все N слотов в полёте.
+    template <typename OnComplete>
+    uint32_t BeginFrame(OnComplete onComplete)
+    {
+        Poll(onComplete);
+        ++frame;
+        uint32_t index = Current();
+        if (slots[index].frame > completedFrame)
+        {
+            ++stalls;
+            auto start = std::chrono::high_resolution_clock::now();
+            while (completedFrame < slots[index].frame)
+            {
+                uint32_t oldest = (uint32_t)(completedFrame % slots.size());
+                Api::Wait(context, slots[oldest].fence);
+                Retire(oldest, onComplete);
+            }
+            waitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+        return index;
+    }
+
+    // Конец кадра: забор ставится после всех команд кадра
+    void EndFrame()
+    {
+        Slot& slot = slots[Current()];
+        Api::Signal(context, slot.fence);
+        slot.frame = frame;
+    }
+
+    // Дождаться всех отправленных кадров (перед освобождением ресурсов слотов)
+    template <typename OnComplete>
+    void Drain(OnComplete onComplete)
+    {
+        while (completedFrame < frame)
+        {
+            uint32_t index = (uint32_t)(completedFrame % slots.size());
+            if (slots[index].frame != completedFrame + 1) break;
+            Api::Wait(context, slots[index].fence);
+            Retire(index, onComplete);
+        }
+    }
+
+private:
+    template <typename OnComplete>
+    void Retire(uint32_t index, OnComplete& onComplete)
+    {
+        completedFrame = slots[index].frame;
+        onComplete(index, completedFrame);
+    }
+};
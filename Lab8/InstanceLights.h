@@ -0,0 +1,201 @@
+// Lab8_InstanceLights
+// Списки источников на экземпляр: до INSTANCE_LIGHT_K источников, чья сфера влияния задевает AABB экземпляра.
+// Источники раскладываются в равномерную сетку (источник попадает во все ячейки, которые задевает его сфера),
+// экземпляр проверяет только источники ячеек своего AABB - SSE по 4 за раз.
+// Дубликаты отбрасываются без лишней памяти: пара (источник, экземпляр) засчитывается только в ячейке,
+// где начинается пересечение их AABB.
+// Если источников больше K, остаются K самых сильных (ближе всего к боксу относительно радиуса).
+// Считается только для видимых экземпляров, группы по 64 раздаются потокам.
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <xmmintrin.h>
+#include "CpuMath.h"
+#include "ClusteredLights.h"
+#include "ContributionCulling.h"
+#include "WorkerPool.h"
+
+const uint32_t INSTANCE_LIGHT_K = 8;
+const uint32_t INSTANCE_LIGHT_GROUP = 64;   // экземпляров на группу DispatchGroups
+
+// ------------------------------------------------------------------
+// Равномерная сетка источников
+// ------------------------------------------------------------------
+struct LightGrid
+{
+    Float3 origin = {};
+    float cellSize = 1.0f, invCellSize = 1.0f;
+    uint32_t dimX = 1, dimY = 1, dimZ = 1;
+    std::vector<uint32_t> cellStart;          // dimX * dimY * dimZ + 1
+    std::vector<float> x, y, z, r;            // копии источников по ячейкам (SoA)
+    std::vector<uint32_t> id;
+    std::vector<uint32_t> firstCell;          // младшая ячейка источника: x | y << 10 | z << 20
+
+    int CellCoord(float v, float o, uint32_t dim) const
+    {
+        int c = (int)floorf((v - o) * invCellSize);
+        return (std::min)((std::max)(c, 0), (int)dim - 1);
+    }
+    uint32_t CellIndex(int cx, int cy, int cz) const { return ((uint32_t)cz * dimY + (uint32_t)cy) * dimX + (uint32_t)cx; }
+
+    // cellSize <= 0 - взять удвоенный средний радиус
+    void Build(const PointLight* lights, uint32_t count, float cellSizeHint = 0.0f, uint32_t maxCellsPerAxis = 128)
+    {
+        Float3 lo = MakeFloat3(FLT_MAX, FLT_MAX, FLT_MAX), hi = MakeFloat3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        float radiusSum = 0.0f;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const PointLight& l = lights[i];
+            lo = MakeFloat3((std::min)(lo.x, l.pos.x - l.radius), (std::min)(lo.y, l.pos.y - l.radius), (std::min)(lo.z, l.pos.z - l.radius));
+            hi = MakeFloat3((std::max)(hi.x, l.pos.x + l.radius), (std::max)(hi.y, l.pos.y + l.radius), (std::max)(hi.z, l.pos.z + l.radius));
+            radiusSum += l.radius;
+        }
+        if (count == 0) { lo = hi = MakeFloat3(0, 0, 0); }
+        origin = lo;
+        cellSize = cellSizeHint > 0.0f ? cellSizeHint : (count ? (std::max)(2.0f * radiusSum / count, 1e-3f) : 1.0f);
+        Float3 extent = Sub(hi, lo);
+        float largest = (std::max)((std::max)(extent.x, extent.y), extent.z);
+        cellSize = (std::max)(cellSize, largest / (std::min)(maxCellsPerAxis, 1024u));
+        invCellSize = 1.0f / cellSize;
+        dimX = (std::max)(1u, (uint32_t)ceilf(extent.x * invCellSize));
+        dimY = (std::max)(1u, (uint32_t)ceilf(extent.y * invCellSize));
+        dimZ = (std::max)(1u, (uint32_t)ceilf(extent.z * invCellSize));
+
+        // Подсчёт -> префиксная сумма -> заполнение
+        uint32_t cellCount = dimX * dimY * dimZ;
+        cellStart.assign(cellCount + 1, 0u);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            if (pass == 1)
+            {
+                uint32_t offset = 0;
+                for (uint32_t c = 0; c <= cellCount; ++c) { uint32_t n = cellStart[c]; cellStart[c] = offset; offset += n; }
+                x.resize(offset); y.resize(offset); z.resize(offset); r.resize(offset); id.resize(offset); firstCell.resize(offset);
+            }
+            std::vector<uint32_t> cursor;
+            if (pass == 1) cursor.assign(cellStart.begin(), cellStart.end() - 1);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const PointLight& l = lights[i];
+                int x0 = CellCoord(l.pos.x - l.radius, origin.x, dimX), x1 = CellCoord(l.pos.x + l.radius, origin.x, dimX);
+                int y0 = CellCoord(l.pos.y - l.radius, origin.y, dimY), y1 = CellCoord(l.pos.y + l.radius, origin.y, dimY);
+                int z0 = CellCoord(l.pos.z - l.radius, origin.z, dimZ), z1 = CellCoord(l.pos.z + l.radius, origin.z, dimZ);
+                for (int cz = z0; cz <= z1; ++cz)
+                    for (int cy = y0; cy <= y1; ++cy)
+                        for (int cx = x0; cx <= x1; ++cx)
+                        {
+                            uint32_t c = CellIndex(cx, cy, cz);
+                            if (pass == 0) { ++cellStart[c]; continue; }
+                            uint32_t slot = cursor[c]++;
+                            x[slot] = l.pos.x; y[slot] = l.pos.y; z[slot] = l.pos.z; r[slot] = l.radius; id[slot] = i;
+                            firstCell[slot] = (uint32_t)x0 | ((uint32_t)y0 << 10) | ((uint32_t)z0 << 20);
+                        }
+            }
+        }
+    }
+};
+
+// ------------------------------------------------------------------
+// Назначение источников экземплярам
+// ------------------------------------------------------------------
+struct InstanceLightLists
+{
+    // (K + 1) uint на экземпляр: [0] - число источников, далее их индексы
+    std::vector<uint32_t> lists;
+    uint64_t assigned = 0, overflowed = 0;
+    std::vector<uint32_t> groupAssigned, groupOverflowed;   // итоги групп, живут между кадрами
+
+    static uint32_t Stride() { return INSTANCE_LIGHT_K + 1; }
+    uint32_t Count(uint32_t instance) const { return lists[instance * Stride()]; }
+    const uint32_t* Lights(uint32_t instance) const { return &lists[instance * Stride() + 1]; }
+
+    // visible - ID видимых экземпляров (после culling); списки невидимых не трогаются
+    void Assign(const LightGrid& grid, const AABBSoA& boxes, const uint32_t* visible, uint32_t visibleCount,
+        uint32_t threadCount, bool useSimd = true)
+    {
+        if (lists.size() < boxes.Size() * Stride()) lists.resize(boxes.Size() * Stride(), 0u);
+        uint32_t groupCount = (visibleCount + INSTANCE_LIGHT_GROUP - 1) / INSTANCE_LIGHT_GROUP;
+        groupAssigned.assign(groupCount, 0u);
+        groupOverflowed.assign(groupCount, 0u);
+        DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+        {
+            uint32_t end = (std::min)(visibleCount, (g + 1) * INSTANCE_LIGHT_GROUP);
+            for (uint32_t v = g * INSTANCE_LIGHT_GROUP; v < end; ++v)
+            {
+                uint32_t total = AssignOne(grid, boxes, visible[v], useSimd);
+                groupAssigned[g] += (std::min)(total, INSTANCE_LIGHT_K);
+                if (total > INSTANCE_LIGHT_K) ++groupOverflowed[g];
+            }
+        });
+        assigned = overflowed = 0;
+        for (uint32_t g = 0; g < groupCount; ++g) { assigned += groupAssigned[g]; overflowed += groupOverflowed[g]; }
+    }
+
+private:
+    // Возвращает число задевающих источников (может быть больше K)
+    uint32_t AssignOne(const LightGrid& grid, const AABBSoA& boxes, uint32_t inst, bool useSimd)
+    {
+        float bminX = boxes.minX[inst], bminY = boxes.minY[inst], bminZ = boxes.minZ[inst];
+        float bmaxX = boxes.maxX[inst], bmaxY = boxes.maxY[inst], bmaxZ = boxes.maxZ[inst];
+        int cx0 = grid.CellCoord(bminX, grid.origin.x, grid.dimX), cx1 = grid.CellCoord(bmaxX, grid.origin.x, grid.dimX);
+        int cy0 = grid.CellCoord(bminY, grid.origin.y, grid.dimY), cy1 = grid.CellCoord(bmaxY, grid.origin.y, grid.dimY);
+        int cz0 = grid.CellCoord(bminZ, grid.origin.z, grid.dimZ), cz1 = grid.CellCoord(bmaxZ, grid.origin.z, grid.dimZ);
+
+        uint32_t* out = &lists[inst * Stride()];
+        float score[INSTANCE_LIGHT_K];
+        uint32_t kept = 0, total = 0;
+
+        // Пара засчитывается в ячейке, где начинается пересечение AABB источника и экземпляра
+        auto accept = [&](uint32_t slot, float d2, int cx, int cy, int cz)
+        {
+            uint32_t first = grid.firstCell[slot];
+            if (cx != (std::max)(cx0, (int)(first & 1023)) || cy != (std::max)(cy0, (int)((first >> 10) & 1023)) ||
+                cz != (std::max)(cz0, (int)(first >> 20))) return;
+            ++total;
+            float s = d2 / (grid.r[slot] * grid.r[slot]); // 0 - бокс в центре источника, 1 - на границе влияния
+            if (kept < INSTANCE_LIGHT_K) { score[kept] = s; out[1 + kept++] = grid.id[slot]; return; }
+            uint32_t worst = 0;
+            for (uint32_t k = 1; k < INSTANCE_LIGHT_K; ++k) if (score[k] > score[worst]) worst = k;
+            if (s < score[worst]) { score[worst] = s; out[1 + worst] = grid.id[slot]; }
+        };
+
+        for (int cz = cz0; cz <= cz1; ++cz)
+            for (int cy = cy0; cy <= cy1; ++cy)
+                for (int cx = cx0; cx <= cx1; ++cx)
+                {
+                    uint32_t c = grid.CellIndex(cx, cy, cz);
+                    uint32_t i = grid.cellStart[c], end = grid.cellStart[c + 1];
+                    if (useSimd)
+                    {
+                        const __m128 zero = _mm_setzero_ps();
+                        const __m128 minX = _mm_set1_ps(bminX), minY = _mm_set1_ps(bminY), minZ = _mm_set1_ps(bminZ);
+                        const __m128 maxX = _mm_set1_ps(bmaxX), maxY = _mm_set1_ps(bmaxY), maxZ = _mm_set1_ps(bmaxZ);
+                        for (; i + 4 <= end; i += 4)
+                        {
+                            __m128 lx = _mm_loadu_ps(&grid.x[i]), ly = _mm_loadu_ps(&grid.y[i]), lz = _mm_loadu_ps(&grid.z[i]), lr = _mm_loadu_ps(&grid.r[i]);
+                            __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, lx), _mm_sub_ps(lx, maxX)), zero);
+                            __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, ly), _mm_sub_ps(ly, maxY)), zero);
+                            __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, lz), _mm_sub_ps(lz, maxZ)), zero);
+                            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                            int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(lr, lr)));
+                            if (!mask) continue;
+                            float d2s[4];
+                            _mm_storeu_ps(d2s, d2);
+                            for (int lane = 0; lane < 4; ++lane)
+                                if (mask & (1 << lane)) accept(i + lane, d2s[lane], cx, cy, cz);
+                        }
+                    }
+                    for (; i < end; ++i)
+                    {
+                        float dx = (std::max)((std::max)(bminX - grid.x[i], grid.x[i] - bmaxX), 0.0f);
+                        float dy = (std::max)((std::max)(bminY - grid.y[i], grid.y[i] - bmaxY), 0.0f);
+                        float dz = (std::max)((std::max)(bminZ - grid.z[i], grid.z[i] - bmaxZ), 0.0f);
+                        float d2 = dx * dx + dy * dy + dz * dz;
+                        if (d2 <= grid.r[i] * grid.r[i]) accept(i, d2, cx, cy, cz);
+                    }
+                }
+        out[0] = kept;
+        return total;
+    }
+};
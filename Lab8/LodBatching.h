@@ -0,0 +1,118 @@
+// Lab8_LodBatching
+// Выбор LOD по экранному размеру и раскладка видимых экземпляров по корзинам (mesh, LOD)
+// с массивом indirect args: одна косвенная отрисовка на корзину.
+// CPU-эталон того, что делают cullCS / batchArgsCS / scatterCS в Source.cpp
+// (сверяется с моделью этих шейдеров в Tests/LodBatchingTest.cpp).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "CpuMath.h"
+
+const uint32_t MAX_LODS = 4;
+
+// Аналог D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS
+struct IndirectDrawArgs
+{
+    uint32_t IndexCountPerInstance;
+    uint32_t InstanceCount;
+    uint32_t StartIndexLocation;
+    int32_t  BaseVertexLocation;
+    uint32_t StartInstanceLocation;
+};
+
+struct MeshLod { uint32_t indexCount, startIndex; int32_t baseVertex; };
+
+// LOD l используется, пока экранный размер >= minScreenSize[l] (в пикселях);
+// последний LOD берётся для всего, что меньше.
+struct MeshLodChain
+{
+    uint32_t lodCount = 0;
+    MeshLod lods[MAX_LODS] = {};
+    float minScreenSize[MAX_LODS] = {};
+};
+
+inline uint32_t LodBucket(uint32_t meshId, uint32_t lod) { return meshId * MAX_LODS + lod; }
+
+// Наибольшая сторона экранной проекции AABB в пикселях (без обрезки по экрану).
+// Если бокс пересекает ближнюю плоскость - размер "бесконечный" (самый детальный LOD).
+inline float ProjectedScreenSize(const Float4x4& viewProj, const Float3& bmin, const Float3& bmax, float viewportW, float viewportH)
+{
+    float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+    for (int c = 0; c < 8; ++c)
+    {
+        Float3 p = MakeFloat3((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+        Float4 clip = TransformPoint(viewProj, p);
+        if (clip.w <= 1e-5f) return FLT_MAX;
+        float invW = 1.0f / clip.w;
+        float x = clip.x * invW * 0.5f * viewportW;
+        float y = clip.y * invW * 0.5f * viewportH;
+        x0 = (std::min)(x0, x); x1 = (std::max)(x1, x);
+        y0 = (std::min)(y0, y); y1 = (std::max)(y1, y);
+    }
+    return (std::max)(x1 - x0, y1 - y0);
+}
+
+inline uint32_t SelectLod(const MeshLodChain& mesh, float screenSize)
+{
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.lodCount && screenSize < mesh.minScreenSize[lod]) ++lod;
+    return lod;
+}
+
+// ------------------------------------------------------------------
+// Раскладка по корзинам: подсчёт -> префиксная сумма -> разброс ID.
+// Внутри корзины сохраняется порядок входного списка.
+// ------------------------------------------------------------------
+struct LodBatches
+{
+    std::vector<uint32_t> instanceBucket;  // корзина каждого видимого экземпляра
+    std::vector<uint32_t> cursors;
+    std::vector<uint32_t> visibleIds;      // ID экземпляров, сгруппированные по корзинам
+    std::vector<IndirectDrawArgs> args;    // по одной записи на корзину (meshCount * MAX_LODS)
+
+    // visible - ID экземпляров, прошедших culling; meshIds/screenSizes индексируются ID экземпляра
+    void Build(const MeshLodChain* meshes, uint32_t meshCount,
+        const uint32_t* visible, uint32_t visibleCount,
+        const uint32_t* meshIds, const float* screenSizes)
+    {
+        uint32_t bucketCount = meshCount * MAX_LODS;
+        args.assign(bucketCount, IndirectDrawArgs());
+        cursors.assign(bucketCount, 0u);
+        instanceBucket.resize(visibleCount);
+        visibleIds.resize(visibleCount);
+
+        for (uint32_t v = 0; v < visibleCount; ++v)
+        {
+            uint32_t id = visible[v];
+            uint32_t mesh = meshIds[id];
+            uint32_t bucket = LodBucket(mesh, SelectLod(meshes[mesh], screenSizes[id]));
+            instanceBucket[v] = bucket;
+            ++args[bucket].InstanceCount;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t b = 0; b < bucketCount; ++b)
+        {
+            const MeshLod& lod = meshes[b / MAX_LODS].lods[b % MAX_LODS];
+            args[b].IndexCountPerInstance = lod.indexCount;
+            args[b].StartIndexLocation = lod.startIndex;
+            args[b].BaseVertexLocation = lod.baseVertex;
+            args[b].StartInstanceLocation = offset;
+            offset += args[b].InstanceCount;
+        }
+
+        for (uint32_t v = 0; v < visibleCount; ++v)
+        {
+            uint32_t b = instanceBucket[v];
+            visibleIds[args[b].StartInstanceLocation + cursors[b]++] = visible[v];
+        }
+    }
+
+    uint32_t NonEmptyDrawCount() const
+    {
+        uint32_t n = 0;
+        for (const IndirectDrawArgs& a : args) if (a.InstanceCount) ++n;
+        return n;
+    }
+};
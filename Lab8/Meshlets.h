@@ -0,0 +1,199 @@
+// Lab8_Meshlets
+// Разбиение индексированного мэша на кластеры (meshlets) до 64 вершин и 124 треугольников,
+// у каждого кластера - ограничивающая сфера и конус нормалей.
+// CPU-проход отбрасывает кластеры вне фрустума и целиком повёрнутые от камеры
+// и выдаёт диапазоны индексов под косвенную отрисовку: по записи на диапазон, экземпляр -
+// через StartInstanceLocation (Tests/MeshletsTest.cpp: покрытие мэша, консервативность отсечения
+// против потреугольной проверки, диапазоны против выживших кластеров).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "CpuMath.h"
+#include "LodBatching.h"
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+    uint32_t vertexOffset, vertexCount;     // диапазон в MeshletMesh::vertices
+    uint32_t triangleOffset, triangleCount; // диапазон треугольников в MeshletMesh::triangles (по 3 локальных индекса)
+    Float3 center; float radius;            // ограничивающая сфера
+    Float3 coneAxis; float coneCutoff;      // конус нормалей: ось - средняя нормаль, cutoff - sin раскрытия
+};
+
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;   // глобальные индексы вершин по кластерам
+    std::vector<uint8_t> triangles;   // локальные индексы вершин кластера
+
+    uint32_t TriangleCount() const { return (uint32_t)(triangles.size() / 3); }
+};
+
+// ------------------------------------------------------------------
+// Построение: жадно по порядку индексов, новый кластер - когда не лезут вершины или треугольники
+// ------------------------------------------------------------------
+inline void ComputeMeshletBounds(Meshlet& m, const MeshletMesh& mesh, const Float3* positions)
+{
+    Float3 lo = MakeFloat3(FLT_MAX, FLT_MAX, FLT_MAX), hi = MakeFloat3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t v = 0; v < m.vertexCount; ++v)
+    {
+        const Float3& p = positions[mesh.vertices[m.vertexOffset + v]];
+        lo = MakeFloat3((std::min)(lo.x, p.x), (std::min)(lo.y, p.y), (std::min)(lo.z, p.z));
+        hi = MakeFloat3((std::max)(hi.x, p.x), (std::max)(hi.y, p.y), (std::max)(hi.z, p.z));
+    }
+    m.center = Scale(Add(lo, hi), 0.5f);
+    m.radius = 0.0f;
+    for (uint32_t v = 0; v < m.vertexCount; ++v)
+        m.radius = (std::max)(m.radius, Length(Sub(positions[mesh.vertices[m.vertexOffset + v]], m.center)));
+
+    // Ось конуса - средняя нормаль, раскрытие - по наихудшему треугольнику.
+    // Считаем в double: у мелких треугольников (полюса сферы) float-нормали и 1 - minDot^2
+    // теряют точность, а ошибка раскрытия даёт ложное отсечение.
+    std::vector<double> normals;
+    normals.reserve(m.triangleCount * 3);
+    double axis[3] = { 0.0, 0.0, 0.0 };
+    for (uint32_t t = 0; t < m.triangleCount; ++t)
+    {
+        const uint8_t* tri = &mesh.triangles[(m.triangleOffset + t) * 3];
+        const Float3& a = positions[mesh.vertices[m.vertexOffset + tri[0]]];
+        const Float3& b = positions[mesh.vertices[m.vertexOffset + tri[1]]];
+        const Float3& c = positions[mesh.vertices[m.vertexOffset + tri[2]]];
+        double e1[3] = { (double)b.x - a.x, (double)b.y - a.y, (double)b.z - a.z };
+        double e2[3] = { (double)c.x - a.x, (double)c.y - a.y, (double)c.z - a.z };
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]); // наружу при обходе по часовой (как в Source.cpp)
+        if (len == 0.0) continue;                                    // вырожденный треугольник не влияет на конус
+        for (int k = 0; k < 3; ++k) { normals.push_back(n[k] / len); axis[k] += n[k] / len; }
+    }
+    double axisLen = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    double minDot = 1.0;
+    if (axisLen > 0.0)
+    {
+        for (int k = 0; k < 3; ++k) axis[k] /= axisLen;
+        for (size_t i = 0; i < normals.size(); i += 3)
+            minDot = (std::min)(minDot, normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]);
+    }
+    m.coneAxis = MakeFloat3((float)axis[0], (float)axis[1], (float)axis[2]);
+    if (normals.empty() || axisLen < 1e-6 || minDot <= 0.0)
+    {
+        m.coneCutoff = 1.0f; // конус шире полусферы - такой кластер по нормалям не отсекается
+        return;
+    }
+    m.coneCutoff = (std::min)((float)sqrt((1.0 - minDot) * (1.0 + minDot)) + 1e-4f, 1.0f); // sin раскрытия с запасом на float в тесте
+}
+
+inline void BuildMeshlets(MeshletMesh& out, const uint32_t* indices, uint32_t indexCount, const Float3* positions, uint32_t vertexCount)
+{
+    out.meshlets.clear();
+    out.vertices.clear();
+    out.triangles.clear();
+
+    std::vector<int32_t> localIndex(vertexCount, -1); // глобальная вершина -> локальная в текущем кластере
+    Meshlet cur = {};
+
+    auto flush = [&]()
+    {
+        if (cur.triangleCount == 0) return;
+        ComputeMeshletBounds(cur, out, positions);
+        out.meshlets.push_back(cur);
+        for (uint32_t v = 0; v < cur.vertexCount; ++v) localIndex[out.vertices[cur.vertexOffset + v]] = -1;
+        cur = Meshlet();
+        cur.vertexOffset = (uint32_t)out.vertices.size();
+        cur.triangleOffset = (uint32_t)(out.triangles.size() / 3);
+    };
+
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; ++k)
+            if (localIndex[tri[k]] < 0 && (k == 0 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) ++newVertices;
+        if (cur.vertexCount + newVertices > MESHLET_MAX_VERTICES || cur.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+            flush();
+
+        for (int k = 0; k < 3; ++k)
+        {
+            if (localIndex[tri[k]] < 0)
+            {
+                localIndex[tri[k]] = (int32_t)cur.vertexCount++;
+                out.vertices.push_back(tri[k]);
+            }
+            out.triangles.push_back((uint8_t)localIndex[tri[k]]);
+        }
+        ++cur.triangleCount;
+    }
+    flush();
+}
+
+// Индексы в порядке кластеров: кластер m занимает [triangleOffset*3, (triangleOffset+triangleCount)*3)
+inline std::vector<uint32_t> BuildMeshletIndexBuffer(const MeshletMesh& mesh)
+{
+    std::vector<uint32_t> result(mesh.triangles.size());
+    for (const Meshlet& m : mesh.meshlets)
+        for (uint32_t t = 0; t < m.triangleCount * 3; ++t)
+            result[m.triangleOffset * 3 + t] = mesh.vertices[m.vertexOffset + mesh.triangles[m.triangleOffset * 3 + t]];
+    return result;
+}
+
+// ------------------------------------------------------------------
+// Culling кластеров одного экземпляра
+// ------------------------------------------------------------------
+struct MeshletCullStats
+{
+    uint32_t meshlets = 0, frustumCulled = 0, backfaceCulled = 0;
+    uint64_t triangles = 0, culledTriangles = 0;
+};
+
+// Все треугольники кластера повёрнуты от камеры, если направление на любую точку сферы
+// отклоняется от оси не больше чем на 90 - раскрытие: (p - eye).axis >= sin(раскрытия) * |p - eye|.
+// Для сферы берём худший случай: проекция уменьшается на radius, длина растёт на radius.
+inline bool IsMeshletBackfacing(const Meshlet& m, const Float3& center, float radius, const Float3& axis, const Float3& eye)
+{
+    Float3 d = Sub(center, eye);
+    return Dot(d, axis) - radius >= m.coneCutoff * (Length(d) + radius);
+}
+
+// world - матрица экземпляра (вращение + перенос + равномерный масштаб), planes - из view-proj.
+// Выжившие кластеры добавляются в draws со StartInstanceLocation = startInstance; соседние
+// по индексному буферу кластеры одного экземпляра сливаются в одну отрисовку.
+inline void CullMeshlets(const MeshletMesh& mesh, const Float4x4& world, const Float4 planes[6], const Float3& eye,
+    uint32_t startIndex, int32_t baseVertex, uint32_t startInstance, std::vector<IndirectDrawArgs>& draws, MeshletCullStats& stats)
+{
+    float scale = Length(MakeFloat3(world.m[0][0], world.m[0][1], world.m[0][2]));
+    for (const Meshlet& m : mesh.meshlets)
+    {
+        ++stats.meshlets;
+        stats.triangles += m.triangleCount;
+
+        Float4 c = TransformPoint(world, m.center);
+        Float3 center = MakeFloat3(c.x, c.y, c.z);
+        float radius = m.radius * scale;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p)
+            outside = planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w < -radius;
+        if (outside) { ++stats.frustumCulled; stats.culledTriangles += m.triangleCount; continue; }
+
+        Float3 axis = Normalize(MakeFloat3(
+            m.coneAxis.x * world.m[0][0] + m.coneAxis.y * world.m[1][0] + m.coneAxis.z * world.m[2][0],
+            m.coneAxis.x * world.m[0][1] + m.coneAxis.y * world.m[1][1] + m.coneAxis.z * world.m[2][1],
+            m.coneAxis.x * world.m[0][2] + m.coneAxis.y * world.m[1][2] + m.coneAxis.z * world.m[2][2]));
+        if (IsMeshletBackfacing(m, center, radius, axis, eye)) { ++stats.backfaceCulled; stats.culledTriangles += m.triangleCount; continue; }
+
+        uint32_t first = startIndex + m.triangleOffset * 3;
+        if (!draws.empty())
+        {
+            IndirectDrawArgs& last = draws.back();
+            if (last.StartInstanceLocation == startInstance && last.BaseVertexLocation == baseVertex &&
+                last.StartIndexLocation + last.IndexCountPerInstance == first)
+            {
+                last.IndexCountPerInstance += m.triangleCount * 3;
+                continue;
+            }
+        }
+        IndirectDrawArgs a = { m.triangleCount * 3, 1, first, baseVertex, startInstance };
+        draws.push_back(a);
+    }
+}
@@ -0,0 +1,199 @@
+// Lab8_OcclusionCulling
+// Двухфазный occlusion culling по видимости прошлого кадра (CPU-часть).
+// Фаза 1: рисуем то, что было видно в прошлом кадре и прошло фрустум, строим пирамиду глубины.
+// Фаза 2: проверяем все прошедшие фрустум экземпляры по пирамиде, дорисовываем только новые
+// и обновляем историю видимости.
+// Тот же алгоритм выполняют шейдеры hizCS и cullCS в Source.cpp; здесь эталон, который
+// работает с CPU буфером глубины и не зависит от D3D11 (проверяется Tests/OcclusionCullingTest.cpp).
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "CpuMath.h"
+
+// ------------------------------------------------------------------
+// История видимости: один бит на экземпляр
+// ------------------------------------------------------------------
+inline uint32_t VisibilityWordCount(uint32_t instanceCount) { return (instanceCount + 31) / 32; }
+
+struct VisibilityHistory
+{
+    std::vector<uint32_t> words;
+
+    void Resize(uint32_t instanceCount) { words.assign(VisibilityWordCount(instanceCount), 0u); }
+    void Clear() { std::fill(words.begin(), words.end(), 0u); }
+    bool Test(uint32_t i) const { return (words[i >> 5] >> (i & 31)) & 1u; }
+    void Set(uint32_t i) { words[i >> 5] |= 1u << (i & 31); }
+    void Reset(uint32_t i) { words[i >> 5] &= ~(1u << (i & 31)); }
+};
+
+// ------------------------------------------------------------------
+// Буфер глубины и пирамида глубины (Hi-Z, хранит максимум = самую дальнюю глубину)
+// ------------------------------------------------------------------
+struct DepthBufferCPU
+{
+    uint32_t width = 0, height = 0;
+    std::vector<float> depth;
+
+    void Resize(uint32_t w, uint32_t h) { width = w; height = h; depth.assign((size_t)w * h, 1.0f); }
+    void Clear(float value = 1.0f) { std::fill(depth.begin(), depth.end(), value); }
+    float At(uint32_t x, uint32_t y) const { return depth[(size_t)y * width + x]; }
+};
+
+// Число мипов полной цепочки для текстуры w x h (как у D3D11 при MipLevels = 0)
+inline uint32_t DepthPyramidMipCount(uint32_t w, uint32_t h)
+{
+    uint32_t count = 1;
+    while (w > 1 || h > 1) { w = (std::max)(w / 2, 1u); h = (std::max)(h / 2, 1u); ++count; }
+    return count;
+}
+
+struct DepthPyramid
+{
+    struct Level { uint32_t width, height; std::vector<float> data; };
+    std::vector<Level> levels;
+
+    // Размеры мипов как у D3D (деление с округлением вниз). Чтобы не терять крайний
+    // столбец/строку нечётного уровня, последний тексел захватывает тройку исходных.
+    void Build(const DepthBufferCPU& src)
+    {
+        uint32_t mipCount = DepthPyramidMipCount(src.width, src.height);
+        levels.resize(mipCount);
+        levels[0].width = src.width;
+        levels[0].height = src.height;
+        levels[0].data = src.depth;
+
+        for (uint32_t l = 1; l < mipCount; ++l)
+        {
+            const Level& s = levels[l - 1];
+            Level& d = levels[l];
+            d.width = (std::max)(s.width / 2, 1u);
+            d.height = (std::max)(s.height / 2, 1u);
+            d.data.resize((size_t)d.width * d.height);
+            for (uint32_t y = 0; y < d.height; ++y)
+            {
+                uint32_t y0 = y * 2;
+                uint32_t y1 = (std::min)(y0 + 1 + ((y == d.height - 1 && (s.height & 1)) ? 1u : 0u), s.height - 1);
+                for (uint32_t x = 0; x < d.width; ++x)
+                {
+                    uint32_t x0 = x * 2;
+                    uint32_t x1 = (std::min)(x0 + 1 + ((x == d.width - 1 && (s.width & 1)) ? 1u : 0u), s.width - 1);
+                    float m = 0.0f;
+                    for (uint32_t sy = y0; sy <= y1; ++sy)
+                        for (uint32_t sx = x0; sx <= x1; ++sx)
+                            m = (std::max)(m, s.data[(size_t)sy * s.width + sx]);
+                    d.data[(size_t)y * d.width + x] = m;
+                }
+            }
+        }
+    }
+
+    uint32_t Width() const { return levels.empty() ? 0 : levels[0].width; }
+    uint32_t Height() const { return levels.empty() ? 0 : levels[0].height; }
+
+    // Максимальная глубина в прямоугольнике пикселей [x0,x1]x[y0,y1] уровня 0.
+    // Уровень выбирается так, чтобы прямоугольник покрывал не больше 2x2 текселей.
+    float MaxDepth(float x0, float y0, float x1, float y1) const
+    {
+        float extent = (std::max)((std::max)(x1 - x0, y1 - y0), 1.0f);
+        uint32_t level = (uint32_t)ceilf(log2f(extent));
+        level = (std::min)(level, (uint32_t)levels.size() - 1);
+        const Level& lv = levels[level];
+        uint32_t tx0 = (std::min)((uint32_t)x0 >> level, lv.width - 1);
+        uint32_t ty0 = (std::min)((uint32_t)y0 >> level, lv.height - 1);
+        uint32_t tx1 = (std::min)((uint32_t)x1 >> level, lv.width - 1);
+        uint32_t ty1 = (std::min)((uint32_t)y1 >> level, lv.height - 1);
+        float m = 0.0f;
+        for (uint32_t y = ty0; y <= ty1; ++y)
+            for (uint32_t x = tx0; x <= tx1; ++x)
+                m = (std::max)(m, lv.data[(size_t)y * lv.width + x]);
+        return m;
+    }
+};
+
+// ------------------------------------------------------------------
+// Проекция AABB на экран: прямоугольник в пикселях и ближайшая глубина.
+// false - бокс пересекает ближнюю плоскость, тест перекрытия для него невозможен.
+// ------------------------------------------------------------------
+struct ScreenRect { float x0, y0, x1, y1, zMin; };
+
+inline bool ProjectAABB(const Float4x4& viewProj, const Float3& bmin, const Float3& bmax,
+    float viewportW, float viewportH, ScreenRect& rect)
+{
+    float u0 = 1.0f, v0 = 1.0f, u1 = 0.0f, v1 = 0.0f, zMin = 1.0f;
+    for (int c = 0; c < 8; ++c)
+    {
+        Float3 p = MakeFloat3((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+        Float4 clip = TransformPoint(viewProj, p);
+        if (clip.w <= 1e-5f) return false;
+        float invW = 1.0f / clip.w;
+        float u = clip.x * invW * 0.5f + 0.5f;
+        float v = 0.5f - clip.y * invW * 0.5f;
+        u0 = (std::min)(u0, u); u1 = (std::max)(u1, u);
+        v0 = (std::min)(v0, v); v1 = (std::max)(v1, v);
+        zMin = (std::min)(zMin, clip.z * invW);
+    }
+    u0 = (std::max)(u0, 0.0f); v0 = (std::max)(v0, 0.0f);
+    u1 = (std::min)(u1, 1.0f); v1 = (std::min)(v1, 1.0f);
+    rect.x0 = u0 * viewportW; rect.y0 = v0 * viewportH;
+    rect.x1 = (std::min)(u1 * viewportW, viewportW - 1.0f);
+    rect.y1 = (std::min)(v1 * viewportH, viewportH - 1.0f);
+    rect.zMin = zMin;
+    return true;
+}
+
+inline bool IsOccludedByPyramid(const DepthPyramid& pyramid, const Float4x4& viewProj, const Float3& bmin, const Float3& bmax)
+{
+    if (pyramid.levels.empty()) return false;
+    ScreenRect r;
+    if (!ProjectAABB(viewProj, bmin, bmax, (float)pyramid.Width(), (float)pyramid.Height(), r)) return false;
+    if (r.x1 < r.x0 || r.y1 < r.y0) return false; // вне экрана - решает фрустум
+    return r.zMin > pyramid.MaxDepth(r.x0, r.y0, r.x1, r.y1);
+}
+
+// ------------------------------------------------------------------
+// Двухфазный culler: списки кандидатов обеих фаз и обновление истории
+// ------------------------------------------------------------------
+struct TwoPhaseCuller
+{
+    VisibilityHistory history;         // видимость прошлого кадра
+    std::vector<uint8_t> inFrustum;    // результат теста фрустума текущего кадра
+    std::vector<uint32_t> phase1;      // видимы в прошлом кадре -> рисуются сразу
+    std::vector<uint32_t> candidates;  // прошли фрустум, но не рисовались в фазе 1
+    std::vector<uint32_t> phase2;      // кандидаты, прошедшие тест по пирамиде
+
+    void Resize(uint32_t instanceCount)
+    {
+        history.Resize(instanceCount);
+        inFrustum.assign(instanceCount, 0);
+    }
+
+    // Фаза 1. bbMin/bbMax - мировые AABB экземпляров
+    void RunPhase1(const Float4 planes[6], const Float3* bbMin, const Float3* bbMax, uint32_t count)
+    {
+        if (inFrustum.size() != count) Resize(count);
+        phase1.clear();
+        candidates.clear();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            inFrustum[i] = IsAABBInsideFrustumCPU(planes, bbMin[i], bbMax[i]) ? 1 : 0;
+            if (!inFrustum[i]) continue;
+            if (history.Test(i)) phase1.push_back(i);
+            else candidates.push_back(i);
+        }
+    }
+
+    // Фаза 2. pyramid построена по глубине после отрисовки phase1.
+    // Все прошедшие фрустум перепроверяются, чтобы история отражала текущий кадр.
+    void RunPhase2(const DepthPyramid& pyramid, const Float4x4& viewProj, const Float3* bbMin, const Float3* bbMax, uint32_t count)
+    {
+        phase2.clear();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            bool wasVisible = history.Test(i);
+            bool visible = inFrustum[i] && !IsOccludedByPyramid(pyramid, viewProj, bbMin[i], bbMax[i]);
+            if (visible) history.Set(i); else history.Reset(i);
+            if (visible && !wasVisible) phase2.push_back(i);
+        }
+    }
+};
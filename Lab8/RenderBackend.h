@@ -0,0 +1,361 @@
+// Lab8_RenderBackend
+// Тонкий слой между кадром и контекстом устройства: обновление буферов, запись проходов, отправка
+// списков и заборы кадров идут через RenderBackend, а не напрямую в ID3D11DeviceContext.
+// Реализации:
+//  - D3D11Backend (Source.cpp) - пересылает вызовы в непосредственный или отложенный контекст;
+//  - NullBackend - ничего не рисует: проверяет вызовы (границы слотов, парность Map/Unmap и Begin/End,
+//    что привязано к Draw/Dispatch) и считает их. Кадр с ним проходит весь путь на CPU без GPU,
+//    поэтому так меряется цена самой отправки. На Linux цикл кадров с ним - Tests/NullBackendTest.cpp.
+// Сигнатуры повторяют D3D11 (без class instances), типы объектов задаёт Api: в приложении - D3D11,
+// в проверках - пустые структуры.
+// Создание ресурсов остаётся за устройством: пустой бэкенд работает с теми же объектами.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+const uint32_t BACKEND_CB_SLOTS = 14;        // D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+const uint32_t BACKEND_SRV_SLOTS = 128;      // D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT
+const uint32_t BACKEND_SAMPLER_SLOTS = 16;
+const uint32_t BACKEND_UAV_SLOTS = 8;        // CS на уровне 11_0
+const uint32_t BACKEND_VB_SLOTS = 32;
+const uint32_t BACKEND_RT_SLOTS = 8;
+const uint32_t BACKEND_VIEWPORTS = 16;
+const uint32_t BACKEND_MAX_GROUPS = 65535;   // D3D11_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION
+
+template <typename Api>
+struct RenderBackend
+{
+    typedef typename Api::Resource Resource;
+    typedef typename Api::Buffer Buffer;
+    typedef typename Api::VertexShader VertexShader;
+    typedef typename Api::PixelShader PixelShader;
+    typedef typename Api::ComputeShader ComputeShader;
+    typedef typename Api::InputLayout InputLayout;
+    typedef typename Api::ShaderResourceView ShaderResourceView;
+    typedef typename Api::UnorderedAccessView UnorderedAccessView;
+    typedef typename Api::RenderTargetView RenderTargetView;
+    typedef typename Api::DepthStencilView DepthStencilView;
+    typedef typename Api::SamplerState SamplerState;
+    typedef typename Api::BlendState BlendState;
+    typedef typename Api::DepthStencilState DepthStencilState;
+    typedef typename Api::RasterizerState RasterizerState;
+    typedef typename Api::Query Query;
+    typedef typename Api::CommandList CommandList;
+    typedef typename Api::Topology Topology;
+    typedef typename Api::Format Format;
+    typedef typename Api::Viewport Viewport;
+    typedef typename Api::Box Box;
+    typedef typename Api::MapType MapType;
+    typedef typename Api::Mapped Mapped;
+
+    virtual ~RenderBackend() {}
+
+    // Конвейер
+    virtual void IASetInputLayout(InputLayout* layout) = 0;
+    virtual void IASetPrimitiveTopology(Topology topology) = 0;
+    virtual void IASetIndexBuffer(Buffer* buffer, Format format, uint32_t offset) = 0;
+    virtual void IASetVertexBuffers(uint32_t start, uint32_t count, Buffer* const* buffers, const uint32_t* strides, const uint32_t* offsets) = 0;
+    virtual void VSSetShader(VertexShader* shader) = 0;
+    virtual void PSSetShader(PixelShader* shader) = 0;
+    virtual void CSSetShader(ComputeShader* shader) = 0;
+    virtual void VSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* buffers) = 0;
+    virtual void PSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* buffers) = 0;
+    virtual void CSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* buffers) = 0;
+    virtual void VSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* views) = 0;
+    virtual void PSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* views) = 0;
+    virtual void CSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* views) = 0;
+    virtual void PSSetSamplers(uint32_t start, uint32_t count, SamplerState* const* samplers) = 0;
+    virtual void CSSetUnorderedAccessViews(uint32_t start, uint32_t count, UnorderedAccessView* const* views, const uint32_t* initialCounts) = 0;
+    virtual void OMSetRenderTargets(uint32_t count, RenderTargetView* const* views, DepthStencilView* depth) = 0;
+    virtual void OMSetBlendState(BlendState* state, const float factor[4], uint32_t mask) = 0;
+    virtual void OMSetDepthStencilState(DepthStencilState* state, uint32_t stencilRef) = 0;
+    virtual void RSSetState(RasterizerState* state) = 0;
+    virtual void RSSetViewports(uint32_t count, const Viewport* viewports) = 0;
+    virtual void ClearState() = 0;
+
+    // Очистки, загрузки и копии
+    virtual void ClearRenderTargetView(RenderTargetView* view, const float color[4]) = 0;
+    virtual void ClearDepthStencilView(DepthStencilView* view, uint32_t flags, float depth, uint8_t stencil) = 0;
+    virtual void ClearUnorderedAccessViewUint(UnorderedAccessView* view, const uint32_t values[4]) = 0;
+    virtual bool Map(Resource* resource, uint32_t subresource, MapType type, uint32_t flags, Mapped* mapped) = 0;
+    virtual void Unmap(Resource* resource, uint32_t subresource) = 0;
+    virtual void UpdateSubresource(Resource* resource, uint32_t subresource, const Box* box, const void* data, uint32_t rowPitch, uint32_t depthPitch) = 0;
+    virtual void CopyResource(Resource* dst, Resource* src) = 0;
+
+    // Работа
+    virtual void Draw(uint32_t vertexCount, uint32_t startVertex) = 0;
+    virtual void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) = 0;
+    virtual void DrawIndexedInstancedIndirect(Buffer* args, uint32_t offset) = 0;
+    virtual void Dispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
+
+    // Запросы и списки команд
+    virtual void Begin(Query* query) = 0;
+    virtual void End(Query* query) = 0;
+    virtual bool GetData(Query* query, void* data, uint32_t size, bool flush) = 0;   // true - результат готов
+    virtual CommandList* FinishCommandList() = 0;                                  // nullptr - список пуст или ошибка
+    virtual void ExecuteCommandList(CommandList* list) = 0;
+};
+
+struct NullBackendStats
+{
+    uint64_t calls = 0;      // все вызовы
+    uint64_t binds = 0;      // установка состояния и привязки
+    uint64_t draws = 0;
+    uint64_t dispatches = 0;
+    uint64_t uploads = 0;    // Map, UpdateSubresource
+    uint64_t errors = 0;
+    const char* lastError = nullptr;
+
+    void Add(const NullBackendStats& o)
+    {
+        calls += o.calls; binds += o.binds; draws += o.draws; dispatches += o.dispatches;
+        uploads += o.uploads; errors += o.errors;
+        if (o.lastError) lastError = o.lastError;
+    }
+};
+
+// Пустой бэкенд: проверка и счёт вызовов. Map отдаёт обнулённую память на Api::MappedBytes байт,
+// GetData сразу отвечает "готово" с нулями, FinishCommandList - пустой список (nullptr).
+template <typename Api>
+struct NullBackend : RenderBackend<Api>
+{
+    typedef RenderBackend<Api> Base;
+    typedef typename Base::Resource Resource;
+    typedef typename Base::Buffer Buffer;
+    typedef typename Base::VertexShader VertexShader;
+    typedef typename Base::PixelShader PixelShader;
+    typedef typename Base::ComputeShader ComputeShader;
+    typedef typename Base::InputLayout InputLayout;
+    typedef typename Base::ShaderResourceView ShaderResourceView;
+    typedef typename Base::UnorderedAccessView UnorderedAccessView;
+    typedef typename Base::RenderTargetView RenderTargetView;
+    typedef typename Base::DepthStencilView DepthStencilView;
+    typedef typename Base::SamplerState SamplerState;
+    typedef typename Base::BlendState BlendState;
+    typedef typename Base::DepthStencilState DepthStencilState;
+    typedef typename Base::RasterizerState RasterizerState;
+    typedef typename Base::Query Query;
+    typedef typename Base::CommandList CommandList;
+    typedef typename Base::Topology Topology;
+    typedef typename Base::Format Format;
+    typedef typename Base::Viewport Viewport;
+    typedef typename Base::Box Box;
+    typedef typename Base::MapType MapType;
+    typedef typename Base::Mapped Mapped;
+
+    NullBackendStats stats;
+
+    NullBackend() { ResetPipeline(); }
+
+    void IASetInputLayout(InputLayout*) override { Bind(); }
+    void IASetPrimitiveTopology(Topology topology) override { Bind(); topologySet = !(topology == Topology()); }
+    void IASetIndexBuffer(Buffer* buffer, Format, uint32_t) override { Bind(); indexBuffer = buffer != nullptr; }
+    void IASetVertexBuffers(uint32_t start, uint32_t count, Buffer* const* buffers, const uint32_t* strides, const uint32_t* offsets) override
+    {
+        Bind();
+        CheckSlots(start, count, BACKEND_VB_SLOTS, "IASetVertexBuffers: slot out of range");
+        if (count && (!buffers || !strides || !offsets)) Fail("IASetVertexBuffers: null array");
+    }
+    void VSSetShader(VertexShader* shader) override { Bind(); vs = shader != nullptr; }
+    void PSSetShader(PixelShader*) override { Bind(); }
+    void CSSetShader(ComputeShader* shader) override { Bind(); cs = shader != nullptr; }
+    void VSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* b) override { SetSlots(start, count, b, BACKEND_CB_SLOTS, "VSSetConstantBuffers: slot out of range"); }
+    void PSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* b) override { SetSlots(start, count, b, BACKEND_CB_SLOTS, "PSSetConstantBuffers: slot out of range"); }
+    void CSSetConstantBuffers(uint32_t start, uint32_t count, Buffer* const* b) override { SetSlots(start, count, b, BACKEND_CB_SLOTS, "CSSetConstantBuffers: slot out of range"); }
+    void VSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* v) override { SetSlots(start, count, v, BACKEND_SRV_SLOTS, "VSSetShaderResources: slot out of range"); }
+    void PSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* v) override { SetSlots(start, count, v, BACKEND_SRV_SLOTS, "PSSetShaderResources: slot out of range"); }
+    void CSSetShaderResources(uint32_t start, uint32_t count, ShaderResourceView* const* v) override { SetSlots(start, count, v, BACKEND_SRV_SLOTS, "CSSetShaderResources: slot out of range"); }
+    void PSSetSamplers(uint32_t start, uint32_t count, SamplerState* const* s) override { SetSlots(start, count, s, BACKEND_SAMPLER_SLOTS, "PSSetSamplers: slot out of range"); }
+    void CSSetUnorderedAccessViews(uint32_t start, uint32_t count, UnorderedAccessView* const* v, const uint32_t*) override
+    {
+        SetSlots(start, count, v, BACKEND_UAV_SLOTS, "CSSetUnorderedAccessViews: slot out of range");
+    }
+    void OMSetRenderTargets(uint32_t count, RenderTargetView* const* views, DepthStencilView* depth) override
+    {
+        Bind();
+        if (count > BACKEND_RT_SLOTS) { Fail("OMSetRenderTargets: too many targets"); count = BACKEND_RT_SLOTS; }
+        if (count && !views) Fail("OMSetRenderTargets: null array");
+        targets = 0;
+        for (uint32_t i = 0; views && i < count; ++i) targets += views[i] != nullptr;
+        depthTarget = depth != nullptr;
+    }
+    void OMSetBlendState(BlendState*, const float*, uint32_t) override { Bind(); }
+    void OMSetDepthStencilState(DepthStencilState*, uint32_t) override { Bind(); }
+    void RSSetState(RasterizerState*) override { Bind(); }
+    void RSSetViewports(uint32_t count, const Viewport* viewports) override
+    {
+        Bind();
+        if (count > BACKEND_VIEWPORTS) Fail("RSSetViewports: too many viewports");
+        if (count && !viewports) Fail("RSSetViewports: null array");
+        viewportCount = count;
+    }
+    void ClearState() override { ++stats.calls; ResetPipeline(); }
+
+    void ClearRenderTargetView(RenderTargetView* view, const float color[4]) override
+    {
+        ++stats.calls;
+        if (!view || !color) Fail("ClearRenderTargetView: null view");
+    }
+    void ClearDepthStencilView(DepthStencilView* view, uint32_t, float depth, uint8_t) override
+    {
+        ++stats.calls;
+        if (!view) Fail("ClearDepthStencilView: null view");
+        if (depth < 0.0f || depth > 1.0f) Fail("ClearDepthStencilView: depth outside [0, 1]");
+    }
+    void ClearUnorderedAccessViewUint(UnorderedAccessView* view, const uint32_t values[4]) override
+    {
+        ++stats.calls;
+        if (!view || !values) Fail("ClearUnorderedAccessViewUint: null view");
+    }
+    bool Map(Resource* resource, uint32_t subresource, MapType, uint32_t, Mapped* mapped) override
+    {
+        ++stats.calls;
+        ++stats.uploads;
+        if (!resource || !mapped) { Fail("Map: null resource"); return false; }
+        for (const OpenMap& m : maps)
+            if (m.resource == resource && m.subresource == subresource) { Fail("Map: subresource already mapped"); return false; }
+        OpenMap* slot = nullptr;
+        for (OpenMap& m : maps) if (!m.resource) { slot = &m; break; }
+        if (!slot) { maps.push_back(OpenMap()); slot = &maps.back(); }
+        slot->resource = resource;
+        slot->subresource = subresource;
+        slot->data.assign((std::max)(Api::MappedBytes(resource), 16u), 0);
+        mapped->pData = slot->data.data();
+        mapped->RowPitch = (uint32_t)slot->data.size();
+        mapped->DepthPitch = (uint32_t)slot->data.size();
+        return true;
+    }
+    void Unmap(Resource* resource, uint32_t subresource) override
+    {
+        ++stats.calls;
+        for (OpenMap& m : maps)
+            if (m.resource == resource && m.subresource == subresource) { m.resource = nullptr; return; }
+        Fail("Unmap: subresource is not mapped");
+    }
+    void UpdateSubresource(Resource* resource, uint32_t, const Box*, const void* data, uint32_t, uint32_t) override
+    {
+        ++stats.calls;
+        ++stats.uploads;
+        if (!resource || !data) Fail("UpdateSubresource: null resource or data");
+    }
+    void CopyResource(Resource* dst, Resource* src) override
+    {
+        ++stats.calls;
+        if (!dst || !src) Fail("CopyResource: null resource");
+        else if (dst == src) Fail("CopyResource: source and destination are the same");
+    }
+
+    void Draw(uint32_t, uint32_t) override { BeginWork(); ++stats.draws; CheckDraw(false); }
+    void DrawIndexed(uint32_t, uint32_t, int32_t) override { BeginWork(); ++stats.draws; CheckDraw(true); }
+    void DrawIndexedInstancedIndirect(Buffer* args, uint32_t offset) override
+    {
+        BeginWork();
+        ++stats.draws;
+        CheckDraw(true);
+        if (!args) Fail("DrawIndexedInstancedIndirect: null args buffer");
+        if (offset % 4) Fail("DrawIndexedInstancedIndirect: unaligned offset");
+    }
+    void Dispatch(uint32_t x, uint32_t y, uint32_t z) override
+    {
+        BeginWork();
+        ++stats.dispatches;
+        if (!cs) Fail("Dispatch: no compute shader");
+        if (x > BACKEND_MAX_GROUPS || y > BACKEND_MAX_GROUPS || z > BACKEND_MAX_GROUPS) Fail("Dispatch: too many groups");
+    }
+
+    void Begin(Query* query) override
+    {
+        ++stats.calls;
+        if (!query) { Fail("Begin: null query"); return; }
+        if (std::find(openQueries.begin(), openQueries.end(), query) != openQueries.end()) { Fail("Begin: query already begun"); return; }
+        openQueries.push_back(query);
+    }
+    // End без Begin - обычное дело для событий (заборов)
+    void End(Query* query) override
+    {
+        ++stats.calls;
+        if (!query) { Fail("End: null query"); return; }
+        typename std::vector<Query*>::iterator it = std::find(openQueries.begin(), openQueries.end(), query);
+        if (it != openQueries.end()) openQueries.erase(it);
+    }
+    bool GetData(Query* query, void* data, uint32_t size, bool) override
+    {
+        ++stats.calls;
+        if (!query) { Fail("GetData: null query"); return false; }
+        if (std::find(openQueries.begin(), openQueries.end(), query) != openQueries.end()) Fail("GetData: query not ended");
+        if (data && size) memset(data, 0, size);
+        return true;
+    }
+    CommandList* FinishCommandList() override
+    {
+        ++stats.calls;
+        CheckClosed("FinishCommandList: resource still mapped", "FinishCommandList: query still open");
+        ResetPipeline();   // список закрывается без сохранения состояния
+        return nullptr;
+    }
+    void ExecuteCommandList(CommandList* list) override
+    {
+        ++stats.calls;
+        if (!list) Fail("ExecuteCommandList: null list");
+    }
+
+    // Конец кадра: всё открытое должно быть закрыто
+    void CheckFrameEnd() { CheckClosed("frame end: resource still mapped", "frame end: query still open"); }
+
+private:
+    struct OpenMap
+    {
+        Resource* resource = nullptr;
+        uint32_t subresource = 0;
+        std::vector<uint8_t> data;
+    };
+    std::vector<OpenMap> maps;
+    std::vector<Query*> openQueries;
+    bool vs = false, cs = false, topologySet = false, indexBuffer = false, depthTarget = false;
+    uint32_t targets = 0, viewportCount = 0;
+
+    void ResetPipeline()
+    {
+        vs = cs = topologySet = indexBuffer = depthTarget = false;
+        targets = viewportCount = 0;
+    }
+    void Fail(const char* message)
+    {
+        ++stats.errors;
+        stats.lastError = message;
+    }
+    void Bind() { ++stats.calls; ++stats.binds; }
+    template <typename T>
+    void SetSlots(uint32_t start, uint32_t count, T* const* values, uint32_t slots, const char* message)
+    {
+        Bind();
+        CheckSlots(start, count, slots, message);
+        if (count && !values) Fail("slot array is null");
+    }
+    void CheckSlots(uint32_t start, uint32_t count, uint32_t slots, const char* message)
+    {
+        if (start >= slots || count > slots - start) Fail(message);
+    }
+    void BeginWork()
+    {
+        ++stats.calls;
+        for (const OpenMap& m : maps)
+            if (m.resource) { Fail("draw/dispatch while a resource is mapped"); break; }
+    }
+    void CheckDraw(bool indexed)
+    {
+        if (!vs) Fail("draw: no vertex shader");
+        if (!topologySet) Fail("draw: no primitive topology");
+        if (!targets && !depthTarget) Fail("draw: no render target or depth");
+        if (!viewportCount) Fail("draw: no viewport");
+        if (indexed && !indexBuffer) Fail("draw: no index buffer");
+    }
+    void CheckClosed(const char* mapMessage, const char* queryMessage)
+    {
+        for (const OpenMap& m : maps)
+            if (m.resource) { Fail(mapMessage); break; }
+        if (!openQueries.empty()) Fail(queryMessage);
+    }
+};
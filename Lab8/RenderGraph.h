@@ -0,0 +1,192 @@
+// Lab8_RenderGraph
+// Граф кадра: проходы объявляют, какие текстуры читают и пишут, остальное граф выводит сам.
+// Compile():
+//  - отсекает проходы, результат которых никто не использует (живы проходы с побочным эффектом
+//    и те, кто пишет во внешний ресурс или в то, что использует живой проход дальше по кадру),
+//  - считает для временных текстур первый и последний живой проход,
+//  - раздаёт физические текстуры: одинаковое описание и непересекающиеся интервалы жизни -
+//    одна текстура пула,
+//  - выводит переходы (запись в цель <-> чтение шейдером) перед каждым проходом.
+// В D3D11 нет размещения ресурсов в общей памяти, поэтому алиасинг - это общая текстура пула.
+// Содержимое такой текстуры при первой записи не определено: переход помечается discard.
+// Без WinAPI/D3D: формат - просто число, граф проверяется на любой платформе (Tests/RenderGraphTest.cpp:
+// инварианты компиляции и память временных текстур без алиасинга, с ним и пик живых).
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+struct RGTextureDesc
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;          // DXGI_FORMAT в приложении
+    uint32_t bytesPerPixel = 4;
+
+    uint64_t Bytes() const { return (uint64_t)width * height * bytesPerPixel; }
+    bool operator==(const RGTextureDesc& o) const
+    {
+        return width == o.width && height == o.height && format == o.format && bytesPerPixel == o.bytesPerPixel;
+    }
+};
+
+enum RGState { RG_STATE_UNDEFINED, RG_STATE_RENDER_TARGET, RG_STATE_SHADER_READ };
+
+struct RGTransition
+{
+    uint32_t resource;
+    RGState before, after;
+    bool discard;                 // первая запись: прежнее содержимое не нужно
+};
+
+struct RenderGraph
+{
+    static const uint32_t INVALID = ~0u;
+
+    struct Resource
+    {
+        std::string name;
+        RGTextureDesc desc;
+        bool imported = false;    // back buffer, глубина и т.п. - живут вне графа
+        uint32_t firstPass = INVALID, lastPass = INVALID;   // позиции в order
+        uint32_t physical = INVALID;
+    };
+    struct Access
+    {
+        uint32_t resource;
+        RGState state;
+    };
+    struct Pass
+    {
+        std::string name;
+        std::vector<Access> accesses;
+        bool sideEffects = false; // жив всегда (запросы, readback)
+        bool culled = false;
+        std::vector<RGTransition> transitions;   // выполнить перед проходом
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<RGTextureDesc> physical;   // текстуры пула
+    std::vector<uint32_t> order;           // живые проходы в порядке исполнения
+    uint64_t transientBytes = 0;           // без алиасинга: у каждой временной текстуры своя память
+    uint64_t aliasedBytes = 0;             // после алиасинга: сумма текстур пула
+
+    void Reset()
+    {
+        resources.clear();
+        passes.clear();
+        physical.clear();
+        order.clear();
+        transientBytes = aliasedBytes = 0;
+    }
+
+    uint32_t CreateTexture(const char* name, const RGTextureDesc& desc)
+    {
+        Resource r;
+        r.name = name;
+        r.desc = desc;
+        resources.push_back(r);
+        return (uint32_t)resources.size() - 1;
+    }
+
+    uint32_t Import(const char* name)
+    {
+        Resource r;
+        r.name = name;
+        r.imported = true;
+        resources.push_back(r);
+        return (uint32_t)resources.size() - 1;
+    }
+
+    // Порядок объявления проходов - порядок исполнения
+    uint32_t AddPass(const char* name, bool sideEffects = false)
+    {
+        Pass p;
+        p.name = name;
+        p.sideEffects = sideEffects;
+        passes.push_back(p);
+        return (uint32_t)passes.size() - 1;
+    }
+
+    void Read(uint32_t pass, uint32_t resource) { passes[pass].accesses.push_back({ resource, RG_STATE_SHADER_READ }); }
+    void Write(uint32_t pass, uint32_t resource) { passes[pass].accesses.push_back({ resource, RG_STATE_RENDER_TARGET }); }
+
+    bool IsLive(uint32_t pass) const { return pass < passes.size() && !passes[pass].culled; }
+    uint32_t Physical(uint32_t resource) const { return resources[resource].physical; }
+
+    // false - временная текстура читается раньше, чем в неё пишут
+    bool Compile()
+    {
+        physical.clear();
+        order.clear();
+        transientBytes = aliasedBytes = 0;
+
+        // Отсечение: обратный проход, needed - что используют живые проходы дальше по кадру
+        std::vector<bool> needed(resources.size(), false);
+        for (uint32_t p = (uint32_t)passes.size(); p-- > 0;)
+        {
+            Pass& pass = passes[p];
+            bool live = pass.sideEffects;
+            for (const Access& a : pass.accesses)
+                if (a.state == RG_STATE_RENDER_TARGET && (resources[a.resource].imported || needed[a.resource])) live = true;
+            pass.culled = !live;
+            pass.transitions.clear();
+            if (!live) continue;
+            // Запись в цель дописывает поверх (смешивание, тест глубины), поэтому прежнее содержимое тоже нужно
+            for (const Access& a : pass.accesses) needed[a.resource] = true;
+        }
+
+        // Интервалы жизни и переходы
+        std::vector<RGState> state(resources.size(), RG_STATE_UNDEFINED);
+        for (Resource& r : resources) { r.firstPass = r.lastPass = INVALID; r.physical = INVALID; }
+        for (uint32_t p = 0; p < passes.size(); ++p)
+        {
+            if (passes[p].culled) continue;
+            uint32_t position = (uint32_t)order.size();
+            order.push_back(p);
+            for (const Access& a : passes[p].accesses)
+            {
+                Resource& r = resources[a.resource];
+                if (r.firstPass == INVALID)
+                {
+                    if (!r.imported && a.state == RG_STATE_SHADER_READ) return false;
+                    r.firstPass = position;
+                }
+                r.lastPass = position;
+                if (state[a.resource] != a.state)
+                {
+                    bool discard = !r.imported && state[a.resource] == RG_STATE_UNDEFINED;
+                    passes[p].transitions.push_back({ a.resource, state[a.resource], a.state, discard });
+                    state[a.resource] = a.state;
+                }
+            }
+        }
+
+        // Алиасинг: временные текстуры по началу жизни, первая подходящая свободная текстура пула
+        std::vector<uint32_t> transient;
+        for (uint32_t i = 0; i < resources.size(); ++i)
+            if (!resources[i].imported && resources[i].firstPass != INVALID) transient.push_back(i);
+        std::sort(transient.begin(), transient.end(), [this](uint32_t a, uint32_t b) { return resources[a].firstPass < resources[b].firstPass; });
+        std::vector<uint32_t> busyUntil;
+        for (uint32_t i : transient)
+        {
+            Resource& r = resources[i];
+            transientBytes += r.desc.Bytes();
+            for (uint32_t t = 0; t < physical.size(); ++t)
+            {
+                if (physical[t] == r.desc && busyUntil[t] < r.firstPass) { r.physical = t; break; }
+            }
+            if (r.physical == INVALID)
+            {
+                r.physical = (uint32_t)physical.size();
+                physical.push_back(r.desc);
+                busyUntil.push_back(0);
+                aliasedBytes += r.desc.Bytes();
+            }
+            busyUntil[r.physical] = r.lastPass;
+        }
+        return true;
+    }
+};
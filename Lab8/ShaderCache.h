@@ -0,0 +1,153 @@
+// Lab8_ShaderCache
+// Дисковый кэш байткода шейдеров. Ключ - хэш исходника, точки входа, профиля, флагов компиляции
+// и соли (версия компилятора и формата кэша): любое изменение даёт другой ключ, а с ним другой файл,
+// поэтому устаревшие записи никогда не читаются. Файл записи: заголовок (ключ, размер, хэш байткода)
+// и байткод; обрезанный или испорченный файл отвергается и считается промахом.
+// Запись идёт во временный файл с уникальным именем и публикуется переименованием, так что несколько
+// потоков или процессов могут писать один ключ одновременно, а читатель видит либо старый файл
+// целиком, либо новый. Компилятор в кэш не входит: вызывающий сам компилирует при промахе и сохраняет.
+// Без WinAPI/D3D: собирается и проверяется на любой платформе (Tests/ShaderCacheTest.cpp - заглушка
+// компилятора, инвалидация, порча файлов, запись из потоков и процессов).
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+const uint32_t SHADER_CACHE_MAGIC = 0x31434853;   // "SHC1"
+const uint32_t SHADER_CACHE_VERSION = 1;          // менять при изменении формата файла
+
+// FNV-1a, 64 бита, с продолжением от предыдущего значения
+inline uint64_t HashAppend(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) { hash ^= bytes[i]; hash *= 1099511628211ull; }
+    return hash;
+}
+
+struct ShaderCacheHeader
+{
+    uint32_t magic, version;
+    uint64_t key;
+    uint64_t bytecodeHash;
+    uint64_t size;
+};
+
+inline FILE* OpenShaderCacheFile(const char* path, const char* mode)
+{
+    FILE* f = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&f, path, mode) != 0) f = nullptr;
+#else
+    f = fopen(path, mode);
+#endif
+    return f;
+}
+
+struct ShaderCache
+{
+    std::string directory;   // с завершающим разделителем; пустая строка - кэш выключен
+    uint64_t salt = 0;       // версия компилятора: смена инвалидирует все записи
+
+    std::atomic<uint32_t> hits{ 0 }, misses{ 0 }, rejected{ 0 }, writes{ 0 }, writeFailures{ 0 };
+    std::atomic<uint32_t> tempCounter{ 0 };
+    uint64_t nonce;          // различает временные файлы разных процессов
+
+    ShaderCache()
+    {
+        std::random_device rd;
+        nonce = ((uint64_t)rd() << 32) ^ rd() ^ (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    }
+
+    void ResetStats() { hits = 0; misses = 0; rejected = 0; writes = 0; writeFailures = 0; }
+
+    // Поля разделены длинами, чтобы ("ab", "c") и ("a", "bc") давали разные ключи
+    uint64_t Key(const char* code, size_t size, const char* entry, const char* target, uint32_t flags) const
+    {
+        uint64_t h = HashAppend(14695981039346656037ull, &SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+        h = HashAppend(h, &salt, sizeof(salt));
+        const char* parts[] = { entry, target };
+        for (const char* p : parts)
+        {
+            uint64_t len = strlen(p);
+            h = HashAppend(h, &len, sizeof(len));
+            h = HashAppend(h, p, len);
+        }
+        h = HashAppend(h, &flags, sizeof(flags));
+        uint64_t len = size;
+        h = HashAppend(h, &len, sizeof(len));
+        return HashAppend(h, code, size);
+    }
+
+    std::string PathFor(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.cso", (unsigned long long)key);
+        return directory + name;
+    }
+
+    // true - байткод прочитан и сошёлся с заголовком; иначе промах
+    bool Load(uint64_t key, std::vector<uint8_t>& bytecode)
+    {
+        if (!directory.empty())
+        {
+            FILE* f = OpenShaderCacheFile(PathFor(key).c_str(), "rb");
+            if (f)
+            {
+                bool ok = ReadEntry(f, key, bytecode);
+                fclose(f);
+                if (ok) { ++hits; return true; }
+                ++rejected;
+            }
+        }
+        ++misses;
+        return false;
+    }
+
+    bool Store(uint64_t key, const void* data, size_t size)
+    {
+        if (directory.empty()) return false;
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%016llx.%u.tmp", (unsigned long long)nonce, tempCounter.fetch_add(1));
+        std::string path = PathFor(key);
+        std::string temp = path + suffix;
+
+        ShaderCacheHeader header = {};
+        header.magic = SHADER_CACHE_MAGIC;
+        header.version = SHADER_CACHE_VERSION;
+        header.key = key;
+        header.bytecodeHash = HashAppend(14695981039346656037ull, data, size);
+        header.size = size;
+        FILE* f = OpenShaderCacheFile(temp.c_str(), "wb");
+        if (!f) { ++writeFailures; return false; }
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && (size == 0 || fwrite(data, size, 1, f) == 1);
+        ok = (fclose(f) == 0) && ok;
+        // rename в Windows не заменяет существующий файл: старый (испорченный или записанный
+        // параллельно тем же содержимым) убирается, и переименование повторяется один раз
+        if (ok && std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(path.c_str());
+            ok = std::rename(temp.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) { std::remove(temp.c_str()); ++writeFailures; return false; }
+        ++writes;
+        return true;
+    }
+
+    static bool ReadEntry(FILE* f, uint64_t key, std::vector<uint8_t>& bytecode)
+    {
+        ShaderCacheHeader header;
+        if (fread(&header, sizeof(header), 1, f) != 1) return false;
+        if (header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key) return false;
+        if (header.size == 0 || header.size > (64u << 20)) return false;
+        bytecode.resize((size_t)header.size);
+        if (fread(bytecode.data(), bytecode.size(), 1, f) != 1) return false;
+        uint8_t extra;
+        if (fread(&extra, 1, 1, f) != 0) return false;   // лишние байты - файл не тот
+        return HashAppend(14695981039346656037ull, bytecode.data(), bytecode.size()) == header.bytecodeHash;
+    }
+};
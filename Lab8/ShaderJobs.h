@@ -0,0 +1,101 @@
+// Lab8_ShaderJobs
+// Параллельная компиляция шейдеров при запуске: все компиляции добавляются в пакет заданий,
+// задания раздаются потокам общего пула (WorkerPool.h), самые длинные исходники первыми (так
+// самый тяжёлый шейдер не остаётся на конец). Объекты создаются после Compile, когда готовы все блобы,
+// на вызывающем потоке. Ошибка одного шейдера не прерывает остальные: у задания остаются
+// текст ошибки и пустой байткод, вызывающий сообщает о каждом отдельно.
+// Компилятор передаётся функцией, тип байткода задаёт Api: в приложении - D3DCompile через кэш
+// и ID3DBlob, в проверках - заглушка (Tests/ShaderJobsTest.cpp: заглушка в процессе или внешний
+// компилятор отдельным процессом, ускорение против числа потоков).
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "WorkerPool.h"
+
+template <typename Api>
+struct ShaderJobBatch
+{
+    typedef typename Api::Blob Blob;
+
+    struct Job
+    {
+        const char* name;       // для отчёта
+        const char* code;       // исходник живёт до конца Compile
+        size_t size;
+        const char* entry;
+        const char* target;
+        uint32_t flags;
+        Blob* bytecode = nullptr;
+        std::string errors;     // ошибки или предупреждения компилятора
+        bool ok = false;
+        double ms = 0.0;
+    };
+    std::vector<Job> jobs;
+    uint32_t threadsUsed = 0;
+    double wallMs = 0.0;
+
+    uint32_t Add(const char* name, const char* code, size_t size, const char* entry, const char* target, uint32_t flags)
+    {
+        Job job;
+        job.name = name;
+        job.code = code;
+        job.size = size;
+        job.entry = entry;
+        job.target = target;
+        job.flags = flags;
+        jobs.push_back(job);
+        return (uint32_t)jobs.size() - 1;
+    }
+
+    // compile(job) вызывается из рабочих потоков, по одному разу на задание: заполняет
+    // job.bytecode и job.errors, возвращает успех
+    template <typename CompileFn>
+    void Compile(uint32_t threadCount, CompileFn compile)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t jobCount = (uint32_t)jobs.size();
+        std::vector<uint32_t> order(jobCount);
+        for (uint32_t i = 0; i < jobCount; ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return jobs[a].size > jobs[b].size; });
+
+        // Пул раздаёт позиции order через чередование: поток t берёт t-е по длине задание, t + threadCount-е, ...
+        threadCount = (std::max)(1u, (std::min)(threadCount, jobCount));
+        DispatchGroups(jobCount, threadCount, [&](uint32_t i)
+        {
+            Job& job = jobs[order[i]];
+            auto jobStart = std::chrono::high_resolution_clock::now();
+            job.ok = compile(job) && job.bytecode != nullptr;
+            job.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - jobStart).count();
+        });
+        threadsUsed = threadCount;
+        wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    Blob* Bytecode(uint32_t job) const { return jobs[job].ok ? jobs[job].bytecode : nullptr; }
+
+    uint32_t FailedCount() const
+    {
+        uint32_t failed = 0;
+        for (const Job& job : jobs) failed += job.ok ? 0 : 1;
+        return failed;
+    }
+
+    double TotalJobMs() const
+    {
+        double total = 0.0;
+        for (const Job& job : jobs) total += job.ms;
+        return total;
+    }
+
+    void Release()
+    {
+        for (Job& job : jobs)
+        {
+            if (job.bytecode) Api::Release(job.bytecode);
+            job.bytecode = nullptr;
+        }
+    }
+};
@@ -0,0 +1,129 @@
+// Lab8_ShaderPermutations
+// Варианты шейдера по набору возможностей: каждая возможность - #define с небольшим числом значений,
+// ключ варианта - значения возможностей, упакованные в биты. Ветвления по режимам кадра уходят
+// из пиксельного шейдера в препроцессор: компилируется по варианту на каждую достижимую комбинацию,
+// при отрисовке выбирается объект по ключу, собранному на CPU.
+// Определения дописываются в начало исходника, поэтому ключ дискового кэша (хэш исходника)
+// различает варианты без изменений в кэше.
+// Тип объекта шейдера задаётся параметром: в приложении - ID3D11PixelShader, в проверках - заглушка
+// (Tests/ShaderPermutationsTest.cpp: упаковка ключей и выбор варианта по переключателям кадра).
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderFeature
+{
+    const char* define;
+    uint32_t valueCount;   // значения 0 .. valueCount - 1
+    uint32_t shift, bits;  // место в ключе
+};
+
+struct ShaderPermutations
+{
+    std::vector<ShaderFeature> features;
+    uint32_t keyBits = 0;
+
+    // Возвращает номер возможности для Set/Get
+    uint32_t AddFeature(const char* define, uint32_t valueCount)
+    {
+        ShaderFeature f;
+        f.define = define;
+        f.valueCount = valueCount;
+        f.shift = keyBits;
+        f.bits = 0;
+        while ((1u << f.bits) < valueCount) ++f.bits;
+        keyBits += f.bits;
+        features.push_back(f);
+        return (uint32_t)features.size() - 1;
+    }
+
+    uint32_t KeySpace() const { return 1u << keyBits; }
+
+    uint32_t Set(uint32_t key, uint32_t feature, uint32_t value) const
+    {
+        const ShaderFeature& f = features[feature];
+        uint32_t mask = ((1u << f.bits) - 1) << f.shift;
+        if (value >= f.valueCount) value = f.valueCount - 1;
+        return (key & ~mask) | (value << f.shift);
+    }
+
+    uint32_t Get(uint32_t key, uint32_t feature) const
+    {
+        const ShaderFeature& f = features[feature];
+        return (key >> f.shift) & ((1u << f.bits) - 1);
+    }
+
+    // Ключи с неиспользуемыми значениями полей (valueCount не степень двойки) не существуют
+    bool IsValid(uint32_t key) const
+    {
+        if (key >= KeySpace()) return false;
+        for (uint32_t i = 0; i < (uint32_t)features.size(); ++i)
+            if (Get(key, i) >= features[i].valueCount) return false;
+        return true;
+    }
+
+    // Строки #define для начала исходника
+    std::string Defines(uint32_t key) const
+    {
+        std::string s;
+        for (uint32_t i = 0; i < (uint32_t)features.size(); ++i)
+            s += std::string("#define ") + features[i].define + " " + std::to_string(Get(key, i)) + "\n";
+        return s;
+    }
+
+    // Для отчётов: "NORMAL_MAP=1 GRAYSCALE=0"
+    std::string Describe(uint32_t key) const
+    {
+        std::string s;
+        for (uint32_t i = 0; i < (uint32_t)features.size(); ++i)
+            s += std::string(i ? " " : "") + features[i].define + "=" + std::to_string(Get(key, i));
+        return s;
+    }
+
+    // Все допустимые ключи, для которых reachable(key) - true (комбинации, которые кадр может выбрать)
+    template <typename ReachableFn>
+    std::vector<uint32_t> Enumerate(ReachableFn reachable) const
+    {
+        std::vector<uint32_t> keys;
+        for (uint32_t key = 0; key < KeySpace(); ++key)
+            if (IsValid(key) && reachable(key)) keys.push_back(key);
+        return keys;
+    }
+};
+
+// Объекты вариантов одного шейдера: плотная таблица по ключу, nullptr - вариант не собран
+template <typename Object>
+struct ShaderVariants
+{
+    ShaderPermutations permutations;
+    std::vector<uint32_t> keys;       // сгенерированные варианты
+    std::vector<Object*> objects;     // KeySpace() элементов
+
+    // Вызывается после того, как заданы возможности
+    template <typename ReachableFn>
+    const std::vector<uint32_t>& Generate(ReachableFn reachable)
+    {
+        keys = permutations.Enumerate(reachable);
+        objects.assign(permutations.KeySpace(), nullptr);
+        return keys;
+    }
+
+    Object* Select(uint32_t key) const { return key < objects.size() ? objects[key] : nullptr; }
+
+    uint32_t BuiltCount() const
+    {
+        uint32_t built = 0;
+        for (Object* o : objects) built += o ? 1 : 0;
+        return built;
+    }
+
+    void Release()
+    {
+        for (Object*& o : objects)
+        {
+            if (o) o->Release();
+            o = nullptr;
+        }
+    }
+};
@@ -0,0 +1,622 @@
+// Lab8_SoftRasterizer
+// Программный растеризатор кадра Lab8 без D3D-устройства: skybox, экземпляры с текстурным массивом
+// и картой нормалей, Фонг по источникам (как instancedPS), фильтр оттенков серого - в память и в TGA.
+// Схема кадра:
+//  1. настройка: вершины в clip space, отсечение по ближней плоскости (z >= 0, как в D3D),
+//     отбрасывание задних граней (лицевые - по часовой стрелке, D3D11_CULL_BACK); каждый поток
+//     берёт свою часть треугольников и раскладывает их по своим корзинам тайлов 64x64;
+//  2. тайлы параллельно: корзины всех потоков в исходном порядке треугольников, edge functions
+//     по 4 пикселя за раз (SSE2), тест глубины LESS, в буфер видимости - треугольник и барицентрики;
+//  3. в том же тайле - затенение видимых пикселей ровно один раз, пустые пиксели - skybox по лучу.
+//     Источники отбираются на тайл: сфера источника против AABB видимых точек тайла в мире
+//     (аналог кластеров Lab8; за радиусом затухание нулевое, поэтому результат тот же).
+// Тайл принадлежит одному потоку, поэтому запись в буферы кадра без синхронизации.
+// Без WinAPI/D3D: сцену (копии вершин, текстур, источников) заполняет вызывающий. На Linux кадры
+// в TGA пишет Tests/SoftRasterizerDriver.cpp, проверки - Tests/SoftRasterizerTest.cpp.
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "CpuMath.h"
+#include "ClusteredLights.h"
+#include "WorkerPool.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SW_RASTER_SSE2 1
+#endif
+
+const uint32_t SW_TILE_SIZE = 64;
+const uint32_t SW_NO_TRIANGLE = ~0u;
+
+// Раскладка как у TextureNormalTangentVertex
+struct SwVertex
+{
+    Float3 pos, normal, tangent;
+    float u, v;
+};
+
+struct SwTexture
+{
+    uint32_t width = 0, height = 0;
+    std::vector<uint32_t> texels;   // RGBA8, R в младшем байте
+
+    // Билинейная выборка mip 0; wrap - как g_pSampler, иначе clamp (грани кубической карты)
+    Float3 Sample(float u, float v, bool wrap = true) const
+    {
+        if (texels.empty()) return MakeFloat3(1.0f, 1.0f, 1.0f);
+        float x = u * width - 0.5f, y = v * height - 0.5f;
+        float fx = floorf(x), fy = floorf(y);
+        float tx = x - fx, ty = y - fy;
+        int x0 = (int)fx, y0 = (int)fy;
+        Float3 c00 = Fetch(x0, y0, wrap), c10 = Fetch(x0 + 1, y0, wrap);
+        Float3 c01 = Fetch(x0, y0 + 1, wrap), c11 = Fetch(x0 + 1, y0 + 1, wrap);
+        Float3 top = Add(Scale(c00, 1.0f - tx), Scale(c10, tx));
+        Float3 bottom = Add(Scale(c01, 1.0f - tx), Scale(c11, tx));
+        return Add(Scale(top, 1.0f - ty), Scale(bottom, ty));
+    }
+
+    static Float3 Unpack(uint32_t c)
+    {
+        const float k = 1.0f / 255.0f;
+        return MakeFloat3((c & 0xFF) * k, ((c >> 8) & 0xFF) * k, ((c >> 16) & 0xFF) * k);
+    }
+
+private:
+    Float3 Fetch(int x, int y, bool wrap) const
+    {
+        int w = (int)width, h = (int)height;
+        if (wrap) { x %= w; y %= h; if (x < 0) x += w; if (y < 0) y += h; }
+        else { x = (std::max)(0, (std::min)(x, w - 1)); y = (std::max)(0, (std::min)(y, h - 1)); }
+        return Unpack(texels[(size_t)y * width + x]);
+    }
+};
+
+enum SwBlockFormat { SW_BC1, SW_BC2, SW_BC3 };
+
+// Распаковка mip 0 из BC1/BC2/BC3 (текстуры Lab8 в DDS сжаты). Альфа не нужна - только цвет.
+inline void DecodeBlockCompressed(const uint8_t* data, uint32_t width, uint32_t height, SwBlockFormat format, SwTexture& out)
+{
+    out.width = width;
+    out.height = height;
+    out.texels.assign((size_t)width * height, 0xFF000000u);
+    uint32_t blockBytes = format == SW_BC1 ? 8 : 16;
+    uint32_t blocksX = (std::max)(1u, (width + 3) / 4), blocksY = (std::max)(1u, (height + 3) / 4);
+    for (uint32_t by = 0; by < blocksY; ++by)
+    {
+        for (uint32_t bx = 0; bx < blocksX; ++bx)
+        {
+            const uint8_t* block = data + ((size_t)by * blocksX + bx) * blockBytes;
+            if (format != SW_BC1) block += 8;   // блок альфы BC2/BC3
+            uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8)), c1 = (uint16_t)(block[2] | (block[3] << 8));
+            uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+            uint32_t rgb[4][3];
+            for (int i = 0; i < 2; ++i)
+            {
+                uint16_t c = i == 0 ? c0 : c1;
+                rgb[i][0] = ((c >> 11) & 31) * 255 / 31;
+                rgb[i][1] = ((c >> 5) & 63) * 255 / 63;
+                rgb[i][2] = (c & 31) * 255 / 31;
+            }
+            // В BC2/BC3 цветовой блок всегда в режиме четырёх цветов
+            bool fourColors = format != SW_BC1 || c0 > c1;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (fourColors)
+                {
+                    rgb[2][k] = (2 * rgb[0][k] + rgb[1][k]) / 3;
+                    rgb[3][k] = (rgb[0][k] + 2 * rgb[1][k]) / 3;
+                }
+                else
+                {
+                    rgb[2][k] = (rgb[0][k] + rgb[1][k]) / 2;
+                    rgb[3][k] = 0;
+                }
+            }
+            for (uint32_t p = 0; p < 16; ++p)
+            {
+                uint32_t x = bx * 4 + p % 4, y = by * 4 + p / 4;
+                if (x >= width || y >= height) continue;
+                const uint32_t* c = rgb[(bits >> (2 * p)) & 3];
+                out.texels[(size_t)y * width + x] = 0xFF000000u | (c[2] << 16) | (c[1] << 8) | c[0];
+            }
+        }
+    }
+}
+
+struct SwCubemap
+{
+    SwTexture faces[6];   // +X, -X, +Y, -Y, +Z, -Z - порядок граней D3D
+
+    // Выбор грани и координат как у TextureCube
+    Float3 Sample(const Float3& d) const
+    {
+        float ax = fabsf(d.x), ay = fabsf(d.y), az = fabsf(d.z);
+        int face;
+        float sc, tc, ma;
+        if (ax >= ay && ax >= az) { face = d.x >= 0 ? 0 : 1; ma = ax; sc = d.x >= 0 ? -d.z : d.z; tc = -d.y; }
+        else if (ay >= az)        { face = d.y >= 0 ? 2 : 3; ma = ay; sc = d.x; tc = d.y >= 0 ? d.z : -d.z; }
+        else                      { face = d.z >= 0 ? 4 : 5; ma = az; sc = d.z >= 0 ? d.x : -d.x; tc = -d.y; }
+        if (ma <= 0.0f) return MakeFloat3(0.0f, 0.0f, 0.0f);
+        return faces[face].Sample((sc / ma + 1.0f) * 0.5f, (tc / ma + 1.0f) * 0.5f, false);
+    }
+};
+
+struct SwInstance
+{
+    Float4x4 model;        // как GeomBuffer.model: v * model
+    Float4x4 normal;       // как GeomBuffer.norm: transpose(inverse(model))
+    uint32_t startIndex = 0, indexCount = 0;
+    int32_t baseVertex = 0;
+    uint32_t texture = 0;  // слой текстурного массива
+    bool normalMap = false;
+    float shininess = 32.0f;
+};
+
+struct SwScene
+{
+    std::vector<SwVertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<SwTexture> textures;   // слои текстурного массива
+    SwTexture normalMap;
+    SwCubemap skybox;
+    std::vector<PointLight> lights;
+    std::vector<SwInstance> instances;
+    Float4x4 viewProj;                 // как ViewProjBuffer до транспонирования
+    Float4x4 vpSky;                    // view без переноса * proj
+    Float3 cameraPos;
+    Float3 ambient = { 0.2f, 0.2f, 0.2f };
+    bool grayscale = true;             // постпроцессинг Lab8
+};
+
+struct SwStats
+{
+    uint32_t triangles = 0;        // на входе
+    uint32_t rasterTriangles = 0;  // после отсечения и отбрасывания задних граней
+    uint32_t binEntries = 0;       // треугольник x тайл
+    double setupMs = 0.0, tileMs = 0.0, totalMs = 0.0;
+};
+
+// Затухание из clusteredLightingCode
+inline float SwLightAttenuation(float dist, float radius)
+{
+    float r = dist / radius;
+    float w = (std::max)(0.0f, (std::min)(1.0f, 1.0f - r * r * r * r));
+    return w * w / (1.0f + 0.1f * dist + 0.01f * dist * dist);
+}
+
+struct SoftRasterizer
+{
+    uint32_t width = 0, height = 0;
+    uint32_t threadCount = 1;
+    std::vector<uint32_t> color;   // результат, RGBA8 (R в младшем байте), строка = width
+    SwStats stats;
+
+    void Resize(uint32_t w, uint32_t h)
+    {
+        width = w;
+        height = h;
+        stride = (w + 3) & ~3u;    // SIMD пишет по 4 пикселя
+        tilesX = (w + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+        tilesY = (h + SW_TILE_SIZE - 1) / SW_TILE_SIZE;
+        color.assign((size_t)w * h, 0);
+        depth.assign((size_t)stride * h, 1.0f);
+        visId.assign((size_t)stride * h, SW_NO_TRIANGLE);
+        visB1.assign((size_t)stride * h, 0.0f);
+        visB2.assign((size_t)stride * h, 0.0f);
+    }
+
+    void Render(const SwScene& scene)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        uint32_t threads = (std::max)(1u, threadCount);
+        stats = SwStats();
+        invSky = Inverse(scene.vpSky);
+
+        // Сквозная нумерация треугольников: начало каждого экземпляра
+        triangleStart.resize(scene.instances.size() + 1);
+        triangleStart[0] = 0;
+        for (size_t i = 0; i < scene.instances.size(); ++i)
+            triangleStart[i + 1] = triangleStart[i] + scene.instances[i].indexCount / 3;
+        stats.triangles = triangleStart.back();
+
+        if (threadTriangles.size() != threads)
+        {
+            threadTriangles.assign(threads, std::vector<Triangle>());
+            threadBins.assign(threads, std::vector<std::vector<uint32_t>>());
+        }
+        DispatchGroups(threads, threads, [&](uint32_t t) { SetupChunk(scene, t, threads); });
+        for (uint32_t t = 0; t < threads; ++t)
+        {
+            stats.rasterTriangles += (uint32_t)threadTriangles[t].size();
+            for (const std::vector<uint32_t>& bin : threadBins[t]) stats.binEntries += (uint32_t)bin.size();
+        }
+        auto setupEnd = std::chrono::high_resolution_clock::now();
+
+        DispatchGroups(tilesX * tilesY, threads, [&](uint32_t tile) { RenderTile(scene, tile); });
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.setupMs = std::chrono::duration<double, std::milli>(setupEnd - start).count();
+        stats.tileMs = std::chrono::duration<double, std::milli>(end - setupEnd).count();
+        stats.totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // Буфер видимости последнего кадра: глубина (1 - пусто) и закрыт ли пиксель треугольником
+    float DepthAt(uint32_t x, uint32_t y) const { return depth[(size_t)y * stride + x]; }
+    bool CoveredAt(uint32_t x, uint32_t y) const { return visId[(size_t)y * stride + x] != SW_NO_TRIANGLE; }
+
+    // Несжатый 32-битный TGA, строки сверху вниз
+    bool WriteTGA(const char* path) const
+    {
+        FILE* f = nullptr;
+#ifdef _MSC_VER
+        if (fopen_s(&f, path, "wb") != 0) f = nullptr;
+#else
+        f = fopen(path, "wb");
+#endif
+        if (!f) return false;
+        uint8_t header[18] = {};
+        header[2] = 2;   // truecolor без сжатия
+        header[12] = (uint8_t)(width & 0xFF); header[13] = (uint8_t)(width >> 8);
+        header[14] = (uint8_t)(height & 0xFF); header[15] = (uint8_t)(height >> 8);
+        header[16] = 32;
+        header[17] = 0x28;   // 8 бит альфы, начало в левом верхнем углу
+        fwrite(header, 1, sizeof(header), f);
+        std::vector<uint8_t> row((size_t)width * 4);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                uint32_t c = color[(size_t)y * width + x];
+                row[x * 4 + 0] = (uint8_t)(c >> 16);
+                row[x * 4 + 1] = (uint8_t)(c >> 8);
+                row[x * 4 + 2] = (uint8_t)c;
+                row[x * 4 + 3] = (uint8_t)(c >> 24);
+            }
+            fwrite(row.data(), 1, row.size(), f);
+        }
+        return fclose(f) == 0;
+    }
+
+private:
+    struct ClipVertex
+    {
+        Float4 clip;
+        Float3 world, normal, tangent;
+        float u, v;
+    };
+    // Точка поверхности после интерполяции (как VSOutput в instancedPS)
+    struct Surface
+    {
+        Float3 world, normal, tangent;
+        float u, v;
+        uint32_t instance;
+    };
+    struct Triangle
+    {
+        ClipVertex v[3];
+        float sx[3], sy[3], sz[3], invW[3];
+        float invArea;
+        uint32_t instance;
+        int minX, minY, maxX, maxY;
+    };
+
+    uint32_t stride = 0, tilesX = 0, tilesY = 0;
+    std::vector<float> depth;
+    std::vector<uint32_t> visId;   // (поток << 24) | номер в threadTriangles[поток]
+    std::vector<float> visB1, visB2;
+    std::vector<uint32_t> triangleStart;
+    std::vector<std::vector<Triangle>> threadTriangles;
+    std::vector<std::vector<std::vector<uint32_t>>> threadBins;   // [поток][тайл]
+    Float4x4 invSky;
+
+    static ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t)
+    {
+        ClipVertex r;
+        r.clip.x = a.clip.x + (b.clip.x - a.clip.x) * t;
+        r.clip.y = a.clip.y + (b.clip.y - a.clip.y) * t;
+        r.clip.z = a.clip.z + (b.clip.z - a.clip.z) * t;
+        r.clip.w = a.clip.w + (b.clip.w - a.clip.w) * t;
+        r.world = Add(a.world, Scale(Sub(b.world, a.world), t));
+        r.normal = Add(a.normal, Scale(Sub(b.normal, a.normal), t));
+        r.tangent = Add(a.tangent, Scale(Sub(b.tangent, a.tangent), t));
+        r.u = a.u + (b.u - a.u) * t;
+        r.v = a.v + (b.v - a.v) * t;
+        return r;
+    }
+
+    void SetupChunk(const SwScene& scene, uint32_t t, uint32_t threads)
+    {
+        std::vector<Triangle>& out = threadTriangles[t];
+        std::vector<std::vector<uint32_t>>& bins = threadBins[t];
+        out.clear();
+        bins.resize(tilesX * tilesY);
+        for (std::vector<uint32_t>& bin : bins) bin.clear();
+
+        uint32_t total = triangleStart.back();
+        uint32_t begin = (uint32_t)((uint64_t)total * t / threads), end = (uint32_t)((uint64_t)total * (t + 1) / threads);
+        uint32_t inst = (uint32_t)(std::upper_bound(triangleStart.begin(), triangleStart.end(), begin) - triangleStart.begin()) - 1;
+        for (uint32_t tri = begin; tri < end; ++tri)
+        {
+            while (tri >= triangleStart[inst + 1]) ++inst;
+            const SwInstance& instance = scene.instances[inst];
+            uint32_t first = instance.startIndex + (tri - triangleStart[inst]) * 3;
+            ClipVertex cv[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const SwVertex& v = scene.vertices[instance.baseVertex + scene.indices[first + k]];
+                Float4 w = TransformPoint(instance.model, v.pos);
+                cv[k].world = MakeFloat3(w.x, w.y, w.z);
+                cv[k].clip = TransformPoint(scene.viewProj, cv[k].world);
+                cv[k].normal = TransformDirection(instance.normal, v.normal);
+                cv[k].tangent = TransformDirection(instance.normal, v.tangent);
+                cv[k].u = v.u;
+                cv[k].v = v.v;
+            }
+
+            // Отсечение по ближней плоскости z >= 0: многоугольник до 4 вершин, веер треугольников
+            ClipVertex poly[4];
+            int count = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                const ClipVertex& a = cv[k];
+                const ClipVertex& b = cv[(k + 1) % 3];
+                if (a.clip.z >= 0.0f) poly[count++] = a;
+                if ((a.clip.z >= 0.0f) != (b.clip.z >= 0.0f)) poly[count++] = Lerp(a, b, a.clip.z / (a.clip.z - b.clip.z));
+            }
+            for (int k = 1; k + 1 < count; ++k) Emit(poly[0], poly[k], poly[k + 1], inst, t, out, bins);
+        }
+    }
+
+    void Emit(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, uint32_t instance, uint32_t t,
+              std::vector<Triangle>& out, std::vector<std::vector<uint32_t>>& bins)
+    {
+        Triangle tri;
+        tri.v[0] = a; tri.v[1] = b; tri.v[2] = c;
+        for (int k = 0; k < 3; ++k)
+        {
+            float invW = 1.0f / tri.v[k].clip.w;
+            tri.invW[k] = invW;
+            tri.sx[k] = (tri.v[k].clip.x * invW * 0.5f + 0.5f) * width;
+            tri.sy[k] = (0.5f - tri.v[k].clip.y * invW * 0.5f) * height;
+            tri.sz[k] = tri.v[k].clip.z * invW;
+        }
+        // y вниз: лицевая грань (по часовой стрелке на экране) даёт положительную площадь
+        float area = (tri.sx[1] - tri.sx[0]) * (tri.sy[2] - tri.sy[0]) - (tri.sy[1] - tri.sy[0]) * (tri.sx[2] - tri.sx[0]);
+        if (!(area > 0.0f)) return;
+        float minX = (std::min)(tri.sx[0], (std::min)(tri.sx[1], tri.sx[2])), maxX = (std::max)(tri.sx[0], (std::max)(tri.sx[1], tri.sx[2]));
+        float minY = (std::min)(tri.sy[0], (std::min)(tri.sy[1], tri.sy[2])), maxY = (std::max)(tri.sy[0], (std::max)(tri.sy[1], tri.sy[2]));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height) return;
+        tri.minX = (std::max)(0, (int)floorf(minX));
+        tri.minY = (std::max)(0, (int)floorf(minY));
+        tri.maxX = (std::min)((int)width - 1, (int)ceilf(maxX));
+        tri.maxY = (std::min)((int)height - 1, (int)ceilf(maxY));
+        tri.invArea = 1.0f / area;
+        tri.instance = instance;
+
+        uint32_t id = (t << 24) | (uint32_t)out.size();
+        out.push_back(tri);
+        for (int ty = tri.minY / (int)SW_TILE_SIZE; ty <= tri.maxY / (int)SW_TILE_SIZE; ++ty)
+            for (int tx = tri.minX / (int)SW_TILE_SIZE; tx <= tri.maxX / (int)SW_TILE_SIZE; ++tx)
+                bins[ty * tilesX + tx].push_back(id);
+    }
+
+    const Triangle& Lookup(uint32_t id) const { return threadTriangles[id >> 24][id & 0xFFFFFF]; }
+
+    void RenderTile(const SwScene& scene, uint32_t tile)
+    {
+        int x0 = (int)((tile % tilesX) * SW_TILE_SIZE), y0 = (int)((tile / tilesX) * SW_TILE_SIZE);
+        int x1 = (std::min)(x0 + (int)SW_TILE_SIZE, (int)width) - 1, y1 = (std::min)(y0 + (int)SW_TILE_SIZE, (int)height) - 1;
+        for (int y = y0; y <= y1; ++y)
+        {
+            std::fill(depth.begin() + (size_t)y * stride + x0, depth.begin() + (size_t)y * stride + x1 + 1, 1.0f);
+            std::fill(visId.begin() + (size_t)y * stride + x0, visId.begin() + (size_t)y * stride + x1 + 1, SW_NO_TRIANGLE);
+        }
+        // Потоки настройки брали треугольники подряд, поэтому корзины по потокам - исходный порядок
+        for (const std::vector<std::vector<uint32_t>>& bins : threadBins)
+            for (uint32_t id : bins[tile]) RasterizeTriangle(Lookup(id), id, x0, y0, x1, y1);
+
+        // Интерполяция видимых пикселей и границы тайла в мире
+        int tileW = x1 - x0 + 1;
+        std::vector<Surface> surfaces((size_t)tileW * (y1 - y0 + 1));
+        Float3 bmin = MakeFloat3(FLT_MAX, FLT_MAX, FLT_MAX), bmax = MakeFloat3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        bool any = false;
+        for (int y = y0; y <= y1; ++y)
+        {
+            for (int x = x0; x <= x1; ++x)
+            {
+                size_t index = (size_t)y * stride + x;
+                if (visId[index] == SW_NO_TRIANGLE) continue;
+                Surface& s = surfaces[(size_t)(y - y0) * tileW + (x - x0)];
+                Interpolate(visId[index], visB1[index], visB2[index], s);
+                bmin = MakeFloat3((std::min)(bmin.x, s.world.x), (std::min)(bmin.y, s.world.y), (std::min)(bmin.z, s.world.z));
+                bmax = MakeFloat3((std::max)(bmax.x, s.world.x), (std::max)(bmax.y, s.world.y), (std::max)(bmax.z, s.world.z));
+                any = true;
+            }
+        }
+        std::vector<uint32_t> lights;
+        if (any)
+        {
+            for (uint32_t l = 0; l < scene.lights.size(); ++l)
+            {
+                const PointLight& light = scene.lights[l];
+                float dx = (std::max)(0.0f, (std::max)(bmin.x - light.pos.x, light.pos.x - bmax.x));
+                float dy = (std::max)(0.0f, (std::max)(bmin.y - light.pos.y, light.pos.y - bmax.y));
+                float dz = (std::max)(0.0f, (std::max)(bmin.z - light.pos.z, light.pos.z - bmax.z));
+                if (dx * dx + dy * dy + dz * dz < light.radius * light.radius) lights.push_back(l);
+            }
+        }
+
+        for (int y = y0; y <= y1; ++y)
+        {
+            for (int x = x0; x <= x1; ++x)
+            {
+                Float3 result;
+                if (visId[(size_t)y * stride + x] == SW_NO_TRIANGLE)
+                {
+                    // Skybox: луч через пиксель на дальней плоскости, vpSky без переноса
+                    float ndcX = (x + 0.5f) / width * 2.0f - 1.0f, ndcY = 1.0f - (y + 0.5f) / height * 2.0f;
+                    Float4 p = TransformPoint(invSky, MakeFloat3(ndcX, ndcY, 1.0f));
+                    result = scene.skybox.Sample(MakeFloat3(p.x / p.w, p.y / p.w, p.z / p.w));
+                }
+                else
+                {
+                    result = ShadeSurface(scene, surfaces[(size_t)(y - y0) * tileW + (x - x0)], lights);
+                }
+                color[(size_t)y * width + x] = Resolve(scene, result);
+            }
+        }
+    }
+
+    void RasterizeTriangle(const Triangle& tri, uint32_t id, int tx0, int ty0, int tx1, int ty1)
+    {
+        int minX = (std::max)(tri.minX, tx0) & ~3, maxX = (std::min)(tri.maxX, tx1);
+        int minY = (std::max)(tri.minY, ty0), maxY = (std::min)(tri.maxY, ty1);
+        if (minX > maxX || minY > maxY) return;
+        // Ребро (a, b): E(p) = A * x + B * y + C, внутри - все три E >= 0
+        float A[3], B[3], C[3];
+        for (int e = 0; e < 3; ++e)
+        {
+            int a = (e + 1) % 3, b = (e + 2) % 3;   // E0 - напротив вершины 0, даёт её вес
+            A[e] = tri.sy[a] - tri.sy[b];
+            B[e] = tri.sx[b] - tri.sx[a];
+            C[e] = -(A[e] * tri.sx[a] + B[e] * tri.sy[a]);
+        }
+        float dz1 = tri.sz[1] - tri.sz[0], dz2 = tri.sz[2] - tri.sz[0];
+#ifdef SW_RASTER_SSE2
+        const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 invArea = _mm_set1_ps(tri.invArea);
+        const __m128 z0 = _mm_set1_ps(tri.sz[0]), vdz1 = _mm_set1_ps(dz1), vdz2 = _mm_set1_ps(dz2);
+        const __m128 limit = _mm_set1_ps((float)maxX + 1.0f);
+        const __m128i vid = _mm_set1_epi32((int)id);
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            size_t row = (size_t)y * stride;
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                __m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(B[0] * py + C[0]));
+                __m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(B[1] * py + C[1]));
+                __m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(B[2] * py + C[2]));
+                __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)),
+                                         _mm_and_ps(_mm_cmpge_ps(w2, zero), _mm_cmplt_ps(px, limit)));
+                if (!_mm_movemask_ps(mask)) continue;
+                __m128 b1 = _mm_mul_ps(w1, invArea), b2 = _mm_mul_ps(w2, invArea);
+                __m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(b1, vdz1), _mm_mul_ps(b2, vdz2)));
+                __m128 oldZ = _mm_loadu_ps(&depth[row + x]);
+                __m128 pass = _mm_and_ps(mask, _mm_cmplt_ps(z, oldZ));
+                if (!_mm_movemask_ps(pass)) continue;
+                _mm_storeu_ps(&depth[row + x], _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldZ)));
+                __m128 oldB1 = _mm_loadu_ps(&visB1[row + x]), oldB2 = _mm_loadu_ps(&visB2[row + x]);
+                _mm_storeu_ps(&visB1[row + x], _mm_or_ps(_mm_and_ps(pass, b1), _mm_andnot_ps(pass, oldB1)));
+                _mm_storeu_ps(&visB2[row + x], _mm_or_ps(_mm_and_ps(pass, b2), _mm_andnot_ps(pass, oldB2)));
+                __m128i passI = _mm_castps_si128(pass);
+                __m128i oldId = _mm_loadu_si128((const __m128i*)&visId[row + x]);
+                _mm_storeu_si128((__m128i*)&visId[row + x], _mm_or_si128(_mm_and_si128(passI, vid), _mm_andnot_si128(passI, oldId)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            size_t row = (size_t)y * stride;
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float px = x + 0.5f;
+                float w0 = A[0] * px + (B[0] * py + C[0]);
+                float w1 = A[1] * px + (B[1] * py + C[1]);
+                float w2 = A[2] * px + (B[2] * py + C[2]);
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+                float b1 = w1 * tri.invArea, b2 = w2 * tri.invArea;
+                float z = tri.sz[0] + (b1 * dz1 + b2 * dz2);
+                if (!(z < depth[row + x])) continue;
+                depth[row + x] = z;
+                visB1[row + x] = b1;
+                visB2[row + x] = b2;
+                visId[row + x] = id;
+            }
+        }
+#endif
+    }
+
+    // Перспективно-корректные веса из экранных барицентрик
+    void Interpolate(uint32_t id, float b1, float b2, Surface& out) const
+    {
+        const Triangle& tri = Lookup(id);
+        float b[3] = { 1.0f - b1 - b2, b1, b2 };
+        float sum = 0.0f;
+        for (int k = 0; k < 3; ++k) { b[k] *= tri.invW[k]; sum += b[k]; }
+        for (int k = 0; k < 3; ++k) b[k] /= sum;
+        out.world = out.normal = out.tangent = MakeFloat3(0.0f, 0.0f, 0.0f);
+        out.u = out.v = 0.0f;
+        for (int k = 0; k < 3; ++k)
+        {
+            out.world = Add(out.world, Scale(tri.v[k].world, b[k]));
+            out.normal = Add(out.normal, Scale(tri.v[k].normal, b[k]));
+            out.tangent = Add(out.tangent, Scale(tri.v[k].tangent, b[k]));
+            out.u += tri.v[k].u * b[k];
+            out.v += tri.v[k].v * b[k];
+        }
+        out.instance = tri.instance;
+    }
+
+    // Цель UNORM8 и фильтр оттенков серого
+    static uint32_t Resolve(const SwScene& scene, const Float3& c)
+    {
+        uint32_t r = ToUnorm(c.x), g = ToUnorm(c.y), b = ToUnorm(c.z);
+        if (scene.grayscale)
+        {
+            // Фильтр читает цель UNORM8, поэтому серый считается от уже округлённого цвета
+            uint32_t gray = ToUnorm((r * 0.299f + g * 0.587f + b * 0.114f) / 255.0f);
+            r = g = b = gray;
+        }
+        return 0xFF000000u | (b << 16) | (g << 8) | r;
+    }
+
+    // instancedPS
+    Float3 ShadeSurface(const SwScene& scene, const Surface& s, const std::vector<uint32_t>& lights) const
+    {
+        const SwInstance& inst = scene.instances[s.instance];
+        const Float3& world = s.world;
+        float u = s.u, v = s.v;
+        Float3 albedo = inst.texture < scene.textures.size() ? scene.textures[inst.texture].Sample(u, v) : MakeFloat3(1, 1, 1);
+        Float3 N = Normalize(s.normal);
+        if (inst.normalMap)
+        {
+            Float3 tn = Sub(Scale(scene.normalMap.Sample(u, v), 2.0f), MakeFloat3(1, 1, 1));
+            Float3 T = Normalize(s.tangent);
+            Float3 B = Cross(N, T);
+            N = Normalize(Add(Add(Scale(T, tn.x), Scale(B, tn.y)), Scale(N, tn.z)));
+        }
+        Float3 result = MakeFloat3(scene.ambient.x * albedo.x, scene.ambient.y * albedo.y, scene.ambient.z * albedo.z);
+        Float3 V = Normalize(Sub(scene.cameraPos, world));
+        for (uint32_t l : lights)
+        {
+            const PointLight& light = scene.lights[l];
+            Float3 L = Sub(light.pos, world);
+            // Список тайла грубый: за радиусом источника вклад нулевой, отбрасываем до sqrt
+            float dist2 = Dot(L, L);
+            if (dist2 >= light.radius * light.radius || dist2 <= 0.0f) continue;
+            float dist = sqrtf(dist2);
+            L = Scale(L, 1.0f / dist);
+            float atten = SwLightAttenuation(dist, light.radius);
+            float diff = (std::max)(Dot(N, L), 0.0f);
+            Float3 R = Sub(Scale(N, 2.0f * Dot(N, L)), L);   // reflect(-L, N)
+            float rv = Dot(V, R);
+            float spec = rv > 0.0f ? powf(rv, inst.shininess) : 0.0f;
+            result.x += (albedo.x * diff + spec) * atten * light.color.x;
+            result.y += (albedo.y * diff + spec) * atten * light.color.y;
+            result.z += (albedo.z * diff + spec) * atten * light.color.z;
+        }
+        return result;
+    }
+
+    static uint32_t ToUnorm(float c)
+    {
+        c = (std::max)(0.0f, (std::min)(1.0f, c));
+        return (uint32_t)(c * 255.0f + 0.5f);
+    }
+};
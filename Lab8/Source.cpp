@@ -11,6 +11,28 @@
 #include <vector>
 #include <algorithm>
 #include <cstring>
+#include <chrono>
+#include <thread>
+#include "OcclusionCulling.h"
+#include "LodBatching.h"
+#include "ContributionCulling.h"
+#include "Meshlets.h"
+#include "ClusteredLights.h"
+#include "InstanceLights.h"
+#include "StateCache.h"
+#include "RenderBackend.h"
+#include "StateFilter.h"
+#include "CommandRecording.h"
+#include "FramePipeline.h"
+#include "RenderGraph.h"
+#include "SoftRasterizer.h"
+#include "ShaderCache.h"
+#include "ShaderJobs.h"
+#include "ShaderPermutations.h"
+#include "DeferredShading.h"
+#include "CpuPostProcess.h"
+#include "Bloom.h"
+#include "FrameGovernor.h"
 
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3)  \
@@ -28,6 +50,9 @@
 using namespace DirectX;
 
 const UINT MAX_INSTANCES = 20;
+const UINT MESH_COUNT = 2;                        // 0 - куб, 1 - сфера с LOD
+const UINT LOD_BUCKETS = MESH_COUNT * MAX_LODS;   // корзины (mesh, LOD) = число indirect args
+const UINT CULL_STATS_UINTS = 4;                  // счётчики после indirect args: отсечено по вкладу (экземпляры, вершины)
 const UINT NUM_TEXTURES = 2;
 const std::wstring TEXTURE_NAMES[] = { L"brick.dds", L"Kitty.dds" };
 
@@ -152,6 +177,13 @@ bool LoadDDS(const wchar_t* filename, TextureDesc& desc, std::vector<void*>* pMi
     return true;
 }
 
+// mip 0 в RGBA8 для программного растеризатора (LoadDDS отдаёт только BC1/BC2/BC3)
+void DecodeSwTexture(const TextureDesc& desc, const void* mip0, SwTexture& out)
+{
+    SwBlockFormat format = desc.fmt == DXGI_FORMAT_BC1_UNORM ? SW_BC1 : (desc.fmt == DXGI_FORMAT_BC2_UNORM ? SW_BC2 : SW_BC3);
+    DecodeBlockCompressed((const uint8_t*)mip0, desc.width, desc.height, format, out);
+}
+
 // ------------------------------------------------------------------
 // Типы вершин
 // ------------------------------------------------------------------
@@ -185,10 +217,11 @@ ID3D11VertexShader* g_pVertexShader = nullptr;
 ID3D11PixelShader* g_pPixelShader = nullptr;
 ID3D11InputLayout* g_pInputLayout = nullptr;
 
-// Шейдеры для skybox
+// Шейдеры для skybox (пиксельный - варианты SKY_*)
 ID3D11VertexShader* g_pSkyboxVS = nullptr;
-ID3D11PixelShader* g_pSkyboxPS = nullptr;
+ShaderVariants<ID3D11PixelShader> g_SkyboxPSVariants;
 ID3D11InputLayout* g_pSkyboxInputLayout = nullptr;
+enum SkyboxPSFeature { SKY_GRAYSCALE };
 
 // Константные буферы
 struct ModelBuffer { XMMATRIX model; };
@@ -197,9 +230,9 @@ struct SceneBuffer
 {
     XMMATRIX vp;
     XMFLOAT4 cameraPos;
-    XMFLOAT4 lightCount;
-    struct Light { XMFLOAT4 pos; XMFLOAT4 color; } lights[10];
+    XMFLOAT4 lightCount;  // x - число источников (normal map и режим списков - варианты instancedPS)
     XMFLOAT4 ambientColor;
+    XMMATRIX invVp;       // позиция по глубине в deferredPS
 };
 ID3D11Buffer* g_pModelBuffer1 = nullptr;
 ID3D11Buffer* g_pModelBuffer2 = nullptr;
@@ -221,9 +254,233 @@ ID3D11ShaderResourceView* g_pCubemapView = nullptr;
 ID3D11RasterizerState* g_pRSCullNone = nullptr;
 ID3D11RasterizerState* g_pRSCullBack = nullptr;
 
+// Кэш объектов состояния: Create*State идут через него, повторное описание возвращает готовый объект
+struct D3D11StateApi
+{
+    typedef ID3D11Device Device;
+    typedef D3D11_DEPTH_STENCIL_DESC DepthStencilDesc;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef D3D11_RASTERIZER_DESC RasterizerDesc;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef D3D11_BLEND_DESC BlendDesc;
+    typedef ID3D11BlendState BlendState;
+    typedef D3D11_SAMPLER_DESC SamplerDesc;
+    typedef ID3D11SamplerState SamplerState;
+};
+PipelineStateCache<D3D11StateApi> g_StateCache;
+
+// Бэкенд кадра: всё, что кадр отправляет в контекст, идёт через RenderBackend
+struct D3D11Types
+{
+    typedef ID3D11Resource Resource;
+    typedef ID3D11Buffer Buffer;
+    typedef ID3D11VertexShader VertexShader;
+    typedef ID3D11PixelShader PixelShader;
+    typedef ID3D11ComputeShader ComputeShader;
+    typedef ID3D11InputLayout InputLayout;
+    typedef ID3D11ShaderResourceView ShaderResourceView;
+    typedef ID3D11UnorderedAccessView UnorderedAccessView;
+    typedef ID3D11RenderTargetView RenderTargetView;
+    typedef ID3D11DepthStencilView DepthStencilView;
+    typedef ID3D11SamplerState SamplerState;
+    typedef ID3D11BlendState BlendState;
+    typedef ID3D11DepthStencilState DepthStencilState;
+    typedef ID3D11RasterizerState RasterizerState;
+    typedef ID3D11Query Query;
+    typedef ID3D11CommandList CommandList;
+    typedef D3D11_PRIMITIVE_TOPOLOGY Topology;
+    typedef DXGI_FORMAT Format;
+    typedef D3D11_VIEWPORT Viewport;
+    typedef D3D11_BOX Box;
+    typedef D3D11_MAP MapType;
+    typedef D3D11_MAPPED_SUBRESOURCE Mapped;
+
+    // Размер памяти под Map в пустом бэкенде
+    static uint32_t MappedBytes(ID3D11Resource* resource)
+    {
+        D3D11_RESOURCE_DIMENSION dimension;
+        resource->GetType(&dimension);
+        if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+        {
+            D3D11_BUFFER_DESC desc;
+            static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+            return desc.ByteWidth;
+        }
+        if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+            return desc.Width * desc.Height * 16;   // с запасом на самый широкий формат
+        }
+        return 0;
+    }
+};
+typedef RenderBackend<D3D11Types> FrameBackend;
+
+// Пересылка в контекст D3D11: непосредственный или отложенный
+struct D3D11Backend : FrameBackend
+{
+    ID3D11DeviceContext* context = nullptr;
+
+    void IASetInputLayout(ID3D11InputLayout* layout) override { context->IASetInputLayout(layout); }
+    void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) override { context->IASetPrimitiveTopology(topology); }
+    void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, uint32_t offset) override { context->IASetIndexBuffer(buffer, format, offset); }
+    void IASetVertexBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* buffers, const uint32_t* strides, const uint32_t* offsets) override
+    {
+        context->IASetVertexBuffers(start, count, buffers, strides, offsets);
+    }
+    void VSSetShader(ID3D11VertexShader* shader) override { context->VSSetShader(shader, nullptr, 0); }
+    void PSSetShader(ID3D11PixelShader* shader) override { context->PSSetShader(shader, nullptr, 0); }
+    void CSSetShader(ID3D11ComputeShader* shader) override { context->CSSetShader(shader, nullptr, 0); }
+    void VSSetConstantBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* buffers) override { context->VSSetConstantBuffers(start, count, buffers); }
+    void PSSetConstantBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* buffers) override { context->PSSetConstantBuffers(start, count, buffers); }
+    void CSSetConstantBuffers(uint32_t start, uint32_t count, ID3D11Buffer* const* buffers) override { context->CSSetConstantBuffers(start, count, buffers); }
+    void VSSetShaderResources(uint32_t start, uint32_t count, ID3D11ShaderResourceView* const* views) override { context->VSSetShaderResources(start, count, views); }
+    void PSSetShaderResources(uint32_t start, uint32_t count, ID3D11ShaderResourceView* const* views) override { context->PSSetShaderResources(start, count, views); }
+    void CSSetShaderResources(uint32_t start, uint32_t count, ID3D11ShaderResourceView* const* views) override { context->CSSetShaderResources(start, count, views); }
+    void PSSetSamplers(uint32_t start, uint32_t count, ID3D11SamplerState* const* samplers) override { context->PSSetSamplers(start, count, samplers); }
+    void CSSetUnorderedAccessViews(uint32_t start, uint32_t count, ID3D11UnorderedAccessView* const* views, const uint32_t* initialCounts) override
+    {
+        context->CSSetUnorderedAccessViews(start, count, views, initialCounts);
+    }
+    void OMSetRenderTargets(uint32_t count, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depth) override { context->OMSetRenderTargets(count, views, depth); }
+    void OMSetBlendState(ID3D11BlendState* state, const float factor[4], uint32_t mask) override { context->OMSetBlendState(state, factor, mask); }
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, uint32_t stencilRef) override { context->OMSetDepthStencilState(state, stencilRef); }
+    void RSSetState(ID3D11RasterizerState* state) override { context->RSSetState(state); }
+    void RSSetViewports(uint32_t count, const D3D11_VIEWPORT* viewports) override { context->RSSetViewports(count, viewports); }
+    void ClearState() override { context->ClearState(); }
+
+    void ClearRenderTargetView(ID3D11RenderTargetView* view, const float color[4]) override { context->ClearRenderTargetView(view, color); }
+    void ClearDepthStencilView(ID3D11DepthStencilView* view, uint32_t flags, float depth, uint8_t stencil) override { context->ClearDepthStencilView(view, flags, depth, stencil); }
+    void ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* view, const uint32_t values[4]) override { context->ClearUnorderedAccessViewUint(view, values); }
+    bool Map(ID3D11Resource* resource, uint32_t subresource, D3D11_MAP type, uint32_t flags, D3D11_MAPPED_SUBRESOURCE* mapped) override
+    {
+        return SUCCEEDED(context->Map(resource, subresource, type, flags, mapped));
+    }
+    void Unmap(ID3D11Resource* resource, uint32_t subresource) override { context->Unmap(resource, subresource); }
+    void UpdateSubresource(ID3D11Resource* resource, uint32_t subresource, const D3D11_BOX* box, const void* data, uint32_t rowPitch, uint32_t depthPitch) override
+    {
+        context->UpdateSubresource(resource, subresource, box, data, rowPitch, depthPitch);
+    }
+    void CopyResource(ID3D11Resource* dst, ID3D11Resource* src) override { context->CopyResource(dst, src); }
+
+    void Draw(uint32_t vertexCount, uint32_t startVertex) override { context->Draw(vertexCount, startVertex); }
+    void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex) override { context->DrawIndexed(indexCount, startIndex, baseVertex); }
+    void DrawIndexedInstancedIndirect(ID3D11Buffer* args, uint32_t offset) override { context->DrawIndexedInstancedIndirect(args, offset); }
+    void Dispatch(uint32_t x, uint32_t y, uint32_t z) override { context->Dispatch(x, y, z); }
+
+    void Begin(ID3D11Query* query) override { context->Begin(query); }
+    void End(ID3D11Query* query) override { context->End(query); }
+    bool GetData(ID3D11Query* query, void* data, uint32_t size, bool flush) override
+    {
+        return context->GetData(query, data, size, flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+    }
+    ID3D11CommandList* FinishCommandList() override
+    {
+        ID3D11CommandList* list = nullptr;
+        if (FAILED(context->FinishCommandList(FALSE, &list))) return nullptr;
+        return list;
+    }
+    void ExecuteCommandList(ID3D11CommandList* list) override { context->ExecuteCommandList(list, FALSE); }
+};
+
+// Фильтр привязок: графический конвейер кадра ставится через него, повторные привязки отбрасываются
+struct FrameContextApi : D3D11Types
+{
+    typedef FrameBackend Context;
+    static void VSSetShader(FrameBackend* context, ID3D11VertexShader* shader) { context->VSSetShader(shader); }
+    static void PSSetShader(FrameBackend* context, ID3D11PixelShader* shader) { context->PSSetShader(shader); }
+    // *SetConstantBuffers1 нет: RenderBackend повторяет только вызовы D3D11.0, окна у PassContext не собираются
+};
+typedef StateFilter<FrameContextApi> PassContext;
+UINT g_FrameBindsRequested = 0, g_FrameBindsIssued = 0;   // за последний кадр
+
+// Параллельная запись проходов: свой отложенный контекст и фильтр на проход, списки команд
+// исполняются на непосредственном контексте в порядке проходов (клавиша M - один поток / все ядра)
+enum RecordPass { RECORD_SKYBOX, RECORD_INSTANCED, RECORD_DEFERRED_LIGHTING, RECORD_BLOOM, RECORD_POSTPROCESS, RECORD_PASS_COUNT };
+struct FrameCommandApi
+{
+    typedef FrameBackend Context;
+    typedef ID3D11CommandList CommandList;
+    static ID3D11CommandList* Finish(FrameBackend* context) { return context->FinishCommandList(); }
+    static void Execute(FrameBackend* immediate, ID3D11CommandList* list) { immediate->ExecuteCommandList(list); }
+    static void Release(ID3D11CommandList* list) { list->Release(); }
+};
+PassRecorder<FrameCommandApi> g_PassRecorder;
+PassContext g_PassFilters[RECORD_PASS_COUNT];
+bool g_UseParallelRecording = true;
+UINT g_RecordThreads = 1;
+double g_RecordMs = 0.0;       // запись всех проходов, по часам
+double g_RecordCpuMs = 0.0;    // сумма по проходам
+
+// Бэкенд кадра (клавиша N): D3D11 или пустой. Пустой проходит весь кадр на CPU без GPU
+// и без Present - так видна цена самой отправки. Проходы пишут в свои бэкенды.
+D3D11Backend g_D3DImmediate;
+D3D11Backend g_D3DPassBackends[RECORD_PASS_COUNT];
+NullBackend<D3D11Types> g_NullImmediate;
+NullBackend<D3D11Types> g_NullPassBackends[RECORD_PASS_COUNT];
+FrameBackend* g_pFrame = &g_D3DImmediate;
+bool g_UseNullBackend = false;
+double g_FrameCpuMs = 0.0;     // кадр на CPU до Present
+double g_FrameGpuMs = 0.0;     // кадр на GPU: от первой до последней команды (TIMESTAMP), 0 - нет данных
+UINT g_FrameBackendCalls = 0;  // вызовов пустого бэкенда за последний кадр
+
+NullBackendStats NullBackendTotals()
+{
+    NullBackendStats total = g_NullImmediate.stats;
+    for (UINT p = 0; p < RECORD_PASS_COUNT; ++p) total.Add(g_NullPassBackends[p].stats);
+    return total;
+}
+
+// Данные кадра, которые проходы только читают во время записи
+struct FrameSetup
+{
+    XMMATRIX viewProj;
+    XMMATRIX vpSky;
+    ID3D11RenderTargetView* sceneTarget;
+    D3D11_VIEWPORT viewport;
+    ID3D11DepthStencilState* dsSky;
+    ID3D11PixelShader* skyboxPS;      // варианты, выбранные на кадр
+    ID3D11PixelShader* instancedPS;   // в отложенном режиме - вариант gbufferPS
+    ID3D11PixelShader* deferredPS;
+    bool deferred;                    // граф собран с G-буфером
+    ID3D11RenderTargetView* gbufferTargets[2];   // GBufferAlbedo, GBufferNormal
+    ID3D11ShaderResourceView* gbufferViews[2];
+    ID3D11PixelShader* filterPS;      // вариант прохода POSTPROCESS
+    D3D11_VIEWPORT outputViewport;    // back buffer; viewport - область рендера в цели сцены
+    XMFLOAT2 sceneUvMax;              // центр последнего текселя области рендера в SceneColor
+    UINT bloomLevels;                 // 0 - свечение выключено
+    ID3D11RenderTargetView* bloomTargets[BLOOM_MAX_LEVELS];
+    ID3D11ShaderResourceView* bloomViews[BLOOM_MAX_LEVELS];
+    D3D11_VIEWPORT bloomViewports[BLOOM_MAX_LEVELS];   // области уровней, цели - под полный кадр
+    XMFLOAT2 bloomUvMax[BLOOM_MAX_LEVELS];
+    XMFLOAT4 bloomSettings;           // x = threshold, y = knee, z = intensity
+    float bloomScatter;
+};
+const FLOAT g_ClearColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+
+StateFilterStats PassBindTotals()
+{
+    StateFilterStats total;
+    for (UINT p = 0; p < RECORD_PASS_COUNT; ++p)
+    {
+        total.requested += g_PassFilters[p].stats.requested;
+        total.issued += g_PassFilters[p].stats.issued;
+    }
+    return total;
+}
+
 UINT g_ClientWidth = 1280;
 UINT g_ClientHeight = 720;
 
+// Регулятор бюджета кадра (FrameGovernor.h). Цели сцены, G-буфер, глубина и уровни свечения
+// выделены под размер окна, сцена рисуется в их левый верхний угол, проход POSTPROCESS растягивает
+// его на экран - смена разрешения стоит только viewport, без пересоздания текстур
+bool g_UseGovernor = false;    // R
+FrameGovernor g_Governor;
+UINT g_RenderWidth = 1280;     // область рендера этого кадра
+UINT g_RenderHeight = 720;
+
 // Управление камерой
 float g_CameraYaw = 0.0f;
 float g_CameraPitch = 0.3f;
@@ -241,17 +498,54 @@ struct GeomBuffer
     XMFLOAT4 shineSpeedTexIdNM; // x=shininess, y=rot speed, z=texture id, w=normal map presence
     XMFLOAT4 angle; // xyz=position, w=current angle
 };
-ID3D11Buffer* g_pGeomBufferInst = nullptr;      // массив данных экземпляров
+
+// Кадры в полёте: данные, которые CPU пишет каждый кадр, запросы и копии статистики - по слоту на кадр.
+// Динамические буферы слота пишутся через Map(WRITE_DISCARD), когда GPU уже закончил прошлый кадр слота.
+const UINT FRAMES_IN_FLIGHT = 3;
+struct FrameResources
+{
+    ID3D11Buffer* geomInst = nullptr;         // массив данных экземпляров
+    ID3D11Buffer* cullParams = nullptr;       // AABB экземпляров для culling
+    ID3D11Buffer* frustumPlanes = nullptr;
+    ID3D11Query* fence = nullptr;             // D3D11_QUERY_EVENT после всех команд кадра
+    ID3D11Query* stats = nullptr;             // pipeline statistics
+    ID3D11Query* timeDisjoint = nullptr;      // частота счётчика и признак его сбоя
+    ID3D11Query* timeStart = nullptr;         // TIMESTAMP до и после команд кадра
+    ID3D11Query* timeEnd = nullptr;
+    ID3D11Buffer* argsStaging[2] = {};        // копии indirect args обеих фаз для статистики
+    UINT argsStagingPhases = 0;
+    ID3D11Buffer* visibilityStaging = nullptr; // копия истории видимости после culling кадра
+    UINT lightFrustum[(MAX_INSTANCES + 31) / 32] = {}; // экземпляры в фрустуме при расчёте списков источников
+    bool lightFrustumValid = false;
+};
+FrameResources g_FrameResources[FRAMES_IN_FLIGHT];
+UINT g_FrameSlot = 0;                          // слот кадра, который сейчас готовит CPU
 ID3D11Buffer* g_pVisibleIdsBuffer = nullptr;   // буфер видимых ID (uint4)
 GeomBuffer g_Instances[MAX_INSTANCES];
 UINT g_InstanceCount = 0;
+UINT g_InstanceMesh[MAX_INSTANCES];            // мэш экземпляра (индекс в g_Meshes)
+MeshLodChain g_Meshes[MESH_COUNT];              // диапазоны индексов LOD в общих VB/IB
+ID3D11Buffer* g_pInstanceIndexVB = nullptr;     // 0..MAX_INSTANCES-1 per-instance: учитывает StartInstanceLocation
 XMVECTOR g_LocalAABBMin = XMVectorSet(-0.5f, -0.5f, -0.5f, 1.0f);
 XMVECTOR g_LocalAABBMax = XMVectorSet(0.5f, 0.5f, 0.5f, 1.0f);
 
-// Шейдеры для instanced
+// Шейдеры для instanced (пиксельный - варианты IPS_*)
 ID3D11VertexShader* g_pInstancedVS = nullptr;
-ID3D11PixelShader* g_pInstancedPS = nullptr;
+ShaderVariants<ID3D11PixelShader> g_InstancedPSVariants;
 ID3D11InputLayout* g_pInstancedInputLayout = nullptr;
+enum InstancedPSFeature { IPS_NORMAL_MAP, IPS_PER_OBJECT_LIGHTS, IPS_LIGHT_BUCKET, IPS_GRAYSCALE };
+// Корзины числа источников на пиксель: без цикла, развёрнутый цикл до INSTANCE_LIGHT_K, обычный цикл
+enum LightBucket { LIGHT_BUCKET_NONE, LIGHT_BUCKET_SMALL, LIGHT_BUCKET_ANY, LIGHT_BUCKET_COUNT };
+bool g_UseNormalMap = false;   // B: карта нормалей у экземпляров, которым она назначена
+UINT g_InstancedPSKey = ~0u;   // вариант прошлого кадра, для лога смены
+
+// Отложенное освещение (клавиша D): проход экземпляров пишет G-буфер (DeferredShading.h),
+// источники перебирает полноэкранный проход по спискам кластеров - один раз на видимый пиксель
+ShaderVariants<ID3D11PixelShader> g_GBufferPSVariants;
+ShaderVariants<ID3D11PixelShader> g_DeferredPSVariants;
+enum GBufferPSFeature { GPS_NORMAL_MAP };
+enum DeferredPSFeature { DPS_LIGHT_BUCKET, DPS_GRAYSCALE };
+bool g_UseDeferred = false;
 
 // Массив текстур
 ID3D11ShaderResourceView* g_pTextureArrayView = nullptr;
@@ -259,12 +553,69 @@ ID3D11ShaderResourceView* g_pTextureArrayView = nullptr;
 // ------------------------------------------------------------------
 // Постпроцессинг
 // ------------------------------------------------------------------
-ID3D11Texture2D* g_pColorBuffer = nullptr;
-ID3D11RenderTargetView* g_pColorBufferRTV = nullptr;
-ID3D11ShaderResourceView* g_pColorBufferSRV = nullptr;
 bool g_UseFilter = true;   // включен фильтр (оттенки серого)
+bool g_FuseGrayscale = true;   // G: серый считают шейдеры сцены, проход фильтра и SceneColor отсекаются графом
+bool g_UseBloom = false;       // H: свечение (Bloom.h), [ и ] - радиус
+BloomSettings g_Bloom;
+
+// Свечение складывается со сценой до фильтра, поэтому с ним серый остаётся проходу фильтра
+bool FusedGrayscale() { return g_UseFilter && g_FuseGrayscale && !g_UseBloom; }
+
+// Граф кадра: проходы в порядке RecordPass, временные цели берутся из пула графа.
+// Пересобирается при смене размера окна.
+struct TransientTexture
+{
+    ID3D11Texture2D* texture = nullptr;
+    ID3D11RenderTargetView* rtv = nullptr;
+    ID3D11ShaderResourceView* srv = nullptr;
+};
+RenderGraph g_RenderGraph;
+std::vector<TransientTexture> g_TransientTextures;   // по текстуре на физический слот графа
+uint32_t g_rgSceneColor = RenderGraph::INVALID;       // цель сцены перед фильтром
+uint32_t g_rgGBufferAlbedo = RenderGraph::INVALID;    // G-буфер отложенного режима
+uint32_t g_rgGBufferNormal = RenderGraph::INVALID;
+bool g_RenderGraphDirty = true;
 ID3D11VertexShader* g_pFilterVS = nullptr;
-ID3D11PixelShader* g_pFilterPS = nullptr;
+ShaderVariants<ID3D11PixelShader> g_FilterPSVariants;
+enum FilterPSFeature { FPS_GRAYSCALE, FPS_BLOOM };
+
+// Пирамида свечения: уровни - временные цели графа RGBA16F, уровень 0 - половина кадра.
+// Спуск - bloomDownPS (на уровне 0 с порогом), подъём - bloomUpPS со смешиванием в цель
+ShaderVariants<ID3D11PixelShader> g_BloomDownPSVariants;
+enum BloomDownPSFeature { BDS_PREFILTER };
+ID3D11PixelShader* g_pBloomUpPS = nullptr;
+struct BloomParams
+{
+    XMFLOAT4 params;   // x = threshold, y = knee, z = intensity
+    XMFLOAT4 source;   // xy - предел uv источника (центр последнего текселя области кадра), zw - то же для уровня 0 в filterPS
+    XMFLOAT4 scene;    // xy - доля SceneColor, занятая областью рендера
+};
+ID3D11Buffer* g_pBloomParamsCB = nullptr;
+ID3D11SamplerState* g_pLinearClampSampler = nullptr;
+ID3D11BlendState* g_pBloomBlend = nullptr;   // цель = up * factor + цель * (1 - factor), factor = scatter
+uint32_t g_rgBloom[BLOOM_MAX_LEVELS] = {};
+UINT g_BloomLevels = 0;
+
+// ------------------------------------------------------------------
+// Дисковый кэш байткода шейдеров: shader_cache\ рядом с exe
+// ------------------------------------------------------------------
+ShaderCache g_ShaderCache;
+
+struct ShaderBlobApi
+{
+    typedef ID3DBlob Blob;
+    static void Release(ID3DBlob* blob) { blob->Release(); }
+};
+typedef ShaderJobBatch<ShaderBlobApi> ShaderBatch;
+
+// ------------------------------------------------------------------
+// Программный растеризатор: P - текущий вид без GPU в frame_sw.tga
+// ------------------------------------------------------------------
+SwScene g_SwScene;                 // CPU-копии геометрии, текстур (mip 0) и источников
+SoftRasterizer g_SoftRasterizer;
+bool g_SwCaptureRequested = false;
+BloomPyramid g_SwBloom;            // свечение кадра на CPU
+std::vector<float> g_SwBloomColor; // сцена + свечение, RGBA32F
 
 // ------------------------------------------------------------------
 // GPU Frustum Culling
@@ -276,8 +627,6 @@ ID3D11UnorderedAccessView* g_pIndirectArgsUAVView = nullptr;
 ID3D11Buffer* g_pVisibleIdsStructured = nullptr;
 ID3D11UnorderedAccessView* g_pVisibleIdsUAV = nullptr;
 ID3D11ShaderResourceView* g_pVisibleIdsSRV = nullptr;
-ID3D11Buffer* g_pCullParamsCB = nullptr;
-ID3D11Buffer* g_pFrustumPlanesCB = nullptr;
 
 struct CullParams {
     UINT   numInstances;
@@ -287,10 +636,124 @@ struct CullParams {
 };
 CullParams g_cullParams;
 
-ID3D11Query* g_pQueries[10] = {};
-UINT         g_curFrame = 0;
-UINT         g_lastCompletedFrame = 0;
+// ------------------------------------------------------------------
+// Двухфазный occlusion culling (Hi-Z по глубине фазы 1)
+// ------------------------------------------------------------------
+ID3D11ShaderResourceView* g_pDepthSRV = nullptr;
+ID3D11Texture2D* g_pHiZTexture = nullptr;
+ID3D11ShaderResourceView* g_pHiZSRV = nullptr;                 // все мипы, для cullCS
+std::vector<ID3D11ShaderResourceView*> g_HiZMipSRVs;          // по одному мипу, источник при построении
+std::vector<ID3D11UnorderedAccessView*> g_HiZMipUAVs;         // по одному мипу, приёмник при построении
+UINT g_HiZMipCount = 0;
+ID3D11ComputeShader* g_pHiZCS = nullptr;
+ID3D11Buffer* g_pHiZParamsCB = nullptr;
+ID3D11Buffer* g_pOcclusionParamsCB = nullptr;
+ID3D11Buffer* g_pVisibilityHistory = nullptr;                 // бит на экземпляр, видимость прошлого кадра
+ID3D11UnorderedAccessView* g_pVisibilityHistoryUAV = nullptr;
+bool g_UseOcclusion = true;
+
+struct HiZParams { UINT srcW, srcH, dstW, dstH; UINT copyLevel; UINT padding[3]; };
+struct OcclusionParams
+{
+    XMMATRIX vp;
+    UINT phase;        // 0 - только фрустум, 1 - видимые в прошлом кадре, 2 - тест по Hi-Z
+    UINT hizMipCount;
+    XMFLOAT2 hizSize;
+    XMFLOAT4 minPixelArea; // порог площади проекции (px^2) по мэшам, 0 - не отсекать
+    XMFLOAT4 detail;       // x - множитель экранного размера при выборе LOD (регулятор кадра)
+};
+OcclusionParams g_occlusionParams;
+
+// Отсечение мелких экземпляров (порог на категорию = мэш)
+bool g_UseContributionCulling = true;
+float g_ContributionMinArea[MESH_COUNT] = { 2.0f, 4.0f };
+int g_gpuContributionCulled = 0;
+int g_gpuContributionCulledVerts = 0;
+
+// Кластеры (meshlets) LOD0 сферы: индексы LOD0 в IB лежат в порядке кластеров,
+// CPU-проход отсекает кластеры вне фрустума и повёрнутые от камеры.
+// Клавиша K: сферы уходят из корзин GPU-отбора и рисуются LOD0 по выжившим диапазонам -
+// косвенная отрисовка на диапазон, экземпляр через StartInstanceLocation, как у корзин
+MeshletMesh g_SphereMeshlets;
+std::vector<IndirectDrawArgs> g_MeshletDraws;
+XMUINT4 g_MeshletInstanceIds[MAX_INSTANCES];    // слот StartInstanceLocation -> (экземпляр, корзина), как visibleIds
+MeshletCullStats g_MeshletStats;
+ID3D11Buffer* g_pMeshletArgs = nullptr;         // аргументы отрисовки диапазонов, до MAX_INSTANCES * кластеров
+ID3D11Buffer* g_pMeshletIds = nullptr;
+ID3D11ShaderResourceView* g_pMeshletIdsSRV = nullptr;
+bool g_UseMeshletDraws = false;    // K
+
+// ------------------------------------------------------------------
+// Кластерное освещение: источники в structured buffer, списки по кластерам строятся на CPU каждый кадр
+// ------------------------------------------------------------------
+const UINT SCENE_LIGHT_COUNT = 2048;
+std::vector<PointLight> g_Lights;
+LightClusters g_LightClusters;
+bool g_ClusterBoundsDirty = true;
+UINT g_LightBinThreads = 1;
+double g_LightBinMs = 0.0;
+ID3D11Buffer* g_pLightsBuffer = nullptr;
+ID3D11ShaderResourceView* g_pLightsSRV = nullptr;
+ID3D11Buffer* g_pClusterRangesBuffer = nullptr;       // uint2 (смещение, число) на кластер
+ID3D11ShaderResourceView* g_pClusterRangesSRV = nullptr;
+ID3D11Buffer* g_pClusterIndicesBuffer = nullptr;      // индексы источников всех кластеров
+ID3D11ShaderResourceView* g_pClusterIndicesSRV = nullptr;
+UINT g_ClusterIndexCapacity = 0;
+ID3D11Buffer* g_pClusterParamsCB = nullptr;
+
+// Списки источников на экземпляр: до INSTANCE_LIGHT_K источников на видимый экземпляр (переключается клавишей L).
+// Сетка источников строится один раз - источники неподвижны.
+// Видимость берётся у GPU: списки считаются до culling своего кадра, поэтому пропускаются экземпляры,
+// которые GPU счёл перекрытыми в последнем прочитанном кадре (был в фрустуме, но не прошёл Hi-Z/вклад).
+// Открывшийся экземпляр несколько кадров (кадры в полёте) рисуется со списком, посчитанным раньше.
+LightGrid g_LightGrid;
+InstanceLightLists g_InstanceLightLists;
+AABBSoA g_InstanceLightBoxes;
+UINT g_GpuOccluded[(MAX_INSTANCES + 31) / 32] = {};
+bool g_UsePerObjectLights = false;
+double g_InstanceLightMs = 0.0;
+ID3D11Buffer* g_pInstanceLightsBuffer = nullptr;      // (K + 1) uint на экземпляр: число, затем индексы
+ID3D11ShaderResourceView* g_pInstanceLightsSRV = nullptr;
+
+struct ClusterParams
+{
+    XMUINT4 grid;       // размер сетки кластеров
+    XMFLOAT4 depth;     // x = near, y = far, z = Z / log(far / near)
+    XMFLOAT4 screen;    // размер цели рендера в пикселях
+};
+
+// ------------------------------------------------------------------
+// LOD и раскладка по корзинам (mesh, LOD)
+// ------------------------------------------------------------------
+ID3D11ComputeShader* g_pBatchArgsCS = nullptr;
+ID3D11ComputeShader* g_pScatterCS = nullptr;
+ID3D11Buffer* g_pLodParamsCB = nullptr;
+ID3D11Buffer* g_pInstanceBuckets = nullptr;                  // корзина каждого экземпляра (~0 - отсечён)
+ID3D11UnorderedAccessView* g_pInstanceBucketsUAV = nullptr;
+ID3D11Buffer* g_pGroupBucketOffsets = nullptr;               // счётчики/смещения групп по 64 экземпляра в корзинах
+ID3D11UnorderedAccessView* g_pGroupBucketOffsetsUAV = nullptr;
+
+struct LodParams
+{
+    XMUINT4 lodRanges[LOD_BUCKETS];       // x=indexCount, y=startIndex, z=baseVertex, w=lodCount мэша
+    XMFLOAT4 lodScreenSizes[MESH_COUNT];  // мин. экранный размер (px) для LOD 0..3
+};
+
+struct FrameFenceApi
+{
+    typedef FrameBackend Context;
+    typedef ID3D11Query Fence;
+    static void Signal(FrameBackend* context, ID3D11Query* fence) { context->End(fence); }
+    static bool IsComplete(FrameBackend* context, ID3D11Query* fence) { return context->GetData(fence, nullptr, 0, false); }
+    static void Wait(FrameBackend* context, ID3D11Query* fence)
+    {
+        while (!context->GetData(fence, nullptr, 0, true)) std::this_thread::yield();
+    }
+};
+FramePipeline<FrameFenceApi> g_FramePipeline;
 int          g_gpuVisibleInstances = 0;
+int          g_gpuVisibleTriangles = 0;
+int          g_gpuBatchDraws = 0;
 bool         g_useGPUculling = true;
 
 // ------------------------------------------------------------------
@@ -299,15 +762,34 @@ bool         g_useGPUculling = true;
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 bool InitDirectX();
 void CreateCubeResources();
+MeshLod AppendSphereLod(std::vector<TextureNormalTangentVertex>& vertices, std::vector<USHORT>& indices, UINT slices, UINT stacks);
+void BuildSphereMeshlets(const std::vector<TextureNormalTangentVertex>& vertices, std::vector<USHORT>& indices, const MeshLod& lod);
+void CullSphereMeshlets(const XMMATRIX& vp, const XMFLOAT3& eye);
 void CompileShaders();
 void LoadTextures();
 void LoadTextureArray();
 void CreateInstances();
+void CreateLights();
+bool EnsureClusterIndexCapacity(UINT count);
+void UpdateLightClusters(const XMMATRIX& view, const XMMATRIX& proj, float nearZ, float farZ);
+void UpdateInstanceLights(const XMMATRIX& vp);
 void CleanupDirectX();
 void RenderFrame();
 void OnResize(UINT newWidth, UINT newHeight);
 void UpdateCamera(double deltaTime);
-void SetupColorBuffer(UINT width, UINT height);
+void BuildRenderGraph(UINT width, UINT height);
+bool SetupDepthBuffer(UINT width, UINT height);
+void SetupHiZ(UINT width, UINT height);
+void BuildHiZ(PassContext& pass, UINT targetCount, ID3D11RenderTargetView* const* targets);
+void RunCullPhase(PassContext& pass, UINT phase);
+void DrawCulledInstances(PassContext& pass);
+void DrawSphereMeshlets(PassContext& pass);
+void RecordSkyboxPass(PassContext& pass, const FrameSetup& frame);
+void RecordInstancedPass(PassContext& pass, const FrameSetup& frame);
+void RecordDeferredLightingPass(PassContext& pass, const FrameSetup& frame);
+void RecordBloomPass(PassContext& pass, const FrameSetup& frame);
+void RecordPostProcessPass(PassContext& pass, const FrameSetup& frame);
+void CaptureSoftwareFrame(const FrameSetup& frame, const XMFLOAT3& eye);
 void BuildFrustumPlanes(const XMMATRIX& vp, XMVECTOR planes[6]);
 void TransformAABB(const XMMATRIX& transform, const XMVECTOR& localMin, const XMVECTOR& localMax, XMVECTOR& worldMin, XMVECTOR& worldMax);
 bool IsAABBInsideFrustum(const XMVECTOR planes[6], const XMVECTOR& aabbMin, const XMVECTOR& aabbMax);
@@ -353,7 +835,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     LoadTextures();
     LoadTextureArray();
     CreateInstances();
-    SetupColorBuffer(g_ClientWidth, g_ClientHeight);
+    CreateLights();
     CreateGPUResources();
 
     // Создание константных буферов
@@ -378,13 +860,17 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     if (FAILED(hr)) { char buf[256]; sprintf_s(buf, "CreateBuffer(SceneBuffer) failed: 0x%08X", (unsigned)hr); MessageBoxA(NULL, buf, "Error", MB_OK | MB_ICONERROR); CleanupDirectX(); DestroyWindow(g_hWnd); return -1; }
 
     desc.ByteWidth = sizeof(GeomBuffer) * MAX_INSTANCES;
-    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
     desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    desc.CPUAccessFlags = 0; // ensure no CPU access for DEFAULT usage
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     desc.MiscFlags = 0;
     desc.StructureByteStride = 0;
-    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pGeomBufferInst);
-    if (FAILED(hr)) { char buf[256]; sprintf_s(buf, "CreateBuffer(GeomBufferInst) failed: 0x%08X", (unsigned)hr); MessageBoxA(NULL, buf, "Error", MB_OK | MB_ICONERROR); CleanupDirectX(); DestroyWindow(g_hWnd); return -1; }
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_FrameResources[i].geomInst);
+        if (FAILED(hr)) { char buf[256]; sprintf_s(buf, "CreateBuffer(GeomBufferInst) failed: 0x%08X", (unsigned)hr); MessageBoxA(NULL, buf, "Error", MB_OK | MB_ICONERROR); CleanupDirectX(); DestroyWindow(g_hWnd); return -1; }
+        SetResourceName(g_FrameResources[i].geomInst, "GeomBufferInst");
+    }
 
     desc.ByteWidth = sizeof(XMUINT4) * MAX_INSTANCES;
     desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -396,7 +882,6 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE, _In_ LPWSTR, _
     SetResourceName(g_pModelBuffer2, "ModelBuffer2");
     SetResourceName(g_pViewProjBuffer, "ViewProjBuffer");
     SetResourceName(g_pSceneBuffer, "SceneBuffer");
-    SetResourceName(g_pGeomBufferInst, "GeomBufferInst");
     SetResourceName(g_pVisibleIdsBuffer, "VisibleIdsBuffer");
 
     g_LastTime = (double)GetTickCount64() / 1000.0;
@@ -438,6 +923,20 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         if (wParam == VK_RIGHT) g_KeyRight = true;
         if (wParam == VK_UP)    g_KeyUp = true;
         if (wParam == VK_DOWN)  g_KeyDown = true;
+        if (wParam == 'O')      g_UseOcclusion = !g_UseOcclusion;
+        if (wParam == 'C')      g_UseContributionCulling = !g_UseContributionCulling;
+        if (wParam == 'L')      g_UsePerObjectLights = !g_UsePerObjectLights;
+        if (wParam == 'M')      g_UseParallelRecording = !g_UseParallelRecording;
+        if (wParam == 'P')      g_SwCaptureRequested = true;
+        if (wParam == 'N')      g_UseNullBackend = !g_UseNullBackend;
+        if (wParam == 'B')      g_UseNormalMap = !g_UseNormalMap;
+        if (wParam == 'G')      { g_FuseGrayscale = !g_FuseGrayscale; g_RenderGraphDirty = true; }
+        if (wParam == 'D')      { g_UseDeferred = !g_UseDeferred; g_RenderGraphDirty = true; }
+        if (wParam == 'H')      { g_UseBloom = !g_UseBloom; g_RenderGraphDirty = true; }
+        if (wParam == 'R')      { g_UseGovernor = !g_UseGovernor; g_Governor.Reset(); g_RenderGraphDirty = true; }
+        if (wParam == 'K')      { g_UseMeshletDraws = !g_UseMeshletDraws; g_MeshletDraws.clear(); g_MeshletStats = MeshletCullStats(); }
+        if (wParam == VK_OEM_4) g_Bloom.scatter = (std::max)(g_Bloom.scatter - 0.1f, 0.0f);
+        if (wParam == VK_OEM_6) g_Bloom.scatter = (std::min)(g_Bloom.scatter + 0.1f, 1.0f);
         return 0;
     case WM_KEYUP:
         if (wParam == VK_LEFT)  g_KeyLeft = false;
@@ -495,6 +994,18 @@ bool InitDirectX()
     pSelectedAdapter->Release();
     if (FAILED(hr) || obtainedLevel != D3D_FEATURE_LEVEL_11_0) { pFactory->Release(); return false; }
 
+    // Отложенные контексты проходов
+    g_D3DImmediate.context = g_pDeviceContext;
+    g_PassRecorder.slots.resize(RECORD_PASS_COUNT);
+    for (UINT p = 0; p < RECORD_PASS_COUNT; ++p)
+    {
+        hr = g_pDevice->CreateDeferredContext(0, &g_D3DPassBackends[p].context);
+        if (FAILED(hr)) { pFactory->Release(); return false; }
+        g_PassRecorder.slots[p].context = &g_D3DPassBackends[p];
+        g_PassFilters[p].context = &g_D3DPassBackends[p];
+    }
+    g_RecordThreads = (std::max)(1u, std::thread::hardware_concurrency());
+
     DXGI_SWAP_CHAIN_DESC scd = {};
     scd.BufferCount = 2;
     scd.BufferDesc.Width = g_ClientWidth;
@@ -516,22 +1027,7 @@ bool InitDirectX()
     hr = g_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&pBackBuffer);
     if (FAILED(hr)) return false;
 
-    D3D11_TEXTURE2D_DESC depthDesc = {};
-    depthDesc.Width = g_ClientWidth;
-    depthDesc.Height = g_ClientHeight;
-    depthDesc.MipLevels = 1;
-    depthDesc.ArraySize = 1;
-    depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
-    depthDesc.SampleDesc.Count = 1;
-    depthDesc.SampleDesc.Quality = 0;
-    depthDesc.Usage = D3D11_USAGE_DEFAULT;
-    depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-    ID3D11Texture2D* pDepthStencil = nullptr;
-    hr = g_pDevice->CreateTexture2D(&depthDesc, nullptr, &pDepthStencil);
-    if (FAILED(hr)) return false;
-    hr = g_pDevice->CreateDepthStencilView(pDepthStencil, nullptr, &g_pDepthStencilView);
-    pDepthStencil->Release();
-    if (FAILED(hr)) return false;
+    if (!SetupDepthBuffer(g_ClientWidth, g_ClientHeight)) { pBackBuffer->Release(); return false; }
 
     hr = g_pDevice->CreateRenderTargetView(pBackBuffer, nullptr, &g_pBackBufferRTV);
     pBackBuffer->Release();
@@ -540,7 +1036,64 @@ bool InitDirectX()
 }
 
 // ------------------------------------------------------------------
-// Создание геометрии (куб + skybox)
+// Сфера радиуса 0.5 (вписана в тот же AABB, что и куб), один LOD
+// ------------------------------------------------------------------
+MeshLod AppendSphereLod(std::vector<TextureNormalTangentVertex>& vertices, std::vector<USHORT>& indices, UINT slices, UINT stacks)
+{
+    MeshLod lod;
+    lod.startIndex = (UINT32)indices.size();
+    lod.baseVertex = (INT32)vertices.size();
+    for (UINT i = 0; i <= stacks; ++i)
+    {
+        float theta = XM_PI * i / stacks;
+        for (UINT j = 0; j <= slices; ++j)
+        {
+            float phi = XM_2PI * j / slices;
+            XMFLOAT3 n(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            TextureNormalTangentVertex v;
+            v.pos = XMFLOAT3(n.x * 0.5f, n.y * 0.5f, n.z * 0.5f);
+            v.normal = n;
+            v.tangent = XMFLOAT3(-sinf(phi), 0.0f, cosf(phi));
+            v.uv = XMFLOAT2((float)j / slices, (float)i / stacks);
+            vertices.push_back(v);
+        }
+    }
+    // Обход по часовой стрелке снаружи, как у куба
+    for (UINT i = 0; i < stacks; ++i)
+    {
+        for (UINT j = 0; j < slices; ++j)
+        {
+            USHORT a = (USHORT)(i * (slices + 1) + j), b = (USHORT)(a + 1);
+            USHORT c = (USHORT)(a + slices + 1), d = (USHORT)(c + 1);
+            USHORT quad[] = { a, b, d, a, d, c };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    lod.indexCount = (UINT32)indices.size() - lod.startIndex;
+    return lod;
+}
+
+// Разбивает LOD на кластеры и переписывает его индексы в порядке кластеров:
+// каждый кластер становится непрерывным диапазоном IB
+void BuildSphereMeshlets(const std::vector<TextureNormalTangentVertex>& vertices, std::vector<USHORT>& indices, const MeshLod& lod)
+{
+    std::vector<Float3> positions;
+    for (size_t v = lod.baseVertex; v < vertices.size(); ++v)
+        positions.push_back(MakeFloat3(vertices[v].pos.x, vertices[v].pos.y, vertices[v].pos.z));
+    std::vector<uint32_t> lodIndices(indices.begin() + lod.startIndex, indices.begin() + lod.startIndex + lod.indexCount);
+    BuildMeshlets(g_SphereMeshlets, lodIndices.data(), (uint32_t)lodIndices.size(), positions.data(), (uint32_t)positions.size());
+
+    std::vector<uint32_t> ordered = BuildMeshletIndexBuffer(g_SphereMeshlets);
+    for (size_t i = 0; i < ordered.size(); ++i)
+        indices[lod.startIndex + i] = (USHORT)ordered[i];
+
+    char buf[128];
+    sprintf_s(buf, "Sphere LOD0: %u triangles -> %u meshlets\n", g_SphereMeshlets.TriangleCount(), (UINT)g_SphereMeshlets.meshlets.size());
+    OutputDebugStringA(buf);
+}
+
+// ------------------------------------------------------------------
+// Создание геометрии (куб, сфера с LOD, skybox)
 // ------------------------------------------------------------------
 void CreateCubeResources()
 {
@@ -580,21 +1133,53 @@ void CreateCubeResources()
          0,  2,  1,  0,  3,  2,  4,  5,  6,  4,  6,  7,  8, 10,  9,  8, 11, 10,
         12, 14, 13, 12, 15, 14, 16, 18, 17, 16, 19, 18, 20, 22, 21, 20, 23, 22
     };
+
+    // Все мэши лежат в общих VB/IB, LOD задаётся диапазоном индексов и baseVertex
+    std::vector<TextureNormalTangentVertex> vertices(cubeVertices, cubeVertices + _countof(cubeVertices));
+    std::vector<USHORT> indices(cubeIndices, cubeIndices + _countof(cubeIndices));
+    g_Meshes[0].lodCount = 1;
+    g_Meshes[0].lods[0] = { (UINT32)_countof(cubeIndices), 0, 0 };
+
+    g_Meshes[1].lodCount = 3;
+    g_Meshes[1].lods[0] = AppendSphereLod(vertices, indices, 32, 16);
+    BuildSphereMeshlets(vertices, indices, g_Meshes[1].lods[0]);
+    g_Meshes[1].lods[1] = AppendSphereLod(vertices, indices, 16, 8);
+    g_Meshes[1].lods[2] = AppendSphereLod(vertices, indices, 8, 4);
+    g_Meshes[1].minScreenSize[0] = 200.0f;
+    g_Meshes[1].minScreenSize[1] = 60.0f;
+
+    // Копия для программного растеризатора: раскладка вершины та же
+    static_assert(sizeof(SwVertex) == sizeof(TextureNormalTangentVertex), "SwVertex layout");
+    g_SwScene.vertices.resize(vertices.size());
+    memcpy(g_SwScene.vertices.data(), vertices.data(), vertices.size() * sizeof(TextureNormalTangentVertex));
+    g_SwScene.indices.assign(indices.begin(), indices.end());
+
     D3D11_BUFFER_DESC desc = {};
-    desc.ByteWidth = sizeof(cubeVertices);
+    desc.ByteWidth = (UINT)(vertices.size() * sizeof(TextureNormalTangentVertex));
     desc.Usage = D3D11_USAGE_IMMUTABLE;
     desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    D3D11_SUBRESOURCE_DATA data = { cubeVertices };
+    D3D11_SUBRESOURCE_DATA data = { vertices.data() };
     HRESULT hr = g_pDevice->CreateBuffer(&desc, &data, &g_pVertexBuffer);
     if (FAILED(hr)) { OutputDebugStringA("CreateBuffer failed\n"); return; }
-    SetResourceName(g_pVertexBuffer, "CubeVertexBuffer");
+    SetResourceName(g_pVertexBuffer, "MeshVertexBuffer");
 
-    desc.ByteWidth = sizeof(cubeIndices);
+    desc.ByteWidth = (UINT)(indices.size() * sizeof(USHORT));
     desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    data.pSysMem = cubeIndices;
+    data.pSysMem = indices.data();
     hr = g_pDevice->CreateBuffer(&desc, &data, &g_pIndexBuffer);
     if (FAILED(hr)) { OutputDebugStringA("CreateBuffer failed\n"); return; }
-    SetResourceName(g_pIndexBuffer, "CubeIndexBuffer");
+    SetResourceName(g_pIndexBuffer, "MeshIndexBuffer");
+
+    // Номер экземпляра для instanced VS: per-instance данные смещаются на StartInstanceLocation,
+    // поэтому каждая корзина читает свой диапазон visibleIds (SV_InstanceID всегда с нуля)
+    UINT instanceIndices[MAX_INSTANCES];
+    for (UINT i = 0; i < MAX_INSTANCES; ++i) instanceIndices[i] = i;
+    desc.ByteWidth = sizeof(instanceIndices);
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    data.pSysMem = instanceIndices;
+    hr = g_pDevice->CreateBuffer(&desc, &data, &g_pInstanceIndexVB);
+    if (FAILED(hr)) { OutputDebugStringA("CreateBuffer failed\n"); return; }
+    SetResourceName(g_pInstanceIndexVB, "InstanceIndexVB");
 
     // Skybox
     const TexturedVertex skyboxVertices[] = {
@@ -625,8 +1210,32 @@ void CreateCubeResources()
 // ------------------------------------------------------------------
 // Компиляция шейдеров (добавлены instanced и фильтр)
 // ------------------------------------------------------------------
+// D3DCompile через дисковый кэш: при попадании компилятор не вызывается
+HRESULT CompileCached(const char* code, size_t size, const char* entry, const char* target, UINT flags, ID3DBlob** ppCode, ID3DBlob** ppErrors)
+{
+    *ppErrors = nullptr;   // при попадании сообщений компилятора нет
+    uint64_t key = g_ShaderCache.Key(code, size, entry, target, flags);
+    std::vector<uint8_t> bytecode;
+    if (g_ShaderCache.Load(key, bytecode) && SUCCEEDED(D3DCreateBlob(bytecode.size(), ppCode)))
+    {
+        memcpy((*ppCode)->GetBufferPointer(), bytecode.data(), bytecode.size());
+        return S_OK;
+    }
+    HRESULT hr = D3DCompile(code, size, nullptr, nullptr, nullptr, entry, target, flags, 0, ppCode, ppErrors);
+    if (SUCCEEDED(hr))
+        g_ShaderCache.Store(key, (*ppCode)->GetBufferPointer(), (*ppCode)->GetBufferSize());
+    return hr;
+}
+
 void CompileShaders()
 {
+    auto compileStart = std::chrono::high_resolution_clock::now();
+    std::wstring cacheDir = GetExePath() + L"shader_cache\\";
+    CreateDirectoryW(cacheDir.c_str(), nullptr);
+    g_ShaderCache.directory = WCSToMBS(cacheDir);
+    g_ShaderCache.salt = D3D_COMPILER_VERSION;
+    g_ShaderCache.ResetStats();
+
     // Шейдеры для обычного куба
     const char* vsCode = R"(
         cbuffer ModelBuffer : register(b0) { float4x4 model; }
@@ -638,9 +1247,46 @@ void CompileShaders()
             float3x3 normalMatrix = (float3x3)model; o.worldNormal = normalize(mul(v.normal, normalMatrix)); o.worldTangent = normalize(mul(v.tangent, normalMatrix)); o.uv = v.uv; return o;
         }
     )";
-    const char* psCode = R"(
+    // Общая часть шейдеров освещения: список источников кластера пикселя
+    const std::string clusteredLightingCode = R"(
+        struct PointLight { float3 pos; float radius; float3 color; float padding; };
+        StructuredBuffer<PointLight> pointLights : register(t3);
+        StructuredBuffer<uint2> clusterRanges : register(t4);
+        StructuredBuffer<uint> clusterLightIndices : register(t5);
+        cbuffer ClusterParams : register(b4) {
+            uint4  clusterGrid;   // x, y, z - размер сетки
+            float4 clusterDepth;  // x = near, y = far, z = Z / log(far / near)
+            float4 clusterScreen; // размер цели рендера в пикселях
+        };
+        // Кластер пикселя: тайл по SV_Position.xy, слой по глубине камеры, восстановленной из SV_Position.z
+        uint2 ClusterLights(float4 svPos) {
+            float n = clusterDepth.x, f = clusterDepth.y;
+            float viewZ = n * f / (f - svPos.z * (f - n));
+            uint x = min((uint)(svPos.x * clusterGrid.x / clusterScreen.x), clusterGrid.x - 1);
+            uint y = min((uint)(svPos.y * clusterGrid.y / clusterScreen.y), clusterGrid.y - 1);
+            uint z = (uint)clamp(log(max(viewZ, n) / n) * clusterDepth.z, 0.0, clusterGrid.z - 1.0);
+            return clusterRanges[(z * clusterGrid.y + y) * clusterGrid.x + x];
+        }
+        // Прежнее затухание, умноженное на окно, которое гасит его к радиусу источника
+        float LightAttenuation(float dist, float radius) {
+            float w = saturate(1.0 - pow(dist / radius, 4.0));
+            return w * w / (1.0 + 0.1 * dist + 0.01 * dist * dist);
+        }
+        // Вклад источника по Фонгу (instancedPS и deferredPS), V - направление на камеру
+        float3 PointLightContribution(PointLight light, float3 worldPos, float3 N, float3 V, float3 color, float shininess) {
+            float3 L = light.pos - worldPos;
+            float dist = length(L);
+            L = L / dist;
+            float atten = LightAttenuation(dist, light.radius);
+            float diff = max(dot(N, L), 0.0);
+            float3 R = reflect(-L, N);
+            float spec = pow(max(dot(V, R), 0.0), shininess);
+            return (color * diff + spec) * atten * light.color;
+        }
+    )";
+    const std::string psCode = clusteredLightingCode + R"(
         Texture2D colorTexture : register(t0); Texture2D normalMap : register(t1); SamplerState colorSampler : register(s0);
-        cbuffer SceneCB : register(b2) { float4x4 vp; float4 cameraPos; float4 lightCount; struct Light { float4 pos; float4 color; } lights[10]; float4 ambientColor; };
+        cbuffer SceneCB : register(b2) { float4x4 vp; float4 cameraPos; float4 lightCount; float4 ambientColor; };
         struct VSOutput { float4 pos : SV_Position; float3 worldPos : TEXCOORD0; float3 worldNormal : NORMAL; float3 worldTangent : TANGENT; float2 uv : TEXCOORD1; };
         float4 ps(VSOutput p) : SV_Target0 {
             float4 texColor = colorTexture.Sample(colorSampler, p.uv);
@@ -648,15 +1294,17 @@ void CompileShaders()
             float3 N = normalize(p.worldNormal); float3 T = normalize(p.worldTangent); float3 B = cross(N, T);
             float3x3 TBN = float3x3(T, B, N); float3 worldNormal = normalize(mul(tangentNormal, TBN));
             float3 finalColor = ambientColor.xyz * texColor.xyz;
-            for (int i = 0; i < lightCount.x; ++i) {
-                float3 L = lights[i].pos.xyz - p.worldPos.xyz; float dist = length(L); L = L / dist;
-                float atten = 1.0 / (1.0 + 0.1*dist + 0.01*dist*dist);
+            uint2 range = ClusterLights(p.pos);
+            for (uint k = 0; k < range.y; ++k) {
+                PointLight light = pointLights[clusterLightIndices[range.x + k]];
+                float3 L = light.pos - p.worldPos.xyz; float dist = length(L); L = L / dist;
+                float atten = LightAttenuation(dist, light.radius);
                 float diff = max(dot(worldNormal, L), 0.0);
-                finalColor += texColor.xyz * diff * atten * lights[i].color.xyz;
+                finalColor += texColor.xyz * diff * atten * light.color;
                 float3 V = normalize(cameraPos.xyz - p.worldPos.xyz);
                 float3 R = reflect(-L, worldNormal);
                 float spec = pow(max(dot(V, R), 0.0), 32.0);
-                finalColor += spec * atten * lights[i].color.xyz;
+                finalColor += spec * atten * light.color;
             }
             return float4(finalColor, 1.0);
         }
@@ -670,7 +1318,15 @@ void CompileShaders()
     const char* skyboxPS = R"(
         TextureCube skyboxTexture : register(t1); SamplerState skyboxSampler : register(s1);
         struct VSOutput { float4 pos : SV_Position; float3 localPos : TEXCOORD; };
-        float4 ps(VSOutput p) : SV_Target0 { return skyboxTexture.Sample(skyboxSampler, p.localPos); }
+        float4 ps(VSOutput p) : SV_Target0 {
+            float4 color = skyboxTexture.Sample(skyboxSampler, p.localPos);
+        #if GRAYSCALE
+            float gray = dot(saturate(color.rgb), float3(0.299, 0.587, 0.114));   // как filterPS по UNORM-цели
+            return float4(gray, gray, gray, 1.0);
+        #else
+            return color;
+        #endif
+        }
     )";
 
     // Instanced вершинный шейдер
@@ -696,7 +1352,7 @@ void CompileShaders()
             float3 tang   : TANGENT;
             float3 norm   : NORMAL;
             float2 uv     : TEXCOORD;
-            uint instanceId : SV_InstanceID;
+            uint drawInstance : INSTANCEIDX; // StartInstanceLocation корзины + SV_InstanceID
         };
         struct VSOutput
         {
@@ -710,20 +1366,21 @@ void CompileShaders()
         VSOutput vs(VSInput v)
         {
             VSOutput o;
-            uint globalIdx = visibleIds[v.instanceId].x;   
+            uint globalIdx = visibleIds[v.drawInstance].x;
             float4 worldPos = mul(geomBuffer[globalIdx].model, float4(v.pos, 1.0));
             o.pos = mul(worldPos, vp);
             o.worldPos = worldPos;
             o.uv = v.uv;
             o.tang = mul(geomBuffer[globalIdx].norm, float4(v.tang, 0)).xyz;
             o.norm = mul(geomBuffer[globalIdx].norm, float4(v.norm, 0)).xyz;
-            o.instanceId = v.instanceId; 
+            o.instanceId = v.drawInstance;
             return o;
         }
     )";
 
-    // Instanced пиксельный шейдер (с поддержкой текстурного массива и normal map)
-    const char* instancedPS = R"(
+    // Поверхность экземпляра: цвет из текстурного массива, нормаль (с картой нормалей - вариант NORMAL_MAP)
+    // и блеск. Общая часть instancedPS и gbufferPS
+    const char* instancedSurfaceCode = R"(
         Texture2DArray colorTexture : register(t0);
         Texture2D normalMapTexture : register(t1);
         SamplerState colorSampler : register(s0);
@@ -737,18 +1394,6 @@ void CompileShaders()
                 float4 angle;
             } geomBuffer[100];
         };
-        cbuffer SceneCB : register(b3)
-        {
-            float4x4 vp;
-            float4 cameraPos;
-            float4 lightCount;
-            struct Light
-            {
-                float4 pos;
-                float4 color;
-            } lights[10];
-            float4 ambientColor;
-        };
         StructuredBuffer<uint4> visibleIds : register(t2);
         struct VSOutput
         {
@@ -759,41 +1404,147 @@ void CompileShaders()
             float2 uv        : TEXCOORD;
             nointerpolation uint instanceId : INST_ID;
         };
+        struct Surface { float3 color; float3 normal; float shininess; };
+        Surface InstanceSurface(VSOutput pixel, uint idx)
+        {
+            Surface s;
+            uint texId = (uint)geomBuffer[idx].shineSpeedTexIdNM.z;
+            s.color = colorTexture.Sample(colorSampler, float3(pixel.uv, texId)).xyz;
+            float3 normal = normalize(pixel.norm);
+        #if NORMAL_MAP
+            // Карта нормалей назначена не всем экземплярам: признак (0 или 1) смешивает нормали без ветвления
+            float3 tangentNormal = normalMapTexture.Sample(colorSampler, pixel.uv).xyz * 2.0 - 1.0;
+            float3 T = normalize(pixel.tang);
+            float3 B = cross(normal, T);
+            float3 mapped = normalize(tangentNormal.x * T + tangentNormal.y * B + tangentNormal.z * normal);
+            normal = normalize(lerp(normal, mapped, geomBuffer[idx].shineSpeedTexIdNM.w));
+        #endif
+            s.normal = normal;
+            s.shininess = geomBuffer[idx].shineSpeedTexIdNM.x;
+            return s;
+        }
+    )";
+
+    // Instanced пиксельный шейдер (с поддержкой текстурного массива и normal map).
+    // Режимы кадра - варианты: NORMAL_MAP, PER_OBJECT_LIGHTS, LIGHT_BUCKET (LightBucket), GRAYSCALE
+    const std::string instancedPS = clusteredLightingCode +
+        "static const uint instanceLightStride = " + std::to_string(InstanceLightLists::Stride()) + ";\n" +
+        "static const uint bucketLightCount = " + std::to_string(INSTANCE_LIGHT_K) + ";\n" + instancedSurfaceCode + R"(
+        cbuffer SceneCB : register(b3)
+        {
+            float4x4 vp;
+            float4 cameraPos;
+            float4 lightCount;
+            float4 ambientColor;
+        };
+        StructuredBuffer<uint> instanceLightLists : register(t6); // [0] - число, далее индексы источников
         float4 ps(VSOutput pixel) : SV_Target0
         {
             uint idx = visibleIds[pixel.instanceId].x;
-            uint texId = (uint)geomBuffer[idx].shineSpeedTexIdNM.z;
-            float3 color = colorTexture.Sample(colorSampler, float3(pixel.uv, texId)).xyz;
-            uint flags = asuint(geomBuffer[idx].shineSpeedTexIdNM.w);
-            float3 normal;
-            if (flags == 1 && lightCount.y > 0)
-            {
-                float3 tangentNormal = normalMapTexture.Sample(colorSampler, pixel.uv).xyz * 2.0 - 1.0;
-                float3 N = normalize(pixel.norm);
-                float3 T = normalize(pixel.tang);
-                float3 B = cross(N, T);
-                normal = normalize(tangentNormal.x * T + tangentNormal.y * B + tangentNormal.z * N);
-            }
-            else
-            {
-                normal = normalize(pixel.norm);
-            }
-            float shininess = geomBuffer[idx].shineSpeedTexIdNM.x;
-            float3 finalColor = ambientColor.xyz * color;
-            for (int i = 0; i < lightCount.x; ++i)
-            {
-                float3 L = lights[i].pos.xyz - pixel.worldPos.xyz;
-                float dist = length(L);
-                L = L / dist;
-                float atten = 1.0 / (1.0 + 0.1 * dist + 0.01 * dist * dist);
-                float diff = max(dot(normal, L), 0.0);
-                finalColor += color * diff * atten * lights[i].color.xyz;
-                float3 V = normalize(cameraPos.xyz - pixel.worldPos.xyz);
-                float3 R = reflect(-L, normal);
-                float spec = pow(max(dot(V, R), 0.0), shininess);
-                finalColor += spec * atten * lights[i].color.xyz;
-            }
+            Surface s = InstanceSurface(pixel, idx);
+            float3 finalColor = ambientColor.xyz * s.color;
+        #if LIGHT_BUCKET != 0
+            // Только источники кластера пикселя или список экземпляра
+        #if PER_OBJECT_LIGHTS
+            uint2 range = uint2(idx * instanceLightStride + 1, instanceLightLists[idx * instanceLightStride]);
+            #define LIGHT_INDEX(k) instanceLightLists[range.x + (k)]
+        #else
+            uint2 range = ClusterLights(pixel.pos);
+            #define LIGHT_INDEX(k) clusterLightIndices[range.x + (k)]
+        #endif
+            float3 V = normalize(cameraPos.xyz - pixel.worldPos.xyz);
+        #if LIGHT_BUCKET == 1
+            [unroll] for (uint k = 0; k < bucketLightCount; ++k) if (k < range.y)
+        #else
+            [loop] for (uint k = 0; k < range.y; ++k)
+        #endif
+                finalColor += PointLightContribution(pointLights[LIGHT_INDEX(k)], pixel.worldPos.xyz, s.normal, V, s.color, s.shininess);
+        #endif
+        #if GRAYSCALE
+            float gray = dot(saturate(finalColor), float3(0.299, 0.587, 0.114));   // как filterPS по UNORM-цели
+            return float4(gray, gray, gray, 1.0);
+        #else
+            return float4(finalColor, 1.0);
+        #endif
+        }
+    )";
+
+    // Отложенный режим. Октаэдрическая развёртка нормали для R16G16_SNORM - как OctEncode/OctDecode в DeferredShading.h
+    const std::string gbufferConstants = "static const float maxShininess = " + std::to_string(DEFERRED_MAX_SHININESS) + ";\n";
+    const char* octahedralCode = R"(
+        float2 OctEncode(float3 n) {
+            n /= abs(n.x) + abs(n.y) + abs(n.z);
+            float2 s = float2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+            return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * s;
+        }
+        float3 OctDecode(float2 f) {
+            float3 n = float3(f, 1.0 - abs(f.x) - abs(f.y));
+            float t = saturate(-n.z);
+            n.x += n.x >= 0.0 ? -t : t;
+            n.y += n.y >= 0.0 ? -t : t;
+            return normalize(n);
+        }
+    )";
+    // Проход экземпляров в G-буфер: без источников, вариант - NORMAL_MAP
+    const std::string gbufferPS = gbufferConstants + octahedralCode + instancedSurfaceCode + R"(
+        struct GBufferOutput
+        {
+            float4 albedo : SV_Target0;   // rgb - цвет, a - блеск / maxShininess
+            float2 normal : SV_Target1;
+        };
+        GBufferOutput ps(VSOutput pixel)
+        {
+            Surface s = InstanceSurface(pixel, visibleIds[pixel.instanceId].x);
+            GBufferOutput o;
+            o.albedo = float4(s.color, s.shininess / maxShininess);
+            o.normal = OctEncode(s.normal);
+            return o;
+        }
+    )";
+    // Освещение по G-буферу: полноэкранный треугольник filterVS, позиция - из глубины и обратной view-proj,
+    // источники - список кластера пикселя. Варианты: LIGHT_BUCKET, GRAYSCALE
+    const std::string deferredPS = clusteredLightingCode + gbufferConstants +
+        "static const uint bucketLightCount = " + std::to_string(INSTANCE_LIGHT_K) + ";\n" + octahedralCode + R"(
+        Texture2D gbufferAlbedo : register(t0);
+        Texture2D<float2> gbufferNormal : register(t1);
+        Texture2D<float> depthTexture : register(t2);
+        cbuffer SceneCB : register(b3)
+        {
+            float4x4 vp;
+            float4 cameraPos;
+            float4 lightCount;
+            float4 ambientColor;
+            float4x4 invVp;
+        };
+        struct VSOutput { float4 pos : SV_Position; float2 uv : TEXCOORD; };
+        float4 ps(VSOutput pixel) : SV_Target0
+        {
+            int3 texel = int3(pixel.pos.xy, 0);
+            float depth = depthTexture.Load(texel);
+            if (depth >= 1.0) discard;   // геометрии нет: остаётся небо прохода skybox
+            float4 albedo = gbufferAlbedo.Load(texel);
+            float3 normal = OctDecode(gbufferNormal.Load(texel));
+            float shininess = albedo.a * maxShininess;
+            float2 ndc = float2(pixel.pos.x / clusterScreen.x * 2.0 - 1.0, 1.0 - pixel.pos.y / clusterScreen.y * 2.0);
+            float4 world = mul(float4(ndc, depth, 1.0), invVp);
+            world.xyz /= world.w;
+            float3 finalColor = ambientColor.xyz * albedo.rgb;
+        #if LIGHT_BUCKET != 0
+            uint2 range = ClusterLights(float4(pixel.pos.xy, depth, 1.0));
+            float3 V = normalize(cameraPos.xyz - world.xyz);
+        #if LIGHT_BUCKET == 1
+            [unroll] for (uint k = 0; k < bucketLightCount; ++k) if (k < range.y)
+        #else
+            [loop] for (uint k = 0; k < range.y; ++k)
+        #endif
+                finalColor += PointLightContribution(pointLights[clusterLightIndices[range.x + k]], world.xyz, normal, V, albedo.rgb, shininess);
+        #endif
+        #if GRAYSCALE
+            float gray = dot(saturate(finalColor), float3(0.299, 0.587, 0.114));
+            return float4(gray, gray, gray, 1.0);
+        #else
             return float4(finalColor, 1.0);
+        #endif
         }
     )";
 
@@ -816,12 +1567,77 @@ void CompileShaders()
     )";
     const char* filterPS = R"(
         Texture2D colorTexture : register(t0);
+        Texture2D bloomTexture : register(t1);
         SamplerState colorSampler : register(s0);
+        SamplerState linearClamp : register(s1);
+        cbuffer BloomParams : register(b0) {
+            float threshold;
+            float knee;
+            float intensity;
+            float4 source;
+            float4 scene;
+        };
         struct VSOutput { float4 pos : SV_Position; float2 uv : TEXCOORD; };
         float4 ps(VSOutput i) : SV_Target0 {
-            float3 color = colorTexture.Sample(colorSampler, i.uv).rgb;
+            // Область рендера может занимать часть цели: растяжение на экран, выборки не выходят за её край
+            float3 color = colorTexture.Sample(colorSampler, min(i.uv * scene.xy, source.xy)).rgb;
+        #if BLOOM
+            // Уровень 0 пирамиды вдвое мельче кадра: растяжение как в bloomUpPS
+            float2 bloomSize;
+            bloomTexture.GetDimensions(bloomSize.x, bloomSize.y);
+            color += intensity * bloomTexture.Sample(linearClamp, min(i.pos.xy * scene.xy * 0.5 / bloomSize, source.zw)).rgb;
+        #endif
+        #if GRAYSCALE
             float gray = dot(color, float3(0.299, 0.587, 0.114));
             return float4(gray, gray, gray, 1.0);
+        #else
+            return float4(color, 1.0);
+        #endif
+        }
+    )";
+    // Свечение (Bloom.h). Координаты выборок - от SV_Position и размера источника, а не от uv
+    // полноэкранного треугольника: при нечётном размере уровень не ровно вдвое меньше.
+    // Область кадра может занимать часть цели (регулятор кадра): выборки прижимаются к её краю, как clamp
+    const char* bloomDownPS = R"(
+        Texture2D source : register(t0);
+        SamplerState linearClamp : register(s0);
+        cbuffer BloomParams : register(b0) {
+            float threshold;
+            float knee;
+            float intensity;
+            float4 sourceMax;
+        };
+        struct VSOutput { float4 pos : SV_Position; float2 uv : TEXCOORD; };
+        float4 ps(VSOutput i) : SV_Target0 {
+            float2 size;
+            source.GetDimensions(size.x, size.y);
+            // [1 3 3 1] / 8 по осям: пары текселей (2p - 1, 2p) и (2p + 1, 2p + 2) - по билинейной выборке
+            float2 a = min((2.0 * i.pos.xy - 0.75) / size, sourceMax.xy);
+            float2 b = min((2.0 * i.pos.xy + 0.75) / size, sourceMax.xy);
+            float3 c = 0.25 * (source.Sample(linearClamp, a).rgb + source.Sample(linearClamp, float2(b.x, a.y)).rgb +
+                               source.Sample(linearClamp, float2(a.x, b.y)).rgb + source.Sample(linearClamp, b).rgb);
+        #if PREFILTER
+            float br = max(c.r, max(c.g, c.b));
+            float soft = clamp(br - threshold + knee, 0.0, 2.0 * knee);
+            soft = soft * soft / (4.0 * knee + 1e-4);
+            c *= max(soft, br - threshold) / max(br, 1e-4);
+        #endif
+            return float4(c, 1.0);
+        }
+    )";
+    const char* bloomUpPS = R"(
+        Texture2D source : register(t0);
+        SamplerState linearClamp : register(s0);
+        cbuffer BloomParams : register(b0) {
+            float4 params;
+            float4 sourceMax;
+        };
+        struct VSOutput { float4 pos : SV_Position; float2 uv : TEXCOORD; };
+        float4 ps(VSOutput i) : SV_Target0 {
+            // Источник вдвое мельче цели: [1 3] / 4 по осям - одна билинейная выборка
+            float2 size;
+            source.GetDimensions(size.x, size.y);
+            return float4(source.Sample(linearClamp, min(i.pos.xy * 0.5 / size, sourceMax.xy)).rgb, 1.0);
         }
     )";
     const char* cullCS = R"(
@@ -833,8 +1649,26 @@ void CompileShaders()
             float4 bbMin[20];
             float4 bbMax[20];
         };
+        cbuffer OcclusionParams : register(b2) {
+            float4x4 vp;
+            uint   phase;       // 0 - только фрустум, 1 - видимые в прошлом кадре, 2 - тест по Hi-Z
+            uint   hizMipCount;
+            float2 hizSize;      // область рендера: Hi-Z строится только по ней
+            float4 minPixelArea; // порог площади проекции (px^2) по мэшам
+            float4 detail;       // x - множитель экранного размера для LOD
+        };
         RWStructuredBuffer<uint> indirectArgs : register(u0);
         RWStructuredBuffer<uint4> visibleIds : register(u1);
+        cbuffer LodParams : register(b3) {
+            uint4  lodRanges[8];      // корзина mesh*4+lod: x=indexCount, y=startIndex, z=baseVertex, w=lodCount мэша
+            float4 lodScreenSizes[2]; // мин. экранный размер (px) для LOD 0..3 каждого мэша
+        };
+        RWStructuredBuffer<uint> visibilityHistory : register(u2);
+        RWStructuredBuffer<uint> instanceBuckets : register(u3);
+        RWStructuredBuffer<uint> groupBucketOffsets : register(u4); // [группа * 8 + корзина]: счётчик группы, после batchArgs - смещение
+        groupshared uint2 gsScan[64];
+        groupshared uint gsGroupScan[64];   // batchArgs: скан счётчиков групп одной корзины
+        Texture2D<float> hiz : register(t0);
 
         bool IsBoxInside(float4 frustum[6], float3 bmin, float3 bmax) {
             for (int i = 0; i < 6; ++i) {
@@ -849,14 +1683,208 @@ void CompileShaders()
             return true;
         }
 
+        // Перекрыт ли бокс глубиной фазы 1 (тот же алгоритм, что IsOccludedByPyramid в OcclusionCulling.h)
+        bool IsOccluded(float3 bmin, float3 bmax) {
+            float2 uvMin = float2(1.0, 1.0);
+            float2 uvMax = float2(0.0, 0.0);
+            float zMin = 1.0;
+            [unroll] for (uint c = 0; c < 8; ++c) {
+                float3 p = float3((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+                float4 clip = mul(float4(p, 1.0), vp);
+                if (clip.w <= 1e-5) return false; // пересекает ближнюю плоскость
+                float3 ndc = clip.xyz / clip.w;
+                float2 uv = float2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+                uvMin = min(uvMin, uv);
+                uvMax = max(uvMax, uv);
+                zMin = min(zMin, ndc.z);
+            }
+            float2 r0 = saturate(uvMin) * hizSize;
+            float2 r1 = min(saturate(uvMax) * hizSize, hizSize - 1.0);
+            if (r1.x < r0.x || r1.y < r0.y) return false;
+            float extent = max(max(r1.x - r0.x, r1.y - r0.y), 1.0);
+            uint level = min((uint)ceil(log2(extent)), hizMipCount - 1);
+            // Размер уровня по области рендера, как в BuildHiZ: текстура может быть больше
+            uint2 size = max(uint2(hizSize) >> level, uint2(1, 1));
+            uint2 t0 = min(uint2(r0) >> level, size - 1);
+            uint2 t1 = min(uint2(r1) >> level, size - 1);
+            float maxDepth = 0.0;
+            [loop] for (uint y = t0.y; y <= t1.y; ++y)
+                [loop] for (uint x = t0.x; x <= t1.x; ++x)
+                    maxDepth = max(maxDepth, hiz.Load(int3(x, y, level)));
+            return zMin > maxDepth;
+        }
+
+        // Размер проекции бокса в пикселях без обрезки по экрану; false - пересекает ближнюю плоскость.
+        // max(extent) - экранный размер для LOD (ProjectedScreenSize в LodBatching.h),
+        // extent.x * extent.y - площадь для отсечения по вкладу (ProjectedPixelArea в ContributionCulling.h)
+        bool ProjectedExtent(float3 bmin, float3 bmax, out float2 extent) {
+            float2 pMin = float2(1e30, 1e30);
+            float2 pMax = float2(-1e30, -1e30);
+            extent = float2(1e30, 1e30);
+            [unroll] for (uint c = 0; c < 8; ++c) {
+                float3 p = float3((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z);
+                float4 clip = mul(float4(p, 1.0), vp);
+                if (clip.w <= 1e-5) return false;
+                float2 s = clip.xy / clip.w * 0.5 * hizSize;
+                pMin = min(pMin, s);
+                pMax = max(pMax, s);
+            }
+            extent = pMax - pMin;
+            return true;
+        }
+
+        uint SelectLod(uint mesh, float screenSize) {
+            screenSize *= detail.x;
+            uint lodCount = lodRanges[mesh * 4].w;
+            uint lod = 0;
+            [loop] while (lod + 1 < lodCount && screenSize < lodScreenSizes[mesh][lod]) ++lod;
+            return lod;
+        }
+
+        // Префиксная сумма по группе для всех 8 корзин сразу: счётчик корзины b - байт (b & 3) в компоненте b >> 2
+        // (в группе не больше 64 экземпляров, байта хватает). Возвращает инклюзивную сумму, итог группы - в gsScan[63].
+        uint2 GroupBucketScan(uint gi, uint bucket) {
+            uint2 own = uint2(0, 0);
+            if (bucket != 0xFFFFFFFF) {
+                if (bucket < 4) own.x = 1u << (bucket * 8);
+                else own.y = 1u << ((bucket - 4) * 8);
+            }
+            gsScan[gi] = own;
+            GroupMemoryBarrierWithGroupSync();
+            [unroll] for (uint s = 1; s < 64; s <<= 1) {
+                uint2 v = gsScan[gi];
+                if (gi >= s) v += gsScan[gi - s];
+                GroupMemoryBarrierWithGroupSync();
+                gsScan[gi] = v;
+                GroupMemoryBarrierWithGroupSync();
+            }
+            return gsScan[gi] - own;
+        }
+
+        uint BucketField(uint2 packed, uint bucket) {
+            return ((bucket < 4 ? packed.x : packed.y) >> ((bucket & 3) * 8)) & 0xFF;
+        }
+
+        // Проход 1: culling, выбор LOD, подсчёт экземпляров в корзинах.
+        // Ранг экземпляра внутри корзины считается префиксной суммой по группе,
+        // в глобальные счётчики идёт один атомик на (группу, непустую корзину)
         [numthreads(64, 1, 1)]
-        void cs(uint3 tid : SV_DispatchThreadID) {
-            if (tid.x >= numInstances) return;
-            if (IsBoxInside(planes, bbMin[tid.x].xyz, bbMax[tid.x].xyz)) {
-                uint id;
-                InterlockedAdd(indirectArgs[1], 1, id); // InstanceCount
-                visibleIds[id] = uint4(tid.x, 0, 0, 0);
+        void cs(uint3 tid : SV_DispatchThreadID, uint3 gid : SV_GroupID, uint gi : SV_GroupIndex) {
+            uint bucket = 0xFFFFFFFF;
+            if (tid.x < numInstances) {
+                uint word = tid.x >> 5;
+                uint bit = 1u << (tid.x & 31);
+                bool wasVisible = (visibilityHistory[word] & bit) != 0;
+                bool inside = IsBoxInside(planes, bbMin[tid.x].xyz, bbMax[tid.x].xyz);
+                uint mesh = (uint)bbMin[tid.x].w;
+                float2 extent;
+                bool nearClipped = !ProjectedExtent(bbMin[tid.x].xyz, bbMax[tid.x].xyz, extent);
+                float screenSize = max(extent.x, extent.y);
+
+                // Отсечение по вкладу: слишком мелкий экземпляр считается невидимым
+                if (inside && !nearClipped && extent.x * extent.y < minPixelArea[mesh]) {
+                    inside = false;
+                    if (phase != 1) { // в фазе 1 те же экземпляры ещё раз проверит фаза 2
+                        InterlockedAdd(indirectArgs[8 * 5 + 0], 1);
+                        InterlockedAdd(indirectArgs[8 * 5 + 1], lodRanges[mesh * 4 + SelectLod(mesh, screenSize)].x);
+                    }
+                }
+                bool draw;
+                if (phase == 1) {
+                    draw = inside && wasVisible;
+                }
+                else {
+                    bool visible = inside && (phase == 0 || !IsOccluded(bbMin[tid.x].xyz, bbMax[tid.x].xyz));
+                    if (visible) InterlockedOr(visibilityHistory[word], bit);
+                    else InterlockedAnd(visibilityHistory[word], ~bit);
+                    draw = (phase == 0) ? visible : (visible && !wasVisible);
+                }
+                if (draw) bucket = mesh * 4 + SelectLod(mesh, screenSize);
+            }
+
+            uint2 rank = GroupBucketScan(gi, bucket);
+            if (tid.x < numInstances)
+                instanceBuckets[tid.x] = (bucket == 0xFFFFFFFF) ? bucket : (bucket | (BucketField(rank, bucket) << 8));
+            if (gi == 0) {
+                uint2 total = gsScan[63];
+                [unroll] for (uint b = 0; b < 8; ++b) {
+                    uint n = BucketField(total, b);
+                    groupBucketOffsets[gid.x * 8 + b] = n;
+                    if (n) InterlockedAdd(indirectArgs[b * 5 + 1], n); // InstanceCount корзины
+                }
+            }
+        }
+
+        // Проход 2: по группе на корзину. StartInstanceLocation - сумма InstanceCount предыдущих корзин
+        // (их досчитал проход 1), остальные поля args из таблицы LOD. Счётчики групп заменяются смещениями
+        // групп внутри корзины: скан по группам в порядке ID блоками по 64 с переносом итога блока
+        [numthreads(64, 1, 1)]
+        void batchArgs(uint3 gid : SV_GroupID, uint gi : SV_GroupIndex) {
+            uint b = gid.x;
+            if (gi == 0) {
+                uint offset = 0;
+                [loop] for (uint prev = 0; prev < b; ++prev)
+                    offset += indirectArgs[prev * 5 + 1];
+                indirectArgs[b * 5 + 0] = lodRanges[b].x;
+                indirectArgs[b * 5 + 2] = lodRanges[b].y;
+                indirectArgs[b * 5 + 3] = lodRanges[b].z;
+                indirectArgs[b * 5 + 4] = offset;
             }
+            uint groupCount = (numInstances + 63) / 64;
+            uint carry = 0;
+            [loop] for (uint first = 0; first < groupCount; first += 64) {
+                uint g = first + gi;
+                uint n = (g < groupCount) ? groupBucketOffsets[g * 8 + b] : 0;
+                gsGroupScan[gi] = n;
+                GroupMemoryBarrierWithGroupSync();
+                [unroll] for (uint s = 1; s < 64; s <<= 1) {
+                    uint v = gsGroupScan[gi];
+                    if (gi >= s) v += gsGroupScan[gi - s];
+                    GroupMemoryBarrierWithGroupSync();
+                    gsGroupScan[gi] = v;
+                    GroupMemoryBarrierWithGroupSync();
+                }
+                if (g < groupCount) groupBucketOffsets[g * 8 + b] = carry + gsGroupScan[gi] - n;
+                carry += gsGroupScan[63];
+                GroupMemoryBarrierWithGroupSync(); // gsGroupScan[63] прочитан всеми до следующего блока
+            }
+        }
+
+        // Проход 3: раскладка видимых ID по диапазонам корзин без атомиков.
+        // Позиция = начало корзины + смещение группы + ранг в группе, поэтому внутри корзины
+        // ID идут в исходном порядке и порядок отрисовки детерминирован (CompactOrdered в StreamCompaction.h)
+        [numthreads(64, 1, 1)]
+        void scatter(uint3 tid : SV_DispatchThreadID, uint3 gid : SV_GroupID) {
+            if (tid.x >= numInstances) return;
+            uint packed = instanceBuckets[tid.x];
+            if (packed == 0xFFFFFFFF) return;
+            uint bucket = packed & 0xFF;
+            uint slot = groupBucketOffsets[gid.x * 8 + bucket] + (packed >> 8);
+            visibleIds[indirectArgs[bucket * 5 + 4] + slot] = uint4(tid.x, bucket, 0, 0);
+        }
+    )";
+    // Построение Hi-Z: мип 0 - копия глубины, далее максимум по 2x2 (3x3 у края нечётного уровня)
+    const char* hizCS = R"(
+        cbuffer HiZParams : register(b0) {
+            uint2 srcSize;
+            uint2 dstSize;
+            uint  copyLevel;
+        };
+        Texture2D<float> srcDepth : register(t0);
+        RWTexture2D<float> dstDepth : register(u0);
+
+        [numthreads(8, 8, 1)]
+        void cs(uint3 tid : SV_DispatchThreadID) {
+            if (tid.x >= dstSize.x || tid.y >= dstSize.y) return;
+            if (copyLevel) { dstDepth[tid.xy] = srcDepth.Load(int3(tid.xy, 0)); return; }
+            uint2 first = tid.xy * 2;
+            uint2 extra = uint2((tid.x == dstSize.x - 1) && (srcSize.x & 1), (tid.y == dstSize.y - 1) && (srcSize.y & 1));
+            uint2 last = min(first + 1 + extra, srcSize - 1);
+            float m = 0.0;
+            [loop] for (uint y = first.y; y <= last.y; ++y)
+                [loop] for (uint x = first.x; x <= last.x; ++x)
+                    m = max(m, srcDepth.Load(int3(x, y, 0)));
+            dstDepth[tid.xy] = m;
         }
     )";
 
@@ -864,81 +1892,204 @@ void CompileShaders()
 #ifdef _DEBUG
     flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
-    ID3DBlob* pVsBlob = nullptr, * pPsBlob = nullptr, * pErrorBlob = nullptr;
-
-    // Обычные шейдеры
-    D3DCompile(vsCode, strlen(vsCode), nullptr, nullptr, nullptr, "vs", "vs_5_0", flags, 0, &pVsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreateVertexShader(pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), nullptr, &g_pVertexShader);
-    D3DCompile(psCode, strlen(psCode), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pPixelShader);
-    SAFE_RELEASE(pPsBlob);
-
-    D3D11_INPUT_ELEMENT_DESC layout[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0}
-    };
-    g_pDevice->CreateInputLayout(layout, 4, pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), &g_pInputLayout);
-    SAFE_RELEASE(pVsBlob);
 
-    // Instanced шейдеры
-    D3DCompile(instancedVS, strlen(instancedVS), nullptr, nullptr, nullptr, "vs", "vs_5_0", flags, 0, &pVsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreateVertexShader(pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), nullptr, &g_pInstancedVS);
-    D3DCompile(instancedPS, strlen(instancedPS), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pInstancedPS);
-    SAFE_RELEASE(pPsBlob);
-
-    D3D11_INPUT_ELEMENT_DESC layoutInst[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    // Все компиляции - одним пакетом на всех ядрах; D3DCompile и кэш потокобезопасны
+    ShaderBatch batch;
+    UINT jobVS = batch.Add("vs", vsCode, strlen(vsCode), "vs", "vs_5_0", flags);
+    UINT jobPS = batch.Add("ps", psCode.c_str(), psCode.size(), "ps", "ps_5_0", flags);
+    UINT jobInstancedVS = batch.Add("instancedVS", instancedVS, strlen(instancedVS), "vs", "vs_5_0", flags);
+    UINT jobSkyboxVS = batch.Add("skyboxVS", skyboxVS, strlen(skyboxVS), "vs", "vs_5_0", flags);
+    UINT jobFilterVS = batch.Add("filterVS", filterVS, strlen(filterVS), "vs", "vs_5_0", flags);
+    UINT jobBloomUpPS = batch.Add("bloomUpPS", bloomUpPS, strlen(bloomUpPS), "ps", "ps_5_0", flags);
+    UINT jobCullCS = batch.Add("cullCS", cullCS, strlen(cullCS), "cs", "cs_5_0", flags);
+    UINT jobBatchArgsCS = batch.Add("cullCS:batchArgs", cullCS, strlen(cullCS), "batchArgs", "cs_5_0", flags);
+    UINT jobScatterCS = batch.Add("cullCS:scatter", cullCS, strlen(cullCS), "scatter", "cs_5_0", flags);
+    UINT jobHiZCS = batch.Add("hizCS", hizCS, strlen(hizCS), "cs", "cs_5_0", flags);
+
+    // Варианты пиксельных шейдеров сцены: по заданию на каждую достижимую комбинацию возможностей
+    ShaderPermutations& ips = g_InstancedPSVariants.permutations;
+    ips = ShaderPermutations();
+    ips.AddFeature("NORMAL_MAP", 2);
+    ips.AddFeature("PER_OBJECT_LIGHTS", 2);
+    ips.AddFeature("LIGHT_BUCKET", LIGHT_BUCKET_COUNT);
+    ips.AddFeature("GRAYSCALE", 2);
+    // Список экземпляра не длиннее INSTANCE_LIGHT_K: с ним выбирается только LIGHT_BUCKET_SMALL
+    g_InstancedPSVariants.Generate([&ips](uint32_t key)
+    {
+        return !ips.Get(key, IPS_PER_OBJECT_LIGHTS) || ips.Get(key, IPS_LIGHT_BUCKET) == LIGHT_BUCKET_SMALL;
+    });
+    ShaderPermutations& sps = g_SkyboxPSVariants.permutations;
+    sps = ShaderPermutations();
+    sps.AddFeature("GRAYSCALE", 2);
+    g_SkyboxPSVariants.Generate([](uint32_t) { return true; });
+    ShaderPermutations& gps = g_GBufferPSVariants.permutations;
+    gps = ShaderPermutations();
+    gps.AddFeature("NORMAL_MAP", 2);
+    g_GBufferPSVariants.Generate([](uint32_t) { return true; });
+    ShaderPermutations& dps = g_DeferredPSVariants.permutations;
+    dps = ShaderPermutations();
+    dps.AddFeature("LIGHT_BUCKET", LIGHT_BUCKET_COUNT);
+    dps.AddFeature("GRAYSCALE", 2);
+    g_DeferredPSVariants.Generate([](uint32_t) { return true; });
+    ShaderPermutations& fps = g_FilterPSVariants.permutations;
+    fps = ShaderPermutations();
+    fps.AddFeature("GRAYSCALE", 2);
+    fps.AddFeature("BLOOM", 2);
+    // Без серого и без свечения проход фильтра отсекается графом
+    g_FilterPSVariants.Generate([&fps](uint32_t key) { return fps.Get(key, FPS_GRAYSCALE) || fps.Get(key, FPS_BLOOM); });
+    ShaderPermutations& bps = g_BloomDownPSVariants.permutations;
+    bps = ShaderPermutations();
+    bps.AddFeature("PREFILTER", 2);
+    g_BloomDownPSVariants.Generate([](uint32_t) { return true; });
+
+    // Исходники и имена заданий живут до конца Compile: reserve, чтобы c_str() не сдвигались
+    size_t variantCount = g_InstancedPSVariants.keys.size() + g_SkyboxPSVariants.keys.size() +
+        g_GBufferPSVariants.keys.size() + g_DeferredPSVariants.keys.size() + g_FilterPSVariants.keys.size() + g_BloomDownPSVariants.keys.size();
+    std::vector<std::string> variantSources, variantNames;
+    variantSources.reserve(variantCount);
+    variantNames.reserve(variantCount);
+    auto addVariants = [&](ShaderVariants<ID3D11PixelShader>& variants, const char* name, const std::string& code)
+    {
+        std::vector<UINT> jobs;
+        for (uint32_t key : variants.keys)
+        {
+            variantSources.push_back(variants.permutations.Defines(key) + code);
+            variantNames.push_back(std::string(name) + "[" + variants.permutations.Describe(key) + "]");
+            jobs.push_back(batch.Add(variantNames.back().c_str(), variantSources.back().c_str(), variantSources.back().size(), "ps", "ps_5_0", flags));
+        }
+        return jobs;
     };
+    std::vector<UINT> jobsInstancedPS = addVariants(g_InstancedPSVariants, "instancedPS", instancedPS);
+    std::vector<UINT> jobsSkyboxPS = addVariants(g_SkyboxPSVariants, "skyboxPS", skyboxPS);
+    std::vector<UINT> jobsGBufferPS = addVariants(g_GBufferPSVariants, "gbufferPS", gbufferPS);
+    std::vector<UINT> jobsDeferredPS = addVariants(g_DeferredPSVariants, "deferredPS", deferredPS);
+    std::vector<UINT> jobsFilterPS = addVariants(g_FilterPSVariants, "filterPS", filterPS);
+    std::vector<UINT> jobsBloomDownPS = addVariants(g_BloomDownPSVariants, "bloomDownPS", bloomDownPS);
+    batch.Compile((std::max)(1u, std::thread::hardware_concurrency()), [](ShaderBatch::Job& job)
+    {
+        ID3DBlob* pErrorBlob = nullptr;
+        HRESULT hr = CompileCached(job.code, job.size, job.entry, job.target, job.flags, &job.bytecode, &pErrorBlob);
+        if (pErrorBlob) { job.errors.assign((const char*)pErrorBlob->GetBufferPointer(), pErrorBlob->GetBufferSize()); pErrorBlob->Release(); }
+        return SUCCEEDED(hr);
+    });
+
+    // Отчёт по каждому шейдеру: ошибка не роняет запуск, объект просто остаётся nullptr
+    std::string failedNames;
+    for (const ShaderBatch::Job& job : batch.jobs)
+    {
+        if (job.errors.empty() && job.ok) continue;
+        std::string msg = std::string("Shader ") + job.name + (job.ok ? " warnings:\n" : " FAILED:\n") + job.errors.c_str() + "\n";
+        OutputDebugStringA(msg.c_str());
+        if (!job.ok) failedNames += std::string(failedNames.empty() ? "" : ", ") + job.name;
+    }
 
-    g_pDevice->CreateInputLayout(layoutInst, 4, pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), &g_pInstancedInputLayout);
-    SAFE_RELEASE(pVsBlob);
-
-    // Skybox
-    D3DCompile(skyboxVS, strlen(skyboxVS), nullptr, nullptr, nullptr, "vs", "vs_5_0", flags, 0, &pVsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreateVertexShader(pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), nullptr, &g_pSkyboxVS);
-    D3DCompile(skyboxPS, strlen(skyboxPS), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pSkyboxPS);
-    SAFE_RELEASE(pPsBlob);
-
-    D3D11_INPUT_ELEMENT_DESC layoutSky[] = {
-        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    // Создание объектов - когда готовы все блобы. Неудачное создание - как ошибка компиляции:
+    // объект обнуляется (проходы с ним пропускаются), имя задания попадает в итоговое сообщение
+    auto created = [&batch, &failedNames](HRESULT hr, const char* call, UINT job)
+    {
+        if (SUCCEEDED(hr)) return true;
+        char buf[256];
+        sprintf_s(buf, "%s(%s) failed: 0x%08X\n", call, batch.jobs[job].name, (unsigned)hr);
+        OutputDebugStringA(buf);
+        failedNames += std::string(failedNames.empty() ? "" : ", ") + batch.jobs[job].name;
+        return false;
     };
-    g_pDevice->CreateInputLayout(layoutSky, 2, pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), &g_pSkyboxInputLayout);
-    SAFE_RELEASE(pVsBlob);
-    SAFE_RELEASE(pPsBlob);
-
-    // Шейдеры фильтра
-    D3DCompile(filterVS, strlen(filterVS), nullptr, nullptr, nullptr, "vs", "vs_5_0", flags, 0, &pVsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    if (pVsBlob) { g_pDevice->CreateVertexShader(pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), nullptr, &g_pFilterVS); SAFE_RELEASE(pVsBlob); }
-    D3DCompile(filterPS, strlen(filterPS), nullptr, nullptr, nullptr, "ps", "ps_5_0", flags, 0, &pPsBlob, &pErrorBlob);
-    if (pErrorBlob) { OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer()); pErrorBlob->Release(); }
-    if (pPsBlob) { g_pDevice->CreatePixelShader(pPsBlob->GetBufferPointer(), pPsBlob->GetBufferSize(), nullptr, &g_pFilterPS); SAFE_RELEASE(pPsBlob); }
-
-    ID3DBlob* pCSBlob = nullptr;
-    HRESULT hrCS = D3DCompile(cullCS, strlen(cullCS), nullptr, nullptr, nullptr, "cs", "cs_5_0", flags, 0, &pCSBlob, &pErrorBlob);
-    if (FAILED(hrCS)) {
-        if (pErrorBlob) OutputDebugStringA((const char*)pErrorBlob->GetBufferPointer());
-        assert(false);
-    }
-    hrCS = g_pDevice->CreateComputeShader(pCSBlob->GetBufferPointer(), pCSBlob->GetBufferSize(), nullptr, &g_pCullCS);
-    assert(SUCCEEDED(hrCS));
-    SAFE_RELEASE(pCSBlob);
-    SAFE_RELEASE(pErrorBlob);
+    if (ID3DBlob* blob = batch.Bytecode(jobVS))
+    {
+        D3D11_INPUT_ELEMENT_DESC layout[] = {
+            {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0}
+        };
+        if (!created(g_pDevice->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pVertexShader), "CreateVertexShader", jobVS))
+            g_pVertexShader = nullptr;
+        if (!created(g_pDevice->CreateInputLayout(layout, 4, blob->GetBufferPointer(), blob->GetBufferSize(), &g_pInputLayout), "CreateInputLayout", jobVS))
+            g_pInputLayout = nullptr;
+    }
+    if (ID3DBlob* blob = batch.Bytecode(jobPS))
+        if (!created(g_pDevice->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pPixelShader), "CreatePixelShader", jobPS))
+            g_pPixelShader = nullptr;
+
+    // Instanced шейдеры
+    if (ID3DBlob* blob = batch.Bytecode(jobInstancedVS))
+    {
+        D3D11_INPUT_ELEMENT_DESC layoutInst[] = {
+            {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"INSTANCEIDX", 0, DXGI_FORMAT_R32_UINT,     1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+        };
+        if (!created(g_pDevice->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pInstancedVS), "CreateVertexShader", jobInstancedVS))
+            g_pInstancedVS = nullptr;
+        if (!created(g_pDevice->CreateInputLayout(layoutInst, 5, blob->GetBufferPointer(), blob->GetBufferSize(), &g_pInstancedInputLayout), "CreateInputLayout", jobInstancedVS))
+            g_pInstancedInputLayout = nullptr;
+    }
+    auto createVariants = [&batch, &created](ShaderVariants<ID3D11PixelShader>& variants, const std::vector<UINT>& jobs)
+    {
+        for (size_t i = 0; i < jobs.size(); ++i)
+            if (ID3DBlob* blob = batch.Bytecode(jobs[i]))
+            {
+                ID3D11PixelShader*& object = variants.objects[variants.keys[i]];
+                if (!created(g_pDevice->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &object), "CreatePixelShader", jobs[i]))
+                    object = nullptr;
+            }
+    };
+    createVariants(g_InstancedPSVariants, jobsInstancedPS);
+    createVariants(g_GBufferPSVariants, jobsGBufferPS);
+    createVariants(g_DeferredPSVariants, jobsDeferredPS);
 
+    // Skybox
+    if (ID3DBlob* blob = batch.Bytecode(jobSkyboxVS))
+    {
+        D3D11_INPUT_ELEMENT_DESC layoutSky[] = {
+            {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,    0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+        };
+        if (!created(g_pDevice->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pSkyboxVS), "CreateVertexShader", jobSkyboxVS))
+            g_pSkyboxVS = nullptr;
+        if (!created(g_pDevice->CreateInputLayout(layoutSky, 2, blob->GetBufferPointer(), blob->GetBufferSize(), &g_pSkyboxInputLayout), "CreateInputLayout", jobSkyboxVS))
+            g_pSkyboxInputLayout = nullptr;
+    }
+    createVariants(g_SkyboxPSVariants, jobsSkyboxPS);
+
+    // Шейдеры фильтра
+    if (ID3DBlob* blob = batch.Bytecode(jobFilterVS))
+        if (!created(g_pDevice->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pFilterVS), "CreateVertexShader", jobFilterVS))
+            g_pFilterVS = nullptr;
+    createVariants(g_FilterPSVariants, jobsFilterPS);
+    createVariants(g_BloomDownPSVariants, jobsBloomDownPS);
+    if (ID3DBlob* blob = batch.Bytecode(jobBloomUpPS))
+        if (!created(g_pDevice->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &g_pBloomUpPS), "CreatePixelShader", jobBloomUpPS))
+            g_pBloomUpPS = nullptr;
+
+    // Compute
+    struct { UINT job; ID3D11ComputeShader** target; } computeShaders[] = {
+        { jobCullCS, &g_pCullCS }, { jobBatchArgsCS, &g_pBatchArgsCS }, { jobScatterCS, &g_pScatterCS }, { jobHiZCS, &g_pHiZCS } };
+    for (const auto& cs : computeShaders)
+    {
+        if (ID3DBlob* blob = batch.Bytecode(cs.job))
+            if (!created(g_pDevice->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, cs.target), "CreateComputeShader", cs.job))
+                *cs.target = nullptr;
+    }
+    batch.Release();
+
+    double compileMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count();
+    char buf[512];
+    sprintf_s(buf, "Shaders: %.1f ms (%u jobs on %u threads: %.1f ms wall, %.1f ms summed), cache hits %u, misses %u (rejected %u), written %u, write failures %u -> %s\n",
+        compileMs, (UINT)batch.jobs.size(), batch.threadsUsed, batch.wallMs, batch.TotalJobMs(),
+        g_ShaderCache.hits.load(), g_ShaderCache.misses.load(), g_ShaderCache.rejected.load(),
+        g_ShaderCache.writes.load(), g_ShaderCache.writeFailures.load(), g_ShaderCache.directory.c_str());
+    OutputDebugStringA(buf);
+    sprintf_s(buf, "Shader variants: instancedPS %u of %u combinations (%u built), skyboxPS %u (%u built), gbufferPS %u (%u built), deferredPS %u (%u built), filterPS %u (%u built), bloomDownPS %u (%u built)\n",
+        (UINT)g_InstancedPSVariants.keys.size(), (UINT)ips.Enumerate([](uint32_t) { return true; }).size(), g_InstancedPSVariants.BuiltCount(),
+        (UINT)g_SkyboxPSVariants.keys.size(), g_SkyboxPSVariants.BuiltCount(),
+        (UINT)g_GBufferPSVariants.keys.size(), g_GBufferPSVariants.BuiltCount(), (UINT)g_DeferredPSVariants.keys.size(), g_DeferredPSVariants.BuiltCount(),
+        (UINT)g_FilterPSVariants.keys.size(), g_FilterPSVariants.BuiltCount(), (UINT)g_BloomDownPSVariants.keys.size(), g_BloomDownPSVariants.BuiltCount());
+    OutputDebugStringA(buf);
+    if (!failedNames.empty())
+        MessageBoxA(NULL, ("Shader compilation failed: " + failedNames + "\nSee debug output for errors.").c_str(), "Error", MB_OK | MB_ICONERROR);
 }
 
 // ------------------------------------------------------------------
@@ -1027,6 +2178,7 @@ void LoadTextures()
             hr = g_pDevice->CreateShaderResourceView(pNormalTex, &nSrvDesc, &g_pNormalMapView);
             pNormalTex->Release();
         }
+        DecodeSwTexture(normalDesc, normalMipData[0], g_SwScene.normalMap);
         free(normalDesc.pData);
     }
 
@@ -1042,7 +2194,7 @@ void LoadTextures()
     sampDesc.MaxAnisotropy = 16;
     sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
     sampDesc.BorderColor[0] = sampDesc.BorderColor[1] = sampDesc.BorderColor[2] = sampDesc.BorderColor[3] = 1.0f;
-    g_pDevice->CreateSamplerState(&sampDesc, &g_pSampler);
+    g_pSampler = g_StateCache.Sampler(g_pDevice, sampDesc);
 
     // Cubemap
     std::wstring skyboxPath = basePath + L"skybox\\";
@@ -1087,6 +2239,7 @@ void LoadTextures()
     ID3D11Texture2D* pCubemapTex = nullptr;
     hr = g_pDevice->CreateTexture2D(&cubeDesc, cubeInitData.data(), &pCubemapTex);
 
+    for (int i = 0; i < 6; ++i) DecodeSwTexture(faceDescs[i], faceDescs[i].pData, g_SwScene.skybox.faces[i]);
     for (int i = 0; i < 6; ++i) free(faceDescs[i].pData);
 
     if (SUCCEEDED(hr))
@@ -1105,9 +2258,29 @@ void LoadTextures()
     rsDesc.FillMode = D3D11_FILL_SOLID;
     rsDesc.CullMode = D3D11_CULL_BACK;
     rsDesc.FrontCounterClockwise = FALSE;
-    g_pDevice->CreateRasterizerState(&rsDesc, &g_pRSCullBack);
+    g_pRSCullBack = g_StateCache.Rasterizer(g_pDevice, rsDesc);
     rsDesc.CullMode = D3D11_CULL_NONE;
-    g_pDevice->CreateRasterizerState(&rsDesc, &g_pRSCullNone);
+    g_pRSCullNone = g_StateCache.Rasterizer(g_pDevice, rsDesc);
+
+    // Свечение: билинейный сэмплер с clamp (выборки пирамиды считают на край clamp) и смешивание подъёма
+    D3D11_SAMPLER_DESC clampDesc = {};
+    clampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    clampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    clampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    clampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    clampDesc.MaxLOD = FLT_MAX;
+    clampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    g_pLinearClampSampler = g_StateCache.Sampler(g_pDevice, clampDesc);
+    D3D11_BLEND_DESC blendDesc = {};
+    blendDesc.RenderTarget[0].BlendEnable = TRUE;
+    blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_BLEND_FACTOR;
+    blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_BLEND_FACTOR;
+    blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+    blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+    blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+    blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+    blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    g_pBloomBlend = g_StateCache.Blend(g_pDevice, blendDesc);
 }
 
 // ------------------------------------------------------------------
@@ -1220,6 +2393,9 @@ void LoadTextureArray()
     ID3D11Texture2D* pTexArray = nullptr;
     HRESULT hr = g_pDevice->CreateTexture2D(&texDesc, initData.data(), &pTexArray);
 
+    g_SwScene.textures.resize(NUM_TEXTURES);
+    for (UINT tex = 0; tex < NUM_TEXTURES; ++tex) DecodeSwTexture(texDescs[tex], mipDataPerTex[tex][0], g_SwScene.textures[tex]);
+
     // Освобождаем выделенную память (каждый TextureDesc.pData указывает на начало блока всех мипов)
     for (auto& td : texDescs) if (td.pData) free(td.pData);
 
@@ -1245,11 +2421,14 @@ void CreateInstances()
     float radius = 3.0f;
     for (UINT i = 0; i < MAX_INSTANCES; ++i)
     {
-        // Золотое сечение для равномерного распределения по сфере
+        // Золотое сечение для равномерного распределения по сфере. Точки спирали берутся с шагом 7
+        // (взаимно просто с MAX_INSTANCES): любой префикс массива, который оставляет регулятор кадра
+        // при снижении плотности, покрывает всю сферу, а не её верх
+        UINT k = (i * 7) % MAX_INSTANCES;
         float phi = XM_PI * (3.0f - sqrtf(5.0f));
-        float y = 1.0f - (i / (float)(MAX_INSTANCES - 1)) * 2.0f;
+        float y = 1.0f - (k / (float)(MAX_INSTANCES - 1)) * 2.0f;
         float radiusAtY = sqrtf(1.0f - y * y);
-        float theta = i * phi * 2.0f * XM_PI;
+        float theta = k * phi * 2.0f * XM_PI;
         float x = cosf(theta) * radiusAtY;
         float z = sinf(theta) * radiusAtY;
         XMFLOAT3 pos(x * radius, y * radius, z * radius);
@@ -1265,9 +2444,31 @@ void CreateInstances()
         float normalMapPresence = (texId == 0) ? 1.0f : 0.0f; // только первая текстура имеет normal map
         g_Instances[i].shineSpeedTexIdNM = XMFLOAT4(shininess, rotSpeed, (float)texId, normalMapPresence);
         g_Instances[i].angle = XMFLOAT4(pos.x, pos.y, pos.z, 0.0f);
+        g_InstanceMesh[i] = (i / 2) % MESH_COUNT; // пары кубов и сфер
     }
 }
 
+// Два прежних источника сцены плюс россыпь мелких цветных вокруг экземпляров
+void CreateLights()
+{
+    g_Lights.clear();
+    PointLight red = { MakeFloat3(0.0f, 2.0f, 0.0f), 12.0f, MakeFloat3(1.0f, 0.0f, 0.0f), 0.0f };
+    PointLight blue = { MakeFloat3(0.0f, 2.0f, 2.5f), 12.0f, MakeFloat3(0.6f, 0.8f, 1.0f), 0.0f };
+    g_Lights.push_back(red);
+    g_Lights.push_back(blue);
+    for (UINT i = 2; i < SCENE_LIGHT_COUNT; ++i)
+    {
+        PointLight l;
+        l.pos = MakeFloat3((rand() % 1000) / 125.0f - 4.0f, (rand() % 1000) / 125.0f - 4.0f, (rand() % 1000) / 125.0f - 4.0f);
+        l.radius = 0.5f + (rand() % 100) / 100.0f;
+        l.color = MakeFloat3((rand() % 100) / 400.0f, (rand() % 100) / 400.0f, (rand() % 100) / 400.0f);
+        l.padding = 0.0f;
+        g_Lights.push_back(l);
+    }
+    g_LightBinThreads = (std::max)(1u, std::thread::hardware_concurrency());
+    g_LightGrid.Build(g_Lights.data(), (uint32_t)g_Lights.size());
+}
+
 void UpdateInstanceTransforms(double time)
 {
     for (UINT i = 0; i < g_InstanceCount; ++i)
@@ -1280,6 +2481,17 @@ void UpdateInstanceTransforms(double time)
     }
 }
 
+// Буфер слота свободен от GPU (FramePipeline), так что WRITE_DISCARD не ждёт и не копирует
+void WriteDynamicBuffer(ID3D11Buffer* buffer, const void* data, size_t size)
+{
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (g_pFrame->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        memcpy(mapped.pData, data, size);
+        g_pFrame->Unmap(buffer, 0);
+    }
+}
+
 void UpdateAABBBuffer()
 {
     XMVECTOR localMin = XMVectorSet(-0.5f, -0.5f, -0.5f, 1.0f);
@@ -1290,8 +2502,9 @@ void UpdateAABBBuffer()
         TransformAABB(g_Instances[i].model, localMin, localMax, worldMin, worldMax);
         XMStoreFloat4(&g_cullParams.bbMin[i], worldMin);
         XMStoreFloat4(&g_cullParams.bbMax[i], worldMax);
+        g_cullParams.bbMin[i].w = (float)g_InstanceMesh[i]; // w не участвует в тесте, несёт номер мэша
     }
-    g_pDeviceContext->UpdateSubresource(g_pCullParamsCB, 0, nullptr, &g_cullParams, 0, 0);
+    WriteDynamicBuffer(g_FrameResources[g_FrameSlot].cullParams, &g_cullParams, sizeof(g_cullParams));
 }
 
 void UpdateFrustumPlanesCB(const XMMATRIX& vp)
@@ -1301,22 +2514,190 @@ void UpdateFrustumPlanesCB(const XMMATRIX& vp)
     XMFLOAT4 planesCPU[6];
     for (int i = 0; i < 6; ++i)
         XMStoreFloat4(&planesCPU[i], planes[i]);
-    g_pDeviceContext->UpdateSubresource(g_pFrustumPlanesCB, 0, nullptr, planesCPU, 0, 0);
+    WriteDynamicBuffer(g_FrameResources[g_FrameSlot].frustumPlanes, planesCPU, sizeof(planesCPU));
 }
 
-void ReadQueries()
+// Статистика кадра, завершённого GPU: забор слота пройден, запросы и копии готовы
+void ReadFrameStats(uint32_t slot, uint64_t)
 {
-    while (g_lastCompletedFrame < g_curFrame) {
-        D3D11_QUERY_DATA_PIPELINE_STATISTICS stats;
-        HRESULT hr = g_pDeviceContext->GetData(g_pQueries[g_lastCompletedFrame % 10], &stats, sizeof(stats), 0);
-        if (hr == S_OK) {
-            g_gpuVisibleInstances = (int)(stats.IAPrimitives / 12); // 12 triangles per cube (36 indices / 3)
-            ++g_lastCompletedFrame;
-        }
-        else {
-            break;
+    FrameResources& res = g_FrameResources[slot];
+    // Время GPU; при сбое счётчика (смена частоты, питание) кадр пропускается.
+    // Пустой бэкенд отвечает нулями - частота 0, времени нет
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+    UINT64 timeStart = 0, timeEnd = 0;
+    if (g_pFrame->GetData(res.timeDisjoint, &disjoint, sizeof(disjoint), true) &&
+        g_pFrame->GetData(res.timeStart, &timeStart, sizeof(timeStart), true) &&
+        g_pFrame->GetData(res.timeEnd, &timeEnd, sizeof(timeEnd), true))
+    {
+        if (disjoint.Frequency == 0) g_FrameGpuMs = 0.0;
+        else if (!disjoint.Disjoint && timeEnd >= timeStart) g_FrameGpuMs = (timeEnd - timeStart) * 1000.0 / disjoint.Frequency;
+    }
+
+    D3D11_QUERY_DATA_PIPELINE_STATISTICS stats;
+    if (!g_pFrame->GetData(res.stats, &stats, sizeof(stats), true)) return;
+    g_gpuVisibleTriangles = (int)stats.IAPrimitives;
+
+    // Экземпляры и непустые отрисовки - из копий indirect args этого кадра
+    int instances = 0, draws = 0, tinyCulled = 0, tinyCulledVerts = 0;
+    for (UINT phase = 0; phase < res.argsStagingPhases; ++phase) {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (g_pFrame->Map(res.argsStaging[phase], 0, D3D11_MAP_READ, 0, &mapped)) {
+            const D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS* args = (const D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS*)mapped.pData;
+            for (UINT b = 0; b < LOD_BUCKETS; ++b) {
+                if (args[b].InstanceCount == 0) continue;
+                instances += (int)args[b].InstanceCount;
+                ++draws;
+            }
+            const UINT* cullStats = (const UINT*)(args + LOD_BUCKETS);
+            tinyCulled += (int)cullStats[0];
+            tinyCulledVerts += (int)cullStats[1];
+            g_pFrame->Unmap(res.argsStaging[phase], 0);
         }
     }
+    g_gpuVisibleInstances = instances;
+    g_gpuBatchDraws = draws;
+    g_gpuContributionCulled = tinyCulled;
+    g_gpuContributionCulledVerts = tinyCulledVerts;
+
+    // Перекрытые с точки зрения GPU: были в фрустуме, когда считались списки, но история видимости - 0.
+    // Пустой бэкенд видимость не считает
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (res.lightFrustumValid && !g_UseNullBackend && g_pFrame->Map(res.visibilityStaging, 0, D3D11_MAP_READ, 0, &mapped)) {
+        const UINT* visible = (const UINT*)mapped.pData;
+        for (UINT w = 0; w < VisibilityWordCount(MAX_INSTANCES); ++w)
+            g_GpuOccluded[w] = res.lightFrustum[w] & ~visible[w];
+        g_pFrame->Unmap(res.visibilityStaging, 0);
+    }
+    else
+        memset(g_GpuOccluded, 0, sizeof(g_GpuOccluded));
+}
+
+// Кластерный culling для экземпляров-сфер: диапазоны индексов LOD0, оставшиеся после отсечения
+// кластеров; соседние кластеры экземпляра сливаются в одну отрисовку. Экземпляр в фрустуме
+// получает слот: StartInstanceLocation его диапазонов и строка g_MeshletInstanceIds
+void CullSphereMeshlets(const XMMATRIX& vp, const XMFLOAT3& eye)
+{
+    Float4x4 vpCPU;
+    XMStoreFloat4x4((XMFLOAT4X4*)&vpCPU, vp);
+    Float4 planes[6];
+    BuildFrustumPlanesCPU(vpCPU, planes);
+    Float3 eyeCPU = MakeFloat3(eye.x, eye.y, eye.z);
+
+    g_MeshletDraws.clear();
+    g_MeshletStats = MeshletCullStats();
+    const MeshLod& lod = g_Meshes[1].lods[0];
+    UINT slot = 0;
+    for (UINT i = 0; i < g_InstanceCount; ++i)
+    {
+        if (g_InstanceMesh[i] != 1) continue;
+        Float3 bmin = MakeFloat3(g_cullParams.bbMin[i].x, g_cullParams.bbMin[i].y, g_cullParams.bbMin[i].z);
+        Float3 bmax = MakeFloat3(g_cullParams.bbMax[i].x, g_cullParams.bbMax[i].y, g_cullParams.bbMax[i].z);
+        if (!IsAABBInsideFrustumCPU(planes, bmin, bmax)) continue;
+        Float4x4 world;
+        XMStoreFloat4x4((XMFLOAT4X4*)&world, g_Instances[i].model);
+        g_MeshletInstanceIds[slot] = XMUINT4(i, 1 * MAX_LODS, 0, 0);
+        CullMeshlets(g_SphereMeshlets, world, planes, eyeCPU, lod.startIndex, lod.baseVertex, slot++, g_MeshletDraws, g_MeshletStats);
+    }
+}
+
+// ------------------------------------------------------------------
+// Кластерное освещение
+// ------------------------------------------------------------------
+bool EnsureClusterIndexCapacity(UINT count)
+{
+    if (count <= g_ClusterIndexCapacity && g_pClusterIndicesBuffer) return true;
+    SAFE_RELEASE(g_pClusterIndicesSRV);
+    SAFE_RELEASE(g_pClusterIndicesBuffer);
+    UINT capacity = (std::max)(count + count / 2, CLUSTER_COUNT * 16);
+
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = sizeof(UINT) * capacity;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = sizeof(UINT);
+    HRESULT hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pClusterIndicesBuffer);
+    if (FAILED(hr)) { OutputDebugStringA("CreateBuffer(ClusterIndices) failed\n"); g_ClusterIndexCapacity = 0; return false; }
+    hr = g_pDevice->CreateShaderResourceView(g_pClusterIndicesBuffer, nullptr, &g_pClusterIndicesSRV);
+    if (FAILED(hr)) { OutputDebugStringA("CreateShaderResourceView(ClusterIndices) failed\n"); g_ClusterIndexCapacity = 0; return false; }
+    SetResourceName(g_pClusterIndicesBuffer, "ClusterIndices");
+    g_ClusterIndexCapacity = capacity;
+    return true;
+}
+
+// Раскладка источников по кластерам и загрузка списков; границы кластеров пересчитываются при смене размера
+void UpdateLightClusters(const XMMATRIX& view, const XMMATRIX& proj, float nearZ, float farZ)
+{
+    XMFLOAT4X4 p;
+    XMStoreFloat4x4(&p, proj);
+    if (g_ClusterBoundsDirty)
+    {
+        g_LightClusters.BuildBounds(p._11, p._22, nearZ, farZ);
+        ClusterParams params;
+        params.grid = XMUINT4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 0);
+        params.depth = XMFLOAT4(nearZ, farZ, CLUSTER_GRID_Z / logf(farZ / nearZ), 0.0f);
+        params.screen = XMFLOAT4((float)g_RenderWidth, (float)g_RenderHeight, 0.0f, 0.0f);
+        g_pFrame->UpdateSubresource(g_pClusterParamsCB, 0, nullptr, &params, 0, 0);
+        g_ClusterBoundsDirty = false;
+    }
+
+    Float4x4 viewCPU;
+    XMStoreFloat4x4((XMFLOAT4X4*)&viewCPU, view);
+    auto start = std::chrono::high_resolution_clock::now();
+    g_LightClusters.Build(viewCPU, g_Lights.data(), (uint32_t)g_Lights.size(), g_LightBinThreads);
+    g_LightBinMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (g_pFrame->Map(g_pClusterRangesBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        memcpy(mapped.pData, g_LightClusters.ranges.data(), sizeof(UINT) * g_LightClusters.ranges.size());
+        g_pFrame->Unmap(g_pClusterRangesBuffer, 0);
+    }
+    if (!EnsureClusterIndexCapacity((UINT)g_LightClusters.indices.size())) return;
+    if (!g_LightClusters.indices.empty() && g_pFrame->Map(g_pClusterIndicesBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        memcpy(mapped.pData, g_LightClusters.indices.data(), sizeof(UINT) * g_LightClusters.indices.size());
+        g_pFrame->Unmap(g_pClusterIndicesBuffer, 0);
+    }
+}
+
+// Списки источников для экземпляров в фрустуме, кроме перекрытых по последней прочитанной видимости GPU
+// (видимость текущего кадра появится только после culling, который ещё не записан)
+void UpdateInstanceLights(const XMMATRIX& vp)
+{
+    FrameResources& res = g_FrameResources[g_FrameSlot];
+    res.lightFrustumValid = false;
+    if (!g_UsePerObjectLights) return;
+    Float4x4 vpCPU;
+    XMStoreFloat4x4((XMFLOAT4X4*)&vpCPU, vp);
+    Float4 planes[6];
+    BuildFrustumPlanesCPU(vpCPU, planes);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    g_InstanceLightBoxes.Resize(g_InstanceCount);   // без выделений, пока число экземпляров не растёт
+    memset(res.lightFrustum, 0, sizeof(res.lightFrustum));
+    uint32_t visible[MAX_INSTANCES];
+    uint32_t visibleCount = 0;
+    for (UINT i = 0; i < g_InstanceCount; ++i)
+    {
+        Float3 bmin = MakeFloat3(g_cullParams.bbMin[i].x, g_cullParams.bbMin[i].y, g_cullParams.bbMin[i].z);
+        Float3 bmax = MakeFloat3(g_cullParams.bbMax[i].x, g_cullParams.bbMax[i].y, g_cullParams.bbMax[i].z);
+        g_InstanceLightBoxes.Set(i, bmin, bmax, g_InstanceMesh[i]);
+        if (!IsAABBInsideFrustumCPU(planes, bmin, bmax)) continue;
+        res.lightFrustum[i >> 5] |= 1u << (i & 31);
+        if (!(g_GpuOccluded[i >> 5] & (1u << (i & 31)))) visible[visibleCount++] = i;
+    }
+    res.lightFrustumValid = true;
+    g_InstanceLightLists.Assign(g_LightGrid, g_InstanceLightBoxes, visible, visibleCount, g_LightBinThreads);
+    g_InstanceLightMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (g_pFrame->Map(g_pInstanceLightsBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        memcpy(mapped.pData, g_InstanceLightLists.lists.data(), sizeof(UINT) * g_InstanceLightLists.lists.size());
+        g_pFrame->Unmap(g_pInstanceLightsBuffer, 0);
+    }
 }
 
 // ------------------------------------------------------------------
@@ -1379,38 +2760,257 @@ bool IsAABBInsideFrustum(const XMVECTOR planes[6], const XMVECTOR& aabbMin, cons
 // ------------------------------------------------------------------
 // Постпроцессинг: текстура для рендера
 // ------------------------------------------------------------------
-void SetupColorBuffer(UINT width, UINT height)
+void ReleaseTransientTextures()
 {
-    SAFE_RELEASE(g_pColorBuffer);
-    SAFE_RELEASE(g_pColorBufferRTV);
-    SAFE_RELEASE(g_pColorBufferSRV);
+    for (TransientTexture& t : g_TransientTextures)
+    {
+        SAFE_RELEASE(t.srv);
+        SAFE_RELEASE(t.rtv);
+        SAFE_RELEASE(t.texture);
+    }
+    g_TransientTextures.clear();
+}
+
+// Объявление кадра: проходы и их цели. Граф отсекает ненужные проходы и раздаёт
+// временным целям текстуры пула (с общими текстурами для непересекающихся по времени целей).
+void BuildRenderGraph(UINT width, UINT height)
+{
+    RenderGraph& graph = g_RenderGraph;
+    graph.Reset();
+    uint32_t backBuffer = graph.Import("BackBuffer");
+    uint32_t depth = graph.Import("Depth");
+    g_rgSceneColor = RenderGraph::INVALID;
+    // Со слиянием серый уже в цели сцены; с регулятором кадра проход растягивает область рендера на экран
+    bool filterPass = (g_UseFilter && !g_FuseGrayscale) || g_UseBloom || g_UseGovernor;
+    if (filterPass)
+    {
+        RGTextureDesc colorDesc;
+        colorDesc.width = width;
+        colorDesc.height = height;
+        colorDesc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        colorDesc.bytesPerPixel = 4;
+        g_rgSceneColor = graph.CreateTexture("SceneColor", colorDesc);
+    }
+    uint32_t sceneTarget = filterPass ? g_rgSceneColor : backBuffer;
+    g_rgGBufferAlbedo = g_rgGBufferNormal = RenderGraph::INVALID;
+    if (g_UseDeferred)
+    {
+        RGTextureDesc gbufferDesc;
+        gbufferDesc.width = width;
+        gbufferDesc.height = height;
+        gbufferDesc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        gbufferDesc.bytesPerPixel = 4;
+        g_rgGBufferAlbedo = graph.CreateTexture("GBufferAlbedo", gbufferDesc);
+        gbufferDesc.format = DXGI_FORMAT_R16G16_SNORM;
+        g_rgGBufferNormal = graph.CreateTexture("GBufferNormal", gbufferDesc);
+    }
+    g_BloomLevels = g_UseBloom ? BloomLevelCount(width, height) : 0;
+    RGTextureDesc bloomDesc;
+    bloomDesc.width = width;
+    bloomDesc.height = height;
+    bloomDesc.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    bloomDesc.bytesPerPixel = 8;
+    for (UINT i = 0; i < g_BloomLevels; ++i)
+    {
+        bloomDesc.width = BloomLevelSize(bloomDesc.width);
+        bloomDesc.height = BloomLevelSize(bloomDesc.height);
+        g_rgBloom[i] = graph.CreateTexture(("Bloom" + std::to_string(i)).c_str(), bloomDesc);
+    }
+
+    uint32_t skybox = graph.AddPass("Skybox");
+    graph.Write(skybox, sceneTarget);
+    graph.Write(skybox, depth);
+    uint32_t instanced = graph.AddPass("Instanced", true);   // запросы статистики и readback
+    if (g_UseDeferred)
+    {
+        graph.Write(instanced, g_rgGBufferAlbedo);
+        graph.Write(instanced, g_rgGBufferNormal);
+    }
+    else
+        graph.Write(instanced, sceneTarget);
+    graph.Write(instanced, depth);
+    uint32_t lighting = graph.AddPass("DeferredLighting");   // без G-буфера отсекается
+    if (g_UseDeferred)
+    {
+        graph.Read(lighting, g_rgGBufferAlbedo);
+        graph.Read(lighting, g_rgGBufferNormal);
+        graph.Read(lighting, depth);
+        graph.Write(lighting, sceneTarget);
+    }
+    uint32_t bloom = graph.AddPass("Bloom");   // без свечения отсекается
+    if (g_BloomLevels)
+    {
+        graph.Read(bloom, g_rgSceneColor);
+        for (UINT i = 0; i < g_BloomLevels; ++i) graph.Write(bloom, g_rgBloom[i]);
+    }
+    uint32_t post = graph.AddPass("PostProcess");
+    if (filterPass)
+    {
+        graph.Read(post, g_rgSceneColor);
+        if (g_BloomLevels) graph.Read(post, g_rgBloom[0]);
+        graph.Write(post, backBuffer);
+    }
+    assert(skybox == RECORD_SKYBOX && instanced == RECORD_INSTANCED && lighting == RECORD_DEFERRED_LIGHTING && bloom == RECORD_BLOOM && post == RECORD_POSTPROCESS);
+    bool compiled = graph.Compile();
+    assert(compiled);
+
+    ReleaseTransientTextures();
+    g_TransientTextures.resize(graph.physical.size());
+    for (size_t i = 0; i < graph.physical.size(); ++i)
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Format = (DXGI_FORMAT)graph.physical[i].format;
+        desc.ArraySize = 1;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.Width = graph.physical[i].width;
+        desc.Height = graph.physical[i].height;
+        desc.MipLevels = 1;
+        TransientTexture& t = g_TransientTextures[i];
+        HRESULT hr = g_pDevice->CreateTexture2D(&desc, nullptr, &t.texture);
+        if (SUCCEEDED(hr)) hr = g_pDevice->CreateRenderTargetView(t.texture, nullptr, &t.rtv);
+        if (SUCCEEDED(hr)) hr = g_pDevice->CreateShaderResourceView(t.texture, nullptr, &t.srv);
+        assert(SUCCEEDED(hr));
+        SetResourceName(t.texture, "RenderGraphTransient" + std::to_string(i));
+    }
+
+    char msg[160];
+    sprintf_s(msg, "Render graph: %u of %u passes live, transient %llu KB -> %llu KB aliased (%u textures)\n",
+        (unsigned)graph.order.size(), (unsigned)graph.passes.size(), graph.transientBytes / 1024, graph.aliasedBytes / 1024, (unsigned)graph.physical.size());
+    OutputDebugStringA(msg);
+}
+
+// ------------------------------------------------------------------
+// Буфер глубины (typeless, чтобы читать его при построении Hi-Z)
+// ------------------------------------------------------------------
+bool SetupDepthBuffer(UINT width, UINT height)
+{
+    SAFE_RELEASE(g_pDepthStencilView);
+    SAFE_RELEASE(g_pDepthSRV);
+
+    D3D11_TEXTURE2D_DESC depthDesc = {};
+    depthDesc.Width = width;
+    depthDesc.Height = height;
+    depthDesc.MipLevels = 1;
+    depthDesc.ArraySize = 1;
+    depthDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+    depthDesc.SampleDesc.Count = 1;
+    depthDesc.SampleDesc.Quality = 0;
+    depthDesc.Usage = D3D11_USAGE_DEFAULT;
+    depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+    ID3D11Texture2D* pDepthStencil = nullptr;
+    HRESULT hr = g_pDevice->CreateTexture2D(&depthDesc, nullptr, &pDepthStencil);
+    if (FAILED(hr)) return false;
+
+    D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+    dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+    dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+    hr = g_pDevice->CreateDepthStencilView(pDepthStencil, &dsvDesc, &g_pDepthStencilView);
+    if (SUCCEEDED(hr))
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+        hr = g_pDevice->CreateShaderResourceView(pDepthStencil, &srvDesc, &g_pDepthSRV);
+    }
+    pDepthStencil->Release();
+    if (FAILED(hr)) return false;
+
+    SetupHiZ(width, height);
+    return true;
+}
+
+// ------------------------------------------------------------------
+// Пирамида глубины: полная цепочка мипов, view на каждый мип
+// ------------------------------------------------------------------
+void SetupHiZ(UINT width, UINT height)
+{
+    SAFE_RELEASE(g_pHiZTexture);
+    SAFE_RELEASE(g_pHiZSRV);
+    for (auto& srv : g_HiZMipSRVs) { SAFE_RELEASE(srv); }
+    for (auto& uav : g_HiZMipUAVs) { SAFE_RELEASE(uav); }
+
+    g_HiZMipCount = DepthPyramidMipCount(width, height);
+    g_HiZMipSRVs.assign(g_HiZMipCount, nullptr);
+    g_HiZMipUAVs.assign(g_HiZMipCount, nullptr);
 
     D3D11_TEXTURE2D_DESC desc = {};
-    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = g_HiZMipCount;
     desc.ArraySize = 1;
-    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    desc.CPUAccessFlags = 0;
-    desc.MiscFlags = 0;
+    desc.Format = DXGI_FORMAT_R32_FLOAT;
     desc.SampleDesc.Count = 1;
-    desc.SampleDesc.Quality = 0;
     desc.Usage = D3D11_USAGE_DEFAULT;
-    desc.Height = height;
-    desc.Width = width;
-    desc.MipLevels = 1;
-
-    HRESULT hr = g_pDevice->CreateTexture2D(&desc, nullptr, &g_pColorBuffer);
-    if (SUCCEEDED(hr)) hr = g_pDevice->CreateRenderTargetView(g_pColorBuffer, nullptr, &g_pColorBufferRTV);
-    if (SUCCEEDED(hr)) hr = g_pDevice->CreateShaderResourceView(g_pColorBuffer, nullptr, &g_pColorBufferSRV);
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    HRESULT hr = g_pDevice->CreateTexture2D(&desc, nullptr, &g_pHiZTexture);
     assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateShaderResourceView(g_pHiZTexture, nullptr, &g_pHiZSRV);
+    assert(SUCCEEDED(hr));
+
+    for (UINT mip = 0; mip < g_HiZMipCount; ++mip)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MostDetailedMip = mip;
+        srvDesc.Texture2D.MipLevels = 1;
+        hr = g_pDevice->CreateShaderResourceView(g_pHiZTexture, &srvDesc, &g_HiZMipSRVs[mip]);
+        assert(SUCCEEDED(hr));
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = mip;
+        hr = g_pDevice->CreateUnorderedAccessView(g_pHiZTexture, &uavDesc, &g_HiZMipUAVs[mip]);
+        assert(SUCCEEDED(hr));
+    }
+
+    g_occlusionParams.hizMipCount = g_HiZMipCount;
+    g_occlusionParams.hizSize = XMFLOAT2((float)width, (float)height);
+}
+
+void BuildHiZ(PassContext& pass, UINT targetCount, ID3D11RenderTargetView* const* targets)
+{
+    // Глубина читается как SRV, поэтому снимаем её с OM
+    pass.context->OMSetRenderTargets(targetCount, targets, nullptr);
+    pass.context->CSSetShader(g_pHiZCS);
+    pass.context->CSSetConstantBuffers(0, 1, &g_pHiZParamsCB);
+
+    UINT srcW = (UINT)g_occlusionParams.hizSize.x, srcH = (UINT)g_occlusionParams.hizSize.y;
+    ID3D11ShaderResourceView* nullSRV = nullptr;
+    ID3D11UnorderedAccessView* nullUAV = nullptr;
+    for (UINT mip = 0; mip < g_HiZMipCount; ++mip)
+    {
+        UINT dstW = (mip == 0) ? srcW : max(srcW / 2, 1u);
+        UINT dstH = (mip == 0) ? srcH : max(srcH / 2, 1u);
+        HiZParams params = { srcW, srcH, dstW, dstH, mip == 0 ? 1u : 0u, { 0, 0, 0 } };
+        pass.context->UpdateSubresource(g_pHiZParamsCB, 0, nullptr, &params, 0, 0);
+
+        ID3D11ShaderResourceView* src = (mip == 0) ? g_pDepthSRV : g_HiZMipSRVs[mip - 1];
+        pass.context->CSSetShaderResources(0, 1, &src);
+        pass.context->CSSetUnorderedAccessViews(0, 1, &g_HiZMipUAVs[mip], nullptr);
+        pass.context->Dispatch(DivUp(dstW, 8u), DivUp(dstH, 8u), 1);
+        pass.context->CSSetShaderResources(0, 1, &nullSRV);
+        pass.context->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+        srcW = dstW; srcH = dstH;
+    }
+
+    ID3D11Buffer* nullCB = nullptr;
+    pass.context->CSSetConstantBuffers(0, 1, &nullCB);
+    pass.context->CSSetShader(nullptr);
+    pass.context->OMSetRenderTargets(targetCount, targets, g_pDepthStencilView);
 }
 
 void CreateGPUResources()
 {
     HRESULT hr;
 
-    // Буфер для аргументов косвенной отрисовки (UAV)
+    // Буфер для аргументов косвенной отрисовки (UAV), по записи на корзину (mesh, LOD)
     D3D11_BUFFER_DESC desc = {};
-    desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS);
+    desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) * LOD_BUCKETS + sizeof(UINT) * CULL_STATS_UINTS;
     desc.Usage = D3D11_USAGE_DEFAULT;
     desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
     desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
@@ -1421,7 +3021,7 @@ void CreateGPUResources()
     assert(SUCCEEDED(hr));
 
     // Буфер для аргументов косвенной отрисовки (только для чтения)
-    desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS);
+    desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) * LOD_BUCKETS + sizeof(UINT) * CULL_STATS_UINTS;
     desc.BindFlags = 0;
     desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
     desc.StructureByteStride = 0;
@@ -1444,35 +3044,253 @@ void CreateGPUResources()
     hr = g_pDevice->CreateShaderResourceView(g_pVisibleIdsStructured, &srvDesc, &g_pVisibleIdsSRV);
     assert(SUCCEEDED(hr));
 
-    // Константный буфер для параметров culling (AABB)
-    desc.ByteWidth = sizeof(CullParams);
+    // Диапазоны кластеров сфер (клавиша K): аргументы косвенной отрисовки и слоты экземпляров
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pMeshletIds);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateShaderResourceView(g_pMeshletIds, &srvDesc, &g_pMeshletIdsSRV);
+    assert(SUCCEEDED(hr));
+    desc.ByteWidth = (UINT)sizeof(IndirectDrawArgs) * MAX_INSTANCES * (std::max)(1u, (UINT)g_SphereMeshlets.meshlets.size());
+    desc.BindFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+    desc.StructureByteStride = 0;
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pMeshletArgs);
+    assert(SUCCEEDED(hr));
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = sizeof(XMUINT4);
+
+    // Константные буферы параметров culling (AABB) и плоскостей фрустума - по слоту на кадр в полёте
+    desc.Usage = D3D11_USAGE_DYNAMIC;
     desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     desc.MiscFlags = 0;
-    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pCullParamsCB);
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        desc.ByteWidth = sizeof(CullParams);
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_FrameResources[i].cullParams);
+        assert(SUCCEEDED(hr));
+        desc.ByteWidth = sizeof(XMFLOAT4) * 6;
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_FrameResources[i].frustumPlanes);
+        assert(SUCCEEDED(hr));
+    }
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.CPUAccessFlags = 0;
+
+    // Константные буферы occlusion culling
+    desc.ByteWidth = sizeof(OcclusionParams);
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pOcclusionParamsCB);
+    assert(SUCCEEDED(hr));
+    desc.ByteWidth = sizeof(HiZParams);
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pHiZParamsCB);
+    assert(SUCCEEDED(hr));
+
+    // История видимости (бит на экземпляр), в первом кадре всё невидимо
+    std::vector<UINT> historyInit(VisibilityWordCount(MAX_INSTANCES), 0u);
+    D3D11_SUBRESOURCE_DATA historyData = { historyInit.data() };
+    desc.ByteWidth = sizeof(UINT) * (UINT)historyInit.size();
+    desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = sizeof(UINT);
+    hr = g_pDevice->CreateBuffer(&desc, &historyData, &g_pVisibilityHistory);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateUnorderedAccessView(g_pVisibilityHistory, nullptr, &g_pVisibilityHistoryUAV);
     assert(SUCCEEDED(hr));
 
-    // Константный буфер для плоскостей фрустума
-    desc.ByteWidth = sizeof(XMFLOAT4) * 6;
-    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pFrustumPlanesCB);
+    // Корзины экземпляров (с рангом внутри группы) и смещения групп в корзинах
+    desc.ByteWidth = sizeof(UINT) * MAX_INSTANCES;
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pInstanceBuckets);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateUnorderedAccessView(g_pInstanceBuckets, nullptr, &g_pInstanceBucketsUAV);
+    assert(SUCCEEDED(hr));
+    desc.ByteWidth = sizeof(UINT) * LOD_BUCKETS * ((MAX_INSTANCES + 63) / 64);
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pGroupBucketOffsets);
     assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateUnorderedAccessView(g_pGroupBucketOffsets, nullptr, &g_pGroupBucketOffsetsUAV);
+    assert(SUCCEEDED(hr));
+
+    // Таблица LOD для culling (не меняется)
+    LodParams lodParams = {};
+    for (UINT b = 0; b < LOD_BUCKETS; ++b)
+    {
+        const MeshLodChain& mesh = g_Meshes[b / MAX_LODS];
+        const MeshLod& lod = mesh.lods[b % MAX_LODS];
+        lodParams.lodRanges[b] = XMUINT4(lod.indexCount, lod.startIndex, (UINT)lod.baseVertex, mesh.lodCount);
+    }
+    for (UINT m = 0; m < MESH_COUNT; ++m)
+        lodParams.lodScreenSizes[m] = XMFLOAT4(g_Meshes[m].minScreenSize[0], g_Meshes[m].minScreenSize[1], g_Meshes[m].minScreenSize[2], g_Meshes[m].minScreenSize[3]);
+    D3D11_SUBRESOURCE_DATA lodData = { &lodParams };
+    desc.ByteWidth = sizeof(LodParams);
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+    hr = g_pDevice->CreateBuffer(&desc, &lodData, &g_pLodParamsCB);
+    assert(SUCCEEDED(hr));
+
+    // Staging-копии indirect args для чтения статистики без ожидания GPU
+    desc.ByteWidth = sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS) * LOD_BUCKETS + sizeof(UINT) * CULL_STATS_UINTS;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i)
+        for (int phase = 0; phase < 2; ++phase) {
+            hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_FrameResources[i].argsStaging[phase]);
+            assert(SUCCEEDED(hr));
+        }
+    desc.ByteWidth = sizeof(UINT) * VisibilityWordCount(MAX_INSTANCES);
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+        hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_FrameResources[i].visibilityStaging);
+        assert(SUCCEEDED(hr));
+    }
 
-    // Запросы для pipeline statistics
+    // Источники света (неизменны) и списки кластеров (обновляются каждый кадр)
+    desc.ByteWidth = (UINT)(sizeof(PointLight) * g_Lights.size());
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = sizeof(PointLight);
+    D3D11_SUBRESOURCE_DATA lightData = { g_Lights.data() };
+    hr = g_pDevice->CreateBuffer(&desc, &lightData, &g_pLightsBuffer);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateShaderResourceView(g_pLightsBuffer, nullptr, &g_pLightsSRV);
+    assert(SUCCEEDED(hr));
+
+    desc.ByteWidth = sizeof(UINT) * 2 * CLUSTER_COUNT;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.StructureByteStride = sizeof(UINT) * 2;
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pClusterRangesBuffer);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateShaderResourceView(g_pClusterRangesBuffer, nullptr, &g_pClusterRangesSRV);
+    assert(SUCCEEDED(hr));
+    EnsureClusterIndexCapacity(0);
+
+    desc.ByteWidth = sizeof(UINT) * MAX_INSTANCES * InstanceLightLists::Stride();
+    desc.StructureByteStride = sizeof(UINT);
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pInstanceLightsBuffer);
+    assert(SUCCEEDED(hr));
+    hr = g_pDevice->CreateShaderResourceView(g_pInstanceLightsBuffer, nullptr, &g_pInstanceLightsSRV);
+    assert(SUCCEEDED(hr));
+
+    desc.ByteWidth = sizeof(ClusterParams);
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pClusterParamsCB);
+    assert(SUCCEEDED(hr));
+    desc.ByteWidth = sizeof(BloomParams);
+    hr = g_pDevice->CreateBuffer(&desc, nullptr, &g_pBloomParamsCB);
+    assert(SUCCEEDED(hr));
+
+    // Запросы для pipeline statistics и времени GPU, заборы кадров
     D3D11_QUERY_DESC qdesc = {};
-    qdesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
     qdesc.MiscFlags = 0;
-    for (int i = 0; i < 10; ++i) {
-        hr = g_pDevice->CreateQuery(&qdesc, &g_pQueries[i]);
+    g_FramePipeline.context = g_pFrame;
+    g_FramePipeline.slots.resize(FRAMES_IN_FLIGHT);
+    for (UINT i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+        qdesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+        hr = g_pDevice->CreateQuery(&qdesc, &g_FrameResources[i].stats);
+        assert(SUCCEEDED(hr));
+        qdesc.Query = D3D11_QUERY_EVENT;
+        hr = g_pDevice->CreateQuery(&qdesc, &g_FrameResources[i].fence);
+        assert(SUCCEEDED(hr));
+        qdesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+        hr = g_pDevice->CreateQuery(&qdesc, &g_FrameResources[i].timeDisjoint);
         assert(SUCCEEDED(hr));
+        qdesc.Query = D3D11_QUERY_TIMESTAMP;
+        hr = g_pDevice->CreateQuery(&qdesc, &g_FrameResources[i].timeStart);
+        assert(SUCCEEDED(hr));
+        hr = g_pDevice->CreateQuery(&qdesc, &g_FrameResources[i].timeEnd);
+        assert(SUCCEEDED(hr));
+        g_FramePipeline.slots[i].fence = g_FrameResources[i].fence;
+    }
+}
+
+// ------------------------------------------------------------------
+// Фаза culling на GPU: заполняет indirect args и список видимых ID
+// ------------------------------------------------------------------
+void RunCullPhase(PassContext& pass, UINT phase)
+{
+    if (!g_pCullCS || !g_pBatchArgsCS || !g_pScatterCS) return;
+    // Сброс indirect args: счётчики корзин с нуля, остальные поля заполнит batchArgs
+    const UINT zeros[4] = { 0, 0, 0, 0 };
+    pass.context->ClearUnorderedAccessViewUint(g_pIndirectArgsUAVView, zeros);
+    g_occlusionParams.phase = phase;
+    pass.context->UpdateSubresource(g_pOcclusionParamsCB, 0, nullptr, &g_occlusionParams, 0, 0);
+
+    // visibleIds прошлой фазы ещё висит на VS/PS как SRV; снимается через фильтр до Dispatch
+    ID3D11ShaderResourceView* nullSRV = nullptr;
+    pass.VSSetShaderResources(2, 1, &nullSRV);
+    pass.PSSetShaderResources(2, 1, &nullSRV);
+
+    // Запуск compute shader для culling
+    FrameResources& res = g_FrameResources[g_FrameSlot];
+    ID3D11Buffer* csCBs[] = { res.frustumPlanes, res.cullParams, g_pOcclusionParamsCB, g_pLodParamsCB };
+    pass.context->CSSetConstantBuffers(0, 4, csCBs);
+    ID3D11UnorderedAccessView* csUAVs[] = { g_pIndirectArgsUAVView, g_pVisibleIdsUAV, g_pVisibilityHistoryUAV, g_pInstanceBucketsUAV, g_pGroupBucketOffsetsUAV };
+    pass.context->CSSetUnorderedAccessViews(0, 5, csUAVs, nullptr);
+    ID3D11ShaderResourceView* hizSRV = (phase == 2) ? g_pHiZSRV : nullptr;
+    pass.context->CSSetShaderResources(0, 1, &hizSRV);
+
+    // culling + LOD -> префиксная сумма корзин -> раскладка ID
+    UINT groupCount = (g_InstanceCount + 63) / 64;
+    pass.context->CSSetShader(g_pCullCS);
+    pass.Dispatch(groupCount, 1, 1);
+    pass.context->CSSetShader(g_pBatchArgsCS);
+    pass.Dispatch(LOD_BUCKETS, 1, 1);
+    pass.context->CSSetShader(g_pScatterCS);
+    pass.Dispatch(groupCount, 1, 1);
+
+    // Сброс состояний compute
+    ID3D11UnorderedAccessView* nullUAVs[5] = {};
+    pass.context->CSSetUnorderedAccessViews(0, 5, nullUAVs, nullptr);
+    pass.context->CSSetShaderResources(0, 1, &nullSRV);
+    ID3D11Buffer* nullCBs[4] = {};
+    pass.context->CSSetConstantBuffers(0, 4, nullCBs);
+    pass.context->CSSetShader(nullptr);
+
+    // Копирование аргументов для косвенной отрисовки и для статистики
+    pass.context->CopyResource(g_pIndirectArgsDraw, g_pIndirectArgsUAV);
+    UINT stagingPhase = (phase == 2) ? 1 : 0;
+    pass.context->CopyResource(res.argsStaging[stagingPhase], g_pIndirectArgsUAV);
+    res.argsStagingPhases = stagingPhase + 1;
+    if (phase != 1) pass.context->CopyResource(res.visibilityStaging, g_pVisibilityHistory);
+}
+
+void DrawCulledInstances(PassContext& pass)
+{
+    // Установка structured buffer visibleIds для вершинного и пиксельного шейдеров
+    ID3D11ShaderResourceView* srvVisible = g_pVisibleIdsSRV;
+    pass.VSSetShaderResources(2, 1, &srvVisible);
+    pass.PSSetShaderResources(2, 1, &srvVisible);
+
+    // Одна косвенная отрисовка на корзину (mesh, LOD); корзины без LOD пропускаются,
+    // сферы с кластерным culling рисует DrawSphereMeshlets
+    for (UINT b = 0; b < LOD_BUCKETS; ++b)
+    {
+        if (b % MAX_LODS >= g_Meshes[b / MAX_LODS].lodCount) continue;
+        if (g_UseMeshletDraws && b / MAX_LODS == 1) continue;
+        pass.DrawIndexedInstancedIndirect(g_pIndirectArgsDraw, b * sizeof(D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS));
     }
+}
 
-    // Инициализация indirect args нулями
-    D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args = {};
-    args.IndexCountPerInstance = 36;
-    args.InstanceCount = 0;
-    args.StartIndexLocation = 0;
-    args.BaseVertexLocation = 0;
-    args.StartInstanceLocation = 0;
-    g_pDeviceContext->UpdateSubresource(g_pIndirectArgsUAV, 0, nullptr, &args, 0, 0);
+// Сферы LOD0 по диапазонам CullSphereMeshlets: visibleIds на t2 подменяется слотами экземпляров,
+// остальное состояние - как у DrawCulledInstances. Аргументы и слоты пишутся в список прохода
+void DrawSphereMeshlets(PassContext& pass)
+{
+    if (!g_UseMeshletDraws || g_MeshletDraws.empty() || !g_pMeshletArgs || !g_pMeshletIdsSRV) return;
+    UINT drawCount = (std::min)((UINT)g_MeshletDraws.size(), MAX_INSTANCES * (UINT)g_SphereMeshlets.meshlets.size());
+    D3D11_BOX box = { 0, 0, 0, drawCount * (UINT)sizeof(IndirectDrawArgs), 1, 1 };
+    pass.context->UpdateSubresource(g_pMeshletArgs, 0, &box, g_MeshletDraws.data(), 0, 0);
+    pass.context->UpdateSubresource(g_pMeshletIds, 0, nullptr, g_MeshletInstanceIds, 0, 0);
+    ID3D11ShaderResourceView* srvIds = g_pMeshletIdsSRV;
+    pass.VSSetShaderResources(2, 1, &srvIds);
+    pass.PSSetShaderResources(2, 1, &srvIds);
+    for (UINT d = 0; d < drawCount; ++d)
+        pass.DrawIndexedInstancedIndirect(g_pMeshletArgs, d * (UINT)sizeof(IndirectDrawArgs));
 }
 
 // ------------------------------------------------------------------
@@ -1489,30 +3307,163 @@ void UpdateCamera(double deltaTime)
     if (g_CameraPitch < -1.5f) g_CameraPitch = -1.5f;
 }
 
+// ------------------------------------------------------------------
+// Кадр программным растеризатором: тот же вид, что на экране, без GPU
+// ------------------------------------------------------------------
+void CaptureSoftwareFrame(const FrameSetup& frame, const XMFLOAT3& eye)
+{
+    g_SwScene.instances.resize(g_InstanceCount);
+    for (UINT i = 0; i < g_InstanceCount; ++i)
+    {
+        SwInstance& inst = g_SwScene.instances[i];
+        XMStoreFloat4x4((XMFLOAT4X4*)&inst.model, g_Instances[i].model);
+        XMStoreFloat4x4((XMFLOAT4X4*)&inst.normal, g_Instances[i].norm);
+        const MeshLod& lod = g_Meshes[g_InstanceMesh[i]].lods[0];   // полная детализация, без выбора LOD
+        inst.startIndex = lod.startIndex;
+        inst.indexCount = lod.indexCount;
+        inst.baseVertex = lod.baseVertex;
+        inst.texture = (uint32_t)g_Instances[i].shineSpeedTexIdNM.z;
+        inst.shininess = g_Instances[i].shineSpeedTexIdNM.x;
+        inst.normalMap = g_UseNormalMap && g_Instances[i].shineSpeedTexIdNM.w > 0.0f;   // как вариант NORMAL_MAP
+    }
+    XMStoreFloat4x4((XMFLOAT4X4*)&g_SwScene.viewProj, frame.viewProj);
+    XMStoreFloat4x4((XMFLOAT4X4*)&g_SwScene.vpSky, frame.vpSky);
+    g_SwScene.cameraPos = MakeFloat3(eye.x, eye.y, eye.z);
+    g_SwScene.lights = g_Lights;
+    g_SwScene.grayscale = false;   // постобработка - цепочкой CPU ниже, как проход POSTPROCESS после сцены
+
+    if (g_SoftRasterizer.width != g_ClientWidth || g_SoftRasterizer.height != g_ClientHeight)
+        g_SoftRasterizer.Resize(g_ClientWidth, g_ClientHeight);
+    g_SoftRasterizer.threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+    g_SoftRasterizer.Render(g_SwScene);
+
+    // Та же постобработка, что на GPU: фильтр оттенков серого по переключателю
+    PostChain post;
+    if (g_UseFilter) post.Grayscale();
+    std::vector<uint32_t>& pixels = g_SoftRasterizer.color;
+    PostStats postStats;
+    if (g_UseBloom)
+    {
+        // Свечение - те же уровни и фильтры, что у прохода BLOOM; сумма со сценой в RGBA32F идёт в ту же цепочку
+        if (g_SwBloom.width != g_SoftRasterizer.width || g_SwBloom.height != g_SoftRasterizer.height)
+            g_SwBloom.Resize(g_SoftRasterizer.width, g_SoftRasterizer.height);
+        g_SwBloom.Build(pixels.data(), g_Bloom, g_SoftRasterizer.threadCount);
+        g_SwBloomColor.resize(pixels.size() * 4);
+        g_SwBloom.Composite(pixels.data(), g_Bloom, g_SwBloomColor.data(), g_SoftRasterizer.threadCount);
+        postStats = RunPostChain(post, g_SwBloomColor.data(), pixels.data(), pixels.size(), g_SoftRasterizer.threadCount);
+    }
+    else
+        postStats = RunPostChain(post, pixels.data(), pixels.data(), pixels.size(), g_SoftRasterizer.threadCount);
+
+    std::string path = WCSToMBS(GetExePath()) + "frame_sw.tga";
+    bool written = g_SoftRasterizer.WriteTGA(path.c_str());
+    const SwStats& st = g_SoftRasterizer.stats;
+    char buf[512];
+    sprintf_s(buf, "Software frame %ux%u, %u threads: %.2f ms (setup %.2f ms, tiles %.2f ms), triangles %u of %u, bin entries %u -> %s%s\n",
+        g_SoftRasterizer.width, g_SoftRasterizer.height, g_SoftRasterizer.threadCount, st.totalMs, st.setupMs, st.tileMs,
+        st.rasterTriangles, st.triangles, st.binEntries, path.c_str(), written ? "" : " (write failed)");
+    OutputDebugStringA(buf);
+    sprintf_s(buf, "Software post [%s], %s: %.2f ms, %.1f Mpix/s\n",
+        post.Describe().c_str(), postStats.avx2 ? "AVX2" : "scalar", postStats.ms, postStats.MPixelsPerSecond());
+    OutputDebugStringA(buf);
+    if (g_UseBloom)
+    {
+        const BloomStats& bs = g_SwBloom.stats;
+        sprintf_s(buf, "Software bloom: %u levels (%.1f%% of frame pixels), scatter %.1f, %s: %.2f ms (down %.2f ms, up %.2f ms, composite %.2f ms)\n",
+            bs.levels, 100.0 * bs.levelPixels / bs.framePixels, g_Bloom.scatter, bs.avx2 ? "AVX2" : "scalar", bs.TotalMs(), bs.downMs, bs.upMs, bs.compositeMs);
+        OutputDebugStringA(buf);
+    }
+}
+
+// Смена бэкенда только между кадрами: отправленные кадры дожидаются на прежнем
+void SelectFrameBackend(bool useNull)
+{
+    g_FramePipeline.Drain(ReadFrameStats);
+    g_pFrame = useNull ? static_cast<FrameBackend*>(&g_NullImmediate) : &g_D3DImmediate;
+    g_FramePipeline.context = g_pFrame;
+    for (UINT p = 0; p < RECORD_PASS_COUNT; ++p)
+    {
+        FrameBackend* backend = useNull ? static_cast<FrameBackend*>(&g_NullPassBackends[p]) : &g_D3DPassBackends[p];
+        g_PassRecorder.slots[p].context = backend;
+        g_PassFilters[p].context = backend;
+    }
+}
+
+// Варианты пиксельных шейдеров кадра. Всё, от чего они зависят, известно на CPU до записи проходов:
+// режимы - из переключателей, корзина источников - из разбиения по кластерам этого кадра.
+void SelectShaderVariants(FrameSetup& frame)
+{
+    const ShaderPermutations& ips = g_InstancedPSVariants.permutations;
+    uint32_t bucket = LIGHT_BUCKET_SMALL;   // списки экземпляров не длиннее INSTANCE_LIGHT_K
+    if (!g_UsePerObjectLights || frame.deferred)   // отложенное освещение берёт только списки кластеров
+    {
+        uint32_t maxLights = g_LightClusters.maxPerCluster;
+        bucket = maxLights == 0 ? LIGHT_BUCKET_NONE : maxLights <= INSTANCE_LIGHT_K ? LIGHT_BUCKET_SMALL : LIGHT_BUCKET_ANY;
+    }
+    bool fusedGrayscale = FusedGrayscale();
+    uint32_t key = ips.Set(0, IPS_NORMAL_MAP, g_UseNormalMap ? 1 : 0);
+    key = ips.Set(key, IPS_PER_OBJECT_LIGHTS, g_UsePerObjectLights ? 1 : 0);
+    key = ips.Set(key, IPS_LIGHT_BUCKET, bucket);
+    key = ips.Set(key, IPS_GRAYSCALE, fusedGrayscale ? 1 : 0);
+    frame.instancedPS = g_InstancedPSVariants.Select(key);
+    frame.skyboxPS = g_SkyboxPSVariants.Select(g_SkyboxPSVariants.permutations.Set(0, SKY_GRAYSCALE, fusedGrayscale ? 1 : 0));
+    const ShaderPermutations& fps = g_FilterPSVariants.permutations;
+    frame.filterPS = g_FilterPSVariants.Select(fps.Set(fps.Set(0, FPS_GRAYSCALE, g_UseFilter && !fusedGrayscale ? 1 : 0), FPS_BLOOM, frame.bloomLevels ? 1 : 0));
+    frame.deferredPS = nullptr;
+    if (frame.deferred)
+    {
+        const ShaderPermutations& dps = g_DeferredPSVariants.permutations;
+        frame.instancedPS = g_GBufferPSVariants.Select(g_GBufferPSVariants.permutations.Set(0, GPS_NORMAL_MAP, g_UseNormalMap ? 1 : 0));
+        frame.deferredPS = g_DeferredPSVariants.Select(dps.Set(dps.Set(0, DPS_LIGHT_BUCKET, bucket), DPS_GRAYSCALE, fusedGrayscale ? 1 : 0));
+        g_InstancedPSKey = ~0u;   // при возврате в прямой режим вариант снова попадёт в лог
+        return;
+    }
+    if (key != g_InstancedPSKey)
+    {
+        std::string msg = "instancedPS variant: " + ips.Describe(key) + (frame.instancedPS ? "\n" : " (not built)\n");
+        OutputDebugStringA(msg.c_str());
+        g_InstancedPSKey = key;
+    }
+}
+
 // ------------------------------------------------------------------
 // Рендер
 // ------------------------------------------------------------------
 void RenderFrame()
 {
     if (!g_pDeviceContext || !g_pBackBufferRTV || !g_pSwapChain) return;
+    if (g_RenderGraphDirty)
+    {
+        BuildRenderGraph(g_ClientWidth, g_ClientHeight);
+        g_RenderGraphDirty = false;
+    }
+    if (g_UseNullBackend != (g_pFrame == &g_NullImmediate)) SelectFrameBackend(g_UseNullBackend);
+    auto frameStart = std::chrono::high_resolution_clock::now();
+    NullBackendStats frameCalls = NullBackendTotals();
+
+    // Слот кадра: ждём GPU, только если все FRAMES_IN_FLIGHT кадров ещё в работе.
+    // Завершённые кадры отдают статистику по дороге.
+    g_FrameSlot = g_FramePipeline.BeginFrame(ReadFrameStats);
+    FrameResources& frameRes = g_FrameResources[g_FrameSlot];
+    g_pFrame->Begin(frameRes.timeDisjoint);
+    auto workStart = std::chrono::high_resolution_clock::now();   // работа CPU без ожидания слота
+
+    // Качество кадра по решению регулятора: область рендера в целях и число экземпляров
+    float renderScale = g_UseGovernor ? g_Governor.RenderScale() : 1.0f;
+    UINT renderWidth = GovernorRenderSize(g_ClientWidth, renderScale), renderHeight = GovernorRenderSize(g_ClientHeight, renderScale);
+    if (renderWidth != g_RenderWidth || renderHeight != g_RenderHeight)
+    {
+        g_RenderWidth = renderWidth;
+        g_RenderHeight = renderHeight;
+        g_ClusterBoundsDirty = true;   // тайлы кластеров - в пикселях области рендера
+    }
+    g_InstanceCount = g_UseGovernor ? GovernorInstanceCount(MAX_INSTANCES, g_Governor.Density()) : MAX_INSTANCES;
 
     double currentTime = (double)GetTickCount64() / 1000.0;
     double deltaTime = currentTime - g_LastTime;
     g_LastTime = currentTime;
     UpdateCamera(deltaTime);
 
-    // Выбор цели рендера: если фильтр включен, рисуем в текстуру, иначе в back buffer
-    ID3D11RenderTargetView* sceneTarget = g_UseFilter ? g_pColorBufferRTV : g_pBackBufferRTV;
-    g_pDeviceContext->ClearState();
-    g_pDeviceContext->OMSetRenderTargets(1, &sceneTarget, g_pDepthStencilView);
-    const FLOAT clearColor[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
-    g_pDeviceContext->ClearRenderTargetView(sceneTarget, clearColor);
-    g_pDeviceContext->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-    D3D11_VIEWPORT viewport = { 0, 0, (FLOAT)g_ClientWidth, (FLOAT)g_ClientHeight, 0.0f, 1.0f };
-    g_pDeviceContext->RSSetViewports(1, &viewport);
-    g_pDeviceContext->RSSetState(g_pRSCullBack);
-
     // Камера
     float camX = g_CameraDist * sin(g_CameraYaw) * cos(g_CameraPitch);
     float camY = g_CameraDist * sin(g_CameraPitch);
@@ -1525,172 +3476,355 @@ void RenderFrame()
     XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PI / 3.0f, aspect, 0.1f, 100.0f);
     XMMATRIX viewProj = view * proj;
 
-    // Skybox (с отдельной матрицей без трансляции)
-    {
-        XMMATRIX viewNoTrans = view;
-        viewNoTrans.r[3] = XMVectorSet(0, 0, 0, 1);
-        XMMATRIX vpSky = viewNoTrans * proj;
-        D3D11_MAPPED_SUBRESOURCE mapped;
-        if (SUCCEEDED(g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
-        {
-            ViewProjBuffer* pData = (ViewProjBuffer*)mapped.pData;
-            XMStoreFloat4x4((XMFLOAT4X4*)&pData->vp, XMMatrixTranspose(vpSky));
-            g_pDeviceContext->Unmap(g_pViewProjBuffer, 0);
-        }
-        D3D11_DEPTH_STENCIL_DESC dsSky = {};
-        dsSky.DepthEnable = TRUE; dsSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO; dsSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-        ID3D11DepthStencilState* pDSSky = nullptr;
-        g_pDevice->CreateDepthStencilState(&dsSky, &pDSSky);
-        g_pDeviceContext->OMSetDepthStencilState(pDSSky, 0);
-        g_pDeviceContext->RSSetState(g_pRSCullNone);
-        SAFE_RELEASE(pDSSky);
-        g_pDeviceContext->VSSetShader(g_pSkyboxVS, nullptr, 0);
-        g_pDeviceContext->PSSetShader(g_pSkyboxPS, nullptr, 0);
-        g_pDeviceContext->IASetInputLayout(g_pSkyboxInputLayout);
-        UINT stride = sizeof(TexturedVertex);
-        UINT offset = 0;
-        ID3D11Buffer* vbSky[] = { g_pSkyboxVertexBuffer };
-        g_pDeviceContext->IASetVertexBuffers(0, 1, vbSky, &stride, &offset);
-        g_pDeviceContext->IASetIndexBuffer(g_pSkyboxIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-        g_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        ID3D11Buffer* cbsSky[] = { nullptr, g_pViewProjBuffer };
-        g_pDeviceContext->VSSetConstantBuffers(0, 2, cbsSky);
-        ID3D11ShaderResourceView* skySRV[] = { g_pCubemapView };
-        g_pDeviceContext->PSSetShaderResources(1, 1, skySRV);
-        ID3D11SamplerState* samplers[] = { g_pSampler };
-        g_pDeviceContext->PSSetSamplers(1, 1, samplers);
-        g_pDeviceContext->DrawIndexed(36, 0, 0);
-        g_pDeviceContext->RSSetState(g_pRSCullBack);
-        g_pDeviceContext->OMSetDepthStencilState(nullptr, 0);
-    }
-
-    // Обновляем обычный ViewProjBuffer для сцены
+    // Данные кадра пишутся на непосредственном контексте до записи проходов:
+    // списки команд исполняются после, поэтому видят уже обновлённые буферы
     D3D11_MAPPED_SUBRESOURCE mapped;
-    if (SUCCEEDED(g_pDeviceContext->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
-    {
-        ViewProjBuffer* pData = (ViewProjBuffer*)mapped.pData;
-        XMStoreFloat4x4((XMFLOAT4X4*)&pData->vp, XMMatrixTranspose(viewProj));
-        g_pDeviceContext->Unmap(g_pViewProjBuffer, 0);
-    }
-
-    // Обновляем SceneBuffer (освещение)
-    if (SUCCEEDED(g_pDeviceContext->Map(g_pSceneBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    if (g_pFrame->Map(g_pSceneBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
     {
         SceneBuffer* pScene = (SceneBuffer*)mapped.pData;
         XMStoreFloat4x4((XMFLOAT4X4*)&pScene->vp, XMMatrixTranspose(viewProj));
         pScene->cameraPos = XMFLOAT4(camX, camY, camZ, 1.0f);
-        pScene->lightCount.x = 2;
-        pScene->lights[0].pos = XMFLOAT4(0.0f, 2.0f, 0.0f, 1.0f);
-        pScene->lights[0].color = XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f);
-        pScene->lights[1].pos = XMFLOAT4(0.0f, 2.0f, 2.5f, 1.0f);
-        pScene->lights[1].color = XMFLOAT4(0.6f, 0.8f, 1.0f, 1.0f);
+        pScene->lightCount.x = (float)g_Lights.size();
+        pScene->lightCount.z = g_UsePerObjectLights ? 1.0f : 0.0f;
         pScene->ambientColor = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-        g_pDeviceContext->Unmap(g_pSceneBuffer, 0);
+        XMStoreFloat4x4((XMFLOAT4X4*)&pScene->invVp, XMMatrixTranspose(XMMatrixInverse(nullptr, viewProj)));
+        g_pFrame->Unmap(g_pSceneBuffer, 0);
     }
 
+    // Списки источников по кластерам для текущей камеры
+    UpdateLightClusters(view, proj, 0.1f, 100.0f);
+
     // Обновляем матрицы экземпляров
     UpdateInstanceTransforms(currentTime);
-    g_pDeviceContext->UpdateSubresource(g_pGeomBufferInst, 0, nullptr, g_Instances, sizeof(GeomBuffer) * MAX_INSTANCES, 0);
+    WriteDynamicBuffer(g_FrameResources[g_FrameSlot].geomInst, g_Instances, sizeof(GeomBuffer) * MAX_INSTANCES);
 
     // Frustum culling
     // Обновление AABB и плоскостей для GPU culling
     UpdateAABBBuffer();
     UpdateFrustumPlanesCB(viewProj);
+    if (g_UseMeshletDraws) CullSphereMeshlets(viewProj, XMFLOAT3(camX, camY, camZ));
+    UpdateInstanceLights(viewProj);
+    g_occlusionParams.vp = XMMatrixTranspose(viewProj);
+    float minArea[4] = {};
+    for (UINT m = 0; m < MESH_COUNT; ++m) minArea[m] = g_UseContributionCulling ? g_ContributionMinArea[m] : 0.0f;
+    g_occlusionParams.minPixelArea = XMFLOAT4(minArea[0], minArea[1], minArea[2], minArea[3]);
+    g_occlusionParams.hizSize = XMFLOAT2((float)g_RenderWidth, (float)g_RenderHeight);
+    g_occlusionParams.detail = XMFLOAT4(g_UseGovernor ? g_Governor.LodScale() : 1.0f, 0.0f, 0.0f, 0.0f);
 
-    // Сброс indirect args
-    D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS args = {};
-    args.IndexCountPerInstance = 36;
-    args.InstanceCount = 0;
-    args.StartIndexLocation = 0;
-    args.BaseVertexLocation = 0;
-    args.StartInstanceLocation = 0;
-    g_pDeviceContext->UpdateSubresource(g_pIndirectArgsUAV, 0, nullptr, &args, 0, 0);
+    // Выбор цели рендера: если фильтр включен, рисуем в текстуру, иначе в back buffer
+    FrameSetup frame;
+    frame.viewProj = viewProj;
+    XMMATRIX viewNoTrans = view;
+    viewNoTrans.r[3] = XMVectorSet(0, 0, 0, 1);
+    frame.vpSky = viewNoTrans * proj;
+    frame.sceneTarget = g_rgSceneColor != RenderGraph::INVALID ? g_TransientTextures[g_RenderGraph.Physical(g_rgSceneColor)].rtv : g_pBackBufferRTV;
+    D3D11_VIEWPORT viewport = { 0, 0, (FLOAT)g_RenderWidth, (FLOAT)g_RenderHeight, 0.0f, 1.0f };
+    D3D11_VIEWPORT outputViewport = { 0, 0, (FLOAT)g_ClientWidth, (FLOAT)g_ClientHeight, 0.0f, 1.0f };
+    frame.viewport = viewport;
+    frame.outputViewport = outputViewport;
+    frame.sceneUvMax = XMFLOAT2((g_RenderWidth - 0.5f) / g_ClientWidth, (g_RenderHeight - 0.5f) / g_ClientHeight);
+    // Кэш состояний не потокобезопасен - состояние берётся до записи
+    D3D11_DEPTH_STENCIL_DESC dsSky = {};
+    dsSky.DepthEnable = TRUE; dsSky.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO; dsSky.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+    frame.dsSky = g_StateCache.DepthStencil(g_pDevice, dsSky);
+    frame.deferred = g_rgGBufferAlbedo != RenderGraph::INVALID;
+    uint32_t gbuffer[] = { g_rgGBufferAlbedo, g_rgGBufferNormal };
+    for (UINT i = 0; i < 2; ++i)
+    {
+        const TransientTexture* t = frame.deferred ? &g_TransientTextures[g_RenderGraph.Physical(gbuffer[i])] : nullptr;
+        frame.gbufferTargets[i] = t ? t->rtv : nullptr;
+        frame.gbufferViews[i] = t ? t->srv : nullptr;
+    }
+    frame.bloomLevels = g_BloomLevels;
+    frame.bloomSettings = XMFLOAT4(g_Bloom.threshold, g_Bloom.knee, g_Bloom.intensity, 0.0f);
+    frame.bloomScatter = g_Bloom.scatter;
+    // Уровни - от области рендера, текстуры уровней - от полного кадра
+    UINT bloomWidth = g_RenderWidth, bloomHeight = g_RenderHeight;
+    UINT levelWidth = g_ClientWidth, levelHeight = g_ClientHeight;
+    for (UINT i = 0; i < frame.bloomLevels; ++i)
+    {
+        bloomWidth = BloomLevelSize(bloomWidth);
+        bloomHeight = BloomLevelSize(bloomHeight);
+        levelWidth = BloomLevelSize(levelWidth);
+        levelHeight = BloomLevelSize(levelHeight);
+        const TransientTexture& t = g_TransientTextures[g_RenderGraph.Physical(g_rgBloom[i])];
+        frame.bloomTargets[i] = t.rtv;
+        frame.bloomViews[i] = t.srv;
+        D3D11_VIEWPORT levelViewport = { 0, 0, (FLOAT)bloomWidth, (FLOAT)bloomHeight, 0.0f, 1.0f };
+        frame.bloomViewports[i] = levelViewport;
+        frame.bloomUvMax[i] = XMFLOAT2((bloomWidth - 0.5f) / levelWidth, (bloomHeight - 0.5f) / levelHeight);
+    }
+    SelectShaderVariants(frame);
 
-    // Запуск compute shader для culling
-    ID3D11Buffer* csCBs[] = { g_pFrustumPlanesCB, g_pCullParamsCB };
-    g_pDeviceContext->CSSetConstantBuffers(0, 2, csCBs);
-    ID3D11UnorderedAccessView* csUAVs[] = { g_pIndirectArgsUAVView, g_pVisibleIdsUAV };
-    g_pDeviceContext->CSSetUnorderedAccessViews(0, 2, csUAVs, nullptr);
-    g_pDeviceContext->CSSetShader(g_pCullCS, nullptr, 0);
+    if (g_SwCaptureRequested)
+    {
+        CaptureSoftwareFrame(frame, XMFLOAT3(camX, camY, camZ));
+        g_SwCaptureRequested = false;
+    }
 
-    UINT groupCount = (g_InstanceCount + 63) / 64;
-    g_pDeviceContext->Dispatch(groupCount, 1, 1);
+    // Запись проходов в списки команд
+    StateFilterStats frameBinds = PassBindTotals();
+    auto recordStart = std::chrono::high_resolution_clock::now();
+    g_PassRecorder.Record(g_UseParallelRecording ? g_RecordThreads : 1, [&frame](uint32_t p, FrameBackend*)
+    {
+        PassContext& pass = g_PassFilters[p];
+        pass.Reset();   // список закрыт без сохранения состояния
+        if (!g_RenderGraph.IsLive(p)) return;   // проход отсечён графом - пустой список
+        if (p == RECORD_SKYBOX) RecordSkyboxPass(pass, frame);
+        else if (p == RECORD_INSTANCED) RecordInstancedPass(pass, frame);
+        else if (p == RECORD_DEFERRED_LIGHTING) RecordDeferredLightingPass(pass, frame);
+        else if (p == RECORD_BLOOM) RecordBloomPass(pass, frame);
+        else RecordPostProcessPass(pass, frame);
+    });
+    g_RecordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+    g_RecordCpuMs = g_PassRecorder.TotalRecordMs();
+    StateFilterStats totalBinds = PassBindTotals();
+    g_FrameBindsRequested = (UINT)(totalBinds.requested - frameBinds.requested);
+    g_FrameBindsIssued = (UINT)(totalBinds.issued - frameBinds.issued);
+
+    // Метки GPU - вокруг списков команд: ожидание записи на CPU во время GPU не попадает
+    g_pFrame->End(frameRes.timeStart);
+    g_PassRecorder.Submit(g_pFrame);
+    g_pFrame->End(frameRes.timeEnd);
+    g_pFrame->End(frameRes.timeDisjoint);
+    g_FramePipeline.EndFrame();
+    auto frameEnd = std::chrono::high_resolution_clock::now();
+    g_FrameCpuMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+
+    // Решение регулятора действует со следующего кадра; время GPU - последнего завершённого
+    if (g_UseGovernor && g_Governor.Update(std::chrono::duration<double, std::milli>(frameEnd - workStart).count(), g_FrameGpuMs))
+    {
+        char buf[256];
+        sprintf_s(buf, "Frame governor (%s-bound): render %ux%u (%.0f%%), LOD x%.2f, %u of %u instances, raise delay %u frames\n",
+            g_Governor.GpuBound() ? "GPU" : "CPU", GovernorRenderSize(g_ClientWidth, g_Governor.RenderScale()), GovernorRenderSize(g_ClientHeight, g_Governor.RenderScale()),
+            100.0f * g_Governor.RenderScale(), g_Governor.LodScale(), GovernorInstanceCount(MAX_INSTANCES, g_Governor.Density()), MAX_INSTANCES, g_Governor.RaiseDelay());
+        OutputDebugStringA(buf);
+    }
+    if (g_UseNullBackend)
+    {
+        g_NullImmediate.CheckFrameEnd();
+        NullBackendStats totalCalls = NullBackendTotals();
+        g_FrameBackendCalls = (UINT)(totalCalls.calls - frameCalls.calls);
+        if (totalCalls.errors != frameCalls.errors)
+        {
+            char buf[256];
+            sprintf_s(buf, "Null backend: %llu errors this frame, last: %s\n", totalCalls.errors - frameCalls.errors, totalCalls.lastError);
+            OutputDebugStringA(buf);
+        }
+    }
 
-    // Сброс состояний compute
-    ID3D11UnorderedAccessView* nullUAV = nullptr;
-    g_pDeviceContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
-    g_pDeviceContext->CSSetUnorderedAccessViews(1, 1, &nullUAV, nullptr);
-    ID3D11Buffer* nullCB = nullptr;
-    g_pDeviceContext->CSSetConstantBuffers(0, 1, &nullCB);
-    g_pDeviceContext->CSSetConstantBuffers(1, 1, &nullCB);
-    g_pDeviceContext->CSSetShader(nullptr, nullptr, 0);
+    // Обновление заголовка окна
+    static double lastTitleUpdate = 0;
+    double now = (double)GetTickCount64() / 1000.0;
+    if (now - lastTitleUpdate > 1.0) {
+        int clusterCulledPercent = g_MeshletStats.triangles ? (int)(100 * g_MeshletStats.culledTriangles / g_MeshletStats.triangles) : 0;
+        wchar_t title[640];
+        swprintf(title, 640, L"8 lab. GPU %s Culling - Visible instances: %d, triangles: %d, LOD draws: %d, tiny culled: %d (%d verts), clusters culled: %d%% (%d ranges%s), lights: %d (max %d/cluster, bin %.2f ms, %s %.2f ms, %s), binds: %d of %d, record: %.2f ms (cpu %.2f ms, %d threads), in flight: %d (stalls %d), %s backend: cpu %.2f ms, gpu %.2f ms, %d calls, bloom: %d levels (scatter %.1f), governor %s: %dx%d, LOD x%.2f, %d instances",
+            g_UseOcclusion ? L"Occlusion" : L"Frustum", g_gpuVisibleInstances, g_gpuVisibleTriangles, g_gpuBatchDraws,
+            g_gpuContributionCulled, g_gpuContributionCulledVerts, clusterCulledPercent, (int)g_MeshletDraws.size(), g_UseMeshletDraws ? L"" : L", off",
+            (int)g_Lights.size(), (int)g_LightClusters.maxPerCluster, g_LightBinMs,
+            g_UsePerObjectLights && !frame.deferred ? L"per-object" : L"clustered", g_InstanceLightMs,
+            frame.deferred ? L"deferred" : L"forward", g_FrameBindsIssued, g_FrameBindsRequested,
+            g_RecordMs, g_RecordCpuMs, g_UseParallelRecording ? (int)(std::min)(g_RecordThreads, (UINT)RECORD_PASS_COUNT) : 1,
+            (int)g_FramePipeline.InFlight(), (int)g_FramePipeline.stalls,
+            g_UseNullBackend ? L"null" : L"D3D11", g_FrameCpuMs, g_FrameGpuMs, g_UseNullBackend ? (int)g_FrameBackendCalls : 0,
+            (int)frame.bloomLevels, frame.bloomScatter, g_UseGovernor ? L"on" : L"off", (int)g_RenderWidth, (int)g_RenderHeight,
+            g_occlusionParams.detail.x, (int)g_InstanceCount);
+        SetWindowTextW(g_hWnd, title);
+        lastTitleUpdate = now;
+    }
 
-    // Копирование аргументов для косвенной отрисовки
-    g_pDeviceContext->CopyResource(g_pIndirectArgsDraw, g_pIndirectArgsUAV);
+    if (!g_UseNullBackend) g_pSwapChain->Present(1, 0);
+}
 
-    // Установка structured buffer visibleIds для вершинного и пиксельного шейдеров
-    ID3D11ShaderResourceView* srvVisible = g_pVisibleIdsSRV;
-    g_pDeviceContext->VSSetShaderResources(2, 1, &srvVisible);
-    g_pDeviceContext->PSSetShaderResources(2, 1, &srvVisible);
+// Skybox (с отдельной матрицей без трансляции); первый проход, очищает цели
+void RecordSkyboxPass(PassContext& pass, const FrameSetup& frame)
+{
+    FrameBackend* context = pass.context;
+    ID3D11RenderTargetView* sceneTarget = frame.sceneTarget;
+    context->OMSetRenderTargets(1, &sceneTarget, g_pDepthStencilView);
+    context->ClearRenderTargetView(sceneTarget, g_ClearColor);
+    context->ClearDepthStencilView(g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    context->RSSetViewports(1, &frame.viewport);
 
-    // Instanced отрисовка
-    UINT stride = sizeof(TextureNormalTangentVertex);
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (context->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        ViewProjBuffer* pData = (ViewProjBuffer*)mapped.pData;
+        XMStoreFloat4x4((XMFLOAT4X4*)&pData->vp, XMMatrixTranspose(frame.vpSky));
+        context->Unmap(g_pViewProjBuffer, 0);
+    }
+    pass.OMSetDepthStencilState(frame.dsSky, 0);
+    pass.RSSetState(g_pRSCullNone);
+    pass.VSSetShader(g_pSkyboxVS);
+    pass.PSSetShader(frame.skyboxPS);
+    pass.IASetInputLayout(g_pSkyboxInputLayout);
+    UINT stride = sizeof(TexturedVertex);
     UINT offset = 0;
-    ID3D11Buffer* vbCube[] = { g_pVertexBuffer };
-    g_pDeviceContext->IASetVertexBuffers(0, 1, vbCube, &stride, &offset);
-    g_pDeviceContext->IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-    g_pDeviceContext->IASetInputLayout(g_pInstancedInputLayout);
-    g_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    g_pDeviceContext->VSSetShader(g_pInstancedVS, nullptr, 0);
-    g_pDeviceContext->PSSetShader(g_pInstancedPS, nullptr, 0);
-
-    ID3D11Buffer* cbInstVS[] = { nullptr, g_pGeomBufferInst, g_pViewProjBuffer };
-    g_pDeviceContext->VSSetConstantBuffers(0, 3, cbInstVS);
-    ID3D11Buffer* cbInstPS[] = { nullptr, g_pGeomBufferInst, g_pSceneBuffer };
-    g_pDeviceContext->PSSetConstantBuffers(1, 1, &g_pGeomBufferInst);
-    g_pDeviceContext->PSSetConstantBuffers(3, 1, &g_pSceneBuffer);
+    ID3D11Buffer* vbSky[] = { g_pSkyboxVertexBuffer };
+    pass.IASetVertexBuffers(0, 1, vbSky, &stride, &offset);
+    pass.IASetIndexBuffer(g_pSkyboxIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pass.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D11Buffer* cbsSky[] = { nullptr, g_pViewProjBuffer };
+    pass.VSSetConstantBuffers(0, 2, cbsSky);
+    ID3D11ShaderResourceView* skySRV[] = { g_pCubemapView };
+    pass.PSSetShaderResources(1, 1, skySRV);
+    ID3D11SamplerState* samplers[] = { g_pSampler };
+    pass.PSSetSamplers(1, 1, samplers);
+    pass.DrawIndexed(36, 0, 0);
+}
+
+// Instanced отрисовка с GPU culling
+void RecordInstancedPass(PassContext& pass, const FrameSetup& frame)
+{
+    // Без шейдеров отбора косвенные аргументы не заполняются - рисовать нечего
+    if (!g_pInstancedVS || !g_pInstancedInputLayout || !frame.instancedPS || !g_pCullCS || !g_pBatchArgsCS || !g_pScatterCS) return;
+    FrameBackend* context = pass.context;
+    // В отложенном режиме цели - G-буфер, освещение добавит RecordDeferredLightingPass
+    ID3D11RenderTargetView* sceneTarget = frame.sceneTarget;
+    UINT targetCount = frame.deferred ? 2 : 1;
+    ID3D11RenderTargetView* const* targets = frame.deferred ? frame.gbufferTargets : &sceneTarget;
+    context->OMSetRenderTargets(targetCount, targets, g_pDepthStencilView);
+    context->RSSetViewports(1, &frame.viewport);
+    pass.RSSetState(g_pRSCullBack);
+
+    // Обычный ViewProjBuffer для сцены (skybox отображал свой в своём списке)
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (context->Map(g_pViewProjBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))
+    {
+        ViewProjBuffer* pData = (ViewProjBuffer*)mapped.pData;
+        XMStoreFloat4x4((XMFLOAT4X4*)&pData->vp, XMMatrixTranspose(frame.viewProj));
+        context->Unmap(g_pViewProjBuffer, 0);
+    }
+
+    UINT strides[] = { sizeof(TextureNormalTangentVertex), sizeof(UINT) };
+    UINT offsets[] = { 0, 0 };
+    ID3D11Buffer* vbInst[] = { g_pVertexBuffer, g_pInstanceIndexVB };
+    pass.IASetVertexBuffers(0, 2, vbInst, strides, offsets);
+    pass.IASetIndexBuffer(g_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+    pass.IASetInputLayout(g_pInstancedInputLayout);
+    pass.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pass.VSSetShader(g_pInstancedVS);
+    pass.PSSetShader(frame.instancedPS);
+
+    FrameResources& res = g_FrameResources[g_FrameSlot];
+    ID3D11Buffer* cbInstVS[] = { nullptr, res.geomInst, g_pViewProjBuffer };
+    pass.VSSetConstantBuffers(0, 3, cbInstVS);
+    pass.PSSetConstantBuffers(1, 1, &res.geomInst);
+    pass.PSSetConstantBuffers(3, 1, &g_pSceneBuffer);
+    pass.PSSetConstantBuffers(4, 1, &g_pClusterParamsCB);
+    ID3D11ShaderResourceView* lightSRVs[] = { g_pLightsSRV, g_pClusterRangesSRV, g_pClusterIndicesSRV, g_pInstanceLightsSRV };
+    pass.PSSetShaderResources(3, 4, lightSRVs);
 
     ID3D11ShaderResourceView* texArraySRV[] = { g_pTextureArrayView, g_pNormalMapView };
-    g_pDeviceContext->PSSetShaderResources(0, 2, texArraySRV);
-    g_pDeviceContext->PSSetSamplers(0, 1, &g_pSampler);
+    pass.PSSetShaderResources(0, 2, texArraySRV);
+    pass.PSSetSamplers(0, 1, &g_pSampler);
+
+    // Косвенная отрисовка с запросом статистики.
+    // С occlusion: фаза 1 рисует видимые в прошлом кадре, по их глубине строится Hi-Z,
+    // фаза 2 дорисовывает только экземпляры, которые стали видимыми.
+    // Без Hi-Z шейдера - одна фаза без occlusion
+    bool occlusion = g_UseOcclusion && g_pHiZCS;
+    context->Begin(res.stats);
+    RunCullPhase(pass, occlusion ? 1 : 0);
+    DrawCulledInstances(pass);
+    DrawSphereMeshlets(pass);   // до Hi-Z: сферы тоже закрывают экземпляры фазы 2
+    if (occlusion)
+    {
+        BuildHiZ(pass, targetCount, targets);
+        RunCullPhase(pass, 2);
+        DrawCulledInstances(pass);
+    }
+    context->End(res.stats);
+}
 
-    // Косвенная отрисовка с запросом статистики
-    g_pDeviceContext->Begin(g_pQueries[g_curFrame % 10]);
-    g_pDeviceContext->DrawIndexedInstancedIndirect(g_pIndirectArgsDraw, 0);
-    g_pDeviceContext->End(g_pQueries[g_curFrame % 10]);
-    g_curFrame++;
+// Отложенное освещение: полноэкранный треугольник по G-буферу, источники - списки кластеров.
+// Глубина читается как SRV, поэтому в OM только цель сцены; пиксели без геометрии шейдер отбрасывает
+void RecordDeferredLightingPass(PassContext& pass, const FrameSetup& frame)
+{
+    if (!g_pFilterVS || !frame.deferredPS) return;
+    FrameBackend* context = pass.context;
+    ID3D11RenderTargetView* sceneTarget = frame.sceneTarget;
+    context->OMSetRenderTargets(1, &sceneTarget, nullptr);
+    context->RSSetViewports(1, &frame.viewport);
+    pass.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pass.VSSetShader(g_pFilterVS);
+    pass.PSSetShader(frame.deferredPS);
+    pass.PSSetConstantBuffers(3, 1, &g_pSceneBuffer);
+    pass.PSSetConstantBuffers(4, 1, &g_pClusterParamsCB);
+    ID3D11ShaderResourceView* srvs[] = { frame.gbufferViews[0], frame.gbufferViews[1], g_pDepthSRV, g_pLightsSRV, g_pClusterRangesSRV, g_pClusterIndicesSRV };
+    pass.PSSetShaderResources(0, 6, srvs);
+    pass.Draw(3, 0);
+}
 
-    ReadQueries();
+// Константы свечения и фильтра для одной отрисовки: пределы uv источников зависят от того, что читается
+void UpdateBloomParams(PassContext& pass, const FrameSetup& frame, const XMFLOAT2& sourceMax, const XMFLOAT2& bloomMax)
+{
+    BloomParams params;
+    params.params = frame.bloomSettings;
+    params.source = XMFLOAT4(sourceMax.x, sourceMax.y, bloomMax.x, bloomMax.y);
+    params.scene = XMFLOAT4(frame.viewport.Width / frame.outputViewport.Width, frame.viewport.Height / frame.outputViewport.Height, 0.0f, 0.0f);
+    pass.context->UpdateSubresource(g_pBloomParamsCB, 0, nullptr, &params, 0, 0);
+}
 
-    // Обновление заголовка окна
-    static double lastTitleUpdate = 0;
-    double now = (double)GetTickCount64() / 1000.0;
-    if (now - lastTitleUpdate > 1.0) {
-        wchar_t title[256];
-        swprintf(title, 256, L"8 lab. GPU Frustum Culling - Visible instances: %d", g_gpuVisibleInstances);
-        SetWindowTextW(g_hWnd, title);
-        lastTitleUpdate = now;
+// Свечение: спуск по уровням пирамиды, затем подъём - уровень i + 1 смешивается в уровень i.
+// SRV снимается до смены цели: уровень, который читала прошлая отрисовка, становится целью
+void RecordBloomPass(PassContext& pass, const FrameSetup& frame)
+{
+    const ShaderPermutations& bps = g_BloomDownPSVariants.permutations;
+    ID3D11PixelShader* prefilterPS = g_BloomDownPSVariants.Select(bps.Set(0, BDS_PREFILTER, 1));
+    ID3D11PixelShader* downPS = g_BloomDownPSVariants.Select(bps.Set(0, BDS_PREFILTER, 0));
+    if (!g_pFilterVS || !prefilterPS || !downPS || !g_pBloomUpPS) return;
+    FrameBackend* context = pass.context;
+    pass.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pass.VSSetShader(g_pFilterVS);
+    pass.PSSetConstantBuffers(0, 1, &g_pBloomParamsCB);
+    pass.PSSetSamplers(0, 1, &g_pLinearClampSampler);
+    ID3D11ShaderResourceView* noView = nullptr;
+    for (UINT i = 0; i < frame.bloomLevels; ++i)
+    {
+        pass.PSSetShaderResources(0, 1, &noView);
+        context->OMSetRenderTargets(1, &frame.bloomTargets[i], nullptr);
+        context->RSSetViewports(1, &frame.bloomViewports[i]);
+        pass.PSSetShader(i == 0 ? prefilterPS : downPS);
+        ID3D11ShaderResourceView* source = i == 0 ? g_TransientTextures[g_RenderGraph.Physical(g_rgSceneColor)].srv : frame.bloomViews[i - 1];
+        pass.PSSetShaderResources(0, 1, &source);
+        UpdateBloomParams(pass, frame, i == 0 ? frame.sceneUvMax : frame.bloomUvMax[i - 1], frame.bloomUvMax[0]);
+        pass.Draw(3, 0);
     }
-
-    // Постпроцессинг: если фильтр включен, применяем его к текстуре и выводим на экран
-    if (g_UseFilter && g_pFilterVS && g_pFilterPS)
+    const float factor[4] = { frame.bloomScatter, frame.bloomScatter, frame.bloomScatter, frame.bloomScatter };
+    pass.OMSetBlendState(g_pBloomBlend, factor, 0xFFFFFFFF);
+    pass.PSSetShader(g_pBloomUpPS);
+    for (int i = (int)frame.bloomLevels - 2; i >= 0; --i)
     {
-        g_pDeviceContext->OMSetRenderTargets(1, &g_pBackBufferRTV, nullptr);
-        g_pDeviceContext->ClearRenderTargetView(g_pBackBufferRTV, clearColor);
-        g_pDeviceContext->OMSetDepthStencilState(nullptr, 0);
-        g_pDeviceContext->RSSetState(nullptr);
-        g_pDeviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-        g_pDeviceContext->IASetInputLayout(nullptr);
-        g_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        g_pDeviceContext->VSSetShader(g_pFilterVS, nullptr, 0);
-        g_pDeviceContext->PSSetShader(g_pFilterPS, nullptr, 0);
-        ID3D11ShaderResourceView* srv[] = { g_pColorBufferSRV };
-        g_pDeviceContext->PSSetShaderResources(0, 1, srv);
-        g_pDeviceContext->PSSetSamplers(0, 1, &g_pSampler);
-        g_pDeviceContext->Draw(3, 0);
+        pass.PSSetShaderResources(0, 1, &noView);
+        context->OMSetRenderTargets(1, &frame.bloomTargets[i], nullptr);
+        context->RSSetViewports(1, &frame.bloomViewports[i]);
+        pass.PSSetShaderResources(0, 1, &frame.bloomViews[i + 1]);
+        UpdateBloomParams(pass, frame, frame.bloomUvMax[i + 1], frame.bloomUvMax[0]);
+        pass.Draw(3, 0);
     }
+}
 
-    g_pSwapChain->Present(1, 0);
+// Постпроцессинг: фильтр и/или свечение по цели сцены, вывод на экран с растяжением области рендера
+void RecordPostProcessPass(PassContext& pass, const FrameSetup& frame)
+{
+    if (!g_pFilterVS || !frame.filterPS) return;
+    FrameBackend* context = pass.context;
+    context->OMSetRenderTargets(1, &g_pBackBufferRTV, nullptr);
+    context->ClearRenderTargetView(g_pBackBufferRTV, g_ClearColor);
+    context->RSSetViewports(1, &frame.outputViewport);
+    pass.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    pass.VSSetShader(g_pFilterVS);
+    pass.PSSetShader(frame.filterPS);
+    ID3D11ShaderResourceView* srv[] = { g_TransientTextures[g_RenderGraph.Physical(g_rgSceneColor)].srv, frame.bloomLevels ? frame.bloomViews[0] : nullptr };
+    pass.PSSetShaderResources(0, 2, srv);
+    // Билинейное растяжение; в полном разрешении выборки попадают в центры текселей
+    ID3D11SamplerState* samplers[] = { g_pLinearClampSampler, g_pLinearClampSampler };
+    pass.PSSetSamplers(0, 2, samplers);
+    pass.PSSetConstantBuffers(0, 1, &g_pBloomParamsCB);
+    UpdateBloomParams(pass, frame, frame.sceneUvMax, frame.bloomLevels ? frame.bloomUvMax[0] : XMFLOAT2(0.0f, 0.0f));
+    pass.Draw(3, 0);
 }
 
 // ------------------------------------------------------------------
@@ -1710,16 +3844,11 @@ void OnResize(UINT newWidth, UINT newHeight)
     hr = g_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (void**)&pBackBuffer);
     if (SUCCEEDED(hr)) { g_pDevice->CreateRenderTargetView(pBackBuffer, nullptr, &g_pBackBufferRTV); pBackBuffer->Release(); }
 
-    D3D11_TEXTURE2D_DESC depthDesc = {};
-    depthDesc.Width = newWidth; depthDesc.Height = newHeight; depthDesc.MipLevels = 1; depthDesc.ArraySize = 1;
-    depthDesc.Format = DXGI_FORMAT_D32_FLOAT; depthDesc.SampleDesc.Count = 1; depthDesc.SampleDesc.Quality = 0;
-    depthDesc.Usage = D3D11_USAGE_DEFAULT; depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-    ID3D11Texture2D* pDepthStencil = nullptr;
-    hr = g_pDevice->CreateTexture2D(&depthDesc, nullptr, &pDepthStencil);
-    if (SUCCEEDED(hr)) { g_pDevice->CreateDepthStencilView(pDepthStencil, nullptr, &g_pDepthStencilView); pDepthStencil->Release(); }
+    SetupDepthBuffer(newWidth, newHeight);
 
     g_ClientWidth = newWidth; g_ClientHeight = newHeight;
-    SetupColorBuffer(g_ClientWidth, g_ClientHeight);
+    g_ClusterBoundsDirty = true;
+    g_RenderGraphDirty = true;
 }
 
 // ------------------------------------------------------------------
@@ -1738,7 +3867,9 @@ void CleanupDirectX()
     SAFE_RELEASE(g_pPixelShader);
     SAFE_RELEASE(g_pSkyboxInputLayout);
     SAFE_RELEASE(g_pSkyboxVS);
-    SAFE_RELEASE(g_pSkyboxPS);
+    g_SkyboxPSVariants.Release();
+    g_GBufferPSVariants.Release();
+    g_DeferredPSVariants.Release();
     SAFE_RELEASE(g_pIndexBuffer);
     SAFE_RELEASE(g_pVertexBuffer);
     SAFE_RELEASE(g_pSkyboxIndexBuffer);
@@ -1748,26 +3879,40 @@ void CleanupDirectX()
     SAFE_RELEASE(g_pSwapChain);
     SAFE_RELEASE(g_pTextureView);
     SAFE_RELEASE(g_pCubemapView);
-    SAFE_RELEASE(g_pSampler);
-    SAFE_RELEASE(g_pRSCullBack);
-    SAFE_RELEASE(g_pRSCullNone);
+    // Объекты состояния принадлежат кэшу
+    StateCacheStats stateStats = g_StateCache.Stats();
+    char stateMsg[128];
+    sprintf_s(stateMsg, "State cache: %llu hits, %llu misses, %u objects\n", stateStats.hits, stateStats.misses, (unsigned)g_StateCache.Size());
+    OutputDebugStringA(stateMsg);
+    g_StateCache.Clear();
+    StateFilterStats passBinds = PassBindTotals();
+    char filterMsg[128];
+    sprintf_s(filterMsg, "State filter: %llu of %llu binds elided\n", passBinds.Elided(), passBinds.requested);
+    OutputDebugStringA(filterMsg);
+    for (D3D11Backend& backend : g_D3DPassBackends) SAFE_RELEASE(backend.context);
+    g_D3DImmediate.context = nullptr;
+    g_pSampler = nullptr;
+    g_pRSCullBack = nullptr;
+    g_pRSCullNone = nullptr;
+    g_pLinearClampSampler = nullptr;
+    g_pBloomBlend = nullptr;
     SAFE_RELEASE(g_pNormalMapView);
     SAFE_RELEASE(g_pTexture);
     SAFE_RELEASE(g_pNormalMapTexture);
     SAFE_RELEASE(g_pCubemapTexture);
 
     SAFE_RELEASE(g_pInstancedVS);
-    SAFE_RELEASE(g_pInstancedPS);
+    g_InstancedPSVariants.Release();
     SAFE_RELEASE(g_pInstancedInputLayout);
-    SAFE_RELEASE(g_pGeomBufferInst);
     SAFE_RELEASE(g_pVisibleIdsBuffer);
     SAFE_RELEASE(g_pTextureArrayView);
 
-    SAFE_RELEASE(g_pColorBuffer);
-    SAFE_RELEASE(g_pColorBufferRTV);
-    SAFE_RELEASE(g_pColorBufferSRV);
+    ReleaseTransientTextures();
     SAFE_RELEASE(g_pFilterVS);
-    SAFE_RELEASE(g_pFilterPS);
+    g_FilterPSVariants.Release();
+    g_BloomDownPSVariants.Release();
+    SAFE_RELEASE(g_pBloomUpPS);
+    SAFE_RELEASE(g_pBloomParamsCB);
 
 #ifdef _DEBUG
     if (g_pDevice)
@@ -1790,7 +3935,58 @@ void CleanupDirectX()
     SAFE_RELEASE(g_pVisibleIdsStructured);
     SAFE_RELEASE(g_pVisibleIdsUAV);
     SAFE_RELEASE(g_pVisibleIdsSRV);
-    SAFE_RELEASE(g_pCullParamsCB);
-    SAFE_RELEASE(g_pFrustumPlanesCB);
-    for (int i = 0; i < 10; ++i) SAFE_RELEASE(g_pQueries[i]);
+    SAFE_RELEASE(g_pMeshletArgs);
+    SAFE_RELEASE(g_pMeshletIds);
+    SAFE_RELEASE(g_pMeshletIdsSRV);
+    char pipelineMsg[128];
+    sprintf_s(pipelineMsg, "Frame pipeline: %llu frames, %llu stalls, %.1f ms waiting for GPU\n", g_FramePipeline.frame, g_FramePipeline.stalls, g_FramePipeline.waitMs);
+    OutputDebugStringA(pipelineMsg);
+    NullBackendStats nullStats = NullBackendTotals();
+    char nullMsg[256];
+    sprintf_s(nullMsg, "Null backend: %llu calls (%llu binds, %llu draws, %llu dispatches, %llu uploads), %llu errors%s%s\n",
+        nullStats.calls, nullStats.binds, nullStats.draws, nullStats.dispatches, nullStats.uploads, nullStats.errors,
+        nullStats.lastError ? ", last: " : "", nullStats.lastError ? nullStats.lastError : "");
+    OutputDebugStringA(nullMsg);
+    for (FrameResources& res : g_FrameResources)
+    {
+        SAFE_RELEASE(res.geomInst);
+        SAFE_RELEASE(res.cullParams);
+        SAFE_RELEASE(res.frustumPlanes);
+        SAFE_RELEASE(res.fence);
+        SAFE_RELEASE(res.stats);
+        SAFE_RELEASE(res.timeDisjoint);
+        SAFE_RELEASE(res.timeStart);
+        SAFE_RELEASE(res.timeEnd);
+        for (int phase = 0; phase < 2; ++phase) SAFE_RELEASE(res.argsStaging[phase]);
+        SAFE_RELEASE(res.visibilityStaging);
+    }
+
+    SAFE_RELEASE(g_pDepthSRV);
+    SAFE_RELEASE(g_pHiZTexture);
+    SAFE_RELEASE(g_pHiZSRV);
+    for (auto& srv : g_HiZMipSRVs) { SAFE_RELEASE(srv); }
+    for (auto& uav : g_HiZMipUAVs) { SAFE_RELEASE(uav); }
+    SAFE_RELEASE(g_pHiZCS);
+    SAFE_RELEASE(g_pHiZParamsCB);
+    SAFE_RELEASE(g_pOcclusionParamsCB);
+    SAFE_RELEASE(g_pVisibilityHistory);
+    SAFE_RELEASE(g_pVisibilityHistoryUAV);
+
+    SAFE_RELEASE(g_pInstanceIndexVB);
+    SAFE_RELEASE(g_pBatchArgsCS);
+    SAFE_RELEASE(g_pScatterCS);
+    SAFE_RELEASE(g_pLodParamsCB);
+    SAFE_RELEASE(g_pInstanceBuckets);
+    SAFE_RELEASE(g_pInstanceBucketsUAV);
+    SAFE_RELEASE(g_pGroupBucketOffsets);
+    SAFE_RELEASE(g_pGroupBucketOffsetsUAV);
+    SAFE_RELEASE(g_pLightsBuffer);
+    SAFE_RELEASE(g_pLightsSRV);
+    SAFE_RELEASE(g_pClusterRangesBuffer);
+    SAFE_RELEASE(g_pClusterRangesSRV);
+    SAFE_RELEASE(g_pClusterIndicesBuffer);
+    SAFE_RELEASE(g_pClusterIndicesSRV);
+    SAFE_RELEASE(g_pClusterParamsCB);
+    SAFE_RELEASE(g_pInstanceLightsBuffer);
+    SAFE_RELEASE(g_pInstanceLightsSRV);
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+// Lab8_StateCache
+// Кэш объектов состояния (depth-stencil, rasterizer, blend, sampler) по хэшу описания:
+// одинаковое описание -> тот же объект, Create* вызывается только при первом запросе.
+// Описания сравниваются побайтно, поэтому объявляются обнулёнными (= {}), как везде в проекте.
+// Объекты принадлежат кэшу и освобождаются в Clear.
+// Типы устройства и описаний задаёт Api: в приложении - D3D11, в проверках - заглушка.
+// Каждая лаба - самостоятельный проект VS без общих include-каталогов, поэтому файл лежит
+// в Lab5-Lab8 копиями, которые отличаются только первой строкой (сверяет Lab5/Tests/SameHeaders.cmake;
+// заглушка устройства - Lab5/Tests/StateCacheTest.cpp). Правка - сразу во все копии.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+// FNV-1a, 64 бита
+inline uint64_t HashBytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) { hash ^= bytes[i]; hash *= 1099511628211ull; }
+    return hash;
+}
+
+struct StateCacheStats
+{
+    uint64_t hits = 0, misses = 0;
+};
+
+template <typename Desc, typename Object>
+struct StateObjectCache
+{
+    struct Entry { Desc desc; Object* object; };
+    std::unordered_multimap<uint64_t, Entry> entries;   // совпадение хэша проверяется сравнением описаний
+    StateCacheStats stats;
+
+    // create(desc, &object) -> HRESULT; при ошибке создания возвращает nullptr и ничего не запоминает
+    template <typename Create>
+    Object* Get(const Desc& desc, Create create)
+    {
+        uint64_t hash = HashBytes(&desc, sizeof(Desc));
+        auto range = entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (memcmp(&it->second.desc, &desc, sizeof(Desc)) == 0)
+            {
+                ++stats.hits;
+                return it->second.object;
+            }
+        }
+        ++stats.misses;
+        Object* object = nullptr;
+        if (create(desc, &object) < 0 || !object) return nullptr;
+        Entry entry;
+        memcpy(&entry.desc, &desc, sizeof(Desc));
+        entry.object = object;
+        entries.emplace(hash, entry);
+        return object;
+    }
+
+    size_t Size() const { return entries.size(); }
+    void Clear()
+    {
+        for (auto& e : entries) e.second.object->Release();
+        entries.clear();
+    }
+};
+
+template <typename Api>
+struct PipelineStateCache
+{
+    typedef typename Api::Device Device;
+    StateObjectCache<typename Api::DepthStencilDesc, typename Api::DepthStencilState> depthStencil;
+    StateObjectCache<typename Api::RasterizerDesc, typename Api::RasterizerState> rasterizer;
+    StateObjectCache<typename Api::BlendDesc, typename Api::BlendState> blend;
+    StateObjectCache<typename Api::SamplerDesc, typename Api::SamplerState> sampler;
+
+    typename Api::DepthStencilState* DepthStencil(Device* device, const typename Api::DepthStencilDesc& desc)
+    {
+        return depthStencil.Get(desc, [device](const typename Api::DepthStencilDesc& d, typename Api::DepthStencilState** out) { return device->CreateDepthStencilState(&d, out); });
+    }
+    typename Api::RasterizerState* Rasterizer(Device* device, const typename Api::RasterizerDesc& desc)
+    {
+        return rasterizer.Get(desc, [device](const typename Api::RasterizerDesc& d, typename Api::RasterizerState** out) { return device->CreateRasterizerState(&d, out); });
+    }
+    typename Api::BlendState* Blend(Device* device, const typename Api::BlendDesc& desc)
+    {
+        return blend.Get(desc, [device](const typename Api::BlendDesc& d, typename Api::BlendState** out) { return device->CreateBlendState(&d, out); });
+    }
+    typename Api::SamplerState* Sampler(Device* device, const typename Api::SamplerDesc& desc)
+    {
+        return sampler.Get(desc, [device](const typename Api::SamplerDesc& d, typename Api::SamplerState** out) { return device->CreateSamplerState(&d, out); });
+    }
+
+    StateCacheStats Stats() const
+    {
+        StateCacheStats s;
+        s.hits = depthStencil.stats.hits + rasterizer.stats.hits + blend.stats.hits + sampler.stats.hits;
+        s.misses = depthStencil.stats.misses + rasterizer.stats.misses + blend.stats.misses + sampler.stats.misses;
+        return s;
+    }
+    size_t Size() const { return depthStencil.Size() + rasterizer.Size() + blend.Size() + sampler.Size(); }
+    void Clear() { depthStencil.Clear(); rasterizer.Clear(); blend.Clear(); sampler.Clear(); }
+};
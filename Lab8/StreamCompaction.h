@@ -0,0 +1,185 @@
+// Lab8_StreamCompaction
+// Компактизация видимых ID по корзинам на префиксных суммах внутри группы (CPU-эмуляция cullCS/scatterCS).
+// Вход - корзина каждого экземпляра (COMPACTION_CULLED - отсечён), выход - ID, сгруппированные по корзинам.
+// Три способа, как их мог бы делать compute shader:
+//   PerItemAtomic  - глобальный атомик на каждый видимый экземпляр (было в cullCS);
+//   PerGroupAtomic - префиксная сумма в группе и один атомик на (группу, корзину);
+//                    порядок внутри группы сохраняется, порядок групп - нет;
+//   Ordered        - счётчики групп без атомиков, скан по группам, запись по смещениям;
+//                    результат совпадает с последовательным проходом (детерминированный порядок отрисовки).
+// Группы раздаются потокам через чередование, как варпы по SM.
+#pragma once
+#include <cstdint>
+#include <cassert>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "WorkerPool.h"
+
+const uint32_t COMPACTION_GROUP_SIZE = 64;
+const uint32_t COMPACTION_CULLED = 0xFFFFFFFF;
+const uint32_t COMPACTION_MAX_BUCKETS = 64;   // итоги группы лежат на стеке, как groupshared в шейдере
+
+inline uint32_t CompactionGroupCount(uint32_t count) { return (count + COMPACTION_GROUP_SIZE - 1) / COMPACTION_GROUP_SIZE; }
+
+struct CompactionResult
+{
+    std::vector<uint32_t> bucketStart;  // начало диапазона корзины в ids (StartInstanceLocation)
+    std::vector<uint32_t> bucketCount;  // InstanceCount корзины
+    std::vector<uint32_t> ids;          // видимые ID по корзинам
+};
+
+// Эталон: последовательный проход, порядок исходных ID внутри корзины
+inline void CompactSerial(const uint32_t* buckets, uint32_t count, uint32_t bucketCount, CompactionResult& r)
+{
+    assert(bucketCount <= COMPACTION_MAX_BUCKETS);
+    r.bucketCount.assign(bucketCount, 0u);
+    for (uint32_t i = 0; i < count; ++i)
+        if (buckets[i] != COMPACTION_CULLED) ++r.bucketCount[buckets[i]];
+    r.bucketStart.assign(bucketCount, 0u);
+    uint32_t offset = 0;
+    for (uint32_t b = 0; b < bucketCount; ++b) { r.bucketStart[b] = offset; offset += r.bucketCount[b]; }
+    r.ids.resize(offset);
+    std::vector<uint32_t> cursor(r.bucketStart);
+    for (uint32_t i = 0; i < count; ++i)
+        if (buckets[i] != COMPACTION_CULLED) r.ids[cursor[buckets[i]]++] = i;
+}
+
+inline void ExclusiveBucketStarts(CompactionResult& r)
+{
+    uint32_t offset = 0;
+    for (size_t b = 0; b < r.bucketCount.size(); ++b) { r.bucketStart[b] = offset; offset += r.bucketCount[b]; }
+    r.ids.resize(offset);
+}
+
+// ------------------------------------------------------------------
+// Атомик на каждый видимый экземпляр (подсчёт и запись)
+// ------------------------------------------------------------------
+inline void CompactPerItemAtomic(const uint32_t* buckets, uint32_t count, uint32_t bucketCount, uint32_t threadCount, CompactionResult& r)
+{
+    assert(bucketCount <= COMPACTION_MAX_BUCKETS);
+    uint32_t groupCount = CompactionGroupCount(count);
+    std::vector<std::atomic<uint32_t>> counters(bucketCount);
+    for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t end = (std::min)(count, (g + 1) * COMPACTION_GROUP_SIZE);
+        for (uint32_t i = g * COMPACTION_GROUP_SIZE; i < end; ++i)
+            if (buckets[i] != COMPACTION_CULLED) counters[buckets[i]].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    r.bucketCount.resize(bucketCount);
+    r.bucketStart.resize(bucketCount);
+    for (uint32_t b = 0; b < bucketCount; ++b) { r.bucketCount[b] = counters[b].load(); counters[b].store(0); }
+    ExclusiveBucketStarts(r);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t end = (std::min)(count, (g + 1) * COMPACTION_GROUP_SIZE);
+        for (uint32_t i = g * COMPACTION_GROUP_SIZE; i < end; ++i)
+        {
+            uint32_t b = buckets[i];
+            if (b == COMPACTION_CULLED) continue;
+            r.ids[r.bucketStart[b] + counters[b].fetch_add(1, std::memory_order_relaxed)] = i;
+        }
+    });
+}
+
+// ------------------------------------------------------------------
+// Префиксная сумма в группе: локальный ранг экземпляра в его корзине и итоги группы
+// (в шейдере - скан по groupshared памяти). Итоги групп вызывающие держат на стеке
+// (totals[COMPACTION_MAX_BUCKETS]), поэтому каждая точка входа проверяет bucketCount
+// ------------------------------------------------------------------
+inline void GroupScan(const uint32_t* buckets, uint32_t count, uint32_t group, uint32_t* localRank, uint32_t* groupTotals, uint32_t bucketCount)
+{
+    assert(bucketCount <= COMPACTION_MAX_BUCKETS);
+    std::fill(groupTotals, groupTotals + bucketCount, 0u);
+    uint32_t begin = group * COMPACTION_GROUP_SIZE;
+    uint32_t end = (std::min)(count, begin + COMPACTION_GROUP_SIZE);
+    for (uint32_t i = begin; i < end; ++i)
+        if (buckets[i] != COMPACTION_CULLED) localRank[i - begin] = groupTotals[buckets[i]]++;
+}
+
+// ------------------------------------------------------------------
+// Один атомик на (группу, непустую корзину)
+// ------------------------------------------------------------------
+inline void CompactPerGroupAtomic(const uint32_t* buckets, uint32_t count, uint32_t bucketCount, uint32_t threadCount, CompactionResult& r)
+{
+    assert(bucketCount <= COMPACTION_MAX_BUCKETS);
+    uint32_t groupCount = CompactionGroupCount(count);
+    std::vector<std::atomic<uint32_t>> counters(bucketCount);
+    for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t rank[COMPACTION_GROUP_SIZE], totals[COMPACTION_MAX_BUCKETS];
+        GroupScan(buckets, count, g, rank, totals, bucketCount);
+        for (uint32_t b = 0; b < bucketCount; ++b)
+            if (totals[b]) counters[b].fetch_add(totals[b], std::memory_order_relaxed);
+    });
+
+    r.bucketCount.resize(bucketCount);
+    r.bucketStart.resize(bucketCount);
+    for (uint32_t b = 0; b < bucketCount; ++b) { r.bucketCount[b] = counters[b].load(); counters[b].store(0); }
+    ExclusiveBucketStarts(r);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t rank[COMPACTION_GROUP_SIZE], totals[COMPACTION_MAX_BUCKETS], base[COMPACTION_MAX_BUCKETS];
+        GroupScan(buckets, count, g, rank, totals, bucketCount);
+        for (uint32_t b = 0; b < bucketCount; ++b)
+            if (totals[b]) base[b] = r.bucketStart[b] + counters[b].fetch_add(totals[b], std::memory_order_relaxed);
+        uint32_t begin = g * COMPACTION_GROUP_SIZE;
+        uint32_t end = (std::min)(count, begin + COMPACTION_GROUP_SIZE);
+        for (uint32_t i = begin; i < end; ++i)
+            if (buckets[i] != COMPACTION_CULLED) r.ids[base[buckets[i]] + rank[i - begin]] = i;
+    });
+}
+
+// ------------------------------------------------------------------
+// С сохранением порядка: счётчики групп -> скан по группам, параллельно по корзинам (batchArgsCS)
+// -> запись (scatterCS). groupOffsets[g * bucketCount + b] - смещение группы g внутри корзины b
+// ------------------------------------------------------------------
+inline void CompactOrdered(const uint32_t* buckets, uint32_t count, uint32_t bucketCount, uint32_t threadCount,
+    CompactionResult& r, std::vector<uint32_t>& groupOffsets)
+{
+    assert(bucketCount <= COMPACTION_MAX_BUCKETS);
+    uint32_t groupCount = CompactionGroupCount(count);
+    groupOffsets.resize((size_t)groupCount * bucketCount);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t rank[COMPACTION_GROUP_SIZE];
+        GroupScan(buckets, count, g, rank, &groupOffsets[(size_t)g * bucketCount], bucketCount);
+    });
+
+    r.bucketCount.assign(bucketCount, 0u);
+    r.bucketStart.resize(bucketCount);
+    DispatchGroups(bucketCount, threadCount, [&](uint32_t b)
+    {
+        uint32_t offset = 0;
+        for (uint32_t g = 0; g < groupCount; ++g)
+        {
+            uint32_t n = groupOffsets[(size_t)g * bucketCount + b];
+            groupOffsets[(size_t)g * bucketCount + b] = offset;
+            offset += n;
+        }
+        r.bucketCount[b] = offset;
+    });
+    ExclusiveBucketStarts(r);
+
+    DispatchGroups(groupCount, threadCount, [&](uint32_t g)
+    {
+        uint32_t rank[COMPACTION_GROUP_SIZE], totals[COMPACTION_MAX_BUCKETS];
+        GroupScan(buckets, count, g, rank, totals, bucketCount);
+        const uint32_t* offsets = &groupOffsets[(size_t)g * bucketCount];
+        uint32_t begin = g * COMPACTION_GROUP_SIZE;
+        uint32_t end = (std::min)(count, begin + COMPACTION_GROUP_SIZE);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            uint32_t b = buckets[i];
+            if (b != COMPACTION_CULLED) r.ids[r.bucketStart[b] + offsets[b] + rank[i - begin]] = i;
+        }
+    });
+}
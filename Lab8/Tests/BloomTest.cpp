@@ -0,0 +1,272 @@
+// Lab8_BloomTest
+// Свечение на CPU (Bloom.h) против эмуляции GPU-пути: bloomDownPS/bloomUpPS/filterPS как в Source.cpp -
+// 2D-билинейные выборки с clamp и 8-битной дробной частью координат, уровни в RGBA16F, подъём через
+// смешивание с коэффициентом scatter. Итоговый уровень совпадает с точностью fp16, кадр RGBA8
+// (цветной и серый) - не больше 1 младшего разряда на доле пикселей. Затем размеры уровней, AVX2
+// против скалярного пути и любое число потоков - бит в бит, и замер цены: спуск, подъём и сложение
+// при разных scatter (цена от радиуса не зависит) против копирования кадра и прямого размытия.
+// Запуск: BloomTest [ширина высота = 1920 1080] [повторов = 3]
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../Bloom.h"
+
+// Запись в RGBA16F: 11 значащих бит
+static float RoundToHalf(float x)
+{
+    if (x == 0.0f || !std::isfinite(x)) return x;
+    int e;
+    float m = frexpf(x, &e);
+    return ldexpf(nearbyintf(m * 2048.0f) / 2048.0f, e);
+}
+
+// Текстура уровня в эмуляции GPU: RGB подряд, выборка - как сэмплер linearClamp
+struct GpuTexture
+{
+    int width = 0, height = 0;
+    std::vector<float> rgb;
+
+    GpuTexture(int w, int h) : width(w), height(h), rgb((size_t)w * h * 3) {}
+
+    float* At(int x, int y)
+    {
+        x = (std::min)((std::max)(x, 0), width - 1);
+        y = (std::min)((std::max)(y, 0), height - 1);
+        return &rgb[((size_t)y * width + x) * 3];
+    }
+
+    // Дробная часть координаты - 8 бит, как у билинейной фильтрации D3D11
+    void Sample(float u, float v, float out[3])
+    {
+        float x = u * width - 0.5f, y = v * height - 0.5f;
+        float x0 = floorf(x), y0 = floorf(y);
+        float fx = nearbyintf((x - x0) * 256.0f) / 256.0f, fy = nearbyintf((y - y0) * 256.0f) / 256.0f;
+        int ix = (int)x0, iy = (int)y0;
+        for (int c = 0; c < 3; ++c)
+        {
+            float a = At(ix, iy)[c], b = At(ix + 1, iy)[c], d = At(ix, iy + 1)[c], e = At(ix + 1, iy + 1)[c];
+            out[c] = (a * (1.0f - fx) + b * fx) * (1.0f - fy) + (d * (1.0f - fx) + e * fx) * fy;
+        }
+    }
+};
+
+// Проход BLOOM на GPU: уровни той же пирамиды, итог - уровень 0
+static std::vector<GpuTexture> GpuBloom(const std::vector<uint32_t>& scene, uint32_t w, uint32_t h, const BloomPyramid& shape, const BloomSettings& s)
+{
+    GpuTexture frame((int)w, (int)h);
+    for (size_t i = 0; i < scene.size(); ++i)
+        for (int c = 0; c < 3; ++c) frame.rgb[i * 3 + c] = ((scene[i] >> (8 * c)) & 0xFF) / 255.0f;
+    std::vector<GpuTexture> levels;
+    for (const BloomLevel& l : shape.levels) levels.push_back(GpuTexture((int)l.width, (int)l.height));
+
+    // bloomDownPS: четыре выборки между парами текселей, на уровне 0 - порог
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        GpuTexture& src = i ? levels[i - 1] : frame;
+        GpuTexture& dst = levels[i];
+        for (int y = 0; y < dst.height; ++y)
+            for (int x = 0; x < dst.width; ++x)
+            {
+                float px = x + 0.5f, py = y + 0.5f;
+                float ax = (2.0f * px - 0.75f) / src.width, ay = (2.0f * py - 0.75f) / src.height;
+                float bx = (2.0f * px + 0.75f) / src.width, by = (2.0f * py + 0.75f) / src.height;
+                float s0[3], s1[3], s2[3], s3[3], c[3];
+                src.Sample(ax, ay, s0); src.Sample(bx, ay, s1); src.Sample(ax, by, s2); src.Sample(bx, by, s3);
+                for (int k = 0; k < 3; ++k) c[k] = 0.25f * (s0[k] + s1[k] + s2[k] + s3[k]);
+                if (i == 0)
+                {
+                    float weight = BloomPrefilterWeight((std::max)(c[0], (std::max)(c[1], c[2])), s);
+                    for (int k = 0; k < 3; ++k) c[k] *= weight;
+                }
+                for (int k = 0; k < 3; ++k) dst.At(x, y)[k] = RoundToHalf(c[k]);
+            }
+    }
+    // bloomUpPS со смешиванием BLEND_FACTOR / INV_BLEND_FACTOR
+    for (int i = (int)levels.size() - 2; i >= 0; --i)
+    {
+        GpuTexture& src = levels[i + 1];
+        GpuTexture& dst = levels[i];
+        for (int y = 0; y < dst.height; ++y)
+            for (int x = 0; x < dst.width; ++x)
+            {
+                float up[3];
+                src.Sample((x + 0.5f) * 0.5f / src.width, (y + 0.5f) * 0.5f / src.height, up);
+                float* d = dst.At(x, y);
+                for (int k = 0; k < 3; ++k) d[k] = RoundToHalf(up[k] * s.scatter + d[k] * (1.0f - s.scatter));
+            }
+    }
+    return levels;
+}
+
+// Сцена с тёмным шумом и яркими пятнами, которые проходят порог
+static std::vector<uint32_t> MakeScene(uint32_t w, uint32_t h, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> scene((size_t)w * h);
+    for (uint32_t y = 0; y < h; ++y)
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            uint32_t r = rng() % 120, g = rng() % 120, b = rng() % 120;
+            for (int s = 0; s < 6; ++s)
+            {
+                float cx = w * (0.1f + 0.15f * s), cy = h * (0.2f + 0.1f * s);
+                if (hypotf(x - cx, y - cy) < 10.0f + 4.0f * s) { r = 255; g = 230 - 20 * s; b = 200 + s * 9; }
+            }
+            scene[(size_t)y * w + x] = r | (g << 8) | (b << 16) | (0xFFu << 24);
+        }
+    return scene;
+}
+
+static void TestLevels()
+{
+    BloomPyramid p;
+    p.Resize(1283, 721);
+    const uint32_t expected[][2] = { { 642, 361 }, { 321, 181 }, { 161, 91 }, { 81, 46 }, { 41, 23 }, { 21, 12 } };
+    CHECK(p.levels.size() == 6);
+    for (size_t i = 0; i < p.levels.size() && i < 6; ++i)
+        CHECK(p.levels[i].width == expected[i][0] && p.levels[i].height == expected[i][1] && p.levels[i].r.size() == (size_t)expected[i][0] * expected[i][1]);
+    CHECK(BloomLevelCount(1920, 1080) == 6);
+    CHECK(BloomLevelCount(64, 40) == 2);          // 32x20, 16x10; 8x5 уже меньше BLOOM_MIN_SIZE
+    CHECK(BloomLevelCount(4, 4) == 1);            // уровень 0 строится всегда
+
+    // Порог: ниже колена - ноль, выше порога + колено - линейно
+    BloomSettings s;
+    CHECK(BloomPrefilterWeight(s.threshold - s.knee - 0.01f, s) == 0.0f);
+    CHECK_NEAR(BloomPrefilterWeight(2.0f, s) * 2.0f, 2.0f - s.threshold, 1e-5);
+}
+
+static void TestAgainstGpu(uint32_t w, uint32_t h)
+{
+    std::vector<uint32_t> scene = MakeScene(w, h, 7);
+    BloomSettings s;
+    BloomPyramid p;
+    p.Resize(w, h);
+    std::vector<float> scalar((size_t)w * h * 4), simd(scalar.size());
+    p.Build(scene.data(), s, 1, false);
+    p.Composite(scene.data(), s, scalar.data(), 1, false);
+    std::vector<float> level0[3] = { p.levels[0].r, p.levels[0].g, p.levels[0].b };
+
+    // AVX2 и потоки - те же числа
+    for (uint32_t threads : { 1u, 4u })
+    {
+        p.Build(scene.data(), s, threads, true);
+        p.Composite(scene.data(), s, simd.data(), threads, true);
+        CHECK(p.levels[0].r == level0[0] && p.levels[0].g == level0[1] && p.levels[0].b == level0[2]);
+        CHECK(simd == scalar);
+    }
+
+    std::vector<GpuTexture> gpu = GpuBloom(scene, w, h, p, s);
+    double maxDiff = 0.0, maxValue = 0.0;
+    for (size_t i = 0; i < level0[0].size(); ++i)
+        for (int c = 0; c < 3; ++c)
+        {
+            maxDiff = (std::max)(maxDiff, (double)fabsf(level0[c][i] - gpu[0].rgb[i * 3 + c]));
+            maxValue = (std::max)(maxValue, (double)level0[c][i]);
+        }
+    std::printf("%ux%u, %zu levels: final bloom level CPU vs GPU emulation max abs diff %.3g (max value %.3g)\n",
+        w, h, p.levels.size(), maxDiff, maxValue);
+    CHECK(maxValue > 0.05);
+    CHECK(maxDiff < 1e-3);
+
+    // filterPS: сцена + intensity * уровень 0, растянутый выборкой, затем серый или нет; цель RGBA8
+    for (int gray = 0; gray < 2; ++gray)
+    {
+        PostChain chain;
+        if (gray) chain.Grayscale();
+        std::vector<uint32_t> cpu8(scene.size()), gpu8(scene.size());
+        RunPostChain(chain, simd.data(), cpu8.data(), cpu8.size(), 1);
+        for (uint32_t y = 0; y < h; ++y)
+            for (uint32_t x = 0; x < w; ++x)
+            {
+                float up[3], c[3];
+                gpu[0].Sample((x + 0.5f) * 0.5f / gpu[0].width, (y + 0.5f) * 0.5f / gpu[0].height, up);
+                uint32_t src = scene[(size_t)y * w + x];
+                for (int k = 0; k < 3; ++k) c[k] = ((src >> (8 * k)) & 0xFF) / 255.0f + s.intensity * up[k];
+                if (gray) c[0] = c[1] = c[2] = c[0] * 0.299f + c[1] * 0.587f + c[2] * 0.114f;
+                gpu8[(size_t)y * w + x] = PostToUnorm8(c[0]) | (PostToUnorm8(c[1]) << 8) | (PostToUnorm8(c[2]) << 16) | (0xFFu << 24);
+            }
+        int worst = 0;
+        size_t differ = 0, changed = 0;
+        for (size_t i = 0; i < cpu8.size(); ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+                worst = (std::max)(worst, abs((int)((cpu8[i] >> (8 * k)) & 0xFF) - (int)((gpu8[i] >> (8 * k)) & 0xFF)));
+            differ += cpu8[i] != gpu8[i];
+            changed += (cpu8[i] & 0xFFFFFF) != (scene[i] & 0xFFFFFF);
+        }
+        std::printf("  RGBA8 %s: max %d LSB, %.4f%% pixels differ, %.1f%% pixels changed by bloom\n",
+            gray ? "grayscale" : "color", worst, 100.0 * differ / cpu8.size(), 100.0 * changed / cpu8.size());
+        CHECK(worst <= 1 && differ * 1000 < cpu8.size());
+        if (!gray) CHECK(changed * 100 > cpu8.size());
+    }
+}
+
+static void Benchmark(uint32_t w, uint32_t h, int repeats)
+{
+    std::vector<uint32_t> scene((size_t)w * h);
+    std::mt19937 rng(3);
+    for (uint32_t& c : scene) c = rng() | 0xFF000000u;
+    BloomPyramid p;
+    p.Resize(w, h);
+    std::vector<float> out((size_t)w * h * 4);
+    std::vector<uint32_t> out8((size_t)w * h);
+    p.Build(scene.data(), BloomSettings(), 1);
+    double copyMs = 0.0;
+    for (int r = 0; r < repeats; ++r) copyMs += RunPostChain(PostChain(), scene.data(), out8.data(), out8.size(), 1).ms;
+    std::printf("%ux%u, %zu levels (%.1f%% of frame pixels), %d repeats, 1 thread; RGBA8 copy %.2f ms\n",
+        w, h, p.levels.size(), 100.0 * p.stats.levelPixels / (std::max)(p.stats.framePixels, (uint64_t)1), repeats, copyMs / repeats);
+    for (int simd = 0; simd < 2; ++simd)
+    {
+        if (simd && !PostCpuHasAvx2()) { std::printf("AVX2 not available\n"); break; }
+        for (float scatter : { 0.1f, 0.4f, 0.7f, 0.95f })
+        {
+            BloomSettings s;
+            s.scatter = scatter;
+            double down = 0.0, up = 0.0, composite = 0.0;
+            for (int r = 0; r < repeats; ++r)
+            {
+                p.Build(scene.data(), s, 1, simd != 0);
+                p.Composite(scene.data(), s, out.data(), 1, simd != 0);
+                down += p.stats.downMs;
+                up += p.stats.upMs;
+                composite += p.stats.compositeMs;
+            }
+            std::printf("%s scatter %.2f: down %.2f ms, up %.2f ms, composite %.2f ms, pyramid %.2f ms\n",
+                simd ? "AVX2  " : "scalar", scatter, down / repeats, up / repeats, composite / repeats, (down + up) / repeats);
+        }
+    }
+
+    // Для сравнения: прямое раздельное размытие в полном разрешении, один канал - цена растёт с радиусом
+    std::vector<float> a((size_t)w * h), b(a.size());
+    for (int radius : { 4, 16 })
+    {
+        for (size_t i = 0; i < a.size(); ++i) a[i] = (scene[i] & 0xFF) / 255.0f;
+        double t = NowMs();
+        for (uint32_t y = 0; y < h; ++y)
+            for (uint32_t x = 0; x < w; ++x)
+            {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) sum += a[(size_t)y * w + (std::min)((std::max)((int)x + k, 0), (int)w - 1)];
+                b[(size_t)y * w + x] = sum;
+            }
+        for (uint32_t y = 0; y < h; ++y)
+            for (uint32_t x = 0; x < w; ++x)
+            {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) sum += b[(size_t)(std::min)((std::max)((int)y + k, 0), (int)h - 1) * w + x];
+                a[(size_t)y * w + x] = sum;
+            }
+        std::printf("full-resolution separable blur, radius %d, one channel: %.1f ms\n", radius, NowMs() - t);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = argc > 2 ? (uint32_t)atoi(argv[1]) : 1920, height = argc > 2 ? (uint32_t)atoi(argv[2]) : 1080;
+    int repeats = argc > 3 ? atoi(argv[3]) : 3;
+    TestLevels();
+    TestAgainstGpu(1283, 721);                    // нечётные размеры: уровни не ровно вдвое меньше
+    Benchmark(width, height, repeats);
+    return TestResult("BloomTest");
+}
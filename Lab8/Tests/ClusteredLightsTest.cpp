@@ -0,0 +1,99 @@
+// Lab8_ClusteredLightsTest
+// Списки кластеров (ClusteredLights.h) против перебора "каждый источник - каждый кластер",
+// одинаковый результат при любом числе потоков и с SSE/без, и отсутствие выделений памяти
+// в установившемся режиме: рабочие массивы слоёв переживают кадры.
+#include <vector>
+#include <random>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../ClusteredLights.h"
+
+static std::atomic<uint64_t> g_Allocations(0);
+
+void* operator new(size_t size)
+{
+    ++g_Allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static const float NEAR_Z = 0.1f, FAR_Z = 100.0f;
+
+static bool Touches(const ClusterBounds& b, const Float3& p, float r)
+{
+    float dx = (std::max)((std::max)(b.bmin.x - p.x, p.x - b.bmax.x), 0.0f);
+    float dy = (std::max)((std::max)(b.bmin.y - p.y, p.y - b.bmax.y), 0.0f);
+    float dz = (std::max)((std::max)(b.bmin.z - p.z, p.z - b.bmax.z), 0.0f);
+    return dx * dx + dy * dy + dz * dz <= r * r;
+}
+
+int main()
+{
+    Float4x4 view = LookAtLH(MakeFloat3(0, 3, -12), MakeFloat3(0, 0, 0), MakeFloat3(0, 1, 0));
+    Float4x4 proj = PerspectiveFovLH(3.14159265f / 3.0f, 16.0f / 9.0f, NEAR_Z, FAR_Z);
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    std::vector<PointLight> lights(3000);
+    for (PointLight& l : lights)
+    {
+        l.pos = MakeFloat3(u(rng) * 30.0f, u(rng) * 5.0f, u(rng) * 30.0f);
+        l.radius = 1.0f + 2.0f * (u(rng) * 0.5f + 0.5f);
+        l.color = MakeFloat3(1, 1, 1);
+        l.padding = 0;
+    }
+
+    LightClusters reference;
+    reference.BuildBounds(proj.m[0][0], proj.m[1][1], NEAR_Z, FAR_Z);
+    reference.Build(view, lights.data(), (uint32_t)lights.size(), 1, false);
+
+    // Перебор: списки в порядке индекса источника
+    for (uint32_t c = 0; c < CLUSTER_COUNT; ++c)
+    {
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < lights.size(); ++i)
+        {
+            Float4 v = TransformPoint(view, lights[i].pos);
+            if (Touches(reference.bounds[c], MakeFloat3(v.x, v.y, v.z), lights[i].radius)) expected.push_back(i);
+        }
+        uint32_t offset = reference.ranges[c * 2], count = reference.ranges[c * 2 + 1];
+        CHECK(std::vector<uint32_t>(reference.indices.begin() + offset, reference.indices.begin() + offset + count) == expected);
+    }
+    CHECK(reference.maxPerCluster > 0 && !reference.indices.empty());
+
+    for (uint32_t threads = 1; threads <= 8; threads *= 2)
+    {
+        LightClusters clusters;
+        clusters.BuildBounds(proj.m[0][0], proj.m[1][1], NEAR_Z, FAR_Z);
+        clusters.Build(view, lights.data(), (uint32_t)lights.size(), threads, true);
+        CHECK(clusters.ranges == reference.ranges && clusters.indices == reference.indices);
+
+        // Камера едет: списки меняются, после прогона тех же кадров ёмкости хватает - ни одного выделения
+        Float4x4 moving = view;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            uint64_t before = g_Allocations.load();
+            for (int frame = 0; frame < 10; ++frame)
+            {
+                moving.m[3][0] = view.m[3][0] + 0.05f * frame;
+                clusters.Build(moving, lights.data(), (uint32_t)lights.size(), threads, true);
+            }
+            if (pass == 1) CHECK(g_Allocations.load() == before);
+        }
+        clusters.Build(view, lights.data(), (uint32_t)lights.size(), threads, true);
+        CHECK(clusters.indices == reference.indices);
+    }
+
+    LightClusters timed;
+    timed.BuildBounds(proj.m[0][0], proj.m[1][1], NEAR_Z, FAR_Z);
+    timed.Build(view, lights.data(), (uint32_t)lights.size(), 1);
+    double t0 = NowMs();
+    for (int frame = 0; frame < 20; ++frame) timed.Build(view, lights.data(), (uint32_t)lights.size(), 1);
+    std::printf("%zu lights: %.3f ms per build (1 thread), %zu indices, max %u per cluster\n",
+        lights.size(), (NowMs() - t0) / 20, timed.indices.size(), timed.maxPerCluster);
+    return TestResult("ClusteredLightsTest");
+}
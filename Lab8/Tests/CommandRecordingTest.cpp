@@ -0,0 +1,200 @@
+// Lab8_CommandRecordingTest
+// Параллельная запись проходов (CommandRecording.h) на абстрактном списке команд: поток исполнения
+// после Submit совпадает с последовательной записью при любом числе потоков, каждый проход пишется
+// ровно один раз и только в свой контекст, два потока никогда не пишут в один контекст, проход
+// с ошибкой Finish пропускается, списки освобождаются. Затем замер записи кадра на 1/2/4/8 потоках.
+// Запуск: CommandRecordingTest [кадров на число потоков = 200]
+#include <cmath>
+#include <mutex>
+#include <set>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../CommandRecording.h"
+
+// Команда: (проход << 32) | номер отрисовки
+struct MockContext
+{
+    std::vector<uint64_t> ops;
+    std::atomic<int> writers;
+    bool failFinish = false;
+    MockContext() : writers(0) {}
+};
+struct MockList { std::vector<uint64_t> ops; };
+
+static std::atomic<int> g_LiveLists(0);
+
+struct MockCommandApi
+{
+    typedef MockContext Context;
+    typedef MockList CommandList;
+    static MockList* Finish(MockContext* c)
+    {
+        if (c->failFinish) { c->ops.clear(); return nullptr; }
+        MockList* list = new MockList;
+        list->ops.swap(c->ops);
+        ++g_LiveLists;
+        return list;
+    }
+    static void Execute(MockContext* immediate, MockList* list) { immediate->ops.insert(immediate->ops.end(), list->ops.begin(), list->ops.end()); }
+    static void Release(MockList* list) { --g_LiveLists; delete list; }
+};
+
+typedef PassRecorder<MockCommandApi> Recorder;
+
+static volatile double g_Sink;
+
+// Проход p пишет draws команд; каждая "стоит" work итераций (проверка состояния, заполнение констант)
+static void RecordPass(uint32_t p, MockContext* c, uint32_t draws, uint32_t work)
+{
+    for (uint32_t d = 0; d < draws; ++d)
+    {
+        double acc = 0.0;
+        for (uint32_t k = 0; k < work; ++k) acc += std::sqrt((double)(k + d));
+        g_Sink = acc;
+        c->ops.push_back(((uint64_t)p << 32) | d);
+    }
+}
+
+// Проходы кадра неравные по работе: второй - тяжёлый, как instanced в Lab8, остальные лёгкие
+const uint32_t PASS_DRAWS[] = { 1, 3000, 40, 12, 1 };
+const uint32_t PASS_COUNT = sizeof(PASS_DRAWS) / sizeof(PASS_DRAWS[0]);
+
+struct Frame
+{
+    std::vector<MockContext> contexts;
+    Recorder recorder;
+    explicit Frame(uint32_t passes) : contexts(passes)
+    {
+        recorder.slots.resize(passes);
+        for (uint32_t p = 0; p < passes; ++p) recorder.slots[p].context = &contexts[p];
+    }
+};
+
+static void TestOrderAndThreads(int frames)
+{
+    std::vector<uint64_t> reference;
+    {
+        MockContext c;
+        for (uint32_t p = 0; p < PASS_COUNT; ++p) RecordPass(p, &c, PASS_DRAWS[p], 1);
+        reference = c.ops;
+    }
+
+    const uint32_t threadCounts[] = { 0, 1, 2, 3, 4, 5, 8, 16 };   // 0 - как 1, больше проходов - как число проходов
+    int mismatches = 0, wrongContext = 0, overlapped = 0, recordedTwice = 0;
+    std::set<std::thread::id> threadsSeen;
+    std::mutex seenMutex;
+    for (uint32_t threads : threadCounts)
+    {
+        Frame frame(PASS_COUNT);   // контексты и слоты живут между кадрами, как в приложении
+        for (int f = 0; f < frames; ++f)
+        {
+            std::atomic<int> calls[PASS_COUNT];
+            for (uint32_t p = 0; p < PASS_COUNT; ++p) calls[p] = 0;
+            frame.recorder.Record(threads, [&](uint32_t p, MockContext* c)
+            {
+                if (c != &frame.contexts[p]) ++wrongContext;
+                if (c->writers.fetch_add(1) != 0) ++overlapped;
+                ++calls[p];
+                RecordPass(p, c, PASS_DRAWS[p], 1);
+                c->writers.fetch_sub(1);
+                std::lock_guard<std::mutex> lock(seenMutex);
+                threadsSeen.insert(std::this_thread::get_id());
+            });
+            for (uint32_t p = 0; p < PASS_COUNT; ++p)
+            {
+                recordedTwice += calls[p] != 1;
+                CHECK(frame.recorder.slots[p].list != nullptr);
+                CHECK(frame.contexts[p].ops.empty());              // всё ушло в список
+            }
+            MockContext immediate;
+            frame.recorder.Submit(&immediate);
+            mismatches += immediate.ops != reference;
+            for (uint32_t p = 0; p < PASS_COUNT; ++p) CHECK(frame.recorder.slots[p].list == nullptr);
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(wrongContext == 0);
+    CHECK(overlapped == 0);
+    CHECK(recordedTwice == 0);
+    CHECK(g_LiveLists == 0);
+    std::printf("order: %d frames x %u thread counts, %d mismatches, %u distinct recording threads\n",
+        frames, (unsigned)(sizeof(threadCounts) / sizeof(threadCounts[0])), mismatches, (unsigned)threadsSeen.size());
+}
+
+static void TestFinishFailure()
+{
+    Frame frame(PASS_COUNT);
+    frame.contexts[1].failFinish = true;          // instanced: ошибка записи
+    frame.recorder.Record(3, [](uint32_t p, MockContext* c) { RecordPass(p, c, PASS_DRAWS[p], 1); });
+    CHECK(frame.recorder.slots[1].list == nullptr);
+    MockContext immediate;
+    frame.recorder.Submit(&immediate);
+
+    std::vector<uint64_t> expected;
+    {
+        MockContext c;
+        for (uint32_t p = 0; p < PASS_COUNT; ++p)
+            if (p != 1) RecordPass(p, &c, PASS_DRAWS[p], 1);
+        expected = c.ops;
+    }
+    CHECK(immediate.ops == expected);
+    CHECK(g_LiveLists == 0);
+
+    // Следующий кадр без ошибки - проход снова на месте
+    frame.contexts[1].failFinish = false;
+    frame.recorder.Record(3, [](uint32_t p, MockContext* c) { RecordPass(p, c, PASS_DRAWS[p], 1); });
+    immediate.ops.clear();
+    frame.recorder.Submit(&immediate);
+    size_t total = 0;
+    for (uint32_t p = 0; p < PASS_COUNT; ++p) total += PASS_DRAWS[p];
+    CHECK(immediate.ops.size() == total);
+    CHECK(g_LiveLists == 0);
+}
+
+static void TestTimings()
+{
+    Frame frame(PASS_COUNT);
+    frame.recorder.Record(2, [](uint32_t p, MockContext* c) { RecordPass(p, c, PASS_DRAWS[p], 50); });
+    double sum = 0.0;
+    for (const Recorder::Slot& s : frame.recorder.slots)
+    {
+        CHECK(s.recordMs >= 0.0);
+        sum += s.recordMs;
+    }
+    CHECK_NEAR(frame.recorder.TotalRecordMs(), sum, 1e-9);
+    CHECK(frame.recorder.slots[1].recordMs > frame.recorder.slots[0].recordMs);   // 3000 отрисовок против одной
+    MockContext immediate;
+    frame.recorder.Submit(&immediate);
+    CHECK(g_LiveLists == 0);
+}
+
+static void Benchmark()
+{
+    const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+    double base = 0.0;
+    for (uint32_t threads : threadCounts)
+    {
+        Frame frame(PASS_COUNT);
+        double best = 1e30;
+        for (int f = 0; f < 10; ++f)
+        {
+            double t0 = NowMs();
+            frame.recorder.Record(threads, [](uint32_t p, MockContext* c) { RecordPass(p, c, PASS_DRAWS[p], 300); });
+            MockContext immediate;
+            frame.recorder.Submit(&immediate);
+            best = (std::min)(best, NowMs() - t0);
+        }
+        if (threads == 1) base = best;
+        std::printf("threads %u: record + submit %.2f ms (x%.2f)\n", threads, best, base / best);
+    }
+    std::printf("hardware threads: %u; the instanced pass bounds the speedup (one pass - one thread)\n", std::thread::hardware_concurrency());
+}
+
+int main(int argc, char** argv)
+{
+    TestOrderAndThreads(argc > 1 ? atoi(argv[1]) : 200);
+    TestFinishFailure();
+    TestTimings();
+    Benchmark();
+    return TestResult("CommandRecordingTest");
+}
@@ -0,0 +1,77 @@
+// Lab8_ContributionCullingTest
+// ContributionCullSSE против скалярного эталона и замер обоих на одном наборе боксов.
+// Площади считаются в разном порядке операций, поэтому расхождение допускается только у боксов,
+// чья площадь совпадает с порогом с точностью до округления.
+// Запуск: ContributionCullingTest [число боксов = 100000] [повторов = 20]
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../ContributionCulling.h"
+
+static const float VIEWPORT_W = 1280.0f, VIEWPORT_H = 720.0f;
+
+int main(int argc, char** argv)
+{
+    uint32_t count = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000u;
+    int repeats = argc > 2 ? atoi(argv[2]) : 20;
+
+    Float4x4 vp = Mul(LookAtLH(MakeFloat3(0, 10, -20), MakeFloat3(0, 0, 50), MakeFloat3(0, 1, 0)),
+                      PerspectiveFovLH(3.14159265f / 4.0f, VIEWPORT_W / VIEWPORT_H, 0.1f, 1000.0f));
+    const float minArea[2] = { 2.0f, 4.0f };
+    const uint32_t vertices[2] = { 24, 2880 };
+
+    // Сцена как у CreateInstances, но до самой дальней плоскости: много мелочи вдали,
+    // часть боксов у камеры пересекает ближнюю плоскость
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    AABBSoA boxes;
+    boxes.Resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Float3 c = MakeFloat3(u(rng) * 400.0f - 200.0f, u(rng) * 8.0f - 4.0f, u(rng) * 900.0f - 25.0f);
+        float r = 0.05f + 0.5f * u(rng);
+        boxes.Set(i, Sub(c, MakeFloat3(r, r, r)), Add(c, MakeFloat3(r, r, r)), (i / 2) % 2);
+    }
+
+    std::vector<uint8_t> scalar(count), sse(count);
+    ContributionCullScalar(vp, boxes, 0, count, VIEWPORT_W, VIEWPORT_H, minArea, scalar.data());
+    ContributionCullSSE(vp, boxes, count, VIEWPORT_W, VIEWPORT_H, minArea, sse.data());
+
+    uint32_t mismatches = 0, nearClipped = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Float3 bmin = MakeFloat3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+        Float3 bmax = MakeFloat3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+        float area = ProjectedPixelArea(vp, bmin, bmax, VIEWPORT_W, VIEWPORT_H);
+        if (area == FLT_MAX) { ++nearClipped; CHECK(scalar[i] && sse[i]); }
+        if (scalar[i] == sse[i]) continue;
+        ++mismatches;
+        CHECK_NEAR(area, minArea[boxes.category[i]], 1e-4 * minArea[boxes.category[i]]);
+    }
+
+    ContributionStats stats = GatherContributionStats(boxes, count, scalar.data(), vertices);
+    uint32_t culled = 0;
+    uint64_t culledVertices = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        if (!scalar[i]) { ++culled; culledVertices += vertices[boxes.category[i]]; }
+    CHECK(stats.tested == count && stats.culled == culled && stats.culledVertices == culledVertices);
+    if (count >= 1000) CHECK(culled > 0 && culled < count && nearClipped > 0);
+
+    double scalarMs = 1e30, sseMs = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        double t0 = NowMs();
+        ContributionCullScalar(vp, boxes, 0, count, VIEWPORT_W, VIEWPORT_H, minArea, scalar.data());
+        double t1 = NowMs();
+        ContributionCullSSE(vp, boxes, count, VIEWPORT_W, VIEWPORT_H, minArea, sse.data());
+        double t2 = NowMs();
+        scalarMs = (std::min)(scalarMs, t1 - t0);
+        sseMs = (std::min)(sseMs, t2 - t1);
+    }
+    std::printf("%u boxes: culled %u (%.1f%%, %llu vertices), near-clipped %u, SSE/scalar mismatches at threshold %u\n",
+        count, stats.culled, 100.0 * stats.culled / (count ? count : 1), (unsigned long long)stats.culledVertices, nearClipped, mismatches);
+    std::printf("scalar %.3f ms (%.1f Mbox/s), SSE %.3f ms (%.1f Mbox/s), speedup x%.2f\n",
+        scalarMs, count / scalarMs / 1e3, sseMs, count / sseMs / 1e3, scalarMs / sseMs);
+    return TestResult("ContributionCullingTest");
+}
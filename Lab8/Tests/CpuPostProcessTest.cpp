@@ -0,0 +1,230 @@
+// Lab8_CpuPostProcessTest
+// Постобработка на CPU (CpuPostProcess.h): путь AVX2 против скалярного эталона на каждой цепочке
+// (без гаммы - бит в бит, с гаммой - не больше 1 младшего разряда из-за приближения pow), входы
+// RGBA8 и RGBA32F, хвост кадра не кратный 8 и полосе, обработка на месте и любое число потоков,
+// тождественная LUT, серый против формулы filterPS. Затем замер Мпикс/с на цепочку: скалярный
+// путь и AVX2 на одном потоке и на всех, слитная цепочка против прохода на операцию.
+// Без AVX2 (или не x64) сверка пропускается, замер - только скалярный.
+// Запуск: CpuPostProcessTest [ширина высота = 1920 1080] [повторов = 3]
+#include <vector>
+#include <random>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include "TestCommon.h"
+#include "../CpuPostProcess.h"
+
+struct Frame
+{
+    size_t count;
+    std::vector<uint32_t> ldr;   // RGBA8
+    std::vector<float> hdr;      // RGBA32F, цвет до 8
+
+    explicit Frame(size_t n) : count(n), ldr(n), hdr(n * 4)
+    {
+        std::mt19937 rng(1);
+        for (uint32_t& c : ldr) c = rng();
+        std::uniform_real_distribution<float> u(0.0f, 8.0f);
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (int c = 0; c < 3; ++c) hdr[i * 4 + c] = u(rng);
+            hdr[i * 4 + 3] = u(rng) / 8.0f;
+        }
+        // Особые значения: ноль, отрицательные, 1 и больше - на краях зажимов
+        const float special[] = { 0.0f, -0.5f, 1.0f, 1e-8f, 1e6f, 0.999f, 1.001f, -0.0f };
+        for (size_t i = 0; i < sizeof(special) / sizeof(special[0]) && i < n; ++i)
+            hdr[i * 4] = hdr[i * 4 + 1] = hdr[i * 4 + 2] = special[i];
+    }
+};
+
+struct NamedChain
+{
+    PostChain chain;
+    bool hdr;
+    bool HasGamma() const
+    {
+        for (const PostStep& s : chain.steps) if (s.op == POST_GAMMA) return true;
+        return false;
+    }
+};
+
+static PostStats Run(const NamedChain& c, const Frame& f, uint32_t* dst, uint32_t threads, bool simd)
+{
+    return c.hdr ? RunPostChain(c.chain, f.hdr.data(), dst, f.count, threads, simd)
+                 : RunPostChain(c.chain, f.ldr.data(), dst, f.count, threads, simd);
+}
+
+// Наибольшая разница каналов в младших разрядах и доля отличающихся пикселей
+static int MaxLsb(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, size_t* differ = nullptr)
+{
+    int worst = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        n += a[i] != b[i];
+        for (int c = 0; c < 4; ++c)
+            worst = (std::max)(worst, abs((int)((a[i] >> (c * 8)) & 0xFF) - (int)((b[i] >> (c * 8)) & 0xFF)));
+    }
+    if (differ) *differ = n;
+    return worst;
+}
+
+static std::vector<NamedChain> Chains(const ColorLut& lut, const ColorLut& identity)
+{
+    std::vector<NamedChain> chains(8);
+    chains[0].chain.Grayscale(); chains[0].hdr = false;
+    chains[1].chain.Gamma(2.2f); chains[1].hdr = false;
+    chains[2].chain.Grade(lut); chains[2].hdr = false;
+    chains[3].chain.Grade(identity); chains[3].hdr = false;
+    chains[4].chain.Exposure(0.7f).Reinhard().Gamma(2.2f); chains[4].hdr = true;
+    chains[5].chain.Exposure(0.6f).Aces().Grade(lut).Gamma(2.2f); chains[5].hdr = true;
+    chains[6].chain.Exposure(0.6f).Aces().Quantize().Grayscale(); chains[6].hdr = true;
+    chains[7].hdr = false;                        // пустая цепочка - копия
+    return chains;
+}
+
+static void TestAvx2MatchesScalar(const Frame& frame, const std::vector<NamedChain>& chains)
+{
+    if (!PostCpuHasAvx2())
+    {
+        std::printf("AVX2 not available: scalar/AVX2 comparison skipped\n");
+        return;
+    }
+    std::vector<uint32_t> scalar(frame.count), avx2(frame.count);
+    for (const NamedChain& c : chains)
+    {
+        PostStats s = Run(c, frame, scalar.data(), 1, false), v = Run(c, frame, avx2.data(), 1, true);
+        CHECK(!s.avx2 && v.avx2);
+        size_t differ = 0;
+        int lsb = MaxLsb(scalar, avx2, &differ);
+        std::printf("%-40s %s: AVX2 vs scalar max %d LSB, %zu of %zu pixels differ\n",
+            c.chain.Describe().c_str(), c.hdr ? "RGBA32F" : "RGBA8  ", lsb, differ, frame.count);
+        if (c.HasGamma()) CHECK(lsb <= 1 && differ * 1000 < frame.count);
+        else CHECK(lsb == 0);
+    }
+
+#ifdef POST_X64
+    // pow через log2/exp2 против double: относительная ошибка на всём [0, 1]
+    PostStep gamma = { POST_GAMMA, { 1.0f / 2.2f, 0.0f, 0.0f }, nullptr };
+    static PostStrip strip;
+    double maxRel = 0.0;
+    for (uint32_t base = 1; base <= 100000; base += POST_STRIP)
+    {
+        uint32_t n = (std::min)(POST_STRIP, 100001 - base);
+        for (uint32_t i = 0; i < n; ++i) strip.r[i] = strip.g[i] = strip.b[i] = (base + i) / 100000.0f;
+        uint32_t n8 = (n + 7) & ~7u;
+        for (uint32_t i = n; i < n8; ++i) strip.r[i] = strip.g[i] = strip.b[i] = 1.0f;
+        PostStepAvx2(gamma, strip, n8);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            double ref = pow((base + i) / 100000.0f, 1.0 / 2.2);
+            maxRel = (std::max)(maxRel, fabs(strip.r[i] - ref) / ref);
+        }
+    }
+    std::printf("AVX2 pow(x, 1/2.2) on (0, 1]: max relative error %.2e\n", maxRel);
+    CHECK(maxRel < 2e-6);
+#endif
+}
+
+static void TestInvariants(const Frame& frame, const ColorLut& identity)
+{
+    std::vector<uint32_t> reference(frame.count), out(frame.count);
+    PostChain gamma;
+    gamma.Gamma(2.2f);
+    for (bool simd : { false, true })
+    {
+        RunPostChain(gamma, frame.ldr.data(), reference.data(), frame.count, 1, simd);
+        // Любое число потоков и на месте - тот же результат
+        for (uint32_t threads : { 2u, 3u, 8u })
+        {
+            out = frame.ldr;
+            PostStats s = RunPostChain(gamma, out.data(), out.data(), frame.count, threads, simd);
+            CHECK(out == reference);
+            CHECK(s.threads == (std::min)(threads, (uint32_t)((frame.count + POST_STRIP - 1) / POST_STRIP)));
+        }
+        // Тождественная LUT и пустая цепочка не меняют RGBA8
+        PostChain id;
+        id.Grade(identity);
+        RunPostChain(id, frame.ldr.data(), out.data(), frame.count, 1, simd);
+        CHECK(MaxLsb(out, frame.ldr) == 0);
+        RunPostChain(PostChain(), frame.ldr.data(), out.data(), frame.count, 1, simd);
+        CHECK(out == frame.ldr);
+        // Кадр короче одной группы из 8 пикселей
+        uint32_t tiny[3] = {};
+        RunPostChain(PostChain(), frame.ldr.data(), tiny, 3, 1, simd);
+        CHECK(memcmp(tiny, frame.ldr.data(), sizeof(tiny)) == 0);
+        CHECK(RunPostChain(PostChain(), frame.ldr.data(), tiny, 0, 4, simd).pixels == 0);
+    }
+
+    // Серый - как filterPS по UNORM-цели: dot(rgb, веса), альфа не меняется
+    PostChain gray;
+    gray.Grayscale();
+    RunPostChain(gray, frame.ldr.data(), out.data(), frame.count, 1, true);
+    size_t wrong = 0;
+    for (size_t i = 0; i < frame.count; ++i)
+    {
+        uint32_t c = frame.ldr[i];
+        float y = ((c & 0xFF) * 0.299f + ((c >> 8) & 0xFF) * 0.587f + ((c >> 16) & 0xFF) * 0.114f) / 255.0f;
+        uint32_t v = PostToUnorm8(y);
+        uint32_t o = out[i];
+        wrong += (o >> 24) != (c >> 24) || (o & 0xFF) != ((o >> 8) & 0xFF) || (o & 0xFF) != ((o >> 16) & 0xFF) ||
+            abs((int)(o & 0xFF) - (int)v) > 1;
+    }
+    CHECK(wrong == 0);
+    CHECK(gamma.Describe() == "gamma" && PostChain().Describe() == "copy");
+}
+
+static void Benchmark(const Frame& frame, const std::vector<NamedChain>& chains, int repeats)
+{
+    bool avx2 = PostCpuHasAvx2();
+    uint32_t cores = (std::max)(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> out(frame.count);
+    std::printf("%zu pixels, %d repeats, %u hardware threads\n", frame.count, repeats, cores);
+    std::printf("%-46s | scalar Mpix/s | AVX2 Mpix/s (x) | AVX2, %u threads\n", "chain", cores);
+    for (const NamedChain& c : chains)
+    {
+        double ms[3] = {};
+        for (int r = 0; r < repeats; ++r)
+        {
+            ms[0] += Run(c, frame, out.data(), 1, false).ms;
+            if (avx2) ms[1] += Run(c, frame, out.data(), 1, true).ms;
+            ms[2] += Run(c, frame, out.data(), cores, avx2).ms;
+        }
+        double mp[3];
+        for (int k = 0; k < 3; ++k) mp[k] = ms[k] > 0.0 ? frame.count * repeats / (ms[k] * 1000.0) : 0.0;
+        std::printf("%-46s | %13.1f | %7.1f (x%4.1f) | %.1f\n", (c.chain.Describe() + (c.hdr ? " (f32)" : "")).c_str(),
+            mp[0], mp[1], mp[0] > 0.0 ? mp[1] / mp[0] : 0.0, mp[2]);
+    }
+
+    // Слитная цепочка против прохода на операцию через RGBA8 между проходами
+    const NamedChain& full = chains[5];
+    double fused = 0.0, separate = 0.0;
+    for (int r = 0; r < repeats; ++r)
+    {
+        fused += Run(full, frame, out.data(), 1, avx2).ms;
+        for (size_t s = 0; s < full.chain.steps.size(); ++s)
+        {
+            PostChain one;
+            one.steps.push_back(full.chain.steps[s]);
+            separate += s == 0 ? RunPostChain(one, frame.hdr.data(), out.data(), frame.count, 1, avx2).ms
+                               : RunPostChain(one, out.data(), out.data(), frame.count, 1, avx2).ms;
+        }
+    }
+    std::printf("%s: fused %.2f ms, %zu separate passes %.2f ms\n", full.chain.Describe().c_str(),
+        fused / repeats, full.chain.steps.size(), separate / repeats);
+}
+
+int main(int argc, char** argv)
+{
+    size_t width = argc > 2 ? (size_t)atol(argv[1]) : 1920, height = argc > 2 ? (size_t)atol(argv[2]) : 1080;
+    int repeats = argc > 3 ? atoi(argv[3]) : 3;
+    Frame frame(width * height + 5);              // хвост: не кратно ни 8, ни полосе
+    ColorLut lut, identity;
+    lut.Build(33, [](float r, float g, float b, float* out) { out[0] = sqrtf(r) * 0.9f + 0.05f * b; out[1] = g * g; out[2] = 1.0f - b * 0.5f + 0.1f * r; });
+    identity.Identity(17);
+    std::vector<NamedChain> chains = Chains(lut, identity);
+    TestAvx2MatchesScalar(frame, chains);
+    TestInvariants(frame, identity);
+    Benchmark(frame, chains, repeats);
+    return TestResult("CpuPostProcessTest");
+}
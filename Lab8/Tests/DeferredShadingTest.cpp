@@ -0,0 +1,235 @@
+// Lab8_DeferredShadingTest
+// G-буфер отложенного освещения (DeferredShading.h): кодирование и декодирование текселя (октаэдрическая
+// нормаль в SNORM16 - угловая ошибка и единичная длина, включая полюса и рёбра октаэдра, блеск и цвет
+// через UNORM8), тест глубины при записи, восстановление позиции по глубине. Затем сцена из сфер
+// и 2048 источников: разрешение по спискам кластеров (тайл экрана x слой глубины) совпадает
+// с перебором всех источников, пиксели неба не трогаются, освещение платит только видимый пиксель.
+#include <vector>
+#include <random>
+#include <cmath>
+#include "TestCommon.h"
+#include "../DeferredShading.h"
+
+static double AngleDegrees(const Float3& a, const Float3& b)
+{
+    double d = (std::min)(1.0, (std::max)(-1.0, (double)Dot(a, b) / (Length(a) * Length(b))));
+    Float3 c = Cross(a, b);
+    // Для малых углов atan2 по векторному и скалярному произведениям точнее acos
+    return atan2(sqrt((double)c.x * c.x + (double)c.y * c.y + (double)c.z * c.z), d) * 180.0 / 3.14159265358979;
+}
+
+static void TestEncodeDecode()
+{
+    // Полюса, рёбра и углы октаэдра - там развёртка ломается, если ошибиться со знаками
+    const float special[][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+        { 0, 0.7071f, -0.7071f }, { -0.5f, -0.5f, -0.7071f }, { 1, 1, -1e-6f }, { -1, 1, 0 }, { 1e-7f, -1e-7f, -1 } };
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    double maxAngle = 0.0;
+    int nonUnit = 0;
+    const int count = 200000;
+    for (int i = 0; i < count; ++i)
+    {
+        Float3 n;
+        if (i < (int)(sizeof(special) / sizeof(special[0]))) n = Normalize(MakeFloat3(special[i][0], special[i][1], special[i][2]));
+        else do { n = MakeFloat3(u(rng), u(rng), u(rng)); } while (Length(n) < 0.01f);
+        n = Normalize(n);
+        GBufferSurface s = DecodeGBuffer(EncodeGBuffer(MakeFloat3(0.5f, 0.25f, 1.0f), n, 32.0f));
+        maxAngle = (std::max)(maxAngle, AngleDegrees(n, s.normal));
+        nonUnit += !(fabsf(Length(s.normal) - 1.0f) < 1e-5f);
+        if (i < 6) CHECK(AngleDegrees(n, s.normal) < 1e-3);   // оси - точно
+    }
+    std::printf("octahedral SNORM16 normal: max angular error %.5f deg over %d normals\n", maxAngle, count);
+    CHECK(maxAngle < 0.01);
+    CHECK(nonUnit == 0);
+
+    // Целые степени блеска и цвета k / 255 проходят без потерь
+    for (uint32_t k = 0; k < 256; ++k)
+    {
+        float c = k / 255.0f;
+        GBufferTexel t = EncodeGBuffer(MakeFloat3(c, 1.0f - c, c), MakeFloat3(0, 0, 1), (float)k);
+        CHECK((t.albedo & 0xFF) == k && ((t.albedo >> 8) & 0xFF) == 255 - k && (t.albedo >> 24) == k);
+        GBufferSurface s = DecodeGBuffer(t);
+        CHECK(s.shininess == (float)k);
+        CHECK_NEAR(s.albedo.x, c, 1e-6);
+        CHECK_NEAR(s.albedo.y, 1.0f - c, 1e-6);
+    }
+    // Вне диапазона - зажим формата
+    GBufferTexel t = EncodeGBuffer(MakeFloat3(-1.0f, 2.0f, 0.5f), MakeFloat3(0, 0, -1), 1000.0f);
+    CHECK((t.albedo & 0xFF) == 0 && ((t.albedo >> 8) & 0xFF) == 255 && (t.albedo >> 24) == 255);
+    CHECK(FromSnorm16(-32768) == -1.0f && FromSnorm16(ToSnorm16(1.0f)) == 1.0f);
+}
+
+static void TestDepthTest()
+{
+    GBuffer gb;
+    gb.Resize(4, 2);
+    CHECK(gb.texels.size() == 8 && gb.depth.size() == 8 && gb.depth[7] == 1.0f);
+    Float3 red = MakeFloat3(1, 0, 0), green = MakeFloat3(0, 1, 0), up = MakeFloat3(0, 1, 0);
+    CHECK(gb.Write(1, 1, 0.5f, red, up, 8.0f));
+    CHECK(!gb.Write(1, 1, 0.5f, green, up, 8.0f));   // LESS: равная глубина не проходит
+    CHECK(!gb.Write(1, 1, 0.7f, green, up, 8.0f));
+    CHECK(DecodeGBuffer(gb.texels[5]).albedo.x == 1.0f);
+    CHECK(gb.Write(1, 1, 0.2f, green, up, 8.0f));
+    CHECK(DecodeGBuffer(gb.texels[5]).albedo.y == 1.0f && gb.depth[5] == 0.2f);
+    CHECK(!gb.Write(0, 0, 1.0f, red, up, 8.0f));     // на дальней плоскости - небо
+    gb.Clear();
+    CHECK(gb.depth[5] == 1.0f && gb.texels[5].albedo == 0);
+}
+
+struct Sphere { Float3 center; float radius; Float3 albedo; float shininess; };
+
+struct SphereScene
+{
+    static const uint32_t W = 320, H = 180;
+    const float nearZ = 0.1f, farZ = 100.0f;
+    Float3 eye;
+    Float4x4 view, proj, viewProj, invViewProj;
+    std::vector<Sphere> spheres;
+    std::vector<PointLight> lights;
+    GBuffer gbuffer;
+    uint64_t fragments = 0, passed = 0;
+    std::vector<std::vector<float>> passedDepths;   // глубины фрагментов, прошедших тест при отрисовке
+
+    SphereScene()
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+        eye = MakeFloat3(0.5f, 1.2f, -4.0f);
+        view = LookAtLH(eye, MakeFloat3(0, 0, 0), MakeFloat3(0, 1, 0));
+        proj = PerspectiveFovLH(3.14159265f / 3.0f, (float)W / H, nearZ, farZ);
+        viewProj = Mul(view, proj);
+        invViewProj = Inverse(viewProj);
+        lights.resize(2048);
+        for (PointLight& l : lights)
+        {
+            l.pos = MakeFloat3(u(rng) * 4.0f, u(rng) * 4.0f, u(rng) * 4.0f);
+            l.radius = 0.3f + 0.7f * (u(rng) * 0.5f + 0.5f);
+            l.color = MakeFloat3(0.5f + 0.5f * u(rng), 0.6f, 0.7f);
+            l.padding = 0;
+        }
+        spheres.resize(120);
+        for (Sphere& s : spheres)
+        {
+            s.center = MakeFloat3(u(rng) * 2.5f, u(rng) * 2.5f, u(rng) * 2.5f);
+            s.radius = 0.2f + 0.3f * (u(rng) * 0.5f + 0.5f);
+            s.albedo = MakeFloat3(0.5f + 0.5f * u(rng), 0.5f, 0.3f);
+            s.shininess = rng() % 2 ? 32.0f : 8.0f;
+        }
+
+        // Проход геометрии: сферы по очереди, пересечение луча через центр пикселя
+        gbuffer.Resize(W, H);
+        passedDepths.resize((size_t)W * H);
+        for (const Sphere& s : spheres)
+            for (uint32_t y = 0; y < H; ++y)
+                for (uint32_t x = 0; x < W; ++x)
+                {
+                    Float3 onNear = ReconstructWorldPosition(invViewProj, x + 0.5f, y + 0.5f, 0.0f, (float)W, (float)H);
+                    Float3 d = Normalize(Sub(onNear, eye)), oc = Sub(eye, s.center);
+                    float b = Dot(oc, d), disc = b * b - (Dot(oc, oc) - s.radius * s.radius);
+                    if (disc < 0.0f) continue;
+                    float t = -b - sqrtf(disc);
+                    if (t < 0.0f) continue;
+                    Float3 p = Add(eye, Scale(d, t));
+                    Float4 clip = TransformPoint(viewProj, p);
+                    float z = clip.z / clip.w;
+                    ++fragments;
+                    if (!gbuffer.Write(x, y, z, s.albedo, Normalize(Sub(p, s.center)), s.shininess)) continue;
+                    ++passed;
+                    passedDepths[(size_t)y * W + x].push_back(z);
+                }
+    }
+
+    DeferredView View() const
+    {
+        DeferredView v;
+        v.invViewProj = invViewProj;
+        v.cameraPos = eye;
+        v.ambient = MakeFloat3(0.2f, 0.2f, 0.2f);
+        v.nearZ = nearZ;
+        v.farZ = farZ;
+        return v;
+    }
+};
+
+static void TestReconstruction(const SphereScene& scene)
+{
+    // Восстановленная точка лежит на поверхности одной из сфер
+    double maxErr = 0.0;
+    int pixels = 0;
+    for (uint32_t y = 0; y < scene.H; ++y)
+        for (uint32_t x = 0; x < scene.W; ++x)
+        {
+            float depth = scene.gbuffer.depth[(size_t)y * scene.W + x];
+            if (depth >= 1.0f) continue;
+            ++pixels;
+            Float3 p = ReconstructWorldPosition(scene.invViewProj, x + 0.5f, y + 0.5f, depth, (float)scene.W, (float)scene.H);
+            float best = 1e9f;
+            for (const Sphere& s : scene.spheres) best = (std::min)(best, fabsf(Length(Sub(p, s.center)) - s.radius));
+            maxErr = (std::max)(maxErr, (double)best);
+        }
+    std::printf("position from depth: %d pixels, max distance to surface %.2e\n", pixels, maxErr);
+    CHECK(pixels > 5000);
+    CHECK(maxErr < 1e-3);
+}
+
+static void TestTiledResolve(const SphereScene& scene)
+{
+    LightClusters clusters;
+    clusters.BuildBounds(scene.proj.m[0][0], scene.proj.m[1][1], scene.nearZ, scene.farZ);
+    clusters.Build(scene.view, scene.lights.data(), (uint32_t)scene.lights.size(), 1);
+    DeferredView view = scene.View();
+    const Float3 sentinel = MakeFloat3(-7.0f, -7.0f, -7.0f);
+    std::vector<Float3> tiled((size_t)scene.W * scene.H, sentinel), all = tiled;
+    DeferredStats stats = scene.gbuffer.Resolve(view, scene.lights.data(), clusters, tiled.data());
+    scene.gbuffer.ResolveAllLights(view, scene.lights.data(), (uint32_t)scene.lights.size(), all.data());
+
+    double maxDiff = 0.0, maxValue = 0.0;
+    uint32_t visible = 0, sky = 0;
+    uint64_t listSum = 0;
+    for (uint32_t y = 0; y < scene.H; ++y)
+        for (uint32_t x = 0; x < scene.W; ++x)
+        {
+            size_t i = (size_t)y * scene.W + x;
+            float depth = scene.gbuffer.depth[i];
+            if (depth >= 1.0f)
+            {
+                ++sky;
+                CHECK(tiled[i].x == sentinel.x && all[i].x == sentinel.x);
+                continue;
+            }
+            ++visible;
+            uint32_t c = ClusterForPixel(x + 0.5f, y + 0.5f, depth, (float)scene.W, (float)scene.H, scene.nearZ, scene.farZ);
+            listSum += clusters.ranges[c * 2 + 1];
+            maxDiff = (std::max)(maxDiff, (double)(std::max)((std::max)(fabsf(tiled[i].x - all[i].x), fabsf(tiled[i].y - all[i].y)), fabsf(tiled[i].z - all[i].z)));
+            maxValue = (std::max)(maxValue, (double)(std::max)((std::max)(all[i].x, all[i].y), all[i].z));
+        }
+
+    // Прямой проход платил бы список кластера за каждый фрагмент, прошедший тест глубины при отрисовке
+    uint64_t forward = 0;
+    for (uint32_t y = 0; y < scene.H; ++y)
+        for (uint32_t x = 0; x < scene.W; ++x)
+            for (float z : scene.passedDepths[(size_t)y * scene.W + x])
+                forward += clusters.ranges[ClusterForPixel(x + 0.5f, y + 0.5f, z, (float)scene.W, (float)scene.H, scene.nearZ, scene.farZ) * 2 + 1];
+    std::printf("%ux%u, %zu spheres, %zu lights: %llu fragments, %llu passed depth, %u visible pixels, %u sky\n",
+        scene.W, scene.H, scene.spheres.size(), scene.lights.size(), (unsigned long long)scene.fragments, (unsigned long long)scene.passed, visible, sky);
+    std::printf("clustered vs all lights: max abs diff %.3g (max value %.3g); light evaluations deferred %llu (max %u per pixel), forward %llu (x%.2f)\n",
+        maxDiff, maxValue, (unsigned long long)stats.lightEvaluations, stats.maxLightsPerPixel, (unsigned long long)forward,
+        (double)forward / (std::max)(stats.lightEvaluations, (uint64_t)1));
+    CHECK(stats.shadedPixels == visible && sky > 0);
+    CHECK(stats.lightEvaluations == listSum);
+    CHECK(stats.maxLightsPerPixel > 0 && stats.lightEvaluations < (uint64_t)visible * scene.lights.size() / 20);
+    CHECK(maxValue > 0.5);                        // источники действительно освещают сцену
+    CHECK(maxDiff < 1e-4);
+    CHECK(scene.passed > visible && forward > stats.lightEvaluations);
+}
+
+int main()
+{
+    TestEncodeDecode();
+    TestDepthTest();
+    SphereScene scene;
+    TestReconstruction(scene);
+    TestTiledResolve(scene);
+    return TestResult("DeferredShadingTest");
+}
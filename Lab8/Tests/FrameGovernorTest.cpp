@@ -0,0 +1,242 @@
+// Lab8_FrameGovernorTest
+// Регулятор бюджета кадра (FrameGovernor.h) на синтетических трассах времени CPU и GPU.
+// Сначала точные трассы: кадр шага после settleFrames + window кадров, порядок понижений
+// (разрешение, LOD, плотность по GPU, только плотность по CPU) и повышений в обратном порядке,
+// settle - кадры в полёте после шага не попадают в окно, медиана не замечает одиночных всплесков,
+// прогноз выигрыша не даёт повышения, после которого кадр снова вылетит из бюджета, откат удваивает
+// ожидание до maxRaiseFrames, удачная проба сокращает его вдвое.
+// Затем сценарии на модели нагрузки с GPU, отстающим на 3 кадра, и шумом: ступенька и рампа нагрузки,
+// перегрузка, упор в CPU, нагрузка у порога ступени, пачки тяжёлых кадров; отчёт по каждому.
+#include <vector>
+#include <random>
+#include "TestCommon.h"
+#include "../FrameGovernor.h"
+
+// Кадров до шага (с 1), 0 - шага не было за limit кадров
+static uint32_t Feed(FrameGovernor& g, double cpuMs, double gpuMs, uint32_t limit)
+{
+    for (uint32_t f = 1; f <= limit; ++f)
+        if (g.Update(cpuMs, gpuMs)) return f;
+    return 0;
+}
+
+static bool Steps(const FrameGovernor& g, uint32_t resolution, uint32_t lod, uint32_t density)
+{
+    return g.step[GOVERNOR_RESOLUTION] == resolution && g.step[GOVERNOR_LOD] == lod && g.step[GOVERNOR_DENSITY] == density;
+}
+
+static void TestSizes()
+{
+    CHECK(GovernorRenderSize(1920, 0.875f) == 1680 && GovernorRenderSize(1080, 0.625f) == 675);
+    CHECK(GovernorRenderSize(1, 0.5f) == 1);
+    CHECK(GovernorInstanceCount(1000, 0.75f) == 750 && GovernorInstanceCount(3, 0.5f) == 2 && GovernorInstanceCount(1, 0.5f) == 1);
+}
+
+static void TestDropAndRaiseOrder()
+{
+    FrameGovernor g;
+    g.Reset();
+    const GovernorSettings& s = g.settings;
+    const uint32_t step = s.settleFrames + s.window;        // кадров от шага до первой медианы
+
+    // GPU за бюджетом: разрешение до конца, затем LOD, затем плотность; каждый шаг - ровно через step кадров
+    const uint32_t expected[][3] = {
+        { 1, 0, 0 }, { 2, 0, 0 }, { 3, 0, 0 }, { 4, 0, 0 }, { 4, 1, 0 }, { 4, 2, 0 }, { 4, 2, 1 }, { 4, 2, 2 } };
+    for (const uint32_t* e : expected)
+    {
+        CHECK(Feed(g, 2.0, 30.0, 1000) == step);
+        CHECK(Steps(g, e[0], e[1], e[2]) && g.GpuBound());
+    }
+    CHECK(g.Drops() == 8 && g.RenderScale() == 0.5f && g.LodScale() == 0.5f && g.Density() == 0.5f);
+    // Крутить нечего: каждый кадр с медианой - сверх бюджета
+    CHECK(Feed(g, 2.0, 30.0, 100) == 0);
+    CHECK(g.stats.exhausted == 100 - (step - 1));
+
+    // Повышения снимают понижения с конца, каждое - после raiseFrames кадров под порогом. Первое окно
+    // не начинается заново: медиана опускается, когда лёгких кадров в нём становится больше половины
+    const uint32_t full[3] = {};
+    for (int i = 7; i >= 0; --i)
+    {
+        CHECK(Feed(g, 2.0, 2.0, 1000) == (i == 7 ? s.window / 2 : step - 1) + s.raiseFrames);
+        const uint32_t* e = i > 0 ? expected[i - 1] : full;
+        CHECK(Steps(g, e[0], e[1], e[2]));
+    }
+    CHECK(Steps(g, 0, 0, 0) && g.Drops() == 0);
+    CHECK(Feed(g, 2.0, 2.0, 3000) == 0);                    // полное качество: повышать некуда
+    CHECK(g.stats.drops == 8 && g.stats.raises == 8 && g.stats.rollbacks == 0);
+
+    // Упор в CPU: только плотность, разрешение и LOD CPU не разгружают
+    g.Reset();
+    CHECK(Feed(g, 30.0, 5.0, 1000) == step && Steps(g, 0, 0, 1) && !g.GpuBound());
+    CHECK(Feed(g, 30.0, 5.0, 1000) == step && Steps(g, 0, 0, 2));
+    CHECK(Feed(g, 30.0, 5.0, 100) == 0 && g.stats.exhausted > 0 && g.Drops() == 2);
+}
+
+static void TestSettleAndSpikes()
+{
+    // После шага GPU ещё отдаёт кадры, нарисованные до него: settleFrames кадров в окно не идут
+    for (uint32_t settle : { 4u, 0u })
+    {
+        FrameGovernor g;
+        g.settings.settleFrames = settle;
+        g.Reset();
+        CHECK(Feed(g, 2.0, 30.0, 1000) > 0);
+        Feed(g, 2.0, 100.0, 4);                             // кадры в полёте со старым качеством
+        uint32_t next = Feed(g, 2.0, 13.0, 500);            // между порогами: шагать незачем
+        std::printf("settleFrames %u: %s\n", settle, next ? "in-flight frames caused a second drop" : "no second drop");
+        CHECK((next != 0) == (settle == 0));
+    }
+
+    // Медиана окна: до window / 2 - 1 всплесков на окно не двигают ступень, window / 2 - двигают
+    FrameGovernor g;
+    g.Reset();
+    uint32_t w = g.settings.window;
+    uint32_t changes = 0;
+    for (uint32_t f = 0; f < 5000; ++f)
+        changes += g.Update(2.0, f % w < w / 2 - 1 ? 60.0 : 8.0);
+    CHECK(changes == 0 && g.stats.frames == 5000);
+    for (uint32_t f = 0; f < w * 4 && !changes; ++f)
+        changes += g.Update(2.0, f % w < w / 2 ? 60.0 : 8.0);
+    CHECK(changes == 1 && g.Drops() == 1);
+}
+
+static void TestRaisePrediction()
+{
+    // Повышение только если кадр, умноженный на выигрыш понижения, уложится в budget * overFraction
+    FrameGovernor g;
+    g.settings.underFraction = 0.9;                         // под порогом - до 15 мс
+    g.Reset();
+    const GovernorSettings& s = g.settings;
+    CHECK(Feed(g, 2.0, 20.0, 1000) > 0 && g.RenderScale() == 0.875f);
+    // 13 мс после понижения с 20: выигрыш 20 / 13 ограничен номинальным 1 / 0.875^2, 13 * 1.31 - сверх бюджета
+    CHECK(Feed(g, 2.0, 13.0, 3000) == 0 && g.RenderScale() == 0.875f);
+    // 11 мс: 11 * 1.31 = 14.4 - укладывается; медиана сдвигается через window / 2 + 1 кадров
+    CHECK(Feed(g, 2.0, 11.0, 3000) == s.window / 2 + s.raiseFrames && g.RenderScale() == 1.0f);
+}
+
+static void TestRollbackBackoff()
+{
+    FrameGovernor g;
+    g.Reset();
+    const GovernorSettings& s = g.settings;
+    const uint32_t step = s.settleFrames + s.window;
+    CHECK(Feed(g, 2.0, 30.0, 1000) == step);
+    // Повышение сразу откатывается: ожидание 60 -> 120 -> 240 -> 480 -> 960 -> 960
+    uint32_t delay = s.raiseFrames;
+    for (int i = 0; i < 6; ++i)
+    {
+        CHECK(g.RaiseDelay() == delay);
+        CHECK(Feed(g, 2.0, 2.0, 3000) == step - 1 + delay && g.RenderScale() == 1.0f);
+        CHECK(Feed(g, 2.0, 30.0, 1000) == step && g.RenderScale() == 0.875f);
+        delay = (std::min)(delay * 2, s.maxRaiseFrames);
+        CHECK(g.stats.rollbacks == (uint32_t)i + 1);
+    }
+    CHECK(g.RaiseDelay() == s.maxRaiseFrames);
+
+    // Повышение пережило probeFrames: ожидание вдвое короче, понижение после пробы - не откат
+    CHECK(Feed(g, 2.0, 2.0, 3000) == step - 1 + s.maxRaiseFrames);
+    CHECK(Feed(g, 2.0, 2.0, s.probeFrames) == 0 && g.RaiseDelay() == s.maxRaiseFrames / 2);
+    CHECK(Feed(g, 2.0, 30.0, 1000) == s.window / 2 && g.stats.rollbacks == 6);   // окно не перезапускалось: медиана - верхняя
+    CHECK(Feed(g, 2.0, 2.0, 3000) == step - 1 + s.maxRaiseFrames / 2);
+    // Удачные пробы подряд возвращают ожидание к raiseFrames, не ниже
+    for (int i = 0; i < 6; ++i)
+    {
+        Feed(g, 2.0, 2.0, s.probeFrames);
+        Feed(g, 2.0, 30.0, step);
+        Feed(g, 2.0, 2.0, 3000);
+    }
+    CHECK(g.RaiseDelay() == s.raiseFrames);
+}
+
+// Модель нагрузки: GPU = fixed + pixels * scale^2 * цена LOD * плотность, CPU = base + perInstance * плотность
+struct Load { double gpuFixed, gpuPixels, cpuBase, cpuInstances; };
+
+struct Scenario
+{
+    GovernorStats stats;
+    uint32_t changes = 0;
+    double overBudget = 0.0, averageScale = 0.0;
+    float scale = 1.0f, lod = 1.0f, density = 1.0f;
+    uint32_t backInBudget = 0;       // кадр, на котором набралось 30 кадров подряд в бюджете
+};
+
+static Scenario Run(const char* name, uint32_t frames, Load (*load)(uint32_t), double noise, uint32_t spikeEvery)
+{
+    FrameGovernor g;
+    g.Reset();
+    std::mt19937 rng(42);
+    std::normal_distribution<double> n(0.0, noise);
+    std::vector<double> inFlight(3, 0.0);                 // время GPU кадра f приходит через 3 кадра
+    Scenario r;
+    uint32_t over = 0, inRow = 0;
+    double scaleSum = 0.0;
+    for (uint32_t f = 0; f < frames; ++f)
+    {
+        Load l = load(f);
+        float s = g.RenderScale();
+        double gpu = l.gpuFixed + l.gpuPixels * s * s * (0.6 + 0.4 * g.LodScale()) * (0.3 + 0.7 * g.Density());
+        double cpu = l.cpuBase + l.cpuInstances * g.Density();
+        gpu *= 1.0 + n(rng);
+        cpu *= 1.0 + n(rng);
+        if (spikeEvery && f % spikeEvery == 7) { gpu *= 4.0; cpu *= 3.0; }
+        double frame = (std::max)(cpu, gpu);
+        over += frame > g.settings.budgetMs;
+        if (frame <= g.settings.budgetMs) { if (++inRow == 30) r.backInBudget = f; }
+        else inRow = 0;
+        scaleSum += s;
+        inFlight.push_back(gpu);
+        double seen = inFlight.front();
+        inFlight.erase(inFlight.begin());
+        r.changes += g.Update(cpu, seen);
+    }
+    r.stats = g.stats;
+    r.overBudget = (double)over / frames;
+    r.averageScale = scaleSum / frames;
+    r.scale = g.RenderScale();
+    r.lod = g.LodScale();
+    r.density = g.Density();
+    std::printf("%-36s | %5u | %6u | %9u | %8.1f%% | %9.3f | %.3f / %.2f / %.2f | %u\n", name, r.stats.drops, r.stats.raises,
+        r.stats.rollbacks, 100.0 * r.overBudget, r.averageScale, r.scale, r.lod, r.density, g.RaiseDelay());
+    return r;
+}
+
+static void Scenarios()
+{
+    std::printf("%-36s | drops | raises | rollbacks | over budget | avg scale | scale / lod / density | raise delay\n", "scenario");
+    Scenario r = Run("light load", 3000, [](uint32_t) { return Load{ 2, 8, 4, 2 }; }, 0.05, 0);
+    CHECK(r.changes == 0);
+    r = Run("light load + x4 spikes every 50", 3000, [](uint32_t) { return Load{ 2, 8, 4, 2 }; }, 0.05, 50);
+    CHECK(r.changes == 0);
+    r = Run("GPU step 10 -> 24 -> 10 ms", 4000, [](uint32_t f) { return f > 500 && f < 2000 ? Load{ 2, 22, 4, 2 } : Load{ 2, 8, 4, 2 }; }, 0.05, 0);
+    CHECK(r.scale == 1.0f && r.lod == 1.0f && r.density == 1.0f && r.stats.drops > 0 && r.stats.rollbacks <= 2);
+    r = Run("GPU overload (resolution)", 3000, [](uint32_t) { return Load{ 2, 45, 4, 2 }; }, 0.05, 0);
+    CHECK(r.scale == 0.5f);
+    r = Run("GPU overload x2 (LOD + density)", 3000, [](uint32_t) { return Load{ 2, 90, 4, 2 }; }, 0.05, 0);
+    CHECK(r.scale == 0.5f && r.lod < 1.0f && r.density < 1.0f);
+    r = Run("CPU-bound", 3000, [](uint32_t) { return Load{ 2, 8, 8, 12 }; }, 0.05, 0);
+    CHECK(r.scale == 1.0f && r.lod == 1.0f && r.density < 1.0f);
+    r = Run("GPU near step boundary", 20000, [](uint32_t) { return Load{ 2, 16.5, 4, 2 }; }, 0.08, 0);
+    CHECK(r.changes <= 12);
+    r = Run("GPU ramp up and down", 12000, [](uint32_t f) { double t = f < 6000 ? f / 6000.0 : (12000 - f) / 6000.0; return Load{ 2, 8 + 30 * t, 4, 2 }; }, 0.05, 0);
+    CHECK(r.scale == 1.0f && r.stats.drops >= 4);
+    r = Run("GPU at 80% budget, 20% noise", 20000, [](uint32_t) { return Load{ 2, 11, 4, 2 }; }, 0.2, 0);
+    CHECK(r.changes <= 12);
+    r = Run("GPU step boundary, 25% noise", 40000, [](uint32_t) { return Load{ 2, 13.2, 4, 2 }; }, 0.25, 0);
+    CHECK(r.changes <= 40 && r.stats.rollbacks > 0);
+    r = Run("20-frame GPU bursts every 150", 20000, [](uint32_t f) { return f % 150 < 20 ? Load{ 2, 20, 4, 2 } : Load{ 2, 9, 4, 2 }; }, 0.05, 0);
+    CHECK(r.stats.rollbacks >= 1 && r.changes <= 60);
+    r = Run("x2.5 GPU jump at frame 200", 1000, [](uint32_t f) { return f < 200 ? Load{ 2, 8, 4, 2 } : Load{ 2, 28, 4, 2 }; }, 0.05, 0);
+    std::printf("  back in budget (30 frames in a row) %u frames after the jump\n", r.backInBudget - 200 - 30);
+    CHECK(r.backInBudget > 230 && r.backInBudget < 300);
+}
+
+int main()
+{
+    TestSizes();
+    TestDropAndRaiseOrder();
+    TestSettleAndSpikes();
+    TestRaisePrediction();
+    TestRollbackBackoff();
+    Scenarios();
+    return TestResult("FrameGovernorTest");
+}
@@ -0,0 +1,169 @@
+// Lab8_FramePipelineTest
+// Кадры в полёте (FramePipeline.h) на симулированной шкале GPU: 1000 кадров для 1-4 слотов при
+// упоре в GPU, в CPU и со скачущей ценой кадра GPU. Слот никогда не пишется, пока GPU его читает,
+// кадры завершаются строго по порядку и все доходят до onComplete, в полёте не больше N кадров;
+// время кадра - сумма CPU и GPU при одном слоте и максимум из них при двух и больше.
+// Запуск: FramePipelineTest [кадров = 1000]
+#include <random>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../FramePipeline.h"
+
+// Часы CPU и очередь GPU: GPU берёт кадр, когда CPU его отправил (EndFrame) и GPU свободен
+struct SimTimeline
+{
+    double cpu = 0.0, gpuFree = 0.0;
+    double gpuCost = 0.0;             // цена следующего отправленного кадра
+    uint64_t waits = 0;
+};
+struct SimFence { double done = 1e300; };
+struct SimFenceApi
+{
+    typedef SimTimeline Context;
+    typedef SimFence Fence;
+    static void Signal(SimTimeline* t, SimFence* f)
+    {
+        double start = (std::max)(t->cpu, t->gpuFree);
+        t->gpuFree = start + t->gpuCost;
+        f->done = t->gpuFree;
+    }
+    static bool IsComplete(SimTimeline* t, SimFence* f) { return f->done <= t->cpu; }
+    static void Wait(SimTimeline* t, SimFence* f) { ++t->waits; t->cpu = (std::max)(t->cpu, f->done); }
+};
+
+struct RunResult
+{
+    double msPerFrame;
+    uint64_t stalls;
+    int hazards, orderErrors, overflows;
+    uint64_t retired;
+};
+
+// jitter > 0 - цена кадра GPU равномерно в [gpuCost * (1 - jitter), gpuCost * (1 + jitter)]
+static RunResult Run(uint32_t slotCount, double cpuCost, double gpuCost, double jitter, int frames)
+{
+    SimTimeline timeline;
+    std::vector<SimFence> fences(slotCount);
+    FramePipeline<SimFenceApi> pipeline;
+    pipeline.context = &timeline;
+    pipeline.slots.resize(slotCount);
+    for (uint32_t i = 0; i < slotCount; ++i) pipeline.slots[i].fence = &fences[i];
+
+    std::mt19937 rng(slotCount * 131 + (uint32_t)cpuCost);
+    std::uniform_real_distribution<double> spread(1.0 - jitter, 1.0 + jitter);
+    std::vector<double> gpuReadsUntil(slotCount, 0.0);   // GPU читает данные слота до этого момента
+    RunResult r = { 0.0, 0, 0, 0, 0, 0 };
+    uint64_t lastRetired = 0;
+    auto onComplete = [&](uint32_t slot, uint64_t frame)
+    {
+        if (frame != lastRetired + 1) ++r.orderErrors;
+        if (slot != (uint32_t)((frame - 1) % slotCount)) ++r.orderErrors;
+        if (fences[slot].done > timeline.cpu) ++r.orderErrors;             // объявлен завершённым раньше GPU
+        lastRetired = frame;
+    };
+
+    for (int f = 0; f < frames; ++f)
+    {
+        uint32_t slot = pipeline.BeginFrame(onComplete);
+        if (gpuReadsUntil[slot] > timeline.cpu) ++r.hazards;              // запись в слот под GPU
+        if (pipeline.InFlight() > slotCount) ++r.overflows;
+        timeline.cpu += cpuCost;
+        timeline.gpuCost = gpuCost * spread(rng);
+        pipeline.EndFrame();
+        gpuReadsUntil[slot] = fences[slot].done;
+        if (f % 3 == 0) pipeline.Poll(onComplete);                        // опрос посреди кадра не ждёт
+    }
+    double cpuBeforeDrain = timeline.cpu;
+    pipeline.Drain(onComplete);
+    CHECK(timeline.cpu >= cpuBeforeDrain);
+    r.msPerFrame = cpuBeforeDrain / frames;
+    r.stalls = pipeline.stalls;
+    r.retired = lastRetired;
+    CHECK(pipeline.completedFrame == (uint64_t)frames);
+    CHECK(pipeline.InFlight() == 0);
+    return r;
+}
+
+static void TestTimeline(int frames)
+{
+    const double gpuCost = 8.0;
+    const double cpuCosts[] = { 4.0, 10.0 };
+    for (uint32_t slots = 1; slots <= 4; ++slots)
+        for (double cpuCost : cpuCosts)
+        {
+            RunResult r = Run(slots, cpuCost, gpuCost, 0.0, frames);
+            std::printf("N=%u cpu=%4.1f gpu=%.1f: %.2f ms/frame, stalls %llu\n",
+                slots, cpuCost, gpuCost, r.msPerFrame, (unsigned long long)r.stalls);
+            CHECK(r.hazards == 0);
+            CHECK(r.orderErrors == 0);
+            CHECK(r.overflows == 0);
+            CHECK(r.retired == (uint64_t)frames);
+            // Установившийся темп: один слот - последовательно, больше - перекрытие CPU и GPU
+            double expected = slots == 1 ? cpuCost + gpuCost : (std::max)(cpuCost, gpuCost);
+            CHECK_NEAR(r.msPerFrame, expected, expected * 0.02);
+            if (slots >= 2 && cpuCost > gpuCost) CHECK(r.stalls == 0);     // упор в CPU: GPU не ждут
+            if (cpuCost < gpuCost) CHECK(r.stalls > 0);                    // упор в GPU: ждут всегда
+        }
+}
+
+static void TestJitter(int frames)
+{
+    // Цена GPU скачет вокруг цены CPU: лишний слот сглаживает всплески
+    double previous = 1e30;
+    for (uint32_t slots = 1; slots <= 4; ++slots)
+    {
+        RunResult r = Run(slots, 7.0, 7.0, 0.8, frames);
+        std::printf("N=%u cpu=7.0 gpu=7.0+-80%%: %.2f ms/frame, stalls %llu\n", slots, r.msPerFrame, (unsigned long long)r.stalls);
+        CHECK(r.hazards == 0);
+        CHECK(r.orderErrors == 0);
+        CHECK(r.overflows == 0);
+        CHECK(r.retired == (uint64_t)frames);
+        CHECK(r.msPerFrame <= previous + 1e-9);
+        CHECK(r.msPerFrame >= 7.0 - 1e-9);
+        previous = r.msPerFrame;
+    }
+}
+
+static void TestPollAndDrain()
+{
+    SimTimeline timeline;
+    SimFence fences[3];
+    FramePipeline<SimFenceApi> pipeline;
+    pipeline.context = &timeline;
+    pipeline.slots.resize(3);
+    for (int i = 0; i < 3; ++i) pipeline.slots[i].fence = &fences[i];
+    std::vector<uint64_t> retired;
+    auto onComplete = [&](uint32_t, uint64_t frame) { retired.push_back(frame); };
+
+    pipeline.Poll(onComplete);                    // ещё ничего не отправлено
+    CHECK(retired.empty());
+    timeline.gpuCost = 5.0;
+    for (int f = 0; f < 3; ++f)
+    {
+        CHECK(pipeline.BeginFrame(onComplete) == (uint32_t)f);
+        timeline.cpu += 1.0;
+        pipeline.EndFrame();
+    }
+    CHECK(pipeline.stalls == 0);
+    CHECK(pipeline.InFlight() == 3);
+    // GPU: кадры заканчиваются в 6, 11, 16; CPU в 3
+    pipeline.Poll(onComplete);
+    CHECK(retired.empty());
+    timeline.cpu = 12.0;
+    pipeline.Poll(onComplete);
+    CHECK(retired.size() == 2 && retired[0] == 1 && retired[1] == 2);
+    CHECK(timeline.waits == 0);                   // Poll не ждёт
+    pipeline.Drain(onComplete);
+    CHECK(retired.size() == 3 && retired[2] == 3);
+    CHECK(timeline.cpu == 16.0);
+    CHECK(pipeline.InFlight() == 0);
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    TestTimeline(frames);
+    TestJitter(frames);
+    TestPollAndDrain();
+    return TestResult("FramePipelineTest");
+}
@@ -0,0 +1,134 @@
+// Lab8_InstanceLightsTest
+// Списки источников на экземпляр (InstanceLights.h): против перебора всех пар на малой сцене
+// (те же K самых сильных, точное число задевающих), SSE == скаляр, одинаково при любом числе потоков;
+// затем замер на большой сцене - сетка и назначение, 1 и все потоки.
+// Запуск: InstanceLightsTest [экземпляров = 100000] [источников = 10000]
+#include <vector>
+#include <random>
+#include <thread>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../InstanceLights.h"
+
+struct Scene
+{
+    std::vector<PointLight> lights;
+    AABBSoA boxes;
+    std::vector<uint32_t> visible;
+};
+
+// Экземпляры и источники равномерно в кубе side^3, каждый второй экземпляр видим
+static Scene MakeScene(uint32_t instances, uint32_t lightCount, float side, uint32_t seed)
+{
+    Scene s;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    s.lights.resize(lightCount);
+    for (PointLight& l : s.lights)
+    {
+        l.pos = MakeFloat3(u(rng) * side, u(rng) * side * 0.1f, u(rng) * side);
+        l.radius = 1.0f + 3.0f * u(rng);
+        l.color = MakeFloat3(1, 1, 1);
+        l.padding = 0;
+    }
+    s.boxes.Resize(instances);
+    for (uint32_t i = 0; i < instances; ++i)
+    {
+        Float3 c = MakeFloat3(u(rng) * side, u(rng) * side * 0.1f, u(rng) * side);
+        float h = 0.25f + 0.5f * u(rng);
+        s.boxes.Set(i, Sub(c, MakeFloat3(h, h, h)), Add(c, MakeFloat3(h, h, h)), i % 2);
+        if (i % 2 == 0) s.visible.push_back(i);
+    }
+    return s;
+}
+
+static std::vector<uint32_t> SortedList(const InstanceLightLists& lists, uint32_t inst)
+{
+    std::vector<uint32_t> ids(lists.Lights(inst), lists.Lights(inst) + lists.Count(inst));
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static void TestAgainstBruteForce()
+{
+    Scene s = MakeScene(2000, 600, 60.0f, 1);
+    LightGrid grid;
+    grid.Build(s.lights.data(), (uint32_t)s.lights.size());
+
+    InstanceLightLists scalar, simd;
+    scalar.Assign(grid, s.boxes, s.visible.data(), (uint32_t)s.visible.size(), 1, false);
+    simd.Assign(grid, s.boxes, s.visible.data(), (uint32_t)s.visible.size(), 1, true);
+    CHECK(scalar.lists == simd.lists);
+    CHECK(scalar.assigned == simd.assigned && scalar.overflowed == simd.overflowed);
+
+    uint64_t assigned = 0, overflowed = 0;
+    for (uint32_t inst : s.visible)
+    {
+        // Все задевающие, по возрастанию d^2 / r^2 (сильнейшие первыми)
+        std::vector<std::pair<float, uint32_t>> touching;
+        for (uint32_t l = 0; l < s.lights.size(); ++l)
+        {
+            const PointLight& p = s.lights[l];
+            float dx = (std::max)((std::max)(s.boxes.minX[inst] - p.pos.x, p.pos.x - s.boxes.maxX[inst]), 0.0f);
+            float dy = (std::max)((std::max)(s.boxes.minY[inst] - p.pos.y, p.pos.y - s.boxes.maxY[inst]), 0.0f);
+            float dz = (std::max)((std::max)(s.boxes.minZ[inst] - p.pos.z, p.pos.z - s.boxes.maxZ[inst]), 0.0f);
+            float d2 = dx * dx + dy * dy + dz * dz;
+            if (d2 <= p.radius * p.radius) touching.push_back(std::make_pair(d2 / (p.radius * p.radius), l));
+        }
+        std::sort(touching.begin(), touching.end());
+        uint32_t kept = (std::min)((uint32_t)touching.size(), INSTANCE_LIGHT_K);
+        std::vector<uint32_t> expected;
+        for (uint32_t k = 0; k < kept; ++k) expected.push_back(touching[k].second);
+        std::sort(expected.begin(), expected.end());
+        CHECK(SortedList(scalar, inst) == expected);
+        assigned += kept;
+        overflowed += touching.size() > INSTANCE_LIGHT_K;
+    }
+    CHECK(scalar.assigned == assigned && scalar.overflowed == overflowed);
+    CHECK(overflowed > 0 && overflowed < s.visible.size());   // сцена проверяет и отбор K сильнейших
+
+    // Невидимые не трогаются
+    for (uint32_t i = 1; i < s.boxes.Size(); i += 2) CHECK(scalar.Count(i) == 0);
+
+    for (uint32_t threads = 2; threads <= 8; threads *= 2)
+    {
+        InstanceLightLists parallel;
+        parallel.Assign(grid, s.boxes, s.visible.data(), (uint32_t)s.visible.size(), threads, true);
+        CHECK(parallel.lists == simd.lists && parallel.assigned == simd.assigned);
+    }
+}
+
+static void Benchmark(uint32_t instances, uint32_t lightCount)
+{
+    // Плотность источников как в малой сцене: сторона растёт с корнем из их числа
+    float side = 60.0f * sqrtf(lightCount / 600.0f);
+    Scene s = MakeScene(instances, lightCount, side, 2);
+    uint32_t hw = (std::max)(1u, std::thread::hardware_concurrency());
+
+    LightGrid grid;
+    double t0 = NowMs();
+    grid.Build(s.lights.data(), lightCount);
+    double gridMs = NowMs() - t0;
+
+    InstanceLightLists lists;
+    lists.Assign(grid, s.boxes, s.visible.data(), (uint32_t)s.visible.size(), 1);   // прогрев: выделение lists
+    double best[2] = { 1e30, 1e30 };
+    for (int r = 0; r < 5; ++r)
+        for (int m = 0; m < 2; ++m)
+        {
+            double t = NowMs();
+            lists.Assign(grid, s.boxes, s.visible.data(), (uint32_t)s.visible.size(), m ? hw : 1);
+            best[m] = (std::min)(best[m], NowMs() - t);
+        }
+    std::printf("%u instances (%zu visible) x %u lights: grid %ux%ux%u built in %.2f ms, %zu cell entries\n",
+        instances, s.visible.size(), lightCount, grid.dimX, grid.dimY, grid.dimZ, gridMs, grid.id.size());
+    std::printf("assign: %.2f ms on 1 thread, %.2f ms on %u thread(s); %llu lights assigned, %llu instances over K\n",
+        best[0], best[1], hw, (unsigned long long)lists.assigned, (unsigned long long)lists.overflowed);
+}
+
+int main(int argc, char** argv)
+{
+    TestAgainstBruteForce();
+    Benchmark(argc > 1 ? (uint32_t)atoi(argv[1]) : 100000u, argc > 2 ? (uint32_t)atoi(argv[2]) : 10000u);
+    return TestResult("InstanceLightsTest");
+}
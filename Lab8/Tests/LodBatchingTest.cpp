@@ -0,0 +1,178 @@
+// Lab8_LodBatchingTest
+// LodBatches (LodBatching.h) против модели GPU-конвейера cullCS в Source.cpp: проход cs (ранг в корзине
+// префиксной суммой по группе из 64 потоков, итоги групп), batchArgs (группа на корзину: StartInstanceLocation
+// и смещения групп сканом блоками по 64 потока) и scatter (ID по диапазонам корзин). Модель повторяет шейдеры поток за потоком на одной
+// синтетической сцене; indirect args и порядок ID внутри корзин должны совпасть байт в байт.
+#include <vector>
+#include <random>
+#include <cstring>
+#include "TestCommon.h"
+#include "../LodBatching.h"
+
+static const uint32_t MESH_COUNT = 2;
+static const uint32_t BUCKETS = MESH_COUNT * MAX_LODS;
+static const uint32_t NO_BUCKET = 0xFFFFFFFF;
+
+// Буферы cullCS: indirectArgs (8 x 5 uint), instanceBuckets, groupBucketOffsets
+struct GpuCullModel
+{
+    uint32_t indirectArgs[BUCKETS * 5];
+    std::vector<uint32_t> instanceBuckets, groupBucketOffsets, visibleIds;
+
+    void Run(const MeshLodChain* meshes, const uint8_t* visible, const uint32_t* meshIds, const float* screenSizes, uint32_t numInstances)
+    {
+        uint32_t groupCount = (numInstances + 63) / 64;
+        memset(indirectArgs, 0, sizeof(indirectArgs));
+        instanceBuckets.assign(numInstances, NO_BUCKET);
+        groupBucketOffsets.assign(groupCount * 8, 0u);
+
+        // cs: инклюзивная сумма по группе минус свой вклад = ранг в корзине
+        for (uint32_t g = 0; g < groupCount; ++g)
+        {
+            uint32_t running[BUCKETS] = {};
+            for (uint32_t gi = 0; gi < 64; ++gi)
+            {
+                uint32_t id = g * 64 + gi;
+                if (id >= numInstances || !visible[id]) continue;
+                uint32_t mesh = meshIds[id];
+                uint32_t bucket = LodBucket(mesh, SelectLod(meshes[mesh], screenSizes[id]));
+                instanceBuckets[id] = bucket | (running[bucket]++ << 8);
+            }
+            for (uint32_t b = 0; b < BUCKETS; ++b)
+            {
+                groupBucketOffsets[g * 8 + b] = running[b];
+                indirectArgs[b * 5 + 1] += running[b];
+            }
+        }
+
+        // batchArgs: группа на корзину
+        for (uint32_t b = 0; b < BUCKETS; ++b)
+        {
+            uint32_t offset = 0;
+            for (uint32_t prev = 0; prev < b; ++prev) offset += indirectArgs[prev * 5 + 1];
+            const MeshLod& lod = meshes[b / MAX_LODS].lods[b % MAX_LODS];
+            indirectArgs[b * 5 + 0] = lod.indexCount;
+            indirectArgs[b * 5 + 2] = lod.startIndex;
+            indirectArgs[b * 5 + 3] = (uint32_t)lod.baseVertex;
+            indirectArgs[b * 5 + 4] = offset;
+
+            uint32_t carry = 0;
+            for (uint32_t first = 0; first < groupCount; first += 64)
+            {
+                uint32_t n[64], scan[64];
+                for (uint32_t gi = 0; gi < 64; ++gi)
+                    scan[gi] = n[gi] = first + gi < groupCount ? groupBucketOffsets[(first + gi) * 8 + b] : 0;
+                for (uint32_t s = 1; s < 64; s <<= 1)   // шаги Хиллиса-Стила, как в шейдере
+                {
+                    uint32_t prev[64];
+                    std::copy(scan, scan + 64, prev);
+                    for (uint32_t gi = s; gi < 64; ++gi) scan[gi] = prev[gi] + prev[gi - s];
+                }
+                for (uint32_t gi = 0; gi < 64 && first + gi < groupCount; ++gi)
+                    groupBucketOffsets[(first + gi) * 8 + b] = carry + scan[gi] - n[gi];
+                carry += scan[63];
+            }
+        }
+        uint32_t offset = indirectArgs[(BUCKETS - 1) * 5 + 4] + indirectArgs[(BUCKETS - 1) * 5 + 1];
+
+        // scatter
+        visibleIds.assign(offset, NO_BUCKET);
+        for (uint32_t id = 0; id < numInstances; ++id)
+        {
+            uint32_t packed = instanceBuckets[id];
+            if (packed == NO_BUCKET) continue;
+            uint32_t bucket = packed & 0xFF;
+            uint32_t slot = groupBucketOffsets[(id / 64) * 8 + bucket] + (packed >> 8);
+            visibleIds[indirectArgs[bucket * 5 + 4] + slot] = id;
+        }
+    }
+};
+
+static void SetupMeshes(MeshLodChain meshes[MESH_COUNT])
+{
+    meshes[0] = MeshLodChain();
+    meshes[0].lodCount = 1;
+    meshes[0].lods[0] = { 36, 0, 0 };
+    meshes[1] = MeshLodChain();
+    meshes[1].lodCount = 3;
+    meshes[1].lods[0] = { 2880, 36, 24 };
+    meshes[1].lods[1] = { 720, 2916, 505 };
+    meshes[1].lods[2] = { 180, 3636, 626 };
+    meshes[1].minScreenSize[0] = 200.0f;
+    meshes[1].minScreenSize[1] = 60.0f;
+}
+
+static void TestSelectLod()
+{
+    MeshLodChain meshes[MESH_COUNT];
+    SetupMeshes(meshes);
+    CHECK(SelectLod(meshes[0], 0.0f) == 0);
+    CHECK(SelectLod(meshes[1], FLT_MAX) == 0);
+    CHECK(SelectLod(meshes[1], 200.0f) == 0);
+    CHECK(SelectLod(meshes[1], 199.0f) == 1);
+    CHECK(SelectLod(meshes[1], 60.0f) == 1);
+    CHECK(SelectLod(meshes[1], 59.0f) == 2);
+    CHECK(SelectLod(meshes[1], 0.0f) == 2);
+
+    // Размер обратно пропорционален глубине; через ближнюю плоскость - "бесконечный" размер
+    Float4x4 proj = PerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+    float near = ProjectedScreenSize(proj, MakeFloat3(-1, -1, 9.5f), MakeFloat3(1, 1, 10.5f), 1280, 720);
+    float far = ProjectedScreenSize(proj, MakeFloat3(-1, -1, 19.5f), MakeFloat3(1, 1, 20.5f), 1280, 720);
+    CHECK_NEAR(near / far, 19.5 / 9.5, 1e-3);   // размер задаёт ближняя грань
+    CHECK(ProjectedScreenSize(proj, MakeFloat3(-1, -1, -1), MakeFloat3(1, 1, 1), 1280, 720) == FLT_MAX);
+}
+
+static void TestAgainstGpuModel(uint32_t numInstances, float visibleFraction, uint32_t seed)
+{
+    MeshLodChain meshes[MESH_COUNT];
+    SetupMeshes(meshes);
+    Float4x4 viewProj = Mul(LookAtLH(MakeFloat3(0, 5, -10), MakeFloat3(0, 0, 30), MakeFloat3(0, 1, 0)),
+                            PerspectiveFovLH(3.14159265f / 4.0f, 16.0f / 9.0f, 0.1f, 500.0f));
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    std::vector<uint32_t> meshIds(numInstances);
+    std::vector<float> screenSizes(numInstances);
+    std::vector<uint8_t> visible(numInstances);
+    std::vector<uint32_t> visibleList;
+    for (uint32_t i = 0; i < numInstances; ++i)
+    {
+        meshIds[i] = (i / 2) % MESH_COUNT;  // пары кубов и сфер, как CreateInstances
+        Float3 c = MakeFloat3(u(rng) * 80.0f - 40.0f, u(rng) * 4.0f, u(rng) * 200.0f - 9.0f);
+        float r = 0.3f + u(rng);
+        screenSizes[i] = ProjectedScreenSize(viewProj, Sub(c, MakeFloat3(r, r, r)), Add(c, MakeFloat3(r, r, r)), 1280, 720);
+        visible[i] = u(rng) < visibleFraction;
+        if (visible[i]) visibleList.push_back(i);
+    }
+
+    LodBatches cpu;
+    cpu.Build(meshes, MESH_COUNT, visibleList.data(), (uint32_t)visibleList.size(), meshIds.data(), screenSizes.data());
+    GpuCullModel gpu;
+    gpu.Run(meshes, visible.data(), meshIds.data(), screenSizes.data(), numInstances);
+
+    CHECK(cpu.args.size() == BUCKETS);
+    CHECK(memcmp(cpu.args.data(), gpu.indirectArgs, sizeof(gpu.indirectArgs)) == 0);
+    CHECK(cpu.visibleIds == gpu.visibleIds);
+
+    // Корзины 1..3 куба пусты (у него один LOD), у сферы при таком разбросе заняты все три
+    uint32_t total = 0;
+    for (uint32_t b = 0; b < BUCKETS; ++b) total += cpu.args[b].InstanceCount;
+    CHECK(total == visibleList.size());
+    for (uint32_t l = 1; l < MAX_LODS; ++l) CHECK(cpu.args[LodBucket(0, l)].InstanceCount == 0);
+    if (numInstances >= 1000)
+        for (uint32_t l = 0; l < 3; ++l) CHECK(cpu.args[LodBucket(1, l)].InstanceCount > 0);
+    CHECK(cpu.NonEmptyDrawCount() <= 4);
+}
+
+int main()
+{
+    TestSelectLod();
+    TestAgainstGpuModel(0, 0.5f, 1);
+    TestAgainstGpuModel(1, 1.0f, 2);
+    TestAgainstGpuModel(63, 0.5f, 3);
+    TestAgainstGpuModel(64, 1.0f, 4);
+    TestAgainstGpuModel(10000, 0.4f, 5);
+    TestAgainstGpuModel(10000, 1.0f, 6);
+    TestAgainstGpuModel(64 * 64 * 3 + 5, 0.9f, 7);   // несколько блоков скана batchArgs
+    return TestResult("LodBatchingTest");
+}
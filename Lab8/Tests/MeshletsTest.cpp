@@ -0,0 +1,211 @@
+// Lab8_MeshletsTest
+// Кластеры LOD0 сферы (как AppendSphereLod в Source.cpp): ограничения кластеров, сохранение
+// треугольников при переупорядочивании IB, консервативность отсечения по фрустуму и по конусу
+// нормалей против проверки каждого треугольника, диапазоны косвенной отрисовки против выживших
+// кластеров. В конце - доля отсечённых треугольников и время прохода на экземпляр.
+// Запуск: MeshletsTest [число камер = 200]
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../Meshlets.h"
+
+// Сфера радиуса 0.5, обход по часовой снаружи - та же сетка, что у AppendSphereLod
+static void BuildSphere(uint32_t slices, uint32_t stacks, std::vector<Float3>& positions, std::vector<uint32_t>& indices)
+{
+    for (uint32_t i = 0; i <= stacks; ++i)
+    {
+        float theta = 3.14159265f * i / stacks;
+        for (uint32_t j = 0; j <= slices; ++j)
+        {
+            float phi = 2.0f * 3.14159265f * j / slices;
+            positions.push_back(MakeFloat3(0.5f * sinf(theta) * cosf(phi), 0.5f * cosf(theta), 0.5f * sinf(theta) * sinf(phi)));
+        }
+    }
+    for (uint32_t i = 0; i < stacks; ++i)
+        for (uint32_t j = 0; j < slices; ++j)
+        {
+            uint32_t a = i * (slices + 1) + j, b = a + 1, c = a + slices + 1, d = c + 1;
+            uint32_t quad[] = { a, b, d, a, d, c };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+}
+
+// Треугольник с поворотом индексов к наименьшему: обход сохраняется
+static std::vector<uint64_t> TriangleKeys(const std::vector<uint32_t>& indices)
+{
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        uint32_t t[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        int r = t[0] <= t[1] && t[0] <= t[2] ? 0 : (t[1] <= t[2] ? 1 : 2);
+        keys.push_back((uint64_t)t[r] << 42 | (uint64_t)t[(r + 1) % 3] << 21 | t[(r + 2) % 3]);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+static Float4x4 RandomWorld(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    Float3 axis = Normalize(MakeFloat3(u(rng) - 0.5f, u(rng) - 0.5f, u(rng) - 0.5f));
+    float angle = u(rng) * 6.2831853f, s = 0.5f + 2.0f * u(rng), c = cosf(angle), sn = sinf(angle), t = 1.0f - c;
+    float r[3][3] = {
+        { t * axis.x * axis.x + c, t * axis.x * axis.y + sn * axis.z, t * axis.x * axis.z - sn * axis.y },
+        { t * axis.x * axis.y - sn * axis.z, t * axis.y * axis.y + c, t * axis.y * axis.z + sn * axis.x },
+        { t * axis.x * axis.z + sn * axis.y, t * axis.y * axis.z - sn * axis.x, t * axis.z * axis.z + c } };
+    Float4x4 w = {};
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) w.m[i][j] = r[i][j] * s;
+    w.m[3][0] = u(rng) * 20.0f - 10.0f;
+    w.m[3][1] = u(rng) * 4.0f - 2.0f;
+    w.m[3][2] = u(rng) * 30.0f;
+    w.m[3][3] = 1.0f;
+    return w;
+}
+
+static Float3 WorldPoint(const Float4x4& w, const Float3& p)
+{
+    Float4 r = TransformPoint(w, p);
+    return MakeFloat3(r.x, r.y, r.z);
+}
+
+int main(int argc, char** argv)
+{
+    int cameras = argc > 1 ? atoi(argv[1]) : 200;
+
+    std::vector<Float3> positions;
+    std::vector<uint32_t> indices;
+    BuildSphere(32, 16, positions, indices);
+    MeshletMesh mesh;
+    BuildMeshlets(mesh, indices.data(), (uint32_t)indices.size(), positions.data(), (uint32_t)positions.size());
+
+    // Ограничения и покрытие: каждый треугольник ровно в одном кластере, с тем же обходом
+    uint32_t expectOffset = 0;
+    for (const Meshlet& m : mesh.meshlets)
+    {
+        CHECK(m.vertexCount <= MESHLET_MAX_VERTICES && m.triangleCount <= MESHLET_MAX_TRIANGLES && m.triangleCount > 0);
+        CHECK(m.triangleOffset == expectOffset);
+        expectOffset += m.triangleCount;
+    }
+    CHECK(mesh.TriangleCount() * 3 == indices.size());
+    std::vector<uint32_t> reordered = BuildMeshletIndexBuffer(mesh);
+    CHECK(TriangleKeys(reordered) == TriangleKeys(indices));
+
+    std::mt19937 rng(29);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    const Float4 everything[6] = { { 0, 0, 0, 1e30f }, { 0, 0, 0, 1e30f }, { 0, 0, 0, 1e30f },
+                                   { 0, 0, 0, 1e30f }, { 0, 0, 0, 1e30f }, { 0, 0, 0, 1e30f } };
+    const uint32_t startIndex = 1000, startInstance = 3;
+    const int32_t baseVertex = 200;
+    uint32_t backfaceCulled = 0, frustumCulled = 0, falseCulls = 0, rangeErrors = 0;
+    MeshletCullStats total;
+    double cullMs = 0.0;
+    uint32_t instancesTimed = 0;
+
+    for (int cam = 0; cam < cameras; ++cam)
+    {
+        Float4x4 world = RandomWorld(rng);
+        Float3 center = WorldPoint(world, MakeFloat3(0, 0, 0));
+        Float3 dir = Normalize(MakeFloat3(u(rng) - 0.5f, u(rng) - 0.5f, u(rng) - 0.5f));
+        float scale = Length(MakeFloat3(world.m[0][0], world.m[0][1], world.m[0][2]));
+        Float3 eye = Add(center, Scale(dir, scale * (0.6f + 10.0f * u(rng))));
+        Float3 target = Add(center, MakeFloat3(u(rng) * 4.0f - 2.0f, u(rng) * 4.0f - 2.0f, u(rng) * 4.0f - 2.0f));
+        Float4x4 vp = Mul(LookAtLH(eye, target, MakeFloat3(0, 1, 0)), PerspectiveFovLH(0.6f, 16.0f / 9.0f, 0.1f, 1000.0f));
+        Float4 planes[6];
+        BuildFrustumPlanesCPU(vp, planes);
+
+        // Каждый кластер отдельно: отсечённый по конусу - все треугольники повёрнуты от камеры,
+        // отсечённый по фрустуму - все вершины за одной плоскостью
+        std::vector<uint8_t> survived(mesh.meshlets.size());
+        for (size_t k = 0; k < mesh.meshlets.size(); ++k)
+        {
+            const Meshlet& m = mesh.meshlets[k];
+            MeshletMesh single = mesh;
+            single.meshlets.assign(1, m);
+            std::vector<IndirectDrawArgs> draws;
+            MeshletCullStats backfaceOnly, full;
+            CullMeshlets(single, world, everything, eye, 0, 0, 0, draws, backfaceOnly);
+            draws.clear();
+            CullMeshlets(single, world, planes, eye, 0, 0, 0, draws, full);
+            survived[k] = !draws.empty();
+
+            if (backfaceOnly.backfaceCulled)
+            {
+                ++backfaceCulled;
+                for (uint32_t t = 0; t < m.triangleCount; ++t)
+                {
+                    const uint32_t* tri = &reordered[(m.triangleOffset + t) * 3];
+                    Float3 a = WorldPoint(world, positions[tri[0]]), b = WorldPoint(world, positions[tri[1]]), c = WorldPoint(world, positions[tri[2]]);
+                    Float3 n = Cross(Sub(b, a), Sub(c, a));
+                    if (Dot(n, Sub(a, eye)) < 0.0f) ++falseCulls;   // лицевой треугольник в отсечённом кластере
+                }
+            }
+            if (full.frustumCulled)
+            {
+                ++frustumCulled;
+                bool separated = false;
+                for (int p = 0; p < 6 && !separated; ++p)
+                {
+                    separated = true;
+                    for (uint32_t v = 0; v < m.vertexCount && separated; ++v)
+                    {
+                        Float3 w = WorldPoint(world, positions[mesh.vertices[m.vertexOffset + v]]);
+                        separated = planes[p].x * w.x + planes[p].y * w.y + planes[p].z * w.z + planes[p].w < 0.0f;
+                    }
+                }
+                if (!separated) ++falseCulls;
+            }
+        }
+
+        // Весь мэш двумя экземплярами: диапазоны не сливаются между экземплярами
+        // и покрывают ровно индексы выживших кластеров
+        std::vector<IndirectDrawArgs> draws;
+        MeshletCullStats stats;
+        double t0 = NowMs();
+        CullMeshlets(mesh, world, planes, eye, startIndex, baseVertex, startInstance, draws, stats);
+        cullMs += NowMs() - t0;
+        ++instancesTimed;
+        size_t firstInstanceDraws = draws.size();
+        CullMeshlets(mesh, world, planes, eye, startIndex, baseVertex, startInstance + 1, draws, stats);
+        CHECK(draws.size() == firstInstanceDraws * 2);
+        for (size_t d = 0; d < draws.size(); ++d)
+        {
+            const IndirectDrawArgs& a = draws[d];
+            CHECK(a.InstanceCount == 1 && a.BaseVertexLocation == baseVertex);
+            CHECK(a.StartInstanceLocation == startInstance + (d < firstInstanceDraws ? 0u : 1u));
+        }
+        std::vector<uint8_t> covered(mesh.TriangleCount() * 3, 0);
+        for (size_t d = 0; d < firstInstanceDraws; ++d)
+        {
+            if (d > 0) CHECK(draws[d].StartIndexLocation > draws[d - 1].StartIndexLocation + draws[d - 1].IndexCountPerInstance);
+            for (uint32_t i = 0; i < draws[d].IndexCountPerInstance; ++i) ++covered[draws[d].StartIndexLocation - startIndex + i];
+        }
+        for (size_t k = 0; k < mesh.meshlets.size(); ++k)
+        {
+            const Meshlet& m = mesh.meshlets[k];
+            for (uint32_t i = m.triangleOffset * 3; i < (m.triangleOffset + m.triangleCount) * 3; ++i)
+                if (covered[i] != survived[k]) ++rangeErrors;
+        }
+        total.meshlets += stats.meshlets;
+        total.frustumCulled += stats.frustumCulled;
+        total.backfaceCulled += stats.backfaceCulled;
+        total.triangles += stats.triangles;
+        total.culledTriangles += stats.culledTriangles;
+    }
+
+    CHECK(falseCulls == 0);
+    CHECK(rangeErrors == 0);
+    if (cameras >= 50) CHECK(backfaceCulled > 0 && frustumCulled > 0 && total.culledTriangles > 0);
+
+    printf("Sphere 32x16: %u triangles, %u meshlets (avg %.1f triangles, %.1f vertices)\n",
+        mesh.TriangleCount(), (uint32_t)mesh.meshlets.size(),
+        (double)mesh.TriangleCount() / mesh.meshlets.size(), (double)mesh.vertices.size() / mesh.meshlets.size());
+    printf("%d cameras: backface-culled %u, frustum-culled %u meshlet tests, false culls %u, range errors %u\n",
+        cameras, backfaceCulled, frustumCulled, falseCulls, rangeErrors);
+    printf("Culled triangles %.1f%% (frustum %u, cone %u of %u meshlets), cull %.2f us per instance\n",
+        total.triangles ? 100.0 * total.culledTriangles / total.triangles : 0.0,
+        total.frustumCulled, total.backfaceCulled, total.meshlets,
+        instancesTimed ? 1000.0 * cullMs / instancesTimed : 0.0);
+    return TestResult("MeshletsTest");
+}
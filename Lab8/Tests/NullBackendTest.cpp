@@ -0,0 +1,440 @@
+// Lab8_NullBackendTest
+// Пустой бэкенд (RenderBackend.h) в цикле кадров как в Source.cpp с клавишей N: обновление констант,
+// пять проходов (skybox, instanced, deferred lighting, bloom, post) пишутся параллельно через фильтр
+// привязок в свои бэкенды, списки отправляются, заборы кадров через FramePipeline. Чистый кадр -
+// без ошибок и с ожидаемым числом отрисовок; затем каждая проверка бэкенда ловит свою ошибку.
+// В конце - цена отправки кадра на CPU и число вызовов.
+// Запуск: NullBackendTest [кадров = 2000] [потоков записи = 3]
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../RenderBackend.h"
+#include "../StateFilter.h"
+#include "../CommandRecording.h"
+#include "../FramePipeline.h"
+
+// Объекты устройства: пустышки, у буфера - размер для Map
+struct Obj { uint32_t bytes = 256; };
+struct Viewport { float x, y, width, height, minDepth, maxDepth; };
+struct Mapped { void* pData; uint32_t RowPitch, DepthPitch; };
+enum Topology { TOPOLOGY_UNDEFINED, TOPOLOGY_TRIANGLELIST = 4 };
+
+struct NullTypes
+{
+    typedef Obj Resource;
+    typedef Obj Buffer;
+    typedef Obj VertexShader;
+    typedef Obj PixelShader;
+    typedef Obj ComputeShader;
+    typedef Obj InputLayout;
+    typedef Obj ShaderResourceView;
+    typedef Obj UnorderedAccessView;
+    typedef Obj RenderTargetView;
+    typedef Obj DepthStencilView;
+    typedef Obj SamplerState;
+    typedef Obj BlendState;
+    typedef Obj DepthStencilState;
+    typedef Obj RasterizerState;
+    typedef Obj Query;
+    typedef Obj CommandList;
+    typedef ::Topology Topology;
+    typedef int Format;
+    typedef ::Viewport Viewport;
+    typedef int Box;
+    typedef int MapType;
+    typedef ::Mapped Mapped;
+    static uint32_t MappedBytes(Obj* resource) { return resource->bytes; }
+};
+typedef RenderBackend<NullTypes> Backend;
+
+// Те же адаптеры, что FrameContextApi / FrameCommandApi / FrameFenceApi в Source.cpp
+struct ContextApi : NullTypes
+{
+    typedef Backend Context;
+    static void VSSetShader(Backend* context, Obj* shader) { context->VSSetShader(shader); }
+    static void PSSetShader(Backend* context, Obj* shader) { context->PSSetShader(shader); }
+};
+static_assert(!FilterHasWindows<ContextApi>::value, "RenderBackend has no constant-buffer windows");
+struct CommandApi
+{
+    typedef Backend Context;
+    typedef Obj CommandList;
+    static Obj* Finish(Backend* context) { return context->FinishCommandList(); }
+    static void Execute(Backend* immediate, Obj* list) { immediate->ExecuteCommandList(list); }
+    static void Release(Obj*) {}
+};
+struct FenceApi
+{
+    typedef Backend Context;
+    typedef Obj Fence;
+    static void Signal(Backend* context, Obj* fence) { context->End(fence); }
+    static bool IsComplete(Backend* context, Obj* fence) { return context->GetData(fence, nullptr, 0, false); }
+    static void Wait(Backend* context, Obj* fence) { while (!context->GetData(fence, nullptr, 0, true)) {} }
+};
+
+enum Pass { PASS_SKYBOX, PASS_INSTANCED, PASS_DEFERRED, PASS_BLOOM, PASS_POST, PASS_COUNT };
+const uint32_t INSTANCED_DRAWS = 200;   // пакетов LOD на кадр
+const uint32_t BLOOM_LEVELS = 5;
+
+struct Device
+{
+    Obj vs, fullscreenVS, skyPS, instancedPS, deferredPS, bloomPS, postPS, cullCS;
+    Obj layout, vb, ib, args, sceneCB, modelCB, bloomCB, lightsSRV, textureSRV, sceneSRV;
+    Obj sampler, rasterizer, dsSky, dsLess, additive, timestamp, fences[2];
+    Obj sceneRTV, gbufferRTV[2], gbufferSRV[2], depth, backBuffer, bloomRTV[BLOOM_LEVELS], bloomSRV[BLOOM_LEVELS];
+    Obj visibleUAV, argsUAV, counterCopy;
+    Viewport viewport, bloomViewports[BLOOM_LEVELS];
+    Device()
+    {
+        sceneCB.bytes = 128;
+        modelCB.bytes = 64 * 1024;
+        viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+        for (uint32_t i = 0; i < BLOOM_LEVELS; ++i)
+            bloomViewports[i] = { 0.0f, 0.0f, 640.0f / (1 << i), 360.0f / (1 << i), 0.0f, 1.0f };
+    }
+};
+
+// Проходы кадра Lab8: фильтр - графический конвейер, бэкенд - очистки, UAV и вычисления
+static void RecordPass(uint32_t pass, StateFilter<ContextApi>& f, Backend* b, Device& d)
+{
+    f.Reset();
+    const float clear[4] = { 0.25f, 0.25f, 0.25f, 1.0f };
+    Obj* sampler = &d.sampler;
+    f.PSSetSamplers(0, 1, &sampler);
+    f.RSSetState(&d.rasterizer);
+    switch (pass)
+    {
+    case PASS_SKYBOX:
+    {
+        Obj* target = &d.sceneRTV;
+        b->OMSetRenderTargets(1, &target, &d.depth);
+        b->ClearRenderTargetView(&d.sceneRTV, clear);
+        b->ClearDepthStencilView(&d.depth, 1, 1.0f, 0);
+        b->RSSetViewports(1, &d.viewport);
+        Obj* cb = &d.sceneCB;
+        Obj* srv = &d.textureSRV;
+        f.VSSetShader(&d.fullscreenVS);
+        f.PSSetShader(&d.skyPS);
+        f.VSSetConstantBuffers(0, 1, &cb);
+        f.PSSetShaderResources(0, 1, &srv);
+        f.OMSetDepthStencilState(&d.dsSky, 0);
+        f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+        f.Draw(3, 0);
+        break;
+    }
+    case PASS_INSTANCED:
+    {
+        // Отсечение на GPU: UAV счётчиков, Dispatch, затем отрисовки по косвенным аргументам
+        Obj* uavs[2] = { &d.visibleUAV, &d.argsUAV };
+        const uint32_t zero[4] = {};
+        b->ClearUnorderedAccessViewUint(&d.argsUAV, zero);
+        b->CSSetShader(&d.cullCS);
+        b->CSSetUnorderedAccessViews(0, 2, uavs, nullptr);
+        b->Dispatch(40, 1, 1);
+        Obj* noUavs[2] = {};
+        b->CSSetUnorderedAccessViews(0, 2, noUavs, nullptr);
+        b->CSSetShader(nullptr);
+
+        Obj* targets[2] = { &d.gbufferRTV[0], &d.gbufferRTV[1] };
+        b->OMSetRenderTargets(2, targets, &d.depth);
+        b->ClearRenderTargetView(&d.gbufferRTV[0], clear);
+        b->ClearRenderTargetView(&d.gbufferRTV[1], clear);
+        b->RSSetViewports(1, &d.viewport);
+        Obj* vb = &d.vb;
+        uint32_t stride = 44, offset = 0;
+        Obj* cbs[2] = { &d.sceneCB, &d.modelCB };
+        Obj* srvs[2] = { &d.textureSRV, &d.lightsSRV };
+        for (uint32_t i = 0; i < INSTANCED_DRAWS; ++i)
+        {
+            // Каждый пакет ставит всё заново - повторы отбрасывает фильтр
+            f.VSSetShader(&d.vs);
+            f.PSSetShader(&d.instancedPS);
+            f.IASetInputLayout(&d.layout);
+            f.IASetVertexBuffers(0, 1, &vb, &stride, &offset);
+            f.IASetIndexBuffer(&d.ib, 42, 0);
+            f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+            f.VSSetConstantBuffers(0, 2, cbs);
+            f.PSSetShaderResources(0, 2, srvs);
+            f.OMSetDepthStencilState(&d.dsLess, 0);
+            if (i % 4 == 0) f.DrawIndexedInstancedIndirect(&d.args, i * 20);
+            else f.DrawIndexed(36 + i, i * 36, 0);
+        }
+        break;
+    }
+    case PASS_DEFERRED:
+    {
+        Obj* target = &d.sceneRTV;
+        b->OMSetRenderTargets(1, &target, nullptr);
+        b->RSSetViewports(1, &d.viewport);
+        Obj* srvs[3] = { &d.gbufferSRV[0], &d.gbufferSRV[1], &d.lightsSRV };
+        f.VSSetShader(&d.fullscreenVS);
+        f.PSSetShader(&d.deferredPS);
+        f.PSSetShaderResources(0, 3, srvs);
+        f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+        f.Draw(3, 0);
+        Obj* none[3] = {};
+        f.PSSetShaderResources(0, 3, none);   // G-буфер снова станет целью
+        f.Flush();
+        break;
+    }
+    case PASS_BLOOM:
+    {
+        Obj* cb = &d.bloomCB;
+        f.VSSetShader(&d.fullscreenVS);
+        f.PSSetShader(&d.bloomPS);
+        f.PSSetConstantBuffers(0, 1, &cb);
+        f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+        // Вниз по цепочке, затем аддитивно вверх
+        for (uint32_t i = 0; i < 2 * BLOOM_LEVELS - 1; ++i)
+        {
+            uint32_t dst = i < BLOOM_LEVELS ? i : 2 * BLOOM_LEVELS - 2 - i;
+            Obj* src = i == 0 ? &d.sceneSRV : &d.bloomSRV[i < BLOOM_LEVELS ? i - 1 : dst + 1];
+            Obj* none = nullptr;
+            f.PSSetShaderResources(0, 1, &none);
+            f.Flush();
+            Obj* target = &d.bloomRTV[dst];
+            b->OMSetRenderTargets(1, &target, nullptr);
+            b->RSSetViewports(1, &d.bloomViewports[dst]);
+            f.OMSetBlendState(i < BLOOM_LEVELS ? nullptr : &d.additive, clear, 0xFFFFFFFF);
+            f.PSSetShaderResources(0, 1, &src);
+            f.Draw(3, 0);
+        }
+        break;
+    }
+    case PASS_POST:
+    {
+        Obj* target = &d.backBuffer;
+        b->OMSetRenderTargets(1, &target, nullptr);
+        b->RSSetViewports(1, &d.viewport);
+        Obj* srvs[2] = { &d.sceneSRV, &d.bloomSRV[0] };
+        f.VSSetShader(&d.fullscreenVS);
+        f.PSSetShader(&d.postPS);
+        f.PSSetShaderResources(0, 2, srvs);
+        f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+        f.OMSetBlendState(nullptr, clear, 0xFFFFFFFF);
+        f.Draw(3, 0);
+        break;
+    }
+    }
+}
+
+const uint64_t DRAWS_PER_FRAME = 1 + INSTANCED_DRAWS + 1 + (2 * BLOOM_LEVELS - 1) + 1;
+
+struct Frame
+{
+    Device device;
+    NullBackend<NullTypes> immediate;
+    NullBackend<NullTypes> passBackends[PASS_COUNT];
+    StateFilter<ContextApi> filters[PASS_COUNT];
+    PassRecorder<CommandApi> recorder;
+    FramePipeline<FenceApi> pipeline;
+    uint64_t completed = 0;
+
+    Frame()
+    {
+        recorder.slots.resize(PASS_COUNT);
+        for (uint32_t p = 0; p < PASS_COUNT; ++p)
+        {
+            recorder.slots[p].context = &passBackends[p];
+            filters[p].context = &passBackends[p];
+        }
+        pipeline.context = &immediate;
+        pipeline.slots.resize(2);
+        for (uint32_t i = 0; i < 2; ++i) pipeline.slots[i].fence = &device.fences[i];
+    }
+
+    void Run(uint32_t threads)
+    {
+        pipeline.BeginFrame([this](uint32_t, uint64_t) { ++completed; });
+        immediate.Begin(&device.timestamp);
+        // Константы кадра и моделей - на непосредственном контексте до записи проходов
+        Mapped m;
+        if (immediate.Map(&device.sceneCB, 0, 0, 0, &m))
+        {
+            memset(m.pData, 0, device.sceneCB.bytes);
+            immediate.Unmap(&device.sceneCB, 0);
+        }
+        if (immediate.Map(&device.modelCB, 0, 0, 0, &m))
+        {
+            memset(m.pData, 1, device.modelCB.bytes);
+            immediate.Unmap(&device.modelCB, 0);
+        }
+        recorder.Record(threads, [this](uint32_t p, Backend* b) { RecordPass(p, filters[p], b, device); });
+        recorder.Submit(&immediate);
+        immediate.CopyResource(&device.counterCopy, &device.argsUAV);
+        immediate.End(&device.timestamp);
+        pipeline.EndFrame();
+        immediate.CheckFrameEnd();
+    }
+
+    NullBackendStats Totals() const
+    {
+        NullBackendStats total = immediate.stats;
+        for (const NullBackend<NullTypes>& b : passBackends) total.Add(b.stats);
+        return total;
+    }
+};
+
+static void TestFrameLoop(int frames, uint32_t threads)
+{
+    Frame frame;
+    double t0 = NowMs();
+    for (int f = 0; f < frames; ++f) frame.Run(threads);
+    double ms = NowMs() - t0;
+    frame.pipeline.Drain([&frame](uint32_t, uint64_t) { ++frame.completed; });
+
+    NullBackendStats total = frame.Totals();
+    StateFilterStats binds;
+    for (const StateFilter<ContextApi>& f : frame.filters)
+    {
+        binds.requested += f.stats.requested;
+        binds.issued += f.stats.issued;
+    }
+    std::printf("%d frames on %u threads: %.3f ms/frame, %.0f backend calls/frame, %.0f binds requested / %.0f issued per frame\n",
+        frames, threads, ms / frames, (double)total.calls / frames, (double)binds.requested / frames, (double)binds.issued / frames);
+    if (total.errors) std::printf("  %llu errors, last: %s\n", (unsigned long long)total.errors, total.lastError);
+    CHECK(total.errors == 0);
+    CHECK(total.draws == DRAWS_PER_FRAME * frames);
+    CHECK(total.dispatches == (uint64_t)frames);
+    CHECK(total.uploads == 2ull * frames);
+    CHECK(frame.completed == (uint64_t)frames);
+    CHECK(frame.pipeline.InFlight() == 0);
+    CHECK(binds.issued < binds.requested / 4);    // пакеты instanced ставят одно и то же
+}
+
+// Каждая проверка бэкенда срабатывает ровно на своей ошибке
+static void TestErrors()
+{
+    Device d;
+    NullBackend<NullTypes> n;
+    uint64_t e = 0;
+    auto expectErrors = [&](uint64_t added, const char* what)
+    {
+        if (n.stats.errors != e + added)
+            std::printf("%s: %llu new errors, expected %llu (last: %s)\n", what,
+                (unsigned long long)(n.stats.errors - e), (unsigned long long)added, n.stats.lastError ? n.stats.lastError : "-");
+        CHECK(n.stats.errors == e + added);
+        e = n.stats.errors;
+    };
+
+    n.Draw(3, 0);
+    expectErrors(4, "empty pipeline");            // нет VS, топологии, цели, viewport
+    Obj* target = &d.sceneRTV;
+    n.VSSetShader(&d.vs);
+    n.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+    n.OMSetRenderTargets(1, &target, nullptr);
+    n.RSSetViewports(1, &d.viewport);
+    n.Draw(3, 0);
+    expectErrors(0, "complete pipeline");
+    n.DrawIndexed(3, 0, 0);
+    expectErrors(1, "no index buffer");
+    n.IASetIndexBuffer(&d.ib, 42, 0);
+    n.DrawIndexedInstancedIndirect(&d.args, 6);
+    expectErrors(1, "unaligned indirect offset");
+    n.DrawIndexedInstancedIndirect(nullptr, 0);
+    expectErrors(1, "null indirect args");
+
+    Obj* cbs[2] = { &d.sceneCB, &d.modelCB };
+    n.VSSetConstantBuffers(13, 2, cbs);
+    expectErrors(1, "CB slot range");
+    n.PSSetShaderResources(127, 1, cbs);
+    expectErrors(0, "last SRV slot");
+    n.PSSetSamplers(16, 1, cbs);
+    expectErrors(1, "sampler slot range");
+    n.CSSetUnorderedAccessViews(7, 2, cbs, nullptr);
+    expectErrors(1, "UAV slot range");
+    n.PSSetShaderResources(0, 1, nullptr);
+    expectErrors(1, "null slot array");
+    n.OMSetRenderTargets(9, nullptr, nullptr);
+    expectErrors(2, "too many render targets, null array");
+
+    Mapped m;
+    n.Unmap(&d.sceneCB, 0);
+    expectErrors(1, "Unmap without Map");
+    CHECK(n.Map(&d.sceneCB, 0, 0, 0, &m) && m.pData && m.RowPitch == d.sceneCB.bytes);
+    n.OMSetRenderTargets(1, &target, nullptr);
+    n.Draw(3, 0);
+    expectErrors(1, "draw while mapped");
+    CHECK(!n.Map(&d.sceneCB, 0, 0, 0, &m));
+    expectErrors(1, "second Map");
+    CHECK(n.Map(&d.sceneCB, 1, 0, 0, &m));        // другой subresource - можно
+    expectErrors(0, "Map of another subresource");
+    n.FinishCommandList();
+    expectErrors(1, "FinishCommandList while mapped");
+    n.Unmap(&d.sceneCB, 0);
+    n.Unmap(&d.sceneCB, 1);
+    n.CheckFrameEnd();
+    expectErrors(0, "all unmapped");
+
+    n.Begin(&d.timestamp);
+    n.Begin(&d.timestamp);
+    expectErrors(1, "Begin twice");
+    n.GetData(&d.timestamp, nullptr, 0, true);
+    expectErrors(1, "GetData before End");
+    n.CheckFrameEnd();
+    expectErrors(1, "open query at frame end");
+    n.End(&d.timestamp);
+    n.End(&d.fences[0]);                          // событие: End без Begin
+    uint64_t value = 7;
+    CHECK(n.GetData(&d.fences[0], &value, sizeof(value), false) && value == 0);
+    expectErrors(0, "fence");
+
+    n.Dispatch(1, 1, 1);
+    expectErrors(1, "Dispatch without CS");
+    n.CSSetShader(&d.cullCS);
+    n.Dispatch(BACKEND_MAX_GROUPS, 1, 1);
+    expectErrors(0, "Dispatch at the group limit");
+    n.Dispatch(1, BACKEND_MAX_GROUPS + 1, 1);
+    expectErrors(1, "too many groups");
+    n.CopyResource(&d.sceneCB, &d.sceneCB);
+    expectErrors(1, "CopyResource onto itself");
+    n.ClearDepthStencilView(&d.depth, 1, 1.5f, 0);
+    expectErrors(1, "depth clear outside [0, 1]");
+    n.ExecuteCommandList(nullptr);
+    expectErrors(1, "null command list");
+
+    // FinishCommandList и ClearState сбрасывают конвейер
+    n.FinishCommandList();
+    n.Draw(3, 0);
+    expectErrors(4, "draw after FinishCommandList");
+    n.VSSetShader(&d.vs);
+    n.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+    n.OMSetRenderTargets(1, &target, nullptr);
+    n.RSSetViewports(1, &d.viewport);
+    n.ClearState();
+    n.Draw(3, 0);
+    expectErrors(4, "draw after ClearState");
+    CHECK(n.stats.lastError != nullptr);
+}
+
+// Пропущенная привязка в проходе видна на пустом бэкенде: проход без viewport
+static void TestBrokenPass()
+{
+    Frame frame;
+    StateFilter<ContextApi>& f = frame.filters[PASS_POST];
+    frame.recorder.Record(2, [&](uint32_t p, Backend* b)
+    {
+        if (p != PASS_POST) { RecordPass(p, frame.filters[p], b, frame.device); return; }
+        f.Reset();
+        f.VSSetShader(&frame.device.fullscreenVS);
+        f.IASetPrimitiveTopology(TOPOLOGY_TRIANGLELIST);
+        Obj* target = &frame.device.backBuffer;
+        b->OMSetRenderTargets(1, &target, nullptr);
+        f.Draw(3, 0);
+    });
+    frame.recorder.Submit(&frame.immediate);
+    CHECK(frame.passBackends[PASS_POST].stats.errors == 1);
+    CHECK(frame.Totals().errors == 1);
+    CHECK(frame.passBackends[PASS_POST].stats.lastError != nullptr &&
+        strcmp(frame.passBackends[PASS_POST].stats.lastError, "draw: no viewport") == 0);
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    uint32_t threads = argc > 2 ? (uint32_t)atoi(argv[2]) : 3u;
+    TestFrameLoop(frames, 1);
+    TestFrameLoop(frames, threads);
+    TestErrors();
+    TestBrokenPass();
+    return TestResult("NullBackendTest");
+}
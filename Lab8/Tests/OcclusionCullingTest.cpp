@@ -0,0 +1,234 @@
+// Lab8_OcclusionCullingTest
+// Эталон двухфазного culling (OcclusionCulling.h) на синтетической сцене: стена-окклюдер,
+// ящики за ней, сбоку, перед ней и вне фрустума. Глубина "рисуется" трассировкой луча через
+// центр пикселя, та же трассировка даёт ожидаемую видимость. Проверяется:
+//  - пирамида консервативна: MaxDepth прямоугольника не меньше точного максимума;
+//  - видимый ящик не отсекается ни в одном кадре (фаза 2 дорисовывает открывшееся в том же кадре);
+//  - спрятанные за стеной ящики уходят из фазы 1 со второго кадра и возвращаются, когда стена уходит.
+#include <vector>
+#include <random>
+#include "TestCommon.h"
+#include "../OcclusionCulling.h"
+
+static const uint32_t W = 256, H = 144;
+
+struct Box { Float3 bmin, bmax; };
+
+struct Scene
+{
+    Float4x4 viewProj;
+    std::vector<Box> boxes;
+    std::vector<Float3> bbMin, bbMax;
+
+    void Sync()
+    {
+        bbMin.resize(boxes.size());
+        bbMax.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) { bbMin[i] = boxes[i].bmin; bbMax[i] = boxes[i].bmax; }
+    }
+};
+
+// Луч из камеры в начале координат (view - единичная) через центр пикселя
+static Float3 PixelRay(const Float4x4& proj, uint32_t x, uint32_t y)
+{
+    float ndcX = (x + 0.5f) / W * 2.0f - 1.0f, ndcY = 1.0f - (y + 0.5f) / H * 2.0f;
+    return MakeFloat3(ndcX / proj.m[0][0], ndcY / proj.m[1][1], 1.0f);
+}
+
+static bool HitBox(const Float3& dir, const Box& b, float& t)
+{
+    float d[3] = { dir.x, dir.y, dir.z }, lo[3] = { b.bmin.x, b.bmin.y, b.bmin.z }, hi[3] = { b.bmax.x, b.bmax.y, b.bmax.z };
+    float t0 = 0.0f, t1 = FLT_MAX;
+    for (int a = 0; a < 3; ++a)
+    {
+        if (fabsf(d[a]) < 1e-8f) { if (lo[a] > 0.0f || hi[a] < 0.0f) return false; continue; }
+        float ta = lo[a] / d[a], tb = hi[a] / d[a];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = (std::max)(t0, ta);
+        t1 = (std::min)(t1, tb);
+    }
+    t = t0;
+    return t0 <= t1;
+}
+
+static void DrawBoxes(const Scene& s, const std::vector<uint32_t>& ids, DepthBufferCPU& depth)
+{
+    for (uint32_t y = 0; y < H; ++y)
+        for (uint32_t x = 0; x < W; ++x)
+        {
+            Float3 dir = PixelRay(s.viewProj, x, y);
+            for (uint32_t id : ids)
+            {
+                float t;
+                if (!HitBox(dir, s.boxes[id], t)) continue;
+                float z = s.viewProj.m[2][2] + s.viewProj.m[3][2] / (dir.z * t);
+                float& d = depth.depth[(size_t)y * W + x];
+                d = (std::min)(d, z);
+            }
+        }
+}
+
+// Ожидаемая видимость: ящик ближайший хотя бы для одного пикселя
+static std::vector<uint8_t> RayVisibility(const Scene& s)
+{
+    std::vector<uint8_t> visible(s.boxes.size(), 0);
+    for (uint32_t y = 0; y < H; ++y)
+        for (uint32_t x = 0; x < W; ++x)
+        {
+            Float3 dir = PixelRay(s.viewProj, x, y);
+            float best = FLT_MAX;
+            int nearest = -1;
+            for (size_t i = 0; i < s.boxes.size(); ++i)
+            {
+                float t;
+                if (HitBox(dir, s.boxes[i], t) && t < best) { best = t; nearest = (int)i; }
+            }
+            if (nearest >= 0) visible[nearest] = 1;
+        }
+    return visible;
+}
+
+struct FrameResult { std::vector<uint32_t> phase1, phase2; std::vector<uint8_t> drawn; };
+
+static FrameResult RunFrame(TwoPhaseCuller& culler, const Scene& s)
+{
+    Float4 planes[6];
+    BuildFrustumPlanesCPU(s.viewProj, planes);
+    uint32_t count = (uint32_t)s.boxes.size();
+    DepthBufferCPU depth;
+    depth.Resize(W, H);
+
+    culler.RunPhase1(planes, s.bbMin.data(), s.bbMax.data(), count);
+    DrawBoxes(s, culler.phase1, depth);
+    DepthPyramid pyramid;
+    pyramid.Build(depth);
+    culler.RunPhase2(pyramid, s.viewProj, s.bbMin.data(), s.bbMax.data(), count);
+
+    FrameResult r;
+    r.phase1 = culler.phase1;
+    r.phase2 = culler.phase2;
+    r.drawn.assign(count, 0);
+    for (uint32_t i : r.phase1) r.drawn[i] = 1;
+    for (uint32_t i : r.phase2) r.drawn[i] = 1;
+    return r;
+}
+
+static bool Contains(const std::vector<uint32_t>& v, uint32_t id)
+{
+    for (uint32_t x : v) if (x == id) return true;
+    return false;
+}
+
+static void TestPyramid()
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    const uint32_t sizes[][2] = { { 37, 23 }, { 64, 64 }, { 1, 17 }, { 255, 3 } };
+    for (const auto& sz : sizes)
+    {
+        DepthBufferCPU depth;
+        depth.Resize(sz[0], sz[1]);
+        for (float& d : depth.depth) d = u(rng);
+        DepthPyramid pyramid;
+        pyramid.Build(depth);
+        CHECK(pyramid.levels.size() == DepthPyramidMipCount(sz[0], sz[1]));
+        const DepthPyramid::Level& top = pyramid.levels.back();
+        CHECK(top.width == 1 && top.height == 1);
+        float globalMax = 0.0f;
+        for (float d : depth.depth) globalMax = (std::max)(globalMax, d);
+        CHECK(top.data[0] == globalMax);
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            uint32_t x0 = rng() % sz[0], y0 = rng() % sz[1];
+            uint32_t x1 = x0 + rng() % (sz[0] - x0), y1 = y0 + rng() % (sz[1] - y0);
+            float exact = 0.0f;
+            for (uint32_t y = y0; y <= y1; ++y)
+                for (uint32_t x = x0; x <= x1; ++x)
+                    exact = (std::max)(exact, depth.At(x, y));
+            CHECK(pyramid.MaxDepth((float)x0, (float)y0, (float)x1, (float)y1) >= exact);
+        }
+    }
+    CHECK(DepthPyramidMipCount(1, 1) == 1);
+    CHECK(DepthPyramidMipCount(1920, 1080) == 11);
+    CHECK(VisibilityWordCount(0) == 0 && VisibilityWordCount(32) == 1 && VisibilityWordCount(33) == 2);
+}
+
+static void TestTwoPhase()
+{
+    Scene s;
+    s.viewProj = PerspectiveFovLH(3.14159265f / 3.0f, (float)W / H, 0.1f, 100.0f);   // камера в начале, смотрит по +z
+
+    s.boxes.push_back({ MakeFloat3(-3, -2, 10), MakeFloat3(3, 2, 10.2f) });               // 0: стена
+    std::vector<uint32_t> hidden, side;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -2; x <= 2; ++x)
+        {
+            hidden.push_back((uint32_t)s.boxes.size());
+            s.boxes.push_back({ MakeFloat3(x * 2.0f - 0.25f, y * 1.5f - 0.25f, 20), MakeFloat3(x * 2.0f + 0.25f, y * 1.5f + 0.25f, 20.5f) });
+        }
+    for (int x = -1; x <= 1; x += 2)
+    {
+        side.push_back((uint32_t)s.boxes.size());
+        s.boxes.push_back({ MakeFloat3(x * 15.0f - 1, -1, 20), MakeFloat3(x * 15.0f + 1, 1, 21) });
+    }
+    uint32_t front = (uint32_t)s.boxes.size();
+    s.boxes.push_back({ MakeFloat3(-0.5f, 2.2f, 5), MakeFloat3(0.5f, 2.8f, 6) });         // ближе стены, над ней
+    uint32_t edge = (uint32_t)s.boxes.size();
+    s.boxes.push_back({ MakeFloat3(5.5f, -0.5f, 20), MakeFloat3(6.5f, 0.5f, 21) });      // краем выглядывает из-за стены
+    uint32_t outside = (uint32_t)s.boxes.size();
+    s.boxes.push_back({ MakeFloat3(100, -1, 20), MakeFloat3(102, 1, 21) });
+    s.Sync();
+
+    std::vector<uint8_t> expected = RayVisibility(s);
+    for (uint32_t id : hidden) CHECK(!expected[id]);
+    CHECK(expected[0] && expected[front] && expected[edge] && !expected[outside]);
+
+    TwoPhaseCuller culler;
+    culler.Resize((uint32_t)s.boxes.size());
+
+    // Кадр 1: истории нет - всё в фазе 2 по пустой пирамиде
+    FrameResult f = RunFrame(culler, s);
+    CHECK(f.phase1.empty());
+    for (size_t i = 0; i < s.boxes.size(); ++i) CHECK(f.drawn[i] == (i != outside ? 1 : 0));
+
+    // Кадр 2: фаза 1 рисует всё видимое в кадре 1, пирамида уже содержит стену
+    f = RunFrame(culler, s);
+    CHECK(f.phase2.empty());
+    for (uint32_t id : hidden) CHECK(!culler.history.Test(id));
+
+    // Кадры 3+: фаза 1 - ровно видимое, фаза 2 пуста
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        f = RunFrame(culler, s);
+        CHECK(f.phase2.empty());
+        for (size_t i = 0; i < s.boxes.size(); ++i)
+        {
+            if (expected[i]) CHECK(Contains(f.phase1, (uint32_t)i));
+            if (!expected[i]) CHECK(!Contains(f.phase1, (uint32_t)i));
+        }
+    }
+
+    // Стена уезжает: спрятанное открывается в том же кадре через фазу 2
+    s.boxes[0] = { MakeFloat3(40, -2, 10), MakeFloat3(46, 2, 10.2f) };
+    s.Sync();
+    expected = RayVisibility(s);
+    f = RunFrame(culler, s);
+    for (uint32_t id : hidden)
+    {
+        CHECK(expected[id]);
+        CHECK(Contains(f.phase2, id));
+    }
+    for (size_t i = 0; i < s.boxes.size(); ++i)
+        if (expected[i]) CHECK(f.drawn[i]);
+    f = RunFrame(culler, s);
+    CHECK(f.phase2.empty());
+    for (uint32_t id : hidden) CHECK(Contains(f.phase1, id));
+}
+
+int main()
+{
+    TestPyramid();
+    TestTwoPhase();
+    return TestResult("OcclusionCullingTest");
+}
@@ -0,0 +1,261 @@
+// Lab8_RenderGraphTest
+// Компиляция графа кадра (RenderGraph.h): отсечение проходов, интервалы жизни, переходы с discard
+// на первой записи, отказ при чтении до записи, и главное - память временных текстур до и после
+// алиасинга. Для каждого графа печатаются три числа: без алиасинга (у каждой текстуры своя память),
+// пул после алиасинга и нижняя граница - пик одновременно живых текстур. Проверяется, что текстуры
+// одного слота пула совпадают описанием и не пересекаются по жизни, а пул лежит между границами.
+// Графы: развёрнутый отложенный кадр с размытием по проходам и граф кадра Lab8 (BuildRenderGraph)
+// во всех сочетаниях режимов.
+#include <string>
+#include "TestCommon.h"
+#include "../RenderGraph.h"
+#include "../Bloom.h"
+
+const uint32_t FORMAT_RGBA8 = 28;      // DXGI_FORMAT_R8G8B8A8_UNORM
+const uint32_t FORMAT_RG16_SNORM = 37; // DXGI_FORMAT_R16G16_SNORM
+const uint32_t FORMAT_RGBA16F = 10;    // DXGI_FORMAT_R16G16B16A16_FLOAT
+
+static RGTextureDesc Desc(uint32_t width, uint32_t height, uint32_t format, uint32_t bytesPerPixel)
+{
+    RGTextureDesc d;
+    d.width = width;
+    d.height = height;
+    d.format = format;
+    d.bytesPerPixel = bytesPerPixel;
+    return d;
+}
+
+// Пик суммы живых временных текстур по позициям кадра - меньше пула быть не может
+static uint64_t PeakLiveBytes(const RenderGraph& g)
+{
+    uint64_t peak = 0;
+    for (uint32_t position = 0; position < g.order.size(); ++position)
+    {
+        uint64_t live = 0;
+        for (const RenderGraph::Resource& r : g.resources)
+            if (!r.imported && r.firstPass != RenderGraph::INVALID && r.firstPass <= position && position <= r.lastPass)
+                live += r.desc.Bytes();
+        peak = (std::max)(peak, live);
+    }
+    return peak;
+}
+
+// Инварианты компиляции; печать памяти
+static void CheckCompiled(const RenderGraph& g, const char* name)
+{
+    uint64_t transient = 0, pool = 0;
+    for (size_t i = 0; i < g.resources.size(); ++i)
+    {
+        const RenderGraph::Resource& a = g.resources[i];
+        if (a.imported) { CHECK(a.physical == RenderGraph::INVALID); continue; }
+        if (a.firstPass == RenderGraph::INVALID) { CHECK(a.physical == RenderGraph::INVALID); continue; }   // не используется
+        transient += a.desc.Bytes();
+        CHECK(a.physical < g.physical.size());
+        if (a.physical >= g.physical.size()) continue;
+        CHECK(g.physical[a.physical] == a.desc);
+        for (size_t j = i + 1; j < g.resources.size(); ++j)
+        {
+            const RenderGraph::Resource& b = g.resources[j];
+            if (b.imported || b.physical != a.physical) continue;
+            CHECK(a.lastPass < b.firstPass || b.lastPass < a.firstPass);
+        }
+    }
+    for (const RGTextureDesc& d : g.physical) pool += d.Bytes();
+    CHECK(transient == g.transientBytes);
+    CHECK(pool == g.aliasedBytes);
+    uint64_t peak = PeakLiveBytes(g);
+    CHECK(peak <= g.aliasedBytes);
+    CHECK(g.aliasedBytes <= g.transientBytes);
+
+    // Переходы: первая запись временной текстуры - discard, чтение идёт после записи
+    std::vector<RGState> state(g.resources.size(), RG_STATE_UNDEFINED);
+    for (uint32_t p : g.order)
+        for (const RGTransition& t : g.passes[p].transitions)
+        {
+            CHECK(t.before == state[t.resource]);
+            CHECK(t.discard == (!g.resources[t.resource].imported && t.before == RG_STATE_UNDEFINED));
+            state[t.resource] = t.after;
+        }
+
+    std::printf("%-32s passes %u/%u, textures %u -> pool %u: no aliasing %6.2f MB, aliased %6.2f MB, peak live %6.2f MB\n",
+        name, (unsigned)g.order.size(), (unsigned)g.passes.size(),
+        (unsigned)std::count_if(g.resources.begin(), g.resources.end(), [](const RenderGraph::Resource& r) { return !r.imported && r.firstPass != RenderGraph::INVALID; }),
+        (unsigned)g.physical.size(), g.transientBytes / 1048576.0, g.aliasedBytes / 1048576.0, peak / 1048576.0);
+}
+
+static void TestExpandedDeferredFrame()
+{
+    const uint32_t w = 1920, h = 1080;
+    RGTextureDesc color = Desc(w, h, FORMAT_RGBA8, 4), hdr = Desc(w, h, FORMAT_RGBA16F, 8);
+    RenderGraph g;
+    uint32_t back = g.Import("BackBuffer"), depth = g.Import("Depth");
+    uint32_t albedo = g.CreateTexture("Albedo", color), normal = g.CreateTexture("Normal", color);
+    uint32_t light = g.CreateTexture("HDR", hdr), bright = g.CreateTexture("Bright", hdr);
+    uint32_t blurA = g.CreateTexture("BlurA", hdr), blurB = g.CreateTexture("BlurB", hdr);
+    uint32_t debug = g.CreateTexture("Debug", color), ldr = g.CreateTexture("LDR", color);
+    uint32_t gbuffer = g.AddPass("GBuffer");
+    g.Write(gbuffer, albedo); g.Write(gbuffer, normal); g.Write(gbuffer, depth);
+    uint32_t debugPass = g.AddPass("DebugNormals");   // результат никто не читает
+    g.Read(debugPass, normal); g.Write(debugPass, debug);
+    uint32_t lighting = g.AddPass("Lighting");
+    g.Read(lighting, albedo); g.Read(lighting, normal); g.Read(lighting, depth); g.Write(lighting, light);
+    uint32_t brightPass = g.AddPass("BrightPass");
+    g.Read(brightPass, light); g.Write(brightPass, bright);
+    uint32_t blurH = g.AddPass("BlurH");
+    g.Read(blurH, bright); g.Write(blurH, blurA);
+    uint32_t blurV = g.AddPass("BlurV");
+    g.Read(blurV, blurA); g.Write(blurV, blurB);
+    uint32_t tonemap = g.AddPass("Tonemap");
+    g.Read(tonemap, light); g.Read(tonemap, blurB); g.Write(tonemap, ldr);
+    uint32_t present = g.AddPass("Grayscale");
+    g.Read(present, ldr); g.Write(present, back);
+
+    CHECK(g.Compile());
+    CHECK(!g.IsLive(debugPass));
+    CHECK(g.IsLive(gbuffer) && g.IsLive(lighting) && g.IsLive(blurV) && g.IsLive(present));
+    CHECK(g.order.size() == 7);
+    CHECK(g.resources[debug].firstPass == RenderGraph::INVALID);
+    // Albedo умирает на Lighting, LDR рождается на Tonemap: одна текстура пула. Bright и BlurB - тоже
+    CHECK(g.Physical(albedo) == g.Physical(ldr));
+    CHECK(g.Physical(bright) == g.Physical(blurB));
+    CHECK(g.Physical(light) != g.Physical(bright));
+    CheckCompiled(g, "expanded deferred + blur, 1080p");
+    CHECK(g.aliasedBytes < g.transientBytes);
+    // Пул: Albedo/LDR, Normal, HDR, Bright/BlurB, BlurA
+    CHECK(g.physical.size() == 5);
+
+    // Переход HDR: запись (discard) на Lighting, чтение на BrightPass, и больше не меняется
+    const std::vector<RGTransition>& lt = g.passes[lighting].transitions;
+    bool lightWrite = false;
+    for (const RGTransition& t : lt) lightWrite |= t.resource == light && t.after == RG_STATE_RENDER_TARGET && t.discard;
+    CHECK(lightWrite);
+    bool tonemapTouchesLight = false;
+    for (const RGTransition& t : g.passes[tonemap].transitions) tonemapTouchesLight |= t.resource == light;
+    CHECK(!tonemapTouchesLight);   // уже в SHADER_READ
+
+    // Повторная компиляция того же графа даёт то же
+    uint64_t aliased = g.aliasedBytes;
+    CHECK(g.Compile());
+    CHECK(g.aliasedBytes == aliased);
+}
+
+// Граф кадра Lab8 (Source.cpp, BuildRenderGraph)
+static void BuildLab8Graph(RenderGraph& graph, uint32_t width, uint32_t height, bool filterPass, bool deferred, bool bloomOn, uint32_t passIds[5])
+{
+    graph.Reset();
+    uint32_t backBuffer = graph.Import("BackBuffer");
+    uint32_t depth = graph.Import("Depth");
+    uint32_t sceneColor = RenderGraph::INVALID;
+    filterPass = filterPass || bloomOn;
+    if (filterPass) sceneColor = graph.CreateTexture("SceneColor", Desc(width, height, FORMAT_RGBA8, 4));
+    uint32_t sceneTarget = filterPass ? sceneColor : backBuffer;
+    uint32_t albedo = RenderGraph::INVALID, normal = RenderGraph::INVALID;
+    if (deferred)
+    {
+        albedo = graph.CreateTexture("GBufferAlbedo", Desc(width, height, FORMAT_RGBA8, 4));
+        normal = graph.CreateTexture("GBufferNormal", Desc(width, height, FORMAT_RG16_SNORM, 4));
+    }
+    uint32_t levels = bloomOn ? BloomLevelCount(width, height) : 0;
+    std::vector<uint32_t> bloom;
+    RGTextureDesc bloomDesc = Desc(width, height, FORMAT_RGBA16F, 8);
+    for (uint32_t i = 0; i < levels; ++i)
+    {
+        bloomDesc.width = BloomLevelSize(bloomDesc.width);
+        bloomDesc.height = BloomLevelSize(bloomDesc.height);
+        bloom.push_back(graph.CreateTexture(("Bloom" + std::to_string(i)).c_str(), bloomDesc));
+    }
+
+    uint32_t skybox = graph.AddPass("Skybox");
+    graph.Write(skybox, sceneTarget);
+    graph.Write(skybox, depth);
+    uint32_t instanced = graph.AddPass("Instanced", true);
+    if (deferred) { graph.Write(instanced, albedo); graph.Write(instanced, normal); }
+    else graph.Write(instanced, sceneTarget);
+    graph.Write(instanced, depth);
+    uint32_t lighting = graph.AddPass("DeferredLighting");
+    if (deferred)
+    {
+        graph.Read(lighting, albedo);
+        graph.Read(lighting, normal);
+        graph.Read(lighting, depth);
+        graph.Write(lighting, sceneTarget);
+    }
+    uint32_t bloomPass = graph.AddPass("Bloom");
+    if (levels)
+    {
+        graph.Read(bloomPass, sceneColor);
+        for (uint32_t b : bloom) graph.Write(bloomPass, b);
+    }
+    uint32_t post = graph.AddPass("PostProcess");
+    if (filterPass)
+    {
+        graph.Read(post, sceneColor);
+        if (levels) graph.Read(post, bloom[0]);
+        graph.Write(post, backBuffer);
+    }
+    uint32_t ids[5] = { skybox, instanced, lighting, bloomPass, post };
+    for (int i = 0; i < 5; ++i) passIds[i] = ids[i];
+}
+
+static void TestLab8Frame()
+{
+    for (int mode = 0; mode < 8; ++mode)
+    {
+        bool filterPass = (mode & 1) != 0, deferred = (mode & 2) != 0, bloomOn = (mode & 4) != 0;
+        RenderGraph g;
+        uint32_t pass[5];
+        BuildLab8Graph(g, 1280, 720, filterPass, deferred, bloomOn, pass);
+        CHECK(g.Compile());
+        char name[64];
+        std::snprintf(name, sizeof(name), "Lab8 720p%s%s%s", filterPass ? " filter" : "", deferred ? " deferred" : "", bloomOn ? " bloom" : "");
+        CheckCompiled(g, name);
+        CHECK(g.IsLive(pass[0]) && g.IsLive(pass[1]));
+        CHECK(g.IsLive(pass[2]) == deferred);
+        CHECK(g.IsLive(pass[3]) == bloomOn);
+        CHECK(g.IsLive(pass[4]) == (filterPass || bloomOn));
+        // G-буфер живёт с Instanced до Lighting и не делит пул с целью сцены (она жива с Skybox)
+        if (deferred)
+        {
+            uint32_t albedo = ~0u, scene = ~0u;
+            for (uint32_t r = 0; r < g.resources.size(); ++r)
+            {
+                if (g.resources[r].name == "GBufferAlbedo") albedo = r;
+                if (g.resources[r].name == "SceneColor") scene = r;
+            }
+            CHECK(g.resources[albedo].lastPass == 2);
+            if (scene != ~0u) CHECK(g.Physical(scene) != g.Physical(albedo));
+        }
+    }
+}
+
+static void TestErrors()
+{
+    RenderGraph g;
+    uint32_t t = g.CreateTexture("T", Desc(64, 64, FORMAT_RGBA8, 4));
+    uint32_t p = g.AddPass("ReadFirst", true);
+    g.Read(p, t);
+    CHECK(!g.Compile());                 // чтение временной текстуры до записи
+
+    // Проход без побочного эффекта, пишущий только в то, что никто не читает, отсекается вместе с цепочкой
+    RenderGraph chain;
+    uint32_t back = chain.Import("BackBuffer");
+    uint32_t a = chain.CreateTexture("A", Desc(64, 64, FORMAT_RGBA8, 4));
+    uint32_t b = chain.CreateTexture("B", Desc(64, 64, FORMAT_RGBA8, 4));
+    uint32_t p0 = chain.AddPass("WriteA");
+    chain.Write(p0, a);
+    uint32_t p1 = chain.AddPass("AtoB");
+    chain.Read(p1, a); chain.Write(p1, b);
+    uint32_t p2 = chain.AddPass("Clear");
+    chain.Write(p2, back);
+    CHECK(chain.Compile());
+    CHECK(!chain.IsLive(p0) && !chain.IsLive(p1) && chain.IsLive(p2));
+    CHECK(chain.physical.empty() && chain.transientBytes == 0);
+}
+
+int main()
+{
+    TestExpandedDeferredFrame();
+    TestLab8Frame();
+    TestErrors();
+    return TestResult("RenderGraphTest");
+}
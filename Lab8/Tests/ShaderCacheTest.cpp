@@ -0,0 +1,307 @@
+// Lab8_ShaderCacheTest
+// Дисковый кэш байткода (ShaderCache.h) с заглушкой компилятора вместо D3DCompile: холодный и тёплый
+// запуск на наборе шейдеров Lab8 (тёплый не компилирует и даёт тот же байткод), инвалидация по
+// исходнику, точке входа, флагам и соли, отказ от обрезанных, дописанных, изменённых и чужих файлов
+// с перезаписью, одновременная запись одних ключей из потоков и процессов без порчи и без
+// оставленных временных файлов, недоступный каталог. Нужен POSIX (fork, каталоги).
+// Запуск: ShaderCacheTest [рабочий каталог = .]
+#include <thread>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TestCommon.h"
+#include "../ShaderCache.h"
+
+// Заглушка компилятора: ms работы, байткод детерминирован по входу
+static std::atomic<int> g_Compiles(0);
+
+static bool StubCompile(const std::string& code, const char* entry, const char* target, uint32_t flags, std::vector<uint8_t>& out, double ms)
+{
+    ++g_Compiles;
+    double end = NowMs() + ms;
+    while (NowMs() < end) {}
+    uint64_t x = HashAppend(HashAppend(HashAppend(14695981039346656037ull, code.data(), code.size()), entry, strlen(entry)), target, strlen(target)) ^ flags;
+    out.resize(2000 + code.size() % 3000);
+    for (uint8_t& b : out) { x = x * 6364136223846793005ull + 1442695040888963407ull; b = (uint8_t)(x >> 56); }
+    return true;
+}
+
+// Как CompileCached в Source.cpp: промах - компиляция и запись
+static bool Compile(ShaderCache& cache, const std::string& code, const char* entry, const char* target, uint32_t flags,
+    std::vector<uint8_t>& out, double ms)
+{
+    uint64_t key = cache.Key(code.data(), code.size(), entry, target, flags);
+    if (cache.Load(key, out)) return true;
+    if (!StubCompile(code, entry, target, flags, out, ms)) return false;
+    cache.Store(key, out.data(), out.size());
+    return true;
+}
+
+static int CountFiles(const std::string& dir, const char* ext)
+{
+    int n = 0;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return -1;
+    size_t extLen = strlen(ext);
+    while (dirent* e = readdir(d))
+    {
+        std::string name = e->d_name;
+        n += name.size() > extLen && name.compare(name.size() - extLen, extLen, ext) == 0;
+    }
+    closedir(d);
+    return n;
+}
+
+static void ClearDirectory(const std::string& dir)
+{
+    mkdir(dir.c_str(), 0755);
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (dirent* e = readdir(d))
+        if (e->d_name[0] != '.') std::remove((dir + e->d_name).c_str());
+    closedir(d);
+}
+
+struct ShaderSource { std::string code; const char* entry; const char* target; };
+
+// Набор как в Lab8: пары VS/PS проходов, три точки входа одного cullCS и hiZ
+static std::vector<ShaderSource> Lab8Shaders()
+{
+    ShaderSource s[] = {
+        { std::string(900, 'a'), "vs", "vs_5_0" }, { std::string(4000, 'b'), "ps", "ps_5_0" },
+        { std::string(2500, 'c'), "vs", "vs_5_0" }, { std::string(6000, 'd'), "ps", "ps_5_0" },
+        { std::string(300, 'e'), "vs", "vs_5_0" }, { std::string(200, 'f'), "ps", "ps_5_0" },
+        { std::string(500, 'g'), "vs", "vs_5_0" }, { std::string(400, 'h'), "ps", "ps_5_0" },
+        { std::string(9000, 'i'), "cs", "cs_5_0" }, { std::string(9000, 'i'), "batchArgs", "cs_5_0" },
+        { std::string(9000, 'i'), "scatter", "cs_5_0" }, { std::string(1200, 'j'), "cs", "cs_5_0" } };
+    return std::vector<ShaderSource>(s, s + sizeof(s) / sizeof(s[0]));
+}
+
+const uint32_t FLAGS = 0x800;   // D3DCOMPILE_OPTIMIZATION_LEVEL3
+
+static double CompileAll(ShaderCache& cache, const std::vector<ShaderSource>& shaders, std::vector<std::vector<uint8_t>>& out, double ms)
+{
+    double t0 = NowMs();
+    out.assign(shaders.size(), std::vector<uint8_t>());
+    for (size_t i = 0; i < shaders.size(); ++i)
+        CHECK(Compile(cache, shaders[i].code, shaders[i].entry, shaders[i].target, FLAGS, out[i], ms));
+    return NowMs() - t0;
+}
+
+static void TestColdWarm(const std::string& dir, const std::vector<ShaderSource>& shaders, std::vector<std::vector<uint8_t>>& cold)
+{
+    const double compileMs = 5.0;
+    g_Compiles = 0;
+    ShaderCache first;
+    first.directory = dir;
+    first.salt = 47;
+    double coldMs = CompileAll(first, shaders, cold, compileMs);
+    CHECK(g_Compiles == (int)shaders.size());
+    CHECK(first.misses == shaders.size() && first.writes == shaders.size() && first.hits == 0);
+    CHECK(CountFiles(dir, ".cso") == (int)shaders.size());
+
+    g_Compiles = 0;
+    ShaderCache second;                           // новый запуск приложения
+    second.directory = dir;
+    second.salt = 47;
+    std::vector<std::vector<uint8_t>> warm;
+    double warmMs = CompileAll(second, shaders, warm, compileMs);
+    CHECK(g_Compiles == 0);
+    CHECK(second.hits == shaders.size() && second.misses == 0);
+    CHECK(warm == cold);
+    std::printf("cold %.1f ms (%d x %.0f ms compile), warm %.2f ms\n", coldMs, (int)shaders.size(), compileMs, warmMs);
+
+    // Кэш выключен: тот же байткод, всё компилируется
+    ShaderCache off;
+    std::vector<std::vector<uint8_t>> direct;
+    g_Compiles = 0;
+    CompileAll(off, shaders, direct, 0.0);
+    CHECK(direct == cold && g_Compiles == (int)shaders.size());
+    CHECK(off.writes == 0 && off.writeFailures == 0);
+}
+
+static void TestInvalidation(const std::string& dir, const std::vector<ShaderSource>& shaders)
+{
+    ShaderCache cache;
+    cache.directory = dir;
+    cache.salt = 47;
+    std::vector<uint8_t> out;
+    const ShaderSource& s = shaders[0];
+    g_Compiles = 0;
+    Compile(cache, s.code + " ", s.entry, s.target, FLAGS, out, 0.0);
+    Compile(cache, s.code, "vs2", s.target, FLAGS, out, 0.0);
+    Compile(cache, s.code, s.entry, "vs_4_0", FLAGS, out, 0.0);
+    Compile(cache, s.code, s.entry, s.target, FLAGS | 1, out, 0.0);
+    ShaderCache newCompiler;
+    newCompiler.directory = dir;
+    newCompiler.salt = 48;
+    Compile(newCompiler, s.code, s.entry, s.target, FLAGS, out, 0.0);
+    CHECK(g_Compiles == 5);
+    Compile(cache, s.code, s.entry, s.target, FLAGS, out, 0.0);   // исходная запись цела
+    CHECK(g_Compiles == 5);
+
+    // Границы полей входят в ключ
+    CHECK(cache.Key("ab", 2, "c", "d", 0) != cache.Key("a", 1, "bc", "d", 0));
+    CHECK(cache.Key("a", 1, "bc", "d", 0) != cache.Key("a", 1, "b", "cd", 0));
+    CHECK(cache.Key("a", 1, "b", "c", 0) == cache.Key("a", 1, "b", "c", 0));
+}
+
+static void WriteByte(const std::string& path, long offset, uint8_t value)
+{
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fseek(f, offset, SEEK_SET);
+    fputc(value, f);
+    fclose(f);
+}
+
+static void TestCorruption(const std::string& dir, const std::vector<ShaderSource>& shaders, const std::vector<std::vector<uint8_t>>& cold)
+{
+    ShaderCache cache;
+    cache.directory = dir;
+    cache.salt = 47;
+    const ShaderSource& s = shaders[1];
+    uint64_t key = cache.Key(s.code.data(), s.code.size(), s.entry, s.target, FLAGS);
+    std::string path = cache.PathFor(key);
+    std::vector<uint8_t> out;
+    auto healed = [&]()
+    {
+        // Испорченная запись - промах; компиляция перезаписывает файл, следующее чтение - попадание
+        CHECK(!cache.Load(key, out));
+        g_Compiles = 0;
+        CHECK(Compile(cache, s.code, s.entry, s.target, FLAGS, out, 0.0));
+        CHECK(g_Compiles == 1 && out == cold[1]);
+        CHECK(cache.Load(key, out) && out == cold[1]);
+    };
+
+    CHECK(truncate(path.c_str(), (off_t)(sizeof(ShaderCacheHeader) + cold[1].size() - 7)) == 0);
+    healed();
+    FILE* f = fopen(path.c_str(), "ab");
+    fputc('x', f);
+    fclose(f);
+    healed();
+    WriteByte(path, (long)sizeof(ShaderCacheHeader) + 500, (uint8_t)(cold[1][500] ^ 0x55));
+    healed();
+    WriteByte(path, 0, 'X');                      // magic
+    healed();
+    CHECK(truncate(path.c_str(), 10) == 0);       // обрезан заголовок
+    healed();
+    // Файл другого ключа под этим именем
+    const ShaderSource& o = shaders[0];
+    uint64_t otherKey = cache.Key(o.code.data(), o.code.size(), o.entry, o.target, FLAGS);
+    std::vector<uint8_t> other;
+    CHECK(cache.Load(otherKey, other));
+    std::remove(path.c_str());
+    CHECK(std::rename(cache.PathFor(otherKey).c_str(), path.c_str()) == 0);
+    healed();
+    std::printf("corruption: %u damaged loads rejected and rewritten\n", cache.rejected.load());
+    CHECK(cache.rejected == 12);                  // по два чтения на случай: проверка и Compile
+}
+
+// Все пишут и читают одни и те же ключи: каждый проход перезаписывает ключ,
+// публикации идут вперемешку с чтениями
+static int HammerCache(const std::vector<ShaderSource>& shaders, const std::vector<std::vector<uint8_t>>& cold,
+    int threads, int rounds, ShaderCache& cache)
+{
+    std::atomic<int> bad(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]()
+        {
+            for (int r = 0; r < rounds; ++r)
+            {
+                size_t i = (size_t)(r + t) % shaders.size();
+                const ShaderSource& s = shaders[i];
+                std::vector<uint8_t> out;
+                uint64_t key = cache.Key(s.code.data(), s.code.size(), s.entry, s.target, FLAGS);
+                if (cache.Load(key, out)) { if (out != cold[i]) ++bad; }
+                else StubCompile(s.code, s.entry, s.target, FLAGS, out, 0.0);
+                cache.Store(key, out.data(), out.size());
+            }
+        });
+    for (std::thread& w : workers) w.join();
+    return bad;
+}
+
+static void TestConcurrentWriters(const std::string& dir, const std::vector<ShaderSource>& shaders, const std::vector<std::vector<uint8_t>>& cold)
+{
+    // Потоки одного процесса
+    ClearDirectory(dir);
+    {
+        ShaderCache cache;
+        cache.directory = dir;
+        cache.salt = 47;
+        int bad = HammerCache(shaders, cold, 8, 300, cache);
+        std::printf("threads: 8 x 300, hits %u misses %u rejected %u writes %u failures %u\n",
+            cache.hits.load(), cache.misses.load(), cache.rejected.load(), cache.writes.load(), cache.writeFailures.load());
+        CHECK(bad == 0);
+        CHECK(cache.rejected == 0 && cache.writeFailures == 0);
+        CHECK(cache.writes == 8 * 300);
+    }
+    CHECK(CountFiles(dir, ".cso") == (int)shaders.size());
+    CHECK(CountFiles(dir, ".tmp") == 0);
+
+    // Несколько процессов (запущенные разом копии приложения) по 4 потока
+    ClearDirectory(dir);
+    const int processes = 4;
+    std::fflush(stdout);
+    for (int p = 0; p < processes; ++p)
+        if (fork() == 0)
+        {
+            ShaderCache cache;
+            cache.directory = dir;
+            cache.salt = 47;
+            usleep(40000 - p * 10000);            // старт примерно одновременно
+            int bad = HammerCache(shaders, cold, 4, 200, cache);
+            _exit(bad || cache.rejected || cache.writeFailures ? 1 : 0);
+        }
+    int failed = 0;
+    for (int p = 0; p < processes; ++p)
+    {
+        int status = 0;
+        wait(&status);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    std::printf("processes: %d x 4 threads, %d failed, %d entries, %d temp files left\n",
+        processes, failed, CountFiles(dir, ".cso"), CountFiles(dir, ".tmp"));
+    CHECK(failed == 0);
+    CHECK(CountFiles(dir, ".cso") == (int)shaders.size());
+    CHECK(CountFiles(dir, ".tmp") == 0);
+
+    ShaderCache check;
+    check.directory = dir;
+    check.salt = 47;
+    std::vector<std::vector<uint8_t>> loaded;
+    g_Compiles = 0;
+    CompileAll(check, shaders, loaded, 0.0);
+    CHECK(g_Compiles == 0 && loaded == cold);
+}
+
+static void TestUnwritableDirectory(const std::vector<ShaderSource>& shaders, const std::vector<std::vector<uint8_t>>& cold)
+{
+    ShaderCache cache;
+    cache.directory = "/nonexistent-dir/shader-cache/";
+    std::vector<uint8_t> out;
+    CHECK(Compile(cache, shaders[0].code, shaders[0].entry, shaders[0].target, FLAGS, out, 0.0));
+    CHECK(out == cold[0]);
+    CHECK(cache.misses == 1 && cache.writeFailures == 1 && cache.writes == 0);
+}
+
+int main(int argc, char** argv)
+{
+    std::string dir = std::string(argc > 1 ? argv[1] : ".") + "/ShaderCacheTest.cache/";
+    ClearDirectory(dir);
+    std::vector<ShaderSource> shaders = Lab8Shaders();
+    std::vector<std::vector<uint8_t>> cold;
+    TestColdWarm(dir, shaders, cold);
+    TestInvalidation(dir, shaders);
+    TestCorruption(dir, shaders, cold);
+    TestConcurrentWriters(dir, shaders, cold);
+    TestUnwritableDirectory(shaders, cold);
+    ClearDirectory(dir);
+    rmdir(dir.c_str());
+    return TestResult("ShaderCacheTest");
+}
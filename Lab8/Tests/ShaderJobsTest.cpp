@@ -0,0 +1,295 @@
+// Lab8_ShaderJobsTest
+// Параллельная компиляция шейдеров (ShaderJobs.h) на наборе шейдеров Lab8: каждое задание
+// компилируется ровно один раз при любом числе потоков, один поток идёт от длинных исходников
+// к коротким, ошибки остаются у своих заданий (текст ошибки, пустой байткод), Release освобождает
+// все блобы, пустой пакет. Затем отчёт: время пакета и ускорение против числа потоков, порядок
+// "длинные первыми" против порядка добавления.
+// Компилятор для отчёта подключаемый: sleep - заглушка, которая ждёт (как процесс компилятора,
+// не занимая ядро), spin - заглушка, которая считает на ядре, иначе - командная строка внешнего
+// компилятора, вызываемая как <команда> <исходник> <точка входа> <профиль> <байткод>; код возврата
+// не 0 - ошибка, stderr - её текст. Сам тест с --stub-compiler - такой компилятор-заглушка.
+// Время заглушки - 5 мс + 0.012 мс на символ исходника (~120 мс на cullCS, порядок D3DCompile с /O3).
+// Запуск: ShaderJobsTest [sleep | spin | команда = sleep] [рабочий каталог = .]
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../ShaderJobs.h"
+
+struct StubBlob
+{
+    std::vector<uint8_t> bytes;
+    static std::atomic<int> live;
+    StubBlob() { ++live; }
+    ~StubBlob() { --live; }
+};
+std::atomic<int> StubBlob::live(0);
+
+struct StubApi
+{
+    typedef StubBlob Blob;
+    static void Release(StubBlob* blob) { delete blob; }
+};
+typedef ShaderJobBatch<StubApi> Batch;
+
+// Набор Lab8: длины исходников в символах, точки входа и профили как в CompileShaders
+struct ShaderDesc { const char* name; size_t size; const char* entry; const char* target; };
+static const ShaderDesc g_Shaders[] = {
+    { "vs", 700, "main", "vs_5_0" }, { "ps", 3400, "main", "ps_5_0" },
+    { "instancedVS", 2600, "main", "vs_5_0" }, { "instancedPS", 5200, "main", "ps_5_0" },
+    { "skyboxVS", 350, "main", "vs_5_0" }, { "skyboxPS", 300, "main", "ps_5_0" },
+    { "filterVS", 800, "main", "vs_5_0" }, { "filterPS", 500, "main", "ps_5_0" },
+    { "cullCS", 9800, "main", "cs_5_0" }, { "batchArgsCS", 9800, "main", "cs_5_0" },
+    { "scatterCS", 9800, "main", "cs_5_0" }, { "hizCS", 1500, "main", "cs_5_0" } };
+const uint32_t SHADER_COUNT = sizeof(g_Shaders) / sizeof(g_Shaders[0]);
+
+// Исходник - допустимый HLSL: имя, комментарии до нужной длины и пустая точка входа,
+// чтобы внешним компилятором мог быть настоящий
+static std::string ShaderSource(const ShaderDesc& d, bool broken)
+{
+    std::string code = "// " + std::string(d.name) + "\n";
+    while (code.size() + 80 < d.size) code += "// " + std::string(76, '-') + "\n";
+    if (broken) code += "#error broken shader\n";
+    if (d.target[0] == 'v') code += "float4 main(float4 p : POSITION) : SV_Position { return p; }\n";
+    else if (d.target[0] == 'p') code += "float4 main() : SV_Target { return 1; }\n";
+    else code += "[numthreads(64, 1, 1)] void main() {}\n";
+    return code;
+}
+
+static double StubCostMs(size_t size) { return 5.0 + size * 0.012; }
+
+static bool StubFails(const char* code) { return strstr(code, "#error") != nullptr; }
+
+static void Spin(double ms)
+{
+    double end = NowMs() + ms;
+    while (NowMs() < end) {}
+}
+
+// Заглушка в процессе теста: байткод - первые 16 символов исходника. Длина - по строке:
+// в пакете "в порядке добавления" job.size обнулён
+static bool StubCompile(Batch::Job& job, bool spin)
+{
+    size_t size = strlen(job.code);
+    double ms = StubCostMs(size);
+    if (spin) Spin(ms);
+    else std::this_thread::sleep_for(std::chrono::microseconds((long long)(ms * 1000.0)));
+    if (StubFails(job.code))
+    {
+        job.errors = std::string(job.name) + "(1,1): error X1507: broken shader";
+        return false;
+    }
+    job.bytecode = new StubBlob();
+    job.bytecode->bytes.assign(job.code, job.code + (std::min)((size_t)16, size));
+    return true;
+}
+
+static bool ReadFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    data.clear();
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    return true;
+}
+
+static bool WriteFile(const std::string& path, const void* data, size_t size)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+// Внешний компилятор: исходник и байткод через файлы рабочего каталога, по файлу на задание
+static bool ProcessCompile(Batch::Job& job, const std::string& command, const std::string& dir)
+{
+    std::string base = dir + "/shaderjobs_" + job.name, src = base + ".hlsl", out = base + ".bin", err = base + ".txt";
+    std::remove(out.c_str());
+    if (!WriteFile(src, job.code, strlen(job.code))) { job.errors = "cannot write " + src; return false; }
+    std::string line = command + " " + src + " " + job.entry + " " + job.target + " " + out + " 2> " + err;
+    int status = std::system(line.c_str());
+    std::vector<uint8_t> data;
+    if (ReadFile(err, data)) job.errors.assign(data.begin(), data.end());
+    bool ok = status == 0 && ReadFile(out, data) && !data.empty();
+    if (ok)
+    {
+        job.bytecode = new StubBlob();
+        job.bytecode->bytes = data;
+    }
+    std::remove(src.c_str());
+    std::remove(out.c_str());
+    std::remove(err.c_str());
+    return ok;
+}
+
+// --stub-compiler <исходник> <точка входа> <профиль> <байткод>: та же заглушка отдельным процессом
+static int StubCompilerMain(int argc, char** argv)
+{
+    std::vector<uint8_t> code;
+    if (argc < 6 || !ReadFile(argv[2], code)) { std::fprintf(stderr, "usage: --stub-compiler src entry target out\n"); return 2; }
+    code.push_back(0);
+    std::this_thread::sleep_for(std::chrono::microseconds((long long)(StubCostMs(code.size() - 1) * 1000.0)));
+    if (StubFails((const char*)code.data())) { std::fprintf(stderr, "%s(1,1): error X1507: broken shader\n", argv[2]); return 1; }
+    return WriteFile(argv[5], code.data(), (std::min)((size_t)16, code.size() - 1)) ? 0 : 1;
+}
+
+struct ShaderSet
+{
+    std::vector<std::string> sources;
+    explicit ShaderSet(uint32_t brokenMask = 0)
+    {
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i) sources.push_back(ShaderSource(g_Shaders[i], (brokenMask >> i) & 1));
+    }
+    // sizeFirst = false: размеры не передаются, и пакет идёт в порядке добавления
+    void AddTo(Batch& batch, bool sizeFirst = true) const
+    {
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+        {
+            uint32_t job = batch.Add(g_Shaders[i].name, sources[i].c_str(), sources[i].size(), g_Shaders[i].entry, g_Shaders[i].target, 0);
+            if (!sizeFirst) batch.jobs[job].size = 0;
+        }
+    }
+};
+
+static void TestEachJobOnce()
+{
+    ShaderSet set;
+    for (uint32_t threads : { 1u, 3u, 12u, 64u })
+    {
+        Batch batch;
+        set.AddTo(batch);
+        std::atomic<int> calls[SHADER_COUNT];
+        for (std::atomic<int>& c : calls) c = 0;
+        batch.Compile(threads, [&](Batch::Job& job)
+        {
+            ++calls[&job - batch.jobs.data()];
+            job.bytecode = new StubBlob();
+            job.bytecode->bytes.assign(job.code, job.code + 16);
+            return true;
+        });
+        CHECK(batch.threadsUsed == (std::min)(threads, SHADER_COUNT));
+        CHECK(batch.FailedCount() == 0);
+        for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+        {
+            CHECK(calls[i] == 1);
+            CHECK(batch.Bytecode(i) && memcmp(batch.Bytecode(i)->bytes.data(), set.sources[i].c_str(), 16) == 0);
+        }
+        batch.Release();
+        CHECK(StubBlob::live == 0);
+    }
+}
+
+static void TestLongestFirst()
+{
+    ShaderSet set;
+    Batch batch;
+    set.AddTo(batch);
+    std::vector<size_t> sizes;
+    batch.Compile(1, [&sizes](Batch::Job& job) { sizes.push_back(job.size); job.bytecode = new StubBlob(); return true; });
+    CHECK(sizes.size() == SHADER_COUNT);
+    for (size_t i = 1; i < sizes.size(); ++i) CHECK(sizes[i] <= sizes[i - 1]);
+    CHECK(sizes.front() > 9000 && sizes.back() < 400);   // compute-шейдеры отбора первыми, skyboxPS последним
+    batch.Release();
+
+    // Без размеров - порядок добавления (равные размеры не переставляются)
+    Batch fifo;
+    set.AddTo(fifo, false);
+    std::vector<std::string> names;
+    fifo.Compile(1, [&names](Batch::Job& job) { names.push_back(job.name); job.bytecode = new StubBlob(); return true; });
+    for (uint32_t i = 0; i < SHADER_COUNT; ++i) CHECK(names[i] == g_Shaders[i].name);
+    fifo.Release();
+    CHECK(StubBlob::live == 0);
+}
+
+static void TestFailures()
+{
+    // instancedPS и scatterCS сломаны, остальные собираются; успех без байткода - тоже ошибка
+    ShaderSet set((1u << 3) | (1u << 10));
+    Batch batch;
+    set.AddTo(batch);
+    batch.Compile(4, [](Batch::Job& job)
+    {
+        if (strcmp(job.name, "skyboxPS") == 0) return true;
+        return StubCompile(job, false);
+    });
+    CHECK(batch.FailedCount() == 3);
+    for (uint32_t i = 0; i < SHADER_COUNT; ++i)
+    {
+        bool broken = i == 3 || i == 10;
+        CHECK(batch.jobs[i].ok == (!broken && i != 5));
+        CHECK((batch.Bytecode(i) == nullptr) == !batch.jobs[i].ok);
+        CHECK(broken == (batch.jobs[i].errors.find(std::string(g_Shaders[i].name) + "(1,1): error") == 0));
+        CHECK(batch.jobs[i].ms >= (i == 5 ? 0.0 : StubCostMs(set.sources[i].size()) * 0.9));
+    }
+    CHECK(batch.jobs[3].bytecode == nullptr && batch.jobs[5].bytecode == nullptr);
+    batch.Release();
+    CHECK(StubBlob::live == 0);
+    for (const Batch::Job& job : batch.jobs) CHECK(job.bytecode == nullptr);
+    batch.Release();                              // повторный - ничего не делает
+
+    Batch empty;
+    empty.Compile(8, [](Batch::Job&) { return true; });
+    CHECK(empty.threadsUsed == 1 && empty.FailedCount() == 0 && empty.TotalJobMs() == 0.0);
+}
+
+// Отчёт: выбранный компилятор, длинные первыми и в порядке добавления
+static void Report(const std::string& compiler, const std::string& dir)
+{
+    bool spin = compiler == "spin", external = compiler != "sleep" && !spin;
+    auto compile = [&](Batch::Job& job) { return external ? ProcessCompile(job, compiler, dir) : StubCompile(job, spin); };
+    ShaderSet set;
+    double summed = 0.0, longest = 0.0;
+    for (const std::string& s : set.sources) { summed += StubCostMs(s.size()); longest = (std::max)(longest, StubCostMs(s.size())); }
+    std::printf("compiler: %s, %u jobs, stub time %.0f ms summed, longest %.0f ms, %u hardware threads\n",
+        compiler.c_str(), SHADER_COUNT, summed, longest, std::thread::hardware_concurrency());
+    std::printf("threads | longest first: wall ms (speedup) | in order added: wall ms (speedup) | summed job ms\n");
+    double base = 0.0;
+    for (uint32_t threads : { 1u, 2u, 4u, 8u, 12u })
+    {
+        double wall[2] = {}, jobMs = 0.0;
+        for (int order = 0; order < 2; ++order)
+        {
+            Batch batch;
+            set.AddTo(batch, order == 0);
+            batch.Compile(threads, compile);
+            CHECK(batch.FailedCount() == 0);
+            for (const Batch::Job& job : batch.jobs)
+                if (!job.ok) std::printf("  %s failed: %s\n", job.name, job.errors.c_str());
+            wall[order] = batch.wallMs;
+            if (order == 0) jobMs = batch.TotalJobMs();
+            batch.Release();
+        }
+        if (threads == 1) base = wall[0];
+        std::printf("%7u | %14.1f (x%.2f) | %14.1f (x%.2f) | %.1f\n", threads, wall[0], base / wall[0], wall[1], base / wall[1], jobMs);
+        // Ждущая заглушка не упирается в ядра: 4 потока близки к сумме / 4, пакет не короче самого длинного задания
+        if (compiler == "sleep" && threads == 4) CHECK(base / wall[0] > 2.5);
+        if (!external) CHECK(wall[0] >= longest * 0.95);
+    }
+    CHECK(StubBlob::live == 0);
+
+    if (external)
+    {
+        // Ошибки внешнего компилятора тоже остаются у своих заданий
+        ShaderSet broken(1u << 3);
+        Batch batch;
+        broken.AddTo(batch);
+        batch.Compile(4, compile);
+        CHECK(batch.FailedCount() == 1 && !batch.Bytecode(3) && !batch.jobs[3].errors.empty());
+        std::printf("broken instancedPS: %s", batch.jobs[3].errors.c_str());
+        batch.Release();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--stub-compiler") == 0) return StubCompilerMain(argc, argv);
+    TestEachJobOnce();
+    TestLongestFirst();
+    TestFailures();
+    Report(argc > 1 ? argv[1] : "sleep", argc > 2 ? argv[2] : ".");
+    return TestResult("ShaderJobsTest");
+}
@@ -0,0 +1,266 @@
+// Lab8_ShaderPermutationsTest
+// Варианты шейдеров (ShaderPermutations.h) с наборами возможностей из CompileShaders: упаковка ключа
+// (Set/Get не задевают соседние поля, значение зажимается, ключи с неиспользуемыми значениями
+// недопустимы), генерация только достижимых комбинаций, строки #define и описание, выбор по
+// переключателям как в SelectShaderVariants - каждое состояние кадра находит собранный вариант,
+// а каждый собранный вариант кто-то выбирает. Варианты через пакет заданий и дисковый кэш:
+// исходники с определениями различаются, тёплый запуск ничего не компилирует. Нужен POSIX (каталоги).
+// Запуск: ShaderPermutationsTest [рабочий каталог = .]
+#include <set>
+#include <string>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "TestCommon.h"
+#include "../ShaderPermutations.h"
+#include "../ShaderCache.h"
+#include "../ShaderJobs.h"
+#include "../InstanceLights.h"
+
+// Заглушка ID3D11PixelShader: Release только считается
+struct StubPS
+{
+    uint32_t key;
+    int refs;
+    void Release() { --refs; }
+};
+
+struct StubBlob { std::vector<uint8_t> bytes; };
+struct StubBlobApi
+{
+    typedef StubBlob Blob;
+    static void Release(StubBlob* blob) { delete blob; }
+};
+
+// Возможности и корзины - как в Source.cpp
+enum InstancedPSFeature { IPS_NORMAL_MAP, IPS_PER_OBJECT_LIGHTS, IPS_LIGHT_BUCKET, IPS_GRAYSCALE };
+enum LightBucket { LIGHT_BUCKET_NONE, LIGHT_BUCKET_SMALL, LIGHT_BUCKET_ANY, LIGHT_BUCKET_COUNT };
+enum DeferredPSFeature { DPS_LIGHT_BUCKET, DPS_GRAYSCALE };
+enum FilterPSFeature { FPS_GRAYSCALE, FPS_BLOOM };
+
+struct Variants
+{
+    ShaderVariants<StubPS> instancedPS, deferredPS, filterPS;
+
+    Variants()
+    {
+        ShaderPermutations& ips = instancedPS.permutations;
+        CHECK(ips.AddFeature("NORMAL_MAP", 2) == IPS_NORMAL_MAP);
+        CHECK(ips.AddFeature("PER_OBJECT_LIGHTS", 2) == IPS_PER_OBJECT_LIGHTS);
+        CHECK(ips.AddFeature("LIGHT_BUCKET", LIGHT_BUCKET_COUNT) == IPS_LIGHT_BUCKET);
+        CHECK(ips.AddFeature("GRAYSCALE", 2) == IPS_GRAYSCALE);
+        instancedPS.Generate([&ips](uint32_t key)
+        {
+            return !ips.Get(key, IPS_PER_OBJECT_LIGHTS) || ips.Get(key, IPS_LIGHT_BUCKET) == LIGHT_BUCKET_SMALL;
+        });
+        ShaderPermutations& dps = deferredPS.permutations;
+        dps.AddFeature("LIGHT_BUCKET", LIGHT_BUCKET_COUNT);
+        dps.AddFeature("GRAYSCALE", 2);
+        deferredPS.Generate([](uint32_t) { return true; });
+        ShaderPermutations& fps = filterPS.permutations;
+        fps.AddFeature("GRAYSCALE", 2);
+        fps.AddFeature("BLOOM", 2);
+        filterPS.Generate([&fps](uint32_t key) { return fps.Get(key, FPS_GRAYSCALE) || fps.Get(key, FPS_BLOOM); });
+    }
+
+    // Объекты всех сгенерированных вариантов, как после удачного CompileShaders
+    void Build()
+    {
+        for (ShaderVariants<StubPS>* v : { &instancedPS, &deferredPS, &filterPS })
+            for (uint32_t key : v->keys) v->objects[key] = new StubPS{ key, 1 };
+    }
+};
+
+struct FrameToggles
+{
+    bool normalMap, perObjectLights, deferred, filter, fuseGrayscale, bloom;
+    uint32_t maxPerCluster;
+};
+
+struct FrameKeys { uint32_t instanced, deferred, filter; };
+
+// Как SelectShaderVariants
+static FrameKeys SelectKeys(const Variants& v, const FrameToggles& t)
+{
+    const ShaderPermutations& ips = v.instancedPS.permutations;
+    uint32_t bucket = LIGHT_BUCKET_SMALL;
+    if (!t.perObjectLights || t.deferred)
+        bucket = t.maxPerCluster == 0 ? LIGHT_BUCKET_NONE : t.maxPerCluster <= INSTANCE_LIGHT_K ? LIGHT_BUCKET_SMALL : LIGHT_BUCKET_ANY;
+    bool fused = t.filter && t.fuseGrayscale && !t.bloom;
+    FrameKeys k;
+    k.instanced = ips.Set(0, IPS_NORMAL_MAP, t.normalMap ? 1 : 0);
+    k.instanced = ips.Set(k.instanced, IPS_PER_OBJECT_LIGHTS, t.perObjectLights ? 1 : 0);
+    k.instanced = ips.Set(k.instanced, IPS_LIGHT_BUCKET, bucket);
+    k.instanced = ips.Set(k.instanced, IPS_GRAYSCALE, fused ? 1 : 0);
+    const ShaderPermutations& dps = v.deferredPS.permutations;
+    k.deferred = dps.Set(dps.Set(0, DPS_LIGHT_BUCKET, bucket), DPS_GRAYSCALE, fused ? 1 : 0);
+    const ShaderPermutations& fps = v.filterPS.permutations;
+    k.filter = fps.Set(fps.Set(0, FPS_GRAYSCALE, t.filter && !fused ? 1 : 0), FPS_BLOOM, t.bloom ? 1 : 0);
+    return k;
+}
+
+static void TestKeyPacking()
+{
+    Variants v;
+    const ShaderPermutations& ips = v.instancedPS.permutations;
+    CHECK(ips.keyBits == 5 && ips.KeySpace() == 32);
+    CHECK(ips.features[IPS_LIGHT_BUCKET].bits == 2 && ips.features[IPS_LIGHT_BUCKET].shift == 2);
+    std::vector<uint32_t> valid = ips.Enumerate([](uint32_t) { return true; });
+    CHECK(valid.size() == 2 * 2 * 3 * 2);
+    CHECK(v.instancedPS.keys.size() == 16);       // с PER_OBJECT_LIGHTS - только SMALL
+    CHECK(v.deferredPS.keys.size() == 6 && v.filterPS.keys.size() == 3);
+    CHECK(v.instancedPS.objects.size() == 32 && v.instancedPS.BuiltCount() == 0);
+
+    for (uint32_t key : valid)
+        for (uint32_t f = 0; f < (uint32_t)ips.features.size(); ++f)
+            for (uint32_t value = 0; value < ips.features[f].valueCount; ++value)
+            {
+                uint32_t changed = ips.Set(key, f, value);
+                CHECK(ips.Get(changed, f) == value && ips.IsValid(changed));
+                for (uint32_t g = 0; g < (uint32_t)ips.features.size(); ++g)
+                    if (g != f) CHECK(ips.Get(changed, g) == ips.Get(key, g));
+            }
+    CHECK(ips.Get(ips.Set(0, IPS_LIGHT_BUCKET, 7), IPS_LIGHT_BUCKET) == LIGHT_BUCKET_COUNT - 1);   // зажим
+    CHECK(!ips.IsValid(3u << ips.features[IPS_LIGHT_BUCKET].shift));   // значение 3 при трёх корзинах
+    CHECK(!ips.IsValid(ips.KeySpace()));
+    for (uint32_t key : v.instancedPS.keys)
+        CHECK(!ips.Get(key, IPS_PER_OBJECT_LIGHTS) || ips.Get(key, IPS_LIGHT_BUCKET) == LIGHT_BUCKET_SMALL);
+
+    // Возможность без значений в ключе не занимает бит
+    ShaderPermutations single;
+    single.AddFeature("ALWAYS", 1);
+    CHECK(single.keyBits == 0 && single.KeySpace() == 1 && single.Enumerate([](uint32_t) { return true; }).size() == 1);
+    CHECK(single.Defines(0) == "#define ALWAYS 0\n");
+
+    uint32_t key = ips.Set(ips.Set(ips.Set(0, IPS_NORMAL_MAP, 1), IPS_LIGHT_BUCKET, LIGHT_BUCKET_ANY), IPS_GRAYSCALE, 1);
+    CHECK(ips.Defines(key) == "#define NORMAL_MAP 1\n#define PER_OBJECT_LIGHTS 0\n#define LIGHT_BUCKET 2\n#define GRAYSCALE 1\n");
+    CHECK(ips.Describe(key) == "NORMAL_MAP=1 PER_OBJECT_LIGHTS=0 LIGHT_BUCKET=2 GRAYSCALE=1");
+}
+
+static void TestSelection()
+{
+    Variants v;
+    v.Build();
+    CHECK(v.instancedPS.BuiltCount() == 16);
+    std::set<uint32_t> instancedHit, deferredHit, filterHit;
+    int states = 0, filterPassCulled = 0;
+    for (int mask = 0; mask < 64; ++mask)
+        for (uint32_t maxPerCluster : { 0u, 1u, INSTANCE_LIGHT_K, INSTANCE_LIGHT_K + 1, 40u })
+        {
+            FrameToggles t = { (mask & 1) != 0, (mask & 2) != 0, (mask & 4) != 0, (mask & 8) != 0, (mask & 16) != 0, (mask & 32) != 0, maxPerCluster };
+            FrameKeys k = SelectKeys(v, t);
+            ++states;
+            // В отложенном режиме проход экземпляров берёт gbufferPS, instancedPS не выбирается
+            if (!t.deferred)
+            {
+                StubPS* ps = v.instancedPS.Select(k.instanced);
+                CHECK(ps && ps->key == k.instanced);
+                instancedHit.insert(k.instanced);
+            }
+            else
+            {
+                StubPS* ps = v.deferredPS.Select(k.deferred);
+                CHECK(ps && ps->key == k.deferred);
+                deferredHit.insert(k.deferred);
+            }
+            // Без серого и свечения варианта фильтра нет - проход отсекается графом
+            StubPS* filter = v.filterPS.Select(k.filter);
+            bool filterPass = (t.filter && !(t.fuseGrayscale && !t.bloom)) || t.bloom;
+            CHECK((filter != nullptr) == filterPass);
+            if (filter) filterHit.insert(k.filter);
+            else ++filterPassCulled;
+        }
+    std::printf("%d frame states: instancedPS %zu of %zu variants, deferredPS %zu of %zu, filterPS %zu of %zu (%d states without filter pass)\n",
+        states, instancedHit.size(), v.instancedPS.keys.size(), deferredHit.size(), v.deferredPS.keys.size(),
+        filterHit.size(), v.filterPS.keys.size(), filterPassCulled);
+    // Ни одного лишнего варианта: каждый собранный выбирается хотя бы одним состоянием
+    CHECK(instancedHit.size() == v.instancedPS.keys.size());
+    CHECK(deferredHit.size() == v.deferredPS.keys.size());
+    CHECK(filterHit.size() == v.filterPS.keys.size());
+    CHECK(v.instancedPS.Select(v.instancedPS.permutations.KeySpace()) == nullptr);
+
+    // Несобранный вариант (ошибка компиляции) выбирается как nullptr, остальные не страдают
+    StubPS* failed = v.instancedPS.objects[v.instancedPS.keys[3]];
+    v.instancedPS.objects[v.instancedPS.keys[3]] = nullptr;
+    CHECK(v.instancedPS.Select(v.instancedPS.keys[3]) == nullptr && v.instancedPS.Select(v.instancedPS.keys[4]) != nullptr);
+    CHECK(v.instancedPS.BuiltCount() == 15);
+    delete failed;
+
+    std::vector<StubPS*> objects;
+    for (ShaderVariants<StubPS>* sv : { &v.instancedPS, &v.deferredPS, &v.filterPS })
+        for (StubPS* o : sv->objects) if (o) objects.push_back(o);
+    v.instancedPS.Release();
+    v.deferredPS.Release();
+    v.filterPS.Release();
+    for (StubPS* o : objects) { CHECK(o->refs == 0); delete o; }
+    CHECK(v.instancedPS.BuiltCount() == 0 && v.instancedPS.objects.size() == 32);
+}
+
+static void ClearDirectory(const std::string& dir)
+{
+    mkdir(dir.c_str(), 0755);
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (dirent* e = readdir(d))
+        if (e->d_name[0] != '.') std::remove((dir + e->d_name).c_str());
+    closedir(d);
+}
+
+// Как addVariants + CompileCached: определения в начале исходника, байткод - из кэша или заглушки
+static void TestCompileVariants(const std::string& dir)
+{
+    Variants v;
+    std::string cacheDir = dir + "/permutation_cache/";
+    ClearDirectory(cacheDir);                     // холодный запуск - с пустым кэшем
+    std::string body(6000, ' ');
+    for (int run = 0; run < 2; ++run)
+    {
+        ShaderCache cache;
+        cache.directory = cacheDir;
+        cache.salt = 46;
+        ShaderJobBatch<StubBlobApi> batch;
+        std::vector<std::string> sources, names;
+        sources.reserve(v.instancedPS.keys.size());
+        names.reserve(v.instancedPS.keys.size());
+        for (uint32_t key : v.instancedPS.keys)
+        {
+            sources.push_back(v.instancedPS.permutations.Defines(key) + body);
+            names.push_back("instancedPS[" + v.instancedPS.permutations.Describe(key) + "]");
+            batch.Add(names.back().c_str(), sources.back().c_str(), sources.back().size(), "ps", "ps_5_0", 0);
+        }
+        std::atomic<int> compiles(0);
+        batch.Compile(4, [&](ShaderJobBatch<StubBlobApi>::Job& job)
+        {
+            uint64_t key = cache.Key(job.code, job.size, job.entry, job.target, job.flags);
+            std::vector<uint8_t> bytes;
+            if (!cache.Load(key, bytes))
+            {
+                ++compiles;
+                bytes.assign(job.code, job.code + 96);   // определения попадают в байткод заглушки
+                cache.Store(key, bytes.data(), bytes.size());
+            }
+            job.bytecode = new StubBlob{ bytes };
+            return true;
+        });
+        std::set<std::vector<uint8_t>> distinct;
+        for (uint32_t i = 0; i < batch.jobs.size(); ++i)
+        {
+            CHECK(batch.Bytecode(i) != nullptr);
+            if (batch.Bytecode(i)) distinct.insert(batch.Bytecode(i)->bytes);
+        }
+        std::printf("%s run: %zu variants, %d compiled, %u cache hits, %u written, %zu distinct bytecodes\n",
+            run ? "warm" : "cold", batch.jobs.size(), compiles.load(), cache.hits.load(), cache.writes.load(), distinct.size());
+        CHECK(distinct.size() == v.instancedPS.keys.size());
+        if (run == 0) CHECK(compiles == 16 && cache.writes == 16);
+        else CHECK(compiles == 0 && cache.hits == 16);
+        batch.Release();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    TestKeyPacking();
+    TestSelection();
+    TestCompileVariants(argc > 1 ? argv[1] : ".");
+    return TestResult("ShaderPermutationsTest");
+}
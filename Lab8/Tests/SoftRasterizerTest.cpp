@@ -0,0 +1,198 @@
+// Lab8_SoftRasterizerTest
+// Программный растеризатор (SoftRasterizer.h): видна ближняя грань куба (задние отброшены), камера
+// внутри куба и пол, уходящий за камеру, - отсечение по ближней плоскости без потери глубины,
+// декодирование блока BC1, одинаковые пиксели на 1 и 4 потоках, пустой кадр - только skybox,
+// фильтр серого и TGA, прочитанный обратно, совпадает с буфером цвета.
+#include <string>
+#include "SoftScene.h"
+
+const uint32_t W = 320, H = 180;
+
+static SwScene SingleCube(const Float4x4& model)
+{
+    SwScene s;
+    BuildLab8Scene(s, nullptr, 2);
+    SwMeshRange cube = { 0, 36, 0 };
+    s.instances.resize(1);
+    SetInstance(s.instances[0], model, cube);
+    return s;
+}
+
+// Глубина точки мира после деления на w
+static float ProjectedDepth(const Float4x4& vp, const Float3& p)
+{
+    Float4 c = TransformPoint(vp, p);
+    return c.z / c.w;
+}
+
+static void TestCullOrientation()
+{
+    SoftRasterizer r;
+    r.Resize(W, H);
+    SwScene s = SingleCube(Translation(0.0f, 0.0f, 0.0f));
+    SetCamera(s, MakeFloat3(0.0f, 0.0f, -3.0f), MakeFloat3(0.0f, 0.0f, 0.0f), (float)W / H);
+    r.Render(s);
+    CHECK(r.CoveredAt(W / 2, H / 2));
+    CHECK_NEAR(r.DepthAt(W / 2, H / 2), ProjectedDepth(s.viewProj, MakeFloat3(0.0f, 0.0f, -0.5f)), 1e-4);
+    CHECK(r.stats.triangles == 12);
+    CHECK(r.stats.rasterTriangles <= 6);          // к камере повёрнута одна грань, остальные - ребром или спиной
+    CHECK(!r.CoveredAt(0, 0));
+
+    // Камера внутри куба: ближняя грань за камерой, дальняя видна изнутри, но это её задняя сторона
+    SetCamera(s, MakeFloat3(0.0f, 0.0f, -0.45f), MakeFloat3(0.0f, 0.0f, 1.0f), (float)W / H);
+    r.Render(s);
+    CHECK(!r.CoveredAt(W / 2, H / 2));
+}
+
+static void TestNearClipFloor()
+{
+    // Пол 40x40 на y = -1 под камерой уходит за неё: треугольники режутся ближней плоскостью,
+    // глубина пикселя - пересечение луча с плоскостью пола
+    SoftRasterizer r;
+    r.Resize(W, H);
+    Float4x4 model = { { { 40, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 40, 0 }, { 0, -1.5f, 0, 1 } } };
+    SwScene s = SingleCube(model);
+    SetCamera(s, MakeFloat3(0.0f, 0.0f, 0.0f), MakeFloat3(0.0f, -0.3f, 1.0f), (float)W / H);
+    r.Render(s);
+    Float4x4 inv = Inverse(s.viewProj);
+    double maxErr = 0.0;
+    int hits = 0, mismatches = 0;
+    for (uint32_t y = H / 2; y < H; y += 4)
+        for (uint32_t x = 0; x < W; x += 4)
+        {
+            float nx = (x + 0.5f) / W * 2.0f - 1.0f, ny = 1.0f - (y + 0.5f) / H * 2.0f;
+            Float4 a = TransformPoint(inv, MakeFloat3(nx, ny, 0.0f)), b = TransformPoint(inv, MakeFloat3(nx, ny, 1.0f));
+            Float3 pa = MakeFloat3(a.x / a.w, a.y / a.w, a.z / a.w), pb = MakeFloat3(b.x / b.w, b.y / b.w, b.z / b.w);
+            float t = (-1.0f - pa.y) / (pb.y - pa.y);
+            if (t < 0.0f || t > 1.0f) { mismatches += r.CoveredAt(x, y); continue; }
+            if (!r.CoveredAt(x, y)) { ++mismatches; continue; }
+            ++hits;
+            Float3 hit = Add(pa, Scale(Sub(pb, pa), t));
+            maxErr = (std::max)(maxErr, (double)fabsf(r.DepthAt(x, y) - ProjectedDepth(s.viewProj, hit)));
+        }
+    std::printf("near clip floor: %d hits, %d mismatches, max depth error %.2e\n", hits, mismatches, maxErr);
+    CHECK(hits > 100);
+    CHECK(mismatches == 0);
+    CHECK(maxErr < 1e-4);
+}
+
+static void TestBC1()
+{
+    // c0 = 0xF800 (красный), c1 = 0x001F (синий), индексы 0, 1, 2, 3 в каждой строке
+    const uint8_t block[8] = { 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 };
+    SwTexture t;
+    DecodeBlockCompressed(block, 4, 4, SW_BC1, t);
+    CHECK(t.width == 4 && t.height == 4 && t.texels.size() == 16);
+    CHECK(t.texels[0] == 0xFF0000FF);
+    CHECK(t.texels[1] == 0xFFFF0000);
+    uint32_t third = t.texels[2], twoThirds = t.texels[3];
+    CHECK((third & 0xFF) > 0xA0 && ((third >> 16) & 0xFF) < 0x60);       // 2/3 c0 + 1/3 c1
+    CHECK((twoThirds & 0xFF) < 0x60 && ((twoThirds >> 16) & 0xFF) > 0xA0);
+    for (int y = 1; y < 4; ++y)
+        for (int x = 0; x < 4; ++x) CHECK(t.texels[y * 4 + x] == t.texels[x]);
+}
+
+static void TestThreadsDeterministic()
+{
+    SwScene s;
+    BuildLab8Scene(s, nullptr, 512);
+    SetCamera(s, MakeFloat3(2.7f, 2.1f, 6.4f), MakeFloat3(0.0f, 0.0f, 0.0f), (float)W / H);
+    SoftRasterizer r;
+    r.Resize(W, H);
+    r.threadCount = 1;
+    r.Render(s);
+    std::vector<uint32_t> reference = r.color;
+    uint32_t binEntries = r.stats.binEntries;
+    for (uint32_t threads : { 2u, 3u, 4u, 7u })
+    {
+        r.threadCount = threads;
+        r.Render(s);
+        size_t differ = 0;
+        for (size_t i = 0; i < reference.size(); ++i) differ += reference[i] != r.color[i];
+        CHECK(differ == 0);
+        CHECK(r.stats.binEntries == binEntries);
+    }
+}
+
+static void TestSkyAndGrayscale()
+{
+    SwScene s;
+    BuildLab8Scene(s, nullptr, 2);
+    SetCamera(s, MakeFloat3(0.0f, 0.0f, -7.0f), MakeFloat3(0.0f, 0.0f, 0.0f), (float)W / H);
+    SoftRasterizer r;
+    r.Resize(W, H);
+
+    // Без экземпляров: ни одного треугольника, каждый пиксель - skybox с глубиной 1
+    s.instances.clear();
+    s.grayscale = false;
+    r.Render(s);
+    CHECK(r.stats.triangles == 0 && r.stats.binEntries == 0);
+    int colored = 0;
+    for (uint32_t y = 0; y < H; y += 8)
+        for (uint32_t x = 0; x < W; x += 8)
+        {
+            CHECK(!r.CoveredAt(x, y) && r.DepthAt(x, y) == 1.0f);
+            uint32_t c = r.color[(size_t)y * W + x];
+            colored += (c & 0xFF) != ((c >> 8) & 0xFF) || (c & 0xFF) != ((c >> 16) & 0xFF);
+        }
+    CHECK(colored > 0);                           // грань +Z голубая
+
+    BuildLab8Scene(s, nullptr, 64);
+    SetCamera(s, MakeFloat3(0.0f, 0.0f, -7.0f), MakeFloat3(0.0f, 0.0f, 0.0f), (float)W / H);
+    s.grayscale = true;
+    r.Render(s);
+    int gray = 0;
+    for (uint32_t c : r.color)
+    {
+        uint32_t red = c & 0xFF, green = (c >> 8) & 0xFF, blue = (c >> 16) & 0xFF;
+        gray += red == green && green == blue;
+        CHECK((c >> 24) == 0xFF);
+    }
+    CHECK(gray == (int)r.color.size());
+}
+
+static void TestWriteTGA(const std::string& path)
+{
+    SwScene s;
+    BuildLab8Scene(s, nullptr, 64);
+    SetCamera(s, MakeFloat3(4.0f, 1.0f, -5.0f), MakeFloat3(0.0f, 0.0f, 0.0f), (float)W / H);
+    s.grayscale = false;
+    SoftRasterizer r;
+    r.Resize(W - 3, H - 1);                       // ширина не кратна 4: строка файла без выравнивания
+    r.Render(s);
+    CHECK(r.WriteTGA(path.c_str()));
+
+    FILE* f = fopen(path.c_str(), "rb");
+    CHECK(f != nullptr);
+    if (!f) return;
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    remove(path.c_str());
+    CHECK(data.size() == 18 + (size_t)r.width * r.height * 4);
+    if (data.size() != 18 + (size_t)r.width * r.height * 4) return;
+    CHECK(data[2] == 2 && data[16] == 32 && data[17] == 0x28);
+    CHECK(data[12] + data[13] * 256u == r.width && data[14] + data[15] * 256u == r.height);
+    size_t differ = 0;
+    for (size_t i = 0; i < r.color.size(); ++i)
+    {
+        const uint8_t* p = &data[18 + i * 4];    // BGRA
+        uint32_t c = p[2] | (p[1] << 8) | (p[0] << 16) | ((uint32_t)p[3] << 24);
+        differ += c != r.color[i];
+    }
+    CHECK(differ == 0);
+    CHECK(!r.WriteTGA("/nonexistent-dir/frame.tga"));
+}
+
+int main(int argc, char** argv)
+{
+    TestCullOrientation();
+    TestNearClipFloor();
+    TestBC1();
+    TestThreadsDeterministic();
+    TestSkyAndGrayscale();
+    TestWriteTGA(std::string(argc > 1 ? argv[1] : ".") + "/SoftRasterizerTest.tga");
+    return TestResult("SoftRasterizerTest");
+}
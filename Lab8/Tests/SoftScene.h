@@ -0,0 +1,201 @@
+// Lab8_SoftScene
+// Сцена для программного растеризатора (SoftRasterizer.h) без D3D: куб и сфера с той же раскладкой
+// и обходом, что CreateCubeResources / AppendSphereLod в Source.cpp, клетчатые текстуры-заглушки,
+// чтение DDS (BC1-BC3, mip 0) из Lab8/Textures и экземпляры по спирали вокруг начала координат.
+#pragma once
+#include <string>
+#include <cstdlib>
+#include "TestCommon.h"
+#include "../SoftRasterizer.h"
+
+inline Float4x4 Translation(float x, float y, float z)
+{
+    Float4x4 m = { { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { x, y, z, 1 } } };
+    return m;
+}
+
+inline Float4x4 Transpose(const Float4x4& a)
+{
+    Float4x4 r;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            r.m[i][j] = a.m[j][i];
+    return r;
+}
+
+struct SwMeshRange
+{
+    uint32_t startIndex, indexCount;
+    int32_t baseVertex;
+};
+
+// Куб 1x1x1, по 4 вершины на грань, лицевые - по часовой стрелке
+inline SwMeshRange AppendCube(SwScene& s)
+{
+    static const float P[24][11] = {
+        { -.5f, -.5f, -.5f, 0, 0, -1, 1, 0, 0, 0, 1 }, { .5f, -.5f, -.5f, 0, 0, -1, 1, 0, 0, 1, 1 },
+        { .5f, .5f, -.5f, 0, 0, -1, 1, 0, 0, 1, 0 }, { -.5f, .5f, -.5f, 0, 0, -1, 1, 0, 0, 0, 0 },
+        { -.5f, -.5f, .5f, 0, 0, 1, 1, 0, 0, 0, 1 }, { .5f, -.5f, .5f, 0, 0, 1, 1, 0, 0, 1, 1 },
+        { .5f, .5f, .5f, 0, 0, 1, 1, 0, 0, 1, 0 }, { -.5f, .5f, .5f, 0, 0, 1, 1, 0, 0, 0, 0 },
+        { -.5f, -.5f, .5f, -1, 0, 0, 0, 0, 1, 0, 1 }, { -.5f, -.5f, -.5f, -1, 0, 0, 0, 0, 1, 1, 1 },
+        { -.5f, .5f, -.5f, -1, 0, 0, 0, 0, 1, 1, 0 }, { -.5f, .5f, .5f, -1, 0, 0, 0, 0, 1, 0, 0 },
+        { .5f, -.5f, -.5f, 1, 0, 0, 0, 0, 1, 0, 1 }, { .5f, -.5f, .5f, 1, 0, 0, 0, 0, 1, 1, 1 },
+        { .5f, .5f, .5f, 1, 0, 0, 0, 0, 1, 1, 0 }, { .5f, .5f, -.5f, 1, 0, 0, 0, 0, 1, 0, 0 },
+        { -.5f, .5f, -.5f, 0, 1, 0, 1, 0, 0, 0, 1 }, { .5f, .5f, -.5f, 0, 1, 0, 1, 0, 0, 1, 1 },
+        { .5f, .5f, .5f, 0, 1, 0, 1, 0, 0, 1, 0 }, { -.5f, .5f, .5f, 0, 1, 0, 1, 0, 0, 0, 0 },
+        { -.5f, -.5f, .5f, 0, -1, 0, 1, 0, 0, 0, 1 }, { .5f, -.5f, .5f, 0, -1, 0, 1, 0, 0, 1, 1 },
+        { .5f, -.5f, -.5f, 0, -1, 0, 1, 0, 0, 1, 0 }, { -.5f, -.5f, -.5f, 0, -1, 0, 1, 0, 0, 0, 0 } };
+    static const uint16_t I[36] = {
+         0,  2,  1,  0,  3,  2,  4,  5,  6,  4,  6,  7,  8, 10,  9,  8, 11, 10,
+        12, 14, 13, 12, 15, 14, 16, 18, 17, 16, 19, 18, 20, 22, 21, 20, 23, 22 };
+    SwMeshRange r = { (uint32_t)s.indices.size(), 36, (int32_t)s.vertices.size() };
+    for (const float* p : P)
+    {
+        SwVertex v = { { p[0], p[1], p[2] }, { p[3], p[4], p[5] }, { p[6], p[7], p[8] }, p[9], p[10] };
+        s.vertices.push_back(v);
+    }
+    s.indices.insert(s.indices.end(), I, I + 36);
+    return r;
+}
+
+// Сфера радиуса 0.5: (stacks + 1) x (slices + 1) вершин
+inline SwMeshRange AppendSphere(SwScene& s, uint32_t slices, uint32_t stacks)
+{
+    SwMeshRange r = { (uint32_t)s.indices.size(), 0, (int32_t)s.vertices.size() };
+    const float pi = 3.14159265f;
+    for (uint32_t i = 0; i <= stacks; ++i)
+    {
+        float theta = pi * i / stacks;
+        for (uint32_t j = 0; j <= slices; ++j)
+        {
+            float phi = 2.0f * pi * j / slices;
+            Float3 n = MakeFloat3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            SwVertex v = { Scale(n, 0.5f), n, MakeFloat3(-sinf(phi), 0.0f, cosf(phi)), (float)j / slices, (float)i / stacks };
+            s.vertices.push_back(v);
+        }
+    }
+    for (uint32_t i = 0; i < stacks; ++i)
+        for (uint32_t j = 0; j < slices; ++j)
+        {
+            uint16_t a = (uint16_t)(i * (slices + 1) + j), b = (uint16_t)(a + 1);
+            uint16_t c = (uint16_t)(a + slices + 1), d = (uint16_t)(c + 1);
+            uint16_t quad[6] = { a, b, d, a, d, c };
+            s.indices.insert(s.indices.end(), quad, quad + 6);
+        }
+    r.indexCount = (uint32_t)s.indices.size() - r.startIndex;
+    return r;
+}
+
+inline SwTexture CheckerTexture(uint32_t c0, uint32_t c1, uint32_t size = 256, uint32_t cell = 32)
+{
+    SwTexture t;
+    t.width = t.height = size;
+    t.texels.resize((size_t)size * size);
+    for (uint32_t y = 0; y < size; ++y)
+        for (uint32_t x = 0; x < size; ++x)
+            t.texels[(size_t)y * size + x] = ((x / cell + y / cell) & 1) ? c0 : c1;
+    return t;
+}
+
+// DDS с BC1/BC2/BC3 (DXT1/DXT3/DXT5); mip 0, без расширенного заголовка DX10
+inline bool LoadDDS(const std::string& path, SwTexture& out)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    if (data.size() < 128 || memcmp(data.data(), "DDS ", 4) != 0) return false;
+    uint32_t height, width, fourCC;
+    memcpy(&height, &data[12], 4);
+    memcpy(&width, &data[16], 4);
+    memcpy(&fourCC, &data[84], 4);
+    SwBlockFormat format;
+    if (fourCC == 0x31545844) format = SW_BC1;          // "DXT1"
+    else if (fourCC == 0x33545844) format = SW_BC2;     // "DXT3"
+    else if (fourCC == 0x35545844) format = SW_BC3;     // "DXT5"
+    else return false;
+    size_t blockBytes = format == SW_BC1 ? 8 : 16;
+    if (data.size() < 128 + (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes) return false;
+    DecodeBlockCompressed(&data[128], width, height, format, out);
+    return true;
+}
+
+inline void SetInstance(SwInstance& in, const Float4x4& model, const SwMeshRange& mesh)
+{
+    in.model = model;
+    in.normal = Transpose(Inverse(model));
+    in.startIndex = mesh.startIndex;
+    in.indexCount = mesh.indexCount;
+    in.baseVertex = mesh.baseVertex;
+}
+
+// Камера как в Source.cpp: fov 60, near 0.1, far 100; skybox - view без переноса
+inline void SetCamera(SwScene& s, const Float3& eye, const Float3& at, float aspect)
+{
+    Float4x4 view = LookAtLH(eye, at, MakeFloat3(0.0f, 1.0f, 0.0f));
+    Float4x4 proj = PerspectiveFovLH(3.14159265f / 3.0f, aspect, 0.1f, 100.0f);
+    s.viewProj = Mul(view, proj);
+    Float4x4 viewSky = view;
+    viewSky.m[3][0] = viewSky.m[3][1] = viewSky.m[3][2] = 0.0f;
+    s.vpSky = Mul(viewSky, proj);
+    s.cameraPos = eye;
+}
+
+// Сцена Lab8: 20 экземпляров (кубы и сферы через пару) на золотой спирали, два ярких источника
+// и lightCount - 2 слабых случайных. Без textureDir - клетчатые заглушки вместо DDS
+inline bool BuildLab8Scene(SwScene& s, const char* textureDir, uint32_t lightCount = 2048)
+{
+    s = SwScene();
+    SwMeshRange cube = AppendCube(s);
+    SwMeshRange sphere = AppendSphere(s, 32, 16);
+
+    bool loaded = true;
+    s.textures.resize(2);
+    const char* faceNames[6] = { "posx", "negx", "posy", "negy", "posz", "negz" };
+    if (textureDir)
+    {
+        std::string dir = std::string(textureDir) + "/";
+        loaded = LoadDDS(dir + "brick.dds", s.textures[0]) && LoadDDS(dir + "Kitty.dds", s.textures[1]) &&
+            LoadDDS(dir + "brick_normal.dds", s.normalMap);
+        for (int f = 0; f < 6 && loaded; ++f)
+            loaded = LoadDDS(dir + "Skybox/" + faceNames[f] + ".dds", s.skybox.faces[f]);
+    }
+    if (!textureDir || !loaded)
+    {
+        s.textures[0] = CheckerTexture(0xFF2040C0, 0xFFE0E0E0);
+        s.textures[1] = CheckerTexture(0xFF20A020, 0xFF303030);
+        s.normalMap = CheckerTexture(0xFFFF8080, 0xFF8080FF);
+        const uint32_t faceColors[6] = { 0xFF4080FF, 0xFF204080, 0xFFFFC080, 0xFF404040, 0xFF80FF80, 0xFF80FFFF };
+        for (int f = 0; f < 6; ++f) s.skybox.faces[f] = CheckerTexture(faceColors[f], 0xFF808080, 64);
+    }
+
+    PointLight red = { { 0.0f, 2.0f, 0.0f }, 12.0f, { 1.0f, 0.0f, 0.0f }, 0.0f };
+    PointLight blue = { { 0.0f, 2.0f, 2.5f }, 12.0f, { 0.6f, 0.8f, 1.0f }, 0.0f };
+    s.lights.push_back(red);
+    s.lights.push_back(blue);
+    srand(1);
+    for (uint32_t i = 2; i < lightCount; ++i)
+    {
+        PointLight l;
+        l.pos = MakeFloat3((rand() % 1000) / 125.0f - 4.0f, (rand() % 1000) / 125.0f - 4.0f, (rand() % 1000) / 125.0f - 4.0f);
+        l.radius = 0.5f + (rand() % 100) / 100.0f;
+        l.color = MakeFloat3((rand() % 100) / 400.0f, (rand() % 100) / 400.0f, (rand() % 100) / 400.0f);
+        l.padding = 0.0f;
+        s.lights.push_back(l);
+    }
+
+    const float pi = 3.14159265f, goldenAngle = pi * (3.0f - sqrtf(5.0f));
+    for (int i = 0; i < 20; ++i)
+    {
+        float y = 1.0f - (i / 19.0f) * 2.0f, r = sqrtf(1.0f - y * y), theta = i * goldenAngle * 2.0f * pi;
+        SwInstance in;
+        SetInstance(in, Translation(cosf(theta) * r * 3.0f, y * 3.0f, sinf(theta) * r * 3.0f), (i / 2) % 2 == 0 ? cube : sphere);
+        in.texture = i % 2;
+        in.normalMap = i % 2 == 0;
+        s.instances.push_back(in);
+    }
+    return loaded;
+}
@@ -0,0 +1,145 @@
+// Lab8_StreamCompactionTest
+// Все варианты компактизации (StreamCompaction.h) против последовательного эталона:
+// частичные группы, пустой вход, всё отсечено, COMPACTION_MAX_BUCKETS корзин, 1..8 потоков.
+// Пул DispatchGroups: потоки переживают диспатчи, вложенные и параллельные вызовы выполняются целиком,
+// и замер диспатча с пустой работой против создания потоков на каждый вызов.
+#include <vector>
+#include <set>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "TestCommon.h"
+#include "../StreamCompaction.h"
+
+static bool SameResult(const CompactionResult& a, const CompactionResult& b)
+{
+    return a.bucketStart == b.bucketStart && a.bucketCount == b.bucketCount && a.ids == b.ids;
+}
+
+// Порядок ID внутри корзины у PerItemAtomic/PerGroupAtomic не задан: сравниваются множества
+static bool SameSets(const CompactionResult& a, const CompactionResult& b)
+{
+    if (a.bucketStart != b.bucketStart || a.bucketCount != b.bucketCount || a.ids.size() != b.ids.size()) return false;
+    for (size_t k = 0; k < a.bucketCount.size(); ++k)
+    {
+        std::multiset<uint32_t> sa(a.ids.begin() + a.bucketStart[k], a.ids.begin() + a.bucketStart[k] + a.bucketCount[k]);
+        std::multiset<uint32_t> sb(b.ids.begin() + b.bucketStart[k], b.ids.begin() + b.bucketStart[k] + b.bucketCount[k]);
+        if (sa != sb) return false;
+    }
+    return true;
+}
+
+static void TestCompaction(uint32_t count, uint32_t bucketCount, float culledFraction, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    std::vector<uint32_t> buckets(count);
+    for (uint32_t& b : buckets) b = u(rng) < culledFraction ? COMPACTION_CULLED : rng() % bucketCount;
+
+    CompactionResult serial;
+    CompactSerial(buckets.data(), count, bucketCount, serial);
+    uint32_t visible = 0;
+    for (uint32_t b : buckets) visible += b != COMPACTION_CULLED;
+    CHECK(serial.ids.size() == visible);
+    for (uint32_t k = 0; k < bucketCount; ++k)
+        for (uint32_t i = 1; i < serial.bucketCount[k]; ++i)
+            CHECK(serial.ids[serial.bucketStart[k] + i - 1] < serial.ids[serial.bucketStart[k] + i]);
+
+    for (uint32_t threads = 1; threads <= 8; threads *= 2)
+    {
+        CompactionResult r;
+        std::vector<uint32_t> groupOffsets;
+        CompactOrdered(buckets.data(), count, bucketCount, threads, r, groupOffsets);
+        CHECK(SameResult(r, serial));
+        CompactPerGroupAtomic(buckets.data(), count, bucketCount, threads, r);
+        CHECK(SameSets(r, serial));
+        CompactPerItemAtomic(buckets.data(), count, bucketCount, threads, r);
+        CHECK(SameSets(r, serial));
+    }
+}
+
+static void TestGroupScan()
+{
+    uint32_t buckets[100];
+    for (uint32_t i = 0; i < 100; ++i) buckets[i] = (i % 3 == 0) ? COMPACTION_CULLED : i % 5;
+    uint32_t rank[COMPACTION_GROUP_SIZE], totals[COMPACTION_MAX_BUCKETS];
+    GroupScan(buckets, 100, 1, rank, totals, 5);   // вторая группа: ID 64..99
+    uint32_t expected[5] = {};
+    for (uint32_t i = 64; i < 100; ++i)
+    {
+        if (buckets[i] == COMPACTION_CULLED) continue;
+        CHECK(rank[i - 64] == expected[buckets[i]]);
+        ++expected[buckets[i]];
+    }
+    for (uint32_t b = 0; b < 5; ++b) CHECK(totals[b] == expected[b]);
+}
+
+static void TestPool()
+{
+    GroupWorkerPool& pool = GroupWorkerPool::Instance();
+    DispatchGroups(4, 4, [](uint32_t) {});
+    uint32_t workers = pool.WorkerCount();   // не меньше 3, больше - если раньше просили больше потоков
+
+    // Каждая группа - ровно один раз, потоки пула одни и те же во всех диспатчах
+    std::mutex idsMutex;
+    std::set<std::thread::id> ids;
+    for (int d = 0; d < 500; ++d)
+    {
+        std::vector<std::atomic<uint32_t>> hits(37);
+        for (auto& h : hits) h.store(0);
+        DispatchGroups(37, 4, [&](uint32_t g)
+        {
+            hits[g].fetch_add(1);
+            std::lock_guard<std::mutex> lock(idsMutex);
+            ids.insert(std::this_thread::get_id());
+        });
+        for (auto& h : hits) CHECK(h.load() == 1);
+    }
+    CHECK(workers >= 3 && pool.WorkerCount() == workers);
+    CHECK(ids.size() <= workers + 1);
+
+    // Вложенный диспатч выполняется на вызывающем потоке
+    std::atomic<uint32_t> nested(0);
+    DispatchGroups(4, 4, [&](uint32_t) { DispatchGroups(8, 4, [&](uint32_t) { nested.fetch_add(1); }); });
+    CHECK(nested.load() == 32);
+
+    // Диспатчи из нескольких потоков сразу: один идёт в пул, остальные - на своих потоках
+    std::atomic<uint32_t> total(0);
+    std::vector<std::thread> callers;
+    for (int c = 0; c < 4; ++c)
+        callers.emplace_back([&]() { for (int d = 0; d < 200; ++d) DispatchGroups(16, 4, [&](uint32_t) { total.fetch_add(1); }); });
+    for (std::thread& t : callers) t.join();
+    CHECK(total.load() == 4u * 200u * 16u);
+
+    // Стоимость самого диспатча: пул против потоков на каждый вызов
+    const int dispatches = 2000;
+    std::atomic<uint32_t> sink(0);
+    double t0 = NowMs();
+    for (int d = 0; d < dispatches; ++d) DispatchGroups(16, 4, [&](uint32_t g) { sink.fetch_add(g); });
+    double t1 = NowMs();
+    for (int d = 0; d < dispatches; ++d)
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < 4; ++t)
+            threads.emplace_back([&, t]() { for (uint32_t g = t; g < 16; g += 4) sink.fetch_add(g); });
+        for (std::thread& th : threads) th.join();
+    }
+    double t2 = NowMs();
+    std::printf("empty dispatch, 4 threads: pool %.1f us, thread per call %.1f us\n",
+        (t1 - t0) * 1e3 / dispatches, (t2 - t1) * 1e3 / dispatches);
+}
+
+int main()
+{
+    TestGroupScan();
+    TestCompaction(0, 8, 0.5f, 1);
+    TestCompaction(1, 8, 0.0f, 2);
+    TestCompaction(63, 8, 0.5f, 3);
+    TestCompaction(64, 1, 0.0f, 4);
+    TestCompaction(1000, 8, 1.0f, 5);
+    TestCompaction(10000, 8, 0.4f, 6);
+    TestCompaction(100000, COMPACTION_MAX_BUCKETS, 0.7f, 7);
+    TestPool();
+    return TestResult("StreamCompactionTest");
+}
@@ -0,0 +1,55 @@
+// Lab8_TestCommon
+// Общее для тестов Lab8: проверки без внешних фреймворков, таймер и камера как в Source.cpp
+// (XMMatrixLookAtLH / XMMatrixPerspectiveFovLH, векторы-строки).
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include "../CpuMath.h"
+
+static int g_TestFailures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++g_TestFailures; } } while (0)
+
+#define CHECK_NEAR(a, b, eps) \
+    do { double a_ = (a), b_ = (b); if (!(a_ - b_ <= (eps) && b_ - a_ <= (eps))) { \
+        std::printf("%s:%d: CHECK_NEAR(%s, %s): %g vs %g\n", __FILE__, __LINE__, #a, #b, a_, b_); ++g_TestFailures; } } while (0)
+
+inline int TestResult(const char* name)
+{
+    if (g_TestFailures) std::printf("%s: %d check(s) failed\n", name, g_TestFailures);
+    else std::printf("%s: OK\n", name);
+    return g_TestFailures ? 1 : 0;
+}
+
+inline double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline Float4x4 Mul(const Float4x4& a, const Float4x4& b)
+{
+    Float4x4 r = {};
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            for (int k = 0; k < 4; ++k)
+                r.m[i][j] += a.m[i][k] * b.m[k][j];
+    return r;
+}
+
+inline Float4x4 LookAtLH(const Float3& eye, const Float3& at, const Float3& up)
+{
+    Float3 z = Normalize(Sub(at, eye)), x = Normalize(Cross(up, z)), y = Cross(z, x);
+    Float4x4 m = { { { x.x, y.x, z.x, 0 }, { x.y, y.y, z.y, 0 }, { x.z, y.z, z.z, 0 },
+                     { -Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1 } } };
+    return m;
+}
+
+inline Float4x4 PerspectiveFovLH(float fovY, float aspect, float nearZ, float farZ)
+{
+    float h = 1.0f / tanf(fovY * 0.5f), w = h / aspect;
+    Float4x4 m = { { { w, 0, 0, 0 }, { 0, h, 0, 0 }, { 0, 0, farZ / (farZ - nearZ), 1 },
+                     { 0, 0, -nearZ * farZ / (farZ - nearZ), 0 } } };
+    return m;
+}
@@ -0,0 +1,143 @@
+// Lab8_WorkerPool
+// Общий пул рабочих потоков: работа раздаётся группами через DispatchGroups, потоки живут
+// между вызовами. Отдельно от компактизации - пул нужен всем многопоточным частям кадра.
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// ------------------------------------------------------------------
+// Постоянные рабочие потоки для DispatchGroups. Создаются при первом диспатче (и добавляются,
+// если потоков попросили больше) и спят на условной переменной до следующего: DispatchGroups
+// зовут по нескольку раз за кадр, создание потоков на вызов стоило бы
+// больше самой работы. Вызывающий поток работает наравне с пулом.
+// ------------------------------------------------------------------
+class GroupWorkerPool
+{
+public:
+    typedef void (*GroupFn)(void* context, uint32_t group);
+
+    static GroupWorkerPool& Instance()
+    {
+        static GroupWorkerPool pool;
+        return pool;
+    }
+
+    ~GroupWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) t.join();
+    }
+
+    uint32_t WorkerCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (uint32_t)workers.size();
+    }
+
+    // Слот t выполняет группы t, t + threadCount, ... false - пул занят другим диспатчем
+    // (вложенный вызов из fn или параллельный из другого потока), выполнять на вызывающем потоке
+    bool Run(uint32_t groupCount, uint32_t threadCount, GroupFn fn, void* context)
+    {
+        if (InSlot()) return false;       // try_lock на своём же мьютексе - неопределённое поведение
+        std::unique_lock<std::mutex> dispatch(dispatchMutex, std::try_to_lock);
+        if (!dispatch.owns_lock()) return false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        // Опоздавший поток мог взять прошлое задание: ждём, пока он увидит исчерпанные слоты
+        changed.wait(lock, [&]() { return active == 0; });
+        uint64_t current = generation;
+        while (workers.size() + 1 < threadCount) workers.emplace_back([this, current]() { WorkerLoop(current); });
+        Job j;
+        j.groupCount = groupCount;
+        j.threadCount = threadCount;
+        j.fn = fn;
+        j.context = context;
+        job = j;
+        nextSlot.store(0);
+        finishedSlots.store(0);
+        ++generation;
+        lock.unlock();
+        wake.notify_all();
+
+        RunSlots(j);
+        lock.lock();
+        changed.wait(lock, [&]() { return finishedSlots.load() == threadCount; });
+        return true;
+    }
+
+private:
+    struct Job { uint32_t groupCount = 0, threadCount = 0; GroupFn fn = nullptr; void* context = nullptr; };
+
+    std::mutex dispatchMutex;               // один диспатч за раз
+    std::mutex mutex;
+    std::condition_variable wake, changed;
+    std::vector<std::thread> workers;
+    Job job;
+    uint64_t generation = 0;
+    uint32_t active = 0;                    // потоков, взявших текущее задание
+    bool stop = false;
+    std::atomic<uint32_t> nextSlot{ 0 }, finishedSlots{ 0 };
+
+    // Поток выполняет группы диспатча: вложенный DispatchGroups из fn идёт на вызывающем потоке
+    static bool& InSlot()
+    {
+        static thread_local bool inSlot = false;
+        return inSlot;
+    }
+
+    void RunSlots(const Job& j)
+    {
+        InSlot() = true;
+        for (uint32_t slot = nextSlot.fetch_add(1); slot < j.threadCount; slot = nextSlot.fetch_add(1))
+        {
+            for (uint32_t g = slot; g < j.groupCount; g += j.threadCount) j.fn(j.context, g);
+            if (finishedSlots.fetch_add(1) + 1 == j.threadCount)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                changed.notify_all();
+            }
+        }
+        InSlot() = false;
+    }
+
+    void WorkerLoop(uint64_t seen)
+    {
+        for (;;)
+        {
+            Job j;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+                j = job;
+                ++active;
+            }
+            RunSlots(j);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) changed.notify_all();
+        }
+    }
+};
+
+// Запуск fn(group) для всех групп на threadCount потоках (поток t берёт группы t, t + threadCount, ...)
+template <typename Fn>
+inline void DispatchGroups(uint32_t groupCount, uint32_t threadCount, Fn fn)
+{
+    threadCount = (std::max)(1u, (std::min)(threadCount, groupCount));
+    if (threadCount > 1)
+    {
+        struct Call { static void Group(void* context, uint32_t g) { (*static_cast<Fn*>(context))(g); } };
+        if (GroupWorkerPool::Instance().Run(groupCount, threadCount, &Call::Group, &fn)) return;
+    }
+    for (uint32_t g = 0; g < groupCount; ++g) fn(g);
+}